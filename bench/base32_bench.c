@@ -0,0 +1,52 @@
+#include "bench.h"
+#include "util/base32.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void run_size(size_t size, uint64_t ops) {
+  uint64_t seed = 3;
+  uint8_t *input = malloc(size);
+  for (size_t i = 0; i < size; i++) {
+    input[i] = (uint8_t)bench_rand(&seed);
+  }
+  BenchRun r;
+
+  bench_begin(&r, "encode", 16);
+  bench_param(&r, "bytes", (long long)size);
+  bench_resume(&r);
+  for (uint64_t i = 0; i < ops; i++) {
+    char *encoded = base32_encode(input, size);
+    bench_use(encoded);
+    free(encoded);
+    bench_tick(&r);
+  }
+  bench_pause(&r);
+  bench_end(&r);
+
+  char *encoded = base32_encode(input, size);
+  bench_begin(&r, "decode", 16);
+  bench_param(&r, "bytes", (long long)size);
+  bench_resume(&r);
+  for (uint64_t i = 0; i < ops; i++) {
+    size_t len;
+    uint8_t *decoded = base32_decode(encoded, &len);
+    bench_use(decoded);
+    free(decoded);
+    bench_tick(&r);
+  }
+  bench_pause(&r);
+  bench_end(&r);
+
+  free(encoded);
+  free(input);
+}
+
+int main(int argc, char **argv) {
+  bench_init(argc, argv, "base32");
+  /* about the same number of bytes per size */
+  uint64_t bytes = bench_ops(256 << 20, 4 << 20);
+  for (size_t size = 16; size <= 4096; size *= 16) {
+    run_size(size, bytes / size);
+  }
+  return bench_finish();
+}
@@ -0,0 +1,118 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *g_suite = NULL;
+static bool g_quick = false;
+static int g_results = 0;
+
+void bench_init(int argc, char **argv, const char *suite) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      g_quick = true;
+    } else {
+      fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+      exit(1);
+    }
+  }
+  g_suite = suite;
+  printf("{\"suite\": \"%s\", \"quick\": %s, \"results\": [", suite,
+         g_quick ? "true" : "false");
+}
+
+bool bench_quick(void) { return g_quick; }
+
+uint64_t bench_ops(uint64_t full, uint64_t quick) {
+  return g_quick ? quick : full;
+}
+
+int bench_finish(void) {
+  printf("\n]}\n");
+  fflush(stdout);
+  return 0;
+}
+
+uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void bench_begin(BenchRun *r, const char *name, uint64_t batch) {
+  memset(r, 0, sizeof(*r));
+  r->name = name;
+  r->batch = batch ? batch : 1;
+  r->latency = malloc(sizeof(Histogram));
+  if (!r->latency) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  histogram_init(r->latency);
+}
+
+void bench_param(BenchRun *r, const char *key, long long value) {
+  if (r->nparams < BENCH_MAX_PARAMS) {
+    r->params[r->nparams].key = key;
+    r->params[r->nparams].value = value;
+    r->nparams++;
+  }
+}
+
+void bench_resume(BenchRun *r) {
+  r->pending = 0;
+  r->section_ns = bench_now_ns();
+  r->last_ns = r->section_ns;
+}
+
+void bench_sample(BenchRun *r) {
+  uint64_t now = bench_now_ns();
+  if (r->pending > 0) {
+    histogram_record_n(r->latency, (now - r->last_ns) / r->pending,
+                       r->pending);
+    r->ops += r->pending;
+    r->pending = 0;
+  }
+  r->last_ns = now;
+}
+
+void bench_pause(BenchRun *r) {
+  bench_sample(r);
+  r->elapsed_ns += r->last_ns - r->section_ns;
+}
+
+void bench_end(BenchRun *r) {
+  const Histogram *h = r->latency;
+  double seconds = (double)r->elapsed_ns / 1e9;
+  double ops_per_sec = seconds > 0 ? (double)r->ops / seconds : 0;
+
+  printf("%s\n  {\"name\": \"%s\", \"params\": {", g_results ? "," : "",
+         r->name);
+  for (int i = 0; i < r->nparams; i++) {
+    printf("%s\"%s\": %lld", i ? ", " : "", r->params[i].key,
+           r->params[i].value);
+  }
+  printf("}, \"ops\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+         "\"latency_ns\": {\"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, "
+         "\"p99\": %llu, \"p999\": %llu, \"max\": %llu}}",
+         (unsigned long long)r->ops, seconds, ops_per_sec, histogram_mean(h),
+         (unsigned long long)histogram_percentile(h, 50),
+         (unsigned long long)histogram_percentile(h, 90),
+         (unsigned long long)histogram_percentile(h, 99),
+         (unsigned long long)histogram_percentile(h, 99.9),
+         (unsigned long long)(h->count ? h->max : 0));
+  fflush(stdout);
+  g_results++;
+
+  fprintf(stderr, "%s.%s", g_suite, r->name);
+  for (int i = 0; i < r->nparams; i++) {
+    fprintf(stderr, " %s=%lld", r->params[i].key, r->params[i].value);
+  }
+  fprintf(stderr, ": %.0f ops/sec, p50 %lluns, p99 %lluns\n", ops_per_sec,
+          (unsigned long long)histogram_percentile(h, 50),
+          (unsigned long long)histogram_percentile(h, 99));
+
+  free(r->latency);
+  r->latency = NULL;
+}
@@ -0,0 +1,89 @@
+#ifndef REDIS_C_BENCH_H__
+#define REDIS_C_BENCH_H__
+
+#include "util/histogram.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Micro-benchmark harness. A suite calls bench_init(), then for every case:
+ *
+ *   BenchRun r;
+ *   bench_begin(&r, "insert", 1);
+ *   bench_param(&r, "size", n);
+ *   bench_resume(&r);
+ *   for (...) { op(); bench_tick(&r); }
+ *   bench_pause(&r);
+ *   bench_end(&r);
+ *
+ * and returns bench_finish() from main. Setup between bench_pause() and
+ * bench_resume() is not timed. The clock is read once per `batch` ticks and
+ * every op of a batch is recorded at the batch average, so ops far shorter
+ * than a clock read can still be measured (at the cost of smoothing their
+ * latency tail).
+ *
+ * Results go to stdout as one JSON document per suite:
+ *
+ *   {"suite": "cms", "quick": false, "results": [{"name": "add",
+ *    "params": {"width": 2000, "depth": 5}, "ops": 1000000, "seconds": 0.03,
+ *    "ops_per_sec": 3.3e7, "latency_ns": {"mean": 30.1, "p50": 30, ...}}]}
+ *
+ * and a one line summary of each case to stderr. `--quick` runs smaller
+ * cases, for a smoke test.
+ */
+#define BENCH_MAX_PARAMS 4
+
+typedef struct {
+  const char *name;
+  struct {
+    const char *key;
+    long long value;
+  } params[BENCH_MAX_PARAMS];
+  int nparams;
+  uint64_t batch;
+  uint64_t pending; /* ticks since the clock was last read */
+  uint64_t ops;
+  uint64_t elapsed_ns;
+  uint64_t section_ns; /* when the current bench_resume() started */
+  uint64_t last_ns;
+  Histogram *latency; /* ns per op */
+} BenchRun;
+
+void bench_init(int argc, char **argv, const char *suite);
+/* Whether `--quick` was given. */
+bool bench_quick(void);
+/* Ops per timed case: `full`, or `quick` with --quick. */
+uint64_t bench_ops(uint64_t full, uint64_t quick);
+int bench_finish(void);
+
+uint64_t bench_now_ns(void);
+void bench_begin(BenchRun *r, const char *name, uint64_t batch);
+void bench_param(BenchRun *r, const char *key, long long value);
+void bench_resume(BenchRun *r);
+void bench_sample(BenchRun *r);
+void bench_pause(BenchRun *r);
+void bench_end(BenchRun *r);
+
+/* Count one op; inline so the timed loop stays tight. */
+static inline void bench_tick(BenchRun *r) {
+  if (++r->pending == r->batch) {
+    bench_sample(r);
+  }
+}
+
+/* Keep the compiler from discarding a result that is otherwise unused. */
+static inline void bench_use(const void *p) {
+  __asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+/* xorshift64*: deterministic inputs, the same on every run */
+static inline uint64_t bench_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include "bench.h"
+#include "data_structure/count_min_sketch.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Ops cycle through this many distinct items */
+#define ITEMS 65536
+
+static char g_items[ITEMS][24];
+static size_t g_item_len[ITEMS];
+
+static void run_case(int layout, unsigned width, unsigned depth, uint64_t ops) {
+  CountMinSketch cms;
+  int rc = layout == CMS_LAYOUT_BLOCKED ? cms_init_blocked(&cms, width, depth)
+                                        : cms_init_by_dim(&cms, width, depth);
+  if (rc != CMS_SUCCESS) {
+    fprintf(stderr, "cannot create a %ux%u sketch\n", width, depth);
+    exit(1);
+  }
+
+  BenchRun r;
+  bench_begin(&r, layout == CMS_LAYOUT_BLOCKED ? "add_blocked" : "add", 64);
+  bench_param(&r, "width", width);
+  bench_param(&r, "depth", depth);
+  bench_resume(&r);
+  for (uint64_t i = 0; i < ops; i++) {
+    size_t k = i & (ITEMS - 1);
+    cms_add_inc_len(&cms, g_items[k], g_item_len[k], 1);
+    bench_tick(&r);
+  }
+  bench_pause(&r);
+  bench_end(&r);
+
+  int64_t sum = 0;
+  bench_begin(&r, layout == CMS_LAYOUT_BLOCKED ? "query_blocked" : "query",
+              64);
+  bench_param(&r, "width", width);
+  bench_param(&r, "depth", depth);
+  bench_resume(&r);
+  for (uint64_t i = 0; i < ops; i++) {
+    size_t k = i & (ITEMS - 1);
+    sum += cms_check_len(&cms, g_items[k], g_item_len[k]);
+    bench_tick(&r);
+  }
+  bench_pause(&r);
+  bench_end(&r);
+  bench_use(&sum);
+
+  cms_destroy(&cms);
+}
+
+int main(int argc, char **argv) {
+  bench_init(argc, argv, "cms");
+  uint64_t seed = 42;
+  for (size_t i = 0; i < ITEMS; i++) {
+    g_item_len[i] = (size_t)snprintf(g_items[i], sizeof(g_items[i]),
+                                     "item:%llu",
+                                     (unsigned long long)bench_rand(&seed));
+  }
+
+  static const unsigned widths[] = {1000, 10000, 100000, 1000000};
+  static const unsigned depths[] = {2, 4, 8};
+  uint64_t ops = bench_ops(2000000, 100000);
+  for (int layout = CMS_LAYOUT_FLAT; layout <= CMS_LAYOUT_BLOCKED; layout++) {
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+      for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+        if (bench_quick() && (w % 2 != 0 || depths[d] != 4)) {
+          continue;
+        }
+        if (layout == CMS_LAYOUT_BLOCKED && depths[d] > CMS_BLOCK_MAX_DEPTH) {
+          continue;
+        }
+        run_case(layout, widths[w], depths[d], ops);
+      }
+    }
+  }
+  return bench_finish();
+}
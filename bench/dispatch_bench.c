@@ -0,0 +1,201 @@
+#include "bench.h"
+#include "cmd_handler.h"
+#include "redis-C/config.h"
+#include "serialize.h"
+#include "storage.h"
+#include "util/monotonic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The request path without the network: RESP parsing, command lookup and
+ * execution against the keyspace, and reply encoding, as the event loop runs
+ * them for a pipeline already sitting in the query buffer.
+ */
+
+/* Requests per pipeline; the buffer is re-parsed from a pristine copy */
+#define PIPELINE 4096
+/* Keys (or members, items...) the requests of a case cycle through */
+#define KEYS 10000
+#define MAX_ARGS 16
+#define MAX_TEMPLATES 4
+
+typedef struct {
+  const char *name;
+  const char *setup;                /* run once, untimed */
+  const char *prefill;              /* run for every key, untimed */
+  const char *requests[MAX_TEMPLATES]; /* request i uses template i % n */
+  unsigned cost; /* slow cases run 1/cost of the ops (at least a pipeline) */
+} Case;
+
+/* `{}` in a template is replaced by the key number */
+static const Case g_cases[] = {
+    {"ping", NULL, NULL, {"PING"}, 1},
+    {"set", NULL, NULL, {"SET key:{} value-0123456789"}, 1},
+    {"get", NULL, "SET key:{} value-0123456789", {"GET key:{}"}, 1},
+    {"incr", NULL, NULL, {"INCR counter:{}"}, 1},
+    {"cms_incrby", "CMS.INITBYDIM sketch 2000 5", NULL,
+     {"CMS.INCRBY sketch item:{} 1"}, 1},
+    {"cms_query", "CMS.INITBYDIM sketch 2000 5", "CMS.INCRBY sketch item:{} 1",
+     {"CMS.QUERY sketch item:{}"}, 1},
+    {"zadd", NULL, NULL, {"ZADD zset {} member:{}"}, 1},
+    {"zscore", NULL, "ZADD zset {} member:{}", {"ZSCORE zset member:{}"}, 1},
+    {"pfadd", NULL, NULL, {"PFADD hll element:{}"}, 1},
+    {"bf_add", "BF.RESERVE bf 0.01 100000", NULL, {"BF.ADD bf item:{}"}, 1},
+    {"geoadd", NULL, NULL, {"GEOADD geo 13.{} 52.{} place:{}"}, 1},
+    {"geosearch", NULL, "GEOADD geo 13.{} 52.{} place:{}",
+     {"GEOSEARCH geo FROMLONLAT 13.5 52.5 BYRADIUS 1 km ASC COUNT 10"},
+     100},
+    {"mix", "CMS.INITBYDIM sketch 2000 5", "SET key:{} value-0123456789",
+     {"GET key:{}", "SET key:{} value-0123456789",
+      "CMS.INCRBY sketch item:{} 1", "ZADD zset {} member:{}"},
+     1},
+};
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+} Buffer;
+
+static void append(Buffer *b, const char *s, size_t len) {
+  if (b->len + len > b->cap) {
+    b->cap = (b->len + len) * 2;
+    b->data = realloc(b->data, b->cap);
+    if (!b->data) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+  }
+  memcpy(b->data + b->len, s, len);
+  b->len += len;
+}
+
+/* Append `tmpl` for key `key` as a RESP multibulk request. */
+static void append_request(Buffer *b, const char *tmpl, unsigned key) {
+  char args[MAX_ARGS][64];
+  int argc = 0;
+  const char *p = tmpl;
+  while (*p && argc < MAX_ARGS) {
+    size_t n = 0;
+    for (; *p && *p != ' '; p++) {
+      if (p[0] == '{' && p[1] == '}') {
+        n += (size_t)snprintf(args[argc] + n, sizeof(args[argc]) - n, "%u",
+                              key);
+        p++;
+      } else if (n + 1 < sizeof(args[argc])) {
+        args[argc][n++] = *p;
+      }
+    }
+    args[argc][n] = '\0';
+    argc++;
+    while (*p == ' ') {
+      p++;
+    }
+  }
+  char header[32];
+  append(b, header, (size_t)snprintf(header, sizeof(header), "*%d\r\n", argc));
+  for (int i = 0; i < argc; i++) {
+    size_t len = strlen(args[i]);
+    append(b, header,
+           (size_t)snprintf(header, sizeof(header), "$%zu\r\n", len));
+    append(b, args[i], len);
+    append(b, "\r\n", 2);
+  }
+}
+
+/* Parse and run every request in buf[0..len); returns how many ran. */
+static size_t run_pipeline(RespParser *p, ReplyBuffer *reply, char *buf,
+                           size_t len, BenchRun *r) {
+  size_t pos = 0;
+  size_t ran = 0;
+  while (pos < len) {
+    if (resp_parse(p, buf + pos, len - pos) != RESP_OK) {
+      fprintf(stderr, "bad request at offset %zu\n", pos);
+      exit(1);
+    }
+    dispatch_command(p->argc, p->argv, p->arg_len, reply);
+    reply_clear(reply);
+    pos += p->pos;
+    resp_parser_reset(p);
+    ran++;
+    if (r) {
+      bench_tick(r);
+    }
+  }
+  return ran;
+}
+
+static void run_case(const Case *c, uint64_t ops) {
+  RespParser p;
+  ReplyBuffer reply;
+  resp_parser_init(&p);
+  reply_init(&reply, 2);
+  storage_clear();
+
+  Buffer setup = {0};
+  if (c->setup) {
+    append_request(&setup, c->setup, 0);
+  }
+  for (unsigned k = 0; c->prefill && k < KEYS; k++) {
+    append_request(&setup, c->prefill, k);
+  }
+  run_pipeline(&p, &reply, setup.data, setup.len, NULL);
+
+  int ntemplates = 0;
+  while (ntemplates < MAX_TEMPLATES && c->requests[ntemplates]) {
+    ntemplates++;
+  }
+  Buffer pristine = {0};
+  uint64_t seed = 5;
+  for (int i = 0; i < PIPELINE; i++) {
+    append_request(&pristine, c->requests[i % ntemplates],
+                   (unsigned)(bench_rand(&seed) % KEYS));
+  }
+  char *work = malloc(pristine.len);
+
+  BenchRun r;
+  bench_begin(&r, c->name, 16);
+  bench_param(&r, "keys", KEYS);
+  bench_param(&r, "pipeline", PIPELINE);
+  if (c->cost > 1) {
+    ops /= c->cost;
+  }
+  for (uint64_t done = 0; done < ops; done += PIPELINE) {
+    /* parsing NUL-terminates the arguments in place */
+    memcpy(work, pristine.data, pristine.len);
+    bench_resume(&r);
+    run_pipeline(&p, &reply, work, pristine.len, &r);
+    bench_pause(&r);
+  }
+  bench_end(&r);
+
+  free(work);
+  free(pristine.data);
+  free(setup.data);
+  reply_free(&reply);
+  resp_parser_free(&p);
+}
+
+int main(int argc, char **argv) {
+  bench_init(argc, argv, "dispatch");
+  RedisCConfig *cfg = create_config(0);
+  cfg->save_params_len = 0;
+  set_config(cfg);
+  /* commands are timed with the clock the server uses */
+  monotonic_init();
+  command_table_init();
+  if (REDIS_FAILED(init_storage())) {
+    fprintf(stderr, "cannot create the keyspace\n");
+    return 1;
+  }
+
+  uint64_t ops = bench_ops(2000000, 50000);
+  for (size_t i = 0; i < sizeof(g_cases) / sizeof(g_cases[0]); i++) {
+    run_case(&g_cases[i], ops);
+  }
+  release_storage();
+  free(cfg);
+  return bench_finish();
+}
@@ -0,0 +1,119 @@
+#include "bench.h"
+#include "data_structure/geo_hash.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Ops cycle through this many random points */
+#define POINTS 4096
+
+static GeoPoint g_points[POINTS];
+static char g_hashes[POINTS][GEOHASH_MAX_PRECISION + 1];
+static GeoHashBits g_bits[POINTS];
+
+static double uniform(uint64_t *seed, double lo, double hi) {
+  return lo + (hi - lo) * (double)(bench_rand(seed) >> 11) / (double)(1ULL << 53);
+}
+
+static void bench_string(size_t precision, uint64_t ops) {
+  char buf[GEOHASH_MAX_PRECISION + 1];
+  GeoBounds bounds;
+  BenchRun r;
+
+  bench_begin(&r, "encode", 64);
+  bench_param(&r, "precision", (long long)precision);
+  bench_resume(&r);
+  for (uint64_t i = 0; i < ops; i++) {
+    geohash_encode_into(&g_points[i & (POINTS - 1)], precision, buf);
+    bench_use(buf);
+    bench_tick(&r);
+  }
+  bench_pause(&r);
+  bench_end(&r);
+
+  for (size_t i = 0; i < POINTS; i++) {
+    geohash_encode_into(&g_points[i], precision, g_hashes[i]);
+  }
+  bench_begin(&r, "decode", 64);
+  bench_param(&r, "precision", (long long)precision);
+  bench_resume(&r);
+  for (uint64_t i = 0; i < ops; i++) {
+    geohash_bounds_of(g_hashes[i & (POINTS - 1)], precision, &bounds);
+    bench_use(&bounds);
+    bench_tick(&r);
+  }
+  bench_pause(&r);
+  bench_end(&r);
+
+  bench_begin(&r, "adjacent", 64);
+  bench_param(&r, "precision", (long long)precision);
+  bench_resume(&r);
+  for (uint64_t i = 0; i < ops; i++) {
+    geohash_adjacent_into(g_hashes[i & (POINTS - 1)], precision,
+                          (GeoDirection)(i & 3), buf);
+    bench_use(buf);
+    bench_tick(&r);
+  }
+  bench_pause(&r);
+  bench_end(&r);
+}
+
+/* The 52-bit integer form the GEO commands store as sorted-set scores */
+static void bench_int(uint64_t ops) {
+  GeoHashBits bits;
+  GeoPoint point;
+  BenchRun r;
+
+  bench_begin(&r, "int_encode", 64);
+  bench_param(&r, "step", GEOHASH_INT_MAX_STEP);
+  bench_resume(&r);
+  for (uint64_t i = 0; i < ops; i++) {
+    geohash_int_encode(&g_points[i & (POINTS - 1)], GEOHASH_INT_MAX_STEP,
+                       &bits);
+    bench_use(&bits);
+    bench_tick(&r);
+  }
+  bench_pause(&r);
+  bench_end(&r);
+
+  for (size_t i = 0; i < POINTS; i++) {
+    geohash_int_encode(&g_points[i], GEOHASH_INT_MAX_STEP, &g_bits[i]);
+  }
+  bench_begin(&r, "int_decode", 64);
+  bench_param(&r, "step", GEOHASH_INT_MAX_STEP);
+  bench_resume(&r);
+  for (uint64_t i = 0; i < ops; i++) {
+    geohash_int_decode(g_bits[i & (POINTS - 1)], &point);
+    bench_use(&point);
+    bench_tick(&r);
+  }
+  bench_pause(&r);
+  bench_end(&r);
+
+  bench_begin(&r, "int_adjacent", 64);
+  bench_param(&r, "step", GEOHASH_INT_MAX_STEP);
+  bench_resume(&r);
+  for (uint64_t i = 0; i < ops; i++) {
+    /* the 8 neighbours in turn */
+    int dx = (int)(i % 3) - 1;
+    int dy = (int)(i / 3 % 3) - 1;
+    geohash_int_move(g_bits[i & (POINTS - 1)], dx, dy, &bits);
+    bench_use(&bits);
+    bench_tick(&r);
+  }
+  bench_pause(&r);
+  bench_end(&r);
+}
+
+int main(int argc, char **argv) {
+  bench_init(argc, argv, "geo_hash");
+  uint64_t seed = 11;
+  for (size_t i = 0; i < POINTS; i++) {
+    g_points[i] = geopoint_create(uniform(&seed, -85, 85),
+                                  uniform(&seed, -180, 180));
+  }
+  uint64_t ops = bench_ops(5000000, 100000);
+  bench_string(GEOHASH_DEFAULT_PRECISION, ops);
+  bench_string(GEOHASH_MAX_PRECISION, ops);
+  bench_int(ops);
+  return bench_finish();
+}
@@ -0,0 +1,92 @@
+#include "bench.h"
+#include "data_structure/skip_list.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Small lists are rebuilt until each phase has run at least this many ops */
+#define MIN_OPS 1000000
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* Fisher-Yates with a fixed seed, so every run sees the same order */
+static void shuffle(uint64_t **v, size_t n, uint64_t *seed) {
+  for (size_t i = n - 1; i > 0; i--) {
+    size_t j = bench_rand(seed) % (i + 1);
+    uint64_t *t = v[i];
+    v[i] = v[j];
+    v[j] = t;
+  }
+}
+
+static void run_size(size_t n) {
+  uint64_t seed = 7;
+  uint64_t *values = malloc(n * sizeof(uint64_t));
+  uint64_t **order = malloc(n * sizeof(uint64_t *));
+  if (!values || !order) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  for (size_t i = 0; i < n; i++) {
+    values[i] = bench_rand(&seed);
+    order[i] = &values[i];
+  }
+  /* big lists are timed per op, small ones in batches of 16 */
+  size_t rounds = n >= MIN_OPS ? 1 : MIN_OPS / n;
+  uint64_t batch = n >= 1000000 ? 1 : 16;
+
+  BenchRun insert, search, erase;
+  bench_begin(&insert, "insert", batch);
+  bench_param(&insert, "size", (long long)n);
+  bench_begin(&search, "search", batch);
+  bench_param(&search, "size", (long long)n);
+  bench_begin(&erase, "erase", batch);
+  bench_param(&erase, "size", (long long)n);
+
+  size_t found = 0;
+  for (size_t round = 0; round < rounds; round++) {
+    SkipList *list = skiplist_create(compare_u64, NULL, NULL);
+    shuffle(order, n, &seed);
+    bench_resume(&insert);
+    for (size_t i = 0; i < n; i++) {
+      skiplist_insert(list, order[i]);
+      bench_tick(&insert);
+    }
+    bench_pause(&insert);
+
+    shuffle(order, n, &seed);
+    bench_resume(&search);
+    for (size_t i = 0; i < n; i++) {
+      found += skiplist_contain(list, order[i]);
+      bench_tick(&search);
+    }
+    bench_pause(&search);
+
+    shuffle(order, n, &seed);
+    bench_resume(&erase);
+    for (size_t i = 0; i < n; i++) {
+      skiplist_erase(list, order[i]);
+      bench_tick(&erase);
+    }
+    bench_pause(&erase);
+    skiplist_destroy(list);
+  }
+  bench_use(&found);
+  bench_end(&insert);
+  bench_end(&search);
+  bench_end(&erase);
+  free(order);
+  free(values);
+}
+
+int main(int argc, char **argv) {
+  bench_init(argc, argv, "skip_list");
+  size_t max = bench_quick() ? 100000 : 10000000;
+  for (size_t n = 1000; n <= max; n *= 10) {
+    run_size(n);
+  }
+  return bench_finish();
+}
@@ -2,12 +2,73 @@
 #define REDIS_C_CONFIG_H__
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #define REDIS_C_DEFAULT_PORT 8091
 #define REDIS_C_DEFAULT_HOST "localhost"
+#define REDIS_C_DEFAULT_IO_THREADS 1
+#define REDIS_C_DEFAULT_SHARDS 1
+#define REDIS_C_DEFAULT_MAXMEMORY 0 /* no limit */
+#define REDIS_C_DEFAULT_DBFILENAME "dump.rdb"
+#define REDIS_C_MAX_SAVE_PARAMS 16
+#define REDIS_C_DEFAULT_APPENDFILENAME "appendonly.aof"
+#define REDIS_C_DEFAULT_LOGLEVEL 6 /* syslog severity: INFO in logging.h */
+#define REDIS_C_DEFAULT_LATENCY_MONITOR_THRESHOLD 0 /* disabled */
+#define REDIS_C_DEFAULT_SLOWLOG_LOG_SLOWER_THAN 10000 /* 10ms */
+#define REDIS_C_DEFAULT_SLOWLOG_MAX_LEN 128
+#define REDIS_C_DEFAULT_CLUSTER_CONFIG_FILE "nodes.conf"
+#define REDIS_C_DEFAULT_CLUSTER_NODE_TIMEOUT 15000 /* ms */
+#define REDIS_C_DEFAULT_REPL_BACKLOG_SIZE (1024 * 1024)
+#define REDIS_C_DEFAULT_REPL_TIMEOUT 60 /* s */
+
+/* What to do when a command needs memory and maxmemory is reached */
+typedef enum {
+    MAXMEMORY_NOEVICTION = 0, /* refuse commands that may allocate */
+    MAXMEMORY_ALLKEYS_LRU,    /* evict the least recently used key */
+    MAXMEMORY_ALLKEYS_LFU,    /* evict the least frequently used key */
+    MAXMEMORY_VOLATILE_TTL    /* evict the key with a TTL closest to expiry */
+} MaxmemoryPolicy;
+
+/* When appended commands are fsynced to the append-only file */
+typedef enum {
+    APPENDFSYNC_NO = 0,   /* left to the kernel */
+    APPENDFSYNC_EVERYSEC, /* once a second, on a background thread */
+    APPENDFSYNC_ALWAYS    /* before replying to the commands */
+} AppendFsync;
+
+/* Snapshot in the background once `changes` writes are `seconds` old */
+typedef struct {
+    long long seconds;
+    long long changes;
+} SaveParam;
 
 typedef struct {
     int port;
+    int io_threads; /* threads doing socket I/O, the main thread included */
+    int shards;     /* event loops each owning a keyspace slice */
+    size_t maxmemory; /* bytes of keyspace memory, 0 for no limit */
+    MaxmemoryPolicy maxmemory_policy;
+    const char* dbfilename; /* snapshot loaded at startup and written by SAVE */
+    SaveParam save_params[REDIS_C_MAX_SAVE_PARAMS];
+    int save_params_len; /* 0 disables automatic snapshots */
+    bool appendonly; /* log writes to the AOF, which is loaded at startup */
+    const char* appendfilename;
+    AppendFsync appendfsync;
+    /* free large values in the background when the server drops them: */
+    bool lazyfree_lazy_eviction;   /* evicted by maxmemory */
+    bool lazyfree_lazy_expire;     /* expired */
+    bool lazyfree_lazy_server_del; /* overwritten */
+    int loglevel; /* most verbose syslog severity logged */
+    long long latency_monitor_threshold; /* ms; 0 disables the monitor */
+    long long slowlog_log_slower_than; /* us; negative disables the log */
+    long long slowlog_max_len; /* entries kept */
+    bool cluster_enabled; /* a node of a cluster rather than standalone */
+    const char* cluster_config_file; /* node table, written by the server */
+    long long cluster_node_timeout; /* ms without a pong before PFAIL */
+    const char* replicaof_host; /* replicate this primary; NULL for none */
+    int replicaof_port;
+    size_t repl_backlog_size; /* stream kept for replicas to resync from */
+    long long repl_timeout; /* s without traffic before a link is dropped */
 } RedisCConfig;
 
 RedisCConfig* create_config(int port); 
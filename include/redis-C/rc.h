@@ -6,6 +6,8 @@
 #define REDIS_RC                int
 
 #define REDIS_OK                0
+/* Success, the rest is up to the connection that sent the command */
+#define REDIS_CONN_COMMAND      1
 
 #define REDIS_FAILED_COMMON_BEGIN       -1
 #define REDIS_FAILED_COMMON_END         -100
@@ -13,19 +15,125 @@
 #define REDIS_FAILED_CMS_BEGIN          -101
 #define REDIS_FAILED_CMS_END            -150
 
+#define REDIS_FAILED_ZSET_BEGIN         -151
+#define REDIS_FAILED_ZSET_END           -200
+
+#define REDIS_FAILED_GEO_BEGIN          -201
+#define REDIS_FAILED_GEO_END            -250
+
+#define REDIS_FAILED_BLOOM_BEGIN        -251
+#define REDIS_FAILED_BLOOM_END          -300
+
+#define REDIS_FAILED_CUCKOO_BEGIN       -301
+#define REDIS_FAILED_CUCKOO_END         -350
+
+#define REDIS_FAILED_TOPK_BEGIN         -351
+#define REDIS_FAILED_TOPK_END           -400
+
+#define REDIS_FAILED_CLUSTER_BEGIN      -401
+#define REDIS_FAILED_CLUSTER_END        -450
+
+#define REDIS_FAILED_REPL_BEGIN         -451
+#define REDIS_FAILED_REPL_END           -500
+
 #define REDIS_ERROR_UNKNOWN             -999
 
 #define REDIS_SUCCESS(rc)                               (rc >= REDIS_OK)
-#define REDIS_FAILED(rc)                                (rc < REDIS_FAILED_BEGIN)
+#define REDIS_FAILED(rc)                                (rc < REDIS_OK)
 
-#define REDIS_CMD_NULL                                  REDIS_FAILED_COMMON_BEGIN 
+#define REDIS_CMD_NULL                                  REDIS_FAILED_COMMON_BEGIN
 #define REDIS_CMD_CONNECTION_FAILED                     REDIS_FAILED_COMMON_BEGIN - 1
 #define REDIS_SUB_CMD_NOT_FOUND                         REDIS_FAILED_COMMON_BEGIN - 2
+#define REDIS_PROTOCOL_ERROR                            REDIS_FAILED_COMMON_BEGIN - 3
+#define REDIS_WRONG_NUMBER_OF_ARGS                      REDIS_FAILED_COMMON_BEGIN - 4
+#define REDIS_INVALID_ARGUMENT                          REDIS_FAILED_COMMON_BEGIN - 5
+#define REDIS_NOT_AN_INTEGER                            REDIS_FAILED_COMMON_BEGIN - 6
+#define REDIS_NOT_A_FLOAT                               REDIS_FAILED_COMMON_BEGIN - 7
+#define REDIS_OUT_OF_MEMORY                             REDIS_FAILED_COMMON_BEGIN - 8
+#define REDIS_UNSUPPORTED_PROTOCOL                      REDIS_FAILED_COMMON_BEGIN - 9
+#define REDIS_WRONG_TYPE                                REDIS_FAILED_COMMON_BEGIN - 10
+#define REDIS_KEY_EXISTS                                REDIS_FAILED_COMMON_BEGIN - 11
+#define REDIS_KEY_NOT_FOUND                             REDIS_FAILED_COMMON_BEGIN - 12
+#define REDIS_CROSS_SHARD                               REDIS_FAILED_COMMON_BEGIN - 13
+#define REDIS_OVERFLOW                                  REDIS_FAILED_COMMON_BEGIN - 14
+#define REDIS_INVALID_EXPIRE                            REDIS_FAILED_COMMON_BEGIN - 15
+#define REDIS_OOM                                       REDIS_FAILED_COMMON_BEGIN - 16
+#define REDIS_IO_ERROR                                  REDIS_FAILED_COMMON_BEGIN - 17
+#define REDIS_CORRUPT_SNAPSHOT                          REDIS_FAILED_COMMON_BEGIN - 18
+#define REDIS_NOT_SUPPORTED                             REDIS_FAILED_COMMON_BEGIN - 19
+#define REDIS_SAVE_IN_PROGRESS                          REDIS_FAILED_COMMON_BEGIN - 20
+#define REDIS_CORRUPT_AOF                               REDIS_FAILED_COMMON_BEGIN - 21
+#define REDIS_AOF_DISABLED                              REDIS_FAILED_COMMON_BEGIN - 22
+#define REDIS_REWRITE_IN_PROGRESS                       REDIS_FAILED_COMMON_BEGIN - 23
+#define REDIS_BUSYKEY                                   REDIS_FAILED_COMMON_BEGIN - 24
+#define REDIS_BAD_PAYLOAD                               REDIS_FAILED_COMMON_BEGIN - 25
+
+#define REDIS_CMS_SKETCH_EXISTED                        REDIS_FAILED_CMS_BEGIN
+#define REDIS_CMS_KEY_NOT_FOUND                         REDIS_FAILED_CMS_BEGIN - 1
+#define REDIS_CMS_DIM_MISMATCH                          REDIS_FAILED_CMS_BEGIN - 2
+#define REDIS_CMS_INVALID_WIDTH                         REDIS_FAILED_CMS_BEGIN - 3
+#define REDIS_CMS_INVALID_DEPTH                         REDIS_FAILED_CMS_BEGIN - 4
+#define REDIS_CMS_INVALID_ERROR_RATE                    REDIS_FAILED_CMS_BEGIN - 5
+#define REDIS_CMS_INVALID_PROB                          REDIS_FAILED_CMS_BEGIN - 6
+#define REDIS_CMS_INVALID_NUMBER                        REDIS_FAILED_CMS_BEGIN - 7
+#define REDIS_CMS_INVALID_NUMKEYS                       REDIS_FAILED_CMS_BEGIN - 8
+#define REDIS_CMS_LAYOUT_MISMATCH                       REDIS_FAILED_CMS_BEGIN - 9
+#define REDIS_CMS_INVALID_COUNTER_BITS                  REDIS_FAILED_CMS_BEGIN - 10
 
-#define REDIS_CMS_SKETCH_EXISTED                        REDIS_FAILED_CMS_BEGIN 
+#define REDIS_ZSET_INVALID_RANGE                        REDIS_FAILED_ZSET_BEGIN
+#define REDIS_ZSET_XX_AND_NX                            REDIS_FAILED_ZSET_BEGIN - 1
+#define REDIS_ZSET_GT_LT_NX                             REDIS_FAILED_ZSET_BEGIN - 2
+#define REDIS_ZSET_INCR_PAIR                            REDIS_FAILED_ZSET_BEGIN - 3
+#define REDIS_ZSET_NAN_SCORE                            REDIS_FAILED_ZSET_BEGIN - 4
+
+#define REDIS_GEO_INVALID_COORDS                        REDIS_FAILED_GEO_BEGIN
+#define REDIS_GEO_UNSUPPORTED_UNIT                      REDIS_FAILED_GEO_BEGIN - 1
+#define REDIS_GEO_MEMBER_NOT_FOUND                      REDIS_FAILED_GEO_BEGIN - 2
+#define REDIS_GEO_FROM_ONE_OF                           REDIS_FAILED_GEO_BEGIN - 3
+#define REDIS_GEO_BY_ONE_OF                             REDIS_FAILED_GEO_BEGIN - 4
+#define REDIS_GEO_ANY_WITHOUT_COUNT                     REDIS_FAILED_GEO_BEGIN - 5
+#define REDIS_GEO_INVALID_COUNT                         REDIS_FAILED_GEO_BEGIN - 6
+#define REDIS_GEO_INVALID_SHAPE                         REDIS_FAILED_GEO_BEGIN - 7
+
+#define REDIS_BF_KEY_EXISTS                             REDIS_FAILED_BLOOM_BEGIN
+#define REDIS_BF_KEY_NOT_FOUND                          REDIS_FAILED_BLOOM_BEGIN - 1
+#define REDIS_BF_INVALID_ERROR_RATE                     REDIS_FAILED_BLOOM_BEGIN - 2
+#define REDIS_BF_INVALID_CAPACITY                       REDIS_FAILED_BLOOM_BEGIN - 3
+#define REDIS_BF_INVALID_EXPANSION                      REDIS_FAILED_BLOOM_BEGIN - 4
+#define REDIS_BF_NONSCALING_EXPANSION                   REDIS_FAILED_BLOOM_BEGIN - 5
+#define REDIS_BF_FILTER_FULL                            REDIS_FAILED_BLOOM_BEGIN - 6
+
+#define REDIS_CF_KEY_EXISTS                             REDIS_FAILED_CUCKOO_BEGIN
+#define REDIS_CF_KEY_NOT_FOUND                          REDIS_FAILED_CUCKOO_BEGIN - 1
+#define REDIS_CF_INVALID_CAPACITY                       REDIS_FAILED_CUCKOO_BEGIN - 2
+#define REDIS_CF_INVALID_MAX_ITERATIONS                 REDIS_FAILED_CUCKOO_BEGIN - 3
+#define REDIS_CF_INVALID_EXPANSION                      REDIS_FAILED_CUCKOO_BEGIN - 4
+#define REDIS_CF_FILTER_FULL                            REDIS_FAILED_CUCKOO_BEGIN - 5
+
+#define REDIS_TOPK_KEY_EXISTS                           REDIS_FAILED_TOPK_BEGIN
+#define REDIS_TOPK_KEY_NOT_FOUND                        REDIS_FAILED_TOPK_BEGIN - 1
+#define REDIS_TOPK_INVALID_K                            REDIS_FAILED_TOPK_BEGIN - 2
+#define REDIS_TOPK_INVALID_WIDTH                        REDIS_FAILED_TOPK_BEGIN - 3
+#define REDIS_TOPK_INVALID_DEPTH                        REDIS_FAILED_TOPK_BEGIN - 4
+#define REDIS_TOPK_INVALID_INCREMENT                    REDIS_FAILED_TOPK_BEGIN - 5
+
+#define REDIS_CLUSTER_DISABLED                          REDIS_FAILED_CLUSTER_BEGIN
+#define REDIS_CLUSTER_INVALID_SLOT                      REDIS_FAILED_CLUSTER_BEGIN - 1
+#define REDIS_CLUSTER_SLOT_BUSY                         REDIS_FAILED_CLUSTER_BEGIN - 2
+#define REDIS_CLUSTER_SLOT_UNASSIGNED                   REDIS_FAILED_CLUSTER_BEGIN - 3
+#define REDIS_CLUSTER_UNKNOWN_NODE                      REDIS_FAILED_CLUSTER_BEGIN - 4
+#define REDIS_CLUSTER_NOT_OWNER                         REDIS_FAILED_CLUSTER_BEGIN - 5
+#define REDIS_CLUSTER_ALREADY_OWNER                     REDIS_FAILED_CLUSTER_BEGIN - 6
+#define REDIS_CLUSTER_SLOT_NOT_EMPTY                    REDIS_FAILED_CLUSTER_BEGIN - 7
+#define REDIS_CLUSTER_INVALID_ADDRESS                   REDIS_FAILED_CLUSTER_BEGIN - 8
+#define REDIS_CLUSTER_INVALID_DB                        REDIS_FAILED_CLUSTER_BEGIN - 9
+#define REDIS_CLUSTER_MIGRATE_IO                        REDIS_FAILED_CLUSTER_BEGIN - 10
+
+#define REDIS_REPL_READONLY                             REDIS_FAILED_REPL_BEGIN
+#define REDIS_REPL_IN_CLUSTER                           REDIS_FAILED_REPL_BEGIN - 1
+#define REDIS_REPL_INVALID_PORT                         REDIS_FAILED_REPL_BEGIN - 2
 
 
 
 // clang-format on
 #endif
-
@@ -0,0 +1,431 @@
+#include "aof.h"
+#include "bio.h"
+#include "cmd_handler.h"
+#include "logging.h"
+#include "rdb.h"
+#include "redis-C/config.h"
+#include "serialize.h"
+#include "storage.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define AOF_RDB_MAGIC "RCDB"
+/* The loader releases the pages it replayed every time it gets this far */
+#define AOF_LOAD_CHUNK (8 << 20)
+/* At most one write error is logged per interval */
+#define AOF_WRITE_ERROR_LOG_MS 1000
+
+#ifdef __linux__
+#define aof_fsync fdatasync
+#else
+#define aof_fsync fsync
+#endif
+
+/* Only an unsharded server logs, so this state is process-wide */
+static int g_fd = -1;
+static char g_path[PATH_MAX];
+static ReplyBuffer g_buf;           /* logged, not written yet */
+static bool g_unsynced = false;     /* written, not handed to fsync yet */
+static long long g_last_fsync_ms = 0;
+static long long g_last_error_ms = 0;
+static size_t g_size = 0;
+static size_t g_base_size = 0;      /* size after the last rewrite */
+static bool g_rewriting = false;
+static bool g_wait_rewrite = false; /* the first rewrite creates the file */
+static bool g_rewrite_scheduled = false;
+static long long g_rewrite_failed_ms = 0;
+static ReplyBuffer g_rewrite_buf;   /* logged since the rewrite forked */
+
+/* private functions */
+static void __append(ReplyBuffer *b, int argc, char **argv,
+                     const size_t *argv_len);
+static bool __write_all(int fd, const char *p, size_t n);
+static void __write_buffer(void);
+static void __fsync_job(void *arg);
+static void __close_job(void *arg);
+static bool __rewrite_path(char *buf, size_t size);
+static void __rewrite_done(bool ok);
+static REDIS_RC __replay(char *data, size_t size, int fd, size_t *commands);
+
+REDIS_RC aof_load(const char *path, size_t *commands) {
+  *commands = 0;
+  int fd = open(path, O_RDWR);
+  if (fd == -1) {
+    LOG_WARNING("Unable to open append only file %s", path);
+    return REDIS_IO_ERROR;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return REDIS_IO_ERROR;
+  }
+  size_t size = (size_t)st.st_size;
+  REDIS_RC rc = REDIS_OK;
+  if (size > 0) {
+    /* private and writable: the parser terminates arguments in place */
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      LOG_WARNING("Unable to map append only file %s", path);
+      close(fd);
+      return REDIS_IO_ERROR;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    storage_set_loading(true);
+    rc = __replay((char *)map, size, fd, commands);
+    storage_set_loading(false);
+    munmap(map, size);
+  }
+  close(fd);
+  if (REDIS_FAILED(rc)) {
+    storage_clear();
+    *commands = 0;
+    return rc;
+  }
+  rdb_reset_save_clock();
+  return REDIS_OK;
+}
+
+REDIS_RC aof_open(const char *path) {
+  if (snprintf(g_path, sizeof(g_path), "%s", path) >= (int)sizeof(g_path)) {
+    return REDIS_IO_ERROR;
+  }
+  int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1) {
+    LOG_WARNING("Unable to open append only file %s", path);
+    if (fd != -1) {
+      close(fd);
+    }
+    return REDIS_IO_ERROR;
+  }
+  g_fd = fd;
+  g_size = g_base_size = (size_t)st.st_size;
+  reply_init(&g_buf, RESP_PROTO_2);
+  reply_init(&g_rewrite_buf, RESP_PROTO_2);
+  return REDIS_OK;
+}
+
+REDIS_RC aof_open_with_rewrite(const char *path) {
+  if (snprintf(g_path, sizeof(g_path), "%s", path) >= (int)sizeof(g_path)) {
+    return REDIS_IO_ERROR;
+  }
+  reply_init(&g_buf, RESP_PROTO_2);
+  reply_init(&g_rewrite_buf, RESP_PROTO_2);
+  g_wait_rewrite = true;
+  g_size = g_base_size = 0;
+  bool scheduled;
+  REDIS_RC rc = aof_rewrite(&scheduled);
+  if (REDIS_FAILED(rc)) {
+    g_wait_rewrite = false;
+    reply_free(&g_buf);
+    reply_free(&g_rewrite_buf);
+  }
+  return rc;
+}
+
+void aof_close(void) {
+  if (g_wait_rewrite) {
+    /* the file was never created: the snapshot is still the dataset */
+    g_wait_rewrite = false;
+    reply_free(&g_buf);
+    reply_free(&g_rewrite_buf);
+    return;
+  }
+  if (g_fd == -1) {
+    return;
+  }
+  __write_buffer();
+  bio_drain(BIO_AOF);
+  if (aof_fsync(g_fd) == -1) {
+    LOG_WARNING("Unable to fsync the append only file");
+  }
+  close(g_fd);
+  g_fd = -1;
+  reply_free(&g_buf);
+  reply_free(&g_rewrite_buf);
+}
+
+bool aof_enabled(void) { return g_fd != -1 || g_wait_rewrite; }
+
+void aof_feed(int argc, char **argv, const size_t *argv_len) {
+  /* before the first rewrite only the commands after its fork are kept: the
+   * rewrite has the others */
+  if (g_fd != -1) {
+    __append(&g_buf, argc, argv, argv_len);
+  }
+  if (g_rewriting) {
+    __append(&g_rewrite_buf, argc, argv, argv_len);
+  }
+}
+
+void aof_flush(void) {
+  if (g_fd == -1) {
+    return;
+  }
+  if (g_buf.len > 0) {
+    __write_buffer();
+  }
+  if (!g_unsynced) {
+    return;
+  }
+  AppendFsync policy = get_current_config()->appendfsync;
+  long long now_ms = storage_mstime();
+  if (policy == APPENDFSYNC_ALWAYS) {
+    if (aof_fsync(g_fd) == -1) {
+      LOG_WARNING("Unable to fsync the append only file");
+    }
+  } else if (policy == APPENDFSYNC_EVERYSEC) {
+    /* a slow disk delays the next fsync rather than queueing them up */
+    if (now_ms - g_last_fsync_ms < AOF_FSYNC_INTERVAL_MS ||
+        bio_pending(BIO_AOF) > 0 ||
+        REDIS_FAILED(
+            bio_submit(BIO_AOF, __fsync_job, (void *)(intptr_t)g_fd))) {
+      return;
+    }
+  }
+  g_unsynced = false;
+  g_last_fsync_ms = now_ms;
+}
+
+REDIS_RC aof_rewrite(bool *scheduled) {
+  *scheduled = false;
+  if (!aof_enabled()) {
+    return REDIS_AOF_DISABLED;
+  }
+  if (g_rewriting) {
+    return REDIS_REWRITE_IN_PROGRESS;
+  }
+  if (rdb_bgsave_in_progress()) {
+    g_rewrite_scheduled = *scheduled = true;
+    return REDIS_OK;
+  }
+  char snap[PATH_MAX];
+  if (!__rewrite_path(snap, sizeof(snap))) {
+    return REDIS_IO_ERROR;
+  }
+  reply_clear(&g_rewrite_buf);
+  REDIS_RC rc = rdb_bgsave_with(snap, __rewrite_done);
+  if (REDIS_FAILED(rc)) {
+    g_rewrite_failed_ms = storage_mstime();
+    return rc;
+  }
+  g_rewriting = true;
+  g_rewrite_scheduled = false;
+  return REDIS_OK;
+}
+
+bool aof_rewrite_in_progress(void) { return g_rewriting; }
+
+void aof_cron(void) {
+  if (!aof_enabled() || rdb_bgsave_in_progress()) {
+    return;
+  }
+  bool scheduled;
+  if (g_rewrite_scheduled) {
+    aof_rewrite(&scheduled);
+    return;
+  }
+  if (g_wait_rewrite) {
+    if (!g_rewriting &&
+        storage_mstime() - g_rewrite_failed_ms >= AOF_REWRITE_RETRY_DELAY_MS) {
+      aof_rewrite(&scheduled);
+    }
+    return;
+  }
+  if (g_size < AOF_AUTO_REWRITE_MIN_SIZE ||
+      storage_mstime() - g_rewrite_failed_ms < AOF_REWRITE_RETRY_DELAY_MS) {
+    return;
+  }
+  size_t base = g_base_size > 0 ? g_base_size : 1;
+  size_t growth = (g_size - g_base_size) * 100 / base;
+  if (g_size > g_base_size && growth >= AOF_AUTO_REWRITE_PERCENT) {
+    LOG_INFO("Starting automatic rewriting of AOF on %zu%% growth", growth);
+    aof_rewrite(&scheduled);
+  }
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+/* Encode a command as a RESP array; dropped whole if memory runs out */
+static void __append(ReplyBuffer *b, int argc, char **argv,
+                     const size_t *argv_len) {
+  size_t start = b->len;
+  reply_add_array_len(b, argc);
+  for (int i = 0; i < argc; i++) {
+    reply_add_bulk(b, argv[i], argv_len[i]);
+  }
+  if (b->oom) {
+    b->len = start;
+    b->oom = false;
+    LOG_ERROR("Out of memory logging '%.*s' to the append only file",
+              (int)argv_len[0], argv[0]);
+  }
+}
+
+static bool __write_all(int fd, const char *p, size_t n) {
+  while (n > 0) {
+    ssize_t done = write(fd, p, n);
+    if (done == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += done;
+    n -= (size_t)done;
+  }
+  return true;
+}
+
+/* Write as much of the buffer as the file takes; the rest is retried later */
+static void __write_buffer(void) {
+  size_t done = 0;
+  while (done < g_buf.len) {
+    ssize_t n = write(g_fd, g_buf.buf + done, g_buf.len - done);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      long long now_ms = storage_mstime();
+      if (now_ms - g_last_error_ms >= AOF_WRITE_ERROR_LOG_MS) {
+        g_last_error_ms = now_ms;
+        LOG_WARNING("Error writing to the append only file, will retry");
+      }
+      break;
+    }
+    done += (size_t)n;
+  }
+  if (done > 0) {
+    memmove(g_buf.buf, g_buf.buf + done, g_buf.len - done);
+    g_buf.len -= done;
+    g_size += done;
+    g_unsynced = true;
+  }
+}
+
+static void __fsync_job(void *arg) {
+  if (aof_fsync((int)(intptr_t)arg) == -1) {
+    LOG_WARNING("Background fsync of the append only file failed");
+  }
+}
+
+/* The last close of a replaced file frees its blocks, which may take long */
+static void __close_job(void *arg) { close((int)(intptr_t)arg); }
+
+static bool __rewrite_path(char *buf, size_t size) {
+  return snprintf(buf, size, "%s.rewrite", g_path) < (int)size;
+}
+
+/*
+ * The child wrote the snapshot: append what was logged since the fork and
+ * swap the result in for the log.
+ */
+static void __rewrite_done(bool ok) {
+  g_rewriting = false;
+  char snap[PATH_MAX];
+  bool named = __rewrite_path(snap, sizeof(snap));
+  if (!ok || !named || !aof_enabled()) {
+    if (named) {
+      unlink(snap);
+    }
+    reply_clear(&g_rewrite_buf);
+    g_rewrite_failed_ms = storage_mstime();
+    LOG_WARNING("Background AOF rewrite failed");
+    return;
+  }
+  /* pending commands go to the old file: they are in g_rewrite_buf too */
+  if (g_fd != -1) {
+    __write_buffer();
+  }
+
+  int fd = open(snap, O_WRONLY | O_APPEND);
+  struct stat st;
+  bool written = fd != -1 &&
+                 __write_all(fd, g_rewrite_buf.buf, g_rewrite_buf.len) &&
+                 aof_fsync(fd) == 0 && fstat(fd, &st) == 0;
+  /* a large buffer is given back rather than kept for the next rewrite */
+  reply_free(&g_rewrite_buf);
+  reply_init(&g_rewrite_buf, RESP_PROTO_2);
+  if (!written || rename(snap, g_path) == -1) {
+    if (fd != -1) {
+      close(fd);
+    }
+    unlink(snap);
+    g_rewrite_failed_ms = storage_mstime();
+    LOG_WARNING("Unable to install the rewritten append only file");
+    return;
+  }
+  /* queued after any fsync of the old fd, which must not see it closed */
+  int old = g_fd;
+  g_fd = fd;
+  g_wait_rewrite = false;
+  g_size = g_base_size = (size_t)st.st_size;
+  g_unsynced = false;
+  if (old != -1 &&
+      REDIS_FAILED(bio_submit(BIO_AOF, __close_job, (void *)(intptr_t)old))) {
+    bio_drain(BIO_AOF);
+    close(old);
+  }
+  LOG_INFO("Background AOF rewrite finished, %zu bytes", g_size);
+}
+
+static REDIS_RC __replay(char *data, size_t size, int fd, size_t *commands) {
+  size_t pos = 0;
+  if (size >= 4 && memcmp(data, AOF_RDB_MAGIC, 4) == 0) {
+    size_t keys;
+    REDIS_RC rc = rdb_load_buffer(data, size, &pos, &keys, true);
+    if (REDIS_FAILED(rc)) {
+      return rc == REDIS_CORRUPT_SNAPSHOT ? REDIS_CORRUPT_AOF : rc;
+    }
+  }
+
+  RespParser p;
+  ReplyBuffer reply;
+  resp_parser_init(&p);
+  reply_init(&reply, RESP_PROTO_2);
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t released = 0;
+  REDIS_RC rc = REDIS_OK;
+  while (pos < size) {
+    RespStatus status = resp_parse(&p, data + pos, size - pos);
+    if (status == RESP_INCOMPLETE) {
+      LOG_WARNING("Append only file truncated at offset %zu of %zu, dropping "
+                  "the incomplete last command",
+                  pos, size);
+      if (ftruncate(fd, (off_t)pos) == -1) {
+        rc = REDIS_IO_ERROR;
+      }
+      break;
+    } else if (status == RESP_ERROR) {
+      LOG_WARNING("Bad command in append only file at offset %zu: %s", pos,
+                  p.error);
+      rc = REDIS_CORRUPT_AOF;
+      break;
+    }
+    if (p.argc > 0) {
+      dispatch_command(p.argc, p.argv, p.arg_len, &reply);
+      reply_clear(&reply);
+      (*commands)++;
+    }
+    pos += p.pos;
+    resp_parser_reset(&p);
+
+    /* replayed commands were copied into the keyspace */
+    if (pos - released >= AOF_LOAD_CHUNK) {
+      size_t upto = pos / page * page;
+      madvise(data + released, upto - released, MADV_DONTNEED);
+      released = upto;
+    }
+  }
+  resp_parser_free(&p);
+  reply_free(&reply);
+  return rc;
+}
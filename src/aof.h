@@ -0,0 +1,72 @@
+#ifndef REDIS_C_AOF_H__
+#define REDIS_C_AOF_H__
+
+#include "redis-C/rc.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Append-only file: every write command that succeeds is logged in RESP, and
+ * replayed at startup.
+ *
+ * Commands are buffered while an event-loop iteration executes them and the
+ * buffer is written with a single write() before any reply of that iteration
+ * is sent (group commit), so a pipeline of writes costs one system call and a
+ * client never sees a reply for a write that is not in the file. The fsync
+ * policy decides when the data reaches the disk: `always` fsyncs on the loop
+ * before replying, `everysec` hands an fsync to a background thread at most
+ * once a second (a crash loses about a second of writes, the loop never waits
+ * on the disk), `no` leaves it to the kernel.
+ *
+ * A rewrite compacts the log: a forked child writes the keyspace as a
+ * snapshot (the RDB format, which also keeps sketches and filters exact),
+ * commands executed meanwhile are kept aside, and once the child is done they
+ * are appended to its file, which then replaces the log. The file is thus an
+ * optional snapshot preamble followed by commands.
+ */
+
+#define AOF_FSYNC_INTERVAL_MS 1000
+/* Rewrite automatically once the file doubled since the last rewrite... */
+#define AOF_AUTO_REWRITE_PERCENT 100
+/* ...and is at least this big */
+#define AOF_AUTO_REWRITE_MIN_SIZE (64 * 1024 * 1024)
+/* After a failed rewrite, automatic ones wait this long to retry */
+#define AOF_REWRITE_RETRY_DELAY_MS 5000
+
+/*
+ * Replay `path` into the (empty) keyspace; nothing expires until the replay
+ * is done (storage_set_loading). An incomplete last command, as left by a
+ * crash mid-write, is dropped and the file truncated before it; anything
+ * else unparsable is REDIS_CORRUPT_AOF and leaves the keyspace empty.
+ * `commands` receives the number of commands replayed.
+ */
+REDIS_RC aof_load(const char *path, size_t *commands);
+
+/* Start logging to `path`, appending to what it already holds. */
+REDIS_RC aof_open(const char *path);
+/*
+ * Start logging to `path`, which does not exist yet, with a rewrite of the
+ * dataset loaded from the snapshot. The file is only created by the rewrite
+ * (retried until one succeeds), so until then a restart still loads the
+ * snapshot. REDIS_IO_ERROR if the rewrite cannot start.
+ */
+REDIS_RC aof_open_with_rewrite(const char *path);
+/* Write and fsync everything logged so far, and stop logging. */
+void aof_close(void);
+bool aof_enabled(void);
+
+/* Log a command that modified the keyspace. */
+void aof_feed(int argc, char **argv, const size_t *argv_len);
+/* Write the commands logged during this iteration; call before replying. */
+void aof_flush(void);
+
+/*
+ * Rewrite the log in the background. *scheduled is set when a background
+ * save is running and the rewrite will start once it is done.
+ */
+REDIS_RC aof_rewrite(bool *scheduled);
+bool aof_rewrite_in_progress(void);
+/* From the server cron: start scheduled and automatic rewrites. */
+void aof_cron(void);
+
+#endif
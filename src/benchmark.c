@@ -0,0 +1,910 @@
+#include "event_loop.h"
+#include "util/histogram.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Load generator in the spirit of redis-benchmark. Every test opens
+ * `clients` connections spread over `threads` event loops; each connection
+ * sends `pipeline` requests at a time and sends the next batch once all of
+ * their replies are in, until `requests` have been sent overall. A reply's
+ * latency is measured from the moment its batch was sent.
+ *
+ * Requests are built from templates: `{}` is a key number drawn from
+ * [0, keyspace) with a uniform or zipfian distribution, `{value}` the
+ * payload, `{lon}` / `{lat}` a point derived from the key (all points lie in
+ * one 1 x 1 degree square, so searches find neighbours).
+ */
+
+#define BENCH_MAX_TESTS 32
+#define BENCH_MAX_THREADS 64
+#define BENCH_READ_CHUNK (16 * 1024)
+
+typedef struct {
+  const char *name;
+  const char *setup; /* sent once before the test; its reply is ignored */
+  const char *request;
+} Test;
+
+static const Test g_tests[] = {
+    {"ping", NULL, "PING"},
+    {"set", NULL, "SET key:{} {value}"},
+    {"get", NULL, "GET key:{}"},
+    {"incr", NULL, "INCR counter:{}"},
+    {"cms.incrby", "CMS.INITBYDIM sketch 2000 5", "CMS.INCRBY sketch item:{} 1"},
+    {"cms.query", "CMS.INITBYDIM sketch 2000 5", "CMS.QUERY sketch item:{}"},
+    {"zadd", NULL, "ZADD zset {} member:{}"},
+    {"zscore", NULL, "ZSCORE zset member:{}"},
+    {"pfadd", NULL, "PFADD hll element:{}"},
+    {"bf.add", NULL, "BF.ADD bloom item:{}"},
+    {"geoadd", NULL, "GEOADD geo {lon} {lat} place:{}"},
+    {"geosearch", NULL,
+     "GEOSEARCH geo FROMLONLAT {lon} {lat} BYRADIUS 1 km ASC COUNT 10"},
+};
+
+#define TEST_COUNT (sizeof(g_tests) / sizeof(g_tests[0]))
+
+typedef enum { DIST_UNIFORM = 0, DIST_ZIPFIAN } Distribution;
+
+typedef struct {
+  const char *host;
+  const char *port;
+  int clients;
+  long long requests;
+  int pipeline;
+  int datasize;
+  long long keyspace;
+  Distribution distribution;
+  double zipf_s;
+  int threads;
+  bool quiet;
+  bool csv;
+  /* -t: tests run one after the other */
+  const Test *tests[BENCH_MAX_TESTS];
+  int ntests;
+  /* --mix: one test picking each request's command by weight */
+  const Test *mix[BENCH_MAX_TESTS];
+  unsigned mix_weight[BENCH_MAX_TESTS];
+  int nmix;
+} Options;
+
+/* Zipfian key generator (Gray et al., as in YCSB): key 0 is the hottest */
+typedef struct {
+  double n;
+  double theta;
+  double alpha;
+  double zetan;
+  double eta;
+  double half_pow_theta;
+} Zipf;
+
+typedef struct Worker Worker;
+
+typedef struct {
+  Worker *w;
+  int fd;
+  char *wbuf;
+  size_t wlen;
+  size_t wpos;
+  size_t wcap;
+  char *rbuf;
+  size_t rlen;
+  size_t rcap;
+  int pending;       /* replies still due for the current batch */
+  long long sent_us; /* when the current batch was sent */
+} Conn;
+
+struct Worker {
+  pthread_t thread;
+  EventLoop *el;
+  Conn *conns;
+  int nconns;
+  int active;
+  uint64_t rng;
+  char *scratch; /* one expanded argument */
+  Histogram *latency; /* microseconds */
+};
+
+static Options g_opts;
+static Zipf g_zipf;
+static char *g_value = NULL;
+
+/* The test being run: one template, or the --mix */
+static const Test *const *g_run = NULL;
+static const unsigned *g_run_weight = NULL;
+static int g_run_len = 0;
+static unsigned g_run_total_weight = 0;
+
+static _Atomic long long g_issued = 0;
+static _Atomic long long g_errors = 0;
+static _Atomic bool g_error_shown = false;
+
+/* private functions */
+static bool __parse_positive(const char *s, long long *out);
+static bool __parse_int_option(const char *name, const char *s, int *out);
+static bool __parse_test_list(const char *s, const Test **tests,
+                              unsigned *weights, int *n);
+static void __usage(void);
+static bool __parse_options(int argc, char **argv);
+static const Test *__find_test(const char *name, size_t len);
+static void __zipf_init(Zipf *z, long long n, double theta);
+static long long __zipf_next(const Zipf *z, double u);
+static uint64_t __rand(uint64_t *state);
+static double __rand01(uint64_t *state);
+static long long __next_key(Worker *w);
+static void __append(char **buf, size_t *len, size_t *cap, const char *s,
+                     size_t n);
+static void __append_request(Worker *w, char **buf, size_t *len, size_t *cap,
+                             const char *tmpl, long long key);
+static long __reply_end(const char *buf, size_t len, size_t pos);
+static int __connect(void);
+static void __send_setup(const char *tmpl);
+static bool __conn_next_batch(Conn *c);
+static void __conn_close(Conn *c);
+static void __conn_readable(EventLoop *el, int fd, void *data, int mask);
+static void __conn_writable(EventLoop *el, int fd, void *data, int mask);
+static void *__worker_main(void *arg);
+static void __run(const char *title, const Test *const *tests,
+                  const unsigned *weights, int n);
+static void __report(const char *title, double seconds, const Histogram *h);
+
+/*
+ * usage: redis-c-benchmark [-h host] [-p port] [-c clients] [-n requests]
+ *                          [-P pipeline] [-d bytes] [-r keyspace]
+ *                          [--distribution uniform|zipfian] [--zipf-s S]
+ *                          [-t test,...] [--mix test=weight,...]
+ *                          [--threads N] [-q] [--csv]
+ */
+int main(int argc, char *argv[]) {
+  if (!__parse_options(argc, argv)) {
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  if (g_opts.distribution == DIST_ZIPFIAN) {
+    __zipf_init(&g_zipf, g_opts.keyspace, g_opts.zipf_s);
+  }
+  g_value = malloc((size_t)g_opts.datasize + 1);
+  if (!g_value) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  memset(g_value, 'x', (size_t)g_opts.datasize);
+  g_value[g_opts.datasize] = '\0';
+
+  if (g_opts.csv) {
+    printf("\"test\",\"rps\",\"avg_latency_ms\",\"min_latency_ms\","
+           "\"p50_latency_ms\",\"p95_latency_ms\",\"p99_latency_ms\","
+           "\"max_latency_ms\"\n");
+  }
+  if (g_opts.nmix > 0) {
+    __run("MIX", g_opts.mix, g_opts.mix_weight, g_opts.nmix);
+  } else {
+    for (int i = 0; i < g_opts.ntests; i++) {
+      static const unsigned one = 1;
+      __run(g_opts.tests[i]->name, &g_opts.tests[i], &one, 1);
+    }
+  }
+  free(g_value);
+  return 0;
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static bool __parse_positive(const char *s, long long *out) {
+  char *end;
+  errno = 0;
+  long long v = strtoll(s, &end, 10);
+  if (errno != 0 || *end != '\0' || v <= 0) {
+    return false;
+  }
+  *out = v;
+  return true;
+}
+
+static bool __parse_int_option(const char *name, const char *s, int *out) {
+  long long v;
+  if (!__parse_positive(s, &v) || v > INT32_MAX) {
+    fprintf(stderr, "%s must be a positive integer\n", name);
+    return false;
+  }
+  *out = (int)v;
+  return true;
+}
+
+/* "a,b,c" into tests; "a=3,b=1" into tests and weights when `weights` */
+static bool __parse_test_list(const char *s, const Test **tests,
+                              unsigned *weights, int *n) {
+  *n = 0;
+  while (*s) {
+    size_t len = strcspn(s, ",");
+    size_t name_len = len;
+    unsigned weight = 1;
+    if (weights) {
+      const char *eq = memchr(s, '=', len);
+      long long w;
+      char num[16];
+      size_t num_len = eq ? len - (size_t)(eq - s) - 1 : 0;
+      if (!eq || num_len == 0 || num_len >= sizeof(num)) {
+        fprintf(stderr, "--mix expects test=weight,...\n");
+        return false;
+      }
+      memcpy(num, eq + 1, num_len);
+      num[num_len] = '\0';
+      if (!__parse_positive(num, &w) || w > 1000000) {
+        fprintf(stderr, "Invalid weight in '%.*s'\n", (int)len, s);
+        return false;
+      }
+      name_len = (size_t)(eq - s);
+      weight = (unsigned)w;
+    }
+    const Test *t = __find_test(s, name_len);
+    if (!t) {
+      fprintf(stderr, "Unknown test '%.*s'\n", (int)name_len, s);
+      return false;
+    }
+    if (*n == BENCH_MAX_TESTS) {
+      fprintf(stderr, "Too many tests\n");
+      return false;
+    }
+    tests[*n] = t;
+    if (weights) {
+      weights[*n] = weight;
+    }
+    (*n)++;
+    s += len;
+    if (*s == ',') {
+      s++;
+    }
+  }
+  return *n > 0;
+}
+
+static void __usage(void) {
+  fprintf(stderr,
+          "Usage: redis-c-benchmark [options]\n"
+          "  -h <host>          server host (default 127.0.0.1)\n"
+          "  -p <port>          server port (default 6379)\n"
+          "  -c <clients>       parallel connections (default 50)\n"
+          "  -n <requests>      requests per test (default 100000)\n"
+          "  -P <pipeline>      requests in flight per connection (default "
+          "1)\n"
+          "  -d <bytes>         SET payload size (default 3)\n"
+          "  -r <keyspace>      distinct keys (default 100000)\n"
+          "  --distribution uniform|zipfian   key popularity (default "
+          "uniform)\n"
+          "  --zipf-s <s>       zipfian skew, 0 < s < 1 (default 0.99)\n"
+          "  -t <tests>         comma separated tests to run one by one\n"
+          "  --mix <t=w,...>    a single test mixing commands by weight\n"
+          "  --threads <n>      client event loops (default 1)\n"
+          "  -q                 one line per test\n"
+          "  --csv              CSV output\n"
+          "Tests:");
+  for (size_t i = 0; i < TEST_COUNT; i++) {
+    fprintf(stderr, " %s", g_tests[i].name);
+  }
+  fprintf(stderr, "\n");
+}
+
+static bool __parse_options(int argc, char **argv) {
+  Options *o = &g_opts;
+  o->host = "127.0.0.1";
+  o->port = "6379";
+  o->clients = 50;
+  o->requests = 100000;
+  o->pipeline = 1;
+  o->datasize = 3;
+  o->keyspace = 100000;
+  o->distribution = DIST_UNIFORM;
+  o->zipf_s = 0.99;
+  o->threads = 1;
+
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "-h") == 0 && has_value) {
+      o->host = argv[++i];
+    } else if (strcmp(argv[i], "-p") == 0 && has_value) {
+      o->port = argv[++i];
+    } else if (strcmp(argv[i], "-c") == 0 && has_value) {
+      if (!__parse_int_option("clients", argv[++i], &o->clients)) {
+        return false;
+      }
+    } else if (strcmp(argv[i], "-n") == 0 && has_value) {
+      if (!__parse_positive(argv[++i], &o->requests)) {
+        fprintf(stderr, "requests must be a positive integer\n");
+        return false;
+      }
+    } else if (strcmp(argv[i], "-P") == 0 && has_value) {
+      if (!__parse_int_option("pipeline", argv[++i], &o->pipeline)) {
+        return false;
+      }
+    } else if (strcmp(argv[i], "-d") == 0 && has_value) {
+      if (!__parse_int_option("datasize", argv[++i], &o->datasize)) {
+        return false;
+      }
+    } else if (strcmp(argv[i], "-r") == 0 && has_value) {
+      if (!__parse_positive(argv[++i], &o->keyspace)) {
+        fprintf(stderr, "keyspace must be a positive integer\n");
+        return false;
+      }
+    } else if (strcmp(argv[i], "--distribution") == 0 && has_value) {
+      i++;
+      if (strcasecmp(argv[i], "uniform") == 0) {
+        o->distribution = DIST_UNIFORM;
+      } else if (strcasecmp(argv[i], "zipfian") == 0) {
+        o->distribution = DIST_ZIPFIAN;
+      } else {
+        fprintf(stderr, "distribution must be uniform or zipfian\n");
+        return false;
+      }
+    } else if (strcmp(argv[i], "--zipf-s") == 0 && has_value) {
+      char *end;
+      o->zipf_s = strtod(argv[++i], &end);
+      if (*end != '\0' || !(o->zipf_s > 0 && o->zipf_s < 1)) {
+        fprintf(stderr, "zipf-s must be between 0 and 1 (exclusive)\n");
+        return false;
+      }
+    } else if (strcmp(argv[i], "-t") == 0 && has_value) {
+      if (!__parse_test_list(argv[++i], o->tests, NULL, &o->ntests)) {
+        return false;
+      }
+    } else if (strcmp(argv[i], "--mix") == 0 && has_value) {
+      if (!__parse_test_list(argv[++i], o->mix, o->mix_weight, &o->nmix)) {
+        return false;
+      }
+    } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+      if (!__parse_int_option("threads", argv[++i], &o->threads)) {
+        return false;
+      }
+      if (o->threads > BENCH_MAX_THREADS) {
+        fprintf(stderr, "At most %d threads\n", BENCH_MAX_THREADS);
+        return false;
+      }
+    } else if (strcmp(argv[i], "-q") == 0) {
+      o->quiet = true;
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      o->csv = true;
+    } else {
+      __usage();
+      return false;
+    }
+  }
+  if (o->ntests == 0 && o->nmix == 0) {
+    for (size_t i = 0; i < TEST_COUNT; i++) {
+      o->tests[o->ntests++] = &g_tests[i];
+    }
+  }
+  if (o->threads > o->clients) {
+    o->threads = o->clients;
+  }
+  return true;
+}
+
+static const Test *__find_test(const char *name, size_t len) {
+  for (size_t i = 0; i < TEST_COUNT; i++) {
+    if (strlen(g_tests[i].name) == len &&
+        strncasecmp(g_tests[i].name, name, len) == 0) {
+      return &g_tests[i];
+    }
+  }
+  return NULL;
+}
+
+static void __zipf_init(Zipf *z, long long n, double theta) {
+  /* zeta(n) is O(n), once per run */
+  double zetan = 0;
+  for (long long i = 1; i <= n; i++) {
+    zetan += 1.0 / pow((double)i, theta);
+  }
+  double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+  z->n = (double)n;
+  z->theta = theta;
+  z->alpha = 1.0 / (1.0 - theta);
+  z->zetan = zetan;
+  z->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+  z->half_pow_theta = 1.0 + pow(0.5, theta);
+}
+
+static long long __zipf_next(const Zipf *z, double u) {
+  double uz = u * z->zetan;
+  if (uz < 1.0) {
+    return 0;
+  }
+  if (uz < z->half_pow_theta) {
+    return 1;
+  }
+  long long k = (long long)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+  return k < (long long)z->n ? k : (long long)z->n - 1;
+}
+
+/* xorshift64* */
+static uint64_t __rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double __rand01(uint64_t *state) {
+  return (double)(__rand(state) >> 11) / (double)(1ULL << 53);
+}
+
+static long long __next_key(Worker *w) {
+  if (g_opts.distribution == DIST_ZIPFIAN) {
+    return __zipf_next(&g_zipf, __rand01(&w->rng));
+  }
+  return (long long)(__rand(&w->rng) % (uint64_t)g_opts.keyspace);
+}
+
+static void __append(char **buf, size_t *len, size_t *cap, const char *s,
+                     size_t n) {
+  if (*len + n > *cap) {
+    size_t new_cap = (*len + n) * 2;
+    char *p = realloc(*buf, new_cap);
+    if (!p) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+    *buf = p;
+    *cap = new_cap;
+  }
+  memcpy(*buf + *len, s, n);
+  *len += n;
+}
+
+/* Expand `tmpl` for `key` and append it as a RESP multibulk request. */
+static void __append_request(Worker *w, char **buf, size_t *len, size_t *cap,
+                             const char *tmpl, long long key) {
+  char num[64];
+  int argc = 0;
+  for (const char *p = tmpl; *p;) {
+    argc++;
+    p += strcspn(p, " ");
+    p += strspn(p, " ");
+  }
+  __append(buf, len, cap, num, (size_t)snprintf(num, sizeof(num), "*%d\r\n", argc));
+
+  const char *p = tmpl;
+  while (*p) {
+    size_t arg_len = strcspn(p, " ");
+    const char *end = p + arg_len;
+    size_t n = 0;
+    while (p < end) {
+      const char *sub = NULL;
+      size_t sub_len = 0;
+      if (strncmp(p, "{}", 2) == 0) {
+        sub_len = (size_t)snprintf(num, sizeof(num), "%lld", key);
+        sub = num;
+        p += 2;
+      } else if (strncmp(p, "{value}", 7) == 0) {
+        sub = g_value;
+        sub_len = (size_t)g_opts.datasize;
+        p += 7;
+      } else if (strncmp(p, "{lon}", 5) == 0) {
+        sub_len = (size_t)snprintf(num, sizeof(num), "%.4f",
+                                   13.0 + (double)(key % 1000) / 1000);
+        sub = num;
+        p += 5;
+      } else if (strncmp(p, "{lat}", 5) == 0) {
+        sub_len = (size_t)snprintf(num, sizeof(num), "%.4f",
+                                   52.0 + (double)(key / 1000 % 1000) / 1000);
+        sub = num;
+        p += 5;
+      } else {
+        sub = p;
+        sub_len = 1;
+        p++;
+      }
+      memcpy(w->scratch + n, sub, sub_len);
+      n += sub_len;
+    }
+    __append(buf, len, cap, num,
+             (size_t)snprintf(num, sizeof(num), "$%zu\r\n", n));
+    __append(buf, len, cap, w->scratch, n);
+    __append(buf, len, cap, "\r\n", 2);
+    p += strspn(p, " ");
+  }
+}
+
+/*
+ * Offset just past the reply starting at buf[pos]: 0 while it is incomplete,
+ * -1 if it is not RESP.
+ */
+static long __reply_end(const char *buf, size_t len, size_t pos) {
+  if (pos >= len) {
+    return 0;
+  }
+  const char *cr = memchr(buf + pos, '\r', len - pos);
+  if (!cr || (size_t)(cr - buf) + 1 >= len) {
+    return 0;
+  }
+  long next = (long)(cr - buf) + 2;
+  switch (buf[pos]) {
+  case '+':
+  case '-':
+  case ':':
+  case ',':
+  case '_':
+  case '#':
+  case '(':
+    return next;
+  case '$':
+  case '=':
+  case '!': {
+    long n = strtol(buf + pos + 1, NULL, 10);
+    if (n < 0) {
+      return next;
+    }
+    return (size_t)(next + n + 2) <= len ? next + n + 2 : 0;
+  }
+  case '*':
+  case '~':
+  case '>':
+  case '%': {
+    long n = strtol(buf + pos + 1, NULL, 10);
+    if (buf[pos] == '%') {
+      n *= 2;
+    }
+    for (long i = 0; i < n; i++) {
+      long end = __reply_end(buf, len, (size_t)next);
+      if (end <= 0) {
+        return end;
+      }
+      next = end;
+    }
+    return next;
+  }
+  default:
+    return -1;
+  }
+}
+
+static int __connect(void) {
+  struct addrinfo hints, *res, *ai;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int rc = getaddrinfo(g_opts.host, g_opts.port, &hints, &res);
+  if (rc != 0) {
+    fprintf(stderr, "Cannot resolve %s: %s\n", g_opts.host, gai_strerror(rc));
+    exit(1);
+  }
+  int fd = -1;
+  for (ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd == -1) {
+      continue;
+    }
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd == -1) {
+    fprintf(stderr, "Could not connect to %s:%s: %s\n", g_opts.host,
+            g_opts.port, strerror(errno));
+    exit(1);
+  }
+  int yes = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+  return fd;
+}
+
+/* Send one request and wait for its reply, whatever it is. */
+static void __send_setup(const char *tmpl) {
+  Worker w = {0};
+  w.scratch = malloc(strlen(tmpl) + 64);
+  char *buf = NULL;
+  size_t len = 0, cap = 0;
+  __append_request(&w, &buf, &len, &cap, tmpl, 0);
+  int fd = __connect();
+  for (size_t off = 0; off < len;) {
+    ssize_t n = write(fd, buf + off, len - off);
+    if (n <= 0) {
+      fprintf(stderr, "Setup failed: %s\n", strerror(errno));
+      exit(1);
+    }
+    off += (size_t)n;
+  }
+  len = 0;
+  while (__reply_end(buf, len, 0) == 0) {
+    char chunk[4096];
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n <= 0) {
+      fprintf(stderr, "Setup failed: connection closed\n");
+      exit(1);
+    }
+    __append(&buf, &len, &cap, chunk, (size_t)n);
+  }
+  close(fd);
+  free(buf);
+  free(w.scratch);
+}
+
+/* Queue the next batch; false once every request has been handed out. */
+static bool __conn_next_batch(Conn *c) {
+  long long start = atomic_fetch_add(&g_issued, g_opts.pipeline);
+  if (start >= g_opts.requests) {
+    return false;
+  }
+  long long count = g_opts.requests - start;
+  if (count > g_opts.pipeline) {
+    count = g_opts.pipeline;
+  }
+  c->wlen = 0;
+  c->wpos = 0;
+  for (long long i = 0; i < count; i++) {
+    const Test *t = g_run[0];
+    if (g_run_len > 1) {
+      unsigned pick = (unsigned)(__rand(&c->w->rng) % g_run_total_weight);
+      for (int j = 0; j < g_run_len; j++) {
+        if (pick < g_run_weight[j]) {
+          t = g_run[j];
+          break;
+        }
+        pick -= g_run_weight[j];
+      }
+    }
+    __append_request(c->w, &c->wbuf, &c->wlen, &c->wcap, t->request,
+                     __next_key(c->w));
+  }
+  c->pending = (int)count;
+  c->sent_us = el_ustime();
+  if (el_add_file_event(c->w->el, c->fd, EL_WRITABLE, __conn_writable, c) ==
+      EL_ERR) {
+    fprintf(stderr, "Cannot watch a connection\n");
+    exit(1);
+  }
+  return true;
+}
+
+static void __conn_close(Conn *c) {
+  el_del_file_event(c->w->el, c->fd, EL_READABLE | EL_WRITABLE);
+  close(c->fd);
+  c->fd = -1;
+  if (--c->w->active == 0) {
+    el_stop(c->w->el);
+  }
+}
+
+static void __conn_writable(EventLoop *el, int fd, void *data, int mask) {
+  (void)mask;
+  Conn *c = (Conn *)data;
+  while (c->wpos < c->wlen) {
+    ssize_t n = write(fd, c->wbuf + c->wpos, c->wlen - c->wpos);
+    if (n == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      } else if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Write error: %s\n", strerror(errno));
+      exit(1);
+    }
+    c->wpos += (size_t)n;
+  }
+  el_del_file_event(el, fd, EL_WRITABLE);
+}
+
+static void __conn_readable(EventLoop *el, int fd, void *data, int mask) {
+  (void)el;
+  (void)mask;
+  Conn *c = (Conn *)data;
+  if (c->rcap - c->rlen < BENCH_READ_CHUNK) {
+    c->rcap = c->rlen + BENCH_READ_CHUNK * 2;
+    c->rbuf = realloc(c->rbuf, c->rcap);
+    if (!c->rbuf) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+  }
+  ssize_t n = read(fd, c->rbuf + c->rlen, c->rcap - c->rlen);
+  if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return;
+  }
+  if (n <= 0) {
+    fprintf(stderr, "Server closed the connection\n");
+    exit(1);
+  }
+  c->rlen += (size_t)n;
+
+  long long now = el_ustime();
+  size_t pos = 0;
+  long end;
+  while (c->pending > 0 && (end = __reply_end(c->rbuf, c->rlen, pos)) != 0) {
+    if (end < 0) {
+      fprintf(stderr, "Protocol error in a reply\n");
+      exit(1);
+    }
+    if (c->rbuf[pos] == '-') {
+      atomic_fetch_add(&g_errors, 1);
+      if (!atomic_exchange(&g_error_shown, true)) {
+        fprintf(stderr, "Error reply: %.*s\n", (int)((size_t)end - pos - 3),
+                c->rbuf + pos + 1);
+      }
+    }
+    histogram_record(c->w->latency, (uint64_t)(now - c->sent_us));
+    c->pending--;
+    pos = (size_t)end;
+  }
+  memmove(c->rbuf, c->rbuf + pos, c->rlen - pos);
+  c->rlen -= pos;
+  if (c->pending == 0 && !__conn_next_batch(c)) {
+    __conn_close(c);
+  }
+}
+
+static void *__worker_main(void *arg) {
+  Worker *w = (Worker *)arg;
+  for (int i = 0; i < w->nconns; i++) {
+    Conn *c = &w->conns[i];
+    if (c->fd == -1) {
+      continue;
+    }
+    if (el_add_file_event(w->el, c->fd, EL_READABLE, __conn_readable, c) ==
+        EL_ERR) {
+      fprintf(stderr, "Cannot watch a connection\n");
+      exit(1);
+    }
+    if (!__conn_next_batch(c)) {
+      __conn_close(c);
+    }
+  }
+  if (w->active > 0) {
+    el_main(w->el);
+  }
+  return NULL;
+}
+
+static void __run(const char *title, const Test *const *tests,
+                  const unsigned *weights, int n) {
+  g_run = tests;
+  g_run_weight = weights;
+  g_run_len = n;
+  g_run_total_weight = 0;
+  for (int i = 0; i < n; i++) {
+    g_run_total_weight += weights[i];
+    if (tests[i]->setup) {
+      __send_setup(tests[i]->setup);
+    }
+  }
+  atomic_store(&g_issued, 0);
+  atomic_store(&g_errors, 0);
+  atomic_store(&g_error_shown, false);
+
+  int threads = g_opts.threads;
+  Worker *workers = calloc((size_t)threads, sizeof(Worker));
+  if (!workers) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  size_t scratch = (size_t)g_opts.datasize + 256;
+  for (int t = 0; t < threads; t++) {
+    Worker *w = &workers[t];
+    w->nconns = g_opts.clients / threads + (t < g_opts.clients % threads);
+    w->conns = calloc((size_t)w->nconns, sizeof(Conn));
+    w->scratch = malloc(scratch);
+    w->latency = malloc(sizeof(Histogram));
+    w->rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(t + 1);
+    if (!w->conns || !w->scratch || !w->latency) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+    histogram_init(w->latency);
+    int maxfd = 0;
+    for (int i = 0; i < w->nconns; i++) {
+      Conn *c = &w->conns[i];
+      c->w = w;
+      c->fd = __connect();
+      fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL, 0) | O_NONBLOCK);
+      if (c->fd > maxfd) {
+        maxfd = c->fd;
+      }
+    }
+    w->active = w->nconns;
+    w->el = el_create(maxfd + 1);
+    if (!w->el) {
+      fprintf(stderr, "Cannot create an event loop\n");
+      exit(1);
+    }
+  }
+
+  long long start = el_ustime();
+  for (int t = 1; t < threads; t++) {
+    if (pthread_create(&workers[t].thread, NULL, __worker_main,
+                       &workers[t]) != 0) {
+      fprintf(stderr, "Cannot start a thread\n");
+      exit(1);
+    }
+  }
+  __worker_main(&workers[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(workers[t].thread, NULL);
+  }
+  double seconds = (double)(el_ustime() - start) / 1e6;
+
+  Histogram *total = workers[0].latency;
+  for (int t = 1; t < threads; t++) {
+    histogram_merge(total, workers[t].latency);
+  }
+  char upper[64];
+  size_t len = strlen(title);
+  if (len >= sizeof(upper)) {
+    len = sizeof(upper) - 1;
+  }
+  for (size_t i = 0; i < len; i++) {
+    upper[i] = (char)(title[i] >= 'a' && title[i] <= 'z' ? title[i] - 32
+                                                         : title[i]);
+  }
+  upper[len] = '\0';
+  __report(upper, seconds, total);
+
+  for (int t = 0; t < threads; t++) {
+    Worker *w = &workers[t];
+    for (int i = 0; i < w->nconns; i++) {
+      free(w->conns[i].wbuf);
+      free(w->conns[i].rbuf);
+    }
+    el_destroy(w->el);
+    free(w->conns);
+    free(w->scratch);
+    free(w->latency);
+  }
+  free(workers);
+}
+
+static void __report(const char *title, double seconds, const Histogram *h) {
+  double rps = seconds > 0 ? (double)h->count / seconds : 0;
+  /* recorded in microseconds, reported in milliseconds */
+#define MS(us) ((double)(us) / 1000.0)
+  if (g_opts.csv) {
+    printf("\"%s\",\"%.2f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\","
+           "\"%.3f\"\n",
+           title, rps, MS(histogram_mean(h)), MS(h->count ? h->min : 0),
+           MS(histogram_percentile(h, 50)), MS(histogram_percentile(h, 95)),
+           MS(histogram_percentile(h, 99)), MS(h->max));
+  } else if (g_opts.quiet) {
+    printf("%s: %.2f requests per second, p50=%.3f msec\n", title, rps,
+           MS(histogram_percentile(h, 50)));
+  } else {
+    printf("====== %s ======\n", title);
+    printf("  %llu requests completed in %.2f seconds\n",
+           (unsigned long long)h->count, seconds);
+    printf("  %d parallel clients, pipeline %d, %d bytes payload, %lld keys "
+           "(%s)\n",
+           g_opts.clients, g_opts.pipeline, g_opts.datasize, g_opts.keyspace,
+           g_opts.distribution == DIST_ZIPFIAN ? "zipfian" : "uniform");
+    printf("  latency (msec): avg=%.3f min=%.3f p50=%.3f p95=%.3f p99=%.3f "
+           "p99.9=%.3f max=%.3f\n",
+           MS(histogram_mean(h)), MS(h->count ? h->min : 0),
+           MS(histogram_percentile(h, 50)), MS(histogram_percentile(h, 95)),
+           MS(histogram_percentile(h, 99)), MS(histogram_percentile(h, 99.9)),
+           MS(h->max));
+    printf("  %.2f requests per second\n\n", rps);
+  }
+#undef MS
+  long long errors = atomic_load(&g_errors);
+  if (errors > 0) {
+    fprintf(stderr, "%s: %lld error replies\n", title, errors);
+  }
+  fflush(stdout);
+}
@@ -0,0 +1,138 @@
+#include "bio.h"
+#include "logging.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct BioJob {
+  BioJobProc proc;
+  void *arg;
+  struct BioJob *next;
+} BioJob;
+
+typedef struct {
+  pthread_t tid;
+  bool started;
+  pthread_mutex_t lock;
+  pthread_cond_t wake; /* a job was queued, or shutdown */
+  pthread_cond_t done; /* a job finished */
+  BioJob *head;
+  BioJob *tail;
+  unsigned long pending; /* queued plus the one running */
+  bool shutdown;
+} BioWorker;
+
+static BioWorker g_workers[BIO_NUM_TYPES];
+
+/* private functions */
+static void *__worker_main(void *arg);
+
+REDIS_RC bio_init(void) {
+  for (int i = 0; i < BIO_NUM_TYPES; i++) {
+    BioWorker *w = &g_workers[i];
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    pthread_cond_init(&w->done, NULL);
+    w->head = w->tail = NULL;
+    w->pending = 0;
+    w->shutdown = false;
+    if (pthread_create(&w->tid, NULL, __worker_main, w) != 0) {
+      LOG_ERROR("Unable to create background thread %d", i);
+      bio_shutdown();
+      return REDIS_OUT_OF_MEMORY;
+    }
+    w->started = true;
+  }
+  return REDIS_OK;
+}
+
+void bio_shutdown(void) {
+  for (int i = 0; i < BIO_NUM_TYPES; i++) {
+    BioWorker *w = &g_workers[i];
+    if (!w->started) {
+      continue;
+    }
+    pthread_mutex_lock(&w->lock);
+    w->shutdown = true;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->tid, NULL);
+    w->started = false;
+  }
+}
+
+REDIS_RC bio_submit(BioType type, BioJobProc proc, void *arg) {
+  BioWorker *w = &g_workers[type];
+  if (!w->started) {
+    /* no thread (startup, shutdown): run the job right here */
+    proc(arg);
+    return REDIS_OK;
+  }
+  BioJob *job = malloc(sizeof(BioJob));
+  if (!job) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  job->proc = proc;
+  job->arg = arg;
+  job->next = NULL;
+  pthread_mutex_lock(&w->lock);
+  if (w->tail) {
+    w->tail->next = job;
+  } else {
+    w->head = job;
+  }
+  w->tail = job;
+  w->pending++;
+  pthread_cond_signal(&w->wake);
+  pthread_mutex_unlock(&w->lock);
+  return REDIS_OK;
+}
+
+unsigned long bio_pending(BioType type) {
+  BioWorker *w = &g_workers[type];
+  pthread_mutex_lock(&w->lock);
+  unsigned long pending = w->pending;
+  pthread_mutex_unlock(&w->lock);
+  return pending;
+}
+
+void bio_drain(BioType type) {
+  BioWorker *w = &g_workers[type];
+  if (!w->started) {
+    return;
+  }
+  pthread_mutex_lock(&w->lock);
+  while (w->pending > 0) {
+    pthread_cond_wait(&w->done, &w->lock);
+  }
+  pthread_mutex_unlock(&w->lock);
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static void *__worker_main(void *arg) {
+  BioWorker *w = (BioWorker *)arg;
+  pthread_mutex_lock(&w->lock);
+  for (;;) {
+    while (!w->head && !w->shutdown) {
+      pthread_cond_wait(&w->wake, &w->lock);
+    }
+    /* the queue is drained before shutting down */
+    if (!w->head) {
+      break;
+    }
+    BioJob *job = w->head;
+    w->head = job->next;
+    if (!w->head) {
+      w->tail = NULL;
+    }
+    pthread_mutex_unlock(&w->lock);
+    job->proc(job->arg);
+    free(job);
+    pthread_mutex_lock(&w->lock);
+    w->pending--;
+    pthread_cond_broadcast(&w->done);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
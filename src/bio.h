@@ -0,0 +1,33 @@
+#ifndef REDIS_C_BIO_H__
+#define REDIS_C_BIO_H__
+
+#include "redis-C/rc.h"
+#include <stdbool.h>
+
+/*
+ * Background jobs: calls that may block for a long time (fsync, closing a
+ * file whose blocks are freed on the last close, freeing a large value) run
+ * on a thread of their own so the event loop never waits on them. Each job
+ * type has its own thread and queue, and jobs of one type run in submission
+ * order: a close queued after an fsync of the same fd never overtakes it.
+ */
+
+typedef enum {
+  BIO_AOF = 0,   /* fsync and close of append-only files */
+  BIO_LAZY_FREE, /* large values and keyspaces dropped from the keyspace */
+  BIO_NUM_TYPES
+} BioType;
+
+typedef void (*BioJobProc)(void *arg);
+
+REDIS_RC bio_init(void);
+/* Run every job still queued, then stop the threads. */
+void bio_shutdown(void);
+/* Queue `proc(arg)` on the thread of `type`. */
+REDIS_RC bio_submit(BioType type, BioJobProc proc, void *arg);
+/* Jobs of `type` queued or running. */
+unsigned long bio_pending(BioType type);
+/* Wait until every job of `type` submitted so far has run. */
+void bio_drain(BioType type);
+
+#endif
@@ -3,10 +3,87 @@
 #include "io-multiplexing/server/config.h"
 #include "redis-C/config.h"
 #include "redis-C/rc.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/*
+ * Print one RESP reply starting at buf[*pos] the way redis-cli does and
+ * advance *pos past it. Returns false on a malformed/truncated reply.
+ */
+static bool print_reply(const char *buf, size_t len, size_t *pos, int indent) {
+  if (*pos >= len) {
+    return false;
+  }
+  const char *line = buf + *pos;
+  const char *cr = memchr(line, '\r', len - *pos);
+  if (!cr || (size_t)(cr - buf) + 1 >= len) {
+    return false;
+  }
+  int line_len = (int)(cr - line) - 1;
+  *pos = (size_t)(cr - buf) + 2;
+
+  switch (line[0]) {
+  case '+':
+    printf("%.*s\n", line_len, line + 1);
+    return true;
+  case '-':
+    printf("(error) %.*s\n", line_len, line + 1);
+    return true;
+  case ':':
+    printf("(integer) %.*s\n", line_len, line + 1);
+    return true;
+  case ',':
+    printf("(double) %.*s\n", line_len, line + 1);
+    return true;
+  case '#':
+    printf("(%s)\n", line[1] == 't' ? "true" : "false");
+    return true;
+  case '_':
+    printf("(nil)\n");
+    return true;
+  case '$': {
+    long blen = strtol(line + 1, NULL, 10);
+    if (blen < 0) {
+      printf("(nil)\n");
+      return true;
+    }
+    if (*pos + (size_t)blen + 2 > len) {
+      return false;
+    }
+    printf("\"%.*s\"\n", (int)blen, buf + *pos);
+    *pos += (size_t)blen + 2;
+    return true;
+  }
+  case '*':
+  case '%': {
+    long count = strtol(line + 1, NULL, 10);
+    if (count < 0) {
+      printf("(nil)\n");
+      return true;
+    }
+    if (count == 0) {
+      printf("(empty array)\n");
+      return true;
+    }
+    long elements = line[0] == '%' ? count * 2 : count;
+    for (long i = 0; i < elements; i++) {
+      if (i > 0) {
+        printf("%*s", indent, "");
+      }
+      int prefix = printf("%ld) ", i + 1);
+      if (!print_reply(buf, len, pos, indent + prefix)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
 bool setup_config(int port) {
   set_config(create_config(port));
   return true;
@@ -25,6 +102,8 @@ int main(int argc, char *argv[]) {
   snprintf(server_ip, sizeof(server_ip), "%s:%d", REDIS_C_DEFAULT_HOST,
            conf.port);
 
+  /* one connection for the whole session, replaced only when it fails */
+  Client *client = NULL;
   while (1) {
     printf("%s> ", server_ip);
     fflush(stdout);
@@ -33,8 +112,10 @@ int main(int argc, char *argv[]) {
       break;
     }
 
-    Client *client = client_create();
-    client_connect(client, &conf);
+    if (!client) {
+      client = client_create();
+      client_connect(client, &conf);
+    }
 
     size_t req_size = strlen(input);
     size_t res_size = 0;
@@ -42,19 +123,20 @@ int main(int argc, char *argv[]) {
     char *response = client_send_request(client, input, req_size, &res_size);
     if (response == NULL) {
       printf("Connection error.\n");
+      free(client);
+      client = NULL;
       continue;
     }
 
-    int rc = *(int *)response;
-    char *msg = response + sizeof(int);
-
-    if (REDIS_SUCCESS(rc)) {
-      printf("OK. \n");
-    } else {
-      printf("Error: %d. %s\n", rc, msg);
+    size_t pos = 0;
+    while (pos < res_size) {
+      if (!print_reply(response, res_size, &pos, 0)) {
+        printf("Invalid reply from server.\n");
+        break;
+      }
     }
 
-    free(client);
     free(response);
   }
+  free(client);
 }
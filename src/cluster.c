@@ -0,0 +1,1903 @@
+#include "cluster.h"
+#include "cmd_handler.h"
+#include "logging.h"
+#include "redis-C/config.h"
+#include "storage.h"
+#include "util/str_util.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CLUSTER_SIG "RCmb"
+#define CLUSTER_PROTO_VER 1
+#define CLUSTER_IPLEN 46 /* INET6_ADDRSTRLEN */
+#define CLUSTER_SLOT_BYTES (CLUSTER_SLOTS / 8)
+
+#define CLUSTER_MSG_PING 0
+#define CLUSTER_MSG_PONG 1
+#define CLUSTER_MSG_MEET 2 /* a ping that makes the receiver add the sender */
+#define CLUSTER_MSG_FAIL 3
+#define CLUSTER_MSG_UPDATE 4 /* the sender's slots are stale: here's news */
+
+/* Message header; integers are big-endian */
+#define HDR_SIG 0
+#define HDR_TOTLEN 4
+#define HDR_VER 8
+#define HDR_TYPE 10
+#define HDR_COUNT 12 /* gossip entries that follow */
+#define HDR_PORT 14
+#define HDR_CPORT 16
+#define HDR_FLAGS 18
+#define HDR_CURRENT_EPOCH 20
+#define HDR_CONFIG_EPOCH 28
+#define HDR_SENDER 36
+#define HDR_SLOTS (HDR_SENDER + CLUSTER_NAMELEN)
+#define HDR_STATE (HDR_SLOTS + CLUSTER_SLOT_BYTES)
+#define HDR_LEN (HDR_STATE + 4)
+
+/* Gossip entry: what the sender knows about another node */
+#define GOSSIP_NAME 0
+#define GOSSIP_PING_SENT 40 /* seconds */
+#define GOSSIP_PONG_RECEIVED 44
+#define GOSSIP_IP 48
+#define GOSSIP_PORT (GOSSIP_IP + CLUSTER_IPLEN)
+#define GOSSIP_CPORT (GOSSIP_PORT + 2)
+#define GOSSIP_FLAGS (GOSSIP_CPORT + 2)
+#define GOSSIP_LEN (GOSSIP_FLAGS + 2)
+
+#define FAIL_LEN (HDR_LEN + CLUSTER_NAMELEN)
+#define UPDATE_LEN (HDR_LEN + 8 + CLUSTER_NAMELEN + CLUSTER_SLOT_BYTES)
+#define CLUSTER_MAX_MSG_LEN (HDR_LEN + 65535 * GOSSIP_LEN)
+
+#define CLUSTER_NODE_MYSELF (1 << 0)
+#define CLUSTER_NODE_MASTER (1 << 1)
+#define CLUSTER_NODE_PFAIL (1 << 2) /* not answering, in our opinion */
+#define CLUSTER_NODE_FAIL (1 << 3)  /* not answering, in a majority's */
+#define CLUSTER_NODE_HANDSHAKE (1 << 4) /* name not known yet */
+#define CLUSTER_NODE_MEET (1 << 5)      /* greet it with a MEET */
+
+/* Failure reports older than node_timeout * this are forgotten */
+#define CLUSTER_FAIL_REPORT_VALIDITY_MULT 2
+/* A FAIL node that has slots is trusted again after node_timeout * this */
+#define CLUSTER_FAIL_UNDO_TIME_MULT 2
+/* Pings carry gossip about a tenth of the nodes, at least this many */
+#define CLUSTER_MIN_GOSSIP 3
+#define CLUSTER_CRON_PER_SECOND 10
+#define CLUSTER_DEL_KEYS_BATCH 128
+
+typedef struct ClusterNode ClusterNode;
+
+typedef struct {
+  ClusterNode *node; /* who thinks it is failing */
+  long long time;
+} FailReport;
+
+/*
+ * A bus connection. We open one to every node and send our pings on it;
+ * the links other nodes open to us are anonymous and only answered.
+ */
+typedef struct {
+  int fd;
+  long long ctime;
+  bool connecting;   /* the non-blocking connect() is in progress */
+  ClusterNode *node; /* NULL for an inbound link */
+  ReplyBuffer snd;
+  size_t sent;
+  char *rcv;
+  size_t rcv_len;
+  size_t rcv_cap;
+} ClusterLink;
+
+struct ClusterNode {
+  char name[CLUSTER_NAMELEN];
+  int flags;
+  uint64_t config_epoch;
+  char ip[CLUSTER_IPLEN]; /* empty while unknown */
+  int port;
+  int cport;
+  long long ctime;
+  long long ping_sent; /* ms; 0 when no ping is waiting for a pong */
+  long long pong_received;
+  long long fail_time;
+  uint8_t slots[CLUSTER_SLOT_BYTES];
+  int numslots;
+  ClusterLink *link;
+  FailReport *reports;
+  int reports_len;
+};
+
+/* A parsed message header */
+typedef struct {
+  int type;
+  int count;
+  int port;
+  int cport;
+  int flags;
+  uint64_t current_epoch;
+  uint64_t config_epoch;
+  const char *sender;
+  const uint8_t *slots;
+  bool state_ok;
+} ClusterMsgHeader;
+
+bool g_cluster_enabled = false;
+
+/* everything below belongs to the main loop */
+static EventLoop *g_el = NULL;
+static int g_listen_fd = -1;
+static ClusterNode *g_myself = NULL;
+static ClusterNode **g_nodes = NULL;
+static int g_nodes_len = 0;
+static int g_nodes_cap = 0;
+static ClusterLink **g_inbound = NULL;
+static int g_inbound_len = 0;
+static int g_inbound_cap = 0;
+static ClusterNode *g_slots[CLUSTER_SLOTS];
+static ClusterNode *g_importing_from[CLUSTER_SLOTS];
+static ClusterNode *g_migrating_to[CLUSTER_SLOTS];
+static uint64_t g_current_epoch = 0;
+static bool g_state_ok = false;
+static int g_size = 0; /* nodes serving at least a slot */
+static bool g_save_pending = false;
+static unsigned long g_cron_runs = 0;
+static unsigned long long g_msgs_sent = 0;
+static unsigned long long g_msgs_received = 0;
+
+/* private functions */
+static int __set_nonblock(int fd);
+static void __put16(uint8_t *p, uint16_t v);
+static void __put32(uint8_t *p, uint32_t v);
+static void __put64(uint8_t *p, uint64_t v);
+static uint16_t __get16(const uint8_t *p);
+static uint32_t __get32(const uint8_t *p);
+static uint64_t __get64(const uint8_t *p);
+static bool __slot_bit(const uint8_t *slots, int slot);
+static ClusterNode *__node_create(const char *name, int flags);
+static void __node_delete(ClusterNode *n);
+static ClusterNode *__node_lookup(const char *name, size_t len);
+static void __node_rename(ClusterNode *n, const char *name);
+static void __add_slot(ClusterNode *n, int slot);
+static void __del_slot(int slot);
+static void __delete_keys_in_slot(int slot);
+static void __add_fail_report(ClusterNode *failing, ClusterNode *sender);
+static void __del_fail_report(ClusterNode *failing, ClusterNode *sender);
+static int __count_fail_reports(ClusterNode *n);
+static void __mark_failing_if_needed(ClusterNode *n);
+static void __update_state(void);
+static void __bump_epoch(void);
+static void __handle_epoch_collision(ClusterNode *sender);
+static void __update_slots_config(ClusterNode *sender, uint64_t epoch,
+                                  const uint8_t *slots);
+static bool __start_handshake(const char *ip, int port, int cport);
+static bool __normalize_ip(const char *ip, char *out);
+static void __peer_ip(int fd, char *ip, bool local);
+static ClusterLink *__link_create(int fd, ClusterNode *node);
+static void __link_free(ClusterLink *l);
+static void __link_connect(ClusterNode *n);
+static void __link_connect_failed(ClusterLink *l);
+static void __link_send(ClusterLink *l, const uint8_t *msg, size_t len);
+static void __link_flush(ClusterLink *l);
+static void __accept_handler(EventLoop *el, int fd, void *data, int mask);
+static void __connect_handler(EventLoop *el, int fd, void *data, int mask);
+static void __read_handler(EventLoop *el, int fd, void *data, int mask);
+static void __write_handler(EventLoop *el, int fd, void *data, int mask);
+static void __build_header(uint8_t *msg, int type, size_t totlen, int count);
+static void __send_ping(ClusterLink *l, int type);
+static void __send_fail(ClusterNode *failing);
+static void __send_update(ClusterLink *l, ClusterNode *n);
+static void __broadcast_pong(void);
+static bool __process_packet(ClusterLink *l, const uint8_t *msg, size_t len);
+static void __process_gossip(ClusterNode *sender, const uint8_t *gossip,
+                             int count);
+static void __node_flags(const ClusterNode *n, char *buf, size_t len);
+static void __appendf(ReplyBuffer *b, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+static void __describe_node(ReplyBuffer *b, const ClusterNode *n);
+static REDIS_RC __load_config(const char *path, bool *found);
+static bool __parse_node_line(char *line, bool slots_pass);
+static int __connect_timeout(const char *host, int port, long long timeout_ms);
+static bool __wait_fd(int fd, short events, long long timeout_ms);
+
+REDIS_RC cluster_init(EventLoop *el) {
+  const RedisCConfig *cfg = get_current_config();
+  if (!cfg->cluster_enabled) {
+    return REDIS_OK;
+  }
+  g_el = el;
+  REDIS_RC rc = storage_enable_slot_index();
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  bool found;
+  rc = __load_config(cfg->cluster_config_file, &found);
+  if (REDIS_FAILED(rc)) {
+    LOG_ERROR("Unable to load the cluster config %s",
+              cfg->cluster_config_file);
+    cluster_shutdown();
+    return rc;
+  }
+  if (!found) {
+    char name[CLUSTER_NAMELEN];
+    string_random_hex(name, CLUSTER_NAMELEN);
+    g_myself = __node_create(name, CLUSTER_NODE_MYSELF | CLUSTER_NODE_MASTER);
+    if (!g_myself) {
+      return REDIS_OUT_OF_MEMORY;
+    }
+    LOG_INFO("No cluster configuration found, I'm %.40s", g_myself->name);
+  }
+  g_myself->port = cfg->port;
+  g_myself->cport = cfg->port + CLUSTER_PORT_INCR;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((uint16_t)g_myself->cport);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (fd == -1 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1 ||
+      bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(fd, 511) == -1 || __set_nonblock(fd) == -1 ||
+      el_add_file_event(el, fd, EL_READABLE, __accept_handler, NULL) ==
+          EL_ERR) {
+    LOG_ERROR("Unable to listen on the cluster bus port %d", g_myself->cport);
+    if (fd != -1) {
+      close(fd);
+    }
+    cluster_shutdown();
+    return REDIS_CMD_CONNECTION_FAILED;
+  }
+  g_listen_fd = fd;
+  g_cluster_enabled = true;
+  __update_state();
+  return cluster_save_config();
+}
+
+void cluster_shutdown(void) {
+  if (g_save_pending) {
+    cluster_save_config();
+  }
+  while (g_inbound_len > 0) {
+    __link_free(g_inbound[0]);
+  }
+  free(g_inbound);
+  g_inbound = NULL;
+  g_inbound_cap = 0;
+  while (g_nodes_len > 0) {
+    __node_delete(g_nodes[g_nodes_len - 1]);
+  }
+  free(g_nodes);
+  g_nodes = NULL;
+  g_nodes_cap = 0;
+  g_myself = NULL;
+  if (g_listen_fd != -1) {
+    el_del_file_event(g_el, g_listen_fd, EL_READABLE);
+    close(g_listen_fd);
+    g_listen_fd = -1;
+  }
+  g_cluster_enabled = false;
+}
+
+void cluster_cron(void) {
+  if (!g_cluster_enabled) {
+    return;
+  }
+  long long now = el_mstime();
+  long long timeout = get_current_config()->cluster_node_timeout;
+  long long handshake_timeout = timeout > 1000 ? timeout : 1000;
+  g_cron_runs++;
+
+  for (int i = 0; i < g_nodes_len; i++) {
+    ClusterNode *n = g_nodes[i];
+    if (n == g_myself) {
+      continue;
+    }
+    if ((n->flags & CLUSTER_NODE_HANDSHAKE) &&
+        now - n->ctime > handshake_timeout) {
+      __node_delete(n);
+      i--;
+      continue;
+    }
+    if (!n->link) {
+      __link_connect(n);
+    }
+  }
+
+  /* once a second, ping one of a few random nodes: the one we heard of last */
+  if (g_cron_runs % CLUSTER_CRON_PER_SECOND == 0 && g_nodes_len > 1) {
+    ClusterNode *oldest = NULL;
+    for (int i = 0; i < 5; i++) {
+      ClusterNode *n = g_nodes[rand() % g_nodes_len];
+      if (n == g_myself || !n->link || n->link->connecting ||
+          n->ping_sent != 0 || (n->flags & CLUSTER_NODE_HANDSHAKE)) {
+        continue;
+      }
+      if (!oldest || n->pong_received < oldest->pong_received) {
+        oldest = n;
+      }
+    }
+    if (oldest) {
+      __send_ping(oldest->link, CLUSTER_MSG_PING);
+    }
+  }
+
+  bool changed = false;
+  for (int i = 0; i < g_nodes_len; i++) {
+    ClusterNode *n = g_nodes[i];
+    if (n == g_myself || (n->flags & CLUSTER_NODE_HANDSHAKE)) {
+      continue;
+    }
+    ClusterLink *l = n->link;
+    /* a pong half a timeout late: maybe the link is the problem, reconnect */
+    if (l && !l->connecting && n->ping_sent &&
+        now - l->ctime > timeout && now - n->ping_sent > timeout / 2) {
+      __link_free(l);
+      l = NULL;
+    }
+    /* nobody else pinged it for half a timeout */
+    if (l && !l->connecting && n->ping_sent == 0 &&
+        now - n->pong_received > timeout / 2) {
+      __send_ping(l, CLUSTER_MSG_PING);
+      continue;
+    }
+    if (n->ping_sent && now - n->ping_sent > timeout &&
+        !(n->flags & (CLUSTER_NODE_PFAIL | CLUSTER_NODE_FAIL))) {
+      LOG_DEBUG("*** NODE %.40s possibly failing", n->name);
+      n->flags |= CLUSTER_NODE_PFAIL;
+      changed = true;
+    }
+  }
+  if (changed || g_cron_runs % CLUSTER_CRON_PER_SECOND == 0) {
+    __update_state();
+  }
+}
+
+void cluster_before_sleep(void) {
+  if (g_cluster_enabled && g_save_pending) {
+    cluster_save_config();
+  }
+}
+
+bool cluster_serves_request(int argc, char **argv, size_t *argv_len,
+                            bool asking, ReplyBuffer *reply) {
+  const RedisCommand *c = command_lookup(argv[0], argv_len[0]);
+  if (!c) {
+    return true;
+  }
+  int stack_keys[16];
+  int *keys = argc <= 16 ? stack_keys : malloc(argc * sizeof(int));
+  if (!keys) {
+    return true;
+  }
+  int n = command_get_keys(argc, argv, argv_len, keys);
+  int slot = -1;
+  bool cross_slot = false;
+  int missing = 0;
+  for (int i = 0; i < n; i++) {
+    int s = (int)hash_key_slot(argv[keys[i]], argv_len[keys[i]]);
+    if (i > 0 && s != slot) {
+      cross_slot = true;
+      break;
+    }
+    slot = s;
+  }
+  /* only a slot on the move can be partially here */
+  if (!cross_slot && n > 0 &&
+      (g_migrating_to[slot] || g_importing_from[slot])) {
+    for (int i = 0; i < n; i++) {
+      if (!storage_lookup(argv[keys[i]], argv_len[keys[i]])) {
+        missing++;
+      }
+    }
+  }
+  if (keys != stack_keys) {
+    free(keys);
+  }
+  if (n == 0) {
+    return true;
+  }
+  if (cross_slot) {
+    reply_add_error(reply,
+                    "CROSSSLOT Keys in request don't hash to the same slot");
+    return false;
+  }
+  if (!g_state_ok) {
+    reply_add_error(reply, "CLUSTERDOWN The cluster is down");
+    return false;
+  }
+  ClusterNode *owner = g_slots[slot];
+  if (!owner) {
+    reply_add_error(reply, "CLUSTERDOWN Hash slot not served");
+    return false;
+  }
+  /* MIGRATE has to run wherever the keys still are */
+  if (c->type == CMD_MIGRATE && owner == g_myself) {
+    return true;
+  }
+  if (owner == g_myself && g_migrating_to[slot] && missing > 0) {
+    if (missing < n) {
+      reply_add_error(reply,
+                      "TRYAGAIN Multiple keys request during rehashing of "
+                      "slot");
+    } else {
+      ClusterNode *to = g_migrating_to[slot];
+      reply_add_error_format(reply, "ASK %d %s:%d", slot, to->ip, to->port);
+    }
+    return false;
+  }
+  if (owner != g_myself && g_importing_from[slot] &&
+      (asking || (c->flags & CMD_FLAG_ASKING))) {
+    if (n > 1 && missing > 0) {
+      reply_add_error(reply,
+                      "TRYAGAIN Multiple keys request during rehashing of "
+                      "slot");
+      return false;
+    }
+    return true;
+  }
+  if (owner != g_myself) {
+    reply_add_error_format(reply, "MOVED %d %s:%d", slot, owner->ip,
+                           owner->port);
+    return false;
+  }
+  return true;
+}
+
+const char *cluster_myid(void) {
+  static char id[CLUSTER_NAMELEN + 1];
+  memcpy(id, g_myself->name, CLUSTER_NAMELEN);
+  return id;
+}
+
+void cluster_reply_info(ReplyBuffer *reply) {
+  int assigned = 0, pfail = 0, fail = 0;
+  for (int j = 0; j < CLUSTER_SLOTS; j++) {
+    ClusterNode *n = g_slots[j];
+    if (!n) {
+      continue;
+    }
+    assigned++;
+    if (n->flags & CLUSTER_NODE_FAIL) {
+      fail++;
+    } else if (n->flags & CLUSTER_NODE_PFAIL) {
+      pfail++;
+    }
+  }
+  char buf[1024];
+  int len = snprintf(buf, sizeof(buf),
+                     "cluster_enabled:1\r\n"
+                     "cluster_state:%s\r\n"
+                     "cluster_slots_assigned:%d\r\n"
+                     "cluster_slots_ok:%d\r\n"
+                     "cluster_slots_pfail:%d\r\n"
+                     "cluster_slots_fail:%d\r\n"
+                     "cluster_known_nodes:%d\r\n"
+                     "cluster_size:%d\r\n"
+                     "cluster_current_epoch:%llu\r\n"
+                     "cluster_my_epoch:%llu\r\n"
+                     "cluster_stats_messages_sent:%llu\r\n"
+                     "cluster_stats_messages_received:%llu\r\n",
+                     g_state_ok ? "ok" : "fail", assigned,
+                     assigned - pfail - fail, pfail, fail, g_nodes_len, g_size,
+                     (unsigned long long)g_current_epoch,
+                     (unsigned long long)g_myself->config_epoch, g_msgs_sent,
+                     g_msgs_received);
+  reply_add_bulk(reply, buf, (size_t)len);
+}
+
+void cluster_reply_nodes(ReplyBuffer *reply) {
+  ReplyBuffer b;
+  reply_init(&b, RESP_PROTO_2);
+  for (int i = 0; i < g_nodes_len; i++) {
+    if (!(g_nodes[i]->flags & CLUSTER_NODE_HANDSHAKE) ||
+        g_nodes[i]->ip[0]) {
+      __describe_node(&b, g_nodes[i]);
+    }
+  }
+  if (b.oom) {
+    reply_add_error(reply, redis_rc_message(REDIS_OUT_OF_MEMORY));
+  } else {
+    reply_add_bulk(reply, b.buf ? b.buf : "", b.len);
+  }
+  reply_free(&b);
+}
+
+/* [[start, end, [ip, port, id]], ...] for every range of slots */
+void cluster_reply_slots(ReplyBuffer *reply) {
+  long ranges = 0;
+  for (int j = 0; j < CLUSTER_SLOTS; j++) {
+    if (g_slots[j] && (j == 0 || g_slots[j - 1] != g_slots[j])) {
+      ranges++;
+    }
+  }
+  reply_add_array_len(reply, ranges);
+  for (int start = 0; start < CLUSTER_SLOTS;) {
+    ClusterNode *n = g_slots[start];
+    int end = start;
+    while (end + 1 < CLUSTER_SLOTS && g_slots[end + 1] == n) {
+      end++;
+    }
+    if (n) {
+      reply_add_array_len(reply, 3);
+      reply_add_integer(reply, start);
+      reply_add_integer(reply, end);
+      reply_add_array_len(reply, 3);
+      reply_add_bulk_cstr(reply, n->ip);
+      reply_add_integer(reply, n->port);
+      reply_add_bulk(reply, n->name, CLUSTER_NAMELEN);
+    }
+    start = end + 1;
+  }
+}
+
+REDIS_RC cluster_meet(const char *ip, int port) {
+  char norm[CLUSTER_IPLEN];
+  if (port <= 0 || port + CLUSTER_PORT_INCR > 65535 ||
+      !__normalize_ip(ip, norm)) {
+    return REDIS_CLUSTER_INVALID_ADDRESS;
+  }
+  __start_handshake(norm, port, port + CLUSTER_PORT_INCR);
+  return REDIS_OK;
+}
+
+REDIS_RC cluster_add_slots(const uint8_t *slots) {
+  for (int j = 0; j < CLUSTER_SLOTS; j++) {
+    if (slots[j] && g_slots[j]) {
+      return REDIS_CLUSTER_SLOT_BUSY;
+    }
+  }
+  for (int j = 0; j < CLUSTER_SLOTS; j++) {
+    if (slots[j]) {
+      /* the slot is ours now, whatever was said about it */
+      g_importing_from[j] = NULL;
+      __add_slot(g_myself, j);
+    }
+  }
+  __update_state();
+  g_save_pending = true;
+  return REDIS_OK;
+}
+
+REDIS_RC cluster_del_slots(const uint8_t *slots) {
+  for (int j = 0; j < CLUSTER_SLOTS; j++) {
+    if (slots[j] && !g_slots[j]) {
+      return REDIS_CLUSTER_SLOT_UNASSIGNED;
+    }
+  }
+  for (int j = 0; j < CLUSTER_SLOTS; j++) {
+    if (slots[j]) {
+      __del_slot(j);
+      g_importing_from[j] = NULL;
+      g_migrating_to[j] = NULL;
+    }
+  }
+  __update_state();
+  g_save_pending = true;
+  return REDIS_OK;
+}
+
+REDIS_RC cluster_set_slot(int slot, ClusterSetSlot how, const char *node,
+                          size_t node_len) {
+  ClusterNode *n = NULL;
+  if (how != CLUSTER_SETSLOT_STABLE) {
+    n = __node_lookup(node, node_len);
+    if (!n || (n->flags & CLUSTER_NODE_HANDSHAKE)) {
+      return REDIS_CLUSTER_UNKNOWN_NODE;
+    }
+  }
+  switch (how) {
+  case CLUSTER_SETSLOT_MIGRATING:
+    if (g_slots[slot] != g_myself) {
+      return REDIS_CLUSTER_NOT_OWNER;
+    }
+    g_migrating_to[slot] = n;
+    break;
+  case CLUSTER_SETSLOT_IMPORTING:
+    if (g_slots[slot] == g_myself) {
+      return REDIS_CLUSTER_ALREADY_OWNER;
+    }
+    g_importing_from[slot] = n;
+    break;
+  case CLUSTER_SETSLOT_STABLE:
+    g_importing_from[slot] = NULL;
+    g_migrating_to[slot] = NULL;
+    break;
+  case CLUSTER_SETSLOT_NODE:
+    /* giving away a slot that still has keys would lose them */
+    if (g_slots[slot] == g_myself && n != g_myself &&
+        storage_slot_size((unsigned int)slot) > 0) {
+      return REDIS_CLUSTER_SLOT_NOT_EMPTY;
+    }
+    if (n != g_myself) {
+      g_migrating_to[slot] = NULL;
+    }
+    __del_slot(slot);
+    __add_slot(n, slot);
+    /*
+     * The end of an import: claim the slot with an epoch nobody else has,
+     * so our claim beats the old owner's, and tell everyone right away.
+     */
+    if (n == g_myself && g_importing_from[slot]) {
+      g_importing_from[slot] = NULL;
+      __bump_epoch();
+      __broadcast_pong();
+    }
+    break;
+  }
+  __update_state();
+  g_save_pending = true;
+  return REDIS_OK;
+}
+
+/* Written to a temporary file first, so a crash leaves the old one intact */
+REDIS_RC cluster_save_config(void) {
+  const char *path = get_current_config()->cluster_config_file;
+  ReplyBuffer b;
+  reply_init(&b, RESP_PROTO_2);
+  for (int i = 0; i < g_nodes_len; i++) {
+    if (!(g_nodes[i]->flags & CLUSTER_NODE_HANDSHAKE)) {
+      __describe_node(&b, g_nodes[i]);
+    }
+  }
+  __appendf(&b, "vars currentEpoch %llu lastVoteEpoch 0\n",
+            (unsigned long long)g_current_epoch);
+  if (b.oom) {
+    reply_free(&b);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  char tmp[1024];
+  snprintf(tmp, sizeof(tmp), "%s.tmp-%d", path, (int)getpid());
+  FILE *f = fopen(tmp, "w");
+  bool ok = f && fwrite(b.buf, 1, b.len, f) == b.len && fflush(f) == 0 &&
+            fsync(fileno(f)) == 0;
+  if (f && fclose(f) != 0) {
+    ok = false;
+  }
+  reply_free(&b);
+  if (!ok || rename(tmp, path) == -1) {
+    LOG_WARNING("Unable to save the cluster config to %s", path);
+    unlink(tmp);
+    return REDIS_IO_ERROR;
+  }
+  g_save_pending = false;
+  return REDIS_OK;
+}
+
+REDIS_RC cluster_migrate_send(const char *host, int port, long long timeout_ms,
+                              const char *req, size_t len, int count, bool *ok,
+                              char *err, size_t err_len) {
+  int fd = __connect_timeout(host, port, timeout_ms);
+  if (fd == -1) {
+    return REDIS_CLUSTER_MIGRATE_IO;
+  }
+  REDIS_RC rc = REDIS_OK;
+  size_t sent = 0;
+  while (sent < len) {
+    if (!__wait_fd(fd, POLLOUT, timeout_ms)) {
+      rc = REDIS_CLUSTER_MIGRATE_IO;
+      break;
+    }
+    ssize_t n = write(fd, req + sent, len - sent);
+    if (n == -1 && errno != EAGAIN && errno != EINTR) {
+      rc = REDIS_CLUSTER_MIGRATE_IO;
+      break;
+    }
+    sent += n > 0 ? (size_t)n : 0;
+  }
+
+  /* every command answers with a single line: +OK or -ERR ... */
+  char buf[4096];
+  size_t buf_len = 0;
+  int replies = 0;
+  err[0] = '\0';
+  while (REDIS_SUCCESS(rc) && replies < count) {
+    char *eol = memchr(buf, '\n', buf_len);
+    if (!eol) {
+      if (buf_len == sizeof(buf)) {
+        buf_len = 0; /* an absurdly long error: keep its tail */
+      }
+      if (!__wait_fd(fd, POLLIN, timeout_ms)) {
+        rc = REDIS_CLUSTER_MIGRATE_IO;
+        break;
+      }
+      ssize_t n = read(fd, buf + buf_len, sizeof(buf) - buf_len);
+      if (n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) {
+        rc = REDIS_CLUSTER_MIGRATE_IO;
+        break;
+      }
+      buf_len += n > 0 ? (size_t)n : 0;
+      continue;
+    }
+    size_t line = (size_t)(eol - buf);
+    ok[replies] = buf[0] == '+';
+    if (!ok[replies] && !err[0]) {
+      size_t n = line > 0 && buf[line - 1] == '\r' ? line - 2 : line - 1;
+      snprintf(err, err_len, "%.*s", (int)n, buf + 1);
+    }
+    replies++;
+    memmove(buf, eol + 1, buf_len - line - 1);
+    buf_len -= line + 1;
+  }
+  close(fd);
+  return rc;
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static int __set_nonblock(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags == -1) {
+    return -1;
+  }
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void __put16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+static void __put32(uint8_t *p, uint32_t v) {
+  __put16(p, (uint16_t)(v >> 16));
+  __put16(p + 2, (uint16_t)v);
+}
+
+static void __put64(uint8_t *p, uint64_t v) {
+  __put32(p, (uint32_t)(v >> 32));
+  __put32(p + 4, (uint32_t)v);
+}
+
+static uint16_t __get16(const uint8_t *p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t __get32(const uint8_t *p) {
+  return ((uint32_t)__get16(p) << 16) | __get16(p + 2);
+}
+
+static uint64_t __get64(const uint8_t *p) {
+  return ((uint64_t)__get32(p) << 32) | __get32(p + 4);
+}
+
+static bool __slot_bit(const uint8_t *slots, int slot) {
+  return (slots[slot >> 3] >> (slot & 7)) & 1;
+}
+
+static ClusterNode *__node_create(const char *name, int flags) {
+  if (g_nodes_len == g_nodes_cap) {
+    int cap = g_nodes_cap ? g_nodes_cap * 2 : 16;
+    ClusterNode **nodes = realloc(g_nodes, cap * sizeof(ClusterNode *));
+    if (!nodes) {
+      return NULL;
+    }
+    g_nodes = nodes;
+    g_nodes_cap = cap;
+  }
+  ClusterNode *n = calloc(1, sizeof(ClusterNode));
+  if (!n) {
+    return NULL;
+  }
+  memcpy(n->name, name, CLUSTER_NAMELEN);
+  n->flags = flags;
+  n->ctime = el_mstime();
+  g_nodes[g_nodes_len++] = n;
+  return n;
+}
+
+/* Forget `n` and everything that points to it */
+static void __node_delete(ClusterNode *n) {
+  for (int j = 0; j < CLUSTER_SLOTS; j++) {
+    if (g_slots[j] == n) {
+      __del_slot(j);
+    }
+    if (g_importing_from[j] == n) {
+      g_importing_from[j] = NULL;
+    }
+    if (g_migrating_to[j] == n) {
+      g_migrating_to[j] = NULL;
+    }
+  }
+  for (int i = 0; i < g_nodes_len; i++) {
+    if (g_nodes[i] == n) {
+      g_nodes[i] = g_nodes[--g_nodes_len];
+      i--;
+    } else {
+      __del_fail_report(g_nodes[i], n);
+    }
+  }
+  for (int i = 0; i < g_inbound_len; i++) {
+    if (g_inbound[i]->node == n) {
+      g_inbound[i]->node = NULL;
+    }
+  }
+  if (n->link) {
+    __link_free(n->link);
+  }
+  free(n->reports);
+  free(n);
+}
+
+static ClusterNode *__node_lookup(const char *name, size_t len) {
+  if (len != CLUSTER_NAMELEN) {
+    return NULL;
+  }
+  for (int i = 0; i < g_nodes_len; i++) {
+    if (memcmp(g_nodes[i]->name, name, CLUSTER_NAMELEN) == 0) {
+      return g_nodes[i];
+    }
+  }
+  return NULL;
+}
+
+/* The end of a handshake: the node told us its real name */
+static void __node_rename(ClusterNode *n, const char *name) {
+  LOG_DEBUG("Renaming node %.40s into %.40s", n->name, name);
+  memcpy(n->name, name, CLUSTER_NAMELEN);
+  g_save_pending = true;
+}
+
+static void __add_slot(ClusterNode *n, int slot) {
+  g_slots[slot] = n;
+  n->slots[slot >> 3] |= (uint8_t)(1 << (slot & 7));
+  n->numslots++;
+}
+
+static void __del_slot(int slot) {
+  ClusterNode *n = g_slots[slot];
+  if (!n) {
+    return;
+  }
+  n->slots[slot >> 3] &= (uint8_t)~(1 << (slot & 7));
+  n->numslots--;
+  g_slots[slot] = NULL;
+}
+
+/* Keys of a slot another node took over are unreachable: drop them */
+static void __delete_keys_in_slot(int slot) {
+  const char *keys[CLUSTER_DEL_KEYS_BATCH];
+  size_t lens[CLUSTER_DEL_KEYS_BATCH];
+  size_t n;
+  while ((n = storage_slot_keys((unsigned int)slot, keys, lens,
+                                CLUSTER_DEL_KEYS_BATCH)) > 0) {
+    /* the views die with the first deletion: copy them first */
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+      total += lens[i];
+    }
+    char *copy = malloc(total ? total : 1);
+    if (!copy) {
+      return;
+    }
+    char *p = copy;
+    for (size_t i = 0; i < n; i++) {
+      memcpy(p, keys[i], lens[i]);
+      p += lens[i];
+    }
+    p = copy;
+    for (size_t i = 0; i < n; i++) {
+      storage_delete(p, lens[i]);
+      p += lens[i];
+    }
+    free(copy);
+  }
+}
+
+static void __add_fail_report(ClusterNode *failing, ClusterNode *sender) {
+  long long now = el_mstime();
+  for (int i = 0; i < failing->reports_len; i++) {
+    if (failing->reports[i].node == sender) {
+      failing->reports[i].time = now;
+      return;
+    }
+  }
+  FailReport *r = realloc(failing->reports,
+                          (failing->reports_len + 1) * sizeof(FailReport));
+  if (!r) {
+    return;
+  }
+  failing->reports = r;
+  failing->reports[failing->reports_len++] = (FailReport){sender, now};
+}
+
+static void __del_fail_report(ClusterNode *failing, ClusterNode *sender) {
+  for (int i = 0; i < failing->reports_len; i++) {
+    if (failing->reports[i].node == sender) {
+      failing->reports[i] = failing->reports[--failing->reports_len];
+      return;
+    }
+  }
+}
+
+/* Reports still valid, dropping the expired ones */
+static int __count_fail_reports(ClusterNode *n) {
+  long long max_age = get_current_config()->cluster_node_timeout *
+                      CLUSTER_FAIL_REPORT_VALIDITY_MULT;
+  long long now = el_mstime();
+  for (int i = 0; i < n->reports_len; i++) {
+    if (now - n->reports[i].time > max_age) {
+      n->reports[i--] = n->reports[--n->reports_len];
+    }
+  }
+  return n->reports_len;
+}
+
+/*
+ * PFAIL becomes FAIL once a majority of the nodes serving slots (us
+ * included) reported it; the verdict is then broadcast so every node
+ * agrees at once.
+ */
+static void __mark_failing_if_needed(ClusterNode *n) {
+  if (!(n->flags & CLUSTER_NODE_PFAIL) || (n->flags & CLUSTER_NODE_FAIL)) {
+    return;
+  }
+  int needed = g_size / 2 + 1;
+  if (__count_fail_reports(n) + 1 < needed) {
+    return;
+  }
+  LOG_NOTICE("Marking node %.40s as failing (quorum reached).", n->name);
+  n->flags &= ~CLUSTER_NODE_PFAIL;
+  n->flags |= CLUSTER_NODE_FAIL;
+  n->fail_time = el_mstime();
+  __send_fail(n);
+  __update_state();
+  g_save_pending = true;
+}
+
+/* Every slot must be served by a node that is not failing */
+static void __update_state(void) {
+  bool ok = true;
+  for (int j = 0; j < CLUSTER_SLOTS && ok; j++) {
+    ok = g_slots[j] && !(g_slots[j]->flags & CLUSTER_NODE_FAIL);
+  }
+  int size = 0;
+  for (int i = 0; i < g_nodes_len; i++) {
+    if (g_nodes[i]->numslots > 0) {
+      size++;
+    }
+  }
+  if (ok != g_state_ok) {
+    LOG_NOTICE("Cluster state changed: %s", ok ? "ok" : "fail");
+  }
+  g_state_ok = ok;
+  g_size = size;
+}
+
+/* Take a config epoch greater than any other, without asking anyone */
+static void __bump_epoch(void) {
+  uint64_t max = g_current_epoch;
+  for (int i = 0; i < g_nodes_len; i++) {
+    if (g_nodes[i]->config_epoch > max) {
+      max = g_nodes[i]->config_epoch;
+    }
+  }
+  if (g_myself->config_epoch == 0 || g_myself->config_epoch != max) {
+    g_current_epoch = max + 1;
+    g_myself->config_epoch = g_current_epoch;
+    g_save_pending = true;
+    LOG_NOTICE("New configEpoch set to %llu",
+               (unsigned long long)g_myself->config_epoch);
+  }
+}
+
+/*
+ * Two nodes with the same config epoch could both win a slot: the one with
+ * the smaller name moves to a new epoch, so all epochs end up distinct.
+ */
+static void __handle_epoch_collision(ClusterNode *sender) {
+  if (sender->config_epoch != g_myself->config_epoch ||
+      memcmp(sender->name, g_myself->name, CLUSTER_NAMELEN) <= 0) {
+    return;
+  }
+  g_current_epoch++;
+  g_myself->config_epoch = g_current_epoch;
+  g_save_pending = true;
+  LOG_DEBUG("configEpoch collision with node %.40s: configEpoch set to %llu",
+            sender->name, (unsigned long long)g_current_epoch);
+}
+
+/* Give `sender` the slots it claims with a newer config than their owner */
+static void __update_slots_config(ClusterNode *sender, uint64_t epoch,
+                                  const uint8_t *slots) {
+  bool changed = false;
+  for (int j = 0; j < CLUSTER_SLOTS; j++) {
+    if (!__slot_bit(slots, j) || g_slots[j] == sender ||
+        g_importing_from[j]) {
+      continue;
+    }
+    if (g_slots[j] && g_slots[j]->config_epoch >= epoch) {
+      continue;
+    }
+    if (g_slots[j] == g_myself) {
+      g_migrating_to[j] = NULL;
+      __delete_keys_in_slot(j);
+    }
+    __del_slot(j);
+    __add_slot(sender, j);
+    changed = true;
+  }
+  if (changed) {
+    __update_state();
+    g_save_pending = true;
+  }
+}
+
+/* Start meeting ip:port, unless that is already going on */
+static bool __start_handshake(const char *ip, int port, int cport) {
+  for (int i = 0; i < g_nodes_len; i++) {
+    ClusterNode *n = g_nodes[i];
+    if ((n->flags & CLUSTER_NODE_HANDSHAKE) && n->port == port &&
+        strcmp(n->ip, ip) == 0) {
+      return false;
+    }
+  }
+  char name[CLUSTER_NAMELEN];
+  string_random_hex(name, CLUSTER_NAMELEN);
+  ClusterNode *n =
+      __node_create(name, CLUSTER_NODE_HANDSHAKE | CLUSTER_NODE_MEET);
+  if (!n) {
+    return false;
+  }
+  snprintf(n->ip, sizeof(n->ip), "%s", ip);
+  n->port = port;
+  n->cport = cport;
+  return true;
+}
+
+/* Numeric IPv4 or IPv6 only, in its canonical form */
+static bool __normalize_ip(const char *ip, char *out) {
+  struct in_addr a4;
+  struct in6_addr a6;
+  if (inet_pton(AF_INET, ip, &a4) == 1) {
+    return inet_ntop(AF_INET, &a4, out, CLUSTER_IPLEN) != NULL;
+  }
+  if (inet_pton(AF_INET6, ip, &a6) == 1) {
+    return inet_ntop(AF_INET6, &a6, out, CLUSTER_IPLEN) != NULL;
+  }
+  return false;
+}
+
+/* The address of the peer of `fd`, or our own end of it with `local` */
+static void __peer_ip(int fd, char *ip, bool local) {
+  struct sockaddr_storage sa;
+  socklen_t sa_len = sizeof(sa);
+  int r = local ? getsockname(fd, (struct sockaddr *)&sa, &sa_len)
+                : getpeername(fd, (struct sockaddr *)&sa, &sa_len);
+  ip[0] = '\0';
+  if (r == -1) {
+    return;
+  }
+  if (sa.ss_family == AF_INET) {
+    inet_ntop(AF_INET, &((struct sockaddr_in *)&sa)->sin_addr, ip,
+              CLUSTER_IPLEN);
+  } else if (sa.ss_family == AF_INET6) {
+    inet_ntop(AF_INET6, &((struct sockaddr_in6 *)&sa)->sin6_addr, ip,
+              CLUSTER_IPLEN);
+  }
+}
+
+static ClusterLink *__link_create(int fd, ClusterNode *node) {
+  ClusterLink *l = calloc(1, sizeof(ClusterLink));
+  if (!l) {
+    return NULL;
+  }
+  if (!node) {
+    if (g_inbound_len == g_inbound_cap) {
+      int cap = g_inbound_cap ? g_inbound_cap * 2 : 16;
+      ClusterLink **links = realloc(g_inbound, cap * sizeof(ClusterLink *));
+      if (!links) {
+        free(l);
+        return NULL;
+      }
+      g_inbound = links;
+      g_inbound_cap = cap;
+    }
+    g_inbound[g_inbound_len++] = l;
+  }
+  l->fd = fd;
+  l->ctime = el_mstime();
+  l->node = node;
+  reply_init(&l->snd, RESP_PROTO_2);
+  return l;
+}
+
+static void __link_free(ClusterLink *l) {
+  if (l->node && l->node->link == l) {
+    l->node->link = NULL;
+  } else {
+    for (int i = 0; i < g_inbound_len; i++) {
+      if (g_inbound[i] == l) {
+        g_inbound[i] = g_inbound[--g_inbound_len];
+        break;
+      }
+    }
+  }
+  el_del_file_event(g_el, l->fd, EL_READABLE | EL_WRITABLE);
+  close(l->fd);
+  reply_free(&l->snd);
+  free(l->rcv);
+  free(l);
+}
+
+static void __link_connect(ClusterNode *n) {
+  struct sockaddr_storage sa;
+  socklen_t sa_len;
+  memset(&sa, 0, sizeof(sa));
+  struct sockaddr_in *in = (struct sockaddr_in *)&sa;
+  struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&sa;
+  if (inet_pton(AF_INET, n->ip, &in->sin_addr) == 1) {
+    in->sin_family = AF_INET;
+    in->sin_port = htons((uint16_t)n->cport);
+    sa_len = sizeof(*in);
+  } else if (inet_pton(AF_INET6, n->ip, &in6->sin6_addr) == 1) {
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port = htons((uint16_t)n->cport);
+    sa_len = sizeof(*in6);
+  } else {
+    return; /* we don't know where it is yet */
+  }
+  int fd = socket(sa.ss_family, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return;
+  }
+  ClusterLink *l = __link_create(fd, n);
+  if (!l) {
+    close(fd);
+    return;
+  }
+  l->connecting = true;
+  n->link = l;
+  int yes = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+  if (__set_nonblock(fd) == -1 ||
+      (connect(fd, (struct sockaddr *)&sa, sa_len) == -1 &&
+       errno != EINPROGRESS) ||
+      el_add_file_event(g_el, fd, EL_WRITABLE, __connect_handler, l) ==
+          EL_ERR) {
+    __link_connect_failed(l);
+  }
+}
+
+/*
+ * A node we cannot connect to counts as one that does not answer our
+ * pings, or a dead node would never be flagged.
+ */
+static void __link_connect_failed(ClusterLink *l) {
+  if (l->node->ping_sent == 0) {
+    l->node->ping_sent = el_mstime();
+  }
+  __link_free(l);
+}
+
+static void __link_send(ClusterLink *l, const uint8_t *msg, size_t len) {
+  reply_add_raw(&l->snd, (const char *)msg, len);
+  g_msgs_sent++;
+  if (!l->connecting) {
+    __link_flush(l);
+  }
+}
+
+/* Write what the socket takes; the rest waits for it to be writable */
+static void __link_flush(ClusterLink *l) {
+  while (l->sent < l->snd.len) {
+    ssize_t n = write(l->fd, l->snd.buf + l->sent, l->snd.len - l->sent);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return; /* the read side notices and drops the link */
+      }
+      if (!(el_get_file_events(g_el, l->fd) & EL_WRITABLE)) {
+        el_add_file_event(g_el, l->fd, EL_WRITABLE, __write_handler, l);
+      }
+      return;
+    }
+    l->sent += (size_t)n;
+  }
+  reply_clear(&l->snd);
+  l->sent = 0;
+  if (el_get_file_events(g_el, l->fd) & EL_WRITABLE) {
+    el_del_file_event(g_el, l->fd, EL_WRITABLE);
+  }
+}
+
+static void __accept_handler(EventLoop *el, int fd, void *data, int mask) {
+  (void)data;
+  (void)mask;
+  for (;;) {
+    int cfd = accept(fd, NULL, NULL);
+    if (cfd == -1) {
+      return;
+    }
+    int yes = 1;
+    __set_nonblock(cfd);
+    setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    ClusterLink *l = __link_create(cfd, NULL);
+    if (!l) {
+      close(cfd);
+      continue;
+    }
+    if (el_add_file_event(el, cfd, EL_READABLE, __read_handler, l) ==
+        EL_ERR) {
+      __link_free(l);
+    }
+  }
+}
+
+/* The outbound connection is up (or failed): greet the node */
+static void __connect_handler(EventLoop *el, int fd, void *data, int mask) {
+  (void)mask;
+  ClusterLink *l = data;
+  int err = 0;
+  socklen_t err_len = sizeof(err);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == -1 || err) {
+    __link_connect_failed(l);
+    return;
+  }
+  el_del_file_event(el, fd, EL_WRITABLE);
+  if (el_add_file_event(el, fd, EL_READABLE, __read_handler, l) == EL_ERR) {
+    __link_free(l);
+    return;
+  }
+  l->connecting = false;
+  ClusterNode *n = l->node;
+  /* a reconnection keeps the ping that was waiting: it is what times out */
+  long long ping_sent = n->ping_sent;
+  __send_ping(l, (n->flags & CLUSTER_NODE_MEET) ? CLUSTER_MSG_MEET
+                                                 : CLUSTER_MSG_PING);
+  if (ping_sent) {
+    n->ping_sent = ping_sent;
+  }
+  n->flags &= ~CLUSTER_NODE_MEET;
+}
+
+static void __read_handler(EventLoop *el, int fd, void *data, int mask) {
+  (void)el;
+  (void)mask;
+  ClusterLink *l = data;
+  for (;;) {
+    if (l->rcv_cap - l->rcv_len < 4096) {
+      size_t cap = l->rcv_cap ? l->rcv_cap * 2 : 16384;
+      char *buf = realloc(l->rcv, cap);
+      if (!buf) {
+        __link_free(l);
+        return;
+      }
+      l->rcv = buf;
+      l->rcv_cap = cap;
+    }
+    ssize_t n = read(fd, l->rcv + l->rcv_len, l->rcv_cap - l->rcv_len);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    } else if (n == -1 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      __link_free(l);
+      return;
+    }
+    l->rcv_len += (size_t)n;
+
+    size_t pos = 0;
+    while (l->rcv_len - pos >= 8) {
+      const uint8_t *msg = (const uint8_t *)l->rcv + pos;
+      uint32_t totlen = __get32(msg + HDR_TOTLEN);
+      if (memcmp(msg, CLUSTER_SIG, 4) != 0 || totlen < HDR_LEN ||
+          totlen > CLUSTER_MAX_MSG_LEN) {
+        LOG_WARNING("Dropping a cluster bus link that sent garbage");
+        __link_free(l);
+        return;
+      }
+      if (l->rcv_len - pos < totlen) {
+        break;
+      }
+      if (!__process_packet(l, msg, totlen)) {
+        return; /* the link is gone */
+      }
+      pos += totlen;
+    }
+    memmove(l->rcv, l->rcv + pos, l->rcv_len - pos);
+    l->rcv_len -= pos;
+  }
+}
+
+static void __write_handler(EventLoop *el, int fd, void *data, int mask) {
+  (void)el;
+  (void)fd;
+  (void)mask;
+  __link_flush(data);
+}
+
+static void __build_header(uint8_t *msg, int type, size_t totlen, int count) {
+  const RedisCConfig *cfg = get_current_config();
+  memset(msg, 0, HDR_LEN);
+  memcpy(msg + HDR_SIG, CLUSTER_SIG, 4);
+  __put32(msg + HDR_TOTLEN, (uint32_t)totlen);
+  __put16(msg + HDR_VER, CLUSTER_PROTO_VER);
+  __put16(msg + HDR_TYPE, (uint16_t)type);
+  __put16(msg + HDR_COUNT, (uint16_t)count);
+  __put16(msg + HDR_PORT, (uint16_t)cfg->port);
+  __put16(msg + HDR_CPORT, (uint16_t)(cfg->port + CLUSTER_PORT_INCR));
+  __put16(msg + HDR_FLAGS, (uint16_t)g_myself->flags);
+  __put64(msg + HDR_CURRENT_EPOCH, g_current_epoch);
+  __put64(msg + HDR_CONFIG_EPOCH, g_myself->config_epoch);
+  memcpy(msg + HDR_SENDER, g_myself->name, CLUSTER_NAMELEN);
+  memcpy(msg + HDR_SLOTS, g_myself->slots, CLUSTER_SLOT_BYTES);
+  msg[HDR_STATE] = g_state_ok ? 1 : 0;
+}
+
+/*
+ * PING, PONG or MEET with gossip about a few random nodes, plus every node
+ * we think is failing so that the reports reach a majority quickly.
+ */
+static void __send_ping(ClusterLink *l, int type) {
+  int wanted = g_nodes_len / 10;
+  if (wanted < CLUSTER_MIN_GOSSIP) {
+    wanted = CLUSTER_MIN_GOSSIP;
+  }
+  /* neither us nor the receiver */
+  int fresh = g_nodes_len - 2;
+  if (wanted > fresh) {
+    wanted = fresh > 0 ? fresh : 0;
+  }
+  int pfail = 0;
+  for (int i = 0; i < g_nodes_len; i++) {
+    if ((g_nodes[i]->flags & CLUSTER_NODE_PFAIL) &&
+        !(g_nodes[i]->flags & CLUSTER_NODE_HANDSHAKE)) {
+      pfail++;
+    }
+  }
+  size_t max = (size_t)(wanted + pfail);
+  uint8_t *msg = malloc(HDR_LEN + max * GOSSIP_LEN);
+  ClusterNode **picked = malloc((max ? max : 1) * sizeof(ClusterNode *));
+  if (!msg || !picked) {
+    free(msg);
+    free(picked);
+    return;
+  }
+  int count = 0;
+  for (int tries = wanted * 3; tries > 0 && count < wanted; tries--) {
+    ClusterNode *n = g_nodes[rand() % g_nodes_len];
+    if (n == g_myself || (n->flags & (CLUSTER_NODE_HANDSHAKE |
+                                      CLUSTER_NODE_PFAIL)) ||
+        !n->ip[0]) {
+      continue;
+    }
+    bool dup = false;
+    for (int i = 0; i < count && !dup; i++) {
+      dup = picked[i] == n;
+    }
+    if (!dup) {
+      picked[count++] = n;
+    }
+  }
+  for (int i = 0; i < g_nodes_len; i++) {
+    if ((g_nodes[i]->flags & CLUSTER_NODE_PFAIL) &&
+        !(g_nodes[i]->flags & CLUSTER_NODE_HANDSHAKE)) {
+      picked[count++] = g_nodes[i];
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    ClusterNode *n = picked[i];
+    uint8_t *g = msg + HDR_LEN + (size_t)i * GOSSIP_LEN;
+    memset(g, 0, GOSSIP_LEN);
+    memcpy(g + GOSSIP_NAME, n->name, CLUSTER_NAMELEN);
+    __put32(g + GOSSIP_PING_SENT, (uint32_t)(n->ping_sent / 1000));
+    __put32(g + GOSSIP_PONG_RECEIVED, (uint32_t)(n->pong_received / 1000));
+    memcpy(g + GOSSIP_IP, n->ip, strlen(n->ip));
+    __put16(g + GOSSIP_PORT, (uint16_t)n->port);
+    __put16(g + GOSSIP_CPORT, (uint16_t)n->cport);
+    __put16(g + GOSSIP_FLAGS, (uint16_t)n->flags);
+  }
+  size_t len = HDR_LEN + (size_t)count * GOSSIP_LEN;
+  __build_header(msg, type, len, count);
+  if (l->node && type != CLUSTER_MSG_PONG && l->node->ping_sent == 0) {
+    l->node->ping_sent = el_mstime();
+  }
+  __link_send(l, msg, len);
+  free(msg);
+  free(picked);
+}
+
+static void __send_fail(ClusterNode *failing) {
+  uint8_t msg[FAIL_LEN];
+  __build_header(msg, CLUSTER_MSG_FAIL, FAIL_LEN, 0);
+  memcpy(msg + HDR_LEN, failing->name, CLUSTER_NAMELEN);
+  for (int i = 0; i < g_nodes_len; i++) {
+    ClusterNode *n = g_nodes[i];
+    if (n->link && !(n->flags & CLUSTER_NODE_HANDSHAKE)) {
+      __link_send(n->link, msg, FAIL_LEN);
+    }
+  }
+}
+
+/* Tell the sender on `l` that `n` owns slots with a newer config */
+static void __send_update(ClusterLink *l, ClusterNode *n) {
+  uint8_t *msg = malloc(UPDATE_LEN);
+  if (!msg) {
+    return;
+  }
+  __build_header(msg, CLUSTER_MSG_UPDATE, UPDATE_LEN, 0);
+  __put64(msg + HDR_LEN, n->config_epoch);
+  memcpy(msg + HDR_LEN + 8, n->name, CLUSTER_NAMELEN);
+  memcpy(msg + HDR_LEN + 8 + CLUSTER_NAMELEN, n->slots, CLUSTER_SLOT_BYTES);
+  __link_send(l, msg, UPDATE_LEN);
+  free(msg);
+}
+
+static void __broadcast_pong(void) {
+  for (int i = 0; i < g_nodes_len; i++) {
+    ClusterNode *n = g_nodes[i];
+    if (n->link && !n->link->connecting &&
+        !(n->flags & CLUSTER_NODE_HANDSHAKE)) {
+      __send_ping(n->link, CLUSTER_MSG_PONG);
+    }
+  }
+}
+
+/* Returns false when `l` was freed */
+static bool __process_packet(ClusterLink *l, const uint8_t *msg, size_t len) {
+  ClusterMsgHeader h = {
+      .type = __get16(msg + HDR_TYPE),
+      .count = __get16(msg + HDR_COUNT),
+      .port = __get16(msg + HDR_PORT),
+      .cport = __get16(msg + HDR_CPORT),
+      .flags = __get16(msg + HDR_FLAGS),
+      .current_epoch = __get64(msg + HDR_CURRENT_EPOCH),
+      .config_epoch = __get64(msg + HDR_CONFIG_EPOCH),
+      .sender = (const char *)msg + HDR_SENDER,
+      .slots = msg + HDR_SLOTS,
+      .state_ok = msg[HDR_STATE] != 0,
+  };
+  bool ping = h.type == CLUSTER_MSG_PING || h.type == CLUSTER_MSG_PONG ||
+              h.type == CLUSTER_MSG_MEET;
+  if (__get16(msg + HDR_VER) != CLUSTER_PROTO_VER ||
+      (ping && len != HDR_LEN + (size_t)h.count * GOSSIP_LEN) ||
+      (h.type == CLUSTER_MSG_FAIL && len != FAIL_LEN) ||
+      (h.type == CLUSTER_MSG_UPDATE && len != UPDATE_LEN)) {
+    return true;
+  }
+  g_msgs_received++;
+  long long now = el_mstime();
+
+  ClusterNode *sender = __node_lookup(h.sender, CLUSTER_NAMELEN);
+  if (sender && (sender->flags & CLUSTER_NODE_HANDSHAKE)) {
+    sender = NULL;
+  }
+  if (sender) {
+    if (h.current_epoch > g_current_epoch) {
+      g_current_epoch = h.current_epoch;
+      g_save_pending = true;
+    }
+    if (h.config_epoch > sender->config_epoch) {
+      sender->config_epoch = h.config_epoch;
+      g_save_pending = true;
+    }
+  }
+
+  if (h.type == CLUSTER_MSG_PING || h.type == CLUSTER_MSG_MEET) {
+    /* we only learn our own address from the nodes that reach us */
+    if (!g_myself->ip[0] && h.type == CLUSTER_MSG_MEET) {
+      __peer_ip(l->fd, g_myself->ip, true);
+      g_save_pending = true;
+    }
+    if (!sender && h.type == CLUSTER_MSG_MEET) {
+      char ip[CLUSTER_IPLEN];
+      __peer_ip(l->fd, ip, false);
+      if (ip[0]) {
+        __start_handshake(ip, h.port, h.cport);
+        g_save_pending = true;
+      }
+    }
+    __send_ping(l, CLUSTER_MSG_PONG);
+  }
+
+  if (ping) {
+    ClusterNode *n = l->node;
+    if (n && (n->flags & CLUSTER_NODE_HANDSHAKE)) {
+      if (sender) {
+        /* we already know it under its real name */
+        __node_delete(n);
+        return false;
+      }
+      __node_rename(n, h.sender);
+      n->flags &= ~CLUSTER_NODE_HANDSHAKE;
+      n->flags |= CLUSTER_NODE_MASTER;
+      sender = n;
+      sender->config_epoch = h.config_epoch;
+    } else if (n && memcmp(n->name, h.sender, CLUSTER_NAMELEN) != 0) {
+      /* someone else answers at its address now */
+      __link_free(l);
+      return false;
+    }
+    if (n && h.type == CLUSTER_MSG_PONG) {
+      n->pong_received = now;
+      n->ping_sent = 0;
+      if (n->flags & CLUSTER_NODE_PFAIL) {
+        n->flags &= ~CLUSTER_NODE_PFAIL;
+        __update_state();
+      } else if ((n->flags & CLUSTER_NODE_FAIL) &&
+                 (n->numslots == 0 ||
+                  now - n->fail_time >
+                      get_current_config()->cluster_node_timeout *
+                          CLUSTER_FAIL_UNDO_TIME_MULT)) {
+        LOG_NOTICE("Clear FAIL state for node %.40s: it is reachable again.",
+                   n->name);
+        n->flags &= ~CLUSTER_NODE_FAIL;
+        __update_state();
+        g_save_pending = true;
+      }
+    }
+    if (!sender) {
+      if (h.type == CLUSTER_MSG_MEET) {
+        __process_gossip(NULL, msg + HDR_LEN, h.count);
+      }
+      return true;
+    }
+    if (memcmp(sender->slots, h.slots, CLUSTER_SLOT_BYTES) != 0) {
+      __update_slots_config(sender, h.config_epoch, h.slots);
+    }
+    /* the sender claims slots that have a newer owner: tell it */
+    for (int j = 0; j < CLUSTER_SLOTS; j++) {
+      ClusterNode *owner = g_slots[j];
+      if (__slot_bit(h.slots, j) && owner && owner != sender &&
+          owner->config_epoch > h.config_epoch) {
+        __send_update(l, owner);
+        break;
+      }
+    }
+    if (h.config_epoch == g_myself->config_epoch) {
+      __handle_epoch_collision(sender);
+    }
+    __process_gossip(sender, msg + HDR_LEN, h.count);
+  } else if (h.type == CLUSTER_MSG_FAIL && sender) {
+    ClusterNode *failing =
+        __node_lookup((const char *)msg + HDR_LEN, CLUSTER_NAMELEN);
+    if (failing &&
+        !(failing->flags & (CLUSTER_NODE_FAIL | CLUSTER_NODE_MYSELF))) {
+      LOG_NOTICE("FAIL message received from %.40s about %.40s", sender->name,
+                 failing->name);
+      failing->flags |= CLUSTER_NODE_FAIL;
+      failing->flags &= ~CLUSTER_NODE_PFAIL;
+      failing->fail_time = now;
+      __update_state();
+      g_save_pending = true;
+    }
+  } else if (h.type == CLUSTER_MSG_UPDATE && sender) {
+    uint64_t epoch = __get64(msg + HDR_LEN);
+    ClusterNode *n =
+        __node_lookup((const char *)msg + HDR_LEN + 8, CLUSTER_NAMELEN);
+    if (n && epoch > n->config_epoch) {
+      n->config_epoch = epoch;
+      __update_slots_config(n, epoch, msg + HDR_LEN + 8 + CLUSTER_NAMELEN);
+    }
+  }
+  return true;
+}
+
+/*
+ * What the sender says about other nodes: whether it can reach them, which
+ * feeds the failure detection, and nodes we had not heard of yet.
+ */
+static void __process_gossip(ClusterNode *sender, const uint8_t *gossip,
+                             int count) {
+  for (int i = 0; i < count; i++) {
+    const uint8_t *g = gossip + (size_t)i * GOSSIP_LEN;
+    int flags = __get16(g + GOSSIP_FLAGS);
+    ClusterNode *n =
+        __node_lookup((const char *)g + GOSSIP_NAME, CLUSTER_NAMELEN);
+    if (n) {
+      if (sender && n != g_myself) {
+        if (flags & (CLUSTER_NODE_PFAIL | CLUSTER_NODE_FAIL)) {
+          __add_fail_report(n, sender);
+          __mark_failing_if_needed(n);
+        } else {
+          __del_fail_report(n, sender);
+        }
+      }
+      continue;
+    }
+    if (!sender || (flags & CLUSTER_NODE_HANDSHAKE)) {
+      continue;
+    }
+    char ip[CLUSTER_IPLEN + 1];
+    memcpy(ip, g + GOSSIP_IP, CLUSTER_IPLEN);
+    ip[CLUSTER_IPLEN] = '\0';
+    char norm[CLUSTER_IPLEN];
+    if (__normalize_ip(ip, norm)) {
+      __start_handshake(norm, __get16(g + GOSSIP_PORT),
+                        __get16(g + GOSSIP_CPORT));
+    }
+  }
+}
+
+static void __node_flags(const ClusterNode *n, char *buf, size_t len) {
+  static const struct {
+    int flag;
+    const char *name;
+  } names[] = {
+      {CLUSTER_NODE_MYSELF, "myself"},       {CLUSTER_NODE_MASTER, "master"},
+      {CLUSTER_NODE_PFAIL, "fail?"},         {CLUSTER_NODE_FAIL, "fail"},
+      {CLUSTER_NODE_HANDSHAKE, "handshake"},
+  };
+  size_t used = 0;
+  buf[0] = '\0';
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (n->flags & names[i].flag) {
+      used += (size_t)snprintf(buf + used, len - used, "%s%s",
+                               used ? "," : "", names[i].name);
+    }
+  }
+  if (used == 0) {
+    snprintf(buf, len, "noflags");
+  }
+}
+
+static void __appendf(ReplyBuffer *b, const char *fmt, ...) {
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  reply_add_raw(b, buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+/*
+ * A line of CLUSTER NODES, which is also the config file format:
+ * <id> <ip:port@cport> <flags> <master> <ping-sent> <pong-recv>
+ * <config-epoch> <link-state> <slot ranges> [<slot>->-<id>] [<slot>-<-<id>]
+ */
+static void __describe_node(ReplyBuffer *b, const ClusterNode *n) {
+  char flags[64];
+  __node_flags(n, flags, sizeof(flags));
+  bool connected = n == g_myself || (n->link && !n->link->connecting);
+  __appendf(b, "%.40s %s:%d@%d %s - %lld %lld %llu %s", n->name, n->ip,
+            n->port, n->cport, flags, n->ping_sent, n->pong_received,
+            (unsigned long long)n->config_epoch,
+            connected ? "connected" : "disconnected");
+  for (int start = 0; start < CLUSTER_SLOTS; start++) {
+    if (g_slots[start] != n) {
+      continue;
+    }
+    int end = start;
+    while (end + 1 < CLUSTER_SLOTS && g_slots[end + 1] == n) {
+      end++;
+    }
+    if (start == end) {
+      __appendf(b, " %d", start);
+    } else {
+      __appendf(b, " %d-%d", start, end);
+    }
+    start = end;
+  }
+  if (n == g_myself) {
+    for (int j = 0; j < CLUSTER_SLOTS; j++) {
+      if (g_migrating_to[j]) {
+        __appendf(b, " [%d->-%.40s]", j, g_migrating_to[j]->name);
+      } else if (g_importing_from[j]) {
+        __appendf(b, " [%d-<-%.40s]", j, g_importing_from[j]->name);
+      }
+    }
+  }
+  reply_add_raw(b, "\n", 1);
+}
+
+/*
+ * Two passes over the lines of the file: the nodes first, then the slots,
+ * which may name nodes further down. `found` is false when there is no file.
+ */
+static REDIS_RC __load_config(const char *path, bool *found) {
+  FILE *f = fopen(path, "r");
+  *found = f != NULL;
+  if (!f) {
+    return errno == ENOENT ? REDIS_OK : REDIS_IO_ERROR;
+  }
+  char *data = NULL;
+  size_t len = 0, cap = 0;
+  for (;;) {
+    if (cap - len < 4096) {
+      cap = cap ? cap * 2 : 65536;
+      char *p = realloc(data, cap);
+      if (!p) {
+        free(data);
+        fclose(f);
+        return REDIS_OUT_OF_MEMORY;
+      }
+      data = p;
+    }
+    size_t n = fread(data + len, 1, cap - len - 1, f);
+    if (n == 0) {
+      break;
+    }
+    len += n;
+  }
+  fclose(f);
+  data[len] = '\0';
+
+  REDIS_RC rc = REDIS_OK;
+  for (int pass = 0; pass < 2 && REDIS_SUCCESS(rc); pass++) {
+    char *copy = strdup(data);
+    if (!copy) {
+      rc = REDIS_OUT_OF_MEMORY;
+      break;
+    }
+    char *save = NULL;
+    for (char *line = strtok_r(copy, "\n", &save); line;
+         line = strtok_r(NULL, "\n", &save)) {
+      if (!__parse_node_line(line, pass == 1)) {
+        rc = REDIS_CORRUPT_SNAPSHOT;
+        break;
+      }
+    }
+    free(copy);
+  }
+  free(data);
+  if (REDIS_SUCCESS(rc) && !g_myself) {
+    rc = REDIS_CORRUPT_SNAPSHOT;
+  }
+  if (REDIS_SUCCESS(rc)) {
+    /* the old pings tell nothing about the nodes now */
+    for (int i = 0; i < g_nodes_len; i++) {
+      g_nodes[i]->ping_sent = 0;
+      g_nodes[i]->pong_received = 0;
+    }
+    LOG_INFO("Loaded the cluster config: %d nodes, I'm %.40s", g_nodes_len,
+             g_myself->name);
+  }
+  return rc;
+}
+
+#define NODE_LINE_FIELDS 8
+
+static bool __parse_node_line(char *line, bool slots_pass) {
+  char *argv[NODE_LINE_FIELDS];
+  int argc = 0;
+  char *save = NULL;
+  char *tok = strtok_r(line, " \r", &save);
+  if (tok && strcmp(tok, "vars") == 0) {
+    while ((tok = strtok_r(NULL, " \r", &save))) {
+      char *value = strtok_r(NULL, " \r", &save);
+      if (value && strcmp(tok, "currentEpoch") == 0) {
+        g_current_epoch = strtoull(value, NULL, 10);
+      }
+    }
+    return true;
+  }
+  for (; tok && argc < NODE_LINE_FIELDS; tok = strtok_r(NULL, " \r", &save)) {
+    argv[argc++] = tok;
+  }
+  if (argc == 0) {
+    return true;
+  }
+  if (argc < NODE_LINE_FIELDS || strlen(argv[0]) != CLUSTER_NAMELEN) {
+    return false;
+  }
+  if (!slots_pass) {
+    char *at = strchr(argv[1], '@');
+    if (!at) {
+      return false;
+    }
+    *at = '\0'; /* an IPv6 address has colons of its own */
+    char *colon = strrchr(argv[1], ':');
+    if (!colon || colon - argv[1] >= CLUSTER_IPLEN) {
+      return false;
+    }
+    ClusterNode *n = __node_create(argv[0], 0);
+    if (!n) {
+      return false;
+    }
+    memcpy(n->ip, argv[1], (size_t)(colon - argv[1]));
+    n->port = atoi(colon + 1);
+    n->cport = atoi(at + 1);
+    char *flag_save = NULL;
+    for (char *flag = strtok_r(argv[2], ",", &flag_save); flag;
+         flag = strtok_r(NULL, ",", &flag_save)) {
+      if (strcmp(flag, "myself") == 0) {
+        n->flags |= CLUSTER_NODE_MYSELF;
+        g_myself = n;
+      } else if (strcmp(flag, "master") == 0) {
+        n->flags |= CLUSTER_NODE_MASTER;
+      } else if (strcmp(flag, "fail?") == 0) {
+        n->flags |= CLUSTER_NODE_PFAIL;
+      } else if (strcmp(flag, "fail") == 0) {
+        n->flags |= CLUSTER_NODE_FAIL;
+        n->fail_time = el_mstime();
+      }
+    }
+    n->config_epoch = strtoull(argv[6], NULL, 10);
+    return true;
+  }
+
+  ClusterNode *n = __node_lookup(argv[0], CLUSTER_NAMELEN);
+  for (; tok; tok = strtok_r(NULL, " \r", &save)) {
+    if (tok[0] == '[') {
+      /* [<slot>->-<id>] or [<slot>-<-<id>] */
+      int slot = atoi(tok + 1);
+      char *dir = strchr(tok, '-');
+      if (!dir || slot < 0 || slot >= CLUSTER_SLOTS ||
+          strlen(dir) != 3 + CLUSTER_NAMELEN + 1) {
+        return false;
+      }
+      ClusterNode *other = __node_lookup(dir + 3, CLUSTER_NAMELEN);
+      if (!other) {
+        return false;
+      }
+      if (dir[1] == '>') {
+        g_migrating_to[slot] = other;
+      } else {
+        g_importing_from[slot] = other;
+      }
+      continue;
+    }
+    char *dash = strchr(tok, '-');
+    int start = atoi(tok);
+    int end = dash ? atoi(dash + 1) : start;
+    if (start < 0 || end < start || end >= CLUSTER_SLOTS) {
+      return false;
+    }
+    for (int j = start; j <= end; j++) {
+      __del_slot(j);
+      __add_slot(n, j);
+    }
+  }
+  return true;
+}
+
+/* A blocking connection to host:port, or -1 */
+static int __connect_timeout(const char *host, int port, long long timeout_ms) {
+  struct sockaddr_storage sa;
+  socklen_t sa_len;
+  memset(&sa, 0, sizeof(sa));
+  struct sockaddr_in *in = (struct sockaddr_in *)&sa;
+  struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&sa;
+  if (inet_pton(AF_INET, host, &in->sin_addr) == 1) {
+    in->sin_family = AF_INET;
+    in->sin_port = htons((uint16_t)port);
+    sa_len = sizeof(*in);
+  } else if (inet_pton(AF_INET6, host, &in6->sin6_addr) == 1) {
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port = htons((uint16_t)port);
+    sa_len = sizeof(*in6);
+  } else {
+    return -1;
+  }
+  int fd = socket(sa.ss_family, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  int yes = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+  if (__set_nonblock(fd) == -1) {
+    close(fd);
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&sa, sa_len) == -1) {
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    if (errno != EINPROGRESS || !__wait_fd(fd, POLLOUT, timeout_ms) ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == -1 || err) {
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+static bool __wait_fd(int fd, short events, long long timeout_ms) {
+  struct pollfd p = {.fd = fd, .events = events};
+  int r;
+  do {
+    r = poll(&p, 1, (int)timeout_ms);
+  } while (r == -1 && errno == EINTR);
+  return r == 1 && !(p.revents & POLLNVAL);
+}
@@ -0,0 +1,102 @@
+#ifndef REDIS_C_CLUSTER_H__
+#define REDIS_C_CLUSTER_H__
+
+#include "event_loop.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include "util/hash.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Cluster mode (--cluster-enabled yes): the keyspace is split over several
+ * nodes by the HASH_KEY_SLOTS hash slots of util/hash.h, as in Redis
+ * Cluster. Every node owns a set of slots and answers requests for the
+ * others with a MOVED redirect, so clients learn the slot map and go
+ * straight to the owner.
+ *
+ * Nodes talk over a binary bus on the client port + CLUSTER_PORT_INCR. A
+ * ping every second or so carries the sender's slots and epochs plus gossip
+ * about a few other nodes: nodes find each other from a single CLUSTER
+ * MEET, a node that stops answering is flagged PFAIL by each peer and FAIL
+ * once a majority of the slot owners agree. Conflicting claims on a slot are
+ * settled by the config epoch of the claimants, the highest wins.
+ *
+ * A slot moves while it is being served: the target is set IMPORTING and the
+ * source MIGRATING, then MIGRATE moves its keys in batches, each copied with
+ * the DUMP encoding (the snapshot's, so every type moves as it is saved) and
+ * deleted from the source once the target stored it. Meanwhile the source
+ * redirects requests for keys it no longer has with ASK, which the target
+ * only serves right after an ASKING. SETSLOT NODE ends the move.
+ *
+ * The cluster state belongs to the main loop, so cluster mode runs a single
+ * shard. It is saved to --cluster-config-file whenever it changes.
+ */
+
+#define CLUSTER_SLOTS HASH_KEY_SLOTS
+#define CLUSTER_NAMELEN 40
+#define CLUSTER_PORT_INCR 10000
+
+typedef enum {
+  CLUSTER_SETSLOT_IMPORTING = 0,
+  CLUSTER_SETSLOT_MIGRATING,
+  CLUSTER_SETSLOT_STABLE,
+  CLUSTER_SETSLOT_NODE
+} ClusterSetSlot;
+
+/* Set once by cluster_init(); read by the request path. */
+extern bool g_cluster_enabled;
+
+static inline bool cluster_enabled(void) { return g_cluster_enabled; }
+
+/*
+ * With --cluster-enabled, load the node table from the config file (or
+ * start a new one-node cluster), index the keyspace by slot and listen on
+ * the bus port. A no-op otherwise. Call before the dataset is loaded.
+ */
+REDIS_RC cluster_init(EventLoop *el);
+void cluster_shutdown(void);
+/* Pings, failure detection, reconnections; from server_cron. */
+void cluster_cron(void);
+/* Save the config if it changed; from before_sleep. */
+void cluster_before_sleep(void);
+
+/*
+ * Whether this node serves the request. If not, the redirect or error to
+ * answer with (MOVED, ASK, TRYAGAIN, CROSSSLOT, CLUSTERDOWN) is appended to
+ * `reply`. `asking`: the client sent ASKING right before.
+ */
+bool cluster_serves_request(int argc, char **argv, size_t *argv_len,
+                            bool asking, ReplyBuffer *reply);
+
+/* CLUSTER subcommands */
+const char *cluster_myid(void);
+void cluster_reply_info(ReplyBuffer *reply);
+void cluster_reply_nodes(ReplyBuffer *reply);
+void cluster_reply_slots(ReplyBuffer *reply);
+REDIS_RC cluster_meet(const char *ip, int port);
+/*
+ * Assign (or unassign) every slot flagged in `slots`, a CLUSTER_SLOTS array,
+ * to this node; nothing changes unless all of them are free (assigned to
+ * this node).
+ */
+REDIS_RC cluster_add_slots(const uint8_t *slots);
+REDIS_RC cluster_del_slots(const uint8_t *slots);
+/* `node` is ignored by CLUSTER_SETSLOT_STABLE */
+REDIS_RC cluster_set_slot(int slot, ClusterSetSlot how, const char *node,
+                          size_t node_len);
+REDIS_RC cluster_save_config(void);
+
+/*
+ * The transfer of MIGRATE: send `count` pipelined commands encoded in `req`
+ * to host:port and read their replies, waiting at most `timeout_ms` for each
+ * step. ok[i] tells whether command i succeeded; the text of the first error
+ * is copied to `err`. Fails with REDIS_CLUSTER_MIGRATE_IO on a connection
+ * error or timeout, after which the outcome of the commands is unknown.
+ */
+REDIS_RC cluster_migrate_send(const char *host, int port, long long timeout_ms,
+                              const char *req, size_t len, int count, bool *ok,
+                              char *err, size_t err_len);
+
+#endif
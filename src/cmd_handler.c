@@ -1,29 +1,820 @@
 #include "cmd_handler.h"
-#include "3rdparty/io-multiplexing/src/shared/logging.h"
+#include "aof.h"
+#include "cluster.h"
+#include "lazyfree.h"
+#include "logging.h"
 #include "command/cmd.h"
+#include "command/cmd_bloom_filter.h"
+#include "command/cmd_cluster.h"
 #include "command/cmd_cms.h"
+#include "command/cmd_cuckoo_filter.h"
+#include "command/cmd_geo.h"
+#include "command/cmd_hyperloglog.h"
+#include "command/cmd_info.h"
+#include "command/cmd_latency.h"
+#include "command/cmd_replication.h"
+#include "command/cmd_slowlog.h"
+#include "command/cmd_sorted_set.h"
+#include "command/cmd_string.h"
+#include "command/cmd_top_k.h"
+#include "latency.h"
 #include "redis-C/config.h"
+#include "rdb.h"
 #include "redis-C/rc.h"
+#include "replication.h"
+#include "shard.h"
+#include "slowlog.h"
+#include "stats.h"
+#include "storage.h"
+#include "util/mem.h"
+#include "util/monotonic.h"
+#include "util/str_util.h"
 #include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
-REDIS_RC handle_ping(void) {
+/* End of the previous command of the current batch, 0 outside of a batch */
+static _Thread_local uint64_t g_batch_mark = 0;
+static _Thread_local const char *g_batch_client = NULL;
+
+/* A command of the batch starts where the previous one ended; a rejection
+ * or an eviction cycle, which has its own sample, moves that point on */
+static void __batch_advance(void) {
+  if (g_batch_mark) {
+    g_batch_mark = monotonic_now();
+  }
+}
+
+/* Hand a write to the AOF and to the replicas */
+static void __feed(int argc, char **argv, size_t *argv_len) {
+  aof_feed(argc, argv, argv_len);
+  repl_feed(argc, argv, argv_len);
+}
+
+/*
+ * Evict keys until used memory is back under maxmemory. Only a command that
+ * may allocate fails (with REDIS_OOM) when the policy finds nothing to evict.
+ * The evictions are propagated as DELs; a replica leaves them to its primary.
+ */
+static REDIS_RC __enforce_maxmemory(int flags) {
+  const RedisCConfig *cfg = get_current_config();
+  if (!cfg || cfg->maxmemory == 0 || mem_used() <= cfg->maxmemory ||
+      repl_is_replica()) {
+    return REDIS_OK;
+  }
+  bool propagate = aof_enabled() || repl_stream_enabled();
+  REDIS_RC rc = REDIS_OK;
+  uint64_t start = monotonic_now();
+  while (mem_used() > cfg->maxmemory) {
+    char *key = NULL;
+    size_t len = 0;
+    if (storage_evict_one(cfg->maxmemory_policy, propagate ? &key : NULL,
+                          &len)) {
+      if (key) {
+        propagate_del(key, len);
+        free(key);
+      }
+      continue;
+    }
+    /* values still being freed in the background may be enough */
+    if (lazyfree_pending() > 0) {
+      lazyfree_drain();
+      continue;
+    }
+    rc = (flags & CMD_FLAG_DENYOOM) ? REDIS_OOM : REDIS_OK;
+    break;
+  }
+  uint64_t ns = monotonic_ticks_to_ns(monotonic_now() - start);
+  latency_add_sample_if_needed(LATENCY_EVICTION_CYCLE, ns / 1000);
+  __batch_advance();
+  return rc;
+}
+
+/*
+ * Log a write that succeeded to the AOF. Expiry times are logged as the
+ * absolute time they resolved to, so a replay does not extend them, and an
+ * expiry that deleted the key right away as a DEL.
+ */
+static void __propagate(CommandType type, int sub_cmd, int argc, char **argv,
+                        size_t *argv_len) {
+  /* MIGRATE propagates the deletions it did itself */
+  if (type == CMD_MIGRATE) {
+    return;
+  }
+  bool restore = type == CMD_RESTORE;
+  bool ttl = restore ||
+             (type == CMD_STRING &&
+              (sub_cmd == EXPIRE || sub_cmd == PEXPIRE || sub_cmd == EXPIREAT ||
+               sub_cmd == PEXPIREAT || (sub_cmd == SET && argc > 3)));
+  if (!ttl) {
+    __feed(argc, argv, argv_len);
+    return;
+  }
+  bool keeps_command = restore || sub_cmd == SET;
+  if (keeps_command) {
+    __feed(argc, argv, argv_len);
+  }
+  long long when_ms = storage_get_expire(argv[1], argv_len[1]);
+  char when[STR_UTIL_LL_SIZE];
+  char *expire[3] = {"PEXPIREAT", argv[1], when};
+  size_t expire_len[3] = {9, argv_len[1], 0};
+  if (when_ms >= 0) {
+    expire_len[2] = string_from_ll(when, when_ms);
+    __feed(3, expire, expire_len);
+  } else if (!keeps_command) {
+    /* the key is gone, or an expiry of a missing key did nothing */
+    char *del[2] = {"DEL", argv[1]};
+    size_t del_len[2] = {3, argv_len[1]};
+    __feed(2, del, del_len);
+  }
+}
+
+REDIS_RC handle_ping(Command *cmd, ReplyBuffer *reply) {
   // When a client send a request and it reaches here, mean that the connection
   // is OK
+  if (cmd->argc > 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if (cmd->argc == 1) {
+    reply_add_bulk(reply, cmd->arg[0], cmd->arg_len[0]);
+  } else {
+    reply_add_status(reply, "PONG");
+  }
   return REDIS_OK;
 }
 
-REDIS_RC handle_command(Command *cmd) {
-  if (cmd == NULL) {
-    return REDIS_CMD_NULL;
+/* HELLO [protover]: switch the reply protocol and describe the server. */
+REDIS_RC handle_hello(Command *cmd, ReplyBuffer *reply) {
+  int proto = reply->proto;
+  if (cmd->argc >= 1) {
+    if (cmd->arg_len[0] != 1 ||
+        (cmd->arg[0][0] != '2' && cmd->arg[0][0] != '3')) {
+      return REDIS_UNSUPPORTED_PROTOCOL;
+    }
+    proto = cmd->arg[0][0] - '0';
+  }
+  reply->proto = proto;
+
+  reply_add_map_len(reply, 5);
+  reply_add_bulk_cstr(reply, "server");
+  reply_add_bulk_cstr(reply, "redis-C");
+  reply_add_bulk_cstr(reply, "version");
+  reply_add_bulk_cstr(reply, REDIS_C_VERSION);
+  reply_add_bulk_cstr(reply, "proto");
+  reply_add_integer(reply, proto);
+  reply_add_bulk_cstr(reply, "mode");
+  reply_add_bulk_cstr(reply, cluster_enabled() ? "cluster" : "standalone");
+  reply_add_bulk_cstr(reply, "role");
+  reply_add_bulk_cstr(reply, repl_is_replica() ? "replica" : "master");
+  return REDIS_OK;
+}
+
+/* SAVE: write the snapshot, blocking until it is on disk. */
+REDIS_RC handle_save(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 0) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  /* each shard only sees its own keyspace */
+  if (shard_count() > 1) {
+    return REDIS_NOT_SUPPORTED;
+  }
+  /* two writers would race for the same file */
+  if (rdb_bgsave_in_progress()) {
+    return REDIS_SAVE_IN_PROGRESS;
+  }
+  REDIS_RC rc = rdb_save(get_current_config()->dbfilename);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
+  }
+  return rc;
+}
+
+/* BGSAVE: fork a child to write the snapshot and return right away. */
+REDIS_RC handle_bgsave(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 0) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if (shard_count() > 1) {
+    return REDIS_NOT_SUPPORTED;
   }
+  REDIS_RC rc = rdb_bgsave(get_current_config()->dbfilename);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_status(reply, "Background saving started");
+  }
+  return rc;
+}
 
-  if (cmd->type == CMD_PING) {
-    return handle_ping();
-  } else if (cmd->type == CMD_CMS) {
-    return handle_cms_command(cmd); 
+/* BGREWRITEAOF: compact the append-only file in the background. */
+REDIS_RC handle_bgrewriteaof(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 0) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  bool scheduled;
+  REDIS_RC rc = aof_rewrite(&scheduled);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_status(reply, scheduled
+                                ? "Background append only file rewriting "
+                                  "scheduled"
+                                : "Background append only file rewriting "
+                                  "started");
+  }
+  return rc;
+}
+
+/*
+ * FLUSHALL [ASYNC | SYNC] / FLUSHDB [ASYNC | SYNC]: delete every key (there
+ * is a single database). ASYNC frees the old keyspace in the background.
+ */
+REDIS_RC handle_flushall(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc > 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  bool async = false;
+  if (cmd->argc == 1) {
+    if (strcasecmp(cmd->arg[0], "ASYNC") == 0) {
+      async = true;
+    } else if (strcasecmp(cmd->arg[0], "SYNC") != 0) {
+      return REDIS_INVALID_ARGUMENT;
+    }
+  }
+  /* each shard only sees its own keyspace */
+  if (shard_count() > 1) {
+    return REDIS_NOT_SUPPORTED;
+  }
+  REDIS_RC rc = storage_flush(async);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
   }
+  return rc;
+}
 
+/* LASTSAVE: unix time of the last successful save. */
+REDIS_RC handle_lastsave(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 0) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  reply_add_integer(reply, rdb_save_info()->lastsave);
   return REDIS_OK;
 }
+
+/* CMS.MERGE dest numkeys src [src ...] [WEIGHTS ...] */
+static int __cms_merge_keys(int argc, char **argv, size_t *argv_len,
+                            int *keys) {
+  keys[0] = 1;
+  long long numkeys;
+  if (!string_to_ll(argv[2], argv_len[2], &numkeys) || numkeys < 1) {
+    return 1;
+  }
+  int n = 1;
+  for (long long i = 0; i < numkeys && 3 + i < argc; i++) {
+    keys[n++] = 3 + (int)i;
+  }
+  return n;
+}
+
+/* MIGRATE host port key|"" db timeout [COPY] [REPLACE] [KEYS key ...] */
+static int __migrate_keys(int argc, char **argv, size_t *argv_len,
+                          int *keys) {
+  if (argv_len[3] > 0) {
+    keys[0] = 3;
+    return 1;
+  }
+  for (int i = 6; i < argc; i++) {
+    if (strcasecmp(argv[i], "KEYS") == 0) {
+      int n = 0;
+      for (int k = i + 1; k < argc; k++) {
+        keys[n++] = k;
+      }
+      return n;
+    }
+  }
+  return 0;
+}
+
+#define RO CMD_FLAG_READONLY
+#define W CMD_FLAG_WRITE
+#define M CMD_FLAG_DENYOOM
+#define F CMD_FLAG_FAST
+#define A CMD_FLAG_ASKING
+
+/* name, handler, type, sub command, arity, flags, first/last key, key step */
+static const RedisCommand g_commands[] = {
+    {"PING", handle_ping, CMD_PING, -1, -1, F, 0, 0, 0, NULL},
+    {"HELLO", handle_hello, CMD_HELLO, -1, -1, F, 0, 0, 0, NULL},
+    {"SAVE", handle_save, CMD_SAVE, -1, 1, 0, 0, 0, 0, NULL},
+    {"BGSAVE", handle_bgsave, CMD_BGSAVE, -1, 1, 0, 0, 0, 0, NULL},
+    {"LASTSAVE", handle_lastsave, CMD_LASTSAVE, -1, 1, F, 0, 0, 0, NULL},
+    {"BGREWRITEAOF", handle_bgrewriteaof, CMD_BGREWRITEAOF, -1, 1, 0, 0, 0, 0,
+     NULL},
+    {"FLUSHALL", handle_flushall, CMD_FLUSHALL, -1, -1, W, 0, 0, 0, NULL},
+    {"FLUSHDB", handle_flushall, CMD_FLUSHALL, -1, -1, W, 0, 0, 0, NULL},
+    {"INFO", handle_info, CMD_INFO, -1, -1, 0, 0, 0, 0, NULL},
+    {"LATENCY", handle_latency_command, CMD_LATENCY, -1, -2, 0, 0, 0, 0, NULL},
+    {"SLOWLOG", handle_slowlog_command, CMD_SLOWLOG, -1, -2, 0, 0, 0, 0, NULL},
+    {"CLUSTER", handle_cluster_command, CMD_CLUSTER, -1, -2, 0, 0, 0, 0, NULL},
+    {"ASKING", handle_asking, CMD_ASKING, -1, 1, F, 0, 0, 0, NULL},
+    {"DUMP", handle_dump, CMD_DUMP, -1, 2, RO, 1, 1, 1, NULL},
+    {"RESTORE", handle_restore, CMD_RESTORE, -1, -4, W | M, 1, 1, 1, NULL},
+    {"RESTORE-ASKING", handle_restore, CMD_RESTORE, -1, -4, W | M | A, 1, 1, 1,
+     NULL},
+    {"MIGRATE", handle_migrate, CMD_MIGRATE, -1, -6, W, 0, 0, 0,
+     __migrate_keys},
+    {"REPLICAOF", handle_replicaof, CMD_REPLICAOF, -1, 3, 0, 0, 0, 0, NULL},
+    {"SLAVEOF", handle_replicaof, CMD_REPLICAOF, -1, 3, 0, 0, 0, 0, NULL},
+    {"ROLE", handle_role, CMD_ROLE, -1, 1, F, 0, 0, 0, NULL},
+    {"REPLCONF", handle_replconf, CMD_REPLCONF, -1, -1, 0, 0, 0, 0, NULL},
+    {"SYNC", handle_sync, CMD_SYNC, -1, 1, 0, 0, 0, 0, NULL},
+    {"PSYNC", handle_sync, CMD_SYNC, -1, 3, 0, 0, 0, 0, NULL},
+
+    {"SET", handle_string_command, CMD_STRING, SET, -3, W | M, 1, 1, 1, NULL},
+    {"GET", handle_string_command, CMD_STRING, GET, 2, RO | F, 1, 1, 1, NULL},
+    {"DEL", handle_string_command, CMD_STRING, DEL, -2, W, 1, -1, 1, NULL},
+    {"UNLINK", handle_string_command, CMD_STRING, UNLINK, -2, W | F, 1, -1, 1,
+     NULL},
+    {"TTL", handle_string_command, CMD_STRING, TTL, 2, RO | F, 1, 1, 1, NULL},
+    {"PTTL", handle_string_command, CMD_STRING, PTTL, 2, RO | F, 1, 1, 1, NULL},
+    {"EXPIRE", handle_string_command, CMD_STRING, EXPIRE, 3, W | F, 1, 1, 1,
+     NULL},
+    {"PEXPIRE", handle_string_command, CMD_STRING, PEXPIRE, 3, W | F, 1, 1, 1,
+     NULL},
+    {"PERSIST", handle_string_command, CMD_STRING, PERSIST, 2, W | F, 1, 1, 1,
+     NULL},
+    {"EXPIREAT", handle_string_command, CMD_STRING, EXPIREAT, 3, W | F, 1, 1, 1,
+     NULL},
+    {"PEXPIREAT", handle_string_command, CMD_STRING, PEXPIREAT, 3, W | F, 1, 1,
+     1, NULL},
+    {"INCR", handle_string_command, CMD_STRING, INCR, 2, W | M | F, 1, 1, 1,
+     NULL},
+    {"DECR", handle_string_command, CMD_STRING, DECR, 2, W | M | F, 1, 1, 1,
+     NULL},
+    {"INCRBY", handle_string_command, CMD_STRING, INCRBY, 3, W | M | F, 1, 1, 1,
+     NULL},
+    {"DECRBY", handle_string_command, CMD_STRING, DECRBY, 3, W | M | F, 1, 1, 1,
+     NULL},
+
+    {"ZADD", handle_sorted_set_command, CMD_SORTED_SET, ZADD, -4, W | M | F, 1,
+     1, 1, NULL},
+    {"ZINCRBY", handle_sorted_set_command, CMD_SORTED_SET, ZINCRBY, 4,
+     W | M | F, 1, 1, 1, NULL},
+    {"ZREM", handle_sorted_set_command, CMD_SORTED_SET, ZREM, -3, W | F, 1, 1, 1,
+     NULL},
+    {"ZSCORE", handle_sorted_set_command, CMD_SORTED_SET, ZSCORE, 3, RO | F, 1,
+     1, 1, NULL},
+    {"ZCARD", handle_sorted_set_command, CMD_SORTED_SET, ZCARD, 2, RO | F, 1, 1,
+     1, NULL},
+    {"ZRANK", handle_sorted_set_command, CMD_SORTED_SET, ZRANK, -3, RO | F, 1,
+     1, 1, NULL},
+    {"ZREVRANK", handle_sorted_set_command, CMD_SORTED_SET, ZREVRANK, -3,
+     RO | F, 1, 1, 1, NULL},
+    {"ZCOUNT", handle_sorted_set_command, CMD_SORTED_SET, ZCOUNT, 4, RO | F, 1,
+     1, 1, NULL},
+    {"ZRANGE", handle_sorted_set_command, CMD_SORTED_SET, ZRANGE, -4, RO, 1, 1,
+     1, NULL},
+    {"ZREVRANGE", handle_sorted_set_command, CMD_SORTED_SET, ZREVRANGE, -4, RO,
+     1, 1, 1, NULL},
+    {"ZRANGEBYSCORE", handle_sorted_set_command, CMD_SORTED_SET, ZRANGEBYSCORE,
+     -4, RO, 1, 1, 1, NULL},
+    {"ZREVRANGEBYSCORE", handle_sorted_set_command, CMD_SORTED_SET,
+     ZREVRANGEBYSCORE, -4, RO, 1, 1, 1, NULL},
+    {"ZREMRANGEBYRANK", handle_sorted_set_command, CMD_SORTED_SET,
+     ZREMRANGEBYRANK, 4, W, 1, 1, 1, NULL},
+    {"ZREMRANGEBYSCORE", handle_sorted_set_command, CMD_SORTED_SET,
+     ZREMRANGEBYSCORE, 4, W, 1, 1, 1, NULL},
+
+    {"GEOADD", handle_geo_command, CMD_GEOSPATIAL, GEOADD, -5, W | M, 1, 1, 1,
+     NULL},
+    {"GEODIST", handle_geo_command, CMD_GEOSPATIAL, GEODIST, -4, RO | F, 1, 1, 1,
+     NULL},
+    {"GEOHASH", handle_geo_command, CMD_GEOSPATIAL, GEOHASH, -2, RO, 1, 1, 1,
+     NULL},
+    {"GEOPOS", handle_geo_command, CMD_GEOSPATIAL, GEOPOS, -2, RO, 1, 1, 1,
+     NULL},
+    {"GEOSEARCH", handle_geo_command, CMD_GEOSPATIAL, GEOSEARCH, -3, RO, 1, 1,
+     1, NULL},
+
+    {"BF.RESERVE", handle_bloom_filter_command, CMD_BLOOM_FILTER, BF_RESERVE,
+     -4, W | M, 1, 1, 1, NULL},
+    {"BF.ADD", handle_bloom_filter_command, CMD_BLOOM_FILTER, BF_ADD, 3,
+     W | M | F, 1, 1, 1, NULL},
+    {"BF.MADD", handle_bloom_filter_command, CMD_BLOOM_FILTER, BF_MADD, -3,
+     W | M, 1, 1, 1, NULL},
+    {"BF.EXISTS", handle_bloom_filter_command, CMD_BLOOM_FILTER, BF_EXISTS, 3,
+     RO | F, 1, 1, 1, NULL},
+    {"BF.MEXISTS", handle_bloom_filter_command, CMD_BLOOM_FILTER, BF_MEXISTS,
+     -3, RO, 1, 1, 1, NULL},
+    {"BF.INFO", handle_bloom_filter_command, CMD_BLOOM_FILTER, BF_INFO, -2,
+     RO | F, 1, 1, 1, NULL},
+
+    {"CF.RESERVE", handle_cuckoo_filter_command, CMD_CUCKOO_FILTER, CF_RESERVE,
+     -3, W | M, 1, 1, 1, NULL},
+    {"CF.ADD", handle_cuckoo_filter_command, CMD_CUCKOO_FILTER, CF_ADD, 3,
+     W | M | F, 1, 1, 1, NULL},
+    {"CF.ADDNX", handle_cuckoo_filter_command, CMD_CUCKOO_FILTER, CF_ADDNX, 3,
+     W | M | F, 1, 1, 1, NULL},
+    {"CF.EXISTS", handle_cuckoo_filter_command, CMD_CUCKOO_FILTER, CF_EXISTS, 3,
+     RO | F, 1, 1, 1, NULL},
+    {"CF.DEL", handle_cuckoo_filter_command, CMD_CUCKOO_FILTER, CF_DEL, 3,
+     W | F, 1, 1, 1, NULL},
+    {"CF.COUNT", handle_cuckoo_filter_command, CMD_CUCKOO_FILTER, CF_COUNT, 3,
+     RO | F, 1, 1, 1, NULL},
+    {"CF.INFO", handle_cuckoo_filter_command, CMD_CUCKOO_FILTER, CF_INFO, 2,
+     RO | F, 1, 1, 1, NULL},
+
+    {"CMS.INITBYDIM", handle_cms_command, CMD_CMS, CMS_INITBYDIM, -4, W | M, 1,
+     1, 1, NULL},
+    {"CMS.INITBYPROB", handle_cms_command, CMD_CMS, CMS_INITBYPROB, -4, W | M,
+     1, 1, 1, NULL},
+    {"CMS.INCRBY", handle_cms_command, CMD_CMS, CMS_INCRBY, -4, W | M, 1, 1, 1,
+     NULL},
+    {"CMS.QUERY", handle_cms_command, CMD_CMS, CMS_QUERY, -3, RO, 1, 1, 1,
+     NULL},
+    {"CMS.MERGE", handle_cms_command, CMD_CMS, CMS_MERGE, -4, W | M, 0, 0, 0,
+     __cms_merge_keys},
+    {"CMS.INFO", handle_cms_command, CMD_CMS, CMS_INFO, 2, RO | F, 1, 1, 1,
+     NULL},
+
+    {"PFADD", handle_hyperloglog_command, CMD_HYPERLOGLOG, PFADD, -2, W | M | F,
+     1, 1, 1, NULL},
+    {"PFCOUNT", handle_hyperloglog_command, CMD_HYPERLOGLOG, PFCOUNT, -2, RO, 1,
+     -1, 1, NULL},
+    {"PFMERGE", handle_hyperloglog_command, CMD_HYPERLOGLOG, PFMERGE, -2, W | M,
+     1, -1, 1, NULL},
+
+    {"TOPK.RESERVE", handle_top_k_command, CMD_TOP_K, TOPK_RESERVE, -3, W | M,
+     1, 1, 1, NULL},
+    {"TOPK.ADD", handle_top_k_command, CMD_TOP_K, TOPK_ADD, -3, W | M, 1, 1, 1,
+     NULL},
+    {"TOPK.INCRBY", handle_top_k_command, CMD_TOP_K, TOPK_INCRBY, -4, W | M, 1,
+     1, 1, NULL},
+    {"TOPK.QUERY", handle_top_k_command, CMD_TOP_K, TOPK_QUERY, -3, RO, 1, 1, 1,
+     NULL},
+    {"TOPK.COUNT", handle_top_k_command, CMD_TOP_K, TOPK_COUNT, -3, RO, 1, 1, 1,
+     NULL},
+    {"TOPK.LIST", handle_top_k_command, CMD_TOP_K, TOPK_LIST, -2, RO, 1, 1, 1,
+     NULL},
+    {"TOPK.INFO", handle_top_k_command, CMD_TOP_K, TOPK_INFO, 2, RO | F, 1, 1,
+     1, NULL},
+};
+
+#undef RO
+#undef W
+#undef M
+#undef F
+#undef A
+
+#define COMMAND_COUNT (sizeof(g_commands) / sizeof(g_commands[0]))
+/* Open addressing: a power of two at least twice the number of commands, so
+ * a probe rarely looks past its first slot */
+#define COMMAND_INDEX_SIZE 256
+_Static_assert(COMMAND_COUNT * 2 <= COMMAND_INDEX_SIZE,
+               "command index too small");
+_Static_assert(COMMAND_COUNT <= STATS_MAX_COMMANDS,
+               "command statistics too small");
+
+static const RedisCommand *g_command_index[COMMAND_INDEX_SIZE];
+static size_t g_command_name_max = 0;
+
+/* FNV-1a over the upper-cased name */
+static uint32_t __command_hash(const char *name, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)name[i];
+    if (c >= 'a' && c <= 'z') {
+      c -= 'a' - 'A';
+    }
+    h = (h ^ c) * 16777619u;
+  }
+  return h;
+}
+
+void command_table_init(void) {
+  memset(g_command_index, 0, sizeof(g_command_index));
+  g_command_name_max = 0;
+  for (size_t i = 0; i < COMMAND_COUNT; i++) {
+    const RedisCommand *c = &g_commands[i];
+    size_t len = strlen(c->name);
+    uint32_t slot = __command_hash(c->name, len) & (COMMAND_INDEX_SIZE - 1);
+    while (g_command_index[slot]) {
+      slot = (slot + 1) & (COMMAND_INDEX_SIZE - 1);
+    }
+    g_command_index[slot] = c;
+    if (len > g_command_name_max) {
+      g_command_name_max = len;
+    }
+  }
+}
+
+/*
+ * Names are matched exactly and case-insensitively, so `PINGX` or
+ * `CMS.QUERYFOO` are unknown commands.
+ */
+const RedisCommand *command_lookup(const char *name, size_t len) {
+  if (len == 0 || len > g_command_name_max) {
+    return NULL;
+  }
+  uint32_t slot = __command_hash(name, len) & (COMMAND_INDEX_SIZE - 1);
+  for (const RedisCommand *c; (c = g_command_index[slot]);
+       slot = (slot + 1) & (COMMAND_INDEX_SIZE - 1)) {
+    if (strncasecmp(c->name, name, len) == 0 && c->name[len] == '\0') {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+int command_count(void) { return (int)COMMAND_COUNT; }
+
+int command_id(const RedisCommand *c) { return (int)(c - g_commands); }
+
+const RedisCommand *command_by_id(int id) { return &g_commands[id]; }
+
+static bool __arity_ok(const RedisCommand *c, int argc) {
+  return c->arity >= 0 ? argc == c->arity : argc >= -c->arity;
+}
+
+void dispatch_batch_begin(const char *client) {
+  g_batch_client = client;
+  if (!g_batch_mark) {
+    g_batch_mark = monotonic_now();
+  }
+}
+
+void dispatch_batch_end(void) {
+  g_batch_client = NULL;
+  g_batch_mark = 0;
+}
+
+REDIS_RC dispatch_command(int argc, char **argv, size_t *argv_len,
+                          ReplyBuffer *reply) {
+  if (argc < 1) {
+    return REDIS_OK;
+  }
+
+  Command cmd;
+  REDIS_RC rc;
+  const RedisCommand *c = command_lookup(argv[0], argv_len[0]);
+  if (!c) {
+    rc = REDIS_CMD_NULL;
+    __batch_advance();
+  } else if (!__arity_ok(c, argc)) {
+    rc = REDIS_WRONG_NUMBER_OF_ARGS;
+    stats_command_rejected(command_id(c));
+    __batch_advance();
+  } else {
+    rc = (c->flags & CMD_FLAG_WRITE) && repl_read_only()
+             ? REDIS_REPL_READONLY
+             : __enforce_maxmemory(c->flags);
+    if (REDIS_SUCCESS(rc)) {
+      init_command(&cmd, c->type, c->sub_cmd, argc - 1, argv + 1,
+                   argv_len + 1);
+      uint64_t start = g_batch_mark ? g_batch_mark : monotonic_now();
+      rc = c->proc(&cmd, reply);
+      uint64_t end = monotonic_now();
+      if (g_batch_mark) {
+        g_batch_mark = end;
+      }
+      uint64_t ns = monotonic_ticks_to_ns(end - start);
+      stats_command_call(command_id(c), ns, REDIS_FAILED(rc));
+      latency_add_sample_if_needed((c->flags & CMD_FLAG_FAST)
+                                       ? LATENCY_FAST_COMMAND
+                                       : LATENCY_COMMAND,
+                                   ns / 1000);
+      if (slowlog_wanted(ns / 1000)) {
+        slowlog_push(argc, argv, argv_len, ns / 1000, g_batch_client);
+      }
+    } else {
+      stats_command_rejected(command_id(c));
+      __batch_advance();
+    }
+    if (REDIS_SUCCESS(rc) && (c->flags & CMD_FLAG_WRITE)) {
+      rdb_add_dirty(1);
+      if (aof_enabled() || repl_stream_enabled()) {
+        __propagate(c->type, c->sub_cmd, argc, argv, argv_len);
+      }
+    }
+  }
+
+  if (REDIS_SUCCESS(rc)) {
+    return rc;
+  }
+  if (rc == REDIS_CMD_NULL) {
+    reply_add_error_format(reply, "ERR unknown command '%.128s'", argv[0]);
+  } else if (rc == REDIS_WRONG_NUMBER_OF_ARGS) {
+    reply_add_error_format(reply,
+                           "ERR wrong number of arguments for '%.128s' command",
+                           argv[0]);
+  } else {
+    reply_add_error(reply, redis_rc_message(rc));
+  }
+  return rc;
+}
+
+int command_get_keys(int argc, char **argv, size_t *argv_len, int *keys) {
+  if (argc < 1) {
+    return 0;
+  }
+  const RedisCommand *c = command_lookup(argv[0], argv_len[0]);
+  /* a malformed request fails the same way on any shard */
+  if (!c || !__arity_ok(c, argc)) {
+    return 0;
+  }
+  if (c->getkeys) {
+    return c->getkeys(argc, argv, argv_len, keys);
+  }
+  if (c->first_key == 0) {
+    return 0;
+  }
+  int last = c->last_key < 0 ? argc + c->last_key : c->last_key;
+  int n = 0;
+  for (int i = c->first_key; i <= last && i < argc; i += c->key_step) {
+    keys[n++] = i;
+  }
+  return n;
+}
+
+void propagate_del(const char *key, size_t len) {
+  if (!aof_enabled() && !repl_stream_enabled()) {
+    return;
+  }
+  char *del[2] = {"DEL", (char *)key};
+  size_t del_len[2] = {3, len};
+  __feed(2, del, del_len);
+}
+
+const char *redis_rc_message(REDIS_RC rc) {
+  switch (rc) {
+  case REDIS_CMD_NULL:
+    return "ERR unknown command";
+  case REDIS_CMD_CONNECTION_FAILED:
+    return "ERR connection failed";
+  case REDIS_SUB_CMD_NOT_FOUND:
+    return "ERR unknown subcommand";
+  case REDIS_PROTOCOL_ERROR:
+    return "ERR Protocol error";
+  case REDIS_WRONG_NUMBER_OF_ARGS:
+    return "ERR wrong number of arguments";
+  case REDIS_INVALID_ARGUMENT:
+    return "ERR syntax error";
+  case REDIS_NOT_AN_INTEGER:
+    return "ERR value is not an integer or out of range";
+  case REDIS_NOT_A_FLOAT:
+    return "ERR value is not a valid float";
+  case REDIS_OUT_OF_MEMORY:
+    return "ERR out of memory";
+  case REDIS_UNSUPPORTED_PROTOCOL:
+    return "NOPROTO unsupported protocol version";
+  case REDIS_WRONG_TYPE:
+    return "WRONGTYPE Operation against a key holding the wrong kind of value";
+  case REDIS_KEY_EXISTS:
+    return "ERR key already exists";
+  case REDIS_KEY_NOT_FOUND:
+    return "ERR no such key";
+  case REDIS_CROSS_SHARD:
+    return "CROSSSLOT Keys in request don't hash to the same shard";
+  case REDIS_OVERFLOW:
+    return "ERR increment or decrement would overflow";
+  case REDIS_INVALID_EXPIRE:
+    return "ERR invalid expire time";
+  case REDIS_OOM:
+    return "OOM command not allowed when used memory > 'maxmemory'";
+  case REDIS_IO_ERROR:
+    return "ERR I/O error writing the snapshot";
+  case REDIS_CORRUPT_SNAPSHOT:
+    return "ERR corrupt snapshot";
+  case REDIS_NOT_SUPPORTED:
+    return "ERR not supported in sharded mode";
+  case REDIS_SAVE_IN_PROGRESS:
+    return "ERR Background save already in progress";
+  case REDIS_CORRUPT_AOF:
+    return "ERR corrupt append only file";
+  case REDIS_AOF_DISABLED:
+    return "ERR append only file is disabled";
+  case REDIS_REWRITE_IN_PROGRESS:
+    return "ERR Background append only file rewriting already in progress";
+  case REDIS_BUSYKEY:
+    return "BUSYKEY Target key name already exists.";
+  case REDIS_BAD_PAYLOAD:
+    return "ERR DUMP payload version or checksum are wrong";
+  case REDIS_CMS_SKETCH_EXISTED:
+    return "ERR CMS: key already exists";
+  case REDIS_CMS_KEY_NOT_FOUND:
+    return "ERR CMS: key does not exist";
+  case REDIS_CMS_DIM_MISMATCH:
+    return "ERR CMS: width/depth is not equal";
+  case REDIS_CMS_LAYOUT_MISMATCH:
+    return "ERR CMS: flat and blocked sketches cannot be merged";
+  case REDIS_CMS_INVALID_WIDTH:
+    return "ERR CMS: invalid width";
+  case REDIS_CMS_INVALID_DEPTH:
+    return "ERR CMS: invalid depth";
+  case REDIS_CMS_INVALID_ERROR_RATE:
+    return "ERR CMS: invalid overestimation value";
+  case REDIS_CMS_INVALID_PROB:
+    return "ERR CMS: invalid prob value";
+  case REDIS_CMS_INVALID_NUMBER:
+    return "ERR CMS: Cannot parse number";
+  case REDIS_CMS_INVALID_NUMKEYS:
+    return "ERR CMS: invalid numkeys";
+  case REDIS_CMS_INVALID_COUNTER_BITS:
+    return "ERR CMS: invalid counter bits";
+  case REDIS_ZSET_INVALID_RANGE:
+    return "ERR min or max is not a float";
+  case REDIS_ZSET_XX_AND_NX:
+    return "ERR XX and NX options at the same time are not compatible";
+  case REDIS_ZSET_GT_LT_NX:
+    return "ERR GT, LT, and/or NX options at the same time are not compatible";
+  case REDIS_ZSET_INCR_PAIR:
+    return "ERR INCR option supports a single increment-element pair";
+  case REDIS_ZSET_NAN_SCORE:
+    return "ERR resulting score is not a number (NaN)";
+  case REDIS_GEO_INVALID_COORDS:
+    return "ERR invalid longitude,latitude pair";
+  case REDIS_GEO_UNSUPPORTED_UNIT:
+    return "ERR unsupported unit provided. please use M, KM, FT, MI";
+  case REDIS_GEO_MEMBER_NOT_FOUND:
+    return "ERR could not decode requested zset member";
+  case REDIS_GEO_FROM_ONE_OF:
+    return "ERR exactly one of FROMMEMBER or FROMLONLAT can be specified";
+  case REDIS_GEO_BY_ONE_OF:
+    return "ERR exactly one of BYRADIUS and BYBOX can be specified";
+  case REDIS_GEO_ANY_WITHOUT_COUNT:
+    return "ERR the ANY argument requires COUNT argument";
+  case REDIS_GEO_INVALID_COUNT:
+    return "ERR COUNT must be > 0";
+  case REDIS_GEO_INVALID_SHAPE:
+    return "ERR radius, width and height cannot be negative";
+  case REDIS_BF_KEY_EXISTS:
+    return "ERR item exists";
+  case REDIS_BF_KEY_NOT_FOUND:
+    return "ERR not found";
+  case REDIS_BF_INVALID_ERROR_RATE:
+    return "ERR (0 < error rate range < 1)";
+  case REDIS_BF_INVALID_CAPACITY:
+    return "ERR (capacity should be larger than 0)";
+  case REDIS_BF_INVALID_EXPANSION:
+    return "ERR expansion should be greater or equal to 1";
+  case REDIS_BF_NONSCALING_EXPANSION:
+    return "ERR Nonscaling filters cannot expand";
+  case REDIS_BF_FILTER_FULL:
+    return "ERR non scaling filter is full";
+  case REDIS_CF_KEY_EXISTS:
+    return "ERR item exists";
+  case REDIS_CF_KEY_NOT_FOUND:
+    return "ERR not found";
+  case REDIS_CF_INVALID_CAPACITY:
+    return "ERR Bad capacity";
+  case REDIS_CF_INVALID_MAX_ITERATIONS:
+    return "ERR Bad max iterations";
+  case REDIS_CF_INVALID_EXPANSION:
+    return "ERR Bad expansion";
+  case REDIS_CF_FILTER_FULL:
+    return "ERR Filter is full";
+  case REDIS_TOPK_KEY_EXISTS:
+    return "ERR TopK: key already exists";
+  case REDIS_TOPK_KEY_NOT_FOUND:
+    return "ERR TopK: key does not exist";
+  case REDIS_TOPK_INVALID_K:
+    return "ERR TopK: invalid k";
+  case REDIS_TOPK_INVALID_WIDTH:
+    return "ERR TopK: invalid width";
+  case REDIS_TOPK_INVALID_DEPTH:
+    return "ERR TopK: invalid depth";
+  case REDIS_TOPK_INVALID_INCREMENT:
+    return "ERR TopK: increment must be an integer between 1 and 100000";
+  case REDIS_CLUSTER_DISABLED:
+    return "ERR This instance has cluster support disabled";
+  case REDIS_CLUSTER_INVALID_SLOT:
+    return "ERR Invalid or out of range slot";
+  case REDIS_CLUSTER_SLOT_BUSY:
+    return "ERR Slot is already busy";
+  case REDIS_CLUSTER_SLOT_UNASSIGNED:
+    return "ERR Slot is already unassigned";
+  case REDIS_CLUSTER_UNKNOWN_NODE:
+    return "ERR I don't know about this node";
+  case REDIS_CLUSTER_NOT_OWNER:
+    return "ERR I'm not the owner of this hash slot";
+  case REDIS_CLUSTER_ALREADY_OWNER:
+    return "ERR I'm already the owner of this hash slot";
+  case REDIS_CLUSTER_SLOT_NOT_EMPTY:
+    return "ERR Can't assign hashslot to a different node while I still hold "
+           "keys for this hash slot.";
+  case REDIS_CLUSTER_INVALID_ADDRESS:
+    return "ERR Invalid node address specified";
+  case REDIS_CLUSTER_INVALID_DB:
+    return "ERR DB index is out of range";
+  case REDIS_CLUSTER_MIGRATE_IO:
+    return "IOERR error or timeout during MIGRATE";
+  case REDIS_REPL_READONLY:
+    return "READONLY You can't write against a read only replica.";
+  case REDIS_REPL_IN_CLUSTER:
+    return "ERR REPLICAOF not allowed in cluster mode.";
+  case REDIS_REPL_INVALID_PORT:
+    return "ERR Invalid master port";
+  default:
+    return "ERR unknown error";
+  }
+}
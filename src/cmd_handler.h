@@ -3,7 +3,96 @@
 
 #include "command/cmd.h"
 #include "redis-C/rc.h"
+#include "serialize.h"
 
-REDIS_RC handle_command(Command* cmd); 
+#define REDIS_C_VERSION "0.1.0"
+
+/* May allocate: refused when over maxmemory and nothing can be evicted */
+#define CMD_FLAG_DENYOOM (1 << 0)
+/* Modifies the keyspace: counted towards the `save` rules and logged */
+#define CMD_FLAG_WRITE (1 << 1)
+/* Only reads the keyspace */
+#define CMD_FLAG_READONLY (1 << 2)
+/* O(1) or O(log N): never blocks the loop for long */
+#define CMD_FLAG_FAST (1 << 3)
+/* Served for a slot being imported without a prior ASKING (cluster mode) */
+#define CMD_FLAG_ASKING (1 << 4)
+
+typedef REDIS_RC (*CommandProc)(Command* cmd, ReplyBuffer* reply);
+typedef int (*CommandGetKeysProc)(int argc, char** argv, size_t* argv_len,
+                                  int* keys);
+
+/*
+ * Command table entry. `arity` counts argv including the name: N means
+ * exactly N, -N at least N. Keys are at argv[first_key], then every
+ * `key_step` up to `last_key` (negative counts from the end, -1 is the last
+ * argument); first_key is 0 for keyless commands. Commands whose keys
+ * depend on their arguments provide `getkeys` instead.
+ */
+typedef struct RedisCommand {
+    const char* name;
+    CommandProc proc;
+    CommandType type;
+    int sub_cmd;
+    int arity;
+    int flags;
+    int first_key;
+    int last_key;
+    int key_step;
+    CommandGetKeysProc getkeys;
+} RedisCommand;
+
+/*
+ * Index the command table by name. Must run once, before any command is
+ * dispatched; the index is read-only afterwards and shared by every thread.
+ */
+void command_table_init(void);
+
+/* The command named `name` (case-insensitive), or NULL. O(1). */
+const RedisCommand* command_lookup(const char* name, size_t len);
+
+/*
+ * Commands are numbered by their position in the table, from 0 to
+ * command_count() - 1; the statistics of INFO are kept by that id.
+ */
+int command_count(void);
+int command_id(const RedisCommand* c);
+const RedisCommand* command_by_id(int id);
+
+/*
+ * Resolve argv[0] to a command, run it and append its reply (or the error
+ * describing the failure) to `reply`. argv must be NUL-terminated views as
+ * produced by resp_parse().
+ */
+REDIS_RC dispatch_command(int argc, char** argv, size_t* argv_len,
+                          ReplyBuffer* reply);
+
+/*
+ * Every command is timed for INFO, LATENCY and SLOWLOG. Between these calls,
+ * around the commands a client pipelined, a command's time runs from the
+ * end of the previous one: one clock read per command rather than two, at
+ * the price of counting its parsing too. `client` ("ip:port") is the one
+ * SLOWLOG reports; calling dispatch_batch_begin() again before
+ * dispatch_batch_end() switches to another client and keeps the clock.
+ */
+void dispatch_batch_begin(const char* client);
+void dispatch_batch_end(void);
+
+/*
+ * Store in `keys` the argv positions of the keys a request touches; `keys`
+ * must have room for argc entries. Returns the number of keys, 0 for keyless
+ * or unknown commands (which then run wherever they arrive).
+ */
+int command_get_keys(int argc, char** argv, size_t* argv_len, int* keys);
+
+/*
+ * Hand a deletion the server did on its own rather than as asked (an
+ * eviction, an expiry, the keys MIGRATE moved away) to the AOF and to the
+ * replicas, as a DEL of `key`. Also the expired hook of the keyspace.
+ */
+void propagate_del(const char* key, size_t len);
+
+/* Client-facing error text for a failed REDIS_RC. */
+const char* redis_rc_message(REDIS_RC rc);
 
 #endif 
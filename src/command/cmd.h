@@ -9,23 +9,50 @@ typedef enum {
     CMD_SET,
     CMD_GEOSPATIAL,
     CMD_BLOOM_FILTER,
-    CMD_CMS
+    CMD_CUCKOO_FILTER,
+    CMD_CMS,
+    CMD_HYPERLOGLOG,
+    CMD_TOP_K,
+    CMD_HELLO,
+    CMD_SAVE,
+    CMD_BGSAVE,
+    CMD_LASTSAVE,
+    CMD_BGREWRITEAOF,
+    CMD_FLUSHALL,
+    CMD_INFO,
+    CMD_LATENCY,
+    CMD_SLOWLOG,
+    CMD_CLUSTER,
+    CMD_ASKING,
+    CMD_DUMP,
+    CMD_RESTORE,
+    CMD_MIGRATE,
+    CMD_REPLICAOF,
+    CMD_ROLE,
+    CMD_REPLCONF,
+    CMD_SYNC
 } CommandType;
 
+/*
+ * A parsed request. `arg` holds the arguments that follow the command name;
+ * they are views into the request buffer (NUL-terminated in place) and are
+ * only valid while the request is being handled.
+ */
 typedef struct {
     CommandType type;
-    int sub_cmd; 
+    int sub_cmd;
+    int argc;
     char** arg;
+    size_t* arg_len;
 } Command;
 
-static Command* create_command(CommandType type, int sub_cmd, char** arg){
-    Command* cmd = malloc(sizeof(Command));
-
+static inline void init_command(Command* cmd, CommandType type, int sub_cmd,
+                                int argc, char** arg, size_t* arg_len) {
     cmd->type = type;
     cmd->sub_cmd = sub_cmd;
+    cmd->argc = argc;
     cmd->arg = arg;
-
-    return cmd;
+    cmd->arg_len = arg_len;
 }
 
 #endif
@@ -1,6 +1,256 @@
 #ifndef CMD_BLOOM_FILTER_H__
 #define CMD_BLOOM_FILTER_H__
 
-typedef enum { RESERVE = 0, INFO, MADD, EXISTS, MEXISTS } CMD_bloom_filter_type;
+#include "cmd_handler.h"
+#include "command/cmd.h"
+#include "data_structure/bloom_filter.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include "storage.h"
+#include "util/str_util.h"
+#include <stdlib.h>
+#include <strings.h>
+
+typedef enum {
+  BF_RESERVE = 0,
+  BF_INFO,
+  BF_MADD,
+  BF_EXISTS,
+  BF_MEXISTS,
+  BF_ADD
+} CMD_bloom_filter_type;
+
+/* Filters created implicitly by BF.ADD / BF.MADD */
+#define BF_DEFAULT_ERROR_RATE 0.01
+#define BF_DEFAULT_CAPACITY 100
+
+/* *bf is NULL when the key does not exist. */
+static REDIS_RC __bf_lookup(Command *cmd, BloomFilter **bf) {
+  RedisObject *obj;
+  REDIS_RC rc =
+      storage_lookup_typed(cmd->arg[0], cmd->arg_len[0], OBJ_BLOOM, &obj);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  *bf = obj ? (BloomFilter *)obj->ptr : NULL;
+  return REDIS_OK;
+}
+
+static REDIS_RC __bf_lookup_or_create(Command *cmd, BloomFilter **bf) {
+  REDIS_RC rc = __bf_lookup(cmd, bf);
+  if (REDIS_SUCCESS(rc) && !*bf) {
+    rc = create_bloom_store(cmd->arg[0], cmd->arg_len[0],
+                            BF_DEFAULT_ERROR_RATE, BF_DEFAULT_CAPACITY,
+                            BLOOM_DEFAULT_EXPANSION, bf);
+  }
+  return rc;
+}
+
+/* BF.RESERVE key error_rate capacity [EXPANSION expansion] [NONSCALING] */
+static REDIS_RC __bf_reserve(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  double error_rate;
+  if (!string_to_double(cmd->arg[1], cmd->arg_len[1], &error_rate) ||
+      !(error_rate > 0 && error_rate < 1)) {
+    return REDIS_BF_INVALID_ERROR_RATE;
+  }
+  unsigned long long capacity;
+  if (!string_to_ull(cmd->arg[2], cmd->arg_len[2], &capacity) ||
+      capacity == 0) {
+    return REDIS_BF_INVALID_CAPACITY;
+  }
+
+  unsigned long long expansion = BLOOM_DEFAULT_EXPANSION;
+  bool expansion_given = false, nonscaling = false;
+  for (int i = 3; i < cmd->argc; i++) {
+    if (strcasecmp(cmd->arg[i], "NONSCALING") == 0) {
+      nonscaling = true;
+    } else if (strcasecmp(cmd->arg[i], "EXPANSION") == 0 &&
+               i + 1 < cmd->argc) {
+      i++;
+      if (!string_to_ull(cmd->arg[i], cmd->arg_len[i], &expansion) ||
+          expansion == 0 || expansion > UINT32_MAX) {
+        return REDIS_BF_INVALID_EXPANSION;
+      }
+      expansion_given = true;
+    } else {
+      return REDIS_INVALID_ARGUMENT;
+    }
+  }
+  if (nonscaling && expansion_given) {
+    return REDIS_BF_NONSCALING_EXPANSION;
+  }
+
+  BloomFilter *bf;
+  REDIS_RC rc = create_bloom_store(cmd->arg[0], cmd->arg_len[0], error_rate,
+                                   capacity, nonscaling ? 0 : expansion, &bf);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
+  }
+  return rc;
+}
+
+/* BF.ADD key item */
+static REDIS_RC __bf_add(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  BloomFilter *bf;
+  REDIS_RC rc = __bf_lookup_or_create(cmd, &bf);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  int res = bloom_add(bf, cmd->arg[1], cmd->arg_len[1]);
+  if (res == BLOOM_ERR_FULL) {
+    return REDIS_BF_FILTER_FULL;
+  } else if (res == BLOOM_ERR_OOM) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  reply_add_bool(reply, res == BLOOM_ADDED);
+  return REDIS_OK;
+}
+
+/* BF.MADD key item [item ...]; a key that does not fit gets an error entry */
+static REDIS_RC __bf_madd(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  BloomFilter *bf;
+  REDIS_RC rc = __bf_lookup_or_create(cmd, &bf);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  size_t n = (size_t)cmd->argc - 1;
+  int *results = malloc(n * sizeof(int));
+  if (!results) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  bloom_madd(bf, (const char **)cmd->arg + 1, cmd->arg_len + 1, n, results);
+  reply_add_array_len(reply, (long)n);
+  for (size_t i = 0; i < n; i++) {
+    if (results[i] == BLOOM_ERR_FULL) {
+      reply_add_error(reply, redis_rc_message(REDIS_BF_FILTER_FULL));
+    } else if (results[i] == BLOOM_ERR_OOM) {
+      reply_add_error(reply, redis_rc_message(REDIS_OUT_OF_MEMORY));
+    } else {
+      reply_add_bool(reply, results[i] == BLOOM_ADDED);
+    }
+  }
+  free(results);
+  return REDIS_OK;
+}
+
+/* BF.EXISTS key item */
+static REDIS_RC __bf_exists(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  BloomFilter *bf;
+  REDIS_RC rc = __bf_lookup(cmd, &bf);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_bool(reply, bf && bloom_exists(bf, cmd->arg[1], cmd->arg_len[1]));
+  return REDIS_OK;
+}
+
+/* BF.MEXISTS key item [item ...] */
+static REDIS_RC __bf_mexists(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  BloomFilter *bf;
+  REDIS_RC rc = __bf_lookup(cmd, &bf);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  size_t n = (size_t)cmd->argc - 1;
+  bool *found = calloc(n, sizeof(bool));
+  if (!found) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  if (bf) {
+    bloom_mexists(bf, (const char **)cmd->arg + 1, cmd->arg_len + 1, n, found);
+  }
+  reply_add_array_len(reply, (long)n);
+  for (size_t i = 0; i < n; i++) {
+    reply_add_bool(reply, found[i]);
+  }
+  free(found);
+  return REDIS_OK;
+}
+
+/* BF.INFO key [CAPACITY | SIZE | FILTERS | ITEMS | EXPANSION] */
+static REDIS_RC __bf_info(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 1 && cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  BloomFilter *bf;
+  REDIS_RC rc = __bf_lookup(cmd, &bf);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  if (!bf) {
+    return REDIS_BF_KEY_NOT_FOUND;
+  }
+
+  static const char *fields[] = {"Capacity", "Size", "Number of filters",
+                                 "Number of items inserted", "Expansion rate"};
+  static const char *names[] = {"CAPACITY", "SIZE", "FILTERS", "ITEMS",
+                                "EXPANSION"};
+  long long values[] = {(long long)bloom_capacity(bf),
+                        (long long)bloom_memory_usage(bf), bf->num_layers,
+                        (long long)bloom_count(bf), bf->expansion};
+  int only = -1;
+  if (cmd->argc == 2) {
+    for (int i = 0; i < 5 && only < 0; i++) {
+      if (strcasecmp(cmd->arg[1], names[i]) == 0) {
+        only = i;
+      }
+    }
+    if (only < 0) {
+      return REDIS_INVALID_ARGUMENT;
+    }
+    reply_add_array_len(reply, 1);
+  } else {
+    reply_add_map_len(reply, 5);
+  }
+  for (int i = 0; i < 5; i++) {
+    if (only >= 0 && i != only) {
+      continue;
+    }
+    if (only < 0) {
+      reply_add_bulk_cstr(reply, fields[i]);
+    }
+    /* A non-scaling filter has no expansion rate */
+    if (i == 4 && bf->expansion == 0) {
+      reply_add_null(reply);
+    } else {
+      reply_add_integer(reply, values[i]);
+    }
+  }
+  return REDIS_OK;
+}
+
+static REDIS_RC handle_bloom_filter_command(Command *cmd, ReplyBuffer *reply) {
+  switch (cmd->sub_cmd) {
+  case BF_RESERVE:
+    return __bf_reserve(cmd, reply);
+  case BF_ADD:
+    return __bf_add(cmd, reply);
+  case BF_MADD:
+    return __bf_madd(cmd, reply);
+  case BF_EXISTS:
+    return __bf_exists(cmd, reply);
+  case BF_MEXISTS:
+    return __bf_mexists(cmd, reply);
+  case BF_INFO:
+    return __bf_info(cmd, reply);
+  default:
+    return REDIS_SUB_CMD_NOT_FOUND;
+  }
+}
 
 #endif
@@ -0,0 +1,384 @@
+#ifndef CMD_CLUSTER_H__
+#define CMD_CLUSTER_H__
+
+#include "cluster.h"
+#include "cmd_handler.h"
+#include "command/cmd.h"
+#include "rdb.h"
+#include "redis-C/rc.h"
+#include "replication.h"
+#include "serialize.h"
+#include "storage.h"
+#include "util/hash.h"
+#include "util/str_util.h"
+#include <stdlib.h>
+#include <strings.h>
+
+#define MIGRATE_DEFAULT_TIMEOUT_MS 1000
+
+static bool __cluster_parse_slot(const char *s, size_t len, int *slot) {
+  long long v;
+  if (!string_to_ll(s, len, &v) || v < 0 || v >= CLUSTER_SLOTS) {
+    return false;
+  }
+  *slot = (int)v;
+  return true;
+}
+
+/*
+ * ADDSLOTS / DELSLOTS slot [slot ...] and ADDSLOTSRANGE / DELSLOTSRANGE
+ * start end [start end ...]
+ */
+static REDIS_RC __cluster_slots_change(Command *cmd, bool add, bool range,
+                                       ReplyBuffer *reply) {
+  int args = cmd->argc - 1;
+  if (args < 1 || (range && args % 2 != 0)) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  uint8_t *slots = calloc(CLUSTER_SLOTS, 1);
+  if (!slots) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  for (int i = 1; i < cmd->argc; i += range ? 2 : 1) {
+    int start, end;
+    if (!__cluster_parse_slot(cmd->arg[i], cmd->arg_len[i], &start) ||
+        (range &&
+         !__cluster_parse_slot(cmd->arg[i + 1], cmd->arg_len[i + 1], &end))) {
+      free(slots);
+      return REDIS_CLUSTER_INVALID_SLOT;
+    }
+    if (!range) {
+      end = start;
+    }
+    for (int j = start; j <= end; j++) {
+      slots[j] = 1;
+    }
+  }
+  REDIS_RC rc = add ? cluster_add_slots(slots) : cluster_del_slots(slots);
+  free(slots);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
+  }
+  return rc;
+}
+
+/* SETSLOT slot IMPORTING|MIGRATING|NODE <id> / SETSLOT slot STABLE */
+static REDIS_RC __cluster_setslot(Command *cmd, ReplyBuffer *reply) {
+  int slot;
+  if (cmd->argc < 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if (!__cluster_parse_slot(cmd->arg[1], cmd->arg_len[1], &slot)) {
+    return REDIS_CLUSTER_INVALID_SLOT;
+  }
+  ClusterSetSlot how;
+  const char *what = cmd->arg[2];
+  if (strcasecmp(what, "IMPORTING") == 0) {
+    how = CLUSTER_SETSLOT_IMPORTING;
+  } else if (strcasecmp(what, "MIGRATING") == 0) {
+    how = CLUSTER_SETSLOT_MIGRATING;
+  } else if (strcasecmp(what, "NODE") == 0) {
+    how = CLUSTER_SETSLOT_NODE;
+  } else if (strcasecmp(what, "STABLE") == 0) {
+    how = CLUSTER_SETSLOT_STABLE;
+  } else {
+    return REDIS_INVALID_ARGUMENT;
+  }
+  if (cmd->argc != (how == CLUSTER_SETSLOT_STABLE ? 3 : 4)) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  REDIS_RC rc = cluster_set_slot(slot, how, cmd->argc == 4 ? cmd->arg[3] : "",
+                                 cmd->argc == 4 ? cmd->arg_len[3] : 0);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
+  }
+  return rc;
+}
+
+/* GETKEYSINSLOT slot count */
+static REDIS_RC __cluster_getkeysinslot(Command *cmd, ReplyBuffer *reply) {
+  int slot;
+  long long count;
+  if (cmd->argc != 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if (!__cluster_parse_slot(cmd->arg[1], cmd->arg_len[1], &slot)) {
+    return REDIS_CLUSTER_INVALID_SLOT;
+  }
+  if (!string_to_ll(cmd->arg[2], cmd->arg_len[2], &count) || count < 0) {
+    return REDIS_NOT_AN_INTEGER;
+  }
+  size_t size = storage_slot_size((unsigned int)slot);
+  size_t max = (size_t)count < size ? (size_t)count : size;
+  const char **keys = malloc((max ? max : 1) * sizeof(char *));
+  size_t *lens = malloc((max ? max : 1) * sizeof(size_t));
+  if (!keys || !lens) {
+    free(keys);
+    free(lens);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  size_t n = storage_slot_keys((unsigned int)slot, keys, lens, max);
+  reply_add_array_len(reply, (long)n);
+  for (size_t i = 0; i < n; i++) {
+    reply_add_bulk(reply, keys[i], lens[i]);
+  }
+  free(keys);
+  free(lens);
+  return REDIS_OK;
+}
+
+static REDIS_RC handle_cluster_command(Command *cmd, ReplyBuffer *reply) {
+  if (!cluster_enabled()) {
+    return REDIS_CLUSTER_DISABLED;
+  }
+  const char *sub = cmd->arg[0];
+  if (strcasecmp(sub, "ADDSLOTS") == 0) {
+    return __cluster_slots_change(cmd, true, false, reply);
+  } else if (strcasecmp(sub, "ADDSLOTSRANGE") == 0) {
+    return __cluster_slots_change(cmd, true, true, reply);
+  } else if (strcasecmp(sub, "DELSLOTS") == 0) {
+    return __cluster_slots_change(cmd, false, false, reply);
+  } else if (strcasecmp(sub, "DELSLOTSRANGE") == 0) {
+    return __cluster_slots_change(cmd, false, true, reply);
+  } else if (strcasecmp(sub, "SETSLOT") == 0) {
+    return __cluster_setslot(cmd, reply);
+  } else if (strcasecmp(sub, "GETKEYSINSLOT") == 0) {
+    return __cluster_getkeysinslot(cmd, reply);
+  } else if (strcasecmp(sub, "MEET") == 0) {
+    long long port;
+    if (cmd->argc != 3) {
+      return REDIS_WRONG_NUMBER_OF_ARGS;
+    }
+    if (!string_to_ll(cmd->arg[2], cmd->arg_len[2], &port)) {
+      return REDIS_CLUSTER_INVALID_ADDRESS;
+    }
+    REDIS_RC rc = cluster_meet(cmd->arg[1], (int)port);
+    if (REDIS_SUCCESS(rc)) {
+      reply_add_ok(reply);
+    }
+    return rc;
+  } else if (strcasecmp(sub, "KEYSLOT") == 0) {
+    if (cmd->argc != 2) {
+      return REDIS_WRONG_NUMBER_OF_ARGS;
+    }
+    reply_add_integer(reply, hash_key_slot(cmd->arg[1], cmd->arg_len[1]));
+    return REDIS_OK;
+  } else if (strcasecmp(sub, "COUNTKEYSINSLOT") == 0) {
+    int slot;
+    if (cmd->argc != 2) {
+      return REDIS_WRONG_NUMBER_OF_ARGS;
+    }
+    if (!__cluster_parse_slot(cmd->arg[1], cmd->arg_len[1], &slot)) {
+      return REDIS_CLUSTER_INVALID_SLOT;
+    }
+    reply_add_integer(reply, (long long)storage_slot_size((unsigned int)slot));
+    return REDIS_OK;
+  }
+
+  if (cmd->argc != 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if (strcasecmp(sub, "INFO") == 0) {
+    cluster_reply_info(reply);
+  } else if (strcasecmp(sub, "NODES") == 0) {
+    cluster_reply_nodes(reply);
+  } else if (strcasecmp(sub, "SLOTS") == 0) {
+    cluster_reply_slots(reply);
+  } else if (strcasecmp(sub, "MYID") == 0) {
+    reply_add_bulk_cstr(reply, cluster_myid());
+  } else if (strcasecmp(sub, "SAVECONFIG") == 0) {
+    REDIS_RC rc = cluster_save_config();
+    if (REDIS_FAILED(rc)) {
+      return rc;
+    }
+    reply_add_ok(reply);
+  } else {
+    return REDIS_SUB_CMD_NOT_FOUND;
+  }
+  return REDIS_OK;
+}
+
+/* ASKING: the next command may touch a slot this node is importing */
+static REDIS_RC handle_asking(Command *cmd, ReplyBuffer *reply) {
+  (void)cmd;
+  if (!cluster_enabled()) {
+    return REDIS_CLUSTER_DISABLED;
+  }
+  reply_add_ok(reply);
+  return REDIS_OK;
+}
+
+/* DUMP key: the value serialized for RESTORE, nil for a missing key */
+static REDIS_RC handle_dump(Command *cmd, ReplyBuffer *reply) {
+  RedisObject *obj = storage_lookup(cmd->arg[0], cmd->arg_len[0]);
+  if (!obj) {
+    reply_add_null(reply);
+    return REDIS_OK;
+  }
+  char *payload;
+  size_t len;
+  REDIS_RC rc = rdb_dump_object(obj, &payload, &len);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_bulk(reply, payload, len);
+  free(payload);
+  return REDIS_OK;
+}
+
+/*
+ * RESTORE key ttl payload [REPLACE] [ABSTTL]: create a key from a DUMP
+ * payload, expiring in `ttl` ms (at unix time `ttl` ms with ABSTTL; 0 for
+ * never). RESTORE-ASKING is the same command, sent by MIGRATE.
+ */
+static REDIS_RC handle_restore(Command *cmd, ReplyBuffer *reply) {
+  const char *key = cmd->arg[0];
+  size_t key_len = cmd->arg_len[0];
+  bool replace = false, absttl = false;
+  for (int i = 3; i < cmd->argc; i++) {
+    if (strcasecmp(cmd->arg[i], "REPLACE") == 0) {
+      replace = true;
+    } else if (strcasecmp(cmd->arg[i], "ABSTTL") == 0) {
+      absttl = true;
+    } else {
+      return REDIS_INVALID_ARGUMENT;
+    }
+  }
+  long long ttl;
+  if (!string_to_ll(cmd->arg[1], cmd->arg_len[1], &ttl) || ttl < 0) {
+    return REDIS_INVALID_EXPIRE;
+  }
+  if (!replace && storage_lookup(key, key_len)) {
+    return REDIS_BUSYKEY;
+  }
+  RedisObject *obj;
+  REDIS_RC rc = rdb_restore_object(cmd->arg[2], cmd->arg_len[2], &obj);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  long long when = ttl == 0 ? -1 : absttl ? ttl : storage_mstime() + ttl;
+  if (when >= 0 && when <= storage_mstime() && !storage_loading() &&
+      !repl_is_replica()) {
+    /* already expired: as if it was restored and expired right away */
+    object_free(obj);
+    storage_delete(key, key_len);
+    reply_add_ok(reply);
+    return REDIS_OK;
+  }
+  rc = storage_set(key, key_len, obj);
+  if (REDIS_FAILED(rc)) {
+    object_free(obj);
+    return rc;
+  }
+  if (when >= 0) {
+    storage_set_expire(key, key_len, when);
+  }
+  reply_add_ok(reply);
+  return REDIS_OK;
+}
+
+/*
+ * MIGRATE host port key|"" db timeout [COPY] [REPLACE] [KEYS key ...]: move
+ * keys to another node with RESTORE-ASKING and delete them here once it
+ * stored them (keep them with COPY). There is a single database, 0. The
+ * loop waits for the transfer, so a slot moves in batches of keys small
+ * enough to keep that short.
+ */
+static REDIS_RC handle_migrate(Command *cmd, ReplyBuffer *reply) {
+  long long port, db, timeout;
+  if (!string_to_ll(cmd->arg[1], cmd->arg_len[1], &port) || port <= 0 ||
+      port > 65535 || !string_to_ll(cmd->arg[4], cmd->arg_len[4], &timeout)) {
+    return REDIS_NOT_AN_INTEGER;
+  }
+  if (!string_to_ll(cmd->arg[3], cmd->arg_len[3], &db) || db != 0) {
+    return REDIS_CLUSTER_INVALID_DB;
+  }
+  if (timeout <= 0) {
+    timeout = MIGRATE_DEFAULT_TIMEOUT_MS;
+  }
+  bool copy = false, replace = false;
+  int first = 2, count = 1;
+  for (int i = 5; i < cmd->argc; i++) {
+    if (strcasecmp(cmd->arg[i], "COPY") == 0) {
+      copy = true;
+    } else if (strcasecmp(cmd->arg[i], "REPLACE") == 0) {
+      replace = true;
+    } else if (strcasecmp(cmd->arg[i], "KEYS") == 0 &&
+               cmd->arg_len[2] == 0) {
+      first = i + 1;
+      count = cmd->argc - first;
+      break;
+    } else {
+      return REDIS_INVALID_ARGUMENT;
+    }
+  }
+
+  /* RESTORE-ASKING key ttl payload [REPLACE] for every key that exists */
+  int *found = malloc((count ? count : 1) * sizeof(int));
+  bool *ok = malloc((count ? count : 1) * sizeof(bool));
+  ReplyBuffer req;
+  reply_init(&req, RESP_PROTO_2);
+  REDIS_RC rc = found && ok ? REDIS_OK : REDIS_OUT_OF_MEMORY;
+  int sent = 0;
+  long long now = storage_mstime();
+  for (int i = 0; i < count && REDIS_SUCCESS(rc); i++) {
+    int k = first + i;
+    RedisObject *obj = storage_lookup(cmd->arg[k], cmd->arg_len[k]);
+    if (!obj) {
+      continue;
+    }
+    long long when = storage_get_expire(cmd->arg[k], cmd->arg_len[k]);
+    long long ttl = when < 0 ? 0 : when > now ? when - now : 1;
+    char *payload;
+    size_t len;
+    rc = rdb_dump_object(obj, &payload, &len);
+    if (REDIS_FAILED(rc)) {
+      break;
+    }
+    char ttl_buf[STR_UTIL_LL_SIZE];
+    size_t ttl_len = string_from_ll(ttl_buf, ttl);
+    reply_add_array_len(&req, replace ? 5 : 4);
+    reply_add_bulk(&req, "RESTORE-ASKING", 14);
+    reply_add_bulk(&req, cmd->arg[k], cmd->arg_len[k]);
+    reply_add_bulk(&req, ttl_buf, ttl_len);
+    reply_add_bulk(&req, payload, len);
+    if (replace) {
+      reply_add_bulk(&req, "REPLACE", 7);
+    }
+    free(payload);
+    found[sent++] = k;
+  }
+  if (REDIS_SUCCESS(rc) && req.oom) {
+    rc = REDIS_OUT_OF_MEMORY;
+  }
+
+  char err[256];
+  if (REDIS_SUCCESS(rc) && sent > 0) {
+    rc = cluster_migrate_send(cmd->arg[0], (int)port, timeout, req.buf,
+                              req.len, sent, ok, err, sizeof(err));
+  }
+  if (REDIS_SUCCESS(rc)) {
+    for (int i = 0; i < sent && !copy; i++) {
+      if (!ok[i]) {
+        continue;
+      }
+      int k = found[i];
+      storage_delete(cmd->arg[k], cmd->arg_len[k]);
+      propagate_del(cmd->arg[k], cmd->arg_len[k]);
+    }
+    if (sent == 0) {
+      reply_add_status(reply, "NOKEY");
+    } else if (err[0]) {
+      reply_add_error_format(reply,
+                             "ERR Target instance replied with error: %s", err);
+    } else {
+      reply_add_ok(reply);
+    }
+  }
+  reply_free(&req);
+  free(found);
+  free(ok);
+  return rc;
+}
+
+#endif
@@ -2,33 +2,337 @@
 #define CMD_CMS_H__
 
 #include "command/cmd.h"
+#include "data_structure/count_min_sketch.h"
 #include "redis-C/rc.h"
+#include "serialize.h"
 #include "storage.h"
+#include "util/str_util.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <strings.h>
+
 typedef enum {
   CMS_INITBYDIM = 0,
   CMS_INITBYPROB,
   CMS_INCRBY,
-  CMS_QUERY
+  CMS_QUERY,
+  CMS_MERGE,
+  CMS_INFO
 } CMD_cms_type;
 
-static REDIS_RC handle_cms_command(Command *cmd) {
-  switch (cmd->sub_cmd) {
-  case CMS_INITBYDIM: {
-    return create_cms_store(cmd->arg[0]);
+static bool __cms_parse_u32(const char *s, size_t len, uint32_t *value) {
+  unsigned long long v;
+  if (!string_to_ull(s, len, &v) || v > UINT32_MAX) {
+    return false;
+  }
+  *value = (uint32_t)v;
+  return true;
+}
+
+static REDIS_RC __cms_lookup(Command *cmd, int idx, CountMinSketch **cms) {
+  RedisObject *obj;
+  REDIS_RC rc =
+      storage_lookup_typed(cmd->arg[idx], cmd->arg_len[idx], OBJ_CMS, &obj);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  if (!obj) {
+    return REDIS_CMS_KEY_NOT_FOUND;
+  }
+  *cms = (CountMinSketch *)obj->ptr;
+  return REDIS_OK;
+}
+
+/*
+ * Creation options shared by INITBYDIM and INITBYPROB:
+ *   [BLOCKED] [COUNTERBITS 8|16|32|64] [PROMOTE] [CONSERVATIVE]
+ * BLOCKED keeps all rows of a key in one cache line (32-bit counters, depth
+ * <= CMS_BLOCK_MAX_DEPTH, a lower confidence: see cms_blocked_confidence);
+ * PROMOTE widens 8/16-bit counters instead of saturating them.
+ */
+static REDIS_RC __cms_parse_options(Command *cmd, int start, CmsOptions *opts) {
+  opts->layout = CMS_LAYOUT_FLAT;
+  opts->counter_bits = 32;
+  opts->flags = 0;
+  bool bits_given = false;
+  for (int i = start; i < cmd->argc; i++) {
+    const char *opt = cmd->arg[i];
+    if (strcasecmp(opt, "BLOCKED") == 0) {
+      opts->layout = CMS_LAYOUT_BLOCKED;
+    } else if (strcasecmp(opt, "PROMOTE") == 0) {
+      opts->flags |= CMS_FLAG_PROMOTE;
+    } else if (strcasecmp(opt, "CONSERVATIVE") == 0) {
+      opts->flags |= CMS_FLAG_CONSERVATIVE;
+    } else if (strcasecmp(opt, "COUNTERBITS") == 0 && i + 1 < cmd->argc) {
+      uint32_t bits;
+      i++;
+      if (!__cms_parse_u32(cmd->arg[i], cmd->arg_len[i], &bits) ||
+          (bits != 8 && bits != 16 && bits != 32 && bits != 64)) {
+        return REDIS_CMS_INVALID_COUNTER_BITS;
+      }
+      opts->counter_bits = bits;
+      bits_given = true;
+    } else {
+      return REDIS_INVALID_ARGUMENT;
+    }
+  }
+  if (opts->layout == CMS_LAYOUT_BLOCKED && bits_given &&
+      opts->counter_bits != 32) {
+    return REDIS_CMS_INVALID_COUNTER_BITS;
+  }
+  if ((opts->flags & CMS_FLAG_PROMOTE) && opts->counter_bits >= 32) {
+    return REDIS_INVALID_ARGUMENT;
+  }
+  return REDIS_OK;
+}
+
+/* CMS.INITBYDIM key width depth [options] */
+static REDIS_RC __cms_initbydim(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  CmsOptions opts;
+  REDIS_RC rc = __cms_parse_options(cmd, 3, &opts);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  uint32_t width, depth;
+  if (!__cms_parse_u32(cmd->arg[1], cmd->arg_len[1], &width) || width == 0) {
+    return REDIS_CMS_INVALID_WIDTH;
+  }
+  if (!__cms_parse_u32(cmd->arg[2], cmd->arg_len[2], &depth) || depth == 0 ||
+      (opts.layout == CMS_LAYOUT_BLOCKED && depth > CMS_BLOCK_MAX_DEPTH)) {
+    return REDIS_CMS_INVALID_DEPTH;
+  }
+  rc = create_cms_store(cmd->arg[0], cmd->arg_len[0], width, depth, &opts);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
+  }
+  return rc;
+}
+
+/* CMS.INITBYPROB key error probability [options] */
+static REDIS_RC __cms_initbyprob(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  CmsOptions opts;
+  REDIS_RC rc = __cms_parse_options(cmd, 3, &opts);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  double error_rate, probability;
+  if (!string_to_double(cmd->arg[1], cmd->arg_len[1], &error_rate) ||
+      error_rate <= 0 || error_rate >= 1) {
+    return REDIS_CMS_INVALID_ERROR_RATE;
+  }
+  if (!string_to_double(cmd->arg[2], cmd->arg_len[2], &probability) ||
+      probability <= 0 || probability >= 1) {
+    return REDIS_CMS_INVALID_PROB;
+  }
+  if (opts.layout == CMS_LAYOUT_BLOCKED &&
+      cms_blocked_depth(1 - probability) == 0) {
+    return REDIS_CMS_INVALID_PROB;
+  }
+  rc = create_cms_store_by_prob(cmd->arg[0], cmd->arg_len[0], error_rate,
+                                probability, &opts);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
+  }
+  return rc;
+}
+
+/*
+ * CMS.INCRBY key item increment [item increment ...]
+ * Every increment is validated before the sketch is touched so a bad pair
+ * never leaves the batch half applied.
+ */
+static REDIS_RC __cms_incrby(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 3 || (cmd->argc - 1) % 2 != 0) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  CountMinSketch *cms;
+  REDIS_RC rc = __cms_lookup(cmd, 0, &cms);
+  if (REDIS_FAILED(rc)) {
+    return rc;
   }
-  case CMS_INITBYPROB: {
-    break;
+
+  size_t n = (size_t)(cmd->argc - 1) / 2;
+  /* one allocation for the whole batch: keys, lengths, increments, results */
+  void *mem = malloc(n * (sizeof(char *) + sizeof(size_t) + sizeof(int64_t) +
+                          sizeof(uint32_t)));
+  if (!mem) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  const char **keys = (const char **)mem;
+  size_t *lens = (size_t *)(keys + n);
+  int64_t *counts = (int64_t *)(lens + n);
+  uint32_t *incs = (uint32_t *)(counts + n);
+  for (size_t i = 0; i < n; i++) {
+    int k = 1 + (int)i * 2;
+    keys[i] = cmd->arg[k];
+    lens[i] = cmd->arg_len[k];
+    if (!__cms_parse_u32(cmd->arg[k + 1], cmd->arg_len[k + 1], &incs[i])) {
+      free(mem);
+      return REDIS_CMS_INVALID_NUMBER;
+    }
+  }
+
+  if (cms_add_inc_multi(cms, keys, lens, incs, n, counts) != CMS_SUCCESS) {
+    free(mem);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  reply_add_array_len(reply, (long)n);
+  for (size_t i = 0; i < n; i++) {
+    reply_add_integer(reply, counts[i]);
+  }
+  free(mem);
+  return REDIS_OK;
+}
+
+/* CMS.QUERY key item [item ...] */
+static REDIS_RC __cms_query(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  CountMinSketch *cms;
+  REDIS_RC rc = __cms_lookup(cmd, 0, &cms);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+
+  size_t n = (size_t)cmd->argc - 1;
+  int64_t *counts = malloc(n * sizeof(int64_t));
+  if (!counts) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  if (cms_check_multi(cms, (const char **)cmd->arg + 1, cmd->arg_len + 1, n,
+                      counts) != CMS_SUCCESS) {
+    free(counts);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  reply_add_array_len(reply, (long)n);
+  for (size_t i = 0; i < n; i++) {
+    reply_add_integer(reply, counts[i]);
+  }
+  free(counts);
+  return REDIS_OK;
+}
+
+/* CMS.MERGE dest numkeys src [src ...] [WEIGHTS weight [weight ...]] */
+static REDIS_RC __cms_merge(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  unsigned long long numkeys;
+  if (!string_to_ull(cmd->arg[1], cmd->arg_len[1], &numkeys) || numkeys == 0) {
+    return REDIS_CMS_INVALID_NUMKEYS;
+  }
+  size_t n = (size_t)numkeys;
+  if (numkeys > (unsigned long long)cmd->argc - 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  int rest = cmd->argc - 2 - (int)n;
+  bool weighted = rest > 0;
+  if (weighted && (rest != (int)n + 1 ||
+                   strcasecmp(cmd->arg[2 + n], "WEIGHTS") != 0)) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
   }
-  case CMS_INCRBY: {
-    break;
+
+  CountMinSketch *dest;
+  REDIS_RC rc = __cms_lookup(cmd, 0, &dest);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  void *mem = malloc(n * (sizeof(CountMinSketch *) + sizeof(int64_t)));
+  if (!mem) {
+    return REDIS_OUT_OF_MEMORY;
   }
-  case CMS_QUERY: {
-    break;
+  CountMinSketch **src = (CountMinSketch **)mem;
+  int64_t *weights = (int64_t *)(src + n);
+  for (size_t i = 0; i < n; i++) {
+    rc = __cms_lookup(cmd, 2 + (int)i, &src[i]);
+    if (REDIS_FAILED(rc)) {
+      free(mem);
+      return rc;
+    }
+    if (src[i]->width != dest->width || src[i]->depth != dest->depth) {
+      free(mem);
+      return REDIS_CMS_DIM_MISMATCH;
+    }
+    /* counter widths may differ: cms_merge() widens or saturates */
+    if (src[i]->layout != dest->layout) {
+      free(mem);
+      return REDIS_CMS_LAYOUT_MISMATCH;
+    }
+    weights[i] = 1;
+    if (weighted) {
+      int k = 3 + (int)(n + i);
+      long long w;
+      if (!string_to_ll(cmd->arg[k], cmd->arg_len[k], &w)) {
+        free(mem);
+        return REDIS_CMS_INVALID_NUMBER;
+      }
+      weights[i] = w;
+    }
+  }
+
+  /* the shapes were checked: what is left to fail is widening the counters */
+  int merged = cms_merge(dest, src, weights, n);
+  free(mem);
+  if (merged != CMS_SUCCESS) {
+    return REDIS_OUT_OF_MEMORY;
   }
+  reply_add_ok(reply);
+  return REDIS_OK;
+}
+
+/* CMS.INFO key */
+static REDIS_RC __cms_info(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  CountMinSketch *cms;
+  REDIS_RC rc = __cms_lookup(cmd, 0, &cms);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_map_len(reply, 7);
+  reply_add_bulk_cstr(reply, "width");
+  reply_add_integer(reply, cms->width);
+  reply_add_bulk_cstr(reply, "depth");
+  reply_add_integer(reply, cms->depth);
+  reply_add_bulk_cstr(reply, "count");
+  reply_add_integer(reply, cms->elements_added);
+  reply_add_bulk_cstr(reply, "layout");
+  reply_add_bulk_cstr(reply, cms->layout == CMS_LAYOUT_BLOCKED ? "blocked"
+                                                               : "flat");
+  reply_add_bulk_cstr(reply, "counter-bits");
+  reply_add_integer(reply, cms->counter_bits);
+  reply_add_bulk_cstr(reply, "conservative");
+  reply_add_integer(reply, (cms->flags & CMS_FLAG_CONSERVATIVE) ? 1 : 0);
+  reply_add_bulk_cstr(reply, "memory");
+  reply_add_integer(reply, (long long)cms_memory_usage(cms));
+  return REDIS_OK;
+}
+
+static REDIS_RC handle_cms_command(Command *cmd, ReplyBuffer *reply) {
+  switch (cmd->sub_cmd) {
+  case CMS_INITBYDIM:
+    return __cms_initbydim(cmd, reply);
+  case CMS_INITBYPROB:
+    return __cms_initbyprob(cmd, reply);
+  case CMS_INCRBY:
+    return __cms_incrby(cmd, reply);
+  case CMS_QUERY:
+    return __cms_query(cmd, reply);
+  case CMS_MERGE:
+    return __cms_merge(cmd, reply);
+  case CMS_INFO:
+    return __cms_info(cmd, reply);
   default:
     return REDIS_SUB_CMD_NOT_FOUND;
   }
-  return REDIS_SUB_CMD_NOT_FOUND;
 }
 
 #endif
@@ -0,0 +1,228 @@
+#ifndef CMD_CUCKOO_FILTER_H__
+#define CMD_CUCKOO_FILTER_H__
+
+#include "cmd_handler.h"
+#include "command/cmd.h"
+#include "data_structure/cuckoo_filter.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include "storage.h"
+#include "util/str_util.h"
+#include <strings.h>
+
+typedef enum {
+  CF_RESERVE = 0,
+  CF_ADD,
+  CF_ADDNX,
+  CF_EXISTS,
+  CF_DEL,
+  CF_COUNT,
+  CF_INFO
+} CMD_cuckoo_filter_type;
+
+/* Filters created implicitly by CF.ADD / CF.ADDNX */
+#define CF_DEFAULT_CAPACITY 1024
+#define CF_MAX_ITERATIONS 65535
+#define CF_MAX_EXPANSION 32768
+
+/* *cf is NULL when the key does not exist. */
+static REDIS_RC __cf_lookup(Command *cmd, CuckooFilter **cf) {
+  RedisObject *obj;
+  REDIS_RC rc =
+      storage_lookup_typed(cmd->arg[0], cmd->arg_len[0], OBJ_CUCKOO, &obj);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  *cf = obj ? (CuckooFilter *)obj->ptr : NULL;
+  return REDIS_OK;
+}
+
+static REDIS_RC __cf_lookup_or_create(Command *cmd, CuckooFilter **cf) {
+  REDIS_RC rc = __cf_lookup(cmd, cf);
+  if (REDIS_SUCCESS(rc) && !*cf) {
+    rc = create_cuckoo_store(cmd->arg[0], cmd->arg_len[0], CF_DEFAULT_CAPACITY,
+                             CUCKOO_DEFAULT_MAX_KICKS, CUCKOO_DEFAULT_EXPANSION,
+                             cf);
+  }
+  return rc;
+}
+
+static REDIS_RC __cf_add_status(int res) {
+  if (res == CUCKOO_ERR_FULL) {
+    return REDIS_CF_FILTER_FULL;
+  } else if (res == CUCKOO_ERR_OOM) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  return REDIS_OK;
+}
+
+/* CF.RESERVE key capacity [MAXITERATIONS iterations] [EXPANSION expansion] */
+static REDIS_RC __cf_reserve(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  unsigned long long capacity;
+  if (!string_to_ull(cmd->arg[1], cmd->arg_len[1], &capacity) ||
+      capacity == 0) {
+    return REDIS_CF_INVALID_CAPACITY;
+  }
+
+  unsigned long long max_kicks = CUCKOO_DEFAULT_MAX_KICKS;
+  unsigned long long expansion = CUCKOO_DEFAULT_EXPANSION;
+  for (int i = 2; i < cmd->argc; i++) {
+    if (i + 1 >= cmd->argc) {
+      return REDIS_INVALID_ARGUMENT;
+    }
+    if (strcasecmp(cmd->arg[i], "MAXITERATIONS") == 0) {
+      i++;
+      if (!string_to_ull(cmd->arg[i], cmd->arg_len[i], &max_kicks) ||
+          max_kicks == 0 || max_kicks > CF_MAX_ITERATIONS) {
+        return REDIS_CF_INVALID_MAX_ITERATIONS;
+      }
+    } else if (strcasecmp(cmd->arg[i], "EXPANSION") == 0) {
+      i++;
+      if (!string_to_ull(cmd->arg[i], cmd->arg_len[i], &expansion) ||
+          expansion > CF_MAX_EXPANSION) {
+        return REDIS_CF_INVALID_EXPANSION;
+      }
+    } else {
+      return REDIS_INVALID_ARGUMENT;
+    }
+  }
+
+  CuckooFilter *cf;
+  REDIS_RC rc = create_cuckoo_store(cmd->arg[0], cmd->arg_len[0], capacity,
+                                    (uint32_t)max_kicks, (uint32_t)expansion,
+                                    &cf);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
+  }
+  return rc;
+}
+
+/* CF.ADD key item / CF.ADDNX key item */
+static REDIS_RC __cf_add(Command *cmd, ReplyBuffer *reply, bool nx) {
+  if (cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  CuckooFilter *cf;
+  REDIS_RC rc = __cf_lookup_or_create(cmd, &cf);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  int res = nx ? cuckoo_add_nx(cf, cmd->arg[1], cmd->arg_len[1])
+               : cuckoo_add(cf, cmd->arg[1], cmd->arg_len[1]);
+  rc = __cf_add_status(res);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_bool(reply, res == CUCKOO_OK);
+  }
+  return rc;
+}
+
+/* CF.EXISTS key item */
+static REDIS_RC __cf_exists(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  CuckooFilter *cf;
+  REDIS_RC rc = __cf_lookup(cmd, &cf);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_bool(reply, cf && cuckoo_exists(cf, cmd->arg[1], cmd->arg_len[1]));
+  return REDIS_OK;
+}
+
+/* CF.DEL key item */
+static REDIS_RC __cf_del(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  CuckooFilter *cf;
+  REDIS_RC rc = __cf_lookup(cmd, &cf);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  if (!cf) {
+    return REDIS_CF_KEY_NOT_FOUND;
+  }
+  reply_add_bool(reply, cuckoo_delete(cf, cmd->arg[1], cmd->arg_len[1]));
+  return REDIS_OK;
+}
+
+/* CF.COUNT key item */
+static REDIS_RC __cf_count(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  CuckooFilter *cf;
+  REDIS_RC rc = __cf_lookup(cmd, &cf);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_integer(
+      reply,
+      cf ? (long long)cuckoo_count(cf, cmd->arg[1], cmd->arg_len[1]) : 0);
+  return REDIS_OK;
+}
+
+/* CF.INFO key */
+static REDIS_RC __cf_info(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  CuckooFilter *cf;
+  REDIS_RC rc = __cf_lookup(cmd, &cf);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  if (!cf) {
+    return REDIS_CF_KEY_NOT_FOUND;
+  }
+
+  static const char *fields[] = {"Size",
+                                 "Number of buckets",
+                                 "Number of filters",
+                                 "Number of items inserted",
+                                 "Number of items deleted",
+                                 "Bucket size",
+                                 "Expansion rate",
+                                 "Max iterations"};
+  long long values[] = {(long long)cuckoo_memory_usage(cf),
+                        (long long)cuckoo_buckets(cf),
+                        cf->num_layers,
+                        (long long)cuckoo_items(cf),
+                        (long long)cf->deleted,
+                        CUCKOO_BUCKET_SIZE,
+                        cf->expansion,
+                        cf->max_kicks};
+  reply_add_map_len(reply, 8);
+  for (int i = 0; i < 8; i++) {
+    reply_add_bulk_cstr(reply, fields[i]);
+    reply_add_integer(reply, values[i]);
+  }
+  return REDIS_OK;
+}
+
+static REDIS_RC handle_cuckoo_filter_command(Command *cmd, ReplyBuffer *reply) {
+  switch (cmd->sub_cmd) {
+  case CF_RESERVE:
+    return __cf_reserve(cmd, reply);
+  case CF_ADD:
+    return __cf_add(cmd, reply, false);
+  case CF_ADDNX:
+    return __cf_add(cmd, reply, true);
+  case CF_EXISTS:
+    return __cf_exists(cmd, reply);
+  case CF_DEL:
+    return __cf_del(cmd, reply);
+  case CF_COUNT:
+    return __cf_count(cmd, reply);
+  case CF_INFO:
+    return __cf_info(cmd, reply);
+  default:
+    return REDIS_SUB_CMD_NOT_FOUND;
+  }
+}
+
+#endif
@@ -1,6 +1,540 @@
 #ifndef CMD_GEO_H__
 #define CMD_GEO_H__
 
+#include "command/cmd.h"
+#include "command/cmd_sorted_set.h"
+#include "data_structure/geo_hash.h"
+#include "data_structure/sorted_set.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include "storage.h"
+#include "util/str_util.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/*
+ * Geo commands on top of sorted sets: a point is a member whose score is its
+ * 52-bit integer geohash, so keys of both kinds are interchangeable.
+ */
+
 typedef enum { GEOADD = 0, GEODIST, GEOHASH, GEOSEARCH, GEOPOS } CMD_geo_type;
 
+typedef enum { GEO_SORT_NONE = 0, GEO_SORT_ASC, GEO_SORT_DESC } GeoSort;
+
+typedef struct {
+  GeoPoint center;
+  bool by_box;
+  double radius_m;
+  double width_m;
+  double height_m;
+  double unit; /* meters per unit of the reply distances */
+  GeoSort sort;
+  long long count; /* 0 for no limit */
+  bool any;
+  bool withcoord;
+  bool withdist;
+  bool withhash;
+} GeoSearchOptions;
+
+typedef struct {
+  const ZSetEntry *entry;
+  GeoPoint point;
+  double dist; /* meters */
+} GeoResult;
+
+typedef struct {
+  GeoResult *items;
+  size_t len;
+  size_t cap;
+} GeoResults;
+
+/* Meters per `unit`: m, km, ft or mi. */
+static bool __geo_parse_unit(const char *unit, double *meters) {
+  if (strcasecmp(unit, "m") == 0) {
+    *meters = 1;
+  } else if (strcasecmp(unit, "km") == 0) {
+    *meters = 1000;
+  } else if (strcasecmp(unit, "ft") == 0) {
+    *meters = 0.3048;
+  } else if (strcasecmp(unit, "mi") == 0) {
+    *meters = 1609.34;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/* `lon lat` at arg[idx], checked against the geohash limits. */
+static bool __geo_parse_point(Command *cmd, int idx, GeoPoint *point) {
+  double lon, lat;
+  if (!string_to_double(cmd->arg[idx], cmd->arg_len[idx], &lon) ||
+      !string_to_double(cmd->arg[idx + 1], cmd->arg_len[idx + 1], &lat)) {
+    return false;
+  }
+  *point = geopoint_create(lat, lon);
+  return true;
+}
+
+static REDIS_RC __geo_parse_lonlat(Command *cmd, int idx, GeoPoint *point,
+                                   GeoHashBits *hash) {
+  if (!__geo_parse_point(cmd, idx, point)) {
+    return REDIS_NOT_A_FLOAT;
+  }
+  if (geohash_int_encode(point, GEOHASH_INT_MAX_STEP, hash) != GEOHASH_OK) {
+    return REDIS_GEO_INVALID_COORDS;
+  }
+  return REDIS_OK;
+}
+
+static void __geo_decode_score(double score, GeoPoint *point) {
+  GeoHashBits hash = {(uint64_t)score, GEOHASH_INT_MAX_STEP};
+  geohash_int_decode(hash, point);
+}
+
+static bool __geo_member_point(SortedSet *zs, const char *member, size_t len,
+                               GeoPoint *point) {
+  double score;
+  if (!zs || !zset_score(zs, member, len, &score)) {
+    return false;
+  }
+  __geo_decode_score(score, point);
+  return true;
+}
+
+/* Distances go out as bulk strings with four decimals, like Redis. */
+static void __geo_reply_distance(ReplyBuffer *reply, double dist) {
+  char buf[64];
+  int len = snprintf(buf, sizeof(buf), "%.4f", dist);
+  reply_add_bulk(reply, buf, (size_t)len);
+}
+
+static void __geo_reply_point(ReplyBuffer *reply, const GeoPoint *point) {
+  reply_add_array_len(reply, 2);
+  reply_add_double(reply, point->longitude);
+  reply_add_double(reply, point->latitude);
+}
+
+/* GEOADD key [NX|XX] [CH] longitude latitude member [...] */
+static REDIS_RC __geo_geoadd(Command *cmd, ReplyBuffer *reply) {
+  int flags = 0;
+  bool ch = false;
+  int i = 1;
+  for (; i < cmd->argc; i++) {
+    if (strcasecmp(cmd->arg[i], "NX") == 0) {
+      flags |= ZSET_ADD_NX;
+    } else if (strcasecmp(cmd->arg[i], "XX") == 0) {
+      flags |= ZSET_ADD_XX;
+    } else if (strcasecmp(cmd->arg[i], "CH") == 0) {
+      ch = true;
+    } else {
+      break;
+    }
+  }
+  if (i >= cmd->argc || (cmd->argc - i) % 3 != 0) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if ((flags & ZSET_ADD_NX) && (flags & ZSET_ADD_XX)) {
+    return REDIS_ZSET_XX_AND_NX;
+  }
+
+  /* Every pair is validated before the set is touched; the points are
+   * parsed first and then encoded as one batch */
+  size_t n = (size_t)(cmd->argc - i) / 3;
+  GeoPoint *points = malloc(n * (sizeof(GeoPoint) + sizeof(uint64_t)));
+  if (!points) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  uint64_t *scores = (uint64_t *)(points + n);
+  size_t parsed = 0;
+  while (parsed < n &&
+         __geo_parse_point(cmd, i + (int)parsed * 3, &points[parsed])) {
+    parsed++;
+  }
+  /* The first bad pair decides the error, as when checking one by one */
+  REDIS_RC rc = REDIS_OK;
+  if (parsed > 0 && geohash_int_encode_batch(points, parsed, scores) < parsed) {
+    rc = REDIS_GEO_INVALID_COORDS;
+  } else if (parsed < n) {
+    rc = REDIS_NOT_A_FLOAT;
+  }
+  if (REDIS_FAILED(rc)) {
+    free(points);
+    return rc;
+  }
+
+  SortedSet *zs = NULL;
+  rc = __zset_lookup(cmd, &zs);
+  if (REDIS_SUCCESS(rc) && !zs && !(flags & ZSET_ADD_XX)) {
+    rc = create_zset_store(cmd->arg[0], cmd->arg_len[0], &zs);
+  }
+  long long changed = 0;
+  for (size_t k = 0; REDIS_SUCCESS(rc) && zs && k < parsed; k++) {
+    int m = i + (int)k * 3 + 2;
+    ZSetAddResult res = zset_add(zs, cmd->arg[m], cmd->arg_len[m],
+                                 (double)scores[k], flags, NULL);
+    if (res == ZSET_ERR_OOM) {
+      rc = REDIS_OUT_OF_MEMORY;
+    } else if (res == ZSET_ADDED || (ch && res == ZSET_UPDATED)) {
+      changed++;
+    }
+  }
+  free(points);
+  if (zs) {
+    __zset_delete_if_empty(cmd, zs);
+  }
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_integer(reply, changed);
+  }
+  return rc;
+}
+
+/* GEODIST key member1 member2 [M|KM|FT|MI] */
+static REDIS_RC __geo_geodist(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 3 && cmd->argc != 4) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  double unit = 1;
+  if (cmd->argc == 4 && !__geo_parse_unit(cmd->arg[3], &unit)) {
+    return REDIS_GEO_UNSUPPORTED_UNIT;
+  }
+  SortedSet *zs;
+  REDIS_RC rc = __zset_lookup(cmd, &zs);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  GeoPoint a, b;
+  if (!__geo_member_point(zs, cmd->arg[1], cmd->arg_len[1], &a) ||
+      !__geo_member_point(zs, cmd->arg[2], cmd->arg_len[2], &b)) {
+    reply_add_null(reply);
+  } else {
+    __geo_reply_distance(reply, geohash_distance(&a, &b) / unit);
+  }
+  return REDIS_OK;
+}
+
+/* GEOHASH key member [member ...] */
+static REDIS_RC __geo_geohash(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  SortedSet *zs;
+  REDIS_RC rc = __zset_lookup(cmd, &zs);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_array_len(reply, cmd->argc - 1);
+  for (int i = 1; i < cmd->argc; i++) {
+    GeoPoint point;
+    /* 52 bits fill ten characters; the eleventh is padding, as in Redis */
+    char buf[12];
+    if (!__geo_member_point(zs, cmd->arg[i], cmd->arg_len[i], &point) ||
+        geohash_encode_into(&point, 10, buf) != GEOHASH_OK) {
+      reply_add_null(reply);
+      continue;
+    }
+    buf[10] = '0';
+    reply_add_bulk(reply, buf, 11);
+  }
+  return REDIS_OK;
+}
+
+/* GEOPOS key member [member ...] */
+static REDIS_RC __geo_geopos(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  SortedSet *zs;
+  REDIS_RC rc = __zset_lookup(cmd, &zs);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_array_len(reply, cmd->argc - 1);
+  for (int i = 1; i < cmd->argc; i++) {
+    GeoPoint point;
+    if (__geo_member_point(zs, cmd->arg[i], cmd->arg_len[i], &point)) {
+      __geo_reply_point(reply, &point);
+    } else {
+      reply_add_null_array(reply);
+    }
+  }
+  return REDIS_OK;
+}
+
+/*
+ * GEOSEARCH key <FROMMEMBER member | FROMLONLAT lon lat>
+ *   <BYRADIUS radius unit | BYBOX width height unit> [ASC|DESC]
+ *   [COUNT count [ANY]] [WITHCOORD] [WITHDIST] [WITHHASH]
+ * FROMMEMBER is resolved later since it needs the set.
+ */
+static REDIS_RC __geo_parse_search(Command *cmd, GeoSearchOptions *opts,
+                                   int *from_member) {
+  memset(opts, 0, sizeof(*opts));
+  *from_member = 0;
+  bool from_lonlat = false, by_radius = false;
+  for (int i = 1; i < cmd->argc; i++) {
+    const char *opt = cmd->arg[i];
+    int left = cmd->argc - i - 1;
+    if (strcasecmp(opt, "FROMMEMBER") == 0 && left >= 1) {
+      if (*from_member || from_lonlat) {
+        return REDIS_GEO_FROM_ONE_OF;
+      }
+      *from_member = ++i;
+    } else if (strcasecmp(opt, "FROMLONLAT") == 0 && left >= 2) {
+      if (*from_member || from_lonlat) {
+        return REDIS_GEO_FROM_ONE_OF;
+      }
+      GeoHashBits hash;
+      REDIS_RC rc = __geo_parse_lonlat(cmd, i + 1, &opts->center, &hash);
+      if (REDIS_FAILED(rc)) {
+        return rc;
+      }
+      from_lonlat = true;
+      i += 2;
+    } else if (strcasecmp(opt, "BYRADIUS") == 0 && left >= 2) {
+      if (by_radius || opts->by_box) {
+        return REDIS_GEO_BY_ONE_OF;
+      }
+      if (!string_to_double(cmd->arg[i + 1], cmd->arg_len[i + 1],
+                            &opts->radius_m)) {
+        return REDIS_NOT_A_FLOAT;
+      }
+      if (!__geo_parse_unit(cmd->arg[i + 2], &opts->unit)) {
+        return REDIS_GEO_UNSUPPORTED_UNIT;
+      }
+      if (opts->radius_m < 0) {
+        return REDIS_GEO_INVALID_SHAPE;
+      }
+      opts->radius_m *= opts->unit;
+      opts->width_m = opts->height_m = 2 * opts->radius_m;
+      by_radius = true;
+      i += 2;
+    } else if (strcasecmp(opt, "BYBOX") == 0 && left >= 3) {
+      if (by_radius || opts->by_box) {
+        return REDIS_GEO_BY_ONE_OF;
+      }
+      if (!string_to_double(cmd->arg[i + 1], cmd->arg_len[i + 1],
+                            &opts->width_m) ||
+          !string_to_double(cmd->arg[i + 2], cmd->arg_len[i + 2],
+                            &opts->height_m)) {
+        return REDIS_NOT_A_FLOAT;
+      }
+      if (!__geo_parse_unit(cmd->arg[i + 3], &opts->unit)) {
+        return REDIS_GEO_UNSUPPORTED_UNIT;
+      }
+      if (opts->width_m < 0 || opts->height_m < 0) {
+        return REDIS_GEO_INVALID_SHAPE;
+      }
+      opts->width_m *= opts->unit;
+      opts->height_m *= opts->unit;
+      opts->by_box = true;
+      i += 3;
+    } else if (strcasecmp(opt, "ASC") == 0) {
+      opts->sort = GEO_SORT_ASC;
+    } else if (strcasecmp(opt, "DESC") == 0) {
+      opts->sort = GEO_SORT_DESC;
+    } else if (strcasecmp(opt, "COUNT") == 0 && left >= 1) {
+      i++;
+      if (!string_to_ll(cmd->arg[i], cmd->arg_len[i], &opts->count)) {
+        return REDIS_NOT_AN_INTEGER;
+      }
+      if (opts->count <= 0) {
+        return REDIS_GEO_INVALID_COUNT;
+      }
+      if (i + 1 < cmd->argc && strcasecmp(cmd->arg[i + 1], "ANY") == 0) {
+        opts->any = true;
+        i++;
+      }
+    } else if (strcasecmp(opt, "WITHCOORD") == 0) {
+      opts->withcoord = true;
+    } else if (strcasecmp(opt, "WITHDIST") == 0) {
+      opts->withdist = true;
+    } else if (strcasecmp(opt, "WITHHASH") == 0) {
+      opts->withhash = true;
+    } else if (strcasecmp(opt, "ANY") == 0) {
+      return REDIS_GEO_ANY_WITHOUT_COUNT;
+    } else {
+      return REDIS_INVALID_ARGUMENT;
+    }
+  }
+  if (!*from_member && !from_lonlat) {
+    return REDIS_GEO_FROM_ONE_OF;
+  }
+  if (!by_radius && !opts->by_box) {
+    return REDIS_GEO_BY_ONE_OF;
+  }
+  /* COUNT without ANY keeps the nearest ones */
+  if (opts->count && !opts->any && opts->sort == GEO_SORT_NONE) {
+    opts->sort = GEO_SORT_ASC;
+  }
+  return REDIS_OK;
+}
+
+/* Distance from the center when `point` is inside the search shape. */
+static bool __geo_in_shape(const GeoSearchOptions *opts, const GeoPoint *point,
+                           double *dist) {
+  if (!opts->by_box) {
+    *dist = geohash_distance(&opts->center, point);
+    return *dist <= opts->radius_m;
+  }
+  /* North-south distance is cheap, try it first */
+  double lat_dist = GEOHASH_EARTH_RADIUS_M *
+                    fabs(point->latitude - opts->center.latitude) * M_PI / 180;
+  if (lat_dist > opts->height_m / 2) {
+    return false;
+  }
+  GeoPoint same_lat = geopoint_create(point->latitude, opts->center.longitude);
+  if (geohash_distance(&same_lat, point) > opts->width_m / 2) {
+    return false;
+  }
+  *dist = geohash_distance(&opts->center, point);
+  return true;
+}
+
+static bool __geo_results_push(GeoResults *results, const ZSetEntry *entry,
+                               const GeoPoint *point, double dist) {
+  if (results->len == results->cap) {
+    size_t cap = results->cap ? results->cap * 2 : 16;
+    GeoResult *items = realloc(results->items, cap * sizeof(GeoResult));
+    if (!items) {
+      return false;
+    }
+    results->items = items;
+    results->cap = cap;
+  }
+  results->items[results->len++] = (GeoResult){entry, *point, dist};
+  return true;
+}
+
+/*
+ * Scan the score range of every covering cell and keep the members inside
+ * the shape. With ANY the scan stops as soon as COUNT members are found.
+ */
+static REDIS_RC __geo_search(SortedSet *zs, const GeoSearchOptions *opts,
+                             GeoResults *results) {
+  GeoSearchArea area;
+  if (geohash_int_search_area(&opts->center, opts->width_m, opts->height_m,
+                              &area) != GEOHASH_OK) {
+    return REDIS_GEO_INVALID_COORDS;
+  }
+  for (size_t c = 0; c < area.count; c++) {
+    ZRangeSpec range = {0, 0, false, true};
+    geohash_int_score_range(area.cells[c], &range.min, &range.max);
+    for (SkipListNode *node = zset_first_in_range(zs, &range); node;
+         node = skiplist_next(node)) {
+      const ZSetEntry *e = zset_node_entry(node);
+      if (e->score >= range.max) {
+        break;
+      }
+      GeoPoint point;
+      double dist;
+      __geo_decode_score(e->score, &point);
+      if (!__geo_in_shape(opts, &point, &dist)) {
+        continue;
+      }
+      if (!__geo_results_push(results, e, &point, dist)) {
+        return REDIS_OUT_OF_MEMORY;
+      }
+      if (opts->any && (long long)results->len >= opts->count) {
+        return REDIS_OK;
+      }
+    }
+  }
+  return REDIS_OK;
+}
+
+static int __geo_cmp_asc(const void *a, const void *b) {
+  double x = ((const GeoResult *)a)->dist, y = ((const GeoResult *)b)->dist;
+  return (x > y) - (x < y);
+}
+
+static int __geo_cmp_desc(const void *a, const void *b) {
+  return __geo_cmp_asc(b, a);
+}
+
+static void __geo_reply_results(ReplyBuffer *reply, const GeoSearchOptions *opts,
+                                GeoResults *results) {
+  if (opts->sort == GEO_SORT_ASC) {
+    qsort(results->items, results->len, sizeof(GeoResult), __geo_cmp_asc);
+  } else if (opts->sort == GEO_SORT_DESC) {
+    qsort(results->items, results->len, sizeof(GeoResult), __geo_cmp_desc);
+  }
+  size_t n = results->len;
+  if (opts->count && (size_t)opts->count < n) {
+    n = (size_t)opts->count;
+  }
+
+  int fields = 1 + opts->withdist + opts->withhash + opts->withcoord;
+  reply_add_array_len(reply, (long)n);
+  for (size_t i = 0; i < n; i++) {
+    const GeoResult *r = &results->items[i];
+    if (fields > 1) {
+      reply_add_array_len(reply, fields);
+    }
+    reply_add_bulk(reply, r->entry->member, r->entry->len);
+    if (opts->withdist) {
+      __geo_reply_distance(reply, r->dist / opts->unit);
+    }
+    if (opts->withhash) {
+      reply_add_integer(reply, (long long)r->entry->score);
+    }
+    if (opts->withcoord) {
+      __geo_reply_point(reply, &r->point);
+    }
+  }
+}
+
+static REDIS_RC __geo_geosearch(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  GeoSearchOptions opts;
+  int from_member;
+  REDIS_RC rc = __geo_parse_search(cmd, &opts, &from_member);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  SortedSet *zs;
+  rc = __zset_lookup(cmd, &zs);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  if (!zs) {
+    reply_add_array_len(reply, 0);
+    return REDIS_OK;
+  }
+  if (from_member &&
+      !__geo_member_point(zs, cmd->arg[from_member], cmd->arg_len[from_member],
+                          &opts.center)) {
+    return REDIS_GEO_MEMBER_NOT_FOUND;
+  }
+
+  GeoResults results = {NULL, 0, 0};
+  rc = __geo_search(zs, &opts, &results);
+  if (REDIS_SUCCESS(rc)) {
+    __geo_reply_results(reply, &opts, &results);
+  }
+  free(results.items);
+  return rc;
+}
+
+static REDIS_RC handle_geo_command(Command *cmd, ReplyBuffer *reply) {
+  switch (cmd->sub_cmd) {
+  case GEOADD:
+    return __geo_geoadd(cmd, reply);
+  case GEODIST:
+    return __geo_geodist(cmd, reply);
+  case GEOHASH:
+    return __geo_geohash(cmd, reply);
+  case GEOPOS:
+    return __geo_geopos(cmd, reply);
+  case GEOSEARCH:
+    return __geo_geosearch(cmd, reply);
+  default:
+    return REDIS_SUB_CMD_NOT_FOUND;
+  }
+}
+
 #endif
@@ -0,0 +1,144 @@
+#ifndef CMD_HYPERLOGLOG_H__
+#define CMD_HYPERLOGLOG_H__
+
+#include "command/cmd.h"
+#include "data_structure/hyperloglog.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include "storage.h"
+#include <stdlib.h>
+
+typedef enum { PFADD = 0, PFCOUNT, PFMERGE } CMD_hyperloglog_type;
+
+/* *hll is NULL when the key does not exist. */
+static REDIS_RC __pf_lookup(Command *cmd, int idx, HyperLogLog **hll) {
+  RedisObject *obj;
+  REDIS_RC rc = storage_lookup_typed(cmd->arg[idx], cmd->arg_len[idx],
+                                     OBJ_HLL, &obj);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  *hll = obj ? (HyperLogLog *)obj->ptr : NULL;
+  return REDIS_OK;
+}
+
+/* PFADD key [element ...]: 1 if the estimate may have changed */
+static REDIS_RC __pf_add(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  HyperLogLog *hll;
+  REDIS_RC rc = __pf_lookup(cmd, 0, &hll);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  bool updated = false;
+  if (!hll) {
+    rc = create_hll_store(cmd->arg[0], cmd->arg_len[0], &hll);
+    if (REDIS_FAILED(rc)) {
+      return rc;
+    }
+    updated = true;
+  }
+  for (int i = 1; i < cmd->argc; i++) {
+    int res = hll_add(hll, cmd->arg[i], cmd->arg_len[i]);
+    if (res == HLL_ERR_OOM) {
+      return REDIS_OUT_OF_MEMORY;
+    }
+    updated |= res == HLL_UPDATED;
+  }
+  reply_add_integer(reply, updated);
+  return REDIS_OK;
+}
+
+/* PFCOUNT key [key ...]: cardinality of the union; missing keys are empty */
+static REDIS_RC __pf_count(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  HyperLogLog *hll = NULL;
+  if (cmd->argc == 1) {
+    REDIS_RC rc = __pf_lookup(cmd, 0, &hll);
+    if (REDIS_FAILED(rc)) {
+      return rc;
+    }
+    reply_add_integer(reply, hll ? (long long)hll_count(hll) : 0);
+    return REDIS_OK;
+  }
+
+  const HyperLogLog **hlls = malloc(cmd->argc * sizeof(HyperLogLog *));
+  if (!hlls) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  size_t found = 0;
+  for (int i = 0; i < cmd->argc; i++) {
+    hll = NULL;
+    REDIS_RC rc = __pf_lookup(cmd, i, &hll);
+    if (REDIS_FAILED(rc)) {
+      free(hlls);
+      return rc;
+    }
+    if (hll) {
+      hlls[found++] = hll;
+    }
+  }
+  reply_add_integer(reply, (long long)hll_count_union(hlls, found));
+  free(hlls);
+  return REDIS_OK;
+}
+
+/* PFMERGE destkey [sourcekey ...] */
+static REDIS_RC __pf_merge(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  size_t n = (size_t)cmd->argc - 1;
+  const HyperLogLog **srcs = malloc((n + 1) * sizeof(HyperLogLog *));
+  if (!srcs) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  /* Type-check every source before creating the destination */
+  REDIS_RC rc = REDIS_OK;
+  size_t found = 0;
+  for (size_t i = 0; i < n; i++) {
+    HyperLogLog *hll = NULL;
+    rc = __pf_lookup(cmd, (int)i + 1, &hll);
+    if (REDIS_FAILED(rc)) {
+      break;
+    }
+    /* a missing source is empty: nothing to merge */
+    if (hll) {
+      srcs[found++] = hll;
+    }
+  }
+  HyperLogLog *dest = NULL;
+  if (REDIS_SUCCESS(rc)) {
+    rc = __pf_lookup(cmd, 0, &dest);
+  }
+  if (REDIS_SUCCESS(rc) && !dest) {
+    rc = create_hll_store(cmd->arg[0], cmd->arg_len[0], &dest);
+  }
+  if (REDIS_SUCCESS(rc) && hll_merge(dest, srcs, found) != HLL_OK) {
+    rc = REDIS_OUT_OF_MEMORY;
+  }
+  free(srcs);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
+  }
+  return rc;
+}
+
+static REDIS_RC handle_hyperloglog_command(Command *cmd, ReplyBuffer *reply) {
+  switch (cmd->sub_cmd) {
+  case PFADD:
+    return __pf_add(cmd, reply);
+  case PFCOUNT:
+    return __pf_count(cmd, reply);
+  case PFMERGE:
+    return __pf_merge(cmd, reply);
+  default:
+    return REDIS_SUB_CMD_NOT_FOUND;
+  }
+}
+
+#endif
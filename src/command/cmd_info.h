@@ -0,0 +1,440 @@
+#ifndef CMD_INFO_H__
+#define CMD_INFO_H__
+
+#include "aof.h"
+#include "cluster.h"
+#include "cmd_handler.h"
+#include "command/cmd.h"
+#include "lazyfree.h"
+#include "networking.h"
+#include "rdb.h"
+#include "redis-C/config.h"
+#include "redis-C/rc.h"
+#include "replication.h"
+#include "serialize.h"
+#include "shard.h"
+#include "stats.h"
+#include "storage.h"
+#include "util/histogram.h"
+#include "util/mem.h"
+#include "util/monotonic.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+
+/*
+ * INFO [section ...]: "# Section" headers followed by field:value lines.
+ * Without arguments (or with "default") it reports server, clients, memory,
+ * persistence, stats, replication, cluster and keyspace; "all" adds
+ * commandstats and latencystats; "everything" adds typestats, which walks
+ * the keyspace of the shard serving the request and costs O(keys).
+ */
+#define INFO_SERVER (1 << 0)
+#define INFO_CLIENTS (1 << 1)
+#define INFO_MEMORY (1 << 2)
+#define INFO_PERSISTENCE (1 << 3)
+#define INFO_STATS (1 << 4)
+#define INFO_COMMANDSTATS (1 << 5)
+#define INFO_LATENCYSTATS (1 << 6)
+#define INFO_KEYSPACE (1 << 7)
+#define INFO_TYPESTATS (1 << 8)
+#define INFO_CLUSTER (1 << 9)
+#define INFO_REPLICATION (1 << 10)
+
+#define INFO_DEFAULT                                                           \
+  (INFO_SERVER | INFO_CLIENTS | INFO_MEMORY | INFO_PERSISTENCE | INFO_STATS |  \
+   INFO_REPLICATION | INFO_CLUSTER | INFO_KEYSPACE)
+#define INFO_ALL (INFO_DEFAULT | INFO_COMMANDSTATS | INFO_LATENCYSTATS)
+#define INFO_EVERYTHING (INFO_ALL | INFO_TYPESTATS)
+
+#define INFO_TYPE_COUNT (OBJ_TOPK + 1)
+
+typedef struct {
+  char *buf;
+  size_t len;
+  size_t cap;
+  bool oom;
+} InfoBuf;
+
+static void __info_appendf(InfoBuf *b, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void __info_appendf(InfoBuf *b, const char *fmt, ...) {
+  for (;;) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = b->oom ? 0 : vsnprintf(b->buf + b->len, b->cap - b->len, fmt, ap);
+    va_end(ap);
+    if (b->oom || (size_t)n < b->cap - b->len) {
+      b->len += (size_t)n;
+      return;
+    }
+    size_t cap = (b->cap + (size_t)n + 1) * 2;
+    char *buf = realloc(b->buf, cap);
+    if (!buf) {
+      b->oom = true;
+      return;
+    }
+    b->buf = buf;
+    b->cap = cap;
+  }
+}
+
+/* Sections are separated by an empty line */
+static void __info_header(InfoBuf *b, const char *title) {
+  __info_appendf(b, "%s# %s\r\n", b->len ? "\r\n" : "", title);
+}
+
+/* 1.23K, 4.56M... as INFO prints memory sizes */
+static void __info_human_bytes(char *out, size_t size, double bytes) {
+  static const char units[] = "BKMGTP";
+  int unit = 0;
+  while (bytes >= 1024 && units[unit + 1]) {
+    bytes /= 1024;
+    unit++;
+  }
+  if (unit == 0) {
+    snprintf(out, size, "%.0fB", bytes);
+  } else {
+    snprintf(out, size, "%.2f%c", bytes, units[unit]);
+  }
+}
+
+static const char *__info_policy_name(MaxmemoryPolicy policy) {
+  switch (policy) {
+  case MAXMEMORY_ALLKEYS_LRU:
+    return "allkeys-lru";
+  case MAXMEMORY_ALLKEYS_LFU:
+    return "allkeys-lfu";
+  case MAXMEMORY_VOLATILE_TTL:
+    return "volatile-ttl";
+  default:
+    return "noeviction";
+  }
+}
+
+static bool __info_section(const char *name, int *sections) {
+  static const struct {
+    const char *name;
+    int sections;
+  } names[] = {
+      {"server", INFO_SERVER},
+      {"clients", INFO_CLIENTS},
+      {"memory", INFO_MEMORY},
+      {"persistence", INFO_PERSISTENCE},
+      {"stats", INFO_STATS},
+      {"commandstats", INFO_COMMANDSTATS},
+      {"latencystats", INFO_LATENCYSTATS},
+      {"replication", INFO_REPLICATION},
+      {"cluster", INFO_CLUSTER},
+      {"keyspace", INFO_KEYSPACE},
+      {"typestats", INFO_TYPESTATS},
+      {"default", INFO_DEFAULT},
+      {"all", INFO_ALL},
+      {"everything", INFO_EVERYTHING},
+  };
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcasecmp(name, names[i].name) == 0) {
+      *sections |= names[i].sections;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Lower-case command name, as cmdstat_ and latency_percentiles_ use it */
+static void __info_command_name(char *out, size_t size, const char *name) {
+  size_t i = 0;
+  for (; name[i] && i + 1 < size; i++) {
+    out[i] = (char)tolower((unsigned char)name[i]);
+  }
+  out[i] = '\0';
+}
+
+static void __info_server(InfoBuf *b) {
+  __info_header(b, "Server");
+  const RedisCConfig *cfg = get_current_config();
+  __info_appendf(b,
+                 "redis_version:%s\r\n"
+                 "redis_mode:%s\r\n"
+                 "process_id:%ld\r\n"
+                 "monotonic_clock:%s\r\n"
+                 "tcp_port:%d\r\n"
+                 "uptime_in_seconds:%lld\r\n"
+                 "shards:%d\r\n"
+                 "io_threads:%d\r\n",
+                 REDIS_C_VERSION,
+                 cluster_enabled()     ? "cluster"
+                 : shard_count() > 1 ? "sharded"
+                                     : "standalone",
+                 (long)getpid(), monotonic_info(), cfg->port,
+                 stats_uptime_seconds(),
+                 shard_count(), cfg->io_threads);
+}
+
+static void __info_clients(InfoBuf *b, const ShardStats *shards) {
+  __info_header(b, "Clients");
+  __info_appendf(b,
+                 "connected_clients:%llu\r\n"
+                 "maxclients:%d\r\n",
+                 (unsigned long long)shards->clients,
+                 NET_MAX_CLIENTS * shard_count());
+}
+
+static void __info_memory(InfoBuf *b) {
+  __info_header(b, "Memory");
+  const RedisCConfig *cfg = get_current_config();
+  char used[32], max[32];
+  __info_human_bytes(used, sizeof(used), (double)mem_used());
+  __info_human_bytes(max, sizeof(max), (double)cfg->maxmemory);
+  __info_appendf(b,
+                 "used_memory:%zu\r\n"
+                 "used_memory_human:%s\r\n"
+                 "maxmemory:%zu\r\n"
+                 "maxmemory_human:%s\r\n"
+                 "maxmemory_policy:%s\r\n"
+                 "lazyfree_pending_objects:%lu\r\n"
+                 "lazyfreed_objects:%zu\r\n",
+                 mem_used(), used, cfg->maxmemory, max,
+                 __info_policy_name(cfg->maxmemory_policy), lazyfree_pending(),
+                 lazyfree_freed_objects());
+}
+
+static void __info_persistence(InfoBuf *b) {
+  __info_header(b, "Persistence");
+  const RdbSaveInfo *rdb = rdb_save_info();
+  __info_appendf(b,
+                 "rdb_changes_since_last_save:%lld\r\n"
+                 "rdb_bgsave_in_progress:%d\r\n"
+                 "rdb_last_save_time:%lld\r\n"
+                 "rdb_last_bgsave_status:%s\r\n"
+                 "rdb_last_bgsave_time_ms:%lld\r\n"
+                 "rdb_last_cow_size:%zu\r\n"
+                 "latest_fork_usec:%lld\r\n"
+                 "aof_enabled:%d\r\n"
+                 "aof_rewrite_in_progress:%d\r\n",
+                 rdb_dirty(), rdb_bgsave_in_progress(), rdb->lastsave,
+                 rdb->last_bgsave_ok ? "ok" : "err", rdb->last_bgsave_ms,
+                 rdb->last_cow_bytes, rdb->last_fork_us, aof_enabled(),
+                 aof_rewrite_in_progress());
+}
+
+static void __info_stats(InfoBuf *b, const ShardStats *shards) {
+  __info_header(b, "Stats");
+  uint64_t calls = 0, rejected = 0, failed = 0;
+  for (int id = 0; id < command_count(); id++) {
+    CommandTotals t;
+    stats_command_totals(id, &t);
+    calls += t.calls;
+    rejected += t.rejected_calls;
+    failed += t.failed_calls;
+  }
+  __info_appendf(
+      b,
+      "total_commands_processed:%llu\r\n"
+      "total_rejected_calls:%llu\r\n"
+      "total_failed_calls:%llu\r\n"
+      "eventloop_cycles:%llu\r\n"
+      "eventloop_duration_sum:%llu\r\n"
+      "eventloop_duration_max:%llu\r\n"
+      "eventloop_duration_last:%llu\r\n"
+      "instantaneous_eventloop_duration_usec:%llu\r\n",
+      (unsigned long long)calls, (unsigned long long)rejected,
+      (unsigned long long)failed, (unsigned long long)shards->loop_cycles,
+      (unsigned long long)shards->loop_usec,
+      (unsigned long long)shards->loop_max_usec,
+      (unsigned long long)shards->loop_last_usec,
+      (unsigned long long)(shards->loop_cycles
+                               ? shards->loop_usec / shards->loop_cycles
+                               : 0));
+}
+
+static void __info_commandstats(InfoBuf *b) {
+  __info_header(b, "Commandstats");
+  for (int id = 0; id < command_count(); id++) {
+    CommandTotals t;
+    stats_command_totals(id, &t);
+    if (t.calls == 0 && t.rejected_calls == 0) {
+      continue;
+    }
+    char name[64];
+    __info_command_name(name, sizeof(name), command_by_id(id)->name);
+    __info_appendf(b,
+                   "cmdstat_%s:calls=%llu,usec=%llu,usec_per_call=%.2f,"
+                   "rejected_calls=%llu,failed_calls=%llu\r\n",
+                   name, (unsigned long long)t.calls,
+                   (unsigned long long)t.usec,
+                   t.calls ? (double)t.usec / (double)t.calls : 0,
+                   (unsigned long long)t.rejected_calls,
+                   (unsigned long long)t.failed_calls);
+  }
+}
+
+static void __info_latencystats(InfoBuf *b) {
+  __info_header(b, "Latencystats");
+  Histogram *h = malloc(sizeof(Histogram));
+  if (!h) {
+    b->oom = true;
+    return;
+  }
+  for (int id = 0; id < command_count(); id++) {
+    histogram_init(h);
+    if (!stats_command_latency(id, h) || h->count == 0) {
+      continue;
+    }
+    char name[64];
+    __info_command_name(name, sizeof(name), command_by_id(id)->name);
+    /* recorded in ns, reported in us */
+    __info_appendf(b,
+                   "latency_percentiles_usec_%s:p50=%.3f,p99=%.3f,"
+                   "p99.9=%.3f\r\n",
+                   name, (double)histogram_percentile(h, 50) / 1000,
+                   (double)histogram_percentile(h, 99) / 1000,
+                   (double)histogram_percentile(h, 99.9) / 1000);
+  }
+  free(h);
+}
+
+static void __info_replication(InfoBuf *b) {
+  __info_header(b, "Replication");
+  ReplStatus s;
+  repl_status(&s);
+  __info_appendf(b, "role:%s\r\n", s.replica ? "slave" : "master");
+  if (s.replica) {
+    __info_appendf(b,
+                   "master_host:%s\r\n"
+                   "master_port:%d\r\n"
+                   "master_link_status:%s\r\n"
+                   "master_last_io_seconds_ago:%lld\r\n"
+                   "master_sync_in_progress:%d\r\n"
+                   "slave_repl_offset:%lld\r\n"
+                   "slave_read_only:1\r\n",
+                   s.primary_host, s.primary_port, s.link_up ? "up" : "down",
+                   s.last_io_s, s.sync_in_progress, s.offset);
+  }
+  __info_appendf(b, "connected_slaves:%d\r\n", s.replicas);
+  for (int i = 0; i < s.replicas; i++) {
+    ReplReplicaStatus r;
+    repl_replica_status(i, &r);
+    __info_appendf(b,
+                   "slave%d:ip=%s,port=%d,state=%s,offset=%lld,lag=%lld\r\n",
+                   i, r.ip, r.port, r.state, r.offset, r.lag_s);
+  }
+  __info_appendf(b,
+                 "master_replid:%s\r\n"
+                 "master_replid2:%s\r\n"
+                 "master_repl_offset:%lld\r\n"
+                 "second_repl_offset:%lld\r\n"
+                 "repl_backlog_active:%d\r\n"
+                 "repl_backlog_size:%zu\r\n"
+                 "repl_backlog_first_byte_offset:%lld\r\n"
+                 "repl_backlog_histlen:%lld\r\n"
+                 "sync_full:%llu\r\n"
+                 "sync_partial_ok:%llu\r\n"
+                 "sync_partial_err:%llu\r\n",
+                 s.replid, s.replid2, s.offset, s.second_offset,
+                 s.backlog_active, s.backlog_size, s.backlog_first_byte,
+                 s.backlog_histlen, s.sync_full, s.sync_partial_ok,
+                 s.sync_partial_err);
+}
+
+static void __info_cluster(InfoBuf *b) {
+  __info_header(b, "Cluster");
+  __info_appendf(b, "cluster_enabled:%d\r\n", cluster_enabled() ? 1 : 0);
+}
+
+static void __info_keyspace(InfoBuf *b, const ShardStats *shards) {
+  __info_header(b, "Keyspace");
+  if (shards->keys > 0) {
+    __info_appendf(b, "db0:keys=%llu,expires=%llu\r\n",
+                   (unsigned long long)shards->keys,
+                   (unsigned long long)shards->expires);
+  }
+}
+
+static void __info_typestats(InfoBuf *b) {
+  size_t keys[INFO_TYPE_COUNT] = {0}, bytes[INFO_TYPE_COUNT] = {0};
+  StorageIterator it;
+  const char *key;
+  size_t len;
+  RedisObject *obj;
+  storage_iter_init(&it);
+  while (storage_iter_next(&it, &key, &len, &obj)) {
+    if (obj->type < INFO_TYPE_COUNT) {
+      keys[obj->type]++;
+      bytes[obj->type] += object_memory_usage(obj);
+    }
+  }
+  storage_iter_release(&it);
+  __info_header(b, "Typestats");
+  for (int t = 0; t < INFO_TYPE_COUNT; t++) {
+    if (keys[t] > 0) {
+      __info_appendf(b, "type_%s:keys=%zu,memory=%zu\r\n",
+                     object_type_name((ObjectType)t), keys[t], bytes[t]);
+    }
+  }
+}
+
+static REDIS_RC handle_info(Command *cmd, ReplyBuffer *reply) {
+  int sections = cmd->argc == 0 ? INFO_DEFAULT : 0;
+  for (int i = 0; i < cmd->argc; i++) {
+    /* unknown sections are skipped, as in Redis */
+    __info_section(cmd->arg[i], &sections);
+  }
+
+  ShardStats shards;
+  stats_shard_totals(&shards);
+  if (shard_count() == 1) {
+    /* the published gauges lag the commands pipelined before this one */
+    shards.keys = storage_size();
+    shards.expires = storage_expires_size();
+    shards.clients = net_connected_clients();
+  }
+  InfoBuf b = {0};
+  if (sections & INFO_SERVER) {
+    __info_server(&b);
+  }
+  if (sections & INFO_CLIENTS) {
+    __info_clients(&b, &shards);
+  }
+  if (sections & INFO_MEMORY) {
+    __info_memory(&b);
+  }
+  if (sections & INFO_PERSISTENCE) {
+    __info_persistence(&b);
+  }
+  if (sections & INFO_STATS) {
+    __info_stats(&b, &shards);
+  }
+  if (sections & INFO_REPLICATION) {
+    __info_replication(&b);
+  }
+  if (sections & INFO_COMMANDSTATS) {
+    __info_commandstats(&b);
+  }
+  if (sections & INFO_LATENCYSTATS) {
+    __info_latencystats(&b);
+  }
+  if (sections & INFO_TYPESTATS) {
+    __info_typestats(&b);
+  }
+  if (sections & INFO_CLUSTER) {
+    __info_cluster(&b);
+  }
+  if (sections & INFO_KEYSPACE) {
+    __info_keyspace(&b, &shards);
+  }
+  if (b.oom) {
+    free(b.buf);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  reply_add_bulk(reply, b.buf ? b.buf : "", b.len);
+  free(b.buf);
+  return REDIS_OK;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef CMD_LATENCY_H__
+#define CMD_LATENCY_H__
+
+#include "command/cmd.h"
+#include "latency.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include <strings.h>
+
+/* LATENCY LATEST: [event, time, latest ms, max ms] per event with samples */
+static REDIS_RC __latency_latest(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  LatencySample latest[LATENCY_EVENT_COUNT];
+  uint32_t max_ms[LATENCY_EVENT_COUNT];
+  bool found[LATENCY_EVENT_COUNT];
+  long n = 0;
+  for (int e = 0; e < LATENCY_EVENT_COUNT; e++) {
+    found[e] = latency_latest((LatencyEvent)e, &latest[e], &max_ms[e]);
+    n += found[e];
+  }
+  reply_add_array_len(reply, n);
+  for (int e = 0; e < LATENCY_EVENT_COUNT; e++) {
+    if (!found[e]) {
+      continue;
+    }
+    reply_add_array_len(reply, 4);
+    reply_add_bulk_cstr(reply, latency_event_name((LatencyEvent)e));
+    reply_add_integer(reply, latest[e].time);
+    reply_add_integer(reply, latest[e].latency_ms);
+    reply_add_integer(reply, max_ms[e]);
+  }
+  return REDIS_OK;
+}
+
+/* LATENCY HISTORY event: [time, ms] pairs, oldest first */
+static REDIS_RC __latency_history(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  LatencyEvent event;
+  if (!latency_event_by_name(cmd->arg[1], &event)) {
+    /* nothing was ever recorded for it */
+    reply_add_array_len(reply, 0);
+    return REDIS_OK;
+  }
+  LatencySample samples[LATENCY_HISTORY_LEN];
+  size_t n = latency_history(event, samples);
+  reply_add_array_len(reply, (long)n);
+  for (size_t i = 0; i < n; i++) {
+    reply_add_array_len(reply, 2);
+    reply_add_integer(reply, samples[i].time);
+    reply_add_integer(reply, samples[i].latency_ms);
+  }
+  return REDIS_OK;
+}
+
+/* LATENCY RESET [event ...]: every event without arguments; the number of
+ * histories dropped */
+static REDIS_RC __latency_reset(Command *cmd, ReplyBuffer *reply) {
+  long long reset = 0;
+  if (cmd->argc == 1) {
+    for (int e = 0; e < LATENCY_EVENT_COUNT; e++) {
+      reset += latency_reset((LatencyEvent)e);
+    }
+  }
+  for (int i = 1; i < cmd->argc; i++) {
+    LatencyEvent event;
+    if (latency_event_by_name(cmd->arg[i], &event)) {
+      reset += latency_reset(event);
+    }
+  }
+  reply_add_integer(reply, reset);
+  return REDIS_OK;
+}
+
+static REDIS_RC handle_latency_command(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if (strcasecmp(cmd->arg[0], "LATEST") == 0) {
+    return __latency_latest(cmd, reply);
+  }
+  if (strcasecmp(cmd->arg[0], "HISTORY") == 0) {
+    return __latency_history(cmd, reply);
+  }
+  if (strcasecmp(cmd->arg[0], "RESET") == 0) {
+    return __latency_reset(cmd, reply);
+  }
+  return REDIS_SUB_CMD_NOT_FOUND;
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef CMD_REPLICATION_H__
+#define CMD_REPLICATION_H__
+
+#include "cluster.h"
+#include "command/cmd.h"
+#include "redis-C/rc.h"
+#include "replication.h"
+#include "serialize.h"
+#include "shard.h"
+#include "util/str_util.h"
+#include <strings.h>
+
+/* REPLICAOF host port | NO ONE (alias SLAVEOF): follow a primary, or stop */
+static REDIS_RC handle_replicaof(Command *cmd, ReplyBuffer *reply) {
+  if (cluster_enabled()) {
+    return REDIS_REPL_IN_CLUSTER;
+  }
+  /* the stream is the main loop's keyspace */
+  if (shard_count() > 1) {
+    return REDIS_NOT_SUPPORTED;
+  }
+  REDIS_RC rc;
+  if (strcasecmp(cmd->arg[0], "NO") == 0 &&
+      strcasecmp(cmd->arg[1], "ONE") == 0) {
+    rc = repl_set_primary(NULL, 0);
+  } else {
+    long long port;
+    if (!string_to_ll(cmd->arg[1], cmd->arg_len[1], &port) || port < 1 ||
+        port > 65535) {
+      return REDIS_REPL_INVALID_PORT;
+    }
+    rc = repl_set_primary(cmd->arg[0], (int)port);
+  }
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
+  }
+  return rc;
+}
+
+/* ROLE: master with its replicas, or slave with the state of its link */
+static REDIS_RC handle_role(Command *cmd, ReplyBuffer *reply) {
+  (void)cmd;
+  repl_reply_role(reply);
+  return REDIS_OK;
+}
+
+/*
+ * REPLCONF, SYNC and PSYNC concern the connection that sent them, so the
+ * connection handles them (networking.c); anywhere else they do nothing.
+ */
+static REDIS_RC handle_replconf(Command *cmd, ReplyBuffer *reply) {
+  (void)cmd;
+  (void)reply;
+  if (shard_count() > 1) {
+    return REDIS_NOT_SUPPORTED;
+  }
+  return REDIS_CONN_COMMAND;
+}
+
+static REDIS_RC handle_sync(Command *cmd, ReplyBuffer *reply) {
+  (void)cmd;
+  (void)reply;
+  if (cluster_enabled()) {
+    return REDIS_REPL_IN_CLUSTER;
+  }
+  if (shard_count() > 1) {
+    return REDIS_NOT_SUPPORTED;
+  }
+  return REDIS_CONN_COMMAND;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef CMD_SLOWLOG_H__
+#define CMD_SLOWLOG_H__
+
+#include "command/cmd.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include "slowlog.h"
+#include "util/str_util.h"
+#include <strings.h>
+
+#define SLOWLOG_DEFAULT_GET_COUNT 10
+
+/* SLOWLOG GET [count]: the newest entries first, -1 for all of them */
+static REDIS_RC __slowlog_get(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc > 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  long long count = SLOWLOG_DEFAULT_GET_COUNT;
+  if (cmd->argc == 2 &&
+      (!string_to_ll(cmd->arg[1], cmd->arg_len[1], &count) || count < -1)) {
+    return REDIS_NOT_AN_INTEGER;
+  }
+  slowlog_reply_entries(reply, (long)count);
+  return REDIS_OK;
+}
+
+static REDIS_RC handle_slowlog_command(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if (strcasecmp(cmd->arg[0], "GET") == 0) {
+    return __slowlog_get(cmd, reply);
+  }
+  if (cmd->argc != 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if (strcasecmp(cmd->arg[0], "LEN") == 0) {
+    reply_add_integer(reply, (long long)slowlog_len());
+    return REDIS_OK;
+  }
+  if (strcasecmp(cmd->arg[0], "RESET") == 0) {
+    slowlog_reset();
+    reply_add_ok(reply);
+    return REDIS_OK;
+  }
+  return REDIS_SUB_CMD_NOT_FOUND;
+}
+
+#endif
@@ -1,6 +1,535 @@
 #ifndef CMD_SORTED_SET_H__
 #define CMD_SORTED_SET_H__
 
-typedef enum { ZADD = 0, ZRANK, ZREM, ZSCORE, ZCARD } CMD_sorted_set_type;
+#include "command/cmd.h"
+#include "data_structure/sorted_set.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include "storage.h"
+#include "util/str_util.h"
+#include <math.h>
+#include <stdlib.h>
+#include <strings.h>
+
+typedef enum {
+  ZADD = 0,
+  ZRANK,
+  ZREM,
+  ZSCORE,
+  ZCARD,
+  ZREVRANK,
+  ZINCRBY,
+  ZCOUNT,
+  ZRANGE,
+  ZREVRANGE,
+  ZRANGEBYSCORE,
+  ZREVRANGEBYSCORE,
+  ZREMRANGEBYRANK,
+  ZREMRANGEBYSCORE
+} CMD_sorted_set_type;
+
+/* Options shared by the ZRANGE family. */
+typedef struct {
+  bool byscore;
+  bool rev;
+  bool withscores;
+  long long offset; /* LIMIT, only with BYSCORE */
+  long long count;  /* -1 for no limit */
+} ZRangeOptions;
+
+/* *zs is NULL when the key does not exist. */
+static REDIS_RC __zset_lookup(Command *cmd, SortedSet **zs) {
+  RedisObject *obj;
+  REDIS_RC rc =
+      storage_lookup_typed(cmd->arg[0], cmd->arg_len[0], OBJ_ZSET, &obj);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  *zs = obj ? (SortedSet *)obj->ptr : NULL;
+  return REDIS_OK;
+}
+
+/* Score bound: a float, `-inf`/`+inf`, optionally prefixed by `(`. */
+static bool __zset_parse_bound(const char *s, size_t len, double *value,
+                               bool *exclusive) {
+  *exclusive = len > 0 && s[0] == '(';
+  if (*exclusive) {
+    s++;
+    len--;
+  }
+  return string_to_double(s, len, value);
+}
+
+static REDIS_RC __zset_parse_range(Command *cmd, int min_idx, int max_idx,
+                                   ZRangeSpec *range) {
+  if (!__zset_parse_bound(cmd->arg[min_idx], cmd->arg_len[min_idx],
+                          &range->min, &range->minex) ||
+      !__zset_parse_bound(cmd->arg[max_idx], cmd->arg_len[max_idx],
+                          &range->max, &range->maxex)) {
+    return REDIS_ZSET_INVALID_RANGE;
+  }
+  return REDIS_OK;
+}
+
+static void __zset_reply_entry(ReplyBuffer *reply, const ZSetEntry *e,
+                               bool withscores) {
+  if (withscores && reply->proto >= RESP_PROTO_3) {
+    reply_add_array_len(reply, 2);
+  }
+  reply_add_bulk(reply, e->member, e->len);
+  if (withscores) {
+    reply_add_double(reply, e->score);
+  }
+}
+
+/* Drop the key once its last member is gone. */
+static void __zset_delete_if_empty(Command *cmd, SortedSet *zs) {
+  if (zset_card(zs) == 0) {
+    storage_delete(cmd->arg[0], cmd->arg_len[0]);
+  }
+}
+
+/*
+ * ZADD key [NX|XX] [GT|LT] [CH] [INCR] score member [score member ...]
+ * Scores are all parsed before the set is touched.
+ */
+static REDIS_RC __zset_add_generic(Command *cmd, ReplyBuffer *reply, int start,
+                                   int flags, bool ch) {
+  if (start >= cmd->argc || (cmd->argc - start) % 2 != 0) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if ((flags & ZSET_ADD_NX) && (flags & ZSET_ADD_XX)) {
+    return REDIS_ZSET_XX_AND_NX;
+  }
+  if (((flags & ZSET_ADD_GT) && (flags & ZSET_ADD_LT)) ||
+      ((flags & (ZSET_ADD_GT | ZSET_ADD_LT)) && (flags & ZSET_ADD_NX))) {
+    return REDIS_ZSET_GT_LT_NX;
+  }
+  size_t n = (size_t)(cmd->argc - start) / 2;
+  if ((flags & ZSET_ADD_INCR) && n != 1) {
+    return REDIS_ZSET_INCR_PAIR;
+  }
+
+  double *scores = malloc(n * sizeof(double));
+  if (!scores) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  for (size_t i = 0; i < n; i++) {
+    int k = start + (int)i * 2;
+    if (!string_to_double(cmd->arg[k], cmd->arg_len[k], &scores[i])) {
+      free(scores);
+      return REDIS_NOT_A_FLOAT;
+    }
+  }
+
+  SortedSet *zs;
+  REDIS_RC rc = __zset_lookup(cmd, &zs);
+  if (REDIS_SUCCESS(rc) && !zs && !(flags & ZSET_ADD_XX)) {
+    rc = create_zset_store(cmd->arg[0], cmd->arg_len[0], &zs);
+  }
+  if (REDIS_FAILED(rc)) {
+    free(scores);
+    return rc;
+  }
+
+  long long changed = 0;
+  ZSetAddResult res = ZSET_NOP;
+  double newscore = NAN; /* stays NaN when a flag aborted INCR */
+  for (size_t i = 0; zs && i < n; i++) {
+    int k = start + (int)i * 2 + 1;
+    res = zset_add(zs, cmd->arg[k], cmd->arg_len[k], scores[i], flags,
+                   &newscore);
+    if (res == ZSET_ERR_NAN || res == ZSET_ERR_OOM) {
+      break;
+    }
+    if (res == ZSET_ADDED || (ch && res == ZSET_UPDATED)) {
+      changed++;
+    }
+  }
+  free(scores);
+  if (zs) {
+    __zset_delete_if_empty(cmd, zs);
+  }
+
+  if (res == ZSET_ERR_NAN) {
+    return REDIS_ZSET_NAN_SCORE;
+  } else if (res == ZSET_ERR_OOM) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  if (!(flags & ZSET_ADD_INCR)) {
+    reply_add_integer(reply, changed);
+  } else if (isnan(newscore)) {
+    reply_add_null(reply);
+  } else {
+    reply_add_double(reply, newscore);
+  }
+  return REDIS_OK;
+}
+
+static REDIS_RC __zset_zadd(Command *cmd, ReplyBuffer *reply) {
+  int flags = 0;
+  bool ch = false;
+  int i = 1;
+  for (; i < cmd->argc; i++) {
+    const char *opt = cmd->arg[i];
+    if (strcasecmp(opt, "NX") == 0) {
+      flags |= ZSET_ADD_NX;
+    } else if (strcasecmp(opt, "XX") == 0) {
+      flags |= ZSET_ADD_XX;
+    } else if (strcasecmp(opt, "GT") == 0) {
+      flags |= ZSET_ADD_GT;
+    } else if (strcasecmp(opt, "LT") == 0) {
+      flags |= ZSET_ADD_LT;
+    } else if (strcasecmp(opt, "CH") == 0) {
+      ch = true;
+    } else if (strcasecmp(opt, "INCR") == 0) {
+      flags |= ZSET_ADD_INCR;
+    } else {
+      break;
+    }
+  }
+  return __zset_add_generic(cmd, reply, i, flags, ch);
+}
+
+/* ZINCRBY key increment member */
+static REDIS_RC __zset_zincrby(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  return __zset_add_generic(cmd, reply, 1, ZSET_ADD_INCR, false);
+}
+
+/* ZREM key member [member ...] */
+static REDIS_RC __zset_zrem(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  SortedSet *zs;
+  REDIS_RC rc = __zset_lookup(cmd, &zs);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  long long removed = 0;
+  for (int i = 1; zs && i < cmd->argc; i++) {
+    removed += zset_remove(zs, cmd->arg[i], cmd->arg_len[i]);
+  }
+  if (zs) {
+    __zset_delete_if_empty(cmd, zs);
+  }
+  reply_add_integer(reply, removed);
+  return REDIS_OK;
+}
+
+/* ZSCORE key member */
+static REDIS_RC __zset_zscore(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  SortedSet *zs;
+  REDIS_RC rc = __zset_lookup(cmd, &zs);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  double score;
+  if (zs && zset_score(zs, cmd->arg[1], cmd->arg_len[1], &score)) {
+    reply_add_double(reply, score);
+  } else {
+    reply_add_null(reply);
+  }
+  return REDIS_OK;
+}
+
+/* ZCARD key */
+static REDIS_RC __zset_zcard(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  SortedSet *zs;
+  REDIS_RC rc = __zset_lookup(cmd, &zs);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_integer(reply, zs ? (long long)zset_card(zs) : 0);
+  return REDIS_OK;
+}
+
+/* ZRANK / ZREVRANK key member [WITHSCORE] */
+static REDIS_RC __zset_zrank(Command *cmd, ReplyBuffer *reply, bool reverse) {
+  if (cmd->argc != 2 && cmd->argc != 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  bool withscore = cmd->argc == 3;
+  if (withscore && strcasecmp(cmd->arg[2], "WITHSCORE") != 0) {
+    return REDIS_INVALID_ARGUMENT;
+  }
+  SortedSet *zs;
+  REDIS_RC rc = __zset_lookup(cmd, &zs);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  size_t rank;
+  double score;
+  if (!zs || !zset_rank(zs, cmd->arg[1], cmd->arg_len[1], reverse, &rank)) {
+    if (withscore) {
+      reply_add_null_array(reply);
+    } else {
+      reply_add_null(reply);
+    }
+    return REDIS_OK;
+  }
+  if (withscore) {
+    zset_score(zs, cmd->arg[1], cmd->arg_len[1], &score);
+    reply_add_array_len(reply, 2);
+    reply_add_integer(reply, (long long)rank);
+    reply_add_double(reply, score);
+  } else {
+    reply_add_integer(reply, (long long)rank);
+  }
+  return REDIS_OK;
+}
+
+/* ZCOUNT key min max */
+static REDIS_RC __zset_zcount(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  ZRangeSpec range;
+  REDIS_RC rc = __zset_parse_range(cmd, 1, 2, &range);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  SortedSet *zs;
+  rc = __zset_lookup(cmd, &zs);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_integer(reply, zs ? (long long)zset_count(zs, &range) : 0);
+  return REDIS_OK;
+}
+
+/*
+ * Resolve negative ranks (counted from the end) and clamp [start, stop] to
+ * the set; false when nothing is left.
+ */
+static bool __zset_clamp_ranks(SortedSet *zs, long long *start,
+                               long long *stop) {
+  long long card = zs ? (long long)zset_card(zs) : 0;
+  if (*start < 0) {
+    *start += card;
+  }
+  if (*stop < 0) {
+    *stop += card;
+  }
+  if (*start < 0) {
+    *start = 0;
+  }
+  if (*stop >= card) {
+    *stop = card - 1;
+  }
+  return *start <= *stop && *start < card;
+}
+
+/* Members at ranks [start, stop] (negative counts from the end). */
+static void __zset_range_by_rank(SortedSet *zs, long long start,
+                                 long long stop, const ZRangeOptions *opts,
+                                 ReplyBuffer *reply) {
+  if (!__zset_clamp_ranks(zs, &start, &stop)) {
+    reply_add_array_len(reply, 0);
+    return;
+  }
+  long long card = (long long)zset_card(zs);
+
+  long long n = stop - start + 1;
+  reply_add_array_len(reply, opts->withscores && reply->proto < RESP_PROTO_3
+                                 ? n * 2
+                                 : n);
+  /* one O(log n) seek, then a linear walk */
+  SkipListNode *node =
+      zset_node_at(zs, (size_t)(opts->rev ? card - 1 - start : start));
+  for (long long i = 0; i < n; i++) {
+    __zset_reply_entry(reply, zset_node_entry(node), opts->withscores);
+    node = opts->rev ? skiplist_prev(node) : skiplist_next(node);
+  }
+}
+
+/* Members with scores in `range`, lowest first (highest first with REV). */
+static void __zset_range_by_score(SortedSet *zs, const ZRangeSpec *range,
+                                  const ZRangeOptions *opts,
+                                  ReplyBuffer *reply) {
+  SkipListNode *node = NULL;
+  long long total = 0;
+  if (zs) {
+    total = (long long)zset_count(zs, range);
+    node = opts->rev ? zset_last_in_range(zs, range)
+                     : zset_first_in_range(zs, range);
+  }
+  long long n = total - opts->offset;
+  if (opts->count >= 0 && n > opts->count) {
+    n = opts->count;
+  }
+  if (!node || n <= 0) {
+    reply_add_array_len(reply, 0);
+    return;
+  }
+
+  if (opts->offset > 0) {
+    /* jump over LIMIT's offset by rank instead of walking it */
+    size_t rank;
+    ZSetEntry *e = zset_node_entry(node);
+    zset_rank(zs, e->member, e->len, false, &rank);
+    rank = opts->rev ? rank - (size_t)opts->offset : rank + (size_t)opts->offset;
+    node = zset_node_at(zs, rank);
+  }
+  reply_add_array_len(reply, opts->withscores && reply->proto < RESP_PROTO_3
+                                 ? n * 2
+                                 : n);
+  for (long long i = 0; i < n; i++) {
+    __zset_reply_entry(reply, zset_node_entry(node), opts->withscores);
+    node = opts->rev ? skiplist_prev(node) : skiplist_next(node);
+  }
+}
+
+/*
+ * ZRANGE key start stop [BYSCORE] [REV] [LIMIT offset count] [WITHSCORES]
+ * With BYSCORE start/stop are score bounds; with REV they are given as
+ * max/min, like ZREVRANGEBYSCORE.
+ */
+static REDIS_RC __zset_range_generic(Command *cmd, ReplyBuffer *reply,
+                                     ZRangeOptions *opts) {
+  if (cmd->argc < 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  bool limit = false;
+  for (int i = 3; i < cmd->argc; i++) {
+    const char *opt = cmd->arg[i];
+    if (strcasecmp(opt, "WITHSCORES") == 0) {
+      opts->withscores = true;
+    } else if (strcasecmp(opt, "BYSCORE") == 0 && cmd->sub_cmd == ZRANGE) {
+      opts->byscore = true;
+    } else if (strcasecmp(opt, "REV") == 0 && cmd->sub_cmd == ZRANGE) {
+      opts->rev = true;
+    } else if (strcasecmp(opt, "LIMIT") == 0 && i + 2 < cmd->argc) {
+      if (!string_to_ll(cmd->arg[i + 1], cmd->arg_len[i + 1], &opts->offset) ||
+          !string_to_ll(cmd->arg[i + 2], cmd->arg_len[i + 2], &opts->count)) {
+        return REDIS_NOT_AN_INTEGER;
+      }
+      limit = true;
+      i += 2;
+    } else {
+      return REDIS_INVALID_ARGUMENT;
+    }
+  }
+  if (limit && !opts->byscore) {
+    return REDIS_INVALID_ARGUMENT;
+  }
+  if (opts->offset < 0) {
+    reply_add_array_len(reply, 0);
+    return REDIS_OK;
+  }
+
+  SortedSet *zs;
+  REDIS_RC rc;
+  if (opts->byscore) {
+    ZRangeSpec range;
+    rc = opts->rev ? __zset_parse_range(cmd, 2, 1, &range)
+                   : __zset_parse_range(cmd, 1, 2, &range);
+    if (REDIS_FAILED(rc)) {
+      return rc;
+    }
+    rc = __zset_lookup(cmd, &zs);
+    if (REDIS_SUCCESS(rc)) {
+      __zset_range_by_score(zs, &range, opts, reply);
+    }
+    return rc;
+  }
+
+  long long start, stop;
+  if (!string_to_ll(cmd->arg[1], cmd->arg_len[1], &start) ||
+      !string_to_ll(cmd->arg[2], cmd->arg_len[2], &stop)) {
+    return REDIS_NOT_AN_INTEGER;
+  }
+  rc = __zset_lookup(cmd, &zs);
+  if (REDIS_SUCCESS(rc)) {
+    __zset_range_by_rank(zs, start, stop, opts, reply);
+  }
+  return rc;
+}
+
+/* ZREMRANGEBYRANK key start stop / ZREMRANGEBYSCORE key min max */
+static REDIS_RC __zset_zremrange(Command *cmd, ReplyBuffer *reply,
+                                 bool byscore) {
+  if (cmd->argc != 3) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  ZRangeSpec range;
+  long long start, stop;
+  REDIS_RC rc = REDIS_OK;
+  if (byscore) {
+    rc = __zset_parse_range(cmd, 1, 2, &range);
+  } else if (!string_to_ll(cmd->arg[1], cmd->arg_len[1], &start) ||
+             !string_to_ll(cmd->arg[2], cmd->arg_len[2], &stop)) {
+    rc = REDIS_NOT_AN_INTEGER;
+  }
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+
+  SortedSet *zs;
+  rc = __zset_lookup(cmd, &zs);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  size_t removed = 0;
+  if (zs && byscore) {
+    removed = zset_remove_range_by_score(zs, &range);
+  } else if (zs && __zset_clamp_ranks(zs, &start, &stop)) {
+    removed = zset_remove_range_by_rank(zs, (size_t)start, (size_t)stop);
+  }
+  if (zs) {
+    __zset_delete_if_empty(cmd, zs);
+  }
+  reply_add_integer(reply, (long long)removed);
+  return REDIS_OK;
+}
+
+static REDIS_RC handle_sorted_set_command(Command *cmd, ReplyBuffer *reply) {
+  ZRangeOptions opts = {false, false, false, 0, -1};
+  switch (cmd->sub_cmd) {
+  case ZADD:
+    return __zset_zadd(cmd, reply);
+  case ZINCRBY:
+    return __zset_zincrby(cmd, reply);
+  case ZREM:
+    return __zset_zrem(cmd, reply);
+  case ZSCORE:
+    return __zset_zscore(cmd, reply);
+  case ZCARD:
+    return __zset_zcard(cmd, reply);
+  case ZRANK:
+    return __zset_zrank(cmd, reply, false);
+  case ZREVRANK:
+    return __zset_zrank(cmd, reply, true);
+  case ZCOUNT:
+    return __zset_zcount(cmd, reply);
+  case ZRANGE:
+    return __zset_range_generic(cmd, reply, &opts);
+  case ZREVRANGE:
+    opts.rev = true;
+    return __zset_range_generic(cmd, reply, &opts);
+  case ZRANGEBYSCORE:
+    opts.byscore = true;
+    return __zset_range_generic(cmd, reply, &opts);
+  case ZREVRANGEBYSCORE:
+    opts.byscore = true;
+    opts.rev = true;
+    return __zset_range_generic(cmd, reply, &opts);
+  case ZREMRANGEBYRANK:
+    return __zset_zremrange(cmd, reply, false);
+  case ZREMRANGEBYSCORE:
+    return __zset_zremrange(cmd, reply, true);
+  default:
+    return REDIS_SUB_CMD_NOT_FOUND;
+  }
+}
 
 #endif
@@ -1,6 +1,312 @@
 #ifndef CMD_STRING_H__
 #define CMD_STRING_H__
 
-typedef enum { SET = 0, GET, DEL, TTL, EXPIRE, INCR } CMD_string_type;
+#include "command/cmd.h"
+#include "object.h"
+#include "redis-C/rc.h"
+#include "replication.h"
+#include "serialize.h"
+#include "storage.h"
+#include "util/str_util.h"
+#include <limits.h>
+#include <strings.h>
+
+typedef enum {
+  SET = 0,
+  GET,
+  DEL,
+  TTL,
+  EXPIRE,
+  INCR,
+  DECR,
+  INCRBY,
+  DECRBY,
+  PTTL,
+  PEXPIRE,
+  PERSIST,
+  EXPIREAT,
+  PEXPIREAT,
+  UNLINK
+} CMD_string_type;
+
+/*
+ * Absolute expiry time for a relative `ttl` in seconds (unit 1000) or
+ * milliseconds (unit 1); false when it would overflow.
+ */
+static bool __string_expire_at(const char *s, size_t len, long long unit,
+                               long long *when_ms) {
+  long long ttl;
+  if (!string_to_ll(s, len, &ttl)) {
+    return false;
+  }
+  long long now = storage_mstime();
+  if (ttl > (LLONG_MAX - now) / unit || ttl < (LLONG_MIN + now) / unit) {
+    return false;
+  }
+  *when_ms = now + ttl * unit;
+  return true;
+}
+
+/* SET key value [NX | XX] [EX seconds | PX milliseconds] */
+static REDIS_RC __string_set(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc < 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  bool nx = false, xx = false;
+  long long when_ms = -1;
+  for (int i = 2; i < cmd->argc; i++) {
+    const char *opt = cmd->arg[i];
+    if (strcasecmp(opt, "NX") == 0 && !xx) {
+      nx = true;
+    } else if (strcasecmp(opt, "XX") == 0 && !nx) {
+      xx = true;
+    } else if ((strcasecmp(opt, "EX") == 0 || strcasecmp(opt, "PX") == 0) &&
+               when_ms < 0 && i + 1 < cmd->argc) {
+      long long unit = (opt[0] | 0x20) == 'e' ? 1000 : 1;
+      i++;
+      if (!__string_expire_at(cmd->arg[i], cmd->arg_len[i], unit, &when_ms) ||
+          when_ms <= storage_mstime()) {
+        return REDIS_INVALID_EXPIRE;
+      }
+    } else {
+      return REDIS_INVALID_ARGUMENT;
+    }
+  }
+  if (nx || xx) {
+    bool exists = storage_lookup(cmd->arg[0], cmd->arg_len[0]) != NULL;
+    if (exists == nx) {
+      reply_add_null(reply);
+      return REDIS_OK;
+    }
+  }
+
+  RedisObject *obj = object_create_string(cmd->arg[1], cmd->arg_len[1]);
+  if (!obj) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  REDIS_RC rc = storage_set(cmd->arg[0], cmd->arg_len[0], obj);
+  if (REDIS_FAILED(rc)) {
+    object_free(obj);
+    return rc;
+  }
+  if (when_ms >= 0) {
+    rc = storage_set_expire(cmd->arg[0], cmd->arg_len[0], when_ms);
+    if (REDIS_FAILED(rc)) {
+      /* never leave the value behind without the TTL it was set with */
+      storage_delete(cmd->arg[0], cmd->arg_len[0]);
+      return rc;
+    }
+  }
+  reply_add_ok(reply);
+  return REDIS_OK;
+}
+
+/* GET key */
+static REDIS_RC __string_get(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  RedisObject *obj;
+  REDIS_RC rc =
+      storage_lookup_typed(cmd->arg[0], cmd->arg_len[0], OBJ_STRING, &obj);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  if (!obj) {
+    reply_add_null(reply);
+    return REDIS_OK;
+  }
+  char ibuf[STR_UTIL_LL_SIZE];
+  size_t len;
+  const char *value = object_string(obj, &len, ibuf);
+  if (obj->encoding == OBJ_ENCODING_RAW && reply_wants_ref(reply, len)) {
+    /* sent from the value itself, which outlives a DEL until written */
+    StringBuffer *sb = object_string_retain(obj);
+    reply_add_bulk_ref(reply, sb->buf, sb->len, object_string_release, sb);
+  } else {
+    reply_add_bulk(reply, value, len);
+  }
+  return REDIS_OK;
+}
+
+/*
+ * DEL key [key ...] / UNLINK key [key ...]: keys of any type. UNLINK frees
+ * large values in the background.
+ */
+static REDIS_RC __string_del(Command *cmd, ReplyBuffer *reply, bool lazy) {
+  if (cmd->argc < 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  long long deleted = 0;
+  for (int i = 0; i < cmd->argc; i++) {
+    deleted += lazy ? storage_unlink(cmd->arg[i], cmd->arg_len[i])
+                    : storage_delete(cmd->arg[i], cmd->arg_len[i]);
+  }
+  reply_add_integer(reply, deleted);
+  return REDIS_OK;
+}
+
+/* TTL key / PTTL key: -2 for a missing key, -1 for one without a TTL */
+static REDIS_RC __string_ttl(Command *cmd, ReplyBuffer *reply, bool ms) {
+  if (cmd->argc != 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  if (!storage_lookup(cmd->arg[0], cmd->arg_len[0])) {
+    reply_add_integer(reply, -2);
+    return REDIS_OK;
+  }
+  long long when_ms = storage_get_expire(cmd->arg[0], cmd->arg_len[0]);
+  if (when_ms < 0) {
+    reply_add_integer(reply, -1);
+    return REDIS_OK;
+  }
+  long long ttl = when_ms - storage_mstime();
+  if (ttl < 0) {
+    ttl = 0;
+  }
+  reply_add_integer(reply, ms ? ttl : (ttl + 500) / 1000);
+  return REDIS_OK;
+}
+
+/*
+ * EXPIRE key seconds / PEXPIRE key milliseconds, or with `absolute` EXPIREAT
+ * key unix-seconds / PEXPIREAT key unix-milliseconds: 1 if the key exists
+ */
+static REDIS_RC __string_expire(Command *cmd, ReplyBuffer *reply, bool ms,
+                                bool absolute) {
+  if (cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  long long when_ms;
+  if (absolute) {
+    if (!string_to_ll(cmd->arg[1], cmd->arg_len[1], &when_ms) ||
+        (!ms && (when_ms > LLONG_MAX / 1000 || when_ms < LLONG_MIN / 1000))) {
+      return REDIS_INVALID_EXPIRE;
+    }
+    when_ms = ms ? when_ms : when_ms * 1000;
+  } else if (!__string_expire_at(cmd->arg[1], cmd->arg_len[1], ms ? 1 : 1000,
+                                 &when_ms)) {
+    return REDIS_INVALID_EXPIRE;
+  }
+  if (!storage_lookup(cmd->arg[0], cmd->arg_len[0])) {
+    reply_add_integer(reply, 0);
+    return REDIS_OK;
+  }
+  /* a TTL already in the past deletes the key right away. Not in a replay of
+   * the AOF, whose next commands may still use the key, nor on a replica,
+   * which waits for the DEL of its primary */
+  if (when_ms <= storage_mstime() && !storage_loading() &&
+      !repl_is_replica()) {
+    storage_delete(cmd->arg[0], cmd->arg_len[0]);
+    reply_add_integer(reply, 1);
+    return REDIS_OK;
+  }
+  REDIS_RC rc = storage_set_expire(cmd->arg[0], cmd->arg_len[0], when_ms);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_integer(reply, 1);
+  return REDIS_OK;
+}
+
+/* PERSIST key: 1 if a TTL was removed */
+static REDIS_RC __string_persist(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  bool removed = storage_lookup(cmd->arg[0], cmd->arg_len[0]) &&
+                 storage_persist(cmd->arg[0], cmd->arg_len[0]);
+  reply_add_integer(reply, removed);
+  return REDIS_OK;
+}
+
+/* INCR / DECR key, INCRBY / DECRBY key delta */
+static REDIS_RC __string_incr(Command *cmd, ReplyBuffer *reply,
+                              long long delta) {
+  RedisObject *obj;
+  REDIS_RC rc =
+      storage_lookup_typed(cmd->arg[0], cmd->arg_len[0], OBJ_STRING, &obj);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  int64_t value = 0;
+  if (obj && !object_string_to_int(obj, &value)) {
+    return REDIS_NOT_AN_INTEGER;
+  }
+  if ((delta > 0 && value > INT64_MAX - delta) ||
+      (delta < 0 && value < INT64_MIN - delta)) {
+    return REDIS_OVERFLOW;
+  }
+  value += delta;
+
+  if (obj) {
+    /* Counters are updated in place, never reparsed, and keep their TTL */
+    object_set_int(obj, value);
+  } else {
+    RedisObject *num = object_create_int(value);
+    if (!num) {
+      return REDIS_OUT_OF_MEMORY;
+    }
+    rc = storage_add(cmd->arg[0], cmd->arg_len[0], num);
+    if (REDIS_FAILED(rc)) {
+      object_free(num);
+      return rc;
+    }
+  }
+  reply_add_integer(reply, value);
+  return REDIS_OK;
+}
+
+static REDIS_RC __string_incrby(Command *cmd, ReplyBuffer *reply, int sign) {
+  if (cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  long long delta;
+  if (!string_to_ll(cmd->arg[1], cmd->arg_len[1], &delta)) {
+    return REDIS_NOT_AN_INTEGER;
+  }
+  if (sign < 0) {
+    if (delta == LLONG_MIN) {
+      return REDIS_OVERFLOW;
+    }
+    delta = -delta;
+  }
+  return __string_incr(cmd, reply, delta);
+}
+
+static REDIS_RC handle_string_command(Command *cmd, ReplyBuffer *reply) {
+  switch (cmd->sub_cmd) {
+  case SET:
+    return __string_set(cmd, reply);
+  case GET:
+    return __string_get(cmd, reply);
+  case DEL:
+  case UNLINK:
+    return __string_del(cmd, reply, cmd->sub_cmd == UNLINK);
+  case TTL:
+  case PTTL:
+    return __string_ttl(cmd, reply, cmd->sub_cmd == PTTL);
+  case EXPIRE:
+  case PEXPIRE:
+    return __string_expire(cmd, reply, cmd->sub_cmd == PEXPIRE, false);
+  case EXPIREAT:
+  case PEXPIREAT:
+    return __string_expire(cmd, reply, cmd->sub_cmd == PEXPIREAT, true);
+  case PERSIST:
+    return __string_persist(cmd, reply);
+  case INCR:
+  case DECR:
+    if (cmd->argc != 1) {
+      return REDIS_WRONG_NUMBER_OF_ARGS;
+    }
+    return __string_incr(cmd, reply, cmd->sub_cmd == INCR ? 1 : -1);
+  case INCRBY:
+    return __string_incrby(cmd, reply, 1);
+  case DECRBY:
+    return __string_incrby(cmd, reply, -1);
+  default:
+    return REDIS_SUB_CMD_NOT_FOUND;
+  }
+}
 
 #endif
@@ -0,0 +1,212 @@
+#ifndef CMD_TOP_K_H__
+#define CMD_TOP_K_H__
+
+#include "cmd_handler.h"
+#include "command/cmd.h"
+#include "data_structure/top_k.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include "storage.h"
+#include "util/str_util.h"
+#include <stdlib.h>
+#include <strings.h>
+
+typedef enum {
+  TOPK_RESERVE = 0,
+  TOPK_ADD,
+  TOPK_INCRBY,
+  TOPK_QUERY,
+  TOPK_COUNT,
+  TOPK_LIST,
+  TOPK_INFO
+} CMD_top_k_type;
+
+#define TOPK_DEFAULT_WIDTH 2048
+#define TOPK_DEFAULT_DEPTH 5
+#define TOPK_MAX_INCREMENT 100000
+
+static REDIS_RC __topk_lookup(Command *cmd, TopK **tk) {
+  RedisObject *obj;
+  REDIS_RC rc =
+      storage_lookup_typed(cmd->arg[0], cmd->arg_len[0], OBJ_TOPK, &obj);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  if (!obj) {
+    return REDIS_TOPK_KEY_NOT_FOUND;
+  }
+  *tk = (TopK *)obj->ptr;
+  return REDIS_OK;
+}
+
+static bool __topk_parse_u32(const char *s, size_t len, uint32_t *value) {
+  unsigned long long v;
+  if (!string_to_ull(s, len, &v) || v == 0 || v > UINT32_MAX) {
+    return false;
+  }
+  *value = (uint32_t)v;
+  return true;
+}
+
+/* TOPK.RESERVE key topk [width depth] */
+static REDIS_RC __topk_reserve(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 2 && cmd->argc != 4) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  uint32_t k, width = TOPK_DEFAULT_WIDTH, depth = TOPK_DEFAULT_DEPTH;
+  if (!__topk_parse_u32(cmd->arg[1], cmd->arg_len[1], &k)) {
+    return REDIS_TOPK_INVALID_K;
+  }
+  if (cmd->argc == 4) {
+    if (!__topk_parse_u32(cmd->arg[2], cmd->arg_len[2], &width)) {
+      return REDIS_TOPK_INVALID_WIDTH;
+    }
+    if (!__topk_parse_u32(cmd->arg[3], cmd->arg_len[3], &depth) ||
+        depth > TOPK_MAX_DEPTH) {
+      return REDIS_TOPK_INVALID_DEPTH;
+    }
+  }
+  REDIS_RC rc = create_topk_store(cmd->arg[0], cmd->arg_len[0], k, width, depth);
+  if (REDIS_SUCCESS(rc)) {
+    reply_add_ok(reply);
+  }
+  return rc;
+}
+
+/*
+ * TOPK.ADD key item [item ...] / TOPK.INCRBY key item incr [item incr ...]:
+ * one entry per item, the item it pushed out of the top k or null.
+ */
+static REDIS_RC __topk_add(Command *cmd, ReplyBuffer *reply, bool incrby) {
+  int step = incrby ? 2 : 1;
+  if (cmd->argc < 2 || (cmd->argc - 1) % step != 0) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  TopK *tk;
+  REDIS_RC rc = __topk_lookup(cmd, &tk);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  /* Validate every increment before counting anything */
+  for (int i = 2; incrby && i < cmd->argc; i += 2) {
+    uint32_t incr;
+    if (!__topk_parse_u32(cmd->arg[i], cmd->arg_len[i], &incr) ||
+        incr > TOPK_MAX_INCREMENT) {
+      return REDIS_TOPK_INVALID_INCREMENT;
+    }
+  }
+
+  reply_add_array_len(reply, (cmd->argc - 1) / step);
+  for (int i = 1; i < cmd->argc; i += step) {
+    uint32_t incr = 1;
+    if (incrby) {
+      __topk_parse_u32(cmd->arg[i + 1], cmd->arg_len[i + 1], &incr);
+    }
+    char *expelled;
+    size_t len;
+    if (topk_add(tk, cmd->arg[i], cmd->arg_len[i], incr, &expelled, &len) !=
+        TOPK_OK) {
+      reply_add_error(reply, redis_rc_message(REDIS_OUT_OF_MEMORY));
+    } else if (expelled) {
+      reply_add_bulk(reply, expelled, len);
+      free(expelled);
+    } else {
+      reply_add_null(reply);
+    }
+  }
+  return REDIS_OK;
+}
+
+/* TOPK.QUERY key item [item ...] / TOPK.COUNT key item [item ...] */
+static REDIS_RC __topk_query(Command *cmd, ReplyBuffer *reply, bool count) {
+  if (cmd->argc < 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  TopK *tk;
+  REDIS_RC rc = __topk_lookup(cmd, &tk);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_array_len(reply, cmd->argc - 1);
+  for (int i = 1; i < cmd->argc; i++) {
+    if (count) {
+      reply_add_integer(reply, topk_count(tk, cmd->arg[i], cmd->arg_len[i]));
+    } else {
+      reply_add_bool(reply, topk_query(tk, cmd->arg[i], cmd->arg_len[i]));
+    }
+  }
+  return REDIS_OK;
+}
+
+/* TOPK.LIST key [WITHCOUNT] */
+static REDIS_RC __topk_list(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 1 && cmd->argc != 2) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  bool withcount = cmd->argc == 2;
+  if (withcount && strcasecmp(cmd->arg[1], "WITHCOUNT") != 0) {
+    return REDIS_INVALID_ARGUMENT;
+  }
+  TopK *tk;
+  REDIS_RC rc = __topk_lookup(cmd, &tk);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  TopKSlot *items = malloc((size_t)tk->k * sizeof(TopKSlot));
+  if (!items) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  uint32_t n = topk_list(tk, items);
+  reply_add_array_len(reply, withcount ? 2 * (long)n : (long)n);
+  for (uint32_t i = 0; i < n; i++) {
+    reply_add_bulk(reply, items[i].entry->key, items[i].entry->key_len);
+    if (withcount) {
+      reply_add_integer(reply, items[i].count);
+    }
+  }
+  free(items);
+  return REDIS_OK;
+}
+
+/* TOPK.INFO key */
+static REDIS_RC __topk_info(Command *cmd, ReplyBuffer *reply) {
+  if (cmd->argc != 1) {
+    return REDIS_WRONG_NUMBER_OF_ARGS;
+  }
+  TopK *tk;
+  REDIS_RC rc = __topk_lookup(cmd, &tk);
+  if (REDIS_FAILED(rc)) {
+    return rc;
+  }
+  reply_add_map_len(reply, 3);
+  reply_add_bulk_cstr(reply, "k");
+  reply_add_integer(reply, tk->k);
+  reply_add_bulk_cstr(reply, "width");
+  reply_add_integer(reply, tk->sketch.width);
+  reply_add_bulk_cstr(reply, "depth");
+  reply_add_integer(reply, tk->sketch.depth);
+  return REDIS_OK;
+}
+
+static REDIS_RC handle_top_k_command(Command *cmd, ReplyBuffer *reply) {
+  switch (cmd->sub_cmd) {
+  case TOPK_RESERVE:
+    return __topk_reserve(cmd, reply);
+  case TOPK_ADD:
+    return __topk_add(cmd, reply, false);
+  case TOPK_INCRBY:
+    return __topk_add(cmd, reply, true);
+  case TOPK_QUERY:
+    return __topk_query(cmd, reply, false);
+  case TOPK_COUNT:
+    return __topk_query(cmd, reply, true);
+  case TOPK_LIST:
+    return __topk_list(cmd, reply);
+  case TOPK_INFO:
+    return __topk_info(cmd, reply);
+  default:
+    return REDIS_SUB_CMD_NOT_FOUND;
+  }
+}
+
+#endif
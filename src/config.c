@@ -6,6 +6,34 @@ static RedisCConfig *current_conf = NULL;
 RedisCConfig *create_config(int port) {
   RedisCConfig *cfg = malloc(sizeof(RedisCConfig));
   cfg->port = port;
+  cfg->io_threads = REDIS_C_DEFAULT_IO_THREADS;
+  cfg->shards = REDIS_C_DEFAULT_SHARDS;
+  cfg->maxmemory = REDIS_C_DEFAULT_MAXMEMORY;
+  cfg->maxmemory_policy = MAXMEMORY_NOEVICTION;
+  cfg->dbfilename = REDIS_C_DEFAULT_DBFILENAME;
+  /* the Redis defaults: after an hour, 5 minutes or a minute of writes */
+  static const SaveParam defaults[] = {{3600, 1}, {300, 100}, {60, 10000}};
+  cfg->appendonly = false;
+  cfg->appendfilename = REDIS_C_DEFAULT_APPENDFILENAME;
+  cfg->appendfsync = APPENDFSYNC_EVERYSEC;
+  cfg->lazyfree_lazy_eviction = false;
+  cfg->lazyfree_lazy_expire = false;
+  cfg->lazyfree_lazy_server_del = false;
+  cfg->loglevel = REDIS_C_DEFAULT_LOGLEVEL;
+  cfg->latency_monitor_threshold = REDIS_C_DEFAULT_LATENCY_MONITOR_THRESHOLD;
+  cfg->slowlog_log_slower_than = REDIS_C_DEFAULT_SLOWLOG_LOG_SLOWER_THAN;
+  cfg->slowlog_max_len = REDIS_C_DEFAULT_SLOWLOG_MAX_LEN;
+  cfg->cluster_enabled = false;
+  cfg->cluster_config_file = REDIS_C_DEFAULT_CLUSTER_CONFIG_FILE;
+  cfg->cluster_node_timeout = REDIS_C_DEFAULT_CLUSTER_NODE_TIMEOUT;
+  cfg->replicaof_host = NULL;
+  cfg->replicaof_port = 0;
+  cfg->repl_backlog_size = REDIS_C_DEFAULT_REPL_BACKLOG_SIZE;
+  cfg->repl_timeout = REDIS_C_DEFAULT_REPL_TIMEOUT;
+  cfg->save_params_len = sizeof(defaults) / sizeof(defaults[0]);
+  for (int i = 0; i < cfg->save_params_len; i++) {
+    cfg->save_params[i] = defaults[i];
+  }
   return cfg;
 }
 
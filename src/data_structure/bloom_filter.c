@@ -0,0 +1,495 @@
+#include "bloom_filter.h"
+#include "util/hash.h"
+#include "util/mem.h"
+#include "util/simd.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define BLOOM_HAVE_AVX2_KERNELS 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BLOOM_HAVE_NEON_KERNELS 1
+#endif
+
+/* Fixed so filters agree on bit positions wherever they are built */
+#define BLOOM_HASH_SEED 0x5bd1e995ULL
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_LANES * 32)
+/* Keys hashed and prefetched ahead of probing in the multi-key calls */
+#define BLOOM_BATCH 64
+#define LN2 0.6931471805599453
+
+/*
+ * One odd multiplier per lane: lane i of a key's block gets bit
+ * (h * salt[i]) >> 27, as in split block Bloom filters.
+ */
+static const uint32_t g_salts[BLOOM_BLOCK_LANES] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+    0x9e3779b1U, 0x85ebca77U, 0xc2b2ae3dU, 0x27d4eb2fU,
+    0x165667b1U, 0xd3a2646dU, 0xfd7046c5U, 0xb55a4f09U,
+};
+
+/*
+ * Block kernels. `h` selects the bit inside each lane and `lanes` has bit i
+ * set for every lane the key uses. test: are all the key's bits set? set:
+ * set them, returning whether they all were already.
+ */
+typedef bool (*__block_test_fn)(const uint32_t *block, uint32_t h,
+                                uint32_t lanes);
+typedef bool (*__block_set_fn)(uint32_t *block, uint32_t h, uint32_t lanes);
+
+static __block_test_fn g_block_test = NULL;
+static __block_set_fn g_block_set = NULL;
+static pthread_once_t g_kernels_once = PTHREAD_ONCE_INIT;
+
+/* Where a key lands, shared by every layer */
+typedef struct {
+  uint64_t block;  /* scaled onto a layer's block count */
+  uint32_t bits;   /* bit selector within the lanes */
+  uint32_t rotate; /* first lane */
+} BloomHash;
+
+/* private functions */
+static void __hash(const char *key, size_t len, BloomHash *h);
+static __inline__ uint32_t *__block_of(const BloomLayer *layer,
+                                       const BloomHash *h);
+static __inline__ uint32_t __lanes_of(const BloomLayer *layer,
+                                      const BloomHash *h);
+static bool __layer_test(const BloomLayer *layer, const BloomHash *h);
+static double __blocked_error_rate(uint64_t keys, uint64_t blocks,
+                                   uint32_t hashes);
+static int __layer_init(BloomLayer *layer, double error_rate,
+                        uint64_t capacity);
+static int __grow(BloomFilter *bf);
+static void __select_block_kernels(void);
+static bool __block_test_scalar(const uint32_t *block, uint32_t h,
+                                uint32_t lanes);
+static bool __block_set_scalar(uint32_t *block, uint32_t h, uint32_t lanes);
+
+BloomFilter *bloom_create(double error_rate, uint64_t capacity,
+                          uint32_t expansion) {
+  if (!(error_rate > 0 && error_rate < 1) || capacity == 0) {
+    return NULL;
+  }
+  pthread_once(&g_kernels_once, __select_block_kernels);
+  BloomFilter *bf = mem_malloc(sizeof(BloomFilter));
+  if (!bf) {
+    return NULL;
+  }
+  bf->layers = mem_malloc(sizeof(BloomLayer));
+  bf->num_layers = 0;
+  bf->expansion = expansion;
+  if (!bf->layers || __layer_init(&bf->layers[0], error_rate, capacity) != 0) {
+    mem_free(bf->layers);
+    mem_free(bf);
+    return NULL;
+  }
+  bf->num_layers = 1;
+  return bf;
+}
+
+void bloom_destroy(BloomFilter *bf) {
+  if (!bf) {
+    return;
+  }
+  for (uint32_t i = 0; i < bf->num_layers; i++) {
+    mem_free(bf->layers[i].blocks);
+  }
+  mem_free(bf->layers);
+  mem_free(bf);
+}
+
+BloomFilter *bloom_restore(const BloomFilter *image) {
+  if (image->num_layers == 0) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < image->num_layers; i++) {
+    const BloomLayer *layer = &image->layers[i];
+    if (layer->num_blocks == 0 || layer->num_blocks >= UINT32_MAX ||
+        layer->hashes == 0 || layer->hashes > BLOOM_MAX_HASHES) {
+      return NULL;
+    }
+  }
+  pthread_once(&g_kernels_once, __select_block_kernels);
+  BloomFilter *bf = mem_malloc(sizeof(BloomFilter));
+  if (!bf) {
+    return NULL;
+  }
+  bf->layers = mem_malloc(image->num_layers * sizeof(BloomLayer));
+  bf->num_layers = 0;
+  bf->expansion = image->expansion;
+  if (!bf->layers) {
+    bloom_destroy(bf);
+    return NULL;
+  }
+  for (uint32_t i = 0; i < image->num_layers; i++) {
+    const BloomLayer *src = &image->layers[i];
+    BloomLayer *layer = &bf->layers[i];
+    size_t bytes = src->num_blocks * BLOOM_BLOCK_LANES * sizeof(uint32_t);
+    *layer = *src;
+    layer->blocks = mem_aligned_alloc(64, bytes);
+    if (!layer->blocks) {
+      bloom_destroy(bf);
+      return NULL;
+    }
+    memcpy(layer->blocks, src->blocks, bytes);
+    bf->num_layers++;
+  }
+  return bf;
+}
+
+size_t bloom_madd(BloomFilter *bf, const char **keys, const size_t *lens,
+                  size_t n, int *results) {
+  BloomHash hashes[BLOOM_BATCH];
+  size_t added = 0;
+  for (size_t base = 0; base < n; base += BLOOM_BATCH) {
+    size_t m = n - base < BLOOM_BATCH ? n - base : BLOOM_BATCH;
+    int *res = results + base;
+    for (size_t j = 0; j < m; j++) {
+      __hash(keys[base + j], lens[base + j], &hashes[j]);
+      res[j] = BLOOM_ADDED;
+    }
+
+    /* Older layers are only tested, a whole batch at a time */
+    uint32_t tested = bf->num_layers - 1;
+    for (uint32_t l = 0; l < tested; l++) {
+      const BloomLayer *layer = &bf->layers[l];
+      for (size_t j = 0; j < m; j++) {
+        if (res[j] == BLOOM_ADDED) {
+          __builtin_prefetch(__block_of(layer, &hashes[j]), 0, 3);
+        }
+      }
+      for (size_t j = 0; j < m; j++) {
+        if (res[j] == BLOOM_ADDED && __layer_test(layer, &hashes[j])) {
+          res[j] = BLOOM_PRESENT;
+        }
+      }
+    }
+
+    const BloomLayer *newest = &bf->layers[tested];
+    for (size_t j = 0; j < m; j++) {
+      if (res[j] == BLOOM_ADDED) {
+        __builtin_prefetch(__block_of(newest, &hashes[j]), 1, 3);
+      }
+    }
+    /* In order, so a key repeated in the batch finds its own bits */
+    for (size_t j = 0; j < m; j++) {
+      if (res[j] != BLOOM_ADDED) {
+        continue;
+      }
+      BloomLayer *last = &bf->layers[bf->num_layers - 1];
+      if (last->count >= last->capacity) {
+        if (bf->expansion == 0) {
+          res[j] = __layer_test(last, &hashes[j]) ? BLOOM_PRESENT
+                                                  : BLOOM_ERR_FULL;
+          continue;
+        }
+        if (__grow(bf) != 0) {
+          res[j] = BLOOM_ERR_OOM;
+          continue;
+        }
+        last = &bf->layers[bf->num_layers - 1];
+      }
+      /* Layers that filled up during this batch were not tested yet */
+      for (uint32_t l = tested; l + 1 < bf->num_layers; l++) {
+        if (__layer_test(&bf->layers[l], &hashes[j])) {
+          res[j] = BLOOM_PRESENT;
+          break;
+        }
+      }
+      if (res[j] == BLOOM_PRESENT ||
+          g_block_set(__block_of(last, &hashes[j]), hashes[j].bits,
+                      __lanes_of(last, &hashes[j]))) {
+        res[j] = BLOOM_PRESENT;
+        continue;
+      }
+      last->count++;
+      added++;
+    }
+  }
+  return added;
+}
+
+void bloom_mexists(const BloomFilter *bf, const char **keys,
+                   const size_t *lens, size_t n, bool *found) {
+  BloomHash hashes[BLOOM_BATCH];
+  for (size_t base = 0; base < n; base += BLOOM_BATCH) {
+    size_t m = n - base < BLOOM_BATCH ? n - base : BLOOM_BATCH;
+    bool *hit = found + base;
+    for (size_t j = 0; j < m; j++) {
+      __hash(keys[base + j], lens[base + j], &hashes[j]);
+      hit[j] = false;
+    }
+    /* Newest first: it is the largest and holds most of the keys */
+    for (uint32_t l = bf->num_layers; l-- > 0;) {
+      const BloomLayer *layer = &bf->layers[l];
+      for (size_t j = 0; j < m; j++) {
+        if (!hit[j]) {
+          __builtin_prefetch(__block_of(layer, &hashes[j]), 0, 3);
+        }
+      }
+      for (size_t j = 0; j < m; j++) {
+        if (!hit[j]) {
+          hit[j] = __layer_test(layer, &hashes[j]);
+        }
+      }
+    }
+  }
+}
+
+int bloom_add(BloomFilter *bf, const char *key, size_t len) {
+  int result;
+  bloom_madd(bf, &key, &len, 1, &result);
+  return result;
+}
+
+bool bloom_exists(const BloomFilter *bf, const char *key, size_t len) {
+  bool found;
+  bloom_mexists(bf, &key, &len, 1, &found);
+  return found;
+}
+
+uint64_t bloom_count(const BloomFilter *bf) {
+  uint64_t count = 0;
+  for (uint32_t i = 0; i < bf->num_layers; i++) {
+    count += bf->layers[i].count;
+  }
+  return count;
+}
+
+uint64_t bloom_capacity(const BloomFilter *bf) {
+  uint64_t capacity = 0;
+  for (uint32_t i = 0; i < bf->num_layers; i++) {
+    capacity += bf->layers[i].capacity;
+  }
+  return capacity;
+}
+
+size_t bloom_memory_usage(const BloomFilter *bf) {
+  size_t bytes = 0;
+  for (uint32_t i = 0; i < bf->num_layers; i++) {
+    bytes += bf->layers[i].num_blocks * BLOOM_BLOCK_LANES * sizeof(uint32_t);
+  }
+  return bytes;
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static void __hash(const char *key, size_t len, BloomHash *h) {
+  uint64_t out[2];
+  hash_murmur3_128(key, len, BLOOM_HASH_SEED, out);
+  h->block = out[0] >> 32;
+  h->bits = (uint32_t)out[1];
+  h->rotate = (uint32_t)(out[1] >> 60);
+}
+
+/* Multiply-shift range reduction onto the layer's blocks */
+static __inline__ uint32_t *__block_of(const BloomLayer *layer,
+                                       const BloomHash *h) {
+  uint64_t block = (h->block * layer->num_blocks) >> 32;
+  return layer->blocks + block * BLOOM_BLOCK_LANES;
+}
+
+/* `hashes` consecutive lanes starting at the key's rotation */
+static __inline__ uint32_t __lanes_of(const BloomLayer *layer,
+                                      const BloomHash *h) {
+  uint32_t mask = (1U << layer->hashes) - 1;
+  mask = (mask << h->rotate) | (mask >> (BLOOM_BLOCK_LANES - h->rotate));
+  return mask & ((1U << BLOOM_BLOCK_LANES) - 1);
+}
+
+static bool __layer_test(const BloomLayer *layer, const BloomHash *h) {
+  return g_block_test(__block_of(layer, h), h->bits, __lanes_of(layer, h));
+}
+
+/*
+ * Expected false positive rate of a blocked layer. The keys of a block are
+ * Poisson distributed with mean keys / blocks, and every key sets a given
+ * bit of its block with probability hashes / BLOOM_BLOCK_BITS.
+ */
+static double __blocked_error_rate(uint64_t keys, uint64_t blocks,
+                                   uint32_t hashes) {
+  double load = (double)keys / (double)blocks;
+  double miss = log1p(-(double)hashes / BLOOM_BLOCK_BITS);
+  uint64_t last = (uint64_t)(load + 12 * sqrt(load) + 16);
+  double rate = 0;
+  for (uint64_t j = 0; j <= last; j++) {
+    double p = exp(-load + (double)j * log(load) - lgamma((double)j + 1));
+    double set = -expm1((double)j * miss);
+    rate += p * pow(set, hashes);
+  }
+  return rate;
+}
+
+static int __layer_init(BloomLayer *layer, double error_rate,
+                        uint64_t capacity) {
+  double bits = ceil(-(double)capacity * log(error_rate) / (LN2 * LN2));
+  double hashes = ceil(-log2(error_rate));
+  layer->hashes = hashes > BLOOM_MAX_HASHES ? BLOOM_MAX_HASHES
+                  : hashes < 1              ? 1
+                                            : (uint32_t)hashes;
+  if (bits / BLOOM_BLOCK_BITS >= UINT32_MAX) {
+    return -1;
+  }
+  uint64_t blocks = (uint64_t)ceil(bits / BLOOM_BLOCK_BITS);
+  if (blocks == 0) {
+    blocks = 1;
+  }
+  /* Blocking loads some blocks more than others; add blocks until the
+   * expected rate is back within the target */
+  while (__blocked_error_rate(capacity, blocks, layer->hashes) > error_rate) {
+    blocks += blocks / 16 + 1;
+    if (blocks >= UINT32_MAX) {
+      return -1;
+    }
+  }
+
+  size_t bytes = blocks * BLOOM_BLOCK_LANES * sizeof(uint32_t);
+  layer->blocks = mem_aligned_alloc(64, bytes);
+  if (!layer->blocks) {
+    return -1;
+  }
+  memset(layer->blocks, 0, bytes);
+  layer->num_blocks = blocks;
+  layer->capacity = capacity;
+  layer->count = 0;
+  layer->error_rate = error_rate;
+  return 0;
+}
+
+static int __grow(BloomFilter *bf) {
+  const BloomLayer *last = &bf->layers[bf->num_layers - 1];
+  if (last->capacity > UINT64_MAX / bf->expansion) {
+    return -1;
+  }
+  BloomLayer *layers =
+      mem_realloc(bf->layers, (bf->num_layers + 1) * sizeof(BloomLayer));
+  if (!layers) {
+    return -1;
+  }
+  bf->layers = layers;
+  last = &layers[bf->num_layers - 1];
+  if (__layer_init(&layers[bf->num_layers],
+                   last->error_rate * BLOOM_TIGHTENING,
+                   last->capacity * bf->expansion) != 0) {
+    return -1;
+  }
+  bf->num_layers++;
+  return 0;
+}
+
+static bool __block_test_scalar(const uint32_t *block, uint32_t h,
+                                uint32_t lanes) {
+  for (int i = 0; i < BLOOM_BLOCK_LANES; i++) {
+    uint32_t bit = ((lanes >> i) & 1U) << ((h * g_salts[i]) >> 27);
+    if ((block[i] & bit) != bit) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool __block_set_scalar(uint32_t *block, uint32_t h, uint32_t lanes) {
+  bool present = true;
+  for (int i = 0; i < BLOOM_BLOCK_LANES; i++) {
+    uint32_t bit = ((lanes >> i) & 1U) << ((h * g_salts[i]) >> 27);
+    present &= (block[i] & bit) == bit;
+    block[i] |= bit;
+  }
+  return present;
+}
+
+#if defined(BLOOM_HAVE_AVX2_KERNELS)
+/* The key's bits in lanes [8 * half, 8 * half + 8) */
+__attribute__((target("avx2"))) static __inline__ __m256i
+__block_mask_avx2(uint32_t h, uint32_t lanes, int half) {
+  const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  __m256i salts = _mm256_loadu_si256((const __m256i *)g_salts + half);
+  __m256i shift = _mm256_srli_epi32(
+      _mm256_mullo_epi32(_mm256_set1_epi32((int)h), salts), 27);
+  __m256i bits = _mm256_sllv_epi32(_mm256_set1_epi32(1), shift);
+  __m256i used = _mm256_and_si256(
+      _mm256_set1_epi32((int)(lanes >> (8 * half))), lane_bits);
+  return _mm256_and_si256(bits, _mm256_cmpeq_epi32(used, lane_bits));
+}
+
+__attribute__((target("avx2"))) static bool
+__block_test_avx2(const uint32_t *block, uint32_t h, uint32_t lanes) {
+  const __m256i *b = (const __m256i *)block;
+  __m256i m0 = __block_mask_avx2(h, lanes, 0);
+  __m256i m1 = __block_mask_avx2(h, lanes, 1);
+  return _mm256_testc_si256(_mm256_load_si256(b), m0) &&
+         _mm256_testc_si256(_mm256_load_si256(b + 1), m1);
+}
+
+__attribute__((target("avx2"))) static bool
+__block_set_avx2(uint32_t *block, uint32_t h, uint32_t lanes) {
+  __m256i *b = (__m256i *)block;
+  __m256i m0 = __block_mask_avx2(h, lanes, 0);
+  __m256i m1 = __block_mask_avx2(h, lanes, 1);
+  __m256i b0 = _mm256_load_si256(b);
+  __m256i b1 = _mm256_load_si256(b + 1);
+  bool present = _mm256_testc_si256(b0, m0) && _mm256_testc_si256(b1, m1);
+  _mm256_store_si256(b, _mm256_or_si256(b0, m0));
+  _mm256_store_si256(b + 1, _mm256_or_si256(b1, m1));
+  return present;
+}
+#endif
+
+#if defined(BLOOM_HAVE_NEON_KERNELS)
+/* The key's bits in lanes [4 * quarter, 4 * quarter + 4) */
+static __inline__ uint32x4_t __block_mask_neon(uint32_t h, uint32_t lanes,
+                                              int quarter) {
+  static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+  uint32x4_t salts = vld1q_u32(g_salts + 4 * quarter);
+  uint32x4_t shift = vshrq_n_u32(vmulq_u32(vdupq_n_u32(h), salts), 27);
+  uint32x4_t bits =
+      vshlq_u32(vdupq_n_u32(1), vreinterpretq_s32_u32(shift));
+  uint32x4_t lb = vld1q_u32(lane_bits);
+  uint32x4_t used = vandq_u32(vdupq_n_u32(lanes >> (4 * quarter)), lb);
+  return vandq_u32(bits, vceqq_u32(used, lb));
+}
+
+static bool __block_test_neon(const uint32_t *block, uint32_t h,
+                              uint32_t lanes) {
+  uint32x4_t all = vdupq_n_u32(UINT32_MAX);
+  for (int q = 0; q < BLOOM_BLOCK_LANES / 4; q++) {
+    uint32x4_t m = __block_mask_neon(h, lanes, q);
+    all = vandq_u32(all, vceqq_u32(vandq_u32(vld1q_u32(block + 4 * q), m), m));
+  }
+  return vminvq_u32(all) != 0;
+}
+
+static bool __block_set_neon(uint32_t *block, uint32_t h, uint32_t lanes) {
+  uint32x4_t all = vdupq_n_u32(UINT32_MAX);
+  for (int q = 0; q < BLOOM_BLOCK_LANES / 4; q++) {
+    uint32x4_t m = __block_mask_neon(h, lanes, q);
+    uint32x4_t b = vld1q_u32(block + 4 * q);
+    all = vandq_u32(all, vceqq_u32(vandq_u32(b, m), m));
+    vst1q_u32(block + 4 * q, vorrq_u32(b, m));
+  }
+  return vminvq_u32(all) != 0;
+}
+#endif
+
+/* Run through g_kernels_once, see util/simd.h */
+static void __select_block_kernels(void) {
+  g_block_test = __block_test_scalar;
+  g_block_set = __block_set_scalar;
+#if defined(BLOOM_HAVE_AVX2_KERNELS)
+  if (simd_level() == SIMD_AVX2) {
+    g_block_test = __block_test_avx2;
+    g_block_set = __block_set_avx2;
+  }
+#elif defined(BLOOM_HAVE_NEON_KERNELS)
+  if (simd_level() == SIMD_NEON) {
+    g_block_test = __block_test_neon;
+    g_block_set = __block_set_neon;
+  }
+#endif
+}
@@ -0,0 +1,114 @@
+/**
+ * @file bloom_filter.h
+ * @brief Scalable, cache-line-blocked Bloom filter
+ *
+ * A Bloom filter answers "possibly present" or "definitely absent" for a set
+ * of keys using a few bits per key.
+ *
+ * The bits are split into 64-byte blocks of BLOOM_BLOCK_LANES 32-bit lanes.
+ * One 128-bit hash of a key picks its block and `k` lanes of it, and sets one
+ * bit in each of those lanes, so adding or testing a key touches a single
+ * cache line and is done with a few vector instructions. Blocks are sized so
+ * the false positive rate stays within the requested error rate despite the
+ * uneven load a blocked layout puts on its blocks.
+ *
+ * A filter is a chain of layers. When the newest layer holds `capacity` keys
+ * a new one is added, `expansion` times larger and with half the error rate,
+ * so the overall error rate stays bounded by twice the requested one. With
+ * an expansion of 0 the filter does not scale and refuses keys once full.
+ */
+
+#ifndef REDIS_C_BLOOM_FILTER_H__
+#define REDIS_C_BLOOM_FILTER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @defgroup Bloom_Results Per-key Results of bloom_madd
+ * @{
+ */
+#define BLOOM_ADDED     1  /**< The key was not present and has been added */
+#define BLOOM_PRESENT   0  /**< The key may already have been present */
+#define BLOOM_ERR_FULL  -1 /**< Non-scaling filter at capacity */
+#define BLOOM_ERR_OOM   -2 /**< A new layer could not be allocated */
+/** @} */
+
+#define BLOOM_BLOCK_LANES     16 /**< 32-bit lanes per 64-byte block */
+#define BLOOM_MAX_HASHES      16 /**< At most one bit per lane */
+#define BLOOM_DEFAULT_EXPANSION 2
+#define BLOOM_TIGHTENING      0.5 /**< Error rate ratio of successive layers */
+
+/**
+ * @struct BloomLayer
+ * @brief One fixed-size blocked filter of the chain
+ */
+typedef struct {
+    uint32_t *blocks;     /**< num_blocks * BLOOM_BLOCK_LANES lanes, 64-byte aligned */
+    uint64_t num_blocks;
+    uint64_t capacity;    /**< Keys the layer is sized for */
+    uint64_t count;       /**< Keys added to it */
+    double error_rate;
+    uint32_t hashes;      /**< Lanes (bits) set per key */
+} BloomLayer;
+
+typedef struct {
+    BloomLayer *layers;
+    uint32_t num_layers;
+    uint32_t expansion;   /**< 0 for a non-scaling filter */
+} BloomFilter;
+
+/**
+ * @brief Create a filter whose first layer holds `capacity` keys at
+ *        `error_rate`; NULL on invalid arguments or out of memory
+ */
+BloomFilter *bloom_create(double error_rate, uint64_t capacity,
+                          uint32_t expansion);
+void bloom_destroy(BloomFilter *bf);
+
+/**
+ * @brief Rebuild a saved filter: layer geometry, counts and bits come from
+ *        `image`, whose `blocks` arrays may point anywhere (e.g. into a
+ *        mapped snapshot) and are copied; NULL on an invalid layer or out of
+ *        memory
+ */
+BloomFilter *bloom_restore(const BloomFilter *image);
+
+/**
+ * @brief Add `n` keys, writing BLOOM_ADDED, BLOOM_PRESENT or an error per key
+ *        to `results`; returns the number of keys added
+ *
+ * All keys are hashed first and their blocks prefetched before any is
+ * probed. A key repeated in the batch is added once.
+ */
+size_t bloom_madd(BloomFilter *bf, const char **keys, const size_t *lens,
+                  size_t n, int *results);
+/**
+ * @brief Test `n` keys, setting found[i] when key i may be present
+ */
+void bloom_mexists(const BloomFilter *bf, const char **keys,
+                   const size_t *lens, size_t n, bool *found);
+
+int bloom_add(BloomFilter *bf, const char *key, size_t len);
+bool bloom_exists(const BloomFilter *bf, const char *key, size_t len);
+
+/**
+ * @brief Keys added / keys the layers are sized for, over all layers
+ */
+uint64_t bloom_count(const BloomFilter *bf);
+uint64_t bloom_capacity(const BloomFilter *bf);
+/**
+ * @brief Bytes used by the bits of all layers
+ */
+size_t bloom_memory_usage(const BloomFilter *bf);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // REDIS_C_BLOOM_FILTER_H__
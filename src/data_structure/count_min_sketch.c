@@ -1,24 +1,79 @@
 #include "count_min_sketch.h"
+#include "util/hash.h"
+#include "util/mem.h"
+#include "util/simd.h"
 #include <inttypes.h> /* PRIu64 */
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define CMS_HAVE_AVX2_KERNELS 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CMS_HAVE_NEON_KERNELS 1
+#endif
+
 #define LOG_TWO 0.6931471805599453
+/* Fixed so sketches built anywhere agree on bins and can be merged */
+#define CMS_HASH_SEED 0x9747b28cULL
+
+/* Blocked-layout kernels: `sel` has all bits set on the lanes of the key */
+typedef uint32_t (*__block_add_fn)(uint32_t *block, const uint32_t *sel,
+                                   uint32_t x);
+typedef uint32_t (*__block_min_fn)(const uint32_t *block, const uint32_t *sel);
+
+static __block_add_fn g_block_add = NULL;
+static __block_min_fn g_block_min = NULL;
+static pthread_once_t g_kernels_once = PTHREAD_ONCE_INIT;
 
 /* private functions */
 static int __setup_cms(CountMinSketch *cms, uint32_t width, uint32_t depth,
-                       double error_rate, double confidence);
-static uint64_t *__default_hash(unsigned int num_hashes, const char *key);
-static uint64_t __fnv_1a(const char *key, int seed);
+                       double error_rate, double confidence,
+                       const CmsOptions *opts);
+static int64_t __add_hashes(CountMinSketch *cms, const uint64_t *hashes,
+                            uint32_t x);
+static int64_t __add_generic(CountMinSketch *cms, const uint64_t *hashes,
+                             uint32_t x);
+static int64_t __check_hashes(CountMinSketch *cms, const uint64_t *hashes);
+static __inline__ int64_t __get(const CountMinSketch *cms, size_t i);
+static __inline__ void __put(CountMinSketch *cms, size_t i, int64_t v);
+static __inline__ int64_t __counter_max(const CountMinSketch *cms);
+static __inline__ int64_t __counter_min(const CountMinSketch *cms);
+static void __ensure_fits(CountMinSketch *cms, int64_t v);
+static int __promote(CountMinSketch *cms);
+static uint32_t __block_add_conservative(uint32_t *block, const uint32_t *sel,
+                                         uint32_t x);
+static __inline__ size_t __bin(const CountMinSketch *cms, unsigned int row,
+                               uint64_t hash);
+static __inline__ size_t __block_base(const CountMinSketch *cms,
+                                      const uint64_t *hashes);
+static __inline__ size_t __counter(const CountMinSketch *cms, size_t base,
+                                   unsigned int row, uint64_t hash);
+static __inline__ size_t __num_bins(const CountMinSketch *cms);
+static __inline__ uint32_t *__block_select(const CountMinSketch *cms,
+                                           const uint64_t *hashes,
+                                           uint32_t *sel);
+static void __select_block_kernels(void);
+static uint32_t __block_add_scalar(uint32_t *block, const uint32_t *sel,
+                                   uint32_t x);
+static uint32_t __block_min_scalar(const uint32_t *block, const uint32_t *sel);
+static __inline__ uint64_t *__hashes_acquire(CountMinSketch *cms,
+                                             uint64_t *stack);
+static __inline__ void __hashes_release(uint64_t *hashes, uint64_t *stack);
 static int __compare(const void *a, const void *b);
 static int32_t __safe_add(int32_t a, uint32_t b);
 static int32_t __safe_sub(int32_t a, uint32_t b);
 static int32_t __safe_add_2(int32_t a, int32_t b);
+static __int128 __weighted_add(__int128 sum, int64_t v, int64_t w);
+static int64_t __saturate_i64(__int128 v);
+static int32_t __clamp_i32(int64_t v);
 
 // Compatibility with non-clang compilers
 #ifndef __has_builtin
@@ -26,6 +81,11 @@ static int32_t __safe_add_2(int32_t a, int32_t b);
 #endif
 
 int cms_init_by_dim(CountMinSketch *cms, uint32_t width, uint32_t depth) {
+  return cms_init_by_dim_ex(cms, width, depth, NULL);
+}
+
+int cms_init_by_dim_ex(CountMinSketch *cms, uint32_t width, uint32_t depth,
+                       const CmsOptions *opts) {
   if (depth < 1 || width < 1) {
     fprintf(stderr, "Unable to initialize the count-min sketch since either "
                     "width or depth is 0!\n");
@@ -33,10 +93,20 @@ int cms_init_by_dim(CountMinSketch *cms, uint32_t width, uint32_t depth) {
   }
   double confidence = 1 - (1 / pow(2, depth));
   double error_rate = 2 / (double)width;
-  return __setup_cms(cms, width, depth, error_rate, confidence);
+  return __setup_cms(cms, width, depth, error_rate, confidence, opts);
+}
+
+int cms_init_blocked(CountMinSketch *cms, uint32_t width, uint32_t depth) {
+  CmsOptions opts = {CMS_LAYOUT_BLOCKED, 32, 0};
+  return cms_init_by_dim_ex(cms, width, depth, &opts);
 }
 
 int cms_init_by_prob(CountMinSketch *cms, double error_rate, double confidence){
+  return cms_init_by_prob_ex(cms, error_rate, confidence, NULL);
+}
+
+int cms_init_by_prob_ex(CountMinSketch *cms, double error_rate,
+                        double confidence, const CmsOptions *opts) {
   // Validate input parameters
   if (error_rate <= 0 || error_rate >= 1) {
     fprintf(stderr, "Error rate must be between 0 and 1 (exclusive)\n");
@@ -56,25 +126,100 @@ int cms_init_by_prob(CountMinSketch *cms, double error_rate, double confidence){
     width = 1;
   if (depth < 1)
     depth = 1;
+  if (opts && opts->layout == CMS_LAYOUT_BLOCKED) {
+    depth = cms_blocked_depth(confidence);
+    if (depth == 0) {
+      fprintf(stderr, "The blocked layout reaches a confidence of %.2f at "
+                      "most!\n",
+              cms_blocked_confidence(CMS_BLOCK_MAX_DEPTH));
+      return CMS_ERROR;
+    }
+  }
 
-  return __setup_cms(cms, width, depth, error_rate, confidence);
+  return __setup_cms(cms, width, depth, error_rate, confidence, opts);
+}
+
+double cms_blocked_confidence(uint32_t depth) {
+  if (depth < 1 || depth > CMS_BLOCK_MAX_DEPTH) {
+    return 0.0;
+  }
+  double lanes = (double)(CMS_BLOCK_LANES / depth); /* row_lanes */
+  double mean = lanes / 2;
+  double p = exp(-mean); /* P(j = 0), which never fails a row */
+  double failure = 0.0;
+  for (int j = 1; j <= 64 * CMS_BLOCK_LANES; ++j) {
+    p *= mean / j;
+    failure += p * pow(j >= lanes ? 1.0 : j / lanes, depth);
+  }
+  return 1.0 - failure;
+}
+
+uint32_t cms_blocked_depth(double confidence) {
+  for (uint32_t depth = 1; depth <= CMS_BLOCK_MAX_DEPTH; ++depth) {
+    if (cms_blocked_confidence(depth) >= confidence) {
+      return depth;
+    }
+  }
+  return 0;
+}
+
+int cms_restore(CountMinSketch *cms, const CountMinSketch *image) {
+  CmsOptions opts = {image->layout, image->counter_bits, image->flags};
+  if (__setup_cms(cms, image->width, image->depth, image->error_rate,
+                  image->confidence, &opts) != CMS_SUCCESS) {
+    return CMS_ERROR;
+  }
+  memcpy(cms->counters, image->counters, cms_memory_usage(cms));
+  cms->elements_added = image->elements_added;
+  return CMS_SUCCESS;
 }
 
 int cms_destroy(CountMinSketch *cms) {
-  free(cms->bins);
+  mem_free(cms->bins);
   cms->width = 0;
   cms->depth = 0;
   cms->confidence = 0.0;
   cms->error_rate = 0.0;
   cms->elements_added = 0;
   cms->hash_function = NULL;
+  cms->layout = CMS_LAYOUT_FLAT;
+  cms->row_lanes = 0;
+  cms->num_blocks = 0;
+  cms->counter_bits = 32;
+  cms->flags = 0;
   cms->bins = NULL;
 
   return CMS_SUCCESS;
 }
 
+size_t cms_memory_usage(const CountMinSketch *cms) {
+  return __num_bins(cms) * (cms->counter_bits / 8);
+}
+
+void cms_hash_key(CountMinSketch *cms, const char *key, size_t len,
+                  uint64_t *hashes) {
+  if (cms->hash_function) {
+    uint64_t *custom = cms->hash_function(cms->depth, key);
+    memcpy(hashes, custom, cms->depth * sizeof(uint64_t));
+    free(custom);
+    return;
+  }
+  uint64_t h[2];
+  hash_murmur3_128(key, len, CMS_HASH_SEED, h);
+  for (unsigned int i = 0; i < cms->depth; ++i) {
+    hashes[i] = h[0] + i * h[1];
+  }
+}
+
 uint64_t *cms_get_hashes(CountMinSketch *cms, const char *key) {
-  return cms->hash_function(cms->depth, key);
+  if (cms->hash_function) {
+    return cms->hash_function(cms->depth, key);
+  }
+  uint64_t *hashes = (uint64_t *)malloc(cms->depth * sizeof(uint64_t));
+  if (hashes) {
+    cms_hash_key(cms, key, strlen(key), hashes);
+  }
+  return hashes;
 }
 
 int32_t cms_add_inc_alt(CountMinSketch *cms, uint64_t *hashes,
@@ -84,26 +229,46 @@ int32_t cms_add_inc_alt(CountMinSketch *cms, uint64_t *hashes,
                     "element to the count-min sketch!");
     return CMS_ERROR;
   }
-  int num_add = INT32_MAX;
-  for (unsigned int i = 0; i < cms->depth; ++i) {
-    uint64_t bin = (hashes[i] % cms->width) + (i * cms->width);
-    cms->bins[bin] = __safe_add(cms->bins[bin], x);
-    /* currently a standard min strategy */
-    if (cms->bins[bin] < num_add) {
-      num_add = cms->bins[bin];
-    }
-  }
-  cms->elements_added += x;
-  return num_add;
+  return __clamp_i32(__add_hashes(cms, hashes, x));
 }
 
 int32_t cms_add_inc(CountMinSketch *cms, const char *key, unsigned int x) {
-  uint64_t *hashes = cms_get_hashes(cms, key);
-  int32_t num_add = cms_add_inc_alt(cms, hashes, cms->depth, x);
-  free(hashes);
+  return __clamp_i32(cms_add_inc_len(cms, key, strlen(key), x));
+}
+
+int64_t cms_add_inc_len(CountMinSketch *cms, const char *key, size_t len,
+                        uint32_t x) {
+  uint64_t stack[CMS_MAX_STACK_HASHES];
+  uint64_t *hashes = __hashes_acquire(cms, stack);
+  if (!hashes) {
+    return CMS_ERROR;
+  }
+  cms_hash_key(cms, key, len, hashes);
+  int64_t num_add = __add_hashes(cms, hashes, x);
+  __hashes_release(hashes, stack);
   return num_add;
 }
 
+int cms_add_inc_multi(CountMinSketch *cms, const char **keys,
+                      const size_t *lens, const uint32_t *x, size_t n,
+                      int64_t *counts) {
+  /* a count may be any value, CMS_ERROR included: only hashing can fail */
+  uint64_t stack[CMS_MAX_STACK_HASHES];
+  uint64_t *hashes = __hashes_acquire(cms, stack);
+  if (!hashes) {
+    return CMS_ERROR;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    cms_hash_key(cms, keys[i], lens[i], hashes);
+    int64_t count = __add_hashes(cms, hashes, x[i]);
+    if (counts) {
+      counts[i] = count;
+    }
+  }
+  __hashes_release(hashes, stack);
+  return CMS_SUCCESS;
+}
+
 int32_t cms_remove_inc_alt(CountMinSketch *cms, uint64_t *hashes,
                            unsigned int num_hashes, unsigned int x) {
   if (num_hashes < cms->depth) {
@@ -111,22 +276,52 @@ int32_t cms_remove_inc_alt(CountMinSketch *cms, uint64_t *hashes,
                     "element to the count-min sketch!");
     return CMS_ERROR;
   }
-  int32_t num_add = INT32_MAX;
+  if (cms->flags & CMS_FLAG_CONSERVATIVE) {
+    /* counters no longer hold sums, subtracting could undercount */
+    return CMS_ERROR;
+  }
+  size_t base = __block_base(cms, hashes);
+  if (cms->counter_bits == 32) {
+    int32_t num_add = INT32_MAX;
+    for (unsigned int i = 0; i < cms->depth; ++i) {
+      size_t bin = __counter(cms, base, i, hashes[i]);
+      if (cms->layout == CMS_LAYOUT_BLOCKED) {
+        /* unsigned lanes floor at zero */
+        cms->bins[bin] = cms->bins[bin] > (int64_t)x ? cms->bins[bin] - x : 0;
+      } else {
+        cms->bins[bin] = __safe_sub(cms->bins[bin], x);
+      }
+      if (cms->bins[bin] < num_add) {
+        num_add = cms->bins[bin];
+      }
+    }
+    cms->elements_added -= x;
+    return num_add;
+  }
+
+  int64_t num_add = INT64_MAX;
   for (unsigned int i = 0; i < cms->depth; ++i) {
-    uint32_t bin = (hashes[i] % cms->width) + (i * cms->width);
-    cms->bins[bin] = __safe_sub(cms->bins[bin], x);
-    if (cms->bins[bin] < num_add) {
-      num_add = cms->bins[bin];
+    size_t bin = __counter(cms, base, i, hashes[i]);
+    int64_t v = __get(cms, bin);
+    v = v < __counter_min(cms) + (int64_t)x ? __counter_min(cms) : v - x;
+    __put(cms, bin, v);
+    if (v < num_add) {
+      num_add = v;
     }
   }
   cms->elements_added -= x;
-  return num_add;
+  return __clamp_i32(num_add);
 }
 
 int32_t cms_remove_inc(CountMinSketch *cms, const char *key, uint32_t x) {
-  uint64_t *hashes = cms_get_hashes(cms, key);
+  uint64_t stack[CMS_MAX_STACK_HASHES];
+  uint64_t *hashes = __hashes_acquire(cms, stack);
+  if (!hashes) {
+    return CMS_ERROR;
+  }
+  cms_hash_key(cms, key, strlen(key), hashes);
   int32_t num_add = cms_remove_inc_alt(cms, hashes, cms->depth, x);
-  free(hashes);
+  __hashes_release(hashes, stack);
   return num_add;
 }
 
@@ -137,23 +332,78 @@ int32_t cms_check_alt(CountMinSketch *cms, uint64_t *hashes,
                     "element to the count-min sketch!");
     return CMS_ERROR;
   }
-  int32_t num_add = INT32_MAX;
-  for (unsigned int i = 0; i < cms->depth; ++i) {
-    uint32_t bin = (hashes[i] % cms->width) + (i * cms->width);
-    if (cms->bins[bin] < num_add) {
-      num_add = cms->bins[bin];
-    }
-  }
-  return num_add;
+  return __clamp_i32(__check_hashes(cms, hashes));
 }
 
 int32_t cms_check(CountMinSketch *cms, const char *key) {
-  uint64_t *hashes = cms_get_hashes(cms, key);
-  int32_t num_add = cms_check_alt(cms, hashes, cms->depth);
-  free(hashes);
+  return __clamp_i32(cms_check_len(cms, key, strlen(key)));
+}
+
+int64_t cms_check_len(CountMinSketch *cms, const char *key, size_t len) {
+  uint64_t stack[CMS_MAX_STACK_HASHES];
+  uint64_t *hashes = __hashes_acquire(cms, stack);
+  if (!hashes) {
+    return CMS_ERROR;
+  }
+  cms_hash_key(cms, key, len, hashes);
+  int64_t num_add = __check_hashes(cms, hashes);
+  __hashes_release(hashes, stack);
   return num_add;
 }
 
+int cms_check_multi(CountMinSketch *cms, const char **keys,
+                    const size_t *lens, size_t n, int64_t *counts) {
+  uint64_t stack[CMS_MAX_STACK_HASHES];
+  uint64_t *hashes = __hashes_acquire(cms, stack);
+  if (!hashes) {
+    return CMS_ERROR;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    cms_hash_key(cms, keys[i], lens[i], hashes);
+    counts[i] = __check_hashes(cms, hashes);
+  }
+  __hashes_release(hashes, stack);
+  return CMS_SUCCESS;
+}
+
+int cms_merge(CountMinSketch *dest, CountMinSketch **src,
+              const int64_t *weights, size_t n) {
+  for (size_t j = 0; j < n; ++j) {
+    if (src[j]->width != dest->width || src[j]->depth != dest->depth ||
+        src[j]->layout != dest->layout) {
+      return CMS_ERROR;
+    }
+  }
+
+  /* one pass over the bins; all sources are read before dest[i] is written so
+   * dest can also be a source */
+  size_t num_bins = __num_bins(dest);
+  for (size_t i = 0; i < num_bins; ++i) {
+    __int128 wide = 0;
+    for (size_t j = 0; j < n; ++j) {
+      wide = __weighted_add(wide, __get(src[j], i), weights ? weights[j] : 1);
+    }
+    int64_t sum = __saturate_i64(wide);
+    if (sum > __counter_max(dest) && (dest->flags & CMS_FLAG_PROMOTE)) {
+      /* promoting keeps indexes, so the bins already merged stay valid */
+      while (dest->counter_bits < 32 && sum > __counter_max(dest)) {
+        if (__promote(dest) != CMS_SUCCESS) {
+          return CMS_ERROR;
+        }
+      }
+    }
+    __put(dest, i, sum);
+  }
+
+  __int128 added = 0;
+  for (size_t j = 0; j < n; ++j) {
+    added = __weighted_add(added, src[j]->elements_added,
+                           weights ? weights[j] : 1);
+  }
+  dest->elements_added = __saturate_i64(added);
+  return CMS_SUCCESS;
+}
+
 int32_t cms_check_mean_alt(CountMinSketch *cms, uint64_t *hashes,
                            unsigned int num_hashes) {
   if (num_hashes < cms->depth) {
@@ -161,18 +411,24 @@ int32_t cms_check_mean_alt(CountMinSketch *cms, uint64_t *hashes,
                     "element to the count-min sketch!");
     return CMS_ERROR;
   }
-  int32_t num_add = 0;
+  int64_t num_add = 0;
+  size_t base = __block_base(cms, hashes);
   for (unsigned int i = 0; i < cms->depth; ++i) {
-    uint32_t bin = (hashes[i] % cms->width) + (i * cms->width);
-    num_add += cms->bins[bin];
+    size_t bin = __counter(cms, base, i, hashes[i]);
+    num_add += __get(cms, bin);
   }
-  return num_add / cms->depth;
+  return __clamp_i32(num_add / cms->depth);
 }
 
 int32_t cms_check_mean(CountMinSketch *cms, const char *key) {
-  uint64_t *hashes = cms_get_hashes(cms, key);
+  uint64_t stack[CMS_MAX_STACK_HASHES];
+  uint64_t *hashes = __hashes_acquire(cms, stack);
+  if (!hashes) {
+    return CMS_ERROR;
+  }
+  cms_hash_key(cms, key, strlen(key), hashes);
   int32_t num_add = cms_check_mean_alt(cms, hashes, cms->depth);
-  free(hashes);
+  __hashes_release(hashes, stack);
   return num_add;
 }
 
@@ -181,43 +437,431 @@ int32_t cms_check_mean(CountMinSketch *cms, const char *key) {
  *******************************************************************************/
 static int __setup_cms(CountMinSketch *cms, unsigned int width,
                        unsigned int depth, double error_rate,
-                       double confidence) {
+                       double confidence, const CmsOptions *opts) {
+  CmsOptions defaults = {CMS_LAYOUT_FLAT, 32, 0};
+  if (!opts) {
+    opts = &defaults;
+  }
+  uint32_t bits = opts->counter_bits;
+  if (bits != 8 && bits != 16 && bits != 32 && bits != 64) {
+    fprintf(stderr, "Counter width must be 8, 16, 32 or 64 bits!\n");
+    return CMS_ERROR;
+  }
+  if (opts->layout == CMS_LAYOUT_BLOCKED &&
+      (bits != 32 || depth > CMS_BLOCK_MAX_DEPTH)) {
+    fprintf(stderr, "The blocked layout needs 32-bit counters and a depth "
+                    "within 1..%d!\n",
+            CMS_BLOCK_MAX_DEPTH);
+    return CMS_ERROR;
+  }
+
   cms->width = width;
   cms->depth = depth;
-  cms->confidence = confidence;
+  /* what the layout gives, which may be less than was asked for */
+  cms->confidence = opts->layout == CMS_LAYOUT_BLOCKED
+                        ? cms_blocked_confidence(depth)
+                        : confidence;
   cms->error_rate = error_rate;
   cms->elements_added = 0;
-  cms->bins = (int32_t *)calloc((width * depth), sizeof(int32_t));
-  cms->hash_function = __default_hash; /* TODO: custom hash function */
+  cms->hash_function = NULL; /* built-in double hashing */
+  cms->layout = opts->layout;
+  cms->row_lanes = 0;
+  cms->num_blocks = 0;
+  cms->counter_bits = (uint8_t)bits;
+  cms->flags = (uint8_t)opts->flags;
+
+  size_t bytes;
+  if (cms->layout == CMS_LAYOUT_BLOCKED) {
+    /* enough blocks that each row still spans at least `width` counters */
+    cms->row_lanes = CMS_BLOCK_LANES / depth;
+    cms->num_blocks = ((uint64_t)width + cms->row_lanes - 1) / cms->row_lanes;
+    bytes = (size_t)cms->num_blocks * CMS_BLOCK_LANES * sizeof(int32_t);
+    cms->bins = (int32_t *)mem_aligned_alloc(64, bytes);
+    if (cms->bins) {
+      memset(cms->bins, 0, bytes);
+    }
+    pthread_once(&g_kernels_once, __select_block_kernels);
+  } else {
+    bytes = (size_t)width * depth * (bits / 8);
+    cms->counters = mem_calloc((size_t)width * depth, bits / 8);
+  }
 
   if (NULL == cms->bins) {
-    fprintf(stderr, "Failed to allocate %zu bytes for bins!",
-            ((width * depth) * sizeof(int32_t)));
+    fprintf(stderr, "Failed to allocate %zu bytes for bins!", bytes);
     return CMS_ERROR;
   }
   return CMS_SUCCESS;
 }
 
-/* NOTE: The caller will free the results */
-static uint64_t *__default_hash(unsigned int num_hashes, const char *str) {
-  uint64_t *results = (uint64_t *)calloc(num_hashes, sizeof(uint64_t));
-  int i;
-  for (i = 0; i < num_hashes; ++i) {
-    results[i] = __fnv_1a(str, i);
+static int64_t __add_hashes(CountMinSketch *cms, const uint64_t *hashes,
+                            uint32_t x) {
+  if (cms->layout == CMS_LAYOUT_BLOCKED) {
+    uint32_t sel[CMS_BLOCK_LANES];
+    uint32_t *block = __block_select(cms, hashes, sel);
+    cms->elements_added += x;
+    if (cms->flags & CMS_FLAG_CONSERVATIVE) {
+      return __block_add_conservative(block, sel, x);
+    }
+    return g_block_add(block, sel, x);
   }
-  return results;
+  if (cms->counter_bits != 32 || (cms->flags & CMS_FLAG_CONSERVATIVE)) {
+    return __add_generic(cms, hashes, x);
+  }
+
+  int num_add = INT32_MAX;
+  for (unsigned int i = 0; i < cms->depth; ++i) {
+    size_t bin = __bin(cms, i, hashes[i]);
+    cms->bins[bin] = __safe_add(cms->bins[bin], x);
+    /* standard min strategy */
+    if (cms->bins[bin] < num_add) {
+      num_add = cms->bins[bin];
+    }
+  }
+  cms->elements_added += x;
+  return num_add;
+}
+
+/* Flat layout, any counter width, standard or conservative update. */
+static int64_t __add_generic(CountMinSketch *cms, const uint64_t *hashes,
+                             uint32_t x) {
+  int64_t num_add = INT64_MAX;
+  cms->elements_added += x;
+
+  if (cms->flags & CMS_FLAG_CONSERVATIVE) {
+    for (unsigned int i = 0; i < cms->depth; ++i) {
+      int64_t v = __get(cms, __bin(cms, i, hashes[i]));
+      num_add = v < num_add ? v : num_add;
+    }
+    int64_t target = num_add > INT64_MAX - x ? INT64_MAX : num_add + x;
+    __ensure_fits(cms, target);
+    if (target > __counter_max(cms)) {
+      target = __counter_max(cms);
+    }
+    /* only the counters below the new estimate move, up to it */
+    for (unsigned int i = 0; i < cms->depth; ++i) {
+      size_t bin = __bin(cms, i, hashes[i]);
+      if (__get(cms, bin) < target) {
+        __put(cms, bin, target);
+      }
+    }
+    return target;
+  }
+
+  for (unsigned int i = 0; i < cms->depth; ++i) {
+    size_t bin = __bin(cms, i, hashes[i]);
+    int64_t v = __get(cms, bin);
+    v = v > INT64_MAX - x ? INT64_MAX : v + x;
+    __ensure_fits(cms, v);
+    __put(cms, bin, v);
+    v = __get(cms, bin);
+    num_add = v < num_add ? v : num_add;
+  }
+  return num_add;
+}
+
+static int64_t __check_hashes(CountMinSketch *cms, const uint64_t *hashes) {
+  if (cms->layout == CMS_LAYOUT_BLOCKED) {
+    uint32_t sel[CMS_BLOCK_LANES];
+    uint32_t *block = __block_select(cms, hashes, sel);
+    return g_block_min(block, sel);
+  }
+  if (cms->counter_bits == 32) {
+    int32_t num_add = INT32_MAX;
+    for (unsigned int i = 0; i < cms->depth; ++i) {
+      size_t bin = __bin(cms, i, hashes[i]);
+      if (cms->bins[bin] < num_add) {
+        num_add = cms->bins[bin];
+      }
+    }
+    return num_add;
+  }
+  int64_t num_add = INT64_MAX;
+  for (unsigned int i = 0; i < cms->depth; ++i) {
+    int64_t v = __get(cms, __bin(cms, i, hashes[i]));
+    num_add = v < num_add ? v : num_add;
+  }
+  return num_add;
+}
+
+static __inline__ int64_t __get(const CountMinSketch *cms, size_t i) {
+  switch (cms->counter_bits) {
+  case 8:
+    return ((const uint8_t *)cms->counters)[i];
+  case 16:
+    return ((const uint16_t *)cms->counters)[i];
+  case 64:
+    return ((const int64_t *)cms->counters)[i];
+  default:
+    return cms->bins[i];
+  }
+}
+
+/* Store `v` clamped to the counter range. */
+static __inline__ void __put(CountMinSketch *cms, size_t i, int64_t v) {
+  int64_t max = __counter_max(cms);
+  int64_t min = __counter_min(cms);
+  v = v > max ? max : (v < min ? min : v);
+  switch (cms->counter_bits) {
+  case 8:
+    ((uint8_t *)cms->counters)[i] = (uint8_t)v;
+    break;
+  case 16:
+    ((uint16_t *)cms->counters)[i] = (uint16_t)v;
+    break;
+  case 64:
+    ((int64_t *)cms->counters)[i] = v;
+    break;
+  default:
+    cms->bins[i] = (int32_t)v;
+    break;
+  }
+}
+
+static __inline__ int64_t __counter_max(const CountMinSketch *cms) {
+  switch (cms->counter_bits) {
+  case 8:
+    return UINT8_MAX;
+  case 16:
+    return UINT16_MAX;
+  case 64:
+    return INT64_MAX;
+  default:
+    return INT32_MAX;
+  }
+}
+
+static __inline__ int64_t __counter_min(const CountMinSketch *cms) {
+  switch (cms->counter_bits) {
+  case 8:
+  case 16:
+    return 0;
+  case 64:
+    return INT64_MIN;
+  default:
+    return cms->layout == CMS_LAYOUT_BLOCKED ? 0 : INT32_MIN;
+  }
+}
+
+/* Widen the sketch until `v` fits, if it is allowed to; on allocation
+ * failure the counters just saturate. */
+static void __ensure_fits(CountMinSketch *cms, int64_t v) {
+  while ((cms->flags & CMS_FLAG_PROMOTE) && cms->counter_bits < 32 &&
+         v > __counter_max(cms)) {
+    if (__promote(cms) != CMS_SUCCESS) {
+      return;
+    }
+  }
+}
+
+/* Double the counter width (8 -> 16 -> 32) in place. */
+static int __promote(CountMinSketch *cms) {
+  size_t num_bins = __num_bins(cms);
+  uint32_t bits = cms->counter_bits * 2;
+  void *wider = mem_calloc(num_bins, bits / 8);
+  if (!wider) {
+    return CMS_ERROR;
+  }
+  for (size_t i = 0; i < num_bins; ++i) {
+    int64_t v = __get(cms, i);
+    if (bits == 16) {
+      ((uint16_t *)wider)[i] = (uint16_t)v;
+    } else {
+      ((int32_t *)wider)[i] = (int32_t)v;
+    }
+  }
+  mem_free(cms->counters);
+  cms->counters = wider;
+  cms->counter_bits = (uint8_t)bits;
+  return CMS_SUCCESS;
+}
+
+/* Lemire's multiply-shift: maps the top 32 bits of `hash` onto [0, width)
+ * without a division. */
+static __inline__ size_t __bin(const CountMinSketch *cms, unsigned int row,
+                               uint64_t hash) {
+  uint64_t col = ((hash >> 32) * (uint64_t)cms->width) >> 32;
+  return (size_t)row * cms->width + (size_t)col;
+}
+
+/* Offset of the key's block in `bins`; always 0 for the flat layout. */
+static __inline__ size_t __block_base(const CountMinSketch *cms,
+                                      const uint64_t *hashes) {
+  if (cms->layout != CMS_LAYOUT_BLOCKED) {
+    return 0;
+  }
+  uint64_t block = ((hashes[0] >> 32) * cms->num_blocks) >> 32;
+  return (size_t)block * CMS_BLOCK_LANES;
 }
 
-static uint64_t __fnv_1a(const char *key, int seed) {
-  // FNV-1a hash (http://www.isthe.com/chongo/tech/comp/fnv/)
-  int i, len = strlen(key);
-  uint64_t h = 14695981039346656037ULL +
-               (31 * seed); // FNV_OFFSET 64 bit with magic number seed
-  for (i = 0; i < len; ++i) {
-    h = h ^ (unsigned char)key[i];
-    h = h * 1099511628211ULL; // FNV_PRIME 64 bit
+/* Index in `bins` of the counter for `row`. Within a block the lane comes
+ * from the low half of the row hash, the block came from the high half. */
+static __inline__ size_t __counter(const CountMinSketch *cms, size_t base,
+                                   unsigned int row, uint64_t hash) {
+  if (cms->layout != CMS_LAYOUT_BLOCKED) {
+    return __bin(cms, row, hash);
+  }
+  uint64_t lane = ((uint64_t)(uint32_t)hash * cms->row_lanes) >> 32;
+  return base + row * cms->row_lanes + (size_t)lane;
+}
+
+static __inline__ size_t __num_bins(const CountMinSketch *cms) {
+  if (cms->layout == CMS_LAYOUT_BLOCKED) {
+    return (size_t)cms->num_blocks * CMS_BLOCK_LANES;
+  }
+  return (size_t)cms->width * cms->depth;
+}
+
+/* Fill the lane mask of a key and return its block. */
+static __inline__ uint32_t *__block_select(const CountMinSketch *cms,
+                                           const uint64_t *hashes,
+                                           uint32_t *sel) {
+  size_t base = __block_base(cms, hashes);
+  memset(sel, 0, CMS_BLOCK_LANES * sizeof(uint32_t));
+  for (unsigned int i = 0; i < cms->depth; ++i) {
+    sel[__counter(cms, base, i, hashes[i]) - base] = UINT32_MAX;
+  }
+  return (uint32_t *)cms->bins + base;
+}
+
+/* Saturating add on the selected lanes: a + min(inc, INT32_MAX - a), then the
+ * minimum of the selected lanes, with the others forced to all ones. */
+static uint32_t __block_add_scalar(uint32_t *block, const uint32_t *sel,
+                                   uint32_t x) {
+  uint32_t min = UINT32_MAX;
+  for (int i = 0; i < CMS_BLOCK_LANES; ++i) {
+    uint32_t inc = x & sel[i];
+    uint32_t room = (uint32_t)INT32_MAX - block[i];
+    block[i] += inc < room ? inc : room;
+    uint32_t v = block[i] | ~sel[i];
+    min = v < min ? v : min;
+  }
+  return min;
+}
+
+static uint32_t __block_min_scalar(const uint32_t *block, const uint32_t *sel) {
+  uint32_t min = UINT32_MAX;
+  for (int i = 0; i < CMS_BLOCK_LANES; ++i) {
+    uint32_t v = block[i] | ~sel[i];
+    min = v < min ? v : min;
+  }
+  return min;
+}
+
+/* Raise the selected lanes below min + x up to it; the others are left. */
+static uint32_t __block_add_conservative(uint32_t *block, const uint32_t *sel,
+                                         uint32_t x) {
+  uint32_t min = g_block_min(block, sel);
+  uint32_t room = (uint32_t)INT32_MAX - min;
+  uint32_t target = min + (x < room ? x : room);
+  for (int i = 0; i < CMS_BLOCK_LANES; ++i) {
+    uint32_t t = target & sel[i];
+    block[i] = block[i] < t ? t : block[i];
+  }
+  return target;
+}
+
+#if defined(CMS_HAVE_AVX2_KERNELS)
+__attribute__((target("avx2"))) static __inline__ uint32_t
+__hmin_avx2(__m256i v) {
+  __m128i m = _mm_min_epu32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  m = _mm_min_epu32(m, _mm_shuffle_epi32(m, 0x4E));
+  m = _mm_min_epu32(m, _mm_shuffle_epi32(m, 0xB1));
+  return (uint32_t)_mm_cvtsi128_si32(m);
+}
+
+__attribute__((target("avx2"))) static uint32_t
+__block_add_avx2(uint32_t *block, const uint32_t *sel, uint32_t x) {
+  const __m256i max = _mm256_set1_epi32(INT32_MAX);
+  const __m256i vx = _mm256_set1_epi32((int)x);
+  __m256i *b = (__m256i *)block;
+  __m256i s0 = _mm256_loadu_si256((const __m256i *)sel);
+  __m256i s1 = _mm256_loadu_si256((const __m256i *)sel + 1);
+  __m256i b0 = _mm256_load_si256(b);
+  __m256i b1 = _mm256_load_si256(b + 1);
+  __m256i i0 = _mm256_and_si256(vx, s0);
+  __m256i i1 = _mm256_and_si256(vx, s1);
+  b0 = _mm256_add_epi32(b0, _mm256_min_epu32(i0, _mm256_sub_epi32(max, b0)));
+  b1 = _mm256_add_epi32(b1, _mm256_min_epu32(i1, _mm256_sub_epi32(max, b1)));
+  _mm256_store_si256(b, b0);
+  _mm256_store_si256(b + 1, b1);
+
+  const __m256i ones = _mm256_set1_epi32(-1);
+  __m256i m0 = _mm256_or_si256(b0, _mm256_xor_si256(s0, ones));
+  __m256i m1 = _mm256_or_si256(b1, _mm256_xor_si256(s1, ones));
+  return __hmin_avx2(_mm256_min_epu32(m0, m1));
+}
+
+__attribute__((target("avx2"))) static uint32_t
+__block_min_avx2(const uint32_t *block, const uint32_t *sel) {
+  const __m256i ones = _mm256_set1_epi32(-1);
+  const __m256i *b = (const __m256i *)block;
+  __m256i s0 = _mm256_loadu_si256((const __m256i *)sel);
+  __m256i s1 = _mm256_loadu_si256((const __m256i *)sel + 1);
+  __m256i m0 = _mm256_or_si256(_mm256_load_si256(b), _mm256_xor_si256(s0, ones));
+  __m256i m1 =
+      _mm256_or_si256(_mm256_load_si256(b + 1), _mm256_xor_si256(s1, ones));
+  return __hmin_avx2(_mm256_min_epu32(m0, m1));
+}
+#endif
+
+#if defined(CMS_HAVE_NEON_KERNELS)
+static uint32_t __block_add_neon(uint32_t *block, const uint32_t *sel,
+                                 uint32_t x) {
+  const uint32x4_t max = vdupq_n_u32(INT32_MAX);
+  const uint32x4_t vx = vdupq_n_u32(x);
+  uint32x4_t min = vdupq_n_u32(UINT32_MAX);
+  for (int i = 0; i < CMS_BLOCK_LANES; i += 4) {
+    uint32x4_t s = vld1q_u32(sel + i);
+    uint32x4_t b = vld1q_u32(block + i);
+    uint32x4_t inc = vandq_u32(vx, s);
+    b = vaddq_u32(b, vminq_u32(inc, vsubq_u32(max, b)));
+    vst1q_u32(block + i, b);
+    min = vminq_u32(min, vorrq_u32(b, vmvnq_u32(s)));
+  }
+  return vminvq_u32(min);
+}
+
+static uint32_t __block_min_neon(const uint32_t *block, const uint32_t *sel) {
+  uint32x4_t min = vdupq_n_u32(UINT32_MAX);
+  for (int i = 0; i < CMS_BLOCK_LANES; i += 4) {
+    uint32x4_t v = vorrq_u32(vld1q_u32(block + i), vmvnq_u32(vld1q_u32(sel + i)));
+    min = vminq_u32(min, v);
+  }
+  return vminvq_u32(min);
+}
+#endif
+
+/* Run through g_kernels_once, see util/simd.h */
+static void __select_block_kernels(void) {
+  g_block_add = __block_add_scalar;
+  g_block_min = __block_min_scalar;
+#if defined(CMS_HAVE_AVX2_KERNELS)
+  if (simd_level() == SIMD_AVX2) {
+    g_block_add = __block_add_avx2;
+    g_block_min = __block_min_avx2;
+  }
+#elif defined(CMS_HAVE_NEON_KERNELS)
+  if (simd_level() == SIMD_NEON) {
+    g_block_add = __block_add_neon;
+    g_block_min = __block_min_neon;
+  }
+#endif
+}
+
+/* Row hashes live on the caller's stack unless the sketch is very deep */
+static __inline__ uint64_t *__hashes_acquire(CountMinSketch *cms,
+                                             uint64_t *stack) {
+  if (cms->depth <= CMS_MAX_STACK_HASHES) {
+    return stack;
+  }
+  return (uint64_t *)malloc(cms->depth * sizeof(uint64_t));
+}
+
+static __inline__ void __hashes_release(uint64_t *hashes, uint64_t *stack) {
+  if (hashes != stack) {
+    free(hashes);
   }
-  return h;
 }
 
 static int __compare(const void *a, const void *b) {
@@ -280,3 +924,32 @@ static int32_t __safe_add_2(int32_t a, int32_t b) {
     return INT32_MAX;
   return (int32_t)c;
 }
+
+/* sum + v * w, exact while |sum| stays within 2^126. A product is at most
+ * 2^126 in magnitude, so the addition cannot overflow; the result is held to
+ * that bound, far past anything __saturate_i64 lets through. */
+static __int128 __weighted_add(__int128 sum, int64_t v, int64_t w) {
+  const __int128 limit = (__int128)1 << 126;
+  sum += (__int128)v * w;
+  return sum > limit ? limit : (sum < -limit ? -limit : sum);
+}
+
+static int64_t __saturate_i64(__int128 v) {
+  if (v >= INT64_MAX) {
+    return INT64_MAX;
+  }
+  if (v <= INT64_MIN) {
+    return INT64_MIN;
+  }
+  return (int64_t)v;
+}
+
+static int32_t __clamp_i32(int64_t v) {
+  if (v >= INT32_MAX) {
+    return INT32_MAX;
+  }
+  if (v <= INT32_MIN) {
+    return INT32_MIN;
+  }
+  return (int32_t)v;
+}
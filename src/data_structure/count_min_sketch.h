@@ -17,6 +17,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -42,6 +43,49 @@ extern "C" {
 
 typedef uint64_t* (*cms_hash_function)(unsigned int num_hashes, const char* key);
 
+/**
+ * @brief Sketches with up to this many rows hash without touching the heap
+ */
+#define CMS_MAX_STACK_HASHES 32
+
+/**
+ * @defgroup CMS_Layout Counter Layouts
+ * @{
+ */
+#define CMS_LAYOUT_FLAT    0  /**< One row of `width` counters per hash */
+#define CMS_LAYOUT_BLOCKED 1  /**< All rows of a key in one cache line */
+#define CMS_BLOCK_LANES    16 /**< 32-bit counters per 64-byte block */
+#define CMS_BLOCK_MAX_DEPTH 4 /**< Deepest blocked sketch: >= 4 lanes a row */
+/** @} */
+
+/**
+ * @defgroup CMS_Flags Option Flags
+ * @{
+ */
+#define CMS_FLAG_PROMOTE      0x1 /**< Widen 8/16-bit counters on saturation */
+#define CMS_FLAG_CONSERVATIVE 0x2 /**< Conservative update (no removals) */
+/** @} */
+
+/**
+ * @struct CmsOptions
+ * @brief Creation options; NULL means flat 32-bit counters, standard update
+ *
+ * `counter_bits` is 8, 16, 32 or 64. 8 and 16-bit counters are unsigned and
+ * saturate at their maximum unless CMS_FLAG_PROMOTE is set, in which case the
+ * whole sketch is widened (8 -> 16 -> 32) the first time a counter would
+ * overflow. 32-bit counters are signed as before and 64-bit counters are
+ * signed, both saturating. The blocked layout only supports 32-bit counters.
+ *
+ * With CMS_FLAG_CONSERVATIVE an increment of `x` only raises the key's
+ * counters that are below min + x, up to min + x. Estimates remain upper
+ * bounds but are tighter for the same memory; removal is not supported.
+ */
+typedef struct {
+    uint32_t layout;       /**< CMS_LAYOUT_FLAT or CMS_LAYOUT_BLOCKED */
+    uint32_t counter_bits; /**< 8, 16, 32 or 64 */
+    uint32_t flags;        /**< CMS_FLAG_* */
+} CmsOptions;
+
 /**
  * @struct CountMinSketch
  * @brief Count-Min Sketch data structure
@@ -49,6 +93,24 @@ typedef uint64_t* (*cms_hash_function)(unsigned int num_hashes, const char* key)
  * Represents a probabilistic frequency counter using a 2D matrix of bins.
  * The structure maintains `depth` independent hash functions, each mapping
  * to `width` counter bins.
+ *
+ * By default one 128-bit MurmurHash3 of the key is computed and the row
+ * hashes are derived by Kirsch-Mitzenmacher double hashing (h1 + i * h2),
+ * which keeps the same error bounds as `depth` independent hashes. A hash is
+ * mapped onto a row with a multiply-shift range reduction instead of `%`.
+ *
+ * With CMS_LAYOUT_BLOCKED the bins are split into 64-byte blocks of
+ * CMS_BLOCK_LANES counters. A key picks one block and each row owns
+ * `row_lanes` lanes of it, so an update or query touches a single cache line
+ * and is done with a few vector instructions. Every row still spreads over
+ * `width` (or slightly more) counters, so the per-row error bound
+ * (error_rate = 2 / width) is unchanged. The rows of a key are not
+ * independent though: they all collide with the other keys of its block, and
+ * a row of `row_lanes` lanes only tells those apart by its lane. The
+ * confidence is therefore well below 1 - 2^-depth (see
+ * cms_blocked_confidence) and stops improving past CMS_BLOCK_MAX_DEPTH rows,
+ * where a row would get too few lanes. Blocked counters are unsigned and
+ * saturate at INT32_MAX.
  */
 typedef struct {
     uint32_t depth;              /**< Number of hash functions (rows) */
@@ -57,7 +119,16 @@ typedef struct {
     double confidence;           /**< Confidence level (1 - error probability) */
     double error_rate;           /**< Maximum error rate per estimate */
     cms_hash_function hash_function; /**< Custom hash function (NULL for default) */
-    int32_t* bins;               /**< Flat array of counters (size: depth * width) */
+    uint32_t layout;             /**< CMS_LAYOUT_FLAT or CMS_LAYOUT_BLOCKED */
+    uint32_t row_lanes;          /**< Blocked: lanes of a block owned by each row */
+    uint64_t num_blocks;         /**< Blocked: number of 64-byte blocks */
+    uint8_t counter_bits;        /**< Width of each counter: 8, 16, 32 or 64 */
+    uint8_t flags;               /**< CMS_FLAG_* */
+    union {
+        int32_t* bins;           /**< Flat array of counters (size: depth * width,
+                                      or num_blocks * CMS_BLOCK_LANES) */
+        void* counters;          /**< Same array when counter_bits != 32 */
+    };
 } CountMinSketch;
 
 /**
@@ -72,6 +143,44 @@ typedef CountMinSketch count_min_sketch;
  */
 int cms_init_by_dim(CountMinSketch *cms, unsigned int width, unsigned int depth);
 int cms_init_by_prob(CountMinSketch *cms, double error_rate, double confidence);
+/**
+ * @brief Initialize a CMS_LAYOUT_BLOCKED sketch; `depth` must be at most
+ *        CMS_BLOCK_MAX_DEPTH
+ */
+int cms_init_blocked(CountMinSketch *cms, unsigned int width, unsigned int depth);
+/**
+ * @brief cms_init_by_dim / cms_init_by_prob with explicit options
+ */
+int cms_init_by_dim_ex(CountMinSketch *cms, unsigned int width,
+                       unsigned int depth, const CmsOptions *opts);
+int cms_init_by_prob_ex(CountMinSketch *cms, double error_rate,
+                        double confidence, const CmsOptions *opts);
+/**
+ * @brief Confidence of a blocked sketch of `depth` rows (0 past
+ *        CMS_BLOCK_MAX_DEPTH)
+ *
+ * The per-row Markov bound of the flat layout, taken given the other keys
+ * of the block: with j of them holding error_rate * N each, a row is over
+ * the bound with probability at most min(1, j / row_lanes), independently
+ * of the other rows, and j is Poisson with mean row_lanes / 2. About 0.50,
+ * 0.70, 0.76 and 0.78 for depths 1 to 4, against 1 - 2^-depth when flat.
+ */
+double cms_blocked_confidence(unsigned int depth);
+/**
+ * @brief Fewest rows of a blocked sketch reaching `confidence`; 0 when no
+ *        blocked sketch does
+ */
+unsigned int cms_blocked_depth(double confidence);
+/**
+ * @brief Initialize `cms` as a copy of a saved sketch: dimensions, options,
+ *        statistics and the cms_memory_usage() bytes of counters `image`
+ *        points to (e.g. into a mapped snapshot). The built-in hash is used.
+ */
+int cms_restore(CountMinSketch *cms, const CountMinSketch *image);
+/**
+ * @brief Bytes used by the counters
+ */
+size_t cms_memory_usage(const CountMinSketch *cms);
 int cms_destroy(CountMinSketch *cms);
 
 /* ============================================================================
@@ -79,6 +188,17 @@ int cms_destroy(CountMinSketch *cms);
  * ============================================================================
  */
 
+/**
+ * @brief Compute the `depth` row hashes of a key into a caller buffer
+ *
+ * Allocation-free unless a custom hash_function is set. The result can be
+ * passed to the *_alt functions.
+ */
+void cms_hash_key(CountMinSketch *cms, const char *key, size_t len,
+                  uint64_t *hashes);
+/**
+ * @brief Heap-allocated variant of cms_hash_key (the caller frees the result)
+ */
 uint64_t *cms_get_hashes(CountMinSketch *cms,
                                            const char *key);
 
@@ -87,6 +207,11 @@ uint64_t *cms_get_hashes(CountMinSketch *cms,
  * ============================================================================
  */
 int32_t cms_add_inc(CountMinSketch *cms, const char *key, uint32_t x);
+/**
+ * @brief Binary-safe cms_add_inc, returning the full-width estimate
+ */
+int64_t cms_add_inc_len(CountMinSketch *cms, const char *key, size_t len,
+                        uint32_t x);
 int32_t cms_add_inc_alt(CountMinSketch *cms, uint64_t *hashes,
                         unsigned int num_hashes, uint32_t x);
 static __inline__ int32_t cms_add(CountMinSketch *cms, const char *key) {
@@ -97,12 +222,25 @@ static __inline__ int32_t cms_add_alt(CountMinSketch *cms, uint64_t *hashes,
   return cms_add_inc_alt(cms, hashes, num_hashes, 1);
 }
 
+/**
+ * @brief Increment `n` keys in one call
+ *
+ * @param counts Output, the estimated count of each key after its increment
+ *               (may be NULL)
+ * @return CMS_SUCCESS, or CMS_ERROR when hashing fails
+ */
+int cms_add_inc_multi(CountMinSketch *cms, const char **keys,
+                      const size_t *lens, const uint32_t *x, size_t n,
+                      int64_t *counts);
+
 /* ============================================================================
  * Element Removal Operations
  * ============================================================================
  */
 
 int32_t cms_remove_inc(CountMinSketch *cms, const char *key, uint32_t x);
+int32_t cms_remove_inc_alt(CountMinSketch *cms, uint64_t *hashes,
+                           unsigned int num_hashes, unsigned int x);
 static __inline__ int32_t cms_remove(CountMinSketch *cms, const char *key) {
   return cms_remove_inc(cms, key, 1);
 }
@@ -113,10 +251,51 @@ static __inline__ int32_t cms_remove(CountMinSketch *cms, const char *key) {
  */
 
 int32_t cms_check(CountMinSketch *cms, const char *key);
+int32_t cms_check_alt(CountMinSketch *cms, uint64_t *hashes,
+                      unsigned int num_hashes);
+/**
+ * @brief Mean of the key's counters instead of the minimum
+ */
+int32_t cms_check_mean(CountMinSketch *cms, const char *key);
+int32_t cms_check_mean_alt(CountMinSketch *cms, uint64_t *hashes,
+                           unsigned int num_hashes);
+/**
+ * @brief Binary-safe cms_check, returning the full-width estimate
+ */
+int64_t cms_check_len(CountMinSketch *cms, const char *key, size_t len);
 static __inline__ int32_t cms_check_min(CountMinSketch *cms, const char *key) {
   return cms_check(cms, key);
 }
 
+/**
+ * @brief Query `n` keys in one call, writing each estimate to `counts`
+ *
+ * Estimates may take any value, INT32_MIN included; failure is only told by
+ * the return value.
+ *
+ * @return CMS_SUCCESS, or CMS_ERROR when hashing fails
+ */
+int cms_check_multi(CountMinSketch *cms, const char **keys,
+                    const size_t *lens, size_t n, int64_t *counts);
+
+/* ============================================================================
+ * Merge Operations
+ * ============================================================================
+ */
+
+/**
+ * @brief Overwrite `dest` with the weighted sum of `n` sketches
+ *
+ * All sketches must share dest's width, depth and layout (counter widths may
+ * differ); `dest` may itself be one of the sources. Counters saturate at
+ * dest's counter range, or promote dest if it has CMS_FLAG_PROMOTE.
+ *
+ * @param weights Per-source multiplier, or NULL for all ones
+ * @return CMS_SUCCESS, or CMS_ERROR when the dimensions differ
+ */
+int cms_merge(CountMinSketch *dest, CountMinSketch **src,
+              const int64_t *weights, size_t n);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,371 @@
+#include "cuckoo_filter.h"
+#include "util/hash.h"
+#include "util/mem.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Fixed so filters agree on buckets wherever they are built */
+#define CUCKOO_HASH_SEED 0xc6a4a7935bd1e995ULL
+/* Load a 4-way cuckoo table reaches reliably with a few dozen kicks */
+#define CUCKOO_MAX_LOAD 0.95
+/* Kick paths up to this long are recorded on the stack */
+#define CUCKOO_STACK_KICKS 64
+#define CUCKOO_MAX_BUCKETS (1ULL << 40)
+
+/*
+ * Word-wide lane arithmetic on the four 16-bit fingerprints of a bucket. A
+ * fingerprint is never 0, which marks an empty slot.
+ */
+#define LANE_ONES 0x0001000100010001ULL
+#define LANE_LOW  0x7FFF7FFF7FFF7FFFULL
+#define LANE_BITS 16
+
+typedef struct {
+  uint64_t index; /* primary bucket before masking to a layer */
+  uint16_t fp;
+} CuckooHash;
+
+typedef struct {
+  uint64_t bucket;
+  unsigned lane;
+} CuckooKick;
+
+/* private functions */
+static void __hash(const char *key, size_t len, CuckooHash *h);
+static __inline__ uint64_t __alt_bucket(const CuckooLayer *layer,
+                                        uint64_t bucket, uint16_t fp);
+static __inline__ uint64_t __match_lanes(uint64_t word, uint16_t fp);
+static __inline__ uint16_t __lane_get(uint64_t word, unsigned lane);
+static __inline__ void __lane_set(uint64_t *word, unsigned lane, uint16_t fp);
+static bool __insert_empty(CuckooLayer *layer, uint64_t bucket, uint16_t fp);
+static bool __kick_insert(CuckooFilter *cf, CuckooLayer *layer,
+                          uint64_t bucket, uint16_t fp);
+static uint64_t __layer_matches(const CuckooLayer *layer, const CuckooHash *h);
+static int __layer_init(CuckooLayer *layer, uint64_t num_buckets);
+static int __grow(CuckooFilter *cf);
+static int __add(CuckooFilter *cf, const CuckooHash *h);
+static uint64_t __next_random(CuckooFilter *cf);
+
+CuckooFilter *cuckoo_create(uint64_t capacity, uint32_t max_kicks,
+                            uint32_t expansion) {
+  if (capacity == 0 || max_kicks == 0) {
+    return NULL;
+  }
+  double need = ceil((double)capacity / CUCKOO_BUCKET_SIZE / CUCKOO_MAX_LOAD);
+  if (need > (double)CUCKOO_MAX_BUCKETS) {
+    return NULL;
+  }
+  uint64_t num_buckets = 1;
+  while ((double)num_buckets < need) {
+    num_buckets <<= 1;
+  }
+
+  CuckooFilter *cf = mem_malloc(sizeof(CuckooFilter));
+  if (!cf) {
+    return NULL;
+  }
+  cf->layers = mem_malloc(sizeof(CuckooLayer));
+  if (!cf->layers || __layer_init(&cf->layers[0], num_buckets) != 0) {
+    mem_free(cf->layers);
+    mem_free(cf);
+    return NULL;
+  }
+  cf->num_layers = 1;
+  cf->expansion = expansion;
+  cf->max_kicks = max_kicks;
+  cf->deleted = 0;
+  cf->rng = 0x9e3779b97f4a7c15ULL;
+  return cf;
+}
+
+void cuckoo_destroy(CuckooFilter *cf) {
+  if (!cf) {
+    return;
+  }
+  for (uint32_t i = 0; i < cf->num_layers; i++) {
+    mem_free(cf->layers[i].buckets);
+  }
+  mem_free(cf->layers);
+  mem_free(cf);
+}
+
+CuckooFilter *cuckoo_restore(const CuckooFilter *image) {
+  if (image->num_layers == 0 || image->max_kicks == 0) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < image->num_layers; i++) {
+    uint64_t n = image->layers[i].num_buckets;
+    if (n == 0 || (n & (n - 1)) != 0 || n > CUCKOO_MAX_BUCKETS) {
+      return NULL;
+    }
+  }
+  CuckooFilter *cf = mem_malloc(sizeof(CuckooFilter));
+  if (!cf) {
+    return NULL;
+  }
+  *cf = *image;
+  cf->num_layers = 0;
+  cf->layers = mem_malloc(image->num_layers * sizeof(CuckooLayer));
+  if (!cf->layers) {
+    mem_free(cf);
+    return NULL;
+  }
+  for (uint32_t i = 0; i < image->num_layers; i++) {
+    const CuckooLayer *src = &image->layers[i];
+    CuckooLayer *layer = &cf->layers[i];
+    size_t bytes = src->num_buckets * sizeof(uint64_t);
+    layer->buckets = mem_malloc(bytes);
+    if (!layer->buckets) {
+      cuckoo_destroy(cf);
+      return NULL;
+    }
+    memcpy(layer->buckets, src->buckets, bytes);
+    layer->num_buckets = src->num_buckets;
+    layer->count = src->count;
+    cf->num_layers++;
+  }
+  return cf;
+}
+
+int cuckoo_add(CuckooFilter *cf, const char *key, size_t len) {
+  CuckooHash h;
+  __hash(key, len, &h);
+  return __add(cf, &h);
+}
+
+int cuckoo_add_nx(CuckooFilter *cf, const char *key, size_t len) {
+  CuckooHash h;
+  __hash(key, len, &h);
+  for (uint32_t i = 0; i < cf->num_layers; i++) {
+    if (__layer_matches(&cf->layers[i], &h)) {
+      return CUCKOO_EXISTS;
+    }
+  }
+  return __add(cf, &h);
+}
+
+bool cuckoo_exists(const CuckooFilter *cf, const char *key, size_t len) {
+  CuckooHash h;
+  __hash(key, len, &h);
+  for (uint32_t i = cf->num_layers; i-- > 0;) {
+    if (__layer_matches(&cf->layers[i], &h)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t cuckoo_count(const CuckooFilter *cf, const char *key, size_t len) {
+  CuckooHash h;
+  __hash(key, len, &h);
+  uint64_t count = 0;
+  for (uint32_t i = 0; i < cf->num_layers; i++) {
+    count += (uint64_t)__builtin_popcountll(__layer_matches(&cf->layers[i], &h));
+  }
+  return count;
+}
+
+bool cuckoo_delete(CuckooFilter *cf, const char *key, size_t len) {
+  CuckooHash h;
+  __hash(key, len, &h);
+  /* Newest first, where most keys live */
+  for (uint32_t i = cf->num_layers; i-- > 0;) {
+    CuckooLayer *layer = &cf->layers[i];
+    uint64_t b1 = h.index & (layer->num_buckets - 1);
+    uint64_t candidates[2] = {b1, __alt_bucket(layer, b1, h.fp)};
+    for (int c = 0; c < 2; c++) {
+      uint64_t match = __match_lanes(layer->buckets[candidates[c]], h.fp);
+      if (match) {
+        __lane_set(&layer->buckets[candidates[c]],
+                   (unsigned)__builtin_ctzll(match) / LANE_BITS, 0);
+        layer->count--;
+        cf->deleted++;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+uint64_t cuckoo_items(const CuckooFilter *cf) {
+  uint64_t items = 0;
+  for (uint32_t i = 0; i < cf->num_layers; i++) {
+    items += cf->layers[i].count;
+  }
+  return items;
+}
+
+uint64_t cuckoo_buckets(const CuckooFilter *cf) {
+  uint64_t buckets = 0;
+  for (uint32_t i = 0; i < cf->num_layers; i++) {
+    buckets += cf->layers[i].num_buckets;
+  }
+  return buckets;
+}
+
+size_t cuckoo_memory_usage(const CuckooFilter *cf) {
+  return (size_t)cuckoo_buckets(cf) * sizeof(uint64_t);
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static void __hash(const char *key, size_t len, CuckooHash *h) {
+  uint64_t out[2];
+  hash_murmur3_128(key, len, CUCKOO_HASH_SEED, out);
+  h->index = out[0];
+  h->fp = (uint16_t)(out[1] >> 48);
+  if (h->fp == 0) {
+    h->fp = 1;
+  }
+}
+
+/* Partial-key cuckoo hashing: the other bucket follows from the fingerprint
+ * alone, so a kicked fingerprint can move without its key */
+static __inline__ uint64_t __alt_bucket(const CuckooLayer *layer,
+                                        uint64_t bucket, uint16_t fp) {
+  return (bucket ^ ((uint64_t)fp * 0x5bd1e995ULL)) & (layer->num_buckets - 1);
+}
+
+/* Top bit of every lane equal to `fp`, exactly (no borrow between lanes) */
+static __inline__ uint64_t __match_lanes(uint64_t word, uint16_t fp) {
+  uint64_t x = word ^ (LANE_ONES * fp);
+  return ~(((x & LANE_LOW) + LANE_LOW) | x | LANE_LOW);
+}
+
+static __inline__ uint16_t __lane_get(uint64_t word, unsigned lane) {
+  return (uint16_t)(word >> (lane * LANE_BITS));
+}
+
+static __inline__ void __lane_set(uint64_t *word, unsigned lane, uint16_t fp) {
+  unsigned shift = lane * LANE_BITS;
+  *word = (*word & ~(0xFFFFULL << shift)) | ((uint64_t)fp << shift);
+}
+
+static bool __insert_empty(CuckooLayer *layer, uint64_t bucket, uint16_t fp) {
+  uint64_t empty = __match_lanes(layer->buckets[bucket], 0);
+  if (!empty) {
+    return false;
+  }
+  __lane_set(&layer->buckets[bucket], (unsigned)__builtin_ctzll(empty) / LANE_BITS,
+             fp);
+  return true;
+}
+
+/*
+ * Make room by moving fingerprints to their alternate buckets. The path is
+ * recorded so a failed attempt can be undone, leaving every fingerprint
+ * where it was.
+ */
+static bool __kick_insert(CuckooFilter *cf, CuckooLayer *layer,
+                          uint64_t bucket, uint16_t fp) {
+  CuckooKick stack[CUCKOO_STACK_KICKS];
+  CuckooKick *path = cf->max_kicks <= CUCKOO_STACK_KICKS
+                         ? stack
+                         : mem_malloc(cf->max_kicks * sizeof(CuckooKick));
+  if (!path) {
+    return false;
+  }
+
+  bool done = false;
+  uint32_t steps = 0;
+  while (steps < cf->max_kicks) {
+    unsigned lane = (unsigned)(__next_random(cf) % CUCKOO_BUCKET_SIZE);
+    path[steps++] = (CuckooKick){bucket, lane};
+    uint16_t victim = __lane_get(layer->buckets[bucket], lane);
+    __lane_set(&layer->buckets[bucket], lane, fp);
+    fp = victim;
+    bucket = __alt_bucket(layer, bucket, fp);
+    if (__insert_empty(layer, bucket, fp)) {
+      done = true;
+      break;
+    }
+  }
+  /* Swap back along the path; the original fingerprint ends up in hand */
+  while (!done && steps > 0) {
+    CuckooKick k = path[--steps];
+    uint16_t resident = __lane_get(layer->buckets[k.bucket], k.lane);
+    __lane_set(&layer->buckets[k.bucket], k.lane, fp);
+    fp = resident;
+  }
+
+  if (path != stack) {
+    mem_free(path);
+  }
+  return done;
+}
+
+/* Lanes holding the key's fingerprint in either of its buckets */
+static uint64_t __layer_matches(const CuckooLayer *layer, const CuckooHash *h) {
+  uint64_t b1 = h->index & (layer->num_buckets - 1);
+  uint64_t b2 = __alt_bucket(layer, b1, h->fp);
+  uint64_t matches = __match_lanes(layer->buckets[b1], h->fp);
+  if (b2 != b1) {
+    /* Keep both buckets' bits apart for the popcount */
+    matches = (matches >> 1) | __match_lanes(layer->buckets[b2], h->fp);
+  }
+  return matches;
+}
+
+static int __layer_init(CuckooLayer *layer, uint64_t num_buckets) {
+  layer->buckets = mem_calloc(num_buckets, sizeof(uint64_t));
+  if (!layer->buckets) {
+    return -1;
+  }
+  layer->num_buckets = num_buckets;
+  layer->count = 0;
+  return 0;
+}
+
+static int __grow(CuckooFilter *cf) {
+  uint64_t factor = 1;
+  while (factor < cf->expansion) {
+    factor <<= 1;
+  }
+  uint64_t num_buckets = cf->layers[cf->num_layers - 1].num_buckets;
+  if (num_buckets > CUCKOO_MAX_BUCKETS / factor) {
+    return -1;
+  }
+  CuckooLayer *layers =
+      mem_realloc(cf->layers, (cf->num_layers + 1) * sizeof(CuckooLayer));
+  if (!layers) {
+    return -1;
+  }
+  cf->layers = layers;
+  if (__layer_init(&layers[cf->num_layers], num_buckets * factor) != 0) {
+    return -1;
+  }
+  cf->num_layers++;
+  return 0;
+}
+
+static int __add(CuckooFilter *cf, const CuckooHash *h) {
+  CuckooLayer *layer = &cf->layers[cf->num_layers - 1];
+  uint64_t b1 = h->index & (layer->num_buckets - 1);
+  uint64_t b2 = __alt_bucket(layer, b1, h->fp);
+  if (__insert_empty(layer, b1, h->fp) || __insert_empty(layer, b2, h->fp) ||
+      __kick_insert(cf, layer, (__next_random(cf) & 1) ? b2 : b1, h->fp)) {
+    layer->count++;
+    return CUCKOO_OK;
+  }
+
+  if (cf->expansion == 0) {
+    return CUCKOO_ERR_FULL;
+  }
+  if (__grow(cf) != 0) {
+    return CUCKOO_ERR_OOM;
+  }
+  layer = &cf->layers[cf->num_layers - 1];
+  __insert_empty(layer, h->index & (layer->num_buckets - 1), h->fp);
+  layer->count++;
+  return CUCKOO_OK;
+}
+
+/* xorshift64* */
+static uint64_t __next_random(CuckooFilter *cf) {
+  cf->rng ^= cf->rng >> 12;
+  cf->rng ^= cf->rng << 25;
+  cf->rng ^= cf->rng >> 27;
+  return cf->rng * 0x2545F4914F6CDD1DULL;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file cuckoo_filter.h
+ * @brief Bucketized cuckoo filter: approximate membership with deletion
+ *
+ * Each key is stored as a 16-bit fingerprint in one of two candidate
+ * buckets. A bucket holds CUCKOO_BUCKET_SIZE fingerprints packed into one
+ * 64-bit word, so checking a bucket is a single word-wide compare. When both
+ * buckets are full a resident fingerprint is kicked to its alternate bucket,
+ * up to `max_kicks` times.
+ *
+ * If the kicks run out the filter is left as it was and, unless growth is
+ * disabled, a new layer `expansion` times larger takes the key. Lookups and
+ * deletions check every layer. False positives happen with probability about
+ * 2 * CUCKOO_BUCKET_SIZE / 65535 per layer.
+ *
+ * Only delete keys that were added: deleting a key that merely collides with
+ * a stored fingerprint removes the other key.
+ */
+
+#ifndef REDIS_C_CUCKOO_FILTER_H__
+#define REDIS_C_CUCKOO_FILTER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @defgroup Cuckoo_Status Status Codes
+ * @{
+ */
+#define CUCKOO_OK        0
+#define CUCKOO_EXISTS    1  /**< cuckoo_add_nx: the key may already be present */
+#define CUCKOO_ERR_FULL  -1 /**< No room and growth disabled */
+#define CUCKOO_ERR_OOM   -2
+/** @} */
+
+#define CUCKOO_BUCKET_SIZE        4
+#define CUCKOO_DEFAULT_MAX_KICKS  20
+#define CUCKOO_DEFAULT_EXPANSION  1
+
+typedef struct {
+    uint64_t *buckets;    /**< One word of CUCKOO_BUCKET_SIZE fingerprints each */
+    uint64_t num_buckets; /**< Power of two */
+    uint64_t count;       /**< Fingerprints stored */
+} CuckooLayer;
+
+typedef struct {
+    CuckooLayer *layers;
+    uint32_t num_layers;
+    uint32_t expansion;   /**< Growth factor; 0 disables growth */
+    uint32_t max_kicks;
+    uint64_t deleted;     /**< Successful deletions, over the filter's life */
+    uint64_t rng;         /**< Picks the fingerprints to kick */
+} CuckooFilter;
+
+/**
+ * @brief Create a filter sized for `capacity` keys; NULL on invalid
+ *        arguments or out of memory
+ */
+CuckooFilter *cuckoo_create(uint64_t capacity, uint32_t max_kicks,
+                            uint32_t expansion);
+void cuckoo_destroy(CuckooFilter *cf);
+
+/**
+ * @brief Rebuild a saved filter from `image`, copying the bucket arrays it
+ *        points to (e.g. into a mapped snapshot); NULL when a layer is not a
+ *        power of two buckets or out of memory
+ */
+CuckooFilter *cuckoo_restore(const CuckooFilter *image);
+
+/**
+ * @brief Add a key, even if it is already present
+ * @return CUCKOO_OK, CUCKOO_ERR_FULL or CUCKOO_ERR_OOM
+ */
+int cuckoo_add(CuckooFilter *cf, const char *key, size_t len);
+/**
+ * @brief Add a key unless it may already be present (CUCKOO_EXISTS)
+ */
+int cuckoo_add_nx(CuckooFilter *cf, const char *key, size_t len);
+bool cuckoo_exists(const CuckooFilter *cf, const char *key, size_t len);
+/**
+ * @brief How many times the key's fingerprint is stored (an upper bound on
+ *        how often it was added)
+ */
+uint64_t cuckoo_count(const CuckooFilter *cf, const char *key, size_t len);
+/**
+ * @brief Remove one occurrence of the key; false if it is not present
+ */
+bool cuckoo_delete(CuckooFilter *cf, const char *key, size_t len);
+
+/**
+ * @brief Fingerprints stored / buckets over all layers
+ */
+uint64_t cuckoo_items(const CuckooFilter *cf);
+uint64_t cuckoo_buckets(const CuckooFilter *cf);
+size_t cuckoo_memory_usage(const CuckooFilter *cf);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // REDIS_C_CUCKOO_FILTER_H__
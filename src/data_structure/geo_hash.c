@@ -12,55 +12,157 @@
 #define BASE32_SIZE 32
 #define BITS_PER_CHAR 5
 
-/* Macros */
-#define GET_BIT(num, idx) (((num) >> (idx)) & 1)
+#define MERCATOR_MAX 20037726.37
 
-/* Lookup tables for adjacent cells */
-#define NUM_DIRECTIONS 4
-#define NUM_PARITY_TYPES 2
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
-static const char *adjacent_map[NUM_DIRECTIONS][NUM_PARITY_TYPES] = {
-    {"p0r21436x8zb9dcf5h7kjnmqesgutwvy", "bc01fg45238967deuvhjyznpkmstqrwx"}, /* North */
-    {"14365h7k9dcfesgujnmqp0r2twvyx8zb", "238967debc01fg45kmstqrwxuvhjyznp"}, /* South */
-    {"bc01fg45238967deuvhjyznpkmstqrwx", "p0r21436x8zb9dcf5h7kjnmqesgutwvy"}, /* East */
-    {"238967debc01fg45kmstqrwxuvhjyznp", "14365h7k9dcfesgujnmqp0r2twvyx8zb"}  /* West */
-};
+/* Macros */
+#define DEG_TO_RAD(d) ((d) * M_PI / 180.0)
+#define RAD_TO_DEG(r) ((r) * 180.0 / M_PI)
 
-static const char *border_map[NUM_DIRECTIONS][NUM_PARITY_TYPES] = {
-    {"prxz", "bcfguvyz"},     /* North */
-    {"028b", "0145hjnp"},     /* South */
-    {"bcfguvyz", "prxz"},     /* East */
-    {"0145hjnp", "028b"}      /* West */
+/* Base32 character -> value + 1; 0 marks characters outside the alphabet */
+static const unsigned char base32_lookup[256] = {
+    ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,  ['5'] = 6,
+    ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10, ['b'] = 11, ['c'] = 12,
+    ['d'] = 13, ['e'] = 14, ['f'] = 15, ['g'] = 16, ['h'] = 17, ['j'] = 18,
+    ['k'] = 19, ['m'] = 20, ['n'] = 21, ['p'] = 22, ['q'] = 23, ['r'] = 24,
+    ['s'] = 25, ['t'] = 26, ['u'] = 27, ['v'] = 28, ['w'] = 29, ['x'] = 30,
+    ['y'] = 31, ['z'] = 32,
 };
 
-/* Internal helper functions */
-static int find_base32_index(char c) {
-    for (int i = 0; i < BASE32_SIZE; i++) {
-        if (BASE32_ALPHABET[i] == c) {
-            return i;
-        }
+/* Even (latitude) and odd (longitude) bit positions */
+#define LAT_MASK 0x5555555555555555ULL
+#define LON_MASK 0xAAAAAAAAAAAAAAAAULL
+
+/* Bit interleaving. BMI2 does it in one instruction; the magic-number
+ * spread is the portable fallback. */
+static uint64_t spread_bits(uint32_t v) {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x << 2)) & 0x3333333333333333ULL;
+    x = (x | (x << 1)) & LAT_MASK;
+    return x;
+}
+
+/* Inverse of spread_bits: gather the even bit positions */
+static uint32_t squash_bits(uint64_t x) {
+    x &= LAT_MASK;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+    return (uint32_t)x;
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define GEOHASH_HAVE_BMI2 1
+#define GEOHASH_HAVE_AVX2_KERNELS 1
+
+__attribute__((target("bmi2"))) static uint64_t interleave_bmi2(uint32_t lat, uint32_t lon) {
+    return _pdep_u64(lat, LAT_MASK) | _pdep_u64(lon, LON_MASK);
+}
+
+__attribute__((target("bmi2"))) static void deinterleave_bmi2(uint64_t bits, uint32_t *lat,
+                                                              uint32_t *lon) {
+    *lat = (uint32_t)_pext_u64(bits, LAT_MASK);
+    *lon = (uint32_t)_pext_u64(bits, LON_MASK);
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define GEOHASH_HAVE_NEON_KERNELS 1
+#endif
+
+/* Latitude in the even bits, longitude in the odd ones */
+static uint64_t interleave(uint32_t lat, uint32_t lon) {
+#if defined(GEOHASH_HAVE_BMI2)
+    if (__builtin_cpu_supports("bmi2")) {
+        return interleave_bmi2(lat, lon);
+    }
+#endif
+    return spread_bits(lat) | (spread_bits(lon) << 1);
+}
+
+static void deinterleave(uint64_t bits, uint32_t *lat, uint32_t *lon) {
+#if defined(GEOHASH_HAVE_BMI2)
+    if (__builtin_cpu_supports("bmi2")) {
+        deinterleave_bmi2(bits, lat, lon);
+        return;
     }
-    return -1;
+#endif
+    *lat = squash_bits(bits);
+    *lon = squash_bits(bits >> 1);
+}
+
+/* Cell index of `value` among 2^bits equal slices of [min, max]; the upper
+ * edge belongs to the last cell */
+static uint32_t quantize(double value, double min, double max, unsigned bits) {
+    uint64_t cells = 1ULL << bits;
+    uint64_t idx = (uint64_t)((value - min) / (max - min) * (double)cells);
+    return (uint32_t)(idx >= cells ? cells - 1 : idx);
+}
+
+/* String geohashes hold 5 bits per character, most significant first and
+ * longitude first. With an odd bit count longitude has the extra bit; the
+ * helpers below pad latitude with a zero bit so the usual even/odd
+ * interleaving applies. */
+static void string_bit_counts(size_t length, unsigned *lat_bits, unsigned *lon_bits) {
+    unsigned total = (unsigned)length * BITS_PER_CHAR;
+    *lon_bits = (total + 1) / 2;
+    *lat_bits = total / 2;
+}
+
+static uint64_t string_bits_pack(uint32_t lat, uint32_t lon, size_t length) {
+    unsigned odd = (length * BITS_PER_CHAR) & 1;
+    return interleave(lat << odd, lon) >> odd;
 }
 
-static int find_char_index(char c, const char *str) {
-    const char *pos = strchr(str, c);
-    return pos ? (int)(pos - str) : -1;
+static void string_bits_unpack(uint64_t bits, size_t length, uint32_t *lat, uint32_t *lon) {
+    unsigned odd = (length * BITS_PER_CHAR) & 1;
+    deinterleave(bits << odd, lat, lon);
+    *lat >>= odd;
 }
 
-static bool is_valid_geohash_string(const char *hash, size_t length) {
+static bool string_to_bits(const char *hash, size_t length, uint64_t *bits) {
     if (!hash || length == 0 || length > GEOHASH_MAX_PRECISION) {
         return false;
     }
-    
+    uint64_t result = 0;
     for (size_t i = 0; i < length; i++) {
-        if (find_base32_index(hash[i]) == -1) {
+        unsigned char v = base32_lookup[(unsigned char)hash[i]];
+        if (v == 0) {
             return false;
         }
+        result = (result << BITS_PER_CHAR) | (uint64_t)(v - 1);
     }
+    *bits = result;
     return true;
 }
 
+static void bits_to_string(uint64_t bits, size_t length, char *out) {
+    for (size_t i = length; i-- > 0;) {
+        out[i] = BASE32_ALPHABET[bits & (BASE32_SIZE - 1)];
+        bits >>= BITS_PER_CHAR;
+    }
+    out[length] = '\0';
+}
+
+/* Copy a caller buffer into a freshly allocated GeoHash */
+static GeoHashError geohash_from_buffer(const char *buf, size_t length, GeoHash *result) {
+    result->hash = (char *)malloc(length + 1);
+    if (!result->hash) {
+        return GEOHASH_ERROR_ALLOCATION;
+    }
+    memcpy(result->hash, buf, length + 1);
+    result->length = length;
+    return GEOHASH_OK;
+}
+
 /* GeoPoint functions */
 GeoPoint geopoint_create(double latitude, double longitude) {
     GeoPoint point = {latitude, longitude};
@@ -120,8 +222,8 @@ const char* geohash_error_string(GeoHashError error) {
 }
 
 /* GeoHash encoding */
-GeoHashError geohash_encode(const GeoPoint *point, size_t precision, GeoHash *result) {
-    if (!point || !result) {
+GeoHashError geohash_encode_into(const GeoPoint *point, size_t precision, char *buf) {
+    if (!point || !buf) {
         return GEOHASH_ERROR_INVALID_POINT;
     }
     
@@ -132,58 +234,27 @@ GeoHashError geohash_encode(const GeoPoint *point, size_t precision, GeoHash *re
     if (precision == 0 || precision > GEOHASH_MAX_PRECISION) {
         return GEOHASH_ERROR_INVALID_PRECISION;
     }
+
+    unsigned lat_bits, lon_bits;
+    string_bit_counts(precision, &lat_bits, &lon_bits);
+    uint32_t lat = quantize(point->latitude, MIN_LATITUDE, MAX_LATITUDE, lat_bits);
+    uint32_t lon = quantize(point->longitude, MIN_LONGITUDE, MAX_LONGITUDE, lon_bits);
+    bits_to_string(string_bits_pack(lat, lon, precision), precision, buf);
     
-    result->hash = (char *)malloc(precision + 1);
-    if (!result->hash) {
-        return GEOHASH_ERROR_ALLOCATION;
+    return GEOHASH_OK;
+}
+
+GeoHashError geohash_encode(const GeoPoint *point, size_t precision, GeoHash *result) {
+    if (!result) {
+        return GEOHASH_ERROR_INVALID_POINT;
     }
-    
-    double min_lon = MIN_LONGITUDE;
-    double max_lon = MAX_LONGITUDE;
-    double min_lat = MIN_LATITUDE;
-    double max_lat = MAX_LATITUDE;
-    
-    int bit = 0;
-    int index = 0;
-    size_t char_count = 0;
-    bool is_even = true; /* Start with longitude */
-    
-    while (char_count < precision) {
-        if (is_even) {
-            /* Process longitude */
-            double mid = (min_lon + max_lon) / 2.0;
-            if (point->longitude >= mid) {
-                index = (index << 1) | 1;
-                min_lon = mid;
-            } else {
-                index = index << 1;
-                max_lon = mid;
-            }
-        } else {
-            /* Process latitude */
-            double mid = (min_lat + max_lat) / 2.0;
-            if (point->latitude >= mid) {
-                index = (index << 1) | 1;
-                min_lat = mid;
-            } else {
-                index = index << 1;
-                max_lat = mid;
-            }
-        }
-        
-        is_even = !is_even;
-        
-        if (++bit == BITS_PER_CHAR) {
-            result->hash[char_count++] = BASE32_ALPHABET[index];
-            index = 0;
-            bit = 0;
-        }
+
+    char buf[GEOHASH_MAX_PRECISION + 1];
+    GeoHashError error = geohash_encode_into(point, precision, buf);
+    if (error != GEOHASH_OK) {
+        return error;
     }
-    
-    result->hash[precision] = '\0';
-    result->length = precision;
-    
-    return GEOHASH_OK;
+    return geohash_from_buffer(buf, precision, result);
 }
 
 GeoHashError geohash_encode_default(const GeoPoint *point, GeoHash *result) {
@@ -191,57 +262,32 @@ GeoHashError geohash_encode_default(const GeoPoint *point, GeoHash *result) {
 }
 
 /* GeoHash decoding */
-GeoHashError geohash_get_bounds(const GeoHash *hash, GeoBounds *bounds) {
-    if (!hash || !hash->hash || !bounds) {
+GeoHashError geohash_bounds_of(const char *hash, size_t length, GeoBounds *bounds) {
+    uint64_t bits;
+    if (!bounds || !string_to_bits(hash, length, &bits)) {
         return GEOHASH_ERROR_INVALID_HASH;
     }
+
+    unsigned lat_bits, lon_bits;
+    uint32_t lat, lon;
+    string_bit_counts(length, &lat_bits, &lon_bits);
+    string_bits_unpack(bits, length, &lat, &lon);
+
+    double lat_size = (MAX_LATITUDE - MIN_LATITUDE) / (double)(1ULL << lat_bits);
+    double lon_size = (MAX_LONGITUDE - MIN_LONGITUDE) / (double)(1ULL << lon_bits);
+    bounds->min_latitude = MIN_LATITUDE + lat * lat_size;
+    bounds->max_latitude = MIN_LATITUDE + (lat + 1.0) * lat_size;
+    bounds->min_longitude = MIN_LONGITUDE + lon * lon_size;
+    bounds->max_longitude = MIN_LONGITUDE + (lon + 1.0) * lon_size;
     
-    if (!is_valid_geohash_string(hash->hash, hash->length)) {
+    return GEOHASH_OK;
+}
+
+GeoHashError geohash_get_bounds(const GeoHash *hash, GeoBounds *bounds) {
+    if (!hash || !hash->hash || !bounds) {
         return GEOHASH_ERROR_INVALID_HASH;
     }
-    
-    double min_lon = MIN_LONGITUDE;
-    double max_lon = MAX_LONGITUDE;
-    double min_lat = MIN_LATITUDE;
-    double max_lat = MAX_LATITUDE;
-    bool is_even = true;
-    
-    for (size_t i = 0; i < hash->length; i++) {
-        int char_index = find_base32_index(hash->hash[i]);
-        if (char_index == -1) {
-            return GEOHASH_ERROR_INVALID_HASH;
-        }
-        
-        for (int bit = BITS_PER_CHAR - 1; bit >= 0; bit--) {
-            int bit_value = GET_BIT(char_index, bit);
-            
-            if (is_even) {
-                /* Process longitude */
-                double mid = (min_lon + max_lon) / 2.0;
-                if (bit_value) {
-                    min_lon = mid;
-                } else {
-                    max_lon = mid;
-                }
-            } else {
-                /* Process latitude */
-                double mid = (min_lat + max_lat) / 2.0;
-                if (bit_value) {
-                    min_lat = mid;
-                } else {
-                    max_lat = mid;
-                }
-            }
-            is_even = !is_even;
-        }
-    }
-    
-    bounds->min_latitude = min_lat;
-    bounds->max_latitude = max_lat;
-    bounds->min_longitude = min_lon;
-    bounds->max_longitude = max_lon;
-    
-    return GEOHASH_OK;
+    return geohash_bounds_of(hash->hash, hash->length, bounds);
 }
 
 GeoHashError geohash_decode(const GeoHash *hash, GeoPoint *result) {
@@ -261,72 +307,48 @@ GeoHashError geohash_decode(const GeoHash *hash, GeoPoint *result) {
     return GEOHASH_OK;
 }
 
-/* GeoHash adjacency */
-GeoHashError geohash_get_adjacent(const GeoHash *hash, GeoDirection direction, GeoHash *result) {
-    if (!hash || !hash->hash || !result) {
-        return GEOHASH_ERROR_INVALID_HASH;
-    }
-    
-    if (!is_valid_geohash_string(hash->hash, hash->length)) {
+/* GeoHash adjacency: one cell over on the lat/lon grid, wrapping around at
+ * the edges in both directions */
+GeoHashError geohash_adjacent_into(const char *hash, size_t length, GeoDirection direction,
+                                   char *buf) {
+    uint64_t bits;
+    if (!buf || !string_to_bits(hash, length, &bits)) {
         return GEOHASH_ERROR_INVALID_HASH;
     }
     
     if (direction < GEOHASH_NORTH || direction > GEOHASH_WEST) {
         return GEOHASH_ERROR_INVALID_HASH;
     }
-    
-    size_t hash_len = hash->length;
-    char last_char = hash->hash[hash_len - 1];
-    int parity = hash_len % 2;
-    
-    /* Allocate memory for result */
-    result->hash = (char *)malloc(hash_len + 1);
-    if (!result->hash) {
-        return GEOHASH_ERROR_ALLOCATION;
-    }
-    
-    /* Copy parent hash (all but last character) */
-    if (hash_len > 1) {
-        memcpy(result->hash, hash->hash, hash_len - 1);
-    }
-    result->length = hash_len;
-    
-    /* Check if last character is on border */
-    if (find_char_index(last_char, border_map[direction][parity]) != -1 && hash_len > 1) {
-        /* Need to adjust parent */
-        GeoHash parent_hash = {NULL, hash_len - 1};
-        parent_hash.hash = (char *)malloc(hash_len);
-        if (!parent_hash.hash) {
-            free(result->hash);
-            return GEOHASH_ERROR_ALLOCATION;
-        }
-        memcpy(parent_hash.hash, hash->hash, hash_len - 1);
-        parent_hash.hash[hash_len - 1] = '\0';
-        
-        GeoHash adjacent_parent = geohash_create();
-        GeoHashError error = geohash_get_adjacent(&parent_hash, direction, &adjacent_parent);
-        free(parent_hash.hash);
-        
-        if (error != GEOHASH_OK) {
-            free(result->hash);
-            return error;
-        }
-        
-        memcpy(result->hash, adjacent_parent.hash, hash_len - 1);
-        geohash_free(&adjacent_parent);
+
+    unsigned lat_bits, lon_bits;
+    uint32_t lat, lon;
+    string_bit_counts(length, &lat_bits, &lon_bits);
+    string_bits_unpack(bits, length, &lat, &lon);
+
+    uint32_t lat_mask = (uint32_t)((1ULL << lat_bits) - 1);
+    uint32_t lon_mask = (uint32_t)((1ULL << lon_bits) - 1);
+    switch (direction) {
+        case GEOHASH_NORTH: lat = (lat + 1) & lat_mask; break;
+        case GEOHASH_SOUTH: lat = (lat - 1) & lat_mask; break;
+        case GEOHASH_EAST: lon = (lon + 1) & lon_mask; break;
+        case GEOHASH_WEST: lon = (lon - 1) & lon_mask; break;
     }
+    bits_to_string(string_bits_pack(lat, lon, length), length, buf);
     
-    /* Find new last character */
-    int new_char_index = find_char_index(last_char, adjacent_map[direction][parity]);
-    if (new_char_index == -1) {
-        free(result->hash);
+    return GEOHASH_OK;
+}
+
+GeoHashError geohash_get_adjacent(const GeoHash *hash, GeoDirection direction, GeoHash *result) {
+    if (!hash || !hash->hash || !result) {
         return GEOHASH_ERROR_INVALID_HASH;
     }
-    
-    result->hash[hash_len - 1] = BASE32_ALPHABET[new_char_index];
-    result->hash[hash_len] = '\0';
-    
-    return GEOHASH_OK;
+
+    char buf[GEOHASH_MAX_PRECISION + 1];
+    GeoHashError error = geohash_adjacent_into(hash->hash, hash->length, direction, buf);
+    if (error != GEOHASH_OK) {
+        return error;
+    }
+    return geohash_from_buffer(buf, hash->length, result);
 }
 
 GeoHashError geohash_get_all_adjacent(const GeoHash *hash, GeoAdjacent *result) {
@@ -380,3 +402,361 @@ void geoadjacent_free(GeoAdjacent *adjacent) {
     geohash_free(&adjacent->southeast);
     geohash_free(&adjacent->southwest);
 }
+
+/* Integer geohash helpers */
+static bool int_step_is_valid(uint8_t step) {
+    return step >= 1 && step <= GEOHASH_INT_MAX_STEP;
+}
+
+/* Integer geohash encoding/decoding */
+GeoHashError geohash_int_encode(const GeoPoint *point, uint8_t step, GeoHashBits *result) {
+    if (!point || !result) {
+        return GEOHASH_ERROR_INVALID_POINT;
+    }
+    /* Written so that NaN fails too */
+    if (!(point->latitude >= GEOHASH_LAT_MIN && point->latitude <= GEOHASH_LAT_MAX &&
+          point->longitude >= MIN_LONGITUDE && point->longitude <= MAX_LONGITUDE)) {
+        return GEOHASH_ERROR_INVALID_POINT;
+    }
+    if (!int_step_is_valid(step)) {
+        return GEOHASH_ERROR_INVALID_PRECISION;
+    }
+
+    uint32_t lat = quantize(point->latitude, GEOHASH_LAT_MIN, GEOHASH_LAT_MAX, step);
+    uint32_t lon = quantize(point->longitude, MIN_LONGITUDE, MAX_LONGITUDE, step);
+    result->bits = interleave(lat, lon);
+    result->step = step;
+    return GEOHASH_OK;
+}
+
+/* Batch encoding at GEOHASH_INT_MAX_STEP. The kernels do the same
+ * subtract, divide, multiply and truncate as quantize() so every lane yields
+ * exactly the scalar score; a block holding an invalid point is redone by the
+ * scalar loop, which finds where to stop. */
+#define BATCH_CELLS ((double)(1ULL << GEOHASH_INT_MAX_STEP))
+
+static size_t encode_batch_scalar(const GeoPoint *points, size_t n, uint64_t *out) {
+    for (size_t i = 0; i < n; i++) {
+        GeoHashBits hash;
+        if (geohash_int_encode(&points[i], GEOHASH_INT_MAX_STEP, &hash) != GEOHASH_OK) {
+            return i;
+        }
+        out[i] = hash.bits;
+    }
+    return n;
+}
+
+#if defined(GEOHASH_HAVE_AVX2_KERNELS)
+__attribute__((target("avx2"))) static __m256i spread_bits_avx2(__m128i v) {
+    __m256i x = _mm256_cvtepu32_epi64(v);
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 16)),
+                         _mm256_set1_epi64x(0x0000FFFF0000FFFFLL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 8)),
+                         _mm256_set1_epi64x(0x00FF00FF00FF00FFLL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 4)),
+                         _mm256_set1_epi64x(0x0F0F0F0F0F0F0F0FLL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 2)),
+                         _mm256_set1_epi64x(0x3333333333333333LL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 1)),
+                         _mm256_set1_epi64x(0x5555555555555555LL));
+    return x;
+}
+
+/* Cell indexes of four coordinates, or false if any is out of [min, max] */
+__attribute__((target("avx2"))) static bool quantize_avx2(__m256d v, double min, double max,
+                                                          __m128i *idx) {
+    __m256d lo = _mm256_set1_pd(min);
+    __m256d hi = _mm256_set1_pd(max);
+    __m256d ok = _mm256_and_pd(_mm256_cmp_pd(v, lo, _CMP_GE_OQ), _mm256_cmp_pd(v, hi, _CMP_LE_OQ));
+    if (_mm256_movemask_pd(ok) != 0xF) {
+        return false;
+    }
+    __m256d scaled = _mm256_mul_pd(_mm256_div_pd(_mm256_sub_pd(v, lo), _mm256_set1_pd(max - min)),
+                                   _mm256_set1_pd(BATCH_CELLS));
+    /* The upper edge belongs to the last cell */
+    *idx = _mm_min_epi32(_mm256_cvttpd_epi32(scaled),
+                         _mm_set1_epi32((1 << GEOHASH_INT_MAX_STEP) - 1));
+    return true;
+}
+
+__attribute__((target("avx2"))) static size_t encode_batch_avx2(const GeoPoint *points, size_t n,
+                                                                uint64_t *out) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        /* {lat, lon} pairs -> one vector per axis, in point order */
+        __m256d a = _mm256_loadu_pd(&points[i].latitude);
+        __m256d b = _mm256_loadu_pd(&points[i + 2].latitude);
+        __m256d lat = _mm256_permute4x64_pd(_mm256_unpacklo_pd(a, b), 0xD8);
+        __m256d lon = _mm256_permute4x64_pd(_mm256_unpackhi_pd(a, b), 0xD8);
+
+        __m128i lat_idx, lon_idx;
+        if (!quantize_avx2(lat, GEOHASH_LAT_MIN, GEOHASH_LAT_MAX, &lat_idx) ||
+            !quantize_avx2(lon, MIN_LONGITUDE, MAX_LONGITUDE, &lon_idx)) {
+            return i + encode_batch_scalar(points + i, n - i, out + i);
+        }
+        __m256i bits = _mm256_or_si256(spread_bits_avx2(lat_idx),
+                                       _mm256_slli_epi64(spread_bits_avx2(lon_idx), 1));
+        _mm256_storeu_si256((__m256i *)(out + i), bits);
+    }
+    return i + encode_batch_scalar(points + i, n - i, out + i);
+}
+#elif defined(GEOHASH_HAVE_NEON_KERNELS)
+static uint64x2_t spread_bits_neon(uint64x2_t x) {
+    x = vandq_u64(vorrq_u64(x, vshlq_n_u64(x, 16)), vdupq_n_u64(0x0000FFFF0000FFFFULL));
+    x = vandq_u64(vorrq_u64(x, vshlq_n_u64(x, 8)), vdupq_n_u64(0x00FF00FF00FF00FFULL));
+    x = vandq_u64(vorrq_u64(x, vshlq_n_u64(x, 4)), vdupq_n_u64(0x0F0F0F0F0F0F0F0FULL));
+    x = vandq_u64(vorrq_u64(x, vshlq_n_u64(x, 2)), vdupq_n_u64(0x3333333333333333ULL));
+    x = vandq_u64(vorrq_u64(x, vshlq_n_u64(x, 1)), vdupq_n_u64(0x5555555555555555ULL));
+    return x;
+}
+
+/* Cell indexes of two coordinates, or false if either is out of [min, max] */
+static bool quantize_neon(float64x2_t v, double min, double max, uint64x2_t *idx) {
+    float64x2_t lo = vdupq_n_f64(min);
+    uint64x2_t ok = vandq_u64(vcgeq_f64(v, lo), vcleq_f64(v, vdupq_n_f64(max)));
+    if ((vgetq_lane_u64(ok, 0) & vgetq_lane_u64(ok, 1)) == 0) {
+        return false;
+    }
+    float64x2_t scaled = vmulq_f64(vdivq_f64(vsubq_f64(v, lo), vdupq_n_f64(max - min)),
+                                   vdupq_n_f64(BATCH_CELLS));
+    uint64x2_t last = vdupq_n_u64((1ULL << GEOHASH_INT_MAX_STEP) - 1);
+    uint64x2_t cell = vcvtq_u64_f64(scaled);
+    /* The upper edge belongs to the last cell */
+    *idx = vbslq_u64(vcgtq_u64(cell, last), last, cell);
+    return true;
+}
+
+static size_t encode_batch_neon(const GeoPoint *points, size_t n, uint64_t *out) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        /* {lat, lon} pairs -> one vector per axis */
+        float64x2x2_t p = vld2q_f64(&points[i].latitude);
+        uint64x2_t lat_idx, lon_idx;
+        if (!quantize_neon(p.val[0], GEOHASH_LAT_MIN, GEOHASH_LAT_MAX, &lat_idx) ||
+            !quantize_neon(p.val[1], MIN_LONGITUDE, MAX_LONGITUDE, &lon_idx)) {
+            return i + encode_batch_scalar(points + i, n - i, out + i);
+        }
+        vst1q_u64(out + i, vorrq_u64(spread_bits_neon(lat_idx),
+                                     vshlq_n_u64(spread_bits_neon(lon_idx), 1)));
+    }
+    return i + encode_batch_scalar(points + i, n - i, out + i);
+}
+#endif
+
+size_t geohash_int_encode_batch(const GeoPoint *points, size_t n, uint64_t *out) {
+#if defined(GEOHASH_HAVE_AVX2_KERNELS)
+    if (__builtin_cpu_supports("avx2")) {
+        return encode_batch_avx2(points, n, out);
+    }
+#elif defined(GEOHASH_HAVE_NEON_KERNELS)
+    return encode_batch_neon(points, n, out);
+#endif
+    return encode_batch_scalar(points, n, out);
+}
+
+GeoHashError geohash_int_cell(GeoHashBits hash, GeoBounds *bounds) {
+    if (!bounds || !int_step_is_valid(hash.step)) {
+        return GEOHASH_ERROR_INVALID_HASH;
+    }
+
+    uint32_t lat, lon;
+    deinterleave(hash.bits, &lat, &lon);
+    double lat_size = (GEOHASH_LAT_MAX - GEOHASH_LAT_MIN) / (double)(1ULL << hash.step);
+    double lon_size = (MAX_LONGITUDE - MIN_LONGITUDE) / (double)(1ULL << hash.step);
+
+    bounds->min_latitude = GEOHASH_LAT_MIN + lat * lat_size;
+    bounds->max_latitude = GEOHASH_LAT_MIN + (lat + 1.0) * lat_size;
+    bounds->min_longitude = MIN_LONGITUDE + lon * lon_size;
+    bounds->max_longitude = MIN_LONGITUDE + (lon + 1.0) * lon_size;
+    return GEOHASH_OK;
+}
+
+GeoHashError geohash_int_decode(GeoHashBits hash, GeoPoint *result) {
+    if (!result) {
+        return GEOHASH_ERROR_INVALID_POINT;
+    }
+
+    GeoBounds bounds;
+    GeoHashError error = geohash_int_cell(hash, &bounds);
+    if (error != GEOHASH_OK) {
+        return error;
+    }
+
+    result->latitude = (bounds.min_latitude + bounds.max_latitude) / 2.0;
+    result->longitude = (bounds.min_longitude + bounds.max_longitude) / 2.0;
+    /* Rounding may push the center a hair past the limits */
+    if (result->latitude > GEOHASH_LAT_MAX) result->latitude = GEOHASH_LAT_MAX;
+    if (result->latitude < GEOHASH_LAT_MIN) result->latitude = GEOHASH_LAT_MIN;
+    if (result->longitude > MAX_LONGITUDE) result->longitude = MAX_LONGITUDE;
+    if (result->longitude < MIN_LONGITUDE) result->longitude = MIN_LONGITUDE;
+    return GEOHASH_OK;
+}
+
+bool geohash_int_move(GeoHashBits hash, int dx, int dy, GeoHashBits *result) {
+    if (!result || !int_step_is_valid(hash.step)) {
+        return false;
+    }
+
+    uint32_t lat, lon;
+    deinterleave(hash.bits, &lat, &lon);
+    int64_t y = (int64_t)lat + dy;
+    if (y < 0 || y >= (1LL << hash.step)) {
+        return false;
+    }
+
+    /* Step the longitude in place: filling the latitude bits with ones lets
+     * the carry ripple through the odd bits only, and the final mask wraps
+     * around the antimeridian */
+    uint64_t used = ~0ULL >> (64 - 2 * hash.step);
+    uint64_t x = hash.bits & LON_MASK;
+    uint64_t step_x = spread_bits((uint32_t)(dx < 0 ? -dx : dx)) << 1;
+    if (dx >= 0) {
+        x = (x | LAT_MASK) + step_x;
+    } else {
+        x = (x & LON_MASK) - step_x;
+    }
+    x &= LON_MASK & used;
+
+    result->bits = x | interleave((uint32_t)y, 0);
+    result->step = hash.step;
+    return true;
+}
+
+void geohash_int_score_range(GeoHashBits hash, double *min, double *max) {
+    int shift = 2 * (GEOHASH_INT_MAX_STEP - hash.step);
+    *min = (double)(hash.bits << shift);
+    *max = (double)((hash.bits + 1) << shift);
+}
+
+/* Distance and search areas */
+double geohash_distance(const GeoPoint *a, const GeoPoint *b) {
+    double lat1 = DEG_TO_RAD(a->latitude);
+    double lat2 = DEG_TO_RAD(b->latitude);
+    double u = sin((lat2 - lat1) / 2);
+    double v = sin(DEG_TO_RAD(b->longitude - a->longitude) / 2);
+    double h = u * u + cos(lat1) * cos(lat2) * v * v;
+    return 2.0 * GEOHASH_EARTH_RADIUS_M * asin(sqrt(h));
+}
+
+uint8_t geohash_int_estimate_step(double radius_m, double latitude) {
+    if (radius_m == 0) {
+        return GEOHASH_INT_MAX_STEP;
+    }
+    int step = 1;
+    while (radius_m < MERCATOR_MAX) {
+        radius_m *= 2;
+        step++;
+    }
+    /* One step coarser so most circles fit in the 3x3 block */
+    step -= 2;
+    /* Cells shrink in width towards the poles */
+    if (latitude > 66 || latitude < -66) {
+        step--;
+        if (latitude > 80 || latitude < -80) {
+            step--;
+        }
+    }
+    if (step < 1) step = 1;
+    if (step > GEOHASH_INT_MAX_STEP) step = GEOHASH_INT_MAX_STEP;
+    return (uint8_t)step;
+}
+
+/* Latitude/longitude box around `center`; the longitude span is taken at
+ * the edge nearer the pole, where it is widest */
+static void search_bounds(const GeoPoint *center, double width_m, double height_m,
+                          GeoBounds *bounds) {
+    double lat_delta = RAD_TO_DEG(height_m / 2 / GEOHASH_EARTH_RADIUS_M);
+    bounds->min_latitude = center->latitude - lat_delta;
+    bounds->max_latitude = center->latitude + lat_delta;
+    double edge = center->latitude < 0 ? bounds->min_latitude : bounds->max_latitude;
+    double lon_delta = RAD_TO_DEG(width_m / 2 / GEOHASH_EARTH_RADIUS_M / cos(DEG_TO_RAD(edge)));
+    bounds->min_longitude = center->longitude - lon_delta;
+    bounds->max_longitude = center->longitude + lon_delta;
+}
+
+/* Center cell and its eight neighbours; cells[i] is (dx, dy) = offsets[i] */
+static const int neighbour_offsets[9][2] = {
+    {0, 0}, {0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1}
+};
+
+static void search_cells(GeoHashBits center, GeoHashBits cells[9]) {
+    for (int i = 0; i < 9; i++) {
+        if (!geohash_int_move(center, neighbour_offsets[i][0], neighbour_offsets[i][1],
+                              &cells[i])) {
+            cells[i].bits = 0;
+            cells[i].step = 0;
+        }
+    }
+}
+
+GeoHashError geohash_int_search_area(const GeoPoint *center, double width_m,
+                                     double height_m, GeoSearchArea *area) {
+    if (!center || !area) {
+        return GEOHASH_ERROR_INVALID_POINT;
+    }
+
+    search_bounds(center, width_m, height_m, &area->bounds);
+    double radius_m = sqrt((width_m / 2) * (width_m / 2) + (height_m / 2) * (height_m / 2));
+    uint8_t step = geohash_int_estimate_step(radius_m, center->latitude);
+
+    GeoHashBits cells[9];
+    GeoBounds cell;
+    GeoHashError error;
+    for (;;) {
+        GeoHashBits hash;
+        if ((error = geohash_int_encode(center, step, &hash)) != GEOHASH_OK) {
+            return error;
+        }
+        search_cells(hash, cells);
+        if (step == 1) {
+            break;
+        }
+
+        /* Coarsen once more if the neighbours fall short of the box */
+        bool short_of_box = false;
+        GeoBounds n;
+        if (cells[1].step && geohash_int_cell(cells[1], &n) == GEOHASH_OK &&
+            n.max_latitude < area->bounds.max_latitude) short_of_box = true;
+        if (cells[2].step && geohash_int_cell(cells[2], &n) == GEOHASH_OK &&
+            n.min_latitude > area->bounds.min_latitude) short_of_box = true;
+        if (geohash_int_cell(cells[3], &n) == GEOHASH_OK &&
+            n.max_longitude < area->bounds.max_longitude) short_of_box = true;
+        if (geohash_int_cell(cells[4], &n) == GEOHASH_OK &&
+            n.min_longitude > area->bounds.min_longitude) short_of_box = true;
+        if (!short_of_box) {
+            break;
+        }
+        step--;
+    }
+
+    /* Skip the neighbours on a side the center cell already covers */
+    geohash_int_cell(cells[0], &cell);
+    if (step >= 2) {
+        for (int i = 1; i < 9; i++) {
+            int dx = neighbour_offsets[i][0];
+            int dy = neighbour_offsets[i][1];
+            if ((dy < 0 && cell.min_latitude < area->bounds.min_latitude) ||
+                (dy > 0 && cell.max_latitude > area->bounds.max_latitude) ||
+                (dx < 0 && cell.min_longitude < area->bounds.min_longitude) ||
+                (dx > 0 && cell.max_longitude > area->bounds.max_longitude)) {
+                cells[i].step = 0;
+            }
+        }
+    }
+
+    /* At coarse steps the wrapped neighbours can repeat */
+    area->count = 0;
+    for (int i = 0; i < 9; i++) {
+        if (!cells[i].step) {
+            continue;
+        }
+        bool seen = false;
+        for (size_t j = 0; j < area->count; j++) {
+            seen |= area->cells[j].bits == cells[i].bits;
+        }
+        if (!seen) {
+            area->cells[area->count++] = cells[i];
+        }
+    }
+    return GEOHASH_OK;
+}
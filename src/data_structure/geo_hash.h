@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Constants */
 #define GEOHASH_MAX_PRECISION 12
@@ -61,13 +62,19 @@ bool geopoint_is_valid(const GeoPoint *point);
 GeoHashError geohash_encode(const GeoPoint *point, size_t precision, GeoHash *result);
 GeoHashError geohash_encode_default(const GeoPoint *point, GeoHash *result);
 GeoHashError geohash_decode(const GeoHash *hash, GeoPoint *result);
+/* Allocation-free forms over caller buffers of at least precision + 1 bytes;
+ * the result is NUL-terminated */
+GeoHashError geohash_encode_into(const GeoPoint *point, size_t precision, char *buf);
 
 /* GeoHash bounds */
 GeoHashError geohash_get_bounds(const GeoHash *hash, GeoBounds *bounds);
+GeoHashError geohash_bounds_of(const char *hash, size_t length, GeoBounds *bounds);
 
 /* GeoHash adjacency */
 GeoHashError geohash_get_adjacent(const GeoHash *hash, GeoDirection direction, GeoHash *result);
 GeoHashError geohash_get_all_adjacent(const GeoHash *hash, GeoAdjacent *result);
+GeoHashError geohash_adjacent_into(const char *hash, size_t length, GeoDirection direction,
+                                   char *buf);
 
 /* GeoHash utility functions */
 GeoHash geohash_create(void);
@@ -78,4 +85,51 @@ const char* geohash_error_string(GeoHashError error);
 /* GeoAdjacent utility functions */
 void geoadjacent_free(GeoAdjacent *adjacent);
 
+/*
+ * Integer geohashes. A cell at `step` is the pair of step-bit lon/lat cell
+ * indexes interleaved into 2 * step bits, longitude first as in the string
+ * form. At GEOHASH_INT_MAX_STEP the 52 bits are exact in a double, which is
+ * how the GEO commands store a point as its sorted-set score. Latitude is
+ * limited to the Web Mercator range, as in Redis.
+ */
+#define GEOHASH_INT_MAX_STEP 26
+#define GEOHASH_LAT_MIN -85.05112878
+#define GEOHASH_LAT_MAX 85.05112878
+#define GEOHASH_EARTH_RADIUS_M 6372797.560856
+
+typedef struct {
+    uint64_t bits;
+    uint8_t step; /* 0 marks an unused cell */
+} GeoHashBits;
+
+/* Cells whose score ranges cover a search shape, plus the shape's bounds */
+typedef struct {
+    GeoHashBits cells[9]; /* center first, then neighbours; deduplicated */
+    size_t count;
+    GeoBounds bounds;
+} GeoSearchArea;
+
+GeoHashError geohash_int_encode(const GeoPoint *point, uint8_t step, GeoHashBits *result);
+/* Encode `n` points at GEOHASH_INT_MAX_STEP into `out`, several at a time
+ * where the CPU has vector units. Returns how many points were encoded
+ * before the first invalid one (n when all are valid). */
+size_t geohash_int_encode_batch(const GeoPoint *points, size_t n, uint64_t *out);
+GeoHashError geohash_int_cell(GeoHashBits hash, GeoBounds *bounds);
+/* Center of the cell */
+GeoHashError geohash_int_decode(GeoHashBits hash, GeoPoint *result);
+/* Cell `dx` columns east and `dy` rows north; longitude wraps around, false
+ * past the latitude limits */
+bool geohash_int_move(GeoHashBits hash, int dx, int dy, GeoHashBits *result);
+/* Scores [*min, *max) of every 52-bit point inside the cell */
+void geohash_int_score_range(GeoHashBits hash, double *min, double *max);
+
+/* Great-circle (haversine) distance in meters */
+double geohash_distance(const GeoPoint *a, const GeoPoint *b);
+/* Coarsest step whose cells are still at least `radius_m` wide at `latitude` */
+uint8_t geohash_int_estimate_step(double radius_m, double latitude);
+/* Cells to scan for a box of width_m x height_m around `center` (a radius r
+ * search is the 2r x 2r box, filtered by distance afterwards) */
+GeoHashError geohash_int_search_area(const GeoPoint *center, double width_m,
+                                     double height_m, GeoSearchArea *area);
+
 #endif /* GEO_HASH_H__ */
@@ -0,0 +1,535 @@
+#include "hyperloglog.h"
+#include "util/hash.h"
+#include "util/mem.h"
+#include "util/simd.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define HLL_HAVE_AVX2_KERNELS 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HLL_HAVE_NEON_KERNELS 1
+#endif
+
+#define HLL_HASH_SEED 0x5f3759df1badb002ULL
+/* Hash bits left for the rank once the register index is taken */
+#define HLL_Q (64 - HLL_P)
+#define HLL_ALPHA_INF 0.721347520444481703680 /* 1 / (2 ln 2) */
+#define HLL_SPARSE_INITIAL_CAP 8
+
+#define SPARSE_INDEX(e) ((e) >> HLL_BITS)
+#define SPARSE_VALUE(e) ((e) & HLL_REGISTER_MAX)
+#define SPARSE_ENTRY(i, v) ((uint32_t)(i) << HLL_BITS | (uint32_t)(v))
+
+/*
+ * Dense registers are unpacked to one byte each (`raw`) to be merged or
+ * histogrammed; the kernel folds a dense array into `raw` with a max.
+ */
+typedef void (*__dense_max_fn)(uint8_t *raw, const uint8_t *dense);
+static __dense_max_fn g_dense_max = NULL;
+static pthread_once_t g_kernels_once = PTHREAD_ONCE_INIT;
+
+/* private functions */
+static void __hash(const char *key, size_t len, uint32_t *index,
+                   uint8_t *rank);
+static __inline__ uint8_t __dense_get(const uint8_t *dense, uint32_t index);
+static __inline__ void __dense_set(uint8_t *dense, uint32_t index,
+                                   uint8_t value);
+static uint32_t __sparse_find(const HyperLogLog *hll, uint32_t index);
+static __inline__ bool __sparse_has(const HyperLogLog *hll, uint32_t pos,
+                                    uint32_t index);
+static bool __sparse_full(const HyperLogLog *hll, uint32_t pos,
+                          uint32_t index);
+static int __sparse_set(HyperLogLog *hll, uint32_t pos, uint32_t index,
+                        uint8_t rank);
+static int __promote(HyperLogLog *hll);
+static bool __valid_dense(const uint8_t *dense);
+static bool __valid_sparse(const uint32_t *sparse, uint32_t len);
+static void __raw_max(uint8_t *raw, const HyperLogLog *hll);
+static void __raw_pack(const uint8_t *raw, uint8_t *dense);
+static uint64_t __estimate_raw(const uint8_t *raw);
+static uint64_t __estimate(const uint32_t *histo);
+static double __sigma(double x);
+static double __tau(double x);
+static void __select_dense_kernels(void);
+static void __dense_max_groups(uint8_t *raw, const uint8_t *dense,
+                               uint32_t from);
+static void __dense_max_scalar(uint8_t *raw, const uint8_t *dense);
+
+HyperLogLog *hll_create(void) {
+  pthread_once(&g_kernels_once, __select_dense_kernels);
+  HyperLogLog *hll = mem_malloc(sizeof(HyperLogLog));
+  if (!hll) {
+    return NULL;
+  }
+  hll->encoding = HLL_SPARSE;
+  hll->card_valid = true;
+  hll->card = 0;
+  hll->sparse = NULL;
+  hll->sparse_len = 0;
+  hll->sparse_cap = 0;
+  hll->dense = NULL;
+  return hll;
+}
+
+void hll_destroy(HyperLogLog *hll) {
+  if (!hll) {
+    return;
+  }
+  mem_free(hll->sparse);
+  mem_free(hll->dense);
+  mem_free(hll);
+}
+
+HyperLogLog *hll_restore(const HyperLogLog *image) {
+  if ((image->encoding != HLL_SPARSE && image->encoding != HLL_DENSE) ||
+      image->sparse_len > HLL_SPARSE_MAX_ENTRIES) {
+    return NULL;
+  }
+  HyperLogLog *hll = hll_create();
+  if (!hll) {
+    return NULL;
+  }
+  hll->card_valid = false;
+  if (image->encoding == HLL_DENSE) {
+    hll->dense = mem_malloc(HLL_DENSE_BYTES + 1);
+    if (!hll->dense) {
+      hll_destroy(hll);
+      return NULL;
+    }
+    memcpy(hll->dense, image->dense, HLL_DENSE_BYTES);
+    hll->dense[HLL_DENSE_BYTES] = 0;
+    hll->encoding = HLL_DENSE;
+    if (!__valid_dense(hll->dense)) {
+      hll_destroy(hll);
+      return NULL;
+    }
+  } else if (image->sparse_len > 0) {
+    if (!__valid_sparse(image->sparse, image->sparse_len)) {
+      hll_destroy(hll);
+      return NULL;
+    }
+    hll->sparse = mem_malloc(image->sparse_len * sizeof(uint32_t));
+    if (!hll->sparse) {
+      hll_destroy(hll);
+      return NULL;
+    }
+    memcpy(hll->sparse, image->sparse, image->sparse_len * sizeof(uint32_t));
+    hll->sparse_len = hll->sparse_cap = image->sparse_len;
+  }
+  return hll;
+}
+
+int hll_add(HyperLogLog *hll, const char *key, size_t len) {
+  uint32_t index;
+  uint8_t rank;
+  __hash(key, len, &index, &rank);
+
+  if (hll->encoding == HLL_SPARSE) {
+    uint32_t pos = __sparse_find(hll, index);
+    if (!__sparse_full(hll, pos, index)) {
+      int rc = __sparse_set(hll, pos, index, rank);
+      if (rc == HLL_UPDATED) {
+        hll->card_valid = false;
+      }
+      return rc;
+    }
+    /* A new register would not fit: switch to dense and set it there */
+    if (__promote(hll) != HLL_OK) {
+      return HLL_ERR_OOM;
+    }
+  }
+
+  if (__dense_get(hll->dense, index) >= rank) {
+    return HLL_OK;
+  }
+  __dense_set(hll->dense, index, rank);
+  hll->card_valid = false;
+  return HLL_UPDATED;
+}
+
+uint64_t hll_count(HyperLogLog *hll) {
+  if (hll->card_valid) {
+    return hll->card;
+  }
+  if (hll->encoding == HLL_SPARSE) {
+    uint32_t histo[HLL_Q + 2] = {0};
+    histo[0] = HLL_REGISTERS - hll->sparse_len;
+    for (uint32_t i = 0; i < hll->sparse_len; i++) {
+      histo[SPARSE_VALUE(hll->sparse[i])]++;
+    }
+    hll->card = __estimate(histo);
+  } else {
+    uint8_t raw[HLL_REGISTERS] = {0};
+    g_dense_max(raw, hll->dense);
+    hll->card = __estimate_raw(raw);
+  }
+  hll->card_valid = true;
+  return hll->card;
+}
+
+uint64_t hll_count_union(const HyperLogLog *const *hlls, size_t n) {
+  uint8_t raw[HLL_REGISTERS] = {0};
+  for (size_t i = 0; i < n; i++) {
+    if (hlls[i]) {
+      __raw_max(raw, hlls[i]);
+    }
+  }
+  return __estimate_raw(raw);
+}
+
+int hll_merge(HyperLogLog *dest, const HyperLogLog *const *srcs, size_t n) {
+  uint8_t raw[HLL_REGISTERS] = {0};
+  __raw_max(raw, dest);
+  for (size_t i = 0; i < n; i++) {
+    if (srcs[i]) {
+      __raw_max(raw, srcs[i]);
+    }
+  }
+
+  if (dest->encoding == HLL_SPARSE) {
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < HLL_REGISTERS; i++) {
+      used += raw[i] != 0;
+    }
+    if (used <= HLL_SPARSE_MAX_ENTRIES) {
+      if (used > dest->sparse_cap) {
+        uint32_t *entries = mem_realloc(dest->sparse, used * sizeof(uint32_t));
+        if (!entries) {
+          return HLL_ERR_OOM;
+        }
+        dest->sparse = entries;
+        dest->sparse_cap = used;
+      }
+      dest->sparse_len = 0;
+      for (uint32_t i = 0; i < HLL_REGISTERS; i++) {
+        if (raw[i]) {
+          dest->sparse[dest->sparse_len++] = SPARSE_ENTRY(i, raw[i]);
+        }
+      }
+      dest->card_valid = false;
+      return HLL_OK;
+    }
+    uint8_t *dense = mem_calloc(HLL_DENSE_BYTES + 1, 1);
+    if (!dense) {
+      return HLL_ERR_OOM;
+    }
+    mem_free(dest->sparse);
+    dest->sparse = NULL;
+    dest->sparse_len = dest->sparse_cap = 0;
+    dest->dense = dense;
+    dest->encoding = HLL_DENSE;
+  }
+  __raw_pack(raw, dest->dense);
+  dest->card_valid = false;
+  return HLL_OK;
+}
+
+size_t hll_memory_usage(const HyperLogLog *hll) {
+  size_t size = sizeof(HyperLogLog);
+  if (hll->encoding == HLL_SPARSE) {
+    return size + hll->sparse_cap * sizeof(uint32_t);
+  }
+  return size + HLL_DENSE_BYTES + 1;
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static void __hash(const char *key, size_t len, uint32_t *index,
+                   uint8_t *rank) {
+  uint64_t h = hash_xxh64(key, len, HLL_HASH_SEED);
+  *index = (uint32_t)(h & (HLL_REGISTERS - 1));
+  /* Position of the first set bit in the remaining bits, 1-based; the
+   * sentinel caps it at HLL_Q + 1 */
+  *rank = (uint8_t)(__builtin_ctzll((h >> HLL_P) | (1ULL << HLL_Q)) + 1);
+}
+
+/* Register i occupies bits [6i, 6i + 6); the slack byte keeps the two-byte
+ * access of the last register in bounds */
+static __inline__ uint8_t __dense_get(const uint8_t *dense, uint32_t index) {
+  uint32_t bit = index * HLL_BITS;
+  const uint8_t *p = dense + (bit >> 3);
+  uint32_t word = p[0] | (uint32_t)p[1] << 8;
+  return (uint8_t)((word >> (bit & 7)) & HLL_REGISTER_MAX);
+}
+
+/* A rank is at most HLL_Q + 1: larger registers would overrun histograms */
+static bool __valid_dense(const uint8_t *dense) {
+  for (uint32_t i = 0; i < HLL_REGISTERS; i++) {
+    if (__dense_get(dense, i) > HLL_Q + 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Entries must name distinct registers in ascending order, with a rank */
+static bool __valid_sparse(const uint32_t *sparse, uint32_t len) {
+  uint32_t next = 0;
+  for (uint32_t i = 0; i < len; i++) {
+    uint32_t index = SPARSE_INDEX(sparse[i]);
+    uint32_t value = SPARSE_VALUE(sparse[i]);
+    if (index < next || index >= HLL_REGISTERS || value < 1 ||
+        value > HLL_Q + 1) {
+      return false;
+    }
+    next = index + 1;
+  }
+  return true;
+}
+
+static __inline__ void __dense_set(uint8_t *dense, uint32_t index,
+                                   uint8_t value) {
+  uint32_t bit = index * HLL_BITS;
+  uint8_t *p = dense + (bit >> 3);
+  uint32_t shift = bit & 7;
+  uint32_t word = p[0] | (uint32_t)p[1] << 8;
+  word = (word & ~((uint32_t)HLL_REGISTER_MAX << shift)) |
+         (uint32_t)value << shift;
+  p[0] = (uint8_t)word;
+  p[1] = (uint8_t)(word >> 8);
+}
+
+/* Position of the first entry whose index is >= `index` */
+static uint32_t __sparse_find(const HyperLogLog *hll, uint32_t index) {
+  uint32_t lo = 0, hi = hll->sparse_len;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (SPARSE_INDEX(hll->sparse[mid]) < index) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static __inline__ bool __sparse_has(const HyperLogLog *hll, uint32_t pos,
+                                    uint32_t index) {
+  return pos < hll->sparse_len && SPARSE_INDEX(hll->sparse[pos]) == index;
+}
+
+/* Setting `index` would need an entry past HLL_SPARSE_MAX_ENTRIES */
+static bool __sparse_full(const HyperLogLog *hll, uint32_t pos,
+                          uint32_t index) {
+  return !__sparse_has(hll, pos, index) &&
+         hll->sparse_len >= HLL_SPARSE_MAX_ENTRIES;
+}
+
+/* Raise register `index`, whose entry is at or would go to `pos` */
+static int __sparse_set(HyperLogLog *hll, uint32_t pos, uint32_t index,
+                        uint8_t rank) {
+  if (__sparse_has(hll, pos, index)) {
+    if (SPARSE_VALUE(hll->sparse[pos]) >= rank) {
+      return HLL_OK;
+    }
+    hll->sparse[pos] = SPARSE_ENTRY(index, rank);
+    return HLL_UPDATED;
+  }
+  if (hll->sparse_len == hll->sparse_cap) {
+    uint32_t cap = hll->sparse_cap ? hll->sparse_cap * 2 : HLL_SPARSE_INITIAL_CAP;
+    if (cap > HLL_SPARSE_MAX_ENTRIES) {
+      cap = HLL_SPARSE_MAX_ENTRIES;
+    }
+    uint32_t *entries = mem_realloc(hll->sparse, cap * sizeof(uint32_t));
+    if (!entries) {
+      return HLL_ERR_OOM;
+    }
+    hll->sparse = entries;
+    hll->sparse_cap = cap;
+  }
+  memmove(hll->sparse + pos + 1, hll->sparse + pos,
+          (hll->sparse_len - pos) * sizeof(uint32_t));
+  hll->sparse[pos] = SPARSE_ENTRY(index, rank);
+  hll->sparse_len++;
+  return HLL_UPDATED;
+}
+
+static int __promote(HyperLogLog *hll) {
+  uint8_t *dense = mem_calloc(HLL_DENSE_BYTES + 1, 1);
+  if (!dense) {
+    return HLL_ERR_OOM;
+  }
+  for (uint32_t i = 0; i < hll->sparse_len; i++) {
+    __dense_set(dense, SPARSE_INDEX(hll->sparse[i]),
+                (uint8_t)SPARSE_VALUE(hll->sparse[i]));
+  }
+  mem_free(hll->sparse);
+  hll->sparse = NULL;
+  hll->sparse_len = hll->sparse_cap = 0;
+  hll->dense = dense;
+  hll->encoding = HLL_DENSE;
+  return HLL_OK;
+}
+
+static void __raw_max(uint8_t *raw, const HyperLogLog *hll) {
+  if (hll->encoding == HLL_DENSE) {
+    g_dense_max(raw, hll->dense);
+    return;
+  }
+  for (uint32_t i = 0; i < hll->sparse_len; i++) {
+    uint32_t index = SPARSE_INDEX(hll->sparse[i]);
+    uint8_t value = (uint8_t)SPARSE_VALUE(hll->sparse[i]);
+    if (raw[index] < value) {
+      raw[index] = value;
+    }
+  }
+}
+
+/* Four registers per three bytes */
+static void __raw_pack(const uint8_t *raw, uint8_t *dense) {
+  for (uint32_t g = 0; g < HLL_REGISTERS / 4; g++) {
+    const uint8_t *r = raw + 4 * g;
+    uint32_t word = r[0] | (uint32_t)r[1] << 6 | (uint32_t)r[2] << 12 |
+                    (uint32_t)r[3] << 18;
+    dense[3 * g] = (uint8_t)word;
+    dense[3 * g + 1] = (uint8_t)(word >> 8);
+    dense[3 * g + 2] = (uint8_t)(word >> 16);
+  }
+}
+
+static uint64_t __estimate_raw(const uint8_t *raw) {
+  uint32_t histo[HLL_Q + 2] = {0};
+  for (uint32_t i = 0; i < HLL_REGISTERS; i++) {
+    histo[raw[i]]++;
+  }
+  return __estimate(histo);
+}
+
+/* Ertl's improved raw estimator, from the register value histogram */
+static uint64_t __estimate(const uint32_t *histo) {
+  double m = HLL_REGISTERS;
+  double z = m * __tau((m - histo[HLL_Q + 1]) / m);
+  for (int j = HLL_Q; j >= 1; j--) {
+    z += histo[j];
+    z *= 0.5;
+  }
+  z += m * __sigma(histo[0] / m);
+  return (uint64_t)llroundl(HLL_ALPHA_INF * m * m / z);
+}
+
+static double __sigma(double x) {
+  if (x == 1.) {
+    return INFINITY;
+  }
+  double prev, y = 1, z = x;
+  do {
+    x *= x;
+    prev = z;
+    z += x * y;
+    y += y;
+  } while (prev != z);
+  return z;
+}
+
+static double __tau(double x) {
+  if (x == 0. || x == 1.) {
+    return 0.;
+  }
+  double prev, y = 1, z = 1 - x;
+  do {
+    x = sqrt(x);
+    prev = z;
+    y *= 0.5;
+    z -= (1 - x) * (1 - x) * y;
+  } while (prev != z);
+  return z / 3;
+}
+
+/*
+ * Unpacking spreads each group of three bytes (four registers) over a 32-bit
+ * word, then shifts registers 1..3 up to their own byte:
+ *   r = (w & 0x3f) | (w << 2 & 0x3f00) | (w << 4 & 0x3f0000) | (w << 6 & ...)
+ * The vector kernels do that for 8 (AVX2) or 4 (NEON) groups at a time and
+ * finish with a byte-wise max; the scalar loop handles the tail.
+ */
+static void __dense_max_groups(uint8_t *raw, const uint8_t *dense,
+                               uint32_t from) {
+  for (uint32_t g = from; g < HLL_REGISTERS / 4; g++) {
+    const uint8_t *p = dense + 3 * g;
+    uint32_t word = p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+    for (int j = 0; j < 4; j++) {
+      uint8_t value = (uint8_t)((word >> (HLL_BITS * j)) & HLL_REGISTER_MAX);
+      if (raw[4 * g + j] < value) {
+        raw[4 * g + j] = value;
+      }
+    }
+  }
+}
+
+static void __dense_max_scalar(uint8_t *raw, const uint8_t *dense) {
+  __dense_max_groups(raw, dense, 0);
+}
+
+#if defined(HLL_HAVE_AVX2_KERNELS)
+__attribute__((target("avx2"))) static void
+__dense_max_avx2(uint8_t *raw, const uint8_t *dense) {
+  const __m256i spread =
+      _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0,
+                       1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m256i m0 = _mm256_set1_epi32(0x3f);
+  const __m256i m1 = _mm256_set1_epi32(0x3f00);
+  const __m256i m2 = _mm256_set1_epi32(0x3f0000);
+  const __m256i m3 = _mm256_set1_epi32(0x3f000000);
+  uint32_t g = 0;
+  /* Each half loads 16 bytes and uses 12 */
+  for (; 3 * g + 28 <= HLL_DENSE_BYTES; g += 8) {
+    const uint8_t *p = dense + 3 * g;
+    __m256i bytes = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+        _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+    __m256i w = _mm256_shuffle_epi8(bytes, spread);
+    __m256i r = _mm256_or_si256(
+        _mm256_or_si256(_mm256_and_si256(w, m0),
+                        _mm256_and_si256(_mm256_slli_epi32(w, 2), m1)),
+        _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(w, 4), m2),
+                        _mm256_and_si256(_mm256_slli_epi32(w, 6), m3)));
+    __m256i *out = (__m256i *)(raw + 4 * g);
+    _mm256_storeu_si256(out, _mm256_max_epu8(_mm256_loadu_si256(out), r));
+  }
+  __dense_max_groups(raw, dense, g);
+}
+#endif
+
+#if defined(HLL_HAVE_NEON_KERNELS)
+static void __dense_max_neon(uint8_t *raw, const uint8_t *dense) {
+  static const uint8_t spread_idx[16] = {0, 1, 2,  0xff, 3, 4,  5,  0xff,
+                                         6, 7, 8,  0xff, 9, 10, 11, 0xff};
+  const uint8x16_t spread = vld1q_u8(spread_idx);
+  const uint32x4_t m0 = vdupq_n_u32(0x3f);
+  const uint32x4_t m1 = vdupq_n_u32(0x3f00);
+  const uint32x4_t m2 = vdupq_n_u32(0x3f0000);
+  const uint32x4_t m3 = vdupq_n_u32(0x3f000000);
+  uint32_t g = 0;
+  for (; 3 * g + 16 <= HLL_DENSE_BYTES; g += 4) {
+    uint32x4_t w =
+        vreinterpretq_u32_u8(vqtbl1q_u8(vld1q_u8(dense + 3 * g), spread));
+    uint32x4_t r =
+        vorrq_u32(vorrq_u32(vandq_u32(w, m0), vandq_u32(vshlq_n_u32(w, 2), m1)),
+                  vorrq_u32(vandq_u32(vshlq_n_u32(w, 4), m2),
+                            vandq_u32(vshlq_n_u32(w, 6), m3)));
+    uint8_t *out = raw + 4 * g;
+    vst1q_u8(out, vmaxq_u8(vld1q_u8(out), vreinterpretq_u8_u32(r)));
+  }
+  __dense_max_groups(raw, dense, g);
+}
+#endif
+
+/* Run through g_kernels_once, see util/simd.h */
+static void __select_dense_kernels(void) {
+  g_dense_max = __dense_max_scalar;
+#if defined(HLL_HAVE_AVX2_KERNELS)
+  if (simd_level() == SIMD_AVX2) {
+    g_dense_max = __dense_max_avx2;
+  }
+#elif defined(HLL_HAVE_NEON_KERNELS)
+  if (simd_level() == SIMD_NEON) {
+    g_dense_max = __dense_max_neon;
+  }
+#endif
+}
@@ -0,0 +1,109 @@
+/**
+ * @file hyperloglog.h
+ * @brief HyperLogLog cardinality estimator with sparse and dense encodings
+ *
+ * HLL_REGISTERS 6-bit registers give a standard error of about 0.81%. A new
+ * HyperLogLog starts sparse: only the non-zero registers are kept, as a
+ * sorted array of (index, value) entries. Past HLL_SPARSE_MAX_ENTRIES it is
+ * promoted, once, to the dense encoding: every register packed into
+ * HLL_DENSE_BYTES bytes.
+ *
+ * The estimate is computed with the improved estimator of Ertl ("New
+ * cardinality estimation algorithms for HyperLogLog sketches"), which needs no
+ * empirical bias correction, and is cached until the next write.
+ */
+
+#ifndef REDIS_C_HYPERLOGLOG_H__
+#define REDIS_C_HYPERLOGLOG_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @defgroup HLL_Status Status Codes
+ * @{
+ */
+#define HLL_OK       0
+#define HLL_UPDATED  1  /**< hll_add: a register changed */
+#define HLL_ERR_OOM  -1
+/** @} */
+
+#define HLL_P            14
+#define HLL_REGISTERS    (1 << HLL_P)
+#define HLL_BITS         6
+#define HLL_REGISTER_MAX ((1 << HLL_BITS) - 1)
+#define HLL_DENSE_BYTES  (HLL_REGISTERS * HLL_BITS / 8)
+/**
+ * @brief Sparse entries kept before promoting to dense (4 bytes each)
+ */
+#define HLL_SPARSE_MAX_ENTRIES 750
+
+/**
+ * @defgroup HLL_Encoding Encodings
+ * @{
+ */
+#define HLL_SPARSE 0
+#define HLL_DENSE  1
+/** @} */
+
+typedef struct {
+    uint8_t encoding;
+    bool card_valid;      /**< `card` matches the registers */
+    uint64_t card;
+    uint32_t *sparse;     /**< Sorted (index << HLL_BITS | value) entries */
+    uint32_t sparse_len;
+    uint32_t sparse_cap;
+    uint8_t *dense;       /**< HLL_DENSE_BYTES (+1 slack) packed registers */
+} HyperLogLog;
+
+/**
+ * @brief Create an empty, sparse HyperLogLog; NULL when out of memory
+ */
+HyperLogLog *hll_create(void);
+void hll_destroy(HyperLogLog *hll);
+
+/**
+ * @brief Rebuild a saved HyperLogLog from `image`: its sparse_len entries or
+ *        HLL_DENSE_BYTES registers are copied (they may point into a mapped
+ *        snapshot); NULL on an invalid encoding, a register out of range,
+ *        unordered sparse entries, or out of memory
+ */
+HyperLogLog *hll_restore(const HyperLogLog *image);
+
+/**
+ * @brief Observe one element
+ * @return HLL_UPDATED if a register changed, HLL_OK if not, HLL_ERR_OOM
+ */
+int hll_add(HyperLogLog *hll, const char *key, size_t len);
+
+/**
+ * @brief Estimated number of distinct elements added
+ */
+uint64_t hll_count(HyperLogLog *hll);
+
+/**
+ * @brief Estimated cardinality of the union of `n` HyperLogLogs; none are
+ *        modified. NULL entries count as empty.
+ */
+uint64_t hll_count_union(const HyperLogLog *const *hlls, size_t n);
+
+/**
+ * @brief Fold `n` HyperLogLogs into `dest` (register-wise max). `dest` ends up
+ *        dense unless every input, including `dest`, is sparse and the union
+ *        still fits. NULL entries are skipped.
+ * @return HLL_OK or HLL_ERR_OOM (dest unchanged)
+ */
+int hll_merge(HyperLogLog *dest, const HyperLogLog *const *srcs, size_t n);
+
+size_t hll_memory_usage(const HyperLogLog *hll);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // REDIS_C_HYPERLOGLOG_H__
@@ -1,4 +1,5 @@
 #include "skip_list.h"
+#include "util/mem.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
@@ -8,26 +9,57 @@
 #define MAX_LEVEL 32
 #define P_VALUE 0.25  // Lower P = flatter tree = better cache performance
 
-// Node structure with flexible array member
+// Node pool: levels 1..POOL_LEVELS (99.6% of nodes at P=0.25) are carved out
+// of per-level slabs; the rare taller nodes use malloc. Slabs start small so
+// tiny lists stay tiny, and double up to POOL_MAX_SLAB_BYTES.
+#define POOL_LEVELS 4
+#define POOL_MIN_SLAB_NODES 8
+#define POOL_MAX_SLAB_BYTES (64 * 1024)
+
+// Node structure with flexible array member. `span` counts the level-0 hops a
+// forward link skips, which is what makes rank queries O(log n). `key` is
+// only filled when the list has a KeyFunc.
 struct SkipListNode {
+    SkipListKey key;
     void* value;
+    SkipListNode* backward; // level-0 predecessor, NULL for the first node
     int level;
-    SkipListNode* next[1]; // Flexible array member
+    struct {
+        SkipListNode* next;
+        size_t span;
+    } levels[1]; // Flexible array member
 };
 
+typedef struct Slab {
+    struct Slab* next;
+    size_t pad; // nodes start at malloc alignment
+} Slab;
+
+typedef struct {
+    SkipListNode* free; // chained through levels[0].next
+    size_t slab_nodes;  // size of the next slab
+} PoolBucket;
+
 // SkipList structure
 struct SkipList {
     SkipListNode* head;
+    SkipListNode* tail;
+    size_t length;
     int current_max_level;
     CompareFunc compare;
     FreeFunc free_value;
     CopyFunc copy_value;
+    KeyFunc key_of;
+
+    PoolBucket pool[POOL_LEVELS];
+    Slab* slabs;
     
     // Fast random state (LCG)
     uint32_t rng_state;
     
     // Reusable update cache
     SkipListNode* update_cache[MAX_LEVEL];
+    size_t rank_cache[MAX_LEVEL];
 };
 
 // ===== Internal Helper Functions =====
@@ -53,55 +85,148 @@ static inline int random_level(SkipList* list) {
     return level;
 }
 
+static inline size_t node_size(int level) {
+    return sizeof(SkipListNode) + (level - 1) * sizeof(((SkipListNode*)0)->levels[0]);
+}
+
+// Take a node of `level` from its slab bucket, growing the bucket if empty
+static SkipListNode* pool_alloc(SkipList* list, int level) {
+    if (level > POOL_LEVELS) {
+        return (SkipListNode*)mem_malloc(node_size(level));
+    }
+
+    PoolBucket* bucket = &list->pool[level - 1];
+    if (!bucket->free) {
+        size_t stride = node_size(level);
+        size_t count = bucket->slab_nodes;
+        Slab* slab = (Slab*)mem_malloc(sizeof(Slab) + count * stride);
+        if (!slab) {
+            return NULL;
+        }
+        slab->next = list->slabs;
+        list->slabs = slab;
+
+        // Thread the new nodes onto the free list, first node on top
+        char* base = (char*)(slab + 1);
+        for (size_t i = count; i-- > 0;) {
+            SkipListNode* node = (SkipListNode*)(base + i * stride);
+            node->levels[0].next = bucket->free;
+            bucket->free = node;
+        }
+        if (bucket->slab_nodes * 2 * stride <= POOL_MAX_SLAB_BYTES) {
+            bucket->slab_nodes *= 2;
+        }
+    }
+
+    SkipListNode* node = bucket->free;
+    bucket->free = node->levels[0].next;
+    return node;
+}
+
+static void pool_free(SkipList* list, SkipListNode* node) {
+    if (node->level > POOL_LEVELS) {
+        mem_free(node);
+        return;
+    }
+    PoolBucket* bucket = &list->pool[node->level - 1];
+    node->levels[0].next = bucket->free;
+    bucket->free = node;
+}
+
 // Create a new node with specified level
-static SkipListNode* node_create(void* value, int level) {
-    // Allocate space for node + additional next pointers
-    size_t node_size = sizeof(SkipListNode) + (level - 1) * sizeof(SkipListNode*);
-    SkipListNode* node = (SkipListNode*)malloc(node_size);
-    
+static SkipListNode* node_create(SkipList* list, void* value, int level) {
+    SkipListNode* node = pool_alloc(list, level);
     if (!node) {
         return NULL;
     }
-    
+
+    if (list->key_of) {
+        list->key_of(value, &node->key);
+    }
     node->value = value;
+    node->backward = NULL;
     node->level = level;
-    memset(node->next, 0, level * sizeof(SkipListNode*));
+    memset(node->levels, 0, level * sizeof(node->levels[0]));
     
     return node;
 }
 
-// Free a node
-static void node_destroy(SkipListNode* node, FreeFunc free_value) {
-    if (node && free_value) {
-        free_value(node->value);
+// Inline key of the search target, NULL when the list has no KeyFunc
+static inline const SkipListKey* probe_key(const SkipList* list, const void* value,
+                                           SkipListKey* key) {
+    if (!list->key_of) {
+        return NULL;
     }
-    free(node);
+    list->key_of(value, key);
+    return key;
+}
+
+// Order `node` against the search target. The inline key settles most
+// comparisons without touching the value; CompareFunc breaks the ties.
+static inline int node_compare(const SkipList* list, const SkipListNode* node,
+                               const void* value, const SkipListKey* key) {
+    if (key) {
+        if (node->key.score != key->score) {
+            return node->key.score < key->score ? -1 : 1;
+        }
+        if (node->key.prefix != key->prefix) {
+            return node->key.prefix < key->prefix ? -1 : 1;
+        }
+    }
+    return list->compare(node->value, value);
 }
 
 // ===== Public API =====
 
+uint64_t skiplist_key_prefix(const void* bytes, size_t len) {
+    unsigned char buf[8] = {0};
+    memcpy(buf, bytes, len < sizeof(buf) ? len : sizeof(buf));
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        prefix = (prefix << 8) | buf[i];
+    }
+    return prefix;
+}
+
 // Create a new skip list
 SkipList* skiplist_create(CompareFunc compare, FreeFunc free_value, CopyFunc copy_value) {
+    return skiplist_create_keyed(compare, free_value, copy_value, NULL);
+}
+
+SkipList* skiplist_create_keyed(CompareFunc compare, FreeFunc free_value,
+                                CopyFunc copy_value, KeyFunc key_of) {
     if (!compare) {
         return NULL;
     }
     
-    SkipList* list = (SkipList*)malloc(sizeof(SkipList));
+    SkipList* list = (SkipList*)mem_malloc(sizeof(SkipList));
     if (!list) {
         return NULL;
     }
     
-    // Initialize head node
-    list->head = node_create(NULL, MAX_LEVEL);
+    // Initialize head node (never pooled, it has every level)
+    list->head = (SkipListNode*)mem_malloc(node_size(MAX_LEVEL));
     if (!list->head) {
-        free(list);
+        mem_free(list);
         return NULL;
     }
+    list->head->value = NULL;
+    list->head->backward = NULL;
+    list->head->level = MAX_LEVEL;
+    memset(list->head->levels, 0, MAX_LEVEL * sizeof(list->head->levels[0]));
     
+    list->tail = NULL;
+    list->length = 0;
     list->current_max_level = 1;
     list->compare = compare;
     list->free_value = free_value;
     list->copy_value = copy_value;
+    list->key_of = key_of;
+    for (int i = 0; i < POOL_LEVELS; i++) {
+        list->pool[i].free = NULL;
+        list->pool[i].slab_nodes = POOL_MIN_SLAB_NODES;
+    }
+    list->slabs = NULL;
     
     // Initialize RNG with time-based seed + address entropy
     list->rng_state = (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)list;
@@ -118,14 +243,27 @@ void skiplist_destroy(SkipList* list) {
         return;
     }
     
-    SkipListNode* current = list->head;
+    // Pooled nodes go away with their slabs; only values and tall nodes
+    // need a walk
+    SkipListNode* current = list->head->levels[0].next;
     while (current) {
-        SkipListNode* next = current->next[0];
-        node_destroy(current, current == list->head ? NULL : list->free_value);
+        SkipListNode* next = current->levels[0].next;
+        if (list->free_value) {
+            list->free_value(current->value);
+        }
+        if (current->level > POOL_LEVELS) {
+            mem_free(current);
+        }
         current = next;
     }
+    while (list->slabs) {
+        Slab* next = list->slabs->next;
+        mem_free(list->slabs);
+        list->slabs = next;
+    }
     
-    free(list);
+    mem_free(list->head);
+    mem_free(list);
 }
 
 // Search for a value with optimized loop
@@ -134,13 +272,15 @@ bool skiplist_contain(const SkipList* list, const void* value) {
         return false;
     }
     
+    SkipListKey probe;
+    const SkipListKey* key = probe_key(list, value, &probe);
     SkipListNode* current = list->head;
     
     // Unroll search loop slightly for better branch prediction
     for (int level = list->current_max_level - 1; level >= 0; level--) {
-        while (current->next[level]) {
-            SkipListNode* next = current->next[level];
-            int cmp = list->compare(next->value, value);
+        while (current->levels[level].next) {
+            SkipListNode* next = current->levels[level].next;
+            int cmp = node_compare(list, next, value, key);
             
             if (cmp < 0) {
                 current = next;
@@ -161,15 +301,21 @@ bool skiplist_insert(SkipList* list, void* value) {
         return false;
     }
     
+    SkipListKey probe;
+    const SkipListKey* key = probe_key(list, value, &probe);
     SkipListNode* current = list->head;
     
-    // Combined search and predecessor tracking
+    // Combined search and predecessor tracking; rank_cache[level] is the rank
+    // of update_cache[level]
     for (int level = list->current_max_level - 1; level >= 0; level--) {
-        while (current->next[level]) {
-            SkipListNode* next = current->next[level];
-            int cmp = list->compare(next->value, value);
+        list->rank_cache[level] =
+            level == list->current_max_level - 1 ? 0 : list->rank_cache[level + 1];
+        while (current->levels[level].next) {
+            SkipListNode* next = current->levels[level].next;
+            int cmp = node_compare(list, next, value, key);
             
             if (cmp < 0) {
+                list->rank_cache[level] += current->levels[level].span;
                 current = next;
             } else if (cmp == 0) {
                 return false;  // Duplicate found
@@ -185,7 +331,9 @@ bool skiplist_insert(SkipList* list, void* value) {
     // If new level exceeds current max, initialize higher levels
     if (new_level > list->current_max_level) {
         for (int level = list->current_max_level; level < new_level; level++) {
+            list->rank_cache[level] = 0;
             list->update_cache[level] = list->head;
+            list->head->levels[level].span = list->length;
         }
         list->current_max_level = new_level;
     }
@@ -199,7 +347,7 @@ bool skiplist_insert(SkipList* list, void* value) {
         }
     }
     
-    SkipListNode* new_node = node_create(node_value, new_level);
+    SkipListNode* new_node = node_create(list, node_value, new_level);
     if (!new_node) {
         if (list->copy_value && list->free_value) {
             list->free_value(node_value);
@@ -207,68 +355,342 @@ bool skiplist_insert(SkipList* list, void* value) {
         return false;
     }
     
-    // Link new node - unroll first few iterations for better performance
-    if (new_level >= 1) {
-        new_node->next[0] = list->update_cache[0]->next[0];
-        list->update_cache[0]->next[0] = new_node;
+    // Link the new node and split the spans of its predecessors
+    for (int level = 0; level < new_level; level++) {
+        SkipListNode* prev = list->update_cache[level];
+        size_t skipped = list->rank_cache[0] - list->rank_cache[level];
+        new_node->levels[level].next = prev->levels[level].next;
+        prev->levels[level].next = new_node;
+        new_node->levels[level].span = prev->levels[level].span - skipped;
+        prev->levels[level].span = skipped + 1;
     }
-    if (new_level >= 2) {
-        new_node->next[1] = list->update_cache[1]->next[1];
-        list->update_cache[1]->next[1] = new_node;
+    // Links above the new node now jump over one more node
+    for (int level = new_level; level < list->current_max_level; level++) {
+        list->update_cache[level]->levels[level].span++;
     }
-    for (int level = 2; level < new_level; level++) {
-        new_node->next[level] = list->update_cache[level]->next[level];
-        list->update_cache[level]->next[level] = new_node;
+    
+    new_node->backward =
+        list->update_cache[0] == list->head ? NULL : list->update_cache[0];
+    if (new_node->levels[0].next) {
+        new_node->levels[0].next->backward = new_node;
+    } else {
+        list->tail = new_node;
     }
+    list->length++;
     
     return true;
 }
 
+// Find `value` and fill update_cache with its predecessors
+static SkipListNode* find_for_erase(SkipList* list, const void* value) {
+    SkipListKey probe;
+    const SkipListKey* key = probe_key(list, value, &probe);
+    SkipListNode* current = list->head;
+    bool found = false;
+
+    for (int level = list->current_max_level - 1; level >= 0; level--) {
+        while (current->levels[level].next) {
+            SkipListNode* next = current->levels[level].next;
+            int cmp = node_compare(list, next, value, key);
+
+            if (cmp < 0) {
+                current = next;
+            } else {
+                found |= cmp == 0;
+                break;
+            }
+        }
+        list->update_cache[level] = current;
+    }
+
+    return found ? list->update_cache[0]->levels[0].next : NULL;
+}
+
+// Unlink a node found by find_for_erase
+static void unlink_node(SkipList* list, SkipListNode* node) {
+    for (int level = 0; level < list->current_max_level; level++) {
+        SkipListNode* prev = list->update_cache[level];
+        if (prev->levels[level].next == node) {
+            prev->levels[level].span += node->levels[level].span - 1;
+            prev->levels[level].next = node->levels[level].next;
+        } else {
+            prev->levels[level].span--;
+        }
+    }
+
+    if (node->levels[0].next) {
+        node->levels[0].next->backward = node->backward;
+    } else {
+        list->tail = node->backward;
+    }
+
+    // Update current max level
+    while (list->current_max_level > 1 &&
+           list->head->levels[list->current_max_level - 1].next == NULL) {
+        list->current_max_level--;
+    }
+    list->length--;
+}
+
 // Delete a value
 bool skiplist_erase(SkipList* list, const void* value) {
+    void* removed = skiplist_unlink(list, value);
+    if (!removed) {
+        return false;
+    }
+    if (list->free_value) {
+        list->free_value(removed);
+    }
+    return true;
+}
+
+// Remove a value and hand it to the caller instead of freeing it
+void* skiplist_unlink(SkipList* list, const void* value) {
     if (!list || !value) {
+        return NULL;
+    }
+
+    SkipListNode* node = find_for_erase(list, value);
+    if (!node) {
+        return NULL;
+    }
+    unlink_node(list, node);
+
+    void* removed = node->value;
+    pool_free(list, node);
+    return removed;
+}
+
+// Free every node built so far after a failed build; values that were not
+// copied still belong to the caller
+static void abandon_build(SkipList* list) {
+    SkipListNode* current = list->head->levels[0].next;
+    while (current) {
+        SkipListNode* next = current->levels[0].next;
+        if (list->copy_value && list->free_value) {
+            list->free_value(current->value);
+        }
+        pool_free(list, current);
+        current = next;
+    }
+    memset(list->head->levels, 0, MAX_LEVEL * sizeof(list->head->levels[0]));
+    list->tail = NULL;
+    list->length = 0;
+    list->current_max_level = 1;
+}
+
+// Append `values` left to right, keeping the last node of every level and its
+// rank in update_cache/rank_cache so each link is made exactly once
+bool skiplist_build_from_sorted(SkipList* list, void* const* values, size_t n) {
+    if (!list || list->length != 0) {
         return false;
     }
-    
+    for (size_t i = 0; i < n; i++) {
+        if (!values[i] || (i > 0 && list->compare(values[i - 1], values[i]) >= 0)) {
+            return false;
+        }
+    }
+
+    for (int level = 0; level < MAX_LEVEL; level++) {
+        list->update_cache[level] = list->head;
+        list->rank_cache[level] = 0;
+    }
+
+    SkipListNode* prev = NULL;
+    for (size_t i = 0; i < n; i++) {
+        void* node_value = values[i];
+        if (list->copy_value) {
+            node_value = list->copy_value(values[i]);
+            if (!node_value) {
+                abandon_build(list);
+                return false;
+            }
+        }
+        int level = random_level(list);
+        SkipListNode* node = node_create(list, node_value, level);
+        if (!node) {
+            if (list->copy_value && list->free_value) {
+                list->free_value(node_value);
+            }
+            abandon_build(list);
+            return false;
+        }
+
+        size_t rank = i + 1;
+        for (int l = 0; l < level; l++) {
+            SkipListNode* last = list->update_cache[l];
+            last->levels[l].next = node;
+            last->levels[l].span = rank - list->rank_cache[l];
+            list->update_cache[l] = node;
+            list->rank_cache[l] = rank;
+        }
+        node->backward = prev;
+        prev = node;
+        if (level > list->current_max_level) {
+            list->current_max_level = level;
+        }
+        // Keep the list consistent so a failure can walk it
+        list->tail = node;
+        list->length = rank;
+    }
+
+    // Links into the void span up to the end, as insert leaves them
+    for (int l = 0; l < list->current_max_level; l++) {
+        list->update_cache[l]->levels[l].span = n - list->rank_cache[l];
+    }
+    return true;
+}
+
+// Predecessors of the node at 1-based `rank` into update_cache
+static void find_rank_for_erase(SkipList* list, size_t rank) {
     SkipListNode* current = list->head;
-    bool found = false;
+    size_t traversed = 0;
+    for (int level = list->current_max_level - 1; level >= 0; level--) {
+        while (current->levels[level].next &&
+               traversed + current->levels[level].span < rank) {
+            traversed += current->levels[level].span;
+            current = current->levels[level].next;
+        }
+        list->update_cache[level] = current;
+    }
+}
+
+// Unlink up to `limit` nodes from update_cache[0]->next on, stopping at the
+// first value >= `hi`. The predecessors stay valid while the run is removed,
+// so it costs a single descent.
+static size_t erase_run(SkipList* list, size_t limit, const void* hi,
+                        EraseFunc on_erase, void* ctx) {
+    SkipListKey probe;
+    const SkipListKey* key = hi ? probe_key(list, hi, &probe) : NULL;
+    SkipListNode* node = list->update_cache[0]->levels[0].next;
+    size_t removed = 0;
+    while (node && removed < limit &&
+           (!hi || node_compare(list, node, hi, key) < 0)) {
+        SkipListNode* next = node->levels[0].next;
+        unlink_node(list, node);
+        if (on_erase) {
+            on_erase(node->value, ctx);
+        }
+        if (list->free_value) {
+            list->free_value(node->value);
+        }
+        pool_free(list, node);
+        removed++;
+        node = next;
+    }
+    return removed;
+}
+
+size_t skiplist_erase_range(SkipList* list, size_t start, size_t end,
+                            EraseFunc on_erase, void* ctx) {
+    if (!list || start == 0 || start > end || start > list->length) {
+        return 0;
+    }
+    find_rank_for_erase(list, start);
+    return erase_run(list, end - start + 1, NULL, on_erase, ctx);
+}
 
-    // Find node and track predecessors
+size_t skiplist_erase_between(SkipList* list, const void* lo, const void* hi,
+                              EraseFunc on_erase, void* ctx) {
+    if (!list) {
+        return 0;
+    }
+
+    SkipListKey probe;
+    const SkipListKey* key = lo ? probe_key(list, lo, &probe) : NULL;
+    SkipListNode* current = list->head;
     for (int level = list->current_max_level - 1; level >= 0; level--) {
-      while (current->next[level]) {
-        SkipListNode *next = current->next[level];
-        int cmp = list->compare(next->value, value);
-
-        if (cmp < 0) {
-          current = next;
-        } else if (cmp == 0) {
-          found = true;
-          break;
-        } else {
-          break;
+        while (lo && current->levels[level].next &&
+               node_compare(list, current->levels[level].next, lo, key) < 0) {
+            current = current->levels[level].next;
         }
-      }
-      list->update_cache[level] = current;
+        list->update_cache[level] = current;
     }
+    return erase_run(list, SIZE_MAX, hi, on_erase, ctx);
+}
+
+size_t skiplist_size(const SkipList* list) {
+    return list ? list->length : 0;
+}
 
-    if (!found) {
-      return false;
+// 1-based rank of `value`, 0 when it is not in the list
+size_t skiplist_rank(const SkipList* list, const void* value) {
+    if (!list || !value) {
+        return 0;
     }
 
-    SkipListNode *node_to_delete = list->update_cache[0]->next[0];
+    SkipListKey probe;
+    const SkipListKey* key = probe_key(list, value, &probe);
+    SkipListNode* current = list->head;
+    size_t rank = 0;
+    for (int level = list->current_max_level - 1; level >= 0; level--) {
+        while (current->levels[level].next &&
+               node_compare(list, current->levels[level].next, value, key) <= 0) {
+            rank += current->levels[level].span;
+            current = current->levels[level].next;
+        }
+        if (current != list->head && node_compare(list, current, value, key) == 0) {
+            return rank;
+        }
+    }
+    return 0;
+}
 
-    // Unlink from all levels
-    for (int level = 0; level < node_to_delete->level; level++) {
-      list->update_cache[level]->next[level] = node_to_delete->next[level];
+// Node at 1-based `rank`, NULL when out of range
+SkipListNode* skiplist_node_at(const SkipList* list, size_t rank) {
+    if (!list || rank == 0 || rank > list->length) {
+        return NULL;
+    }
+
+    SkipListNode* current = list->head;
+    size_t traversed = 0;
+    for (int level = list->current_max_level - 1; level >= 0; level--) {
+        while (current->levels[level].next &&
+               traversed + current->levels[level].span <= rank) {
+            traversed += current->levels[level].span;
+            current = current->levels[level].next;
+        }
+        if (traversed == rank) {
+            return current;
+        }
     }
+    return NULL;
+}
 
-    node_destroy(node_to_delete, list->free_value);
+// First node whose value is >= `probe`
+SkipListNode* skiplist_lower_bound(const SkipList* list, const void* probe) {
+    if (!list) {
+        return NULL;
+    }
 
-    // Update current max level
-    while (list->current_max_level > 1 &&
-           list->head->next[list->current_max_level - 1] == NULL) {
-      list->current_max_level--;
+    SkipListKey probe_buf;
+    const SkipListKey* key = probe_key(list, probe, &probe_buf);
+    SkipListNode* current = list->head;
+    for (int level = list->current_max_level - 1; level >= 0; level--) {
+        while (current->levels[level].next &&
+               node_compare(list, current->levels[level].next, probe, key) < 0) {
+            current = current->levels[level].next;
+        }
     }
+    return current->levels[0].next;
+}
 
-    return true;
+SkipListNode* skiplist_first(const SkipList* list) {
+    return list ? list->head->levels[0].next : NULL;
+}
+
+SkipListNode* skiplist_last(const SkipList* list) {
+    return list ? list->tail : NULL;
+}
+
+SkipListNode* skiplist_next(const SkipListNode* node) {
+    return node->levels[0].next;
+}
+
+SkipListNode* skiplist_prev(const SkipListNode* node) {
+    return node->backward;
+}
+
+void* skiplist_node_value(const SkipListNode* node) {
+    return node->value;
 }
@@ -2,6 +2,8 @@
 #define SKIPLIST_H__
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // Forward declarations
 typedef struct SkipListNode SkipListNode;
@@ -12,11 +14,65 @@ typedef int (*CompareFunc)(const void *a, const void *b);
 typedef void (*FreeFunc)(void *value);
 typedef void *(*CopyFunc)(const void *value);
 
+// Optional inline key cached in every node so the search loop can order most
+// nodes without dereferencing their value. It must agree with CompareFunc:
+// keys are compared by `score`, then `prefix` as an unsigned integer, and
+// CompareFunc only decides between nodes whose keys are equal.
+typedef struct {
+    double score;
+    uint64_t prefix; // see skiplist_key_prefix()
+} SkipListKey;
+typedef void (*KeyFunc)(const void *value, SkipListKey *key);
+
+// First 8 bytes of `bytes`, zero padded, as a big-endian integer: comparing
+// two prefixes agrees with memcmp-then-length ordering whenever they differ
+uint64_t skiplist_key_prefix(const void *bytes, size_t len);
+
 SkipList *skiplist_create(CompareFunc compare, FreeFunc free_value,
                           CopyFunc copy_value);
+SkipList *skiplist_create_keyed(CompareFunc compare, FreeFunc free_value,
+                                CopyFunc copy_value, KeyFunc key_of);
 bool skiplist_contain(const SkipList *list, const void *value);
 bool skiplist_insert(SkipList *list, void *value);
 bool skiplist_erase(SkipList *list, const void *value);
+// Remove `value` without freeing it; returns the stored value or NULL
+void *skiplist_unlink(SkipList *list, const void *value);
 void skiplist_destroy(SkipList* list);
 
+// Called with each value skiplist_erase_range/between removes, before the
+// list's FreeFunc
+typedef void (*EraseFunc)(void *value, void *ctx);
+
+// ===== Bulk operations =====
+
+// Fill an empty list from `n` strictly ascending values in one O(n) pass (no
+// searching). Values are copied like skiplist_insert does. Returns false and
+// leaves the list empty if the list is not empty, the input is not strictly
+// ascending, or memory runs out.
+bool skiplist_build_from_sorted(SkipList *list, void *const *values, size_t n);
+// Remove the nodes at 1-based ranks [start, end] (clamped to the size) with
+// one descent; returns how many were removed
+size_t skiplist_erase_range(SkipList *list, size_t start, size_t end,
+                            EraseFunc on_erase, void *ctx);
+// Remove every value with lo <= value < hi (NULL leaves that side unbounded)
+size_t skiplist_erase_between(SkipList *list, const void *lo, const void *hi,
+                              EraseFunc on_erase, void *ctx);
+
+// ===== Rank and ordered access =====
+// Every forward link records how many nodes it skips, so ranks are O(log n).
+
+size_t skiplist_size(const SkipList *list);
+// 1-based rank of `value`, 0 if absent
+size_t skiplist_rank(const SkipList *list, const void *value);
+// Node at 1-based `rank`, NULL if out of range
+SkipListNode *skiplist_node_at(const SkipList *list, size_t rank);
+// First node whose value compares >= `probe`, NULL if none
+SkipListNode *skiplist_lower_bound(const SkipList *list, const void *probe);
+
+SkipListNode *skiplist_first(const SkipList *list);
+SkipListNode *skiplist_last(const SkipList *list);
+SkipListNode *skiplist_next(const SkipListNode *node);
+SkipListNode *skiplist_prev(const SkipListNode *node);
+void *skiplist_node_value(const SkipListNode *node);
+
 #endif // SKIPLIST_H
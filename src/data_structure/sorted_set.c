@@ -0,0 +1,327 @@
+#include "sorted_set.h"
+#include "util/mem.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ===== Internal Helper Functions =====
+
+// Order by score, then by member bytes (a prefix sorts first)
+static int entry_compare(const void *a, const void *b) {
+    const ZSetEntry *ea = (const ZSetEntry *)a;
+    const ZSetEntry *eb = (const ZSetEntry *)b;
+    if (ea->score < eb->score) {
+        return -1;
+    }
+    if (ea->score > eb->score) {
+        return 1;
+    }
+    size_t min = ea->len < eb->len ? ea->len : eb->len;
+    int cmp = memcmp(ea->member, eb->member, min);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (ea->len > eb->len) - (ea->len < eb->len);
+}
+
+// Inline skip list key: score, then the first member bytes, matching
+// entry_compare
+static void entry_key(const void *value, SkipListKey *key) {
+    const ZSetEntry *e = (const ZSetEntry *)value;
+    key->score = e->score;
+    key->prefix = skiplist_key_prefix(e->member, e->len);
+}
+
+static ZSetEntry *entry_create(const char *member, size_t len, double score) {
+    ZSetEntry *e = (ZSetEntry *)mem_malloc(sizeof(ZSetEntry) + len + 1);
+    if (!e) {
+        return NULL;
+    }
+    e->score = score;
+    e->len = len;
+    memcpy(e->member, member, len);
+    e->member[len] = '\0';
+    return e;
+}
+
+// Probe sorting before every member with this score (empty member)
+static void *score_probe(ZSetEntry *probe, double score) {
+    probe->score = score;
+    probe->len = 0;
+    return probe;
+}
+
+// Drop the dict side of a member the skip list is removing
+static void entry_forget(void *value, void *ctx) {
+    ZSetEntry *e = (ZSetEntry *)value;
+    dict_delete(((SortedSet *)ctx)->dict, e->member, e->len);
+}
+
+// Move an existing member to a new score
+static bool entry_rescore(SortedSet *zs, ZSetEntry *e, double score) {
+    double old = e->score;
+    skiplist_unlink(zs->zsl, e);
+    e->score = score;
+    if (!skiplist_insert(zs->zsl, e)) {
+        // Out of memory: put it back where it was
+        e->score = old;
+        if (!skiplist_insert(zs->zsl, e)) {
+            dict_delete(zs->dict, e->member, e->len);
+            mem_free(e);
+        }
+        return false;
+    }
+    return true;
+}
+
+// ===== Public API =====
+
+SortedSet *zset_create(void) {
+    SortedSet *zs = (SortedSet *)mem_malloc(sizeof(SortedSet));
+    if (!zs) {
+        return NULL;
+    }
+    zs->zsl = skiplist_create_keyed(entry_compare, mem_free, NULL, entry_key);
+    zs->dict = dict_create(NULL);
+    if (!zs->zsl || !zs->dict) {
+        skiplist_destroy(zs->zsl);
+        dict_destroy(zs->dict);
+        mem_free(zs);
+        return NULL;
+    }
+    return zs;
+}
+
+void zset_destroy(SortedSet *zs) {
+    if (!zs) {
+        return;
+    }
+    skiplist_destroy(zs->zsl);
+    dict_destroy(zs->dict);
+    mem_free(zs);
+}
+
+ZSetAddResult zset_add(SortedSet *zs, const char *member, size_t len,
+                       double score, int flags, double *newscore) {
+    DictEntry *de = dict_find(zs->dict, member, len);
+    if (de) {
+        if (flags & ZSET_ADD_NX) {
+            return ZSET_NOP;
+        }
+        ZSetEntry *e = (ZSetEntry *)de->v.val;
+        double current = e->score;
+        if (flags & ZSET_ADD_INCR) {
+            score += current;
+            if (isnan(score)) {
+                return ZSET_ERR_NAN;
+            }
+        }
+        if (((flags & ZSET_ADD_GT) && score <= current) ||
+            ((flags & ZSET_ADD_LT) && score >= current)) {
+            return ZSET_NOP;
+        }
+        if (newscore) {
+            *newscore = score;
+        }
+        if (score == current) {
+            return ZSET_NOP;
+        }
+        if (!entry_rescore(zs, e, score)) {
+            return ZSET_ERR_OOM;
+        }
+        return ZSET_UPDATED;
+    }
+
+    if (flags & ZSET_ADD_XX) {
+        return ZSET_NOP;
+    }
+    ZSetEntry *e = entry_create(member, len, score);
+    if (!e) {
+        return ZSET_ERR_OOM;
+    }
+    de = dict_add_raw(zs->dict, member, len, NULL);
+    if (!de) {
+        mem_free(e);
+        return ZSET_ERR_OOM;
+    }
+    de->v.val = e;
+    if (!skiplist_insert(zs->zsl, e)) {
+        dict_delete(zs->dict, member, len);
+        mem_free(e);
+        return ZSET_ERR_OOM;
+    }
+    if (newscore) {
+        *newscore = score;
+    }
+    return ZSET_ADDED;
+}
+
+bool zset_load_sorted(SortedSet *zs, const char *const *members,
+                      const size_t *lens, const double *scores, size_t n) {
+    if (zset_card(zs) != 0) {
+        return false;
+    }
+    ZSetEntry **entries = (ZSetEntry **)malloc(n * sizeof(ZSetEntry *));
+    if (!entries && n > 0) {
+        return false;
+    }
+    dict_expand(zs->dict, n);
+    size_t made = 0;
+    bool ok = true;
+    for (; made < n; made++) {
+        ZSetEntry *e = entry_create(members[made], lens[made], scores[made]);
+        if (!e) {
+            ok = false;
+            break;
+        }
+        entries[made] = e;
+    }
+    for (size_t i = 0; ok && i < n; i++) {
+        DictEntry *de = dict_add_raw(zs->dict, entries[i]->member,
+                                     entries[i]->len, NULL);
+        if (!de) {
+            ok = false;
+            break;
+        }
+        de->v.val = entries[i];
+    }
+    // Also rejects input that is out of order
+    ok = ok && skiplist_build_from_sorted(zs->zsl, (void *const *)entries, n);
+    if (!ok) {
+        dict_clear(zs->dict);
+        for (size_t i = 0; i < made; i++) {
+            mem_free(entries[i]);
+        }
+    }
+    free(entries);
+    return ok;
+}
+
+bool zset_remove(SortedSet *zs, const char *member, size_t len) {
+    DictEntry *de = dict_unlink(zs->dict, member, len);
+    if (!de) {
+        return false;
+    }
+    skiplist_erase(zs->zsl, de->v.val);
+    dict_free_unlinked(zs->dict, de);
+    return true;
+}
+
+bool zset_score(SortedSet *zs, const char *member, size_t len, double *score) {
+    ZSetEntry *e = (ZSetEntry *)dict_fetch_value(zs->dict, member, len);
+    if (!e) {
+        return false;
+    }
+    *score = e->score;
+    return true;
+}
+
+size_t zset_card(const SortedSet *zs) {
+    return skiplist_size(zs->zsl);
+}
+
+// Members whose length is sampled by zset_memory_usage
+#define ZSET_MEMORY_SAMPLES 5
+// A skip list node with its average 1.33 levels, rounded up to the allocator
+#define ZSET_NODE_ESTIMATE 64
+
+size_t zset_memory_usage(const SortedSet *zs) {
+    size_t card = zset_card(zs);
+    size_t sampled = 0, bytes = 0;
+    for (SkipListNode *n = skiplist_first(zs->zsl);
+         n && sampled < ZSET_MEMORY_SAMPLES; n = skiplist_next(n)) {
+        bytes += zset_node_entry(n)->len + 1;
+        sampled++;
+    }
+    size_t member = sampled ? bytes / sampled : 0;
+    // the member is stored twice: in its entry and as the dictionary key
+    size_t per_member = sizeof(ZSetEntry) + sizeof(DictEntry) + 2 * member +
+                        ZSET_NODE_ESTIMATE;
+    return sizeof(SortedSet) + dict_buckets(zs->dict) * sizeof(DictEntry *) +
+           card * per_member;
+}
+
+bool zset_rank(SortedSet *zs, const char *member, size_t len, bool reverse,
+               size_t *rank) {
+    ZSetEntry *e = (ZSetEntry *)dict_fetch_value(zs->dict, member, len);
+    if (!e) {
+        return false;
+    }
+    size_t r = skiplist_rank(zs->zsl, e);
+    *rank = reverse ? zset_card(zs) - r : r - 1;
+    return true;
+}
+
+SkipListNode *zset_node_at(const SortedSet *zs, size_t rank) {
+    return skiplist_node_at(zs->zsl, rank + 1);
+}
+
+bool zset_in_range(const ZRangeSpec *range, double score) {
+    return (range->minex ? score > range->min : score >= range->min) &&
+           (range->maxex ? score < range->max : score <= range->max);
+}
+
+SkipListNode *zset_first_in_range(const SortedSet *zs, const ZRangeSpec *range) {
+    // The first score at or above min; nextafter() turns "> min" into
+    // ">= the next double", so ties with an exclusive min are not walked
+    if (range->minex && range->min == INFINITY) {
+        return NULL;
+    }
+    double bound = range->minex ? nextafter(range->min, INFINITY) : range->min;
+    ZSetEntry probe;
+    SkipListNode *node =
+        skiplist_lower_bound(zs->zsl, score_probe(&probe, bound));
+    if (!node || !zset_in_range(range, zset_node_entry(node)->score)) {
+        return NULL;
+    }
+    return node;
+}
+
+SkipListNode *zset_last_in_range(const SortedSet *zs, const ZRangeSpec *range) {
+    // The node before the first score above the range (or at max when
+    // exclusive); nextafter() turns "> max" into ">= the next double"
+    SkipListNode *node;
+    if (range->max == INFINITY && !range->maxex) {
+        node = skiplist_last(zs->zsl);
+    } else {
+        double bound =
+            range->maxex ? range->max : nextafter(range->max, INFINITY);
+        ZSetEntry probe;
+        node = skiplist_lower_bound(zs->zsl, score_probe(&probe, bound));
+        node = node ? skiplist_prev(node) : skiplist_last(zs->zsl);
+    }
+    if (!node || !zset_in_range(range, zset_node_entry(node)->score)) {
+        return NULL;
+    }
+    return node;
+}
+
+size_t zset_count(const SortedSet *zs, const ZRangeSpec *range) {
+    SkipListNode *first = zset_first_in_range(zs, range);
+    if (!first) {
+        return 0;
+    }
+    SkipListNode *last = zset_last_in_range(zs, range);
+    return skiplist_rank(zs->zsl, skiplist_node_value(last)) -
+           skiplist_rank(zs->zsl, skiplist_node_value(first)) + 1;
+}
+
+size_t zset_remove_range_by_rank(SortedSet *zs, size_t start, size_t end) {
+    return skiplist_erase_range(zs->zsl, start + 1, end + 1, entry_forget, zs);
+}
+
+size_t zset_remove_range_by_score(SortedSet *zs, const ZRangeSpec *range) {
+    // As a half-open [lo, hi) over score probes; nextafter() turns an
+    // exclusive min and an inclusive max into the next double up
+    if (range->minex && range->min == INFINITY) {
+        return 0;
+    }
+    ZSetEntry lo, hi;
+    score_probe(&lo, range->minex ? nextafter(range->min, INFINITY) : range->min);
+    bool unbounded = range->max == INFINITY && !range->maxex;
+    if (!unbounded) {
+        score_probe(&hi, range->maxex ? range->max : nextafter(range->max, INFINITY));
+    }
+    return skiplist_erase_between(zs->zsl, &lo, unbounded ? NULL : &hi,
+                                  entry_forget, zs);
+}
@@ -0,0 +1,101 @@
+#ifndef SORTED_SET_H__
+#define SORTED_SET_H__
+
+#include "data_structure/skip_list.h"
+#include "util/dict.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Sorted set: members ordered by (score, member bytes).
+ *
+ * Two indexes over the same members:
+ *  - a rank-augmented skip list holding the ZSetEntry records, for rank
+ *    queries, index ranges and score ranges in O(log n);
+ *  - a member -> entry dictionary for O(1) ZSCORE and membership checks;
+ *    the entry doubles as the search key when the member has to be found
+ *    in the skip list (rank, removal, score update).
+ *
+ * Ranks are 0-based here, as in the commands.
+ */
+
+/* ZADD flags */
+#define ZSET_ADD_NX   (1 << 0) /* only add new members */
+#define ZSET_ADD_XX   (1 << 1) /* only update existing members */
+#define ZSET_ADD_GT   (1 << 2) /* only update when the new score is greater */
+#define ZSET_ADD_LT   (1 << 3) /* only update when the new score is lower */
+#define ZSET_ADD_INCR (1 << 4) /* `score` is an increment */
+
+/* zset_add results */
+typedef enum {
+    ZSET_NOP = 0,
+    ZSET_ADDED,
+    ZSET_UPDATED,
+    ZSET_ERR_NAN = -1, /* INCR produced NaN (inf + -inf) */
+    ZSET_ERR_OOM = -2
+} ZSetAddResult;
+
+typedef struct {
+    double score;
+    size_t len;
+    char member[]; /* len bytes + NUL */
+} ZSetEntry;
+
+typedef struct {
+    SkipList *zsl;
+    Dict *dict;
+} SortedSet;
+
+/* Score interval; `minex`/`maxex` make the bound exclusive. */
+typedef struct {
+    double min;
+    double max;
+    bool minex;
+    bool maxex;
+} ZRangeSpec;
+
+SortedSet *zset_create(void);
+void zset_destroy(SortedSet *zs);
+
+/*
+ * Add or update a member according to `flags`. ZSET_NOP when a flag prevented
+ * the change or the score stayed the same; *newscore (if given) receives the
+ * member's score only in the latter case and on success.
+ */
+ZSetAddResult zset_add(SortedSet *zs, const char *member, size_t len,
+                       double score, int flags, double *newscore);
+/*
+ * Fill an empty set from `n` members already in ascending (score, member)
+ * order, as a snapshot stores them, in O(n) and without searching the skip
+ * list. Members are copied. False (the set stays empty) if the set is not
+ * empty, the input is not strictly ascending, or memory runs out.
+ */
+bool zset_load_sorted(SortedSet *zs, const char *const *members,
+                      const size_t *lens, const double *scores, size_t n);
+bool zset_remove(SortedSet *zs, const char *member, size_t len);
+bool zset_score(SortedSet *zs, const char *member, size_t len, double *score);
+size_t zset_card(const SortedSet *zs);
+/* Approximate bytes held by the set, from the length of a few members. */
+size_t zset_memory_usage(const SortedSet *zs);
+/* 0-based rank, counted from the highest score when `reverse`. */
+bool zset_rank(SortedSet *zs, const char *member, size_t len, bool reverse,
+               size_t *rank);
+
+/* Node at 0-based `rank` in ascending order; walk with skiplist_next/prev. */
+SkipListNode *zset_node_at(const SortedSet *zs, size_t rank);
+/* Lowest / highest node inside `range`, NULL when the range is empty. */
+SkipListNode *zset_first_in_range(const SortedSet *zs, const ZRangeSpec *range);
+SkipListNode *zset_last_in_range(const SortedSet *zs, const ZRangeSpec *range);
+bool zset_in_range(const ZRangeSpec *range, double score);
+size_t zset_count(const SortedSet *zs, const ZRangeSpec *range);
+
+/* Remove the members at 0-based ranks [start, end] / with scores in `range`
+ * in a single pass; return how many were removed. */
+size_t zset_remove_range_by_rank(SortedSet *zs, size_t start, size_t end);
+size_t zset_remove_range_by_score(SortedSet *zs, const ZRangeSpec *range);
+
+static inline ZSetEntry *zset_node_entry(const SkipListNode *node) {
+    return (ZSetEntry *)skiplist_node_value(node);
+}
+
+#endif
@@ -0,0 +1,211 @@
+#include "top_k.h"
+#include "util/mem.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* private functions */
+static __inline__ void __slot_place(TopK *tk, uint32_t pos, TopKSlot slot);
+static void __sift_up(TopK *tk, uint32_t pos);
+static void __sift_down(TopK *tk, uint32_t pos);
+static int __expel_min(TopK *tk, char **expelled, size_t *expelled_len);
+static int __by_count_desc(const void *a, const void *b);
+
+TopK *topk_create(uint32_t k, uint32_t width, uint32_t depth) {
+  if (k == 0 || width == 0 || depth == 0 || depth > TOPK_MAX_DEPTH) {
+    return NULL;
+  }
+  TopK *tk = mem_calloc(1, sizeof(TopK));
+  if (!tk) {
+    return NULL;
+  }
+  /* Conservative update: heavy hitters are ranked on tighter estimates */
+  CmsOptions opts = {CMS_LAYOUT_FLAT, 32, CMS_FLAG_CONSERVATIVE};
+  if (cms_init_by_dim_ex(&tk->sketch, width, depth, &opts) != CMS_SUCCESS) {
+    mem_free(tk);
+    return NULL;
+  }
+  tk->heap = mem_malloc((size_t)k * sizeof(TopKSlot));
+  tk->index = dict_create(NULL);
+  if (!tk->heap || !tk->index) {
+    topk_destroy(tk);
+    return NULL;
+  }
+  tk->k = k;
+  tk->size = 0;
+  return tk;
+}
+
+void topk_destroy(TopK *tk) {
+  if (!tk) {
+    return;
+  }
+  cms_destroy(&tk->sketch);
+  if (tk->index) {
+    dict_destroy(tk->index);
+  }
+  mem_free(tk->heap);
+  mem_free(tk);
+}
+
+TopK *topk_restore(uint32_t k, const CountMinSketch *sketch) {
+  if (k == 0 || sketch->depth > TOPK_MAX_DEPTH) {
+    return NULL;
+  }
+  TopK *tk = mem_calloc(1, sizeof(TopK));
+  if (!tk) {
+    return NULL;
+  }
+  if (cms_restore(&tk->sketch, sketch) != CMS_SUCCESS) {
+    mem_free(tk);
+    return NULL;
+  }
+  tk->heap = mem_malloc((size_t)k * sizeof(TopKSlot));
+  tk->index = dict_create(NULL);
+  if (!tk->heap || !tk->index) {
+    topk_destroy(tk);
+    return NULL;
+  }
+  tk->k = k;
+  tk->size = 0;
+  return tk;
+}
+
+int topk_restore_slot(TopK *tk, const char *key, size_t len, int64_t count) {
+  if (tk->size == tk->k) {
+    return TOPK_ERR_OOM;
+  }
+  DictEntry *de = dict_add_raw(tk->index, key, len, NULL);
+  if (!de) {
+    return TOPK_ERR_OOM;
+  }
+  __slot_place(tk, tk->size++, (TopKSlot){de, count});
+  return TOPK_OK;
+}
+
+int topk_add(TopK *tk, const char *key, size_t len, uint32_t incr,
+             char **expelled, size_t *expelled_len) {
+  *expelled = NULL;
+  *expelled_len = 0;
+  uint64_t hashes[TOPK_MAX_DEPTH];
+  cms_hash_key(&tk->sketch, key, len, hashes);
+  int64_t count = cms_add_inc_alt(&tk->sketch, hashes, tk->sketch.depth, incr);
+
+  DictEntry *de = dict_find(tk->index, key, len);
+  if (de) {
+    uint32_t pos = (uint32_t)de->v.s64;
+    if (count > tk->heap[pos].count) {
+      tk->heap[pos].count = count;
+      __sift_down(tk, pos);
+    }
+    return TOPK_OK;
+  }
+  if (tk->size == tk->k && count <= tk->heap[0].count) {
+    return TOPK_OK;
+  }
+
+  de = dict_add_raw(tk->index, key, len, NULL);
+  if (!de) {
+    return TOPK_ERR_OOM;
+  }
+  if (tk->size == tk->k && __expel_min(tk, expelled, expelled_len) != TOPK_OK) {
+    dict_delete(tk->index, key, len);
+    return TOPK_ERR_OOM;
+  }
+  uint32_t pos = tk->size++;
+  __slot_place(tk, pos, (TopKSlot){de, count});
+  __sift_up(tk, pos);
+  return TOPK_OK;
+}
+
+bool topk_query(const TopK *tk, const char *key, size_t len) {
+  return dict_find(tk->index, key, len) != NULL;
+}
+
+int64_t topk_count(TopK *tk, const char *key, size_t len) {
+  return cms_check_len(&tk->sketch, key, len);
+}
+
+uint32_t topk_list(const TopK *tk, TopKSlot *out) {
+  memcpy(out, tk->heap, (size_t)tk->size * sizeof(TopKSlot));
+  qsort(out, tk->size, sizeof(TopKSlot), __by_count_desc);
+  return tk->size;
+}
+
+size_t topk_memory_usage(const TopK *tk) {
+  size_t size = sizeof(TopK) + cms_memory_usage(&tk->sketch) +
+                (size_t)tk->k * sizeof(TopKSlot) +
+                dict_buckets(tk->index) * sizeof(DictEntry *);
+  for (uint32_t i = 0; i < tk->size; i++) {
+    size += sizeof(DictEntry) + tk->heap[i].entry->key_len + 1;
+  }
+  return size;
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+/* Store a slot and record its position in the index */
+static __inline__ void __slot_place(TopK *tk, uint32_t pos, TopKSlot slot) {
+  tk->heap[pos] = slot;
+  slot.entry->v.s64 = pos;
+}
+
+static void __sift_up(TopK *tk, uint32_t pos) {
+  TopKSlot slot = tk->heap[pos];
+  while (pos > 0) {
+    uint32_t parent = (pos - 1) / 2;
+    if (tk->heap[parent].count <= slot.count) {
+      break;
+    }
+    __slot_place(tk, pos, tk->heap[parent]);
+    pos = parent;
+  }
+  __slot_place(tk, pos, slot);
+}
+
+static void __sift_down(TopK *tk, uint32_t pos) {
+  TopKSlot slot = tk->heap[pos];
+  for (;;) {
+    uint32_t child = 2 * pos + 1;
+    if (child >= tk->size) {
+      break;
+    }
+    if (child + 1 < tk->size &&
+        tk->heap[child + 1].count < tk->heap[child].count) {
+      child++;
+    }
+    if (slot.count <= tk->heap[child].count) {
+      break;
+    }
+    __slot_place(tk, pos, tk->heap[child]);
+    pos = child;
+  }
+  __slot_place(tk, pos, slot);
+}
+
+/* Remove the heap minimum, handing its item to the caller */
+static int __expel_min(TopK *tk, char **expelled, size_t *expelled_len) {
+  DictEntry *min = tk->heap[0].entry;
+  /* handed to the caller, who releases it with free() */
+  char *item = malloc(min->key_len + 1);
+  if (!item) {
+    return TOPK_ERR_OOM;
+  }
+  memcpy(item, min->key, min->key_len + 1);
+  *expelled = item;
+  *expelled_len = min->key_len;
+  dict_delete(tk->index, min->key, min->key_len);
+
+  tk->size--;
+  if (tk->size > 0) {
+    __slot_place(tk, 0, tk->heap[tk->size]);
+    __sift_down(tk, 0);
+  }
+  return TOPK_OK;
+}
+
+static int __by_count_desc(const void *a, const void *b) {
+  int64_t ca = ((const TopKSlot *)a)->count;
+  int64_t cb = ((const TopKSlot *)b)->count;
+  return (ca < cb) - (ca > cb);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file top_k.h
+ * @brief Top-K heavy hitters over a Count-Min Sketch
+ *
+ * Every added item is counted in a Count-Min Sketch (hashed once, through the
+ * *_alt path). The `k` items with the highest estimates seen so far are kept
+ * in a min-heap, with a dictionary from item to heap position, so an add
+ * costs O(depth) for the sketch plus O(log k) for the heap.
+ *
+ * An item outside the heap replaces the heap minimum once its estimate
+ * exceeds it; the replaced item is handed back to the caller. Heap counts are
+ * refreshed when their item is added again, so an item's count is its sketch
+ * estimate at its last add (an upper bound on its true count).
+ */
+
+#ifndef REDIS_C_TOP_K_H__
+#define REDIS_C_TOP_K_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "data_structure/count_min_sketch.h"
+#include "util/dict.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @defgroup TopK_Status Status Codes
+ * @{
+ */
+#define TOPK_OK       0
+#define TOPK_ERR_OOM  -1
+/** @} */
+
+#define TOPK_MAX_DEPTH CMS_MAX_STACK_HASHES
+
+typedef struct {
+    DictEntry *entry;  /**< Index entry: the item and, in v.s64, the position */
+    int64_t count;
+} TopKSlot;
+
+typedef struct {
+    CountMinSketch sketch;
+    uint32_t k;
+    uint32_t size;     /**< Items in the heap, at most k */
+    TopKSlot *heap;    /**< Min-heap on count */
+    Dict *index;       /**< Item -> heap position */
+} TopK;
+
+/**
+ * @brief Create a tracker for the `k` most frequent items on a
+ *        `width` x `depth` sketch; NULL on invalid dimensions or out of memory
+ */
+TopK *topk_create(uint32_t k, uint32_t width, uint32_t depth);
+void topk_destroy(TopK *tk);
+
+/**
+ * @brief Rebuild a saved tracker: an empty heap over a copy of `sketch` (see
+ *        cms_restore), to be refilled with topk_restore_slot(); NULL on
+ *        invalid dimensions or out of memory
+ */
+TopK *topk_restore(uint32_t k, const CountMinSketch *sketch);
+/**
+ * @brief Append a saved heap slot. Slots must be restored in the order they
+ *        had in `heap`, which keeps it a valid min-heap.
+ * @return TOPK_OK, or TOPK_ERR_OOM when out of memory, the heap is full or
+ *         the item is already in it
+ */
+int topk_restore_slot(TopK *tk, const char *key, size_t len, int64_t count);
+
+/**
+ * @brief Count `incr` occurrences of an item
+ * @param expelled Set to a malloc'd copy of the item that left the top k to
+ *                 make room (NUL-terminated, length in *expelled_len), or
+ *                 NULL; the caller frees it
+ * @return TOPK_OK or TOPK_ERR_OOM
+ */
+int topk_add(TopK *tk, const char *key, size_t len, uint32_t incr,
+             char **expelled, size_t *expelled_len);
+
+/**
+ * @brief Whether the item is currently in the top k
+ */
+bool topk_query(const TopK *tk, const char *key, size_t len);
+
+/**
+ * @brief Sketch estimate of the item's count, in the top k or not
+ */
+int64_t topk_count(TopK *tk, const char *key, size_t len);
+
+/**
+ * @brief Copy the current top items into `out` (room for k), highest count
+ *        first
+ * @return Number of items written
+ */
+uint32_t topk_list(const TopK *tk, TopKSlot *out);
+
+size_t topk_memory_usage(const TopK *tk);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // REDIS_C_TOP_K_H__
@@ -0,0 +1,452 @@
+#include "event_loop.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define EL_USE_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) ||   \
+    defined(__NetBSD__)
+#include <sys/event.h>
+#define EL_USE_KQUEUE 1
+#else
+#error "event_loop.c requires epoll or kqueue"
+#endif
+
+typedef struct {
+  int mask;
+  FileEventProc rproc;
+  FileEventProc wproc;
+  void *data;
+} FileEvent;
+
+typedef struct {
+  int fd;
+  int mask;
+} FiredEvent;
+
+typedef struct TimeEvent {
+  long long id;
+  long long when_ms; /* monotonic: a step of the wall clock leaves it be */
+  TimeEventProc proc;
+  void *data;
+  bool deleted;
+  struct TimeEvent *next;
+} TimeEvent;
+
+struct EventLoop {
+  int setsize;
+  int maxfd;
+  bool stop;
+  FileEvent *events;
+  FiredEvent *fired;
+  TimeEvent *timers;
+  long long next_timer_id;
+  BeforeSleepProc before_sleep;
+
+  long long woke_us; /* when the current cycle started, 0 before the first */
+  ElStats stats;
+
+  int poll_fd;
+#if defined(EL_USE_EPOLL)
+  struct epoll_event *poll_events;
+#else
+  struct kevent *poll_events;
+#endif
+};
+
+/* private functions */
+static int __backend_add(EventLoop *el, int fd, int old_mask, int add_mask);
+static void __backend_del(EventLoop *el, int fd, int old_mask, int del_mask);
+static int __backend_poll(EventLoop *el, long long timeout_ms);
+static long long __nearest_timer_ms(EventLoop *el);
+static int __process_time_events(EventLoop *el);
+static void __end_cycle(EventLoop *el);
+static long long __monotonic_ms(void);
+
+EventLoop *el_create(int setsize) {
+  EventLoop *el = calloc(1, sizeof(EventLoop));
+  if (!el) {
+    return NULL;
+  }
+  el->setsize = setsize;
+  el->maxfd = -1;
+  el->events = calloc(setsize, sizeof(FileEvent));
+  el->fired = calloc(setsize, sizeof(FiredEvent));
+  el->poll_events = calloc(setsize, sizeof(*el->poll_events));
+  if (!el->events || !el->fired || !el->poll_events) {
+    goto err;
+  }
+#if defined(EL_USE_EPOLL)
+  el->poll_fd = epoll_create(1024);
+#else
+  el->poll_fd = kqueue();
+#endif
+  if (el->poll_fd == -1) {
+    goto err;
+  }
+  return el;
+
+err:
+  free(el->events);
+  free(el->fired);
+  free(el->poll_events);
+  free(el);
+  return NULL;
+}
+
+void el_destroy(EventLoop *el) {
+  if (!el) {
+    return;
+  }
+  close(el->poll_fd);
+  TimeEvent *te = el->timers;
+  while (te) {
+    TimeEvent *next = te->next;
+    free(te);
+    te = next;
+  }
+  free(el->events);
+  free(el->fired);
+  free(el->poll_events);
+  free(el);
+}
+
+int el_get_setsize(EventLoop *el) { return el->setsize; }
+
+int el_add_file_event(EventLoop *el, int fd, int mask, FileEventProc proc,
+                      void *data) {
+  if (fd < 0 || fd >= el->setsize) {
+    errno = ERANGE;
+    return EL_ERR;
+  }
+  FileEvent *fe = &el->events[fd];
+  if (__backend_add(el, fd, fe->mask, mask) == EL_ERR) {
+    return EL_ERR;
+  }
+  fe->mask |= mask;
+  if (mask & EL_READABLE) {
+    fe->rproc = proc;
+  }
+  if (mask & EL_WRITABLE) {
+    fe->wproc = proc;
+  }
+  fe->data = data;
+  if (fd > el->maxfd) {
+    el->maxfd = fd;
+  }
+  return EL_OK;
+}
+
+void el_del_file_event(EventLoop *el, int fd, int mask) {
+  if (fd < 0 || fd >= el->setsize) {
+    return;
+  }
+  FileEvent *fe = &el->events[fd];
+  if (fe->mask == EL_NONE) {
+    return;
+  }
+  __backend_del(el, fd, fe->mask, mask);
+  fe->mask &= ~mask;
+  if (fd == el->maxfd && fe->mask == EL_NONE) {
+    int j;
+    for (j = el->maxfd - 1; j >= 0; j--) {
+      if (el->events[j].mask != EL_NONE) {
+        break;
+      }
+    }
+    el->maxfd = j;
+  }
+}
+
+int el_get_file_events(EventLoop *el, int fd) {
+  if (fd < 0 || fd >= el->setsize) {
+    return EL_NONE;
+  }
+  return el->events[fd].mask;
+}
+
+long long el_add_time_event(EventLoop *el, long long ms, TimeEventProc proc,
+                            void *data) {
+  TimeEvent *te = malloc(sizeof(TimeEvent));
+  if (!te) {
+    return EL_ERR;
+  }
+  te->id = el->next_timer_id++;
+  te->when_ms = __monotonic_ms() + ms;
+  te->proc = proc;
+  te->data = data;
+  te->deleted = false;
+  te->next = el->timers;
+  el->timers = te;
+  return te->id;
+}
+
+int el_del_time_event(EventLoop *el, long long id) {
+  for (TimeEvent *te = el->timers; te; te = te->next) {
+    if (te->id == id) {
+      /* unlinked lazily so a timer may delete itself while running */
+      te->deleted = true;
+      return EL_OK;
+    }
+  }
+  return EL_ERR;
+}
+
+void el_set_before_sleep(EventLoop *el, BeforeSleepProc proc) {
+  el->before_sleep = proc;
+}
+
+int el_process_events(EventLoop *el, int flags) {
+  int processed = 0;
+  if (!(flags & (EL_FILE_EVENTS | EL_TIME_EVENTS))) {
+    return 0;
+  }
+
+  if (flags & EL_FILE_EVENTS) {
+    long long timeout = -1;
+    if (flags & EL_DONT_WAIT) {
+      timeout = 0;
+    } else if (flags & EL_TIME_EVENTS) {
+      timeout = __nearest_timer_ms(el);
+    }
+
+    int numevents = __backend_poll(el, timeout);
+    el->woke_us = el_monotonic_us();
+    for (int j = 0; j < numevents; j++) {
+      int fd = el->fired[j].fd;
+      int mask = el->fired[j].mask;
+      FileEvent *fe = &el->events[fd];
+      bool fired_read = false;
+
+      if (fe->mask & mask & EL_READABLE) {
+        fe->rproc(el, fd, fe->data, mask);
+        fired_read = true;
+      }
+      /* the read handler may have closed and unregistered the fd */
+      fe = &el->events[fd];
+      if (fe->mask & mask & EL_WRITABLE) {
+        if (!fired_read || fe->wproc != fe->rproc) {
+          fe->wproc(el, fd, fe->data, mask);
+        }
+      }
+      processed++;
+    }
+  }
+
+  if (flags & EL_TIME_EVENTS) {
+    processed += __process_time_events(el);
+  }
+  return processed;
+}
+
+void el_main(EventLoop *el) {
+  el->stop = false;
+  while (!el->stop) {
+    if (el->before_sleep) {
+      el->before_sleep(el);
+    }
+    __end_cycle(el);
+    el_process_events(el, EL_ALL_EVENTS);
+  }
+}
+
+void el_get_stats(EventLoop *el, ElStats *stats) { *stats = el->stats; }
+
+void el_stop(EventLoop *el) { el->stop = true; }
+
+long long el_mstime(void) { return el_ustime() / 1000; }
+
+long long el_ustime(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return ((long long)tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+long long el_monotonic_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((long long)ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+#if defined(EL_USE_EPOLL)
+
+static int __backend_add(EventLoop *el, int fd, int old_mask, int add_mask) {
+  struct epoll_event ee = {0};
+  int op = old_mask == EL_NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  int mask = old_mask | add_mask;
+  if (mask & EL_READABLE) {
+    ee.events |= EPOLLIN;
+  }
+  if (mask & EL_WRITABLE) {
+    ee.events |= EPOLLOUT;
+  }
+  ee.data.fd = fd;
+  return epoll_ctl(el->poll_fd, op, fd, &ee) == -1 ? EL_ERR : EL_OK;
+}
+
+static void __backend_del(EventLoop *el, int fd, int old_mask, int del_mask) {
+  struct epoll_event ee = {0};
+  int mask = old_mask & ~del_mask;
+  if (mask & EL_READABLE) {
+    ee.events |= EPOLLIN;
+  }
+  if (mask & EL_WRITABLE) {
+    ee.events |= EPOLLOUT;
+  }
+  ee.data.fd = fd;
+  epoll_ctl(el->poll_fd, mask == EL_NONE ? EPOLL_CTL_DEL : EPOLL_CTL_MOD, fd,
+            &ee);
+}
+
+static int __backend_poll(EventLoop *el, long long timeout_ms) {
+  int n = epoll_wait(el->poll_fd, el->poll_events, el->setsize,
+                     timeout_ms < 0 ? -1 : (int)timeout_ms);
+  for (int j = 0; j < n; j++) {
+    struct epoll_event *e = &el->poll_events[j];
+    int mask = EL_NONE;
+    if (e->events & EPOLLIN) {
+      mask |= EL_READABLE;
+    }
+    if (e->events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+      mask |= EL_WRITABLE;
+    }
+    if (e->events & (EPOLLERR | EPOLLHUP)) {
+      mask |= EL_READABLE;
+    }
+    el->fired[j].fd = e->data.fd;
+    el->fired[j].mask = mask;
+  }
+  return n > 0 ? n : 0;
+}
+
+#else /* kqueue */
+
+static int __backend_add(EventLoop *el, int fd, int old_mask, int add_mask) {
+  struct kevent ke;
+  (void)old_mask;
+  if (add_mask & EL_READABLE) {
+    EV_SET(&ke, fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+    if (kevent(el->poll_fd, &ke, 1, NULL, 0, NULL) == -1) {
+      return EL_ERR;
+    }
+  }
+  if (add_mask & EL_WRITABLE) {
+    EV_SET(&ke, fd, EVFILT_WRITE, EV_ADD, 0, 0, NULL);
+    if (kevent(el->poll_fd, &ke, 1, NULL, 0, NULL) == -1) {
+      return EL_ERR;
+    }
+  }
+  return EL_OK;
+}
+
+static void __backend_del(EventLoop *el, int fd, int old_mask, int del_mask) {
+  struct kevent ke;
+  if (old_mask & del_mask & EL_READABLE) {
+    EV_SET(&ke, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    kevent(el->poll_fd, &ke, 1, NULL, 0, NULL);
+  }
+  if (old_mask & del_mask & EL_WRITABLE) {
+    EV_SET(&ke, fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    kevent(el->poll_fd, &ke, 1, NULL, 0, NULL);
+  }
+}
+
+static int __backend_poll(EventLoop *el, long long timeout_ms) {
+  struct timespec ts;
+  struct timespec *tsp = NULL;
+  if (timeout_ms >= 0) {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+    tsp = &ts;
+  }
+  int n = kevent(el->poll_fd, NULL, 0, el->poll_events, el->setsize, tsp);
+  int fired = 0;
+  for (int j = 0; j < n; j++) {
+    struct kevent *e = &el->poll_events[j];
+    int mask = e->filter == EVFILT_READ ? EL_READABLE : EL_WRITABLE;
+    /* both filters of one fd are reported separately; merge them */
+    int k;
+    for (k = 0; k < fired; k++) {
+      if (el->fired[k].fd == (int)e->ident) {
+        el->fired[k].mask |= mask;
+        break;
+      }
+    }
+    if (k == fired) {
+      el->fired[fired].fd = (int)e->ident;
+      el->fired[fired].mask = mask;
+      fired++;
+    }
+  }
+  return fired;
+}
+
+#endif
+
+static long long __nearest_timer_ms(EventLoop *el) {
+  long long nearest = -1;
+  for (TimeEvent *te = el->timers; te; te = te->next) {
+    if (!te->deleted && (nearest == -1 || te->when_ms < nearest)) {
+      nearest = te->when_ms;
+    }
+  }
+  if (nearest == -1) {
+    return -1;
+  }
+  long long wait = nearest - __monotonic_ms();
+  return wait > 0 ? wait : 0;
+}
+
+static int __process_time_events(EventLoop *el) {
+  int processed = 0;
+  long long now = __monotonic_ms();
+  /* timers registered by a callback wait for the next iteration */
+  long long max_id = el->next_timer_id - 1;
+  TimeEvent **link = &el->timers;
+
+  while (*link) {
+    TimeEvent *te = *link;
+    if (te->deleted) {
+      *link = te->next;
+      free(te);
+      continue;
+    }
+    if (te->id <= max_id && te->when_ms <= now) {
+      long long next = te->proc(el, te->id, te->data);
+      processed++;
+      if (next == EL_NOMORE) {
+        te->deleted = true;
+      } else {
+        te->when_ms = __monotonic_ms() + next;
+      }
+      now = __monotonic_ms();
+    }
+    link = &te->next;
+  }
+  return processed;
+}
+
+/* A cycle runs from the poll returning to the end of the next before_sleep,
+ * which flushes the replies its events produced */
+static void __end_cycle(EventLoop *el) {
+  if (el->woke_us == 0) {
+    return;
+  }
+  long long us = el_monotonic_us() - el->woke_us;
+  el->stats.cycles++;
+  el->stats.duration_us += us;
+  el->stats.last_duration_us = us;
+  if (us > el->stats.max_duration_us) {
+    el->stats.max_duration_us = us;
+  }
+}
+
+static long long __monotonic_ms(void) { return el_monotonic_us() / 1000; }
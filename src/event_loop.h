@@ -0,0 +1,75 @@
+#ifndef REDIS_C_EVENT_LOOP_H__
+#define REDIS_C_EVENT_LOOP_H__
+
+#include <stdbool.h>
+
+/*
+ * Single-threaded reactor: file events are multiplexed with epoll on Linux and
+ * kqueue on macOS/BSD, timers are kept in a small unsorted list (there are only
+ * a handful of them), and an optional hook runs before the loop blocks, which
+ * is where buffered replies get flushed.
+ */
+
+#define EL_OK 0
+#define EL_ERR -1
+
+#define EL_NONE 0
+#define EL_READABLE 1
+#define EL_WRITABLE 2
+
+/* returned by a timer callback to unregister itself */
+#define EL_NOMORE -1
+
+#define EL_FILE_EVENTS 1
+#define EL_TIME_EVENTS 2
+#define EL_ALL_EVENTS (EL_FILE_EVENTS | EL_TIME_EVENTS)
+#define EL_DONT_WAIT 4
+
+typedef struct EventLoop EventLoop;
+
+typedef void (*FileEventProc)(EventLoop *el, int fd, void *data, int mask);
+/* Return the delay in ms until the next run, or EL_NOMORE. */
+typedef long long (*TimeEventProc)(EventLoop *el, long long id, void *data);
+typedef void (*BeforeSleepProc)(EventLoop *el);
+
+/*
+ * Time spent handling events, kept by el_main. A cycle starts when the poll
+ * returns and ends after the before_sleep hook that follows, so it covers
+ * the commands run and the replies written for one batch of events: the
+ * "tick" a request that arrives meanwhile has to wait for.
+ */
+typedef struct {
+    unsigned long long cycles;
+    long long duration_us;      /* all cycles */
+    long long max_duration_us;
+    long long last_duration_us;
+} ElStats;
+
+EventLoop *el_create(int setsize);
+void el_destroy(EventLoop *el);
+int el_get_setsize(EventLoop *el);
+
+int el_add_file_event(EventLoop *el, int fd, int mask, FileEventProc proc,
+                      void *data);
+void el_del_file_event(EventLoop *el, int fd, int mask);
+int el_get_file_events(EventLoop *el, int fd);
+
+long long el_add_time_event(EventLoop *el, long long ms, TimeEventProc proc,
+                            void *data);
+int el_del_time_event(EventLoop *el, long long id);
+
+void el_set_before_sleep(EventLoop *el, BeforeSleepProc proc);
+
+/* Process pending events once; returns how many events were handled. */
+int el_process_events(EventLoop *el, int flags);
+void el_main(EventLoop *el);
+void el_stop(EventLoop *el);
+void el_get_stats(EventLoop *el, ElStats *stats);
+
+/* Wall clock in milliseconds / microseconds. */
+long long el_mstime(void);
+long long el_ustime(void);
+/* Microseconds on a clock that never jumps, for measuring durations. */
+long long el_monotonic_us(void);
+
+#endif
@@ -0,0 +1,155 @@
+#include "io_threads.h"
+#include "logging.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define IO_THREADS_SPIN 1000000
+
+typedef struct {
+  pthread_t tid;
+  int id;
+  /* held by the main thread while the worker is parked */
+  pthread_mutex_t lock;
+  /* set by the main thread when a batch is published, cleared when done */
+  atomic_int pending;
+} IoThread;
+
+static IoThread g_threads[IO_THREADS_MAX];
+static int g_num = 1;
+static bool g_active = false;
+static atomic_bool g_shutdown = false;
+
+/* the batch being processed; only written while every worker is idle */
+static void **g_items = NULL;
+static size_t g_nitems = 0;
+static IoJobProc g_proc = NULL;
+
+/* private functions */
+static void *__thread_main(void *arg);
+static void __run_share(int id);
+static void __start(void);
+static void __stop(void);
+
+REDIS_RC io_threads_init(int num) {
+  if (num > IO_THREADS_MAX) {
+    return REDIS_INVALID_ARGUMENT;
+  }
+  g_num = num < 1 ? 1 : num;
+  for (int i = 1; i < g_num; i++) {
+    IoThread *t = &g_threads[i];
+    t->id = i;
+    atomic_init(&t->pending, 0);
+    pthread_mutex_init(&t->lock, NULL);
+    /* workers start parked */
+    pthread_mutex_lock(&t->lock);
+    if (pthread_create(&t->tid, NULL, __thread_main, t) != 0) {
+      LOG_ERROR("Unable to create I/O thread %d", i);
+      pthread_mutex_unlock(&t->lock);
+      pthread_mutex_destroy(&t->lock);
+      g_num = i;
+      io_threads_shutdown();
+      return REDIS_OUT_OF_MEMORY;
+    }
+  }
+  return REDIS_OK;
+}
+
+void io_threads_shutdown(void) {
+  atomic_store(&g_shutdown, true);
+  if (!g_active) {
+    __start();
+  }
+  for (int i = 1; i < g_num; i++) {
+    pthread_join(g_threads[i].tid, NULL);
+    pthread_mutex_destroy(&g_threads[i].lock);
+  }
+  g_active = false;
+  g_num = 1;
+  atomic_store(&g_shutdown, false);
+}
+
+int io_threads_num(void) { return g_num; }
+
+void io_threads_run(void **items, size_t n, IoJobProc proc) {
+  if (g_num == 1 || n < (size_t)g_num * 2) {
+    io_threads_pause();
+    for (size_t i = 0; i < n; i++) {
+      proc(items[i]);
+    }
+    return;
+  }
+  if (!g_active) {
+    __start();
+  }
+
+  g_items = items;
+  g_nitems = n;
+  g_proc = proc;
+  for (int i = 1; i < g_num; i++) {
+    atomic_store_explicit(&g_threads[i].pending, 1, memory_order_release);
+  }
+  __run_share(0);
+  for (int i = 1; i < g_num; i++) {
+    while (atomic_load_explicit(&g_threads[i].pending, memory_order_acquire)) {
+    }
+  }
+  g_items = NULL;
+  g_nitems = 0;
+  g_proc = NULL;
+}
+
+void io_threads_pause(void) {
+  if (g_active) {
+    __stop();
+  }
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static void *__thread_main(void *arg) {
+  IoThread *t = arg;
+  for (;;) {
+    /* spin for a while before checking whether we should park */
+    for (int i = 0; i < IO_THREADS_SPIN; i++) {
+      if (atomic_load_explicit(&t->pending, memory_order_acquire)) {
+        break;
+      }
+    }
+    if (!atomic_load_explicit(&t->pending, memory_order_acquire)) {
+      if (atomic_load(&g_shutdown)) {
+        return NULL;
+      }
+      pthread_mutex_lock(&t->lock);
+      pthread_mutex_unlock(&t->lock);
+      continue;
+    }
+
+    __run_share(t->id);
+    atomic_store_explicit(&t->pending, 0, memory_order_release);
+  }
+  return NULL;
+}
+
+/* Thread `id` owns items id, id + g_num, id + 2 * g_num, ... */
+static void __run_share(int id) {
+  for (size_t i = (size_t)id; i < g_nitems; i += (size_t)g_num) {
+    g_proc(g_items[i]);
+  }
+}
+
+static void __start(void) {
+  for (int i = 1; i < g_num; i++) {
+    pthread_mutex_unlock(&g_threads[i].lock);
+  }
+  g_active = true;
+}
+
+static void __stop(void) {
+  for (int i = 1; i < g_num; i++) {
+    pthread_mutex_lock(&g_threads[i].lock);
+  }
+  g_active = false;
+}
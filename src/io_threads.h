@@ -0,0 +1,34 @@
+#ifndef REDIS_C_IO_THREADS_H__
+#define REDIS_C_IO_THREADS_H__
+
+#include "redis-C/rc.h"
+#include <stddef.h>
+
+/*
+ * Optional pool of I/O threads (the Redis 6 `io-threads` model). The main
+ * thread hands a batch of items to io_threads_run(), which splits it
+ * round-robin between the workers and itself and returns once every item has
+ * been processed. Workers only ever run during that call, so the job function
+ * may touch per-item state freely but nothing shared (keyspace, event loop).
+ *
+ * Workers busy-wait for jobs while the pool is active and park on a mutex when
+ * the load is too low to be worth it; io_threads_pause() parks them explicitly.
+ */
+
+#define IO_THREADS_MAX 128
+
+typedef void (*IoJobProc)(void *item);
+
+/* `num` counts the main thread; 1 (or less) keeps all I/O on the main thread. */
+REDIS_RC io_threads_init(int num);
+void io_threads_shutdown(void);
+/* Number of threads taking part in a batch, the main thread included. */
+int io_threads_num(void);
+/*
+ * Run `proc` on every item. Small batches (fewer than two items per thread)
+ * are processed inline and park the workers.
+ */
+void io_threads_run(void **items, size_t n, IoJobProc proc);
+void io_threads_pause(void);
+
+#endif
@@ -0,0 +1,122 @@
+#include "latency.h"
+#include <pthread.h>
+#include <strings.h>
+#include <time.h>
+
+typedef struct {
+  LatencySample samples[LATENCY_HISTORY_LEN];
+  size_t next; /* slot of the next sample */
+  size_t len;
+  uint32_t max_ms;
+} LatencyHistory;
+
+static const char *g_event_names[LATENCY_EVENT_COUNT] = {
+    [LATENCY_COMMAND] = "command",
+    [LATENCY_FAST_COMMAND] = "fast-command",
+    [LATENCY_EVENTLOOP] = "eventloop",
+    [LATENCY_EXPIRE_CYCLE] = "expire-cycle",
+    [LATENCY_EVICTION_CYCLE] = "eviction-cycle",
+    [LATENCY_AOF_WRITE] = "aof-write",
+    [LATENCY_FORK] = "fork",
+};
+
+uint64_t g_latency_threshold_us = 0;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static LatencyHistory g_history[LATENCY_EVENT_COUNT];
+
+/* private functions */
+static void __update_max(LatencyHistory *h);
+
+void latency_set_threshold_ms(long long ms) {
+  g_latency_threshold_us = ms > 0 ? (uint64_t)ms * 1000 : 0;
+}
+
+void latency_add_sample(LatencyEvent event, uint64_t us) {
+  int64_t now = (int64_t)time(NULL);
+  uint64_t ms = us / 1000;
+  uint32_t latency_ms = ms > UINT32_MAX ? UINT32_MAX : (uint32_t)ms;
+
+  pthread_mutex_lock(&g_lock);
+  LatencyHistory *h = &g_history[event];
+  LatencySample *prev =
+      h->len ? &h->samples[(h->next + LATENCY_HISTORY_LEN - 1) %
+                           LATENCY_HISTORY_LEN]
+             : NULL;
+  if (prev && prev->time == now) {
+    if (latency_ms > prev->latency_ms) {
+      prev->latency_ms = latency_ms;
+    }
+  } else {
+    h->samples[h->next] = (LatencySample){now, latency_ms};
+    h->next = (h->next + 1) % LATENCY_HISTORY_LEN;
+    if (h->len < LATENCY_HISTORY_LEN) {
+      h->len++;
+    }
+  }
+  /* the sample pushed out may have been the largest */
+  __update_max(h);
+  pthread_mutex_unlock(&g_lock);
+}
+
+const char *latency_event_name(LatencyEvent event) {
+  return g_event_names[event];
+}
+
+bool latency_event_by_name(const char *name, LatencyEvent *event) {
+  for (int i = 0; i < LATENCY_EVENT_COUNT; i++) {
+    if (strcasecmp(name, g_event_names[i]) == 0) {
+      *event = (LatencyEvent)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool latency_latest(LatencyEvent event, LatencySample *latest,
+                    uint32_t *max_ms) {
+  pthread_mutex_lock(&g_lock);
+  LatencyHistory *h = &g_history[event];
+  bool found = h->len > 0;
+  if (found) {
+    *latest = h->samples[(h->next + LATENCY_HISTORY_LEN - 1) %
+                         LATENCY_HISTORY_LEN];
+    *max_ms = h->max_ms;
+  }
+  pthread_mutex_unlock(&g_lock);
+  return found;
+}
+
+size_t latency_history(LatencyEvent event, LatencySample *out) {
+  pthread_mutex_lock(&g_lock);
+  LatencyHistory *h = &g_history[event];
+  size_t first = (h->next + LATENCY_HISTORY_LEN - h->len) % LATENCY_HISTORY_LEN;
+  for (size_t i = 0; i < h->len; i++) {
+    out[i] = h->samples[(first + i) % LATENCY_HISTORY_LEN];
+  }
+  size_t len = h->len;
+  pthread_mutex_unlock(&g_lock);
+  return len;
+}
+
+bool latency_reset(LatencyEvent event) {
+  pthread_mutex_lock(&g_lock);
+  LatencyHistory *h = &g_history[event];
+  bool had = h->len > 0;
+  h->next = h->len = 0;
+  h->max_ms = 0;
+  pthread_mutex_unlock(&g_lock);
+  return had;
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static void __update_max(LatencyHistory *h) {
+  h->max_ms = 0;
+  for (size_t i = 0; i < h->len; i++) {
+    if (h->samples[i].latency_ms > h->max_ms) {
+      h->max_ms = h->samples[i].latency_ms;
+    }
+  }
+}
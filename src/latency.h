@@ -0,0 +1,73 @@
+#ifndef REDIS_C_LATENCY_H__
+#define REDIS_C_LATENCY_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Latency monitor: each kind of event that can stall the event loop keeps a
+ * history of the last LATENCY_HISTORY_LEN seconds in which it took at least
+ * the threshold (--latency-monitor-threshold, in ms). Only the comparison
+ * against the threshold runs on the hot path; recording a sample takes a
+ * lock shared by the shards, which is cheap next to the stall it reports.
+ * Several samples within one second keep the largest.
+ */
+
+#define LATENCY_HISTORY_LEN 160
+
+typedef enum {
+  LATENCY_COMMAND = 0,     /* a command not flagged fast */
+  LATENCY_FAST_COMMAND,    /* an O(1) or O(log N) command */
+  LATENCY_EVENTLOOP,       /* one event loop cycle, see ElStats */
+  LATENCY_EXPIRE_CYCLE,    /* an active expiry round from the cron */
+  LATENCY_EVICTION_CYCLE,  /* evicting keys down to maxmemory */
+  LATENCY_AOF_WRITE,       /* writing (and fsyncing) the AOF buffer */
+  LATENCY_FORK,            /* fork() for a background save or rewrite */
+  LATENCY_EVENT_COUNT
+} LatencyEvent;
+
+typedef struct {
+  int64_t time;        /* unix time, seconds */
+  uint32_t latency_ms;
+} LatencySample;
+
+/* Samples taking at least this long are recorded; 0 disables the monitor. */
+extern uint64_t g_latency_threshold_us;
+
+void latency_set_threshold_ms(long long ms);
+
+static inline bool latency_monitored(uint64_t us) {
+  return g_latency_threshold_us != 0 && us >= g_latency_threshold_us;
+}
+
+/* Record `us` for `event` regardless of the threshold. */
+void latency_add_sample(LatencyEvent event, uint64_t us);
+
+static inline void latency_add_sample_if_needed(LatencyEvent event,
+                                                uint64_t us) {
+  if (latency_monitored(us)) {
+    latency_add_sample(event, us);
+  }
+}
+
+/* Event name as LATENCY reports it, e.g. "fast-command". */
+const char *latency_event_name(LatencyEvent event);
+/* Case-insensitive inverse of latency_event_name. */
+bool latency_event_by_name(const char *name, LatencyEvent *event);
+
+/*
+ * The newest sample of `event` and the largest in its history; false when
+ * it has none.
+ */
+bool latency_latest(LatencyEvent event, LatencySample *latest,
+                    uint32_t *max_ms);
+/*
+ * Copy the history of `event`, oldest first, into `out`
+ * (LATENCY_HISTORY_LEN entries); returns the number of samples.
+ */
+size_t latency_history(LatencyEvent event, LatencySample *out);
+/* Drop the history of `event`; false when it had none. */
+bool latency_reset(LatencyEvent event);
+
+#endif
@@ -0,0 +1,103 @@
+#include "lazyfree.h"
+#include "bio.h"
+#include "data_structure/bloom_filter.h"
+#include "data_structure/count_min_sketch.h"
+#include "data_structure/cuckoo_filter.h"
+#include "data_structure/hyperloglog.h"
+#include "data_structure/sorted_set.h"
+#include "data_structure/top_k.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct {
+  Dict *keyspace;
+  Dict *expires;
+} KeyspaceJob;
+
+static _Atomic size_t g_freed_objects = 0;
+
+/* private functions */
+static void __free_object_job(void *arg);
+static void __free_keyspace_job(void *arg);
+static size_t __pages(size_t bytes);
+
+size_t lazyfree_effort(const RedisObject *o) {
+  switch (o->type) {
+  case OBJ_STRING:
+    /* INT and EMBSTR values live in the header */
+    return o->encoding == OBJ_ENCODING_RAW
+               ? __pages(((const StringBuffer *)o->ptr)->len)
+               : 1;
+  case OBJ_ZSET:
+    return zset_card((const SortedSet *)o->ptr);
+  case OBJ_CMS:
+    return __pages(cms_memory_usage((const CountMinSketch *)o->ptr));
+  case OBJ_BLOOM:
+    return __pages(bloom_memory_usage((const BloomFilter *)o->ptr));
+  case OBJ_CUCKOO:
+    return __pages(cuckoo_memory_usage((const CuckooFilter *)o->ptr));
+  case OBJ_HLL:
+    return __pages(hll_memory_usage((const HyperLogLog *)o->ptr));
+  case OBJ_TOPK:
+    return __pages(topk_memory_usage((const TopK *)o->ptr));
+  default:
+    return 1;
+  }
+}
+
+void lazyfree_free_object(RedisObject *o) {
+  if (!o) {
+    return;
+  }
+  if (lazyfree_effort(o) <= LAZYFREE_THRESHOLD ||
+      REDIS_FAILED(bio_submit(BIO_LAZY_FREE, __free_object_job, o))) {
+    object_free(o);
+  }
+}
+
+void lazyfree_free_keyspace(Dict *keyspace, Dict *expires) {
+  size_t keys = keyspace ? dict_size(keyspace) : 0;
+  KeyspaceJob *job = NULL;
+  if (keys > LAZYFREE_THRESHOLD) {
+    job = malloc(sizeof(KeyspaceJob));
+  }
+  if (job) {
+    job->keyspace = keyspace;
+    job->expires = expires;
+    if (REDIS_SUCCESS(bio_submit(BIO_LAZY_FREE, __free_keyspace_job, job))) {
+      return;
+    }
+    free(job);
+  }
+  dict_destroy(keyspace);
+  dict_destroy(expires);
+}
+
+unsigned long lazyfree_pending(void) { return bio_pending(BIO_LAZY_FREE); }
+
+void lazyfree_drain(void) { bio_drain(BIO_LAZY_FREE); }
+
+size_t lazyfree_freed_objects(void) {
+  return atomic_load_explicit(&g_freed_objects, memory_order_relaxed);
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static void __free_object_job(void *arg) {
+  object_free((RedisObject *)arg);
+  atomic_fetch_add_explicit(&g_freed_objects, 1, memory_order_relaxed);
+}
+
+static void __free_keyspace_job(void *arg) {
+  KeyspaceJob *job = (KeyspaceJob *)arg;
+  size_t keys = dict_size(job->keyspace);
+  dict_destroy(job->keyspace);
+  dict_destroy(job->expires);
+  free(job);
+  atomic_fetch_add_explicit(&g_freed_objects, keys, memory_order_relaxed);
+}
+
+static size_t __pages(size_t bytes) {
+  return bytes / LAZYFREE_PAGE_SIZE + 1;
+}
@@ -0,0 +1,46 @@
+#ifndef REDIS_C_LAZYFREE_H__
+#define REDIS_C_LAZYFREE_H__
+
+#include "object.h"
+#include "util/dict.h"
+#include <stddef.h>
+
+/*
+ * Lazy free: releasing a value that owns many allocations (a sorted set
+ * frees a skip list node, a dictionary entry and a member per element) or
+ * one large block (the counters of a sketch or a filter, unmapped page by
+ * page) can block the event loop for hundreds of milliseconds. Once it is
+ * unlinked from the keyspace such a value is unreachable by clients, so it
+ * is handed to the BIO_LAZY_FREE thread instead. Small values are freed
+ * inline: queueing them would cost more than freeing them.
+ *
+ * Freeing on another thread is safe because a value shares no state with
+ * the rest of the keyspace and the mem_* counters are atomic; used memory
+ * drops once the job has run.
+ */
+
+/* Values whose free effort is above this are freed in the background */
+#define LAZYFREE_THRESHOLD 64
+/* A large block counts one unit of effort per page it spans */
+#define LAZYFREE_PAGE_SIZE 4096
+
+/*
+ * Roughly the cost of freeing `o`: its number of allocations, or the pages
+ * of its largest block. O(1).
+ */
+size_t lazyfree_effort(const RedisObject *o);
+/* Free `o` now, or on the lazy-free thread when its effort is large. */
+void lazyfree_free_object(RedisObject *o);
+/*
+ * Destroy a detached keyspace and its expiry dictionary (either may be
+ * NULL), in the background when it holds more than LAZYFREE_THRESHOLD keys.
+ */
+void lazyfree_free_keyspace(Dict *keyspace, Dict *expires);
+/* Objects and keyspaces queued for a background free, or being freed. */
+unsigned long lazyfree_pending(void);
+/* Wait until everything queued so far has been freed. */
+void lazyfree_drain(void);
+/* Objects freed in the background since startup. */
+size_t lazyfree_freed_objects(void);
+
+#endif
@@ -0,0 +1,5 @@
+#include "logging.h"
+
+int g_log_verbosity = LOG_LEVEL;
+
+void log_set_verbosity(int level) { g_log_verbosity = level; }
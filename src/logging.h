@@ -60,17 +60,29 @@
 
 #define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 
+/*
+ * Messages above LOG_LEVEL are compiled out. The rest are also filtered at
+ * run time against the verbosity (--loglevel), one predictable branch on a
+ * global that only changes at startup, so a message left in a hot path
+ * costs a comparison when it is not wanted.
+ */
+extern int g_log_verbosity;
+#define LOG_ENABLED(level) __builtin_expect((level) <= g_log_verbosity, 0)
+
+/* Set the run-time verbosity; messages above LOG_LEVEL stay compiled out. */
+void log_set_verbosity(int level);
+
 /* safe readable version of errno */
 #define clean_errno() (errno == 0 ? "None" : strerror(errno))
 
-#define LOG_EMERG(M, ...)   do { fprintf(stderr, RED    "[EMERG]   " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
-#define LOG_ALERT(M, ...)   do { fprintf(stderr, PURPLE "[ALERT]   " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
-#define LOG_CRIT(M, ...)    do { fprintf(stderr, YELLOW "[CRIT]    " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
-#define LOG_ERROR(M, ...)     do { fprintf(stderr, BROWN  "[ERR]     " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
-#define LOG_WARNING(M, ...) do { fprintf(stderr, BLUE   "[WARNING] " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
-#define LOG_NOTICE(M, ...)  do { fprintf(stderr, CYAN   "[NOTICE]  " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
-#define LOG_INFO(M, ...)    do { fprintf(stderr, GREEN  "[INFO]    " "%s (%s:%d) " NONE M "\n", __func__, __FILENAME__, __LINE__, ##__VA_ARGS__); } while(0)
-#define LOG_DEBUG(M, ...)   do { fprintf(stderr, GRAY   "[DEBUG]   " "%s (%s:%d) " NONE M "\n", __func__, __FILENAME__, __LINE__, ##__VA_ARGS__); } while(0)
+#define LOG_EMERG(M, ...)   do { if (LOG_ENABLED(EMERG)) fprintf(stderr, RED    "[EMERG]   " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
+#define LOG_ALERT(M, ...)   do { if (LOG_ENABLED(ALERT)) fprintf(stderr, PURPLE "[ALERT]   " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
+#define LOG_CRIT(M, ...)    do { if (LOG_ENABLED(CRIT)) fprintf(stderr, YELLOW "[CRIT]    " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
+#define LOG_ERROR(M, ...)     do { if (LOG_ENABLED(ERR)) fprintf(stderr, BROWN  "[ERR]     " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
+#define LOG_WARNING(M, ...) do { if (LOG_ENABLED(WARNING)) fprintf(stderr, BLUE   "[WARNING] " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
+#define LOG_NOTICE(M, ...)  do { if (LOG_ENABLED(NOTICE)) fprintf(stderr, CYAN   "[NOTICE]  " "%s (%s:%d) " NONE M YELLOW " errno: %s\n" NONE, __func__, __FILENAME__, __LINE__, ##__VA_ARGS__, clean_errno()); } while(0)
+#define LOG_INFO(M, ...)    do { if (LOG_ENABLED(INFO)) fprintf(stderr, GREEN  "[INFO]    " "%s (%s:%d) " NONE M "\n", __func__, __FILENAME__, __LINE__, ##__VA_ARGS__); } while(0)
+#define LOG_DEBUG(M, ...)   do { if (LOG_ENABLED(DEBUG)) fprintf(stderr, GRAY   "[DEBUG]   " "%s (%s:%d) " NONE M "\n", __func__, __FILENAME__, __LINE__, ##__VA_ARGS__); } while(0)
 
 /* LOG_LEVEL controls */
 #if LOG_LEVEL < DEBUG
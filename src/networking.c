@@ -0,0 +1,619 @@
+#include "networking.h"
+#include "cluster.h"
+#include "cmd_handler.h"
+#include "io_threads.h"
+#include "logging.h"
+#include "replication.h"
+#include "shard.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define MAX_ACCEPTS_PER_CALL 1000
+/* iovecs per writev(): buffer stretches and referenced values alternate */
+#define MAX_WRITE_IOV 16
+
+/* per thread: in sharded mode every shard runs its own copy */
+static _Thread_local EventLoop *g_el = NULL;
+static _Thread_local int g_listen_fd = -1;
+static _Thread_local Connection **g_conns = NULL; /* indexed by fd */
+static _Thread_local int g_conns_size = 0;
+static _Thread_local unsigned long g_connected = 0;
+static _Thread_local uint64_t g_next_conn_id = 1;
+static _Thread_local Connection *g_pending_writes = NULL;
+static _Thread_local Connection *g_pending_reads = NULL;
+/* scratch array handed to I/O threads */
+static _Thread_local Connection **g_io_batch = NULL;
+static _Thread_local size_t g_io_batch_cap = 0;
+
+/* private functions */
+static int __set_nonblock(int fd);
+static void __accept_handler(EventLoop *el, int fd, void *data, int mask);
+static void __read_handler(EventLoop *el, int fd, void *data, int mask);
+static void __write_handler(EventLoop *el, int fd, void *data, int mask);
+static Connection *__conn_create(int fd, const struct sockaddr_storage *sa);
+static void __conn_detach(Connection *c);
+static void __conn_free(Connection *c);
+static void __format_addr(const struct sockaddr_storage *sa, char *buf,
+                          size_t len);
+static bool __read_from_client(Connection *c);
+static void __process_input(Connection *c);
+static void __execute(Connection *c);
+static void __connection_command(Connection *c);
+static bool __write_reply(Connection *c);
+static bool __write_to_client(Connection *c);
+static void __queue_write(Connection *c);
+static void __unqueue_write(Connection *c);
+static void __unqueue_read(Connection *c);
+static size_t __collect_batch(Connection **head, bool reads);
+static void __threaded_read(void *item);
+static void __threaded_write(void *item);
+static void __handle_pending_reads(void);
+static void __handle_pending_writes(void);
+
+REDIS_RC net_init(EventLoop *el, int port) {
+  g_el = el;
+  g_conns_size = el_get_setsize(el);
+  g_conns = calloc(g_conns_size, sizeof(Connection *));
+  if (!g_conns) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) {
+    LOG_ERROR("socket() failed");
+    return REDIS_CMD_CONNECTION_FAILED;
+  }
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  if (shard_count() > 1) {
+    /* every shard binds the port, the kernel balances new connections */
+#ifdef SO_REUSEPORT
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+#else
+    LOG_ERROR("Sharded mode needs SO_REUSEPORT");
+    close(fd);
+    return REDIS_CMD_CONNECTION_FAILED;
+#endif
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(fd, NET_LISTEN_BACKLOG) == -1 || __set_nonblock(fd) == -1) {
+    LOG_ERROR("Unable to listen on port %d", port);
+    close(fd);
+    return REDIS_CMD_CONNECTION_FAILED;
+  }
+  if (el_add_file_event(el, fd, EL_READABLE, __accept_handler, NULL) ==
+      EL_ERR) {
+    close(fd);
+    return REDIS_CMD_CONNECTION_FAILED;
+  }
+  g_listen_fd = fd;
+  return REDIS_OK;
+}
+
+void net_handle_pending_reads(void) { __handle_pending_reads(); }
+
+void net_before_sleep(EventLoop *el) {
+  (void)el;
+  if (!g_pending_writes) {
+    io_threads_pause();
+    return;
+  }
+  __handle_pending_writes();
+}
+
+void net_shutdown(void) {
+  for (int fd = 0; fd < g_conns_size; fd++) {
+    if (g_conns[fd]) {
+      __conn_free(g_conns[fd]);
+    }
+  }
+  if (g_listen_fd != -1) {
+    el_del_file_event(g_el, g_listen_fd, EL_READABLE);
+    close(g_listen_fd);
+    g_listen_fd = -1;
+  }
+  free(g_conns);
+  g_conns = NULL;
+  g_conns_size = 0;
+  free(g_io_batch);
+  g_io_batch = NULL;
+  g_io_batch_cap = 0;
+}
+
+unsigned long net_connected_clients(void) { return g_connected; }
+
+void net_forward_done(int fd, uint64_t conn_id, const ReplyBuffer *reply) {
+  if (fd < 0 || fd >= g_conns_size) {
+    return;
+  }
+  Connection *c = g_conns[fd];
+  if (!c || c->id != conn_id) {
+    return; /* the client went away meanwhile */
+  }
+  reply_add_raw(&c->reply, reply->buf, reply->len);
+  c->flags &= ~CONN_BLOCKED;
+  __process_input(c);
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static int __set_nonblock(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags == -1) {
+    return -1;
+  }
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void __accept_handler(EventLoop *el, int fd, void *data, int mask) {
+  (void)data;
+  (void)mask;
+  for (int i = 0; i < MAX_ACCEPTS_PER_CALL; i++) {
+    struct sockaddr_storage sa;
+    socklen_t sa_len = sizeof(sa);
+    int cfd = accept(fd, (struct sockaddr *)&sa, &sa_len);
+    if (cfd == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        LOG_WARNING("accept() failed");
+      }
+      return;
+    }
+    if (g_connected >= NET_MAX_CLIENTS || cfd >= g_conns_size) {
+      const char *err = "-ERR max number of clients reached\r\n";
+      if (write(cfd, err, strlen(err)) == -1) {
+        /* nothing to do, the client is dropped anyway */
+      }
+      close(cfd);
+      continue;
+    }
+    int yes = 1;
+    __set_nonblock(cfd);
+    setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    Connection *c = __conn_create(cfd, &sa);
+    if (!c || el_add_file_event(el, cfd, EL_READABLE, __read_handler, c) ==
+                  EL_ERR) {
+      if (c) {
+        __conn_free(c);
+      } else {
+        close(cfd);
+      }
+    }
+  }
+}
+
+static void __read_handler(EventLoop *el, int fd, void *data, int mask) {
+  (void)el;
+  (void)fd;
+  (void)mask;
+  Connection *c = data;
+
+  if (io_threads_num() > 1) {
+    /* defer to net_before_sleep(), which spreads reads over the threads */
+    if (!(c->flags & CONN_PENDING_READ)) {
+      c->flags |= CONN_PENDING_READ;
+      c->pending_read_next = g_pending_reads;
+      g_pending_reads = c;
+    }
+    return;
+  }
+  if (!__read_from_client(c)) {
+    __conn_free(c);
+    return;
+  }
+  __process_input(c);
+}
+
+static void __write_handler(EventLoop *el, int fd, void *data, int mask) {
+  (void)fd;
+  (void)mask;
+  Connection *c = data;
+  if (!__write_to_client(c)) {
+    return;
+  }
+  if (c->sent == reply_length(&c->reply)) {
+    el_del_file_event(el, c->fd, EL_WRITABLE);
+  }
+}
+
+static Connection *__conn_create(int fd, const struct sockaddr_storage *sa) {
+  Connection *c = calloc(1, sizeof(Connection));
+  if (!c) {
+    return NULL;
+  }
+  c->fd = fd;
+  c->id = g_next_conn_id++;
+  __format_addr(sa, c->addr, sizeof(c->addr));
+  resp_parser_init(&c->parser);
+  reply_init(&c->reply, RESP_PROTO_2);
+  reply_allow_refs(&c->reply);
+  g_conns[fd] = c;
+  g_connected++;
+  return c;
+}
+
+/* Stop serving the socket, which stays open */
+static void __conn_detach(Connection *c) {
+  if (c->flags & CONN_PENDING_WRITE) {
+    __unqueue_write(c);
+  }
+  if (c->flags & CONN_PENDING_READ) {
+    __unqueue_read(c);
+  }
+  el_del_file_event(g_el, c->fd, EL_READABLE | EL_WRITABLE);
+  g_conns[c->fd] = NULL;
+  g_connected--;
+  c->flags |= CONN_DETACHED;
+}
+
+static void __conn_free(Connection *c) {
+  if (!(c->flags & CONN_DETACHED)) {
+    __conn_detach(c);
+    close(c->fd);
+  }
+  resp_parser_free(&c->parser);
+  reply_free(&c->reply);
+  free(c->querybuf);
+  free(c);
+}
+
+/* "ip:port" as Redis prints it, "[ip]:port" for IPv6 */
+static void __format_addr(const struct sockaddr_storage *sa, char *buf,
+                          size_t len) {
+  char ip[INET6_ADDRSTRLEN];
+  if (sa->ss_family == AF_INET) {
+    const struct sockaddr_in *in = (const struct sockaddr_in *)sa;
+    inet_ntop(AF_INET, &in->sin_addr, ip, sizeof(ip));
+    snprintf(buf, len, "%s:%d", ip, ntohs(in->sin_port));
+  } else if (sa->ss_family == AF_INET6) {
+    const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)sa;
+    inet_ntop(AF_INET6, &in6->sin6_addr, ip, sizeof(ip));
+    snprintf(buf, len, "[%s]:%d", ip, ntohs(in6->sin6_port));
+  } else {
+    snprintf(buf, len, "?:0");
+  }
+}
+
+/*
+ * Append whatever the socket has to the query buffer. Returns false when the
+ * connection must be closed; safe to call from an I/O thread.
+ */
+static bool __read_from_client(Connection *c) {
+  if (c->qb_cap - c->qb_len < NET_IOBUF_LEN) {
+    size_t cap = c->qb_cap ? c->qb_cap * 2 : NET_IOBUF_LEN;
+    while (cap - c->qb_len < NET_IOBUF_LEN) {
+      cap *= 2;
+    }
+    char *buf = realloc(c->querybuf, cap);
+    if (!buf) {
+      return false;
+    }
+    c->querybuf = buf;
+    c->qb_cap = cap;
+  }
+
+  ssize_t nread = read(c->fd, c->querybuf + c->qb_len, c->qb_cap - c->qb_len);
+  if (nread == -1) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  } else if (nread == 0) {
+    return false;
+  }
+  c->qb_len += (size_t)nread;
+  if (c->qb_len > NET_MAX_QUERYBUF_LEN) {
+    LOG_WARNING("Closing client that reached max query buffer length");
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Execute every complete command buffered so far. Replies accumulate in
+ * c->reply and are written in one go by net_before_sleep().
+ */
+static void __process_input(Connection *c) {
+  dispatch_batch_begin(c->addr);
+  while (c->qb_pos < c->qb_len &&
+         !(c->flags &
+           (CONN_CLOSE_AFTER_REPLY | CONN_BLOCKED | CONN_DETACHED))) {
+    RespStatus status;
+    if (c->flags & CONN_PENDING_COMMAND) {
+      /* already parsed by an I/O thread */
+      status = c->parsed;
+      c->flags &= ~CONN_PENDING_COMMAND;
+    } else {
+      status = resp_parse(&c->parser, c->querybuf + c->qb_pos,
+                          c->qb_len - c->qb_pos);
+    }
+    if (status == RESP_INCOMPLETE) {
+      break;
+    } else if (status == RESP_ERROR) {
+      reply_add_error_format(&c->reply, "ERR %s", c->parser.error);
+      c->flags |= CONN_CLOSE_AFTER_REPLY;
+      break;
+    }
+    __execute(c);
+    c->qb_pos += c->parser.pos;
+    resp_parser_reset(&c->parser);
+  }
+  dispatch_batch_end();
+  if (c->flags & CONN_DETACHED) {
+    __conn_free(c);
+    return;
+  }
+
+  /* keep only the partial command; parser offsets are relative to it */
+  if (c->qb_pos > 0) {
+    memmove(c->querybuf, c->querybuf + c->qb_pos, c->qb_len - c->qb_pos);
+    c->qb_len -= c->qb_pos;
+    c->qb_pos = 0;
+  }
+  /* a burst of large requests should not pin its buffer for good */
+  if (c->qb_len == 0 && c->qb_cap > NET_MAX_IDLE_BUF_LEN) {
+    free(c->querybuf);
+    c->querybuf = NULL;
+    c->qb_cap = 0;
+  }
+
+  if (c->reply.oom) {
+    LOG_WARNING("Closing client whose reply could not be buffered");
+    __conn_free(c);
+    return;
+  }
+  if (reply_length(&c->reply) > c->sent ||
+      (c->flags & CONN_CLOSE_AFTER_REPLY)) {
+    __queue_write(c);
+  }
+}
+
+/*
+ * Write as much of the reply as the socket takes, resetting the buffer once
+ * it is fully flushed. Returns false on a write error; safe to call from an
+ * I/O thread.
+ */
+static bool __write_reply(Connection *c) {
+  struct iovec iov[MAX_WRITE_IOV];
+  size_t total = reply_length(&c->reply);
+  while (c->sent < total) {
+    int iovcnt = reply_iov(&c->reply, c->sent, iov, MAX_WRITE_IOV);
+    ssize_t n = writev(c->fd, iov, iovcnt);
+    if (n == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true;
+      } else if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    c->sent += (size_t)n;
+  }
+
+  /* everything was flushed: the buffer is reused for the next batch */
+  reply_clear(&c->reply);
+  c->sent = 0;
+  if (c->reply.cap > NET_MAX_IDLE_BUF_LEN) {
+    reply_free(&c->reply);
+  }
+  return true;
+}
+
+/* Run the parsed command here, or on the shard that owns its keys. */
+static void __execute(Connection *c) {
+  RespParser *p = &c->parser;
+  if (cluster_enabled() && p->argc > 0) {
+    /* ASKING only holds for the command that follows it */
+    bool asking = c->flags & CONN_ASKING;
+    const RedisCommand *cmd = command_lookup(p->argv[0], p->arg_len[0]);
+    c->flags &= ~CONN_ASKING;
+    if (cmd && cmd->type == CMD_ASKING) {
+      c->flags |= CONN_ASKING;
+    }
+    if (!cluster_serves_request(p->argc, p->argv, p->arg_len, asking,
+                                &c->reply)) {
+      return;
+    }
+  }
+  int owner = shard_route(p->argc, p->argv, p->arg_len);
+  if (owner == shard_self()) {
+    if (dispatch_command(p->argc, p->argv, p->arg_len, &c->reply) ==
+        REDIS_CONN_COMMAND) {
+      __connection_command(c);
+    }
+  } else if (owner == -1) {
+    reply_add_error(&c->reply, redis_rc_message(REDIS_CROSS_SHARD));
+  } else if (REDIS_FAILED(shard_forward(owner, c->fd, c->id, c->addr,
+                                        c->reply.proto, p->argc, p->argv,
+                                        p->arg_len))) {
+    reply_add_error(&c->reply, redis_rc_message(REDIS_OUT_OF_MEMORY));
+  } else {
+    c->flags |= CONN_BLOCKED;
+  }
+}
+
+/*
+ * The commands dispatch_command() leaves to the connection: REPLCONF, and
+ * SYNC / PSYNC after which the socket carries the replication stream and
+ * belongs to replication.c.
+ */
+static void __connection_command(Connection *c) {
+  RespParser *p = &c->parser;
+  if (strcasecmp(p->argv[0], "REPLCONF") == 0) {
+    repl_replconf(p->argc, p->argv, p->arg_len, &c->replica_port, &c->reply);
+    return;
+  }
+  /* a replica waits for the answer to PSYNC before it sends anything else;
+   * what it was answered before (REPLCONF) goes out first */
+  if (c->qb_pos + p->pos < c->qb_len ||
+      (reply_length(&c->reply) > c->sent &&
+       (!__write_reply(c) || reply_length(&c->reply) > c->sent))) {
+    reply_add_error(&c->reply, "ERR SYNC and PSYNC cannot be pipelined");
+    return;
+  }
+  int fd = c->fd;
+  __conn_detach(c);
+  repl_add_replica(fd, c->addr, c->replica_port, p->argc, p->argv,
+                   p->arg_len);
+}
+
+/* Returns false when the connection was closed. */
+static bool __write_to_client(Connection *c) {
+  if (!__write_reply(c) ||
+      (c->sent == reply_length(&c->reply) &&
+       (c->flags & CONN_CLOSE_AFTER_REPLY))) {
+    __conn_free(c);
+    return false;
+  }
+  return true;
+}
+
+static void __queue_write(Connection *c) {
+  if (c->flags & CONN_PENDING_WRITE) {
+    return;
+  }
+  c->flags |= CONN_PENDING_WRITE;
+  c->pending_next = g_pending_writes;
+  g_pending_writes = c;
+}
+
+static void __unqueue_write(Connection *c) {
+  Connection **link = &g_pending_writes;
+  while (*link) {
+    if (*link == c) {
+      *link = c->pending_next;
+      break;
+    }
+    link = &(*link)->pending_next;
+  }
+  c->pending_next = NULL;
+  c->flags &= ~CONN_PENDING_WRITE;
+}
+
+static void __unqueue_read(Connection *c) {
+  Connection **link = &g_pending_reads;
+  while (*link) {
+    if (*link == c) {
+      *link = c->pending_read_next;
+      break;
+    }
+    link = &(*link)->pending_read_next;
+  }
+  c->pending_read_next = NULL;
+  c->flags &= ~CONN_PENDING_READ;
+}
+
+/*
+ * Move the connections queued on `*head` into g_io_batch, clearing their queue
+ * flag. If the batch cannot grow the rest stays queued.
+ */
+static size_t __collect_batch(Connection **head, bool reads) {
+  size_t n = 0;
+  Connection *c = *head;
+  while (c) {
+    if (n == g_io_batch_cap) {
+      size_t cap = g_io_batch_cap ? g_io_batch_cap * 2 : 64;
+      Connection **batch = realloc(g_io_batch, cap * sizeof(Connection *));
+      if (!batch) {
+        break;
+      }
+      g_io_batch = batch;
+      g_io_batch_cap = cap;
+    }
+    g_io_batch[n++] = c;
+    Connection *next;
+    if (reads) {
+      next = c->pending_read_next;
+      c->pending_read_next = NULL;
+      c->flags &= ~CONN_PENDING_READ;
+    } else {
+      next = c->pending_next;
+      c->pending_next = NULL;
+      c->flags &= ~CONN_PENDING_WRITE;
+    }
+    c = next;
+  }
+  *head = c;
+  return n;
+}
+
+static void __threaded_read(void *item) {
+  Connection *c = item;
+  if (!__read_from_client(c)) {
+    c->flags |= CONN_CLOSE_ASAP;
+    return;
+  }
+  if (c->qb_pos < c->qb_len && !(c->flags & CONN_CLOSE_AFTER_REPLY)) {
+    c->parsed = resp_parse(&c->parser, c->querybuf + c->qb_pos,
+                           c->qb_len - c->qb_pos);
+    c->flags |= CONN_PENDING_COMMAND;
+  }
+}
+
+static void __threaded_write(void *item) {
+  Connection *c = item;
+  if (!__write_reply(c)) {
+    c->flags |= CONN_CLOSE_ASAP;
+  }
+}
+
+/*
+ * Read and parse on the I/O threads, then execute on the main thread in the
+ * order the connections were handed out.
+ */
+static void __handle_pending_reads(void) {
+  while (g_pending_reads) {
+    size_t n = __collect_batch(&g_pending_reads, true);
+    if (n == 0) {
+      return;
+    }
+    io_threads_run((void **)g_io_batch, n, __threaded_read);
+    for (size_t i = 0; i < n; i++) {
+      Connection *c = g_io_batch[i];
+      if (c->flags & CONN_CLOSE_ASAP) {
+        __conn_free(c);
+      } else {
+        __process_input(c);
+      }
+    }
+  }
+}
+
+static void __handle_pending_writes(void) {
+  while (g_pending_writes) {
+    size_t n = __collect_batch(&g_pending_writes, false);
+    if (n == 0) {
+      return;
+    }
+    io_threads_run((void **)g_io_batch, n, __threaded_write);
+    for (size_t i = 0; i < n; i++) {
+      Connection *c = g_io_batch[i];
+      size_t total = reply_length(&c->reply);
+      if ((c->flags & CONN_CLOSE_ASAP) ||
+          (c->sent == total && (c->flags & CONN_CLOSE_AFTER_REPLY))) {
+        __conn_free(c);
+      } else if (c->sent < total &&
+                 !(el_get_file_events(g_el, c->fd) & EL_WRITABLE)) {
+        /* the socket buffer is full; finish from the writable handler */
+        if (el_add_file_event(g_el, c->fd, EL_WRITABLE, __write_handler, c) ==
+            EL_ERR) {
+          __conn_free(c);
+        }
+      }
+    }
+  }
+}
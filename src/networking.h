@@ -0,0 +1,75 @@
+#ifndef REDIS_C_NETWORKING_H__
+#define REDIS_C_NETWORKING_H__
+
+#include "event_loop.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NET_IOBUF_LEN (16 * 1024)
+/* Query and reply buffers above this are released once they are empty */
+#define NET_MAX_IDLE_BUF_LEN (64 * 1024)
+#define NET_MAX_QUERYBUF_LEN (1024L * 1024 * 1024)
+#define NET_MAX_CLIENTS 10000
+#define NET_LISTEN_BACKLOG 511
+/* "ip:port" of a client, IPv6 included */
+#define NET_ADDR_LEN 64
+
+#define CONN_CLOSE_AFTER_REPLY (1 << 0)
+#define CONN_PENDING_WRITE (1 << 1)
+#define CONN_PENDING_READ (1 << 2)   /* queued for a threaded read */
+#define CONN_PENDING_COMMAND (1 << 3) /* `parsed` holds the first resp_parse() */
+#define CONN_CLOSE_ASAP (1 << 4)     /* an I/O thread hit EOF or an error */
+#define CONN_BLOCKED (1 << 5)        /* waiting for another shard's reply */
+#define CONN_ASKING (1 << 6)         /* sent ASKING before this command */
+#define CONN_DETACHED (1 << 7)       /* the socket was handed over */
+
+/*
+ * One client connection. Everything read from the socket is appended to
+ * `querybuf`; every complete command in it is executed in order and the
+ * replies are appended to `reply`, which is flushed once per event-loop
+ * iteration, so a pipeline of N commands costs one read and one write.
+ * Both buffers live as long as the connection and are reused by every
+ * request. Large values are not copied into `reply`: it references them
+ * and they are written from the keyspace's own memory with writev().
+ *
+ * With I/O threads the read, the parse of the first command and the write
+ * happen on a worker; the flags below record what it did so the main thread
+ * can finish the job (execute commands, close the connection).
+ */
+typedef struct Connection {
+  int fd;
+  uint64_t id;    /* unique per shard, fds get reused */
+  char addr[NET_ADDR_LEN]; /* the peer, "ip:port" */
+  int flags;
+  char *querybuf;
+  size_t qb_len;  /* bytes buffered */
+  size_t qb_cap;
+  size_t qb_pos;  /* start of the first command not executed yet */
+  RespParser parser;
+  ReplyBuffer reply;
+  size_t sent;    /* bytes of `reply` already written (reply_length) */
+  RespStatus parsed;
+  int replica_port; /* from REPLCONF listening-port */
+  struct Connection *pending_next;
+  struct Connection *pending_read_next;
+} Connection;
+
+/* Start listening on `port` and accept clients from `el`. */
+REDIS_RC net_init(EventLoop *el, int port);
+/*
+ * Run the commands the I/O threads read during this iteration; call first
+ * thing before sleeping, so that what they log reaches the AOF before
+ * net_before_sleep() sends their replies.
+ */
+void net_handle_pending_reads(void);
+/* Flush the replies produced during this iteration; call before sleeping. */
+void net_before_sleep(EventLoop *el);
+void net_shutdown(void);
+unsigned long net_connected_clients(void);
+/* Deliver the reply of a command that ran on another shard. */
+void net_forward_done(int fd, uint64_t conn_id, const ReplyBuffer *reply);
+
+#endif
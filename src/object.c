@@ -0,0 +1,270 @@
+#include "object.h"
+#include "data_structure/bloom_filter.h"
+#include "data_structure/count_min_sketch.h"
+#include "data_structure/cuckoo_filter.h"
+#include "data_structure/hyperloglog.h"
+#include "data_structure/sorted_set.h"
+#include "data_structure/top_k.h"
+#include "util/mem.h"
+#include "util/str_util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* access tracking must fit in the header padding */
+_Static_assert(sizeof(RedisObject) == 16, "RedisObject grew");
+
+/* per thread: the LFU counter's coin flips */
+static _Thread_local uint64_t g_lfu_state = 0;
+
+/* private functions */
+static void __init_header(RedisObject *o, ObjectType type,
+                          ObjectEncoding encoding);
+static double __lfu_random(void);
+
+RedisObject *object_create(ObjectType type, void *ptr) {
+  RedisObject *o = mem_malloc(sizeof(RedisObject));
+  if (!o) {
+    return NULL;
+  }
+  __init_header(o, type, OBJ_ENCODING_RAW);
+  o->ptr = ptr;
+  return o;
+}
+
+RedisObject *object_create_string(const char *s, size_t len) {
+  long long value;
+  if (len < STR_UTIL_LL_SIZE && string_to_ll(s, len, &value)) {
+    /* Only canonical spellings, so GET returns the bytes that were SET */
+    char buf[STR_UTIL_LL_SIZE];
+    if (string_from_ll(buf, value) == len) {
+      return object_create_int(value);
+    }
+  }
+
+  if (len <= OBJ_EMBSTR_MAX_LEN) {
+    RedisObject *o = mem_malloc(sizeof(RedisObject) + 1 + len + 1);
+    if (!o) {
+      return NULL;
+    }
+    uint8_t *hdr = (uint8_t *)(o + 1);
+    hdr[0] = (uint8_t)len;
+    memcpy(hdr + 1, s, len);
+    hdr[1 + len] = '\0';
+    __init_header(o, OBJ_STRING, OBJ_ENCODING_EMBSTR);
+    o->ptr = hdr + 1;
+    return o;
+  }
+
+  StringBuffer *sb = mem_malloc(sizeof(StringBuffer) + len + 1);
+  if (!sb) {
+    return NULL;
+  }
+  sb->len = len;
+  atomic_init(&sb->refcount, 1);
+  memcpy(sb->buf, s, len);
+  sb->buf[len] = '\0';
+  RedisObject *o = object_create(OBJ_STRING, sb);
+  if (!o) {
+    mem_free(sb);
+  }
+  return o;
+}
+
+RedisObject *object_create_int(int64_t value) {
+  RedisObject *o = mem_malloc(sizeof(RedisObject));
+  if (!o) {
+    return NULL;
+  }
+  __init_header(o, OBJ_STRING, OBJ_ENCODING_INT);
+  o->ival = value;
+  return o;
+}
+
+const char *object_string(const RedisObject *o, size_t *len, char *ibuf) {
+  switch (o->encoding) {
+  case OBJ_ENCODING_INT:
+    *len = string_from_ll(ibuf, o->ival);
+    return ibuf;
+  case OBJ_ENCODING_EMBSTR:
+    *len = ((const uint8_t *)o->ptr)[-1];
+    return o->ptr;
+  default:
+    *len = ((const StringBuffer *)o->ptr)->len;
+    return ((const StringBuffer *)o->ptr)->buf;
+  }
+}
+
+StringBuffer *object_string_retain(const RedisObject *o) {
+  StringBuffer *sb = (StringBuffer *)o->ptr;
+  atomic_fetch_add_explicit(&sb->refcount, 1, memory_order_relaxed);
+  return sb;
+}
+
+void object_string_release(void *sb) {
+  StringBuffer *b = (StringBuffer *)sb;
+  if (atomic_fetch_sub_explicit(&b->refcount, 1, memory_order_acq_rel) == 1) {
+    mem_free(b);
+  }
+}
+
+bool object_string_to_int(const RedisObject *o, int64_t *value) {
+  if (o->encoding == OBJ_ENCODING_INT) {
+    *value = o->ival;
+    return true;
+  }
+  /* Non-canonical spellings such as "-0" are still numbers */
+  size_t len;
+  const char *s = object_string(o, &len, NULL);
+  long long v;
+  if (!string_to_ll(s, len, &v)) {
+    return false;
+  }
+  *value = v;
+  return true;
+}
+
+void object_set_int(RedisObject *o, int64_t value) {
+  /* EMBSTR bytes just go unused until the header is freed */
+  if (o->encoding == OBJ_ENCODING_RAW) {
+    object_string_release(o->ptr);
+  }
+  o->encoding = OBJ_ENCODING_INT;
+  o->ival = value;
+}
+
+uint32_t object_clock(void) { return (uint32_t)time(NULL); }
+
+void object_touch(RedisObject *o) {
+  uint8_t lfu = object_lfu(o);
+  if (lfu < UINT8_MAX) {
+    double base = lfu > OBJ_LFU_INIT_VAL ? lfu - OBJ_LFU_INIT_VAL : 0;
+    if (__lfu_random() < 1.0 / (base * OBJ_LFU_LOG_FACTOR + 1)) {
+      lfu++;
+    }
+  }
+  o->lfu = lfu;
+  o->atime = object_clock();
+}
+
+uint32_t object_idle_time(const RedisObject *o) {
+  /* unsigned arithmetic, so the clock wrapping is harmless */
+  return object_clock() - o->atime;
+}
+
+uint8_t object_lfu(const RedisObject *o) {
+  uint32_t periods = object_idle_time(o) / OBJ_LFU_DECAY_SECONDS;
+  return periods >= o->lfu ? 0 : (uint8_t)(o->lfu - periods);
+}
+
+void object_free(RedisObject *o) {
+  if (!o) {
+    return;
+  }
+  switch (o->type) {
+  case OBJ_STRING:
+    /* INT and EMBSTR values are part of the header allocation */
+    if (o->encoding == OBJ_ENCODING_RAW) {
+      object_string_release(o->ptr);
+    }
+    break;
+  case OBJ_CMS:
+    cms_destroy((CountMinSketch *)o->ptr);
+    mem_free(o->ptr);
+    break;
+  case OBJ_ZSET:
+    zset_destroy((SortedSet *)o->ptr);
+    break;
+  case OBJ_BLOOM:
+    bloom_destroy((BloomFilter *)o->ptr);
+    break;
+  case OBJ_CUCKOO:
+    cuckoo_destroy((CuckooFilter *)o->ptr);
+    break;
+  case OBJ_HLL:
+    hll_destroy((HyperLogLog *)o->ptr);
+    break;
+  case OBJ_TOPK:
+    topk_destroy((TopK *)o->ptr);
+    break;
+  default:
+    mem_free(o->ptr);
+    break;
+  }
+  mem_free(o);
+}
+
+const char *object_type_name(ObjectType type) {
+  switch (type) {
+  case OBJ_STRING:
+    return "string";
+  case OBJ_ZSET:
+    return "zset";
+  case OBJ_BLOOM:
+    return "MBbloom--";
+  case OBJ_CUCKOO:
+    return "MBbloomCF";
+  case OBJ_CMS:
+    return "CMSk-TYPE";
+  case OBJ_HLL:
+    return "hyperloglog";
+  case OBJ_TOPK:
+    return "TopK-TYPE";
+  default:
+    return "none";
+  }
+}
+
+size_t object_memory_usage(const RedisObject *o) {
+  switch (o->type) {
+  case OBJ_STRING:
+    if (o->encoding == OBJ_ENCODING_INT) {
+      return sizeof(RedisObject);
+    }
+    if (o->encoding == OBJ_ENCODING_EMBSTR) {
+      /* [RedisObject][len:1][bytes][NUL] */
+      return sizeof(RedisObject) + 1 + ((const uint8_t *)o->ptr)[-1] + 1;
+    }
+    return sizeof(RedisObject) + sizeof(StringBuffer) +
+           ((const StringBuffer *)o->ptr)->len + 1;
+  case OBJ_ZSET:
+    return sizeof(RedisObject) + zset_memory_usage((const SortedSet *)o->ptr);
+  case OBJ_BLOOM:
+    return sizeof(RedisObject) + bloom_memory_usage((const BloomFilter *)o->ptr);
+  case OBJ_CUCKOO:
+    return sizeof(RedisObject) +
+           cuckoo_memory_usage((const CuckooFilter *)o->ptr);
+  case OBJ_CMS:
+    return sizeof(RedisObject) +
+           cms_memory_usage((const CountMinSketch *)o->ptr);
+  case OBJ_HLL:
+    return sizeof(RedisObject) + hll_memory_usage((const HyperLogLog *)o->ptr);
+  case OBJ_TOPK:
+    return sizeof(RedisObject) + topk_memory_usage((const TopK *)o->ptr);
+  default:
+    return sizeof(RedisObject);
+  }
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static void __init_header(RedisObject *o, ObjectType type,
+                          ObjectEncoding encoding) {
+  o->type = type;
+  o->encoding = encoding;
+  o->lfu = OBJ_LFU_INIT_VAL;
+  o->atime = object_clock();
+}
+
+/* Uniform in [0, 1), from a per-thread xorshift64* */
+static double __lfu_random(void) {
+  if (g_lfu_state == 0) {
+    uint64_t local;
+    g_lfu_state = ((uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)&local) | 1;
+  }
+  g_lfu_state ^= g_lfu_state >> 12;
+  g_lfu_state ^= g_lfu_state << 25;
+  g_lfu_state ^= g_lfu_state >> 27;
+  return (double)((g_lfu_state * 0x2545f4914f6cdd1dULL) >> 11) * 0x1.0p-53;
+}
@@ -0,0 +1,110 @@
+#ifndef REDIS_C_OBJECT_H__
+#define REDIS_C_OBJECT_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Every value in the keyspace is wrapped in a RedisObject so keys of all types
+ * share one namespace; `type` says what `ptr` points to and `encoding` how it
+ * is laid out in memory.
+ */
+typedef enum {
+  OBJ_STRING = 0,
+  OBJ_ZSET, /* also backs the geo commands */
+  OBJ_BLOOM,
+  OBJ_CUCKOO,
+  OBJ_CMS,
+  OBJ_HLL,
+  OBJ_TOPK
+} ObjectType;
+
+/*
+ * Strings have three encodings:
+ *  - INT: a canonical decimal int64 is kept as the number itself, in `ival`;
+ *  - EMBSTR: values up to OBJ_EMBSTR_MAX_LEN bytes live in the same
+ *    allocation as the header: [RedisObject][len:1][bytes][NUL], 64 bytes at
+ *    most; `ptr` points at the bytes;
+ *  - RAW: `ptr` is a separately allocated StringBuffer.
+ * Other types are always RAW.
+ */
+typedef enum {
+  OBJ_ENCODING_RAW = 0,
+  OBJ_ENCODING_INT,
+  OBJ_ENCODING_EMBSTR
+} ObjectEncoding;
+
+#define OBJ_EMBSTR_MAX_LEN 44
+
+/*
+ * Access tracking for eviction, kept in what would otherwise be header
+ * padding. `lfu` is a logarithmic frequency counter: incremented with
+ * probability 1 / ((lfu - OBJ_LFU_INIT_VAL) * OBJ_LFU_LOG_FACTOR + 1), so it
+ * takes about a million accesses to saturate, and decremented once per
+ * OBJ_LFU_DECAY_SECONDS without access. New objects start at
+ * OBJ_LFU_INIT_VAL so they are not evicted before they get a chance.
+ */
+#define OBJ_LFU_INIT_VAL 5
+#define OBJ_LFU_LOG_FACTOR 10
+#define OBJ_LFU_DECAY_SECONDS 60
+
+typedef struct {
+  uint8_t type;
+  uint8_t encoding;
+  uint8_t lfu;    /* logarithmic access frequency */
+  uint32_t atime; /* last access, on object_clock() */
+  union {
+    void *ptr;
+    int64_t ival;
+  };
+} RedisObject;
+
+/*
+ * Length-prefixed, binary-safe string value (NUL-terminated for convenience).
+ * The bytes never change once created, and a reply may pin them past the
+ * life of their object (see reply_add_bulk_ref): the buffer is freed when
+ * the last reference is dropped, from whichever thread drops it.
+ */
+typedef struct {
+  size_t len;
+  _Atomic uint32_t refcount;
+  char buf[];
+} StringBuffer;
+
+RedisObject *object_create(ObjectType type, void *ptr);
+/* A string object for `len` bytes, in the most compact encoding. */
+RedisObject *object_create_string(const char *s, size_t len);
+RedisObject *object_create_int(int64_t value);
+/*
+ * The bytes of a string object. INT values are formatted into `ibuf`, which
+ * must hold STR_UTIL_LL_SIZE bytes.
+ */
+const char *object_string(const RedisObject *o, size_t *len, char *ibuf);
+/* Take a reference to the buffer of a RAW string object. */
+StringBuffer *object_string_retain(const RedisObject *o);
+/* Drop a reference taken with object_string_retain (a ReplyRelease). */
+void object_string_release(void *sb);
+/* Whether a string object holds an int64, and which. */
+bool object_string_to_int(const RedisObject *o, int64_t *value);
+/* Turn a string object into an INT one in place, keeping its key's state. */
+void object_set_int(RedisObject *o, int64_t value);
+/* Seconds on the clock `atime` is kept in. */
+uint32_t object_clock(void);
+/* Record an access: refresh atime and bump the LFU counter. */
+void object_touch(RedisObject *o);
+/* Seconds since the last access. */
+uint32_t object_idle_time(const RedisObject *o);
+/* The LFU counter with the decay owed since the last access applied. */
+uint8_t object_lfu(const RedisObject *o);
+/* Free the object and the value it owns. */
+void object_free(RedisObject *o);
+const char *object_type_name(ObjectType type);
+/*
+ * Approximate bytes held by the object, header included. O(1): a sorted
+ * set is estimated from a few of its members.
+ */
+size_t object_memory_usage(const RedisObject *o);
+
+#endif
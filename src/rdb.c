@@ -0,0 +1,1284 @@
+#include "rdb.h"
+#include "latency.h"
+#include "logging.h"
+#include "object.h"
+#include "redis-C/config.h"
+#include "replication.h"
+#include "storage.h"
+#include "util/hash.h"
+#include "util/mem.h"
+#include "util/str_util.h"
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RDB_MAGIC "RCDB"
+#define RDB_BYTE_ORDER_MARK 0x01020304u
+#define RDB_HEADER_SIZE 16
+#define RDB_CHECKSUM_SIZE 8
+/* version:u16 | byte order mark:u32 | checksum:u64 */
+#define RDB_DUMP_TRAILER_SIZE 14
+/* Writes are batched into a buffer this big; larger arrays bypass it */
+#define RDB_WRITE_BUFFER (1 << 20)
+/* The loader folds the bytes it parsed into the checksum, and releases their
+ * pages, every time it gets this far past the last point */
+#define RDB_LOAD_CHUNK (8 << 20)
+
+typedef struct {
+  int fd;
+  /* diskless: the sockets written instead of `fd`, a failed one is dropped */
+  const int *socks;
+  bool *socks_ok;
+  int nsocks;
+  long long timeout_ms; /* for a socket to take more data */
+  uint8_t *buf;
+  size_t len;
+  size_t cap;     /* in memory only: the buffer grows instead of flushing */
+  bool in_memory;
+  HashXxh64State sum;
+  bool failed;
+} RdbWriter;
+
+/* The mapped file being parsed: every read is a view into the mapping */
+typedef struct {
+  const uint8_t *base;
+  const uint8_t *pos;
+  const uint8_t *end; /* start of the checksum */
+  size_t hashed;      /* bytes folded into `sum` so far */
+  size_t released;    /* bytes whose pages have been dropped */
+  bool release_pages; /* only for a private mapping of a file */
+  bool keep_expired;  /* load keys whose TTL has passed too */
+  HashXxh64State sum;
+  bool failed;
+} RdbReader;
+
+/* Only an unsharded server forks, so the save state is process-wide; the
+ * change counter is per keyspace like everything else here */
+static RdbSaveInfo g_save_info = {-1, 0, true, -1, -1, 0};
+static _Thread_local long long g_dirty = 0;
+static long long g_dirty_at_fork = 0;
+static long long g_bgsave_start_ms = 0;
+static long long g_bgsave_try_ms = 0;
+static int g_cow_pipe = -1; /* the child reports its copy-on-write bytes */
+static char g_bgsave_path[PATH_MAX];
+static RdbChildDone g_child_done = NULL; /* NULL for a snapshot of the dataset */
+static RdbSocketsDone g_sockets_done = NULL; /* set for a diskless transfer */
+static int g_sockets_count = 0;
+
+/* private functions */
+static bool __temp_path(char *buf, size_t size, const char *path, pid_t pid);
+static long long __ustime(void);
+static size_t __private_dirty_bytes(void);
+static void __bgsave_child(const char *path, int report_fd);
+static pid_t __fork_child(const char *what, int *report_fd);
+static void __bgsave_sockets_child(const int *fds, int count,
+                                   const char *mark, long long timeout_ms,
+                                   int report_fd);
+static void __bgsave_done(bool ok);
+static bool __write_all(int fd, const void *p, size_t n);
+static bool __send_all(int fd, const void *p, size_t n, long long timeout_ms);
+static bool __write_out(RdbWriter *w, const void *p, size_t n);
+static void __write_snapshot(RdbWriter *w);
+static void __write_flush(RdbWriter *w);
+static void __write_grow(RdbWriter *w, size_t n);
+static void __write(RdbWriter *w, const void *p, size_t n);
+static void __write_u8(RdbWriter *w, uint8_t v);
+static void __write_varint(RdbWriter *w, uint64_t v);
+static void __write_svarint(RdbWriter *w, int64_t v);
+static void __write_fixed64(RdbWriter *w, uint64_t v);
+static void __write_double(RdbWriter *w, double v);
+static void __write_string(RdbWriter *w, const char *s, size_t len);
+static void __write_cms(RdbWriter *w, const CountMinSketch *cms);
+static void __write_object(RdbWriter *w, const char *key, size_t len,
+                           const RedisObject *obj);
+static int __object_rdb_type(const RedisObject *obj);
+static void __write_value(RdbWriter *w, const RedisObject *obj);
+static const uint8_t *__read(RdbReader *r, size_t n);
+static uint8_t __read_u8(RdbReader *r);
+static uint64_t __read_varint(RdbReader *r);
+static int64_t __read_svarint(RdbReader *r);
+static uint64_t __read_fixed64(RdbReader *r);
+static double __read_double(RdbReader *r);
+static const char *__read_string(RdbReader *r, size_t *len);
+static void __reader_progress(RdbReader *r, bool final);
+static bool __read_cms(RdbReader *r, CountMinSketch *image);
+static RedisObject *__wrap(ObjectType type, void *value);
+static RedisObject *__read_zset(RdbReader *r);
+static RedisObject *__read_bloom(RdbReader *r);
+static RedisObject *__read_cuckoo(RdbReader *r);
+static RedisObject *__read_hll(RdbReader *r);
+static RedisObject *__read_topk(RdbReader *r);
+static RedisObject *__read_object(RdbReader *r, uint8_t type);
+static REDIS_RC __load_buffer(const void *buf, size_t size, size_t *used,
+                              size_t *keys, bool release_pages,
+                              bool keep_expired);
+static REDIS_RC __load_records(RdbReader *r, size_t *keys);
+
+REDIS_RC rdb_save(const char *path) {
+  char tmp[PATH_MAX];
+  if (!__temp_path(tmp, sizeof(tmp), path, getpid())) {
+    return REDIS_IO_ERROR;
+  }
+  RdbWriter w = {0};
+  w.fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  w.buf = malloc(RDB_WRITE_BUFFER);
+  if (w.fd == -1 || !w.buf) {
+    LOG_WARNING("Unable to create snapshot file %s", tmp);
+    if (w.fd != -1) {
+      close(w.fd);
+      unlink(tmp);
+    }
+    free(w.buf);
+    return REDIS_IO_ERROR;
+  }
+  __write_snapshot(&w);
+  bool ok = !w.failed && fsync(w.fd) == 0;
+  ok = close(w.fd) == 0 && ok;
+  free(w.buf);
+  if (!ok || rename(tmp, path) == -1) {
+    LOG_WARNING("Failed to write the snapshot to %s", path);
+    unlink(tmp);
+    return REDIS_IO_ERROR;
+  }
+  g_dirty = 0;
+  g_save_info.lastsave = time(NULL);
+  return REDIS_OK;
+}
+
+REDIS_RC rdb_bgsave(const char *path) { return rdb_bgsave_with(path, NULL); }
+
+REDIS_RC rdb_bgsave_with(const char *path, RdbChildDone done) {
+  if (g_save_info.child_pid != -1) {
+    return REDIS_SAVE_IN_PROGRESS;
+  }
+  if (snprintf(g_bgsave_path, sizeof(g_bgsave_path), "%s", path) >=
+      (int)sizeof(g_bgsave_path)) {
+    return REDIS_IO_ERROR;
+  }
+  int report_fd;
+  g_bgsave_try_ms = storage_mstime();
+  pid_t pid = __fork_child(done ? "AOF rewrite" : "saving", &report_fd);
+  if (pid == 0) {
+    __bgsave_child(path, report_fd);
+  } else if (pid == -1) {
+    g_save_info.last_bgsave_ok = false;
+    return REDIS_IO_ERROR;
+  }
+  g_child_done = done;
+  return REDIS_OK;
+}
+
+REDIS_RC rdb_bgsave_to_sockets(const int *fds, int count, const char *mark,
+                               long long timeout_ms, RdbSocketsDone done) {
+  if (g_save_info.child_pid != -1) {
+    return REDIS_SAVE_IN_PROGRESS;
+  }
+  int report_fd;
+  pid_t pid = __fork_child("transfer to replicas", &report_fd);
+  if (pid == 0) {
+    __bgsave_sockets_child(fds, count, mark, timeout_ms, report_fd);
+  } else if (pid == -1) {
+    return REDIS_IO_ERROR;
+  }
+  g_sockets_done = done;
+  g_sockets_count = count;
+  g_bgsave_path[0] = '\0'; /* nothing to clean up on disk */
+  return REDIS_OK;
+}
+
+bool rdb_bgsave_in_progress(void) { return g_save_info.child_pid != -1; }
+
+void rdb_bgsave_abort(void) {
+  if (g_save_info.child_pid == -1) {
+    return;
+  }
+  kill(g_save_info.child_pid, SIGKILL);
+  waitpid(g_save_info.child_pid, NULL, 0);
+  __bgsave_done(false);
+}
+
+void rdb_cron(void) {
+  if (g_save_info.child_pid != -1) {
+    int status;
+    pid_t pid = waitpid(g_save_info.child_pid, &status, WNOHANG);
+    if (pid == g_save_info.child_pid) {
+      __bgsave_done(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    } else if (pid == -1 && errno != EINTR) {
+      __bgsave_done(false);
+    }
+    return;
+  }
+  const RedisCConfig *cfg = get_current_config();
+  long long now_ms = storage_mstime();
+  /* keep a failing disk from being hammered by a save every tick */
+  if (!g_save_info.last_bgsave_ok &&
+      now_ms - g_bgsave_try_ms < RDB_BGSAVE_RETRY_DELAY_MS) {
+    return;
+  }
+  for (int i = 0; i < cfg->save_params_len; i++) {
+    const SaveParam *sp = &cfg->save_params[i];
+    if (g_dirty >= sp->changes &&
+        now_ms / 1000 - g_save_info.lastsave >= sp->seconds) {
+      LOG_INFO("%lld changes in %lld seconds. Saving...", sp->changes,
+               sp->seconds);
+      rdb_bgsave(cfg->dbfilename);
+      return;
+    }
+  }
+}
+
+void rdb_add_dirty(long long n) { g_dirty += n; }
+
+long long rdb_dirty(void) { return g_dirty; }
+
+const RdbSaveInfo *rdb_save_info(void) { return &g_save_info; }
+
+REDIS_RC rdb_load(const char *path, size_t *keys) {
+  if (keys) {
+    *keys = 0;
+  }
+  /* `save` rules count from startup, the state of the snapshot on disk */
+  rdb_reset_save_clock();
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return REDIS_OK;
+    }
+    LOG_WARNING("Unable to open snapshot file %s", path);
+    return REDIS_IO_ERROR;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return REDIS_IO_ERROR;
+  }
+  size_t size = (size_t)st.st_size;
+  if (size < RDB_HEADER_SIZE + 1 + RDB_CHECKSUM_SIZE) {
+    close(fd);
+    return REDIS_CORRUPT_SNAPSHOT;
+  }
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    LOG_WARNING("Unable to map snapshot file %s", path);
+    return REDIS_IO_ERROR;
+  }
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  size_t used;
+  storage_set_loading(true);
+  /* a replica keeps expired keys until its primary deletes them */
+  REDIS_RC rc = __load_buffer(map, size, &used, keys, true, repl_is_replica());
+  storage_set_loading(false);
+  munmap(map, size);
+  if (REDIS_SUCCESS(rc) && used != size) {
+    /* trailing garbage */
+    storage_clear();
+    if (keys) {
+      *keys = 0;
+    }
+    rc = REDIS_CORRUPT_SNAPSHOT;
+  }
+  return rc;
+}
+
+REDIS_RC rdb_load_buffer(const void *buf, size_t size, size_t *used,
+                         size_t *keys, bool release_pages) {
+  return __load_buffer(buf, size, used, keys, release_pages, true);
+}
+
+void rdb_reset_save_clock(void) {
+  g_dirty = 0;
+  g_save_info.lastsave = time(NULL);
+}
+
+REDIS_RC rdb_dump_object(const RedisObject *obj, char **payload, size_t *len) {
+  int type = __object_rdb_type(obj);
+  if (type < 0) {
+    return REDIS_WRONG_TYPE;
+  }
+  RdbWriter w = {0};
+  w.fd = -1;
+  w.in_memory = true;
+  __write_u8(&w, (uint8_t)type);
+  __write_value(&w, obj);
+  uint16_t version = RDB_VERSION;
+  uint32_t bom = RDB_BYTE_ORDER_MARK;
+  __write(&w, &version, sizeof(version));
+  __write(&w, &bom, sizeof(bom));
+  if (!w.failed) {
+    uint64_t checksum = hash_xxh64(w.buf, w.len, 0);
+    __write(&w, &checksum, sizeof(checksum));
+  }
+  if (w.failed) {
+    free(w.buf);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  *payload = (char *)w.buf;
+  *len = w.len;
+  return REDIS_OK;
+}
+
+REDIS_RC rdb_restore_object(const void *payload, size_t len,
+                            RedisObject **obj) {
+  const uint8_t *p = (const uint8_t *)payload;
+  uint16_t version;
+  uint32_t bom;
+  uint64_t checksum;
+  if (len < 1 + RDB_DUMP_TRAILER_SIZE) {
+    return REDIS_BAD_PAYLOAD;
+  }
+  size_t body = len - RDB_DUMP_TRAILER_SIZE;
+  memcpy(&version, p + body, sizeof(version));
+  memcpy(&bom, p + body + sizeof(version), sizeof(bom));
+  memcpy(&checksum, p + len - sizeof(checksum), sizeof(checksum));
+  if (version != RDB_VERSION || bom != RDB_BYTE_ORDER_MARK ||
+      checksum != hash_xxh64(p, len - sizeof(checksum), 0)) {
+    return REDIS_BAD_PAYLOAD;
+  }
+
+  RdbReader r = {0};
+  r.base = r.pos = p;
+  r.end = p + body;
+  uint8_t type = __read_u8(&r);
+  *obj = __read_object(&r, type);
+  if (!*obj) {
+    return r.failed ? REDIS_BAD_PAYLOAD : REDIS_OUT_OF_MEMORY;
+  }
+  if (r.pos != r.end) {
+    object_free(*obj);
+    *obj = NULL;
+    return REDIS_BAD_PAYLOAD;
+  }
+  return REDIS_OK;
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static bool __temp_path(char *buf, size_t size, const char *path, pid_t pid) {
+  return snprintf(buf, size, "%s.tmp-%d", path, (int)pid) < (int)size;
+}
+
+static long long __ustime(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Private_Dirty of the calling process: in a forked child, the pages the
+ * parent has written to since (and so copied), plus the child's own.
+ */
+static size_t __private_dirty_bytes(void) {
+  size_t bytes = 0;
+#ifdef __linux__
+  FILE *f = fopen("/proc/self/smaps_rollup", "r");
+  if (!f) {
+    f = fopen("/proc/self/smaps", "r");
+  }
+  if (!f) {
+    return 0;
+  }
+  char line[256];
+  unsigned long long kb;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "Private_Dirty: %llu kB", &kb) == 1) {
+      bytes += (size_t)kb * 1024;
+    }
+  }
+  fclose(f);
+#endif
+  return bytes;
+}
+
+/* Runs in the forked child: write the snapshot, report, and exit */
+static void __bgsave_child(const char *path, int report_fd) {
+  /* the parent's handlers stop an event loop the child does not run */
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  REDIS_RC rc = rdb_save(path);
+  size_t cow = __private_dirty_bytes();
+  __write_all(report_fd, &cow, sizeof(cow));
+  _exit(REDIS_SUCCESS(rc) ? 0 : 1);
+}
+
+/*
+ * Fork a child for a background save: 0 in the child, its pid in the
+ * parent, -1 if it could not be started. The child reports back through
+ * *report_fd (its end of the pipe).
+ */
+static pid_t __fork_child(const char *what, int *report_fd) {
+  int fds[2];
+  if (pipe(fds) == -1) {
+    return -1;
+  }
+  long long start = __ustime();
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    *report_fd = fds[1];
+    return 0;
+  }
+  close(fds[1]);
+  if (pid == -1) {
+    close(fds[0]);
+    LOG_WARNING("Can't save in background: fork failed");
+    return -1;
+  }
+  /* the whole page table is copied while the loop stands still */
+  g_save_info.last_fork_us = __ustime() - start;
+  latency_add_sample_if_needed(LATENCY_FORK,
+                               (uint64_t)g_save_info.last_fork_us);
+  g_save_info.child_pid = pid;
+  g_cow_pipe = fds[0];
+  g_dirty_at_fork = g_dirty;
+  g_bgsave_start_ms = storage_mstime();
+  LOG_INFO("Background %s started by pid %d (fork took %lld us)", what,
+           (int)pid, g_save_info.last_fork_us);
+  return pid;
+}
+
+/*
+ * Runs in the forked child: stream the snapshot, framed by the EOF mark, to
+ * every socket, then report which of them got all of it.
+ */
+static void __bgsave_sockets_child(const int *fds, int count,
+                                   const char *mark, long long timeout_ms,
+                                   int report_fd) {
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  bool *ok = malloc((size_t)count * sizeof(bool));
+  RdbWriter w = {0};
+  w.fd = -1;
+  w.socks = fds;
+  w.socks_ok = ok;
+  w.nsocks = count;
+  w.timeout_ms = timeout_ms;
+  w.buf = malloc(RDB_WRITE_BUFFER);
+  if (!ok || !w.buf) {
+    _exit(1);
+  }
+  for (int i = 0; i < count; i++) {
+    ok[i] = true;
+  }
+  char preamble[8 + RDB_EOF_MARK_LEN];
+  int n = snprintf(preamble, sizeof(preamble), "$EOF:%.*s\r\n",
+                   RDB_EOF_MARK_LEN, mark);
+  w.failed = !__write_out(&w, preamble, (size_t)n);
+  __write_snapshot(&w);
+  if (!w.failed) {
+    __write_out(&w, mark, RDB_EOF_MARK_LEN);
+  }
+  size_t cow = __private_dirty_bytes();
+  __write_all(report_fd, &cow, sizeof(cow));
+  __write_all(report_fd, ok, (size_t)count * sizeof(bool));
+  bool any = false;
+  for (int i = 0; i < count; i++) {
+    any = any || ok[i];
+  }
+  _exit(any ? 0 : 1);
+}
+
+/* The child is gone: collect its report and account for the save */
+static void __bgsave_done(bool ok) {
+  size_t cow;
+  if (read(g_cow_pipe, &cow, sizeof(cow)) != (ssize_t)sizeof(cow)) {
+    cow = 0;
+  }
+  bool *sent = NULL;
+  if (g_sockets_done) {
+    /* a socket the child did not report on failed */
+    size_t size = (size_t)g_sockets_count * sizeof(bool);
+    sent = calloc((size_t)g_sockets_count, sizeof(bool));
+    if (sent && (!ok || read(g_cow_pipe, sent, size) != (ssize_t)size)) {
+      memset(sent, 0, size);
+    }
+  }
+  close(g_cow_pipe);
+  g_cow_pipe = -1;
+
+  long long now_ms = storage_mstime();
+  g_save_info.last_bgsave_ms = now_ms - g_bgsave_start_ms;
+  g_save_info.last_cow_bytes = cow;
+  pid_t pid = g_save_info.child_pid;
+  g_save_info.child_pid = -1;
+  if (g_sockets_done) {
+    RdbSocketsDone done = g_sockets_done;
+    int count = g_sockets_count;
+    g_sockets_done = NULL;
+    g_sockets_count = 0;
+    LOG_INFO("Diskless transfer to replicas %s in %lld ms, %zu MB of memory "
+             "used by copy-on-write",
+             ok ? "done" : "failed", g_save_info.last_bgsave_ms, cow >> 20);
+    done(sent, count);
+    free(sent);
+    return;
+  }
+  if (!ok) {
+    char tmp[PATH_MAX];
+    if (__temp_path(tmp, sizeof(tmp), g_bgsave_path, pid)) {
+      unlink(tmp);
+    }
+  }
+  if (g_child_done) {
+    RdbChildDone done = g_child_done;
+    g_child_done = NULL;
+    LOG_INFO("Background AOF snapshot %s in %lld ms, %zu MB of memory used "
+             "by copy-on-write",
+             ok ? "written" : "failed", g_save_info.last_bgsave_ms, cow >> 20);
+    done(ok);
+    return;
+  }
+  g_save_info.last_bgsave_ok = ok;
+  if (ok) {
+    /* writes that arrived during the save still count towards the next */
+    g_dirty -= g_dirty_at_fork;
+    g_save_info.lastsave = now_ms / 1000;
+    LOG_INFO("Background saving terminated with success in %lld ms, %zu MB "
+             "of memory used by copy-on-write",
+             g_save_info.last_bgsave_ms, cow >> 20);
+  } else {
+    LOG_WARNING("Background saving failed");
+  }
+}
+
+static bool __write_all(int fd, const void *p, size_t n) {
+  const char *c = (const char *)p;
+  while (n > 0) {
+    ssize_t done = write(fd, c, n);
+    if (done == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    c += done;
+    n -= (size_t)done;
+  }
+  return true;
+}
+
+/*
+ * Write to a non-blocking socket, waiting up to `timeout_ms` each time it
+ * does not take any more. The socket is shared with the parent, whose
+ * event loop expects it to stay non-blocking.
+ */
+static bool __send_all(int fd, const void *p, size_t n, long long timeout_ms) {
+  const char *c = (const char *)p;
+  while (n > 0) {
+    ssize_t done = write(fd, c, n);
+    if (done == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+      if ((errno != EAGAIN && errno != EWOULDBLOCK) ||
+          poll(&pfd, 1, (int)timeout_ms) != 1 || (pfd.revents & POLLNVAL)) {
+        return false;
+      }
+      continue;
+    }
+    c += done;
+    n -= (size_t)done;
+  }
+  return true;
+}
+
+/* To the file, or to every socket still there; fails when none is left */
+static bool __write_out(RdbWriter *w, const void *p, size_t n) {
+  if (!w->socks) {
+    return __write_all(w->fd, p, n);
+  }
+  bool any = false;
+  for (int i = 0; i < w->nsocks; i++) {
+    if (w->socks_ok[i]) {
+      w->socks_ok[i] = __send_all(w->socks[i], p, n, w->timeout_ms);
+      any = any || w->socks_ok[i];
+    }
+  }
+  return any;
+}
+
+static void __write_flush(RdbWriter *w) {
+  if (w->len == 0 || w->failed) {
+    w->len = 0;
+    return;
+  }
+  hash_xxh64_update(&w->sum, w->buf, w->len);
+  w->failed = !__write_out(w, w->buf, w->len);
+  w->len = 0;
+}
+
+/* The whole snapshot, checksum included, to a writer with a buffer */
+static void __write_snapshot(RdbWriter *w) {
+  hash_xxh64_init(&w->sum, 0);
+  uint32_t header[3] = {RDB_VERSION, RDB_BYTE_ORDER_MARK, 0};
+  __write(w, RDB_MAGIC, 4);
+  __write(w, header, sizeof(header));
+  __write_u8(w, RDB_OP_RESIZE);
+  __write_varint(w, storage_size());
+  __write_varint(w, storage_expires_size());
+
+  long long now = storage_mstime();
+  StorageIterator it;
+  const char *key;
+  size_t len;
+  RedisObject *obj;
+  storage_iter_init(&it);
+  while (!w->failed && storage_iter_next(&it, &key, &len, &obj)) {
+    long long when_ms = storage_get_expire(key, len);
+    if (when_ms >= 0) {
+      if (when_ms <= now) {
+        continue;
+      }
+      __write_u8(w, RDB_OP_EXPIRE_MS);
+      __write_fixed64(w, (uint64_t)when_ms);
+    }
+    __write_object(w, key, len, obj);
+  }
+  storage_iter_release(&it);
+  __write_u8(w, RDB_OP_EOF);
+  __write_flush(w);
+
+  uint64_t checksum = hash_xxh64_digest(&w->sum);
+  if (!w->failed) {
+    w->failed = !__write_out(w, &checksum, sizeof(checksum));
+  }
+}
+
+static void __write(RdbWriter *w, const void *p, size_t n) {
+  if (w->in_memory) {
+    __write_grow(w, n);
+    if (!w->failed) {
+      memcpy(w->buf + w->len, p, n);
+      w->len += n;
+    }
+    return;
+  }
+  if (w->len + n > RDB_WRITE_BUFFER || n > RDB_WRITE_BUFFER / 2) {
+    __write_flush(w);
+  }
+  if (n > RDB_WRITE_BUFFER / 2) {
+    /* big arrays go straight from the object to the file */
+    if (!w->failed) {
+      hash_xxh64_update(&w->sum, p, n);
+      w->failed = !__write_out(w, p, n);
+    }
+    return;
+  }
+  memcpy(w->buf + w->len, p, n);
+  w->len += n;
+}
+
+/* Room for `n` more bytes in an in-memory writer */
+static void __write_grow(RdbWriter *w, size_t n) {
+  if (w->failed || w->cap - w->len >= n) {
+    return;
+  }
+  size_t cap = w->cap ? w->cap : 64;
+  while (cap - w->len < n) {
+    cap *= 2;
+  }
+  uint8_t *buf = realloc(w->buf, cap);
+  if (!buf) {
+    w->failed = true;
+    return;
+  }
+  w->buf = buf;
+  w->cap = cap;
+}
+
+static void __write_u8(RdbWriter *w, uint8_t v) { __write(w, &v, 1); }
+
+static void __write_varint(RdbWriter *w, uint64_t v) {
+  uint8_t out[10];
+  size_t n = 0;
+  do {
+    out[n] = (uint8_t)(v & 0x7f);
+    v >>= 7;
+    out[n++] |= v ? 0x80 : 0;
+  } while (v);
+  __write(w, out, n);
+}
+
+static void __write_svarint(RdbWriter *w, int64_t v) {
+  __write_varint(w, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void __write_fixed64(RdbWriter *w, uint64_t v) {
+  __write(w, &v, sizeof(v));
+}
+
+static void __write_double(RdbWriter *w, double v) {
+  __write(w, &v, sizeof(v));
+}
+
+static void __write_string(RdbWriter *w, const char *s, size_t len) {
+  __write_varint(w, len);
+  __write(w, s, len);
+}
+
+static void __write_cms(RdbWriter *w, const CountMinSketch *cms) {
+  __write_varint(w, cms->width);
+  __write_varint(w, cms->depth);
+  __write_varint(w, cms->layout);
+  __write_varint(w, cms->counter_bits);
+  __write_varint(w, cms->flags);
+  __write_svarint(w, cms->elements_added);
+  __write_double(w, cms->confidence);
+  __write_double(w, cms->error_rate);
+  __write(w, cms->counters, cms_memory_usage(cms));
+}
+
+/* type:u8 | key | value */
+static void __write_object(RdbWriter *w, const char *key, size_t len,
+                           const RedisObject *obj) {
+  int type = __object_rdb_type(obj);
+  if (type < 0) {
+    LOG_WARNING("Cannot save key of unknown type %d", obj->type);
+    w->failed = true;
+    return;
+  }
+  __write_u8(w, (uint8_t)type);
+  __write_string(w, key, len);
+  __write_value(w, obj);
+}
+
+/* The RDB_TYPE_* of `obj`, -1 for an unknown type */
+static int __object_rdb_type(const RedisObject *obj) {
+  switch (obj->type) {
+  case OBJ_STRING:
+    return obj->encoding == OBJ_ENCODING_INT ? RDB_TYPE_STRING_INT
+                                             : RDB_TYPE_STRING;
+  case OBJ_ZSET:
+    return RDB_TYPE_ZSET;
+  case OBJ_BLOOM:
+    return RDB_TYPE_BLOOM;
+  case OBJ_CUCKOO:
+    return RDB_TYPE_CUCKOO;
+  case OBJ_CMS:
+    return RDB_TYPE_CMS;
+  case OBJ_HLL:
+    return RDB_TYPE_HLL;
+  case OBJ_TOPK:
+    return RDB_TYPE_TOPK;
+  default:
+    return -1;
+  }
+}
+
+/* The value of a record, as __read_object reads it back */
+static void __write_value(RdbWriter *w, const RedisObject *obj) {
+  if (obj->type == OBJ_STRING && obj->encoding == OBJ_ENCODING_INT) {
+    __write_svarint(w, obj->ival);
+    return;
+  }
+  switch (obj->type) {
+  case OBJ_STRING: {
+    char ibuf[STR_UTIL_LL_SIZE];
+    size_t vlen;
+    const char *value = object_string(obj, &vlen, ibuf);
+    __write_string(w, value, vlen);
+    break;
+  }
+  case OBJ_ZSET: {
+    const SortedSet *zs = (const SortedSet *)obj->ptr;
+    __write_varint(w, zset_card(zs));
+    /* ascending, so the loader can link the skip list in one pass */
+    for (SkipListNode *n = skiplist_first(zs->zsl); n; n = skiplist_next(n)) {
+      const ZSetEntry *e = zset_node_entry(n);
+      __write_double(w, e->score);
+      __write_string(w, e->member, e->len);
+    }
+    break;
+  }
+  case OBJ_BLOOM: {
+    const BloomFilter *bf = (const BloomFilter *)obj->ptr;
+    __write_varint(w, bf->expansion);
+    __write_varint(w, bf->num_layers);
+    for (uint32_t i = 0; i < bf->num_layers; i++) {
+      const BloomLayer *layer = &bf->layers[i];
+      __write_varint(w, layer->num_blocks);
+      __write_varint(w, layer->capacity);
+      __write_varint(w, layer->count);
+      __write_double(w, layer->error_rate);
+      __write_varint(w, layer->hashes);
+      __write(w, layer->blocks,
+              layer->num_blocks * BLOOM_BLOCK_LANES * sizeof(uint32_t));
+    }
+    break;
+  }
+  case OBJ_CUCKOO: {
+    const CuckooFilter *cf = (const CuckooFilter *)obj->ptr;
+    __write_varint(w, cf->expansion);
+    __write_varint(w, cf->max_kicks);
+    __write_varint(w, cf->deleted);
+    __write_fixed64(w, cf->rng);
+    __write_varint(w, cf->num_layers);
+    for (uint32_t i = 0; i < cf->num_layers; i++) {
+      const CuckooLayer *layer = &cf->layers[i];
+      __write_varint(w, layer->num_buckets);
+      __write_varint(w, layer->count);
+      __write(w, layer->buckets, layer->num_buckets * sizeof(uint64_t));
+    }
+    break;
+  }
+  case OBJ_CMS:
+    __write_cms(w, (const CountMinSketch *)obj->ptr);
+    break;
+  case OBJ_HLL: {
+    const HyperLogLog *hll = (const HyperLogLog *)obj->ptr;
+    __write_u8(w, hll->encoding);
+    if (hll->encoding == HLL_DENSE) {
+      __write(w, hll->dense, HLL_DENSE_BYTES);
+    } else {
+      __write_varint(w, hll->sparse_len);
+      __write(w, hll->sparse, hll->sparse_len * sizeof(uint32_t));
+    }
+    break;
+  }
+  case OBJ_TOPK: {
+    const TopK *tk = (const TopK *)obj->ptr;
+    __write_varint(w, tk->k);
+    __write_cms(w, &tk->sketch);
+    __write_varint(w, tk->size);
+    /* heap order, so restoring the slots needs no sifting */
+    for (uint32_t i = 0; i < tk->size; i++) {
+      __write_string(w, tk->heap[i].entry->key, tk->heap[i].entry->key_len);
+      __write_svarint(w, tk->heap[i].count);
+    }
+    break;
+  }
+  default:
+    w->failed = true;
+  }
+}
+
+static const uint8_t *__read(RdbReader *r, size_t n) {
+  if (r->failed || (size_t)(r->end - r->pos) < n) {
+    r->failed = true;
+    return NULL;
+  }
+  const uint8_t *p = r->pos;
+  r->pos += n;
+  return p;
+}
+
+static uint8_t __read_u8(RdbReader *r) {
+  const uint8_t *p = __read(r, 1);
+  return p ? *p : 0;
+}
+
+static uint64_t __read_varint(RdbReader *r) {
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte = __read_u8(r);
+    v |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return v;
+    }
+  }
+  r->failed = true;
+  return 0;
+}
+
+static int64_t __read_svarint(RdbReader *r) {
+  uint64_t v = __read_varint(r);
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint64_t __read_fixed64(RdbReader *r) {
+  uint64_t v = 0;
+  const uint8_t *p = __read(r, sizeof(v));
+  if (p) {
+    memcpy(&v, p, sizeof(v));
+  }
+  return v;
+}
+
+static double __read_double(RdbReader *r) {
+  double v = 0;
+  const uint8_t *p = __read(r, sizeof(v));
+  if (p) {
+    memcpy(&v, p, sizeof(v));
+  }
+  return v;
+}
+
+static const char *__read_string(RdbReader *r, size_t *len) {
+  *len = (size_t)__read_varint(r);
+  return (const char *)__read(r, *len);
+}
+
+/*
+ * Fold what has been parsed into the checksum while it is still cached, and
+ * drop the pages behind it: a large snapshot is streamed, not kept mapped.
+ */
+static void __reader_progress(RdbReader *r, bool final) {
+  size_t parsed = (size_t)(r->pos - r->base);
+  if (!final && parsed - r->hashed < RDB_LOAD_CHUNK) {
+    return;
+  }
+  hash_xxh64_update(&r->sum, r->base + r->hashed, parsed - r->hashed);
+  r->hashed = parsed;
+
+  if (!r->release_pages) {
+    return;
+  }
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t upto = parsed / page * page;
+  if (upto > r->released) {
+    madvise((void *)(r->base + r->released), upto - r->released,
+            MADV_DONTNEED);
+    r->released = upto;
+  }
+}
+
+/* A sketch header with `counters` pointing into the mapping */
+static bool __read_cms(RdbReader *r, CountMinSketch *image) {
+  memset(image, 0, sizeof(*image));
+  image->width = (uint32_t)__read_varint(r);
+  image->depth = (uint32_t)__read_varint(r);
+  image->layout = (uint32_t)__read_varint(r);
+  image->counter_bits = (uint8_t)__read_varint(r);
+  image->flags = (uint8_t)__read_varint(r);
+  image->elements_added = __read_svarint(r);
+  image->confidence = __read_double(r);
+  image->error_rate = __read_double(r);
+  if (r->failed || image->width == 0 || image->depth == 0) {
+    return false;
+  }
+  /* the counter array is as large as a sketch of these dimensions needs */
+  CountMinSketch probe = *image;
+  if (image->layout == CMS_LAYOUT_BLOCKED) {
+    if (image->depth > CMS_BLOCK_MAX_DEPTH) {
+      return false;
+    }
+    probe.row_lanes = CMS_BLOCK_LANES / image->depth;
+    probe.num_blocks =
+        ((uint64_t)image->width + probe.row_lanes - 1) / probe.row_lanes;
+  }
+  image->counters = (void *)__read(r, cms_memory_usage(&probe));
+  return image->counters != NULL;
+}
+
+/* An object owning `value`, which is released when that fails */
+static RedisObject *__wrap(ObjectType type, void *value) {
+  RedisObject *obj = object_create(type, value);
+  if (obj) {
+    return obj;
+  }
+  switch (type) {
+  case OBJ_ZSET:
+    zset_destroy(value);
+    break;
+  case OBJ_BLOOM:
+    bloom_destroy(value);
+    break;
+  case OBJ_CUCKOO:
+    cuckoo_destroy(value);
+    break;
+  case OBJ_CMS:
+    cms_destroy(value);
+    mem_free(value);
+    break;
+  case OBJ_HLL:
+    hll_destroy(value);
+    break;
+  case OBJ_TOPK:
+    topk_destroy(value);
+    break;
+  default:
+    break;
+  }
+  return NULL;
+}
+
+static RedisObject *__read_zset(RdbReader *r) {
+  size_t n = (size_t)__read_varint(r);
+  /* every member takes at least 9 bytes: guards the allocations below */
+  if (r->failed || n > (size_t)(r->end - r->pos) / 9) {
+    r->failed = true;
+    return NULL;
+  }
+  const char **members = malloc(n * sizeof(char *) + 1);
+  size_t *lens = malloc(n * sizeof(size_t) + 1);
+  double *scores = malloc(n * sizeof(double) + 1);
+  SortedSet *zs = NULL;
+  if (members && lens && scores) {
+    for (size_t i = 0; i < n && !r->failed; i++) {
+      scores[i] = __read_double(r);
+      members[i] = __read_string(r, &lens[i]);
+    }
+    zs = r->failed ? NULL : zset_create();
+    if (zs && !zset_load_sorted(zs, members, lens, scores, n)) {
+      zset_destroy(zs);
+      zs = NULL;
+    }
+  }
+  free(members);
+  free(lens);
+  free(scores);
+  return zs ? __wrap(OBJ_ZSET, zs) : NULL;
+}
+
+static RedisObject *__read_bloom(RdbReader *r) {
+  BloomFilter image;
+  image.expansion = (uint32_t)__read_varint(r);
+  image.num_layers = (uint32_t)__read_varint(r);
+  if (r->failed || image.num_layers == 0 ||
+      image.num_layers > (size_t)(r->end - r->pos)) {
+    r->failed = true;
+    return NULL;
+  }
+  image.layers = malloc(image.num_layers * sizeof(BloomLayer));
+  if (!image.layers) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < image.num_layers && !r->failed; i++) {
+    BloomLayer *layer = &image.layers[i];
+    layer->num_blocks = __read_varint(r);
+    layer->capacity = __read_varint(r);
+    layer->count = __read_varint(r);
+    layer->error_rate = __read_double(r);
+    layer->hashes = (uint32_t)__read_varint(r);
+    size_t bytes = (size_t)(r->end - r->pos);
+    if (layer->num_blocks > bytes / (BLOOM_BLOCK_LANES * sizeof(uint32_t))) {
+      r->failed = true;
+      break;
+    }
+    layer->blocks = (uint32_t *)__read(
+        r, layer->num_blocks * BLOOM_BLOCK_LANES * sizeof(uint32_t));
+  }
+  BloomFilter *bf = r->failed ? NULL : bloom_restore(&image);
+  free(image.layers);
+  return bf ? __wrap(OBJ_BLOOM, bf) : NULL;
+}
+
+static RedisObject *__read_cuckoo(RdbReader *r) {
+  CuckooFilter image;
+  image.expansion = (uint32_t)__read_varint(r);
+  image.max_kicks = (uint32_t)__read_varint(r);
+  image.deleted = __read_varint(r);
+  image.rng = __read_fixed64(r);
+  image.num_layers = (uint32_t)__read_varint(r);
+  if (r->failed || image.num_layers == 0 ||
+      image.num_layers > (size_t)(r->end - r->pos)) {
+    r->failed = true;
+    return NULL;
+  }
+  image.layers = malloc(image.num_layers * sizeof(CuckooLayer));
+  if (!image.layers) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < image.num_layers && !r->failed; i++) {
+    CuckooLayer *layer = &image.layers[i];
+    layer->num_buckets = __read_varint(r);
+    layer->count = __read_varint(r);
+    if (layer->num_buckets > (size_t)(r->end - r->pos) / sizeof(uint64_t)) {
+      r->failed = true;
+      break;
+    }
+    layer->buckets =
+        (uint64_t *)__read(r, layer->num_buckets * sizeof(uint64_t));
+  }
+  CuckooFilter *cf = r->failed ? NULL : cuckoo_restore(&image);
+  free(image.layers);
+  return cf ? __wrap(OBJ_CUCKOO, cf) : NULL;
+}
+
+static RedisObject *__read_hll(RdbReader *r) {
+  HyperLogLog image = {0};
+  image.encoding = __read_u8(r);
+  if (image.encoding == HLL_DENSE) {
+    image.dense = (uint8_t *)__read(r, HLL_DENSE_BYTES);
+  } else {
+    image.sparse_len = (uint32_t)__read_varint(r);
+    if (image.sparse_len > HLL_SPARSE_MAX_ENTRIES) {
+      r->failed = true;
+      return NULL;
+    }
+    image.sparse = (uint32_t *)__read(r, image.sparse_len * sizeof(uint32_t));
+  }
+  HyperLogLog *hll = r->failed ? NULL : hll_restore(&image);
+  return hll ? __wrap(OBJ_HLL, hll) : NULL;
+}
+
+static RedisObject *__read_topk(RdbReader *r) {
+  uint32_t k = (uint32_t)__read_varint(r);
+  CountMinSketch sketch;
+  if (!__read_cms(r, &sketch)) {
+    r->failed = true;
+    return NULL;
+  }
+  uint64_t size = __read_varint(r);
+  if (r->failed || size > k) {
+    r->failed = true;
+    return NULL;
+  }
+  TopK *tk = topk_restore(k, &sketch);
+  if (!tk) {
+    return NULL;
+  }
+  for (uint64_t i = 0; i < size; i++) {
+    size_t len;
+    const char *item = __read_string(r, &len);
+    int64_t count = __read_svarint(r);
+    if (r->failed || topk_restore_slot(tk, item, len, count) != TOPK_OK) {
+      topk_destroy(tk);
+      return NULL;
+    }
+  }
+  return __wrap(OBJ_TOPK, tk);
+}
+
+/* The value of a `type` record; NULL with r->failed set on a bad record,
+ * NULL alone when out of memory */
+static RedisObject *__read_object(RdbReader *r, uint8_t type) {
+  switch (type) {
+  case RDB_TYPE_STRING: {
+    size_t len;
+    const char *value = __read_string(r, &len);
+    return value ? object_create_string(value, len) : NULL;
+  }
+  case RDB_TYPE_STRING_INT: {
+    int64_t value = __read_svarint(r);
+    return r->failed ? NULL : object_create_int(value);
+  }
+  case RDB_TYPE_ZSET:
+    return __read_zset(r);
+  case RDB_TYPE_BLOOM:
+    return __read_bloom(r);
+  case RDB_TYPE_CUCKOO:
+    return __read_cuckoo(r);
+  case RDB_TYPE_CMS: {
+    CountMinSketch image;
+    CountMinSketch *cms = mem_malloc(sizeof(CountMinSketch));
+    if (!cms || !__read_cms(r, &image) ||
+        cms_restore(cms, &image) != CMS_SUCCESS) {
+      mem_free(cms);
+      return NULL;
+    }
+    return __wrap(OBJ_CMS, cms);
+  }
+  case RDB_TYPE_HLL:
+    return __read_hll(r);
+  case RDB_TYPE_TOPK:
+    return __read_topk(r);
+  default:
+    r->failed = true;
+    return NULL;
+  }
+}
+
+static REDIS_RC __load_buffer(const void *buf, size_t size, size_t *used,
+                              size_t *keys, bool release_pages,
+                              bool keep_expired) {
+  if (keys) {
+    *keys = 0;
+  }
+  RdbReader r = {0};
+  r.base = r.pos = (const uint8_t *)buf;
+  r.end = r.base + size;
+  r.release_pages = release_pages;
+  r.keep_expired = keep_expired;
+  hash_xxh64_init(&r.sum, 0);
+  REDIS_RC rc = __load_records(&r, keys);
+  if (REDIS_FAILED(rc)) {
+    storage_clear();
+    if (keys) {
+      *keys = 0;
+    }
+    return rc;
+  }
+  *used = (size_t)(r.pos - r.base);
+  return REDIS_OK;
+}
+
+static REDIS_RC __load_records(RdbReader *r, size_t *keys) {
+  const uint8_t *magic = __read(r, 4);
+  const uint8_t *header = __read(r, 12);
+  uint32_t version, bom;
+  if (!magic || memcmp(magic, RDB_MAGIC, 4) != 0) {
+    return REDIS_CORRUPT_SNAPSHOT;
+  }
+  memcpy(&version, header, sizeof(version));
+  memcpy(&bom, header + 4, sizeof(bom));
+  if (version != RDB_VERSION || bom != RDB_BYTE_ORDER_MARK) {
+    LOG_WARNING("Snapshot version %u or byte order not supported", version);
+    return REDIS_CORRUPT_SNAPSHOT;
+  }
+
+  long long now = storage_mstime();
+  size_t loaded = 0;
+  for (;;) {
+    uint8_t type = __read_u8(r);
+    if (r->failed) {
+      return REDIS_CORRUPT_SNAPSHOT;
+    }
+    if (type == RDB_OP_EOF) {
+      break;
+    }
+    if (type == RDB_OP_RESIZE) {
+      size_t total = (size_t)__read_varint(r);
+      size_t expires = (size_t)__read_varint(r);
+      /* only a hint: a bogus size must not allocate the machine away */
+      if (total <= (size_t)(r->end - r->pos)) {
+        storage_reserve(total, expires <= total ? expires : total);
+      }
+      continue;
+    }
+    long long when_ms = -1;
+    if (type == RDB_OP_EXPIRE_MS) {
+      when_ms = (long long)__read_fixed64(r);
+      type = __read_u8(r);
+    }
+
+    size_t len;
+    const char *key = __read_string(r, &len);
+    RedisObject *obj = key ? __read_object(r, type) : NULL;
+    if (!obj) {
+      return r->failed ? REDIS_CORRUPT_SNAPSHOT : REDIS_OUT_OF_MEMORY;
+    }
+    if (when_ms >= 0 && when_ms <= now && !r->keep_expired) {
+      object_free(obj);
+    } else {
+      REDIS_RC rc = storage_add(key, len, obj);
+      if (REDIS_FAILED(rc)) {
+        object_free(obj);
+        return rc == REDIS_KEY_EXISTS ? REDIS_CORRUPT_SNAPSHOT : rc;
+      }
+      if (when_ms >= 0 &&
+          REDIS_FAILED(rc = storage_set_expire(key, len, when_ms))) {
+        return rc;
+      }
+      loaded++;
+    }
+    __reader_progress(r, false);
+  }
+
+  __reader_progress(r, true);
+  uint64_t actual = hash_xxh64_digest(&r->sum);
+  uint64_t expected = __read_fixed64(r);
+  if (r->failed || expected != actual) {
+    LOG_WARNING("Snapshot checksum mismatch");
+    return REDIS_CORRUPT_SNAPSHOT;
+  }
+  if (keys) {
+    *keys = loaded;
+  }
+  return REDIS_OK;
+}
@@ -0,0 +1,146 @@
+#ifndef REDIS_C_RDB_H__
+#define REDIS_C_RDB_H__
+
+#include "object.h"
+#include "redis-C/rc.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Binary snapshots of the calling thread's keyspace.
+ *
+ * File layout:
+ *
+ *   header     "RCDB" | version:u32 | byte order mark:u32 | reserved:u32
+ *   RESIZE     keys:varint | expires:varint, to presize the dictionaries
+ *   records    [EXPIRE_MS when:i64] | type:u8 | key:string | value
+ *   EOF
+ *   checksum   xxh64 of every byte before it:u64
+ *
+ * Counts and lengths are LEB128 varints, signed values zigzag varints, and a
+ * string is its length followed by the bytes. Fixed-width fields and bulk
+ * arrays (sketch counters, filter bits, HLL registers) are written in host
+ * byte order, exactly as they are in memory, so loading one is a single copy
+ * out of the mapped file; a snapshot is only loaded on a host with the byte
+ * order recorded in its header. Sorted sets are written in ascending order
+ * and rebuilt in O(n) without searching.
+ */
+
+#define RDB_VERSION 1
+
+/* Value types; the number is part of the format, not the ObjectType */
+#define RDB_TYPE_STRING     0
+#define RDB_TYPE_STRING_INT 1
+#define RDB_TYPE_ZSET       2
+#define RDB_TYPE_BLOOM      3
+#define RDB_TYPE_CUCKOO     4
+#define RDB_TYPE_CMS        5
+#define RDB_TYPE_HLL        6
+#define RDB_TYPE_TOPK       7
+
+#define RDB_OP_RESIZE    0xFB
+#define RDB_OP_EXPIRE_MS 0xFC
+#define RDB_OP_EOF       0xFF
+
+/* After a failed background save, automatic ones wait this long to retry */
+#define RDB_BGSAVE_RETRY_DELAY_MS 5000
+
+/* Background save bookkeeping, for reporting */
+typedef struct {
+    pid_t child_pid;             /* -1 when no background save runs */
+    long long lastsave;          /* unix time of the last successful save */
+    bool last_bgsave_ok;
+    long long last_bgsave_ms;    /* duration of the last background save */
+    long long last_fork_us;      /* time the parent spent in fork() */
+    size_t last_cow_bytes;       /* pages the child saw copied on write */
+} RdbSaveInfo;
+
+/*
+ * Write the keyspace to `path`, through a temporary file that replaces it
+ * only once it is complete and synced. REDIS_IO_ERROR on failure; on
+ * success the change counter restarts from zero.
+ */
+REDIS_RC rdb_save(const char *path);
+
+/*
+ * Fork a child that writes the snapshot from its copy-on-write view of the
+ * keyspace while the parent keeps serving. REDIS_SAVE_IN_PROGRESS if one is
+ * already running, REDIS_IO_ERROR if the fork fails.
+ */
+REDIS_RC rdb_bgsave(const char *path);
+/*
+ * Called in the parent when a background save started by rdb_bgsave_with
+ * ends. Such a save is a building block (the AOF rewrite), not a save of the
+ * dataset: it does not reset the change counter or LASTSAVE.
+ */
+typedef void (*RdbChildDone)(bool ok);
+REDIS_RC rdb_bgsave_with(const char *path, RdbChildDone done);
+/*
+ * Diskless replication: fork a child that streams the snapshot to each of
+ * the `count` sockets in `fds` as "$EOF:<mark>\r\n" <snapshot> <mark>, the
+ * mark being RDB_EOF_MARK_LEN random characters the receiver looks for since
+ * the length is not known up front. A socket that takes nothing for
+ * `timeout_ms` is given up. `done` is then called in the parent with, for
+ * each socket, whether all of it was written (NULL if that could not be
+ * told: count them all as failed); like rdb_bgsave_with, this is not a save
+ * of the dataset.
+ */
+#define RDB_EOF_MARK_LEN 40
+typedef void (*RdbSocketsDone)(const bool *ok, int count);
+REDIS_RC rdb_bgsave_to_sockets(const int *fds, int count, const char *mark,
+                               long long timeout_ms, RdbSocketsDone done);
+/* A background save, or a rewrite using one, is running. */
+bool rdb_bgsave_in_progress(void);
+/* Kill a running background save and remove its temporary file. */
+void rdb_bgsave_abort(void);
+
+/*
+ * From the server cron: reap a finished background save, and start one when
+ * a `save` rule of the current config is met.
+ */
+void rdb_cron(void);
+
+/* Count `n` writes to the calling thread's keyspace towards `save` rules. */
+void rdb_add_dirty(long long n);
+long long rdb_dirty(void);
+const RdbSaveInfo *rdb_save_info(void);
+
+/*
+ * Load `path` into the (empty) keyspace, skipping keys that have expired
+ * since (unless this is a replica, which leaves them to its primary's DELs).
+ * A missing file loads nothing. The checksum is verified as the file
+ * is read; REDIS_CORRUPT_SNAPSHOT on any mismatch, in which case the keyspace
+ * is left empty. `keys`, if given, receives the number of keys loaded.
+ */
+REDIS_RC rdb_load(const char *path, size_t *keys);
+
+/*
+ * Load the snapshot image at the start of buf[0..size), which may be followed
+ * by other data; *used receives its length. Unlike rdb_load, keys that have
+ * expired are loaded too: the image is the preamble of an AOF, whose commands
+ * may still use them. As rdb_load otherwise. With `release_pages` the pages
+ * parsed are dropped as the load goes (madvise MADV_DONTNEED): only for a
+ * private mapping of a file, whose untouched pages are read back from the
+ * file if need be; heap memory would be zeroed.
+ */
+REDIS_RC rdb_load_buffer(const void *buf, size_t size, size_t *used,
+                         size_t *keys, bool release_pages);
+/* Start the `save` rules afresh once a dataset is loaded: no changes yet. */
+void rdb_reset_save_clock(void);
+
+/*
+ * Serialize one value the way DUMP returns it: the type and value of its
+ * snapshot record (no key), the format version, the byte order mark and an
+ * xxh64 checksum of the rest. Used to move keys between nodes, so it carries
+ * the same restrictions as a snapshot. *payload is malloc'd.
+ */
+REDIS_RC rdb_dump_object(const RedisObject *obj, char **payload, size_t *len);
+/*
+ * The value a DUMP payload holds, in *obj; REDIS_BAD_PAYLOAD when the
+ * payload does not verify or parse.
+ */
+REDIS_RC rdb_restore_object(const void *payload, size_t len,
+                            RedisObject **obj);
+
+#endif
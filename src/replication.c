@@ -0,0 +1,1329 @@
+#include "replication.h"
+#include "aof.h"
+#include "cmd_handler.h"
+#include "logging.h"
+#include "rdb.h"
+#include "redis-C/config.h"
+#include "storage.h"
+#include "util/str_util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define REPL_IOBUF_LEN (16 * 1024)
+/* Buffers above this are released once they are empty */
+#define REPL_MAX_IDLE_BUF_LEN (64 * 1024)
+/* A replica only sends acks: anything longer is garbage */
+#define REPL_MAX_REPLICA_INPUT (64 * 1024)
+/* Reconnections to the primary are this far apart */
+#define REPL_CONNECT_PERIOD_MS 1000
+#define REPL_ADDR_LEN 64
+
+typedef enum {
+  REPLICA_WAIT_FORK = 0, /* wants a full sync, waits for a child to run it */
+  REPLICA_WAIT_SNAPSHOT, /* a child streams the snapshot, `out` buffers */
+  REPLICA_ONLINE
+} ReplicaState;
+
+/* A replica of this node */
+typedef struct {
+  int fd;
+  char addr[REPL_ADDR_LEN]; /* "ip:port" of the connection */
+  char ip[REPL_ADDR_LEN];
+  int port;                 /* it listens on, from REPLCONF listening-port */
+  ReplicaState state;
+  bool old_sync;            /* SYNC: no +FULLRESYNC line, no acks */
+  bool drop;                /* disconnect from repl_before_sleep() */
+  ReplyBuffer out;          /* stream not sent yet */
+  size_t sent;              /* bytes of `out` already written */
+  long long ack_offset;
+  long long ack_ms;
+  char *rcv;
+  size_t rcv_len;
+  size_t rcv_cap;
+  RespParser parser;
+} Replica;
+
+typedef enum {
+  LINK_NONE = 0,         /* not a replica */
+  LINK_CONNECT,          /* to connect from the cron */
+  LINK_CONNECTING,
+  LINK_RECEIVE_PONG,
+  LINK_RECEIVE_REPLCONF,
+  LINK_RECEIVE_PSYNC,
+  LINK_TRANSFER,         /* receiving the snapshot */
+  LINK_CONNECTED         /* applying the stream */
+} LinkState;
+
+/* The link to the primary of this node */
+typedef struct {
+  char *host;
+  int port;
+  char addr[REPL_ADDR_LEN]; /* host:port, for the slow log */
+  LinkState state;
+  int fd;
+  char *buf; /* received, from `pos` on not processed yet */
+  size_t len;
+  size_t cap;
+  size_t pos;
+  RespParser parser;
+  ReplyBuffer snd;
+  size_t sent;
+  int replconf_pending; /* replies to REPLCONF still expected */
+  long long last_io_ms;
+  long long last_ack_ms;
+  /* full sync */
+  char sync_replid[REPL_ID_LEN + 1];
+  long long sync_offset;
+  bool eof_header; /* "$EOF:<mark>" was read */
+  char mark[RDB_EOF_MARK_LEN];
+  int tmp_fd;
+  char *tmp_path;
+  size_t transfer_bytes;
+} PrimaryLink;
+
+bool g_repl_replica = false;
+bool g_repl_streaming = false;
+bool g_repl_applying = false;
+
+static EventLoop *g_el = NULL;
+static char g_replid[REPL_ID_LEN + 1];
+static char g_replid2[REPL_ID_LEN + 1];
+static long long g_offset = 0; /* of the last byte of the stream */
+/* g_replid2 is valid for the offsets before this one */
+static long long g_second_offset = -1;
+/* the last g_histlen bytes of the stream, the newest right before g_idx */
+static char *g_backlog = NULL;
+static size_t g_backlog_size = 0;
+static size_t g_idx = 0;
+static size_t g_histlen = 0;
+static Replica **g_replicas = NULL;
+static int g_replicas_len = 0;
+static int g_replicas_cap = 0;
+/* the replicas of the running full sync, as the child numbers its sockets */
+static Replica **g_transfer = NULL;
+static int g_transfer_len = 0;
+static PrimaryLink g_primary;
+static ReplyBuffer g_encoded; /* repl_feed() scratch */
+static ReplyBuffer g_discard; /* replies to the stream of the primary */
+static long long g_last_ping_ms = 0;
+static unsigned long long g_sync_full = 0;
+static unsigned long long g_sync_partial_ok = 0;
+static unsigned long long g_sync_partial_err = 0;
+
+/* private functions */
+static int __set_nonblock(int fd);
+static bool __write_all(int fd, const char *p, size_t n);
+static void __update_streaming(void);
+static bool __backlog_create(void);
+static void __backlog_copy(long long from, ReplyBuffer *out);
+static void __stream_append(const char *p, size_t n);
+static void __shift_replid(const char *replid);
+static Replica *__replica_create(int fd, const char *addr, int port);
+static void __replica_free(Replica *r);
+static void __drop_replicas(void);
+static bool __replica_flush(Replica *r);
+static bool __try_partial_resync(Replica *r, const char *replid, size_t len,
+                                 const char *offset, size_t offset_len);
+static void __start_full_sync(void);
+static void __full_sync_done(const bool *ok, int count);
+static void __replica_read_handler(EventLoop *el, int fd, void *data, int mask);
+static void __replica_write_handler(EventLoop *el, int fd, void *data,
+                                    int mask);
+static void __primary_connect(void);
+static void __primary_disconnect(void);
+static void __primary_send(int argc, const char **argv);
+static void __primary_flush(void);
+static void __send_ack(void);
+static char *__read_line(void);
+static bool __process_primary_input(void);
+static bool __handshake_reply(const char *line);
+static bool __transfer_read(void);
+static bool __transfer_load(void);
+static bool __apply_stream(void);
+static const char *__find_mark(const char *p, size_t len);
+static void __primary_connect_handler(EventLoop *el, int fd, void *data,
+                                      int mask);
+static void __primary_read_handler(EventLoop *el, int fd, void *data,
+                                   int mask);
+static void __primary_write_handler(EventLoop *el, int fd, void *data,
+                                    int mask);
+
+REDIS_RC repl_init(EventLoop *el) {
+  g_el = el;
+  string_random_hex(g_replid, REPL_ID_LEN);
+  g_replid[REPL_ID_LEN] = '\0';
+  memset(g_replid2, '0', REPL_ID_LEN);
+  g_replid2[REPL_ID_LEN] = '\0';
+  reply_init(&g_encoded, RESP_PROTO_2);
+  reply_init(&g_discard, RESP_PROTO_2);
+  memset(&g_primary, 0, sizeof(g_primary));
+  g_primary.fd = -1;
+  g_primary.tmp_fd = -1;
+  resp_parser_init(&g_primary.parser);
+  reply_init(&g_primary.snd, RESP_PROTO_2);
+
+  const RedisCConfig *cfg = get_current_config();
+  if (cfg->replicaof_host) {
+    return repl_set_primary(cfg->replicaof_host, cfg->replicaof_port);
+  }
+  return REDIS_OK;
+}
+
+void repl_shutdown(void) {
+  if (!g_el) {
+    return;
+  }
+  __primary_disconnect();
+  free(g_primary.host);
+  resp_parser_free(&g_primary.parser);
+  reply_free(&g_primary.snd);
+  free(g_primary.buf);
+  memset(&g_primary, 0, sizeof(g_primary));
+  g_primary.fd = -1;
+  g_primary.tmp_fd = -1;
+  __drop_replicas();
+  free(g_replicas);
+  g_replicas = NULL;
+  g_replicas_cap = 0;
+  free(g_transfer);
+  g_transfer = NULL;
+  g_transfer_len = 0;
+  free(g_backlog);
+  g_backlog = NULL;
+  g_backlog_size = g_idx = g_histlen = 0;
+  reply_free(&g_encoded);
+  reply_free(&g_discard);
+  g_repl_replica = false;
+  __update_streaming();
+  g_el = NULL;
+}
+
+void repl_cron(void) {
+  if (!g_el) {
+    return;
+  }
+  long long now = el_mstime();
+  long long timeout = get_current_config()->repl_timeout * 1000;
+
+  switch (g_primary.state) {
+  case LINK_NONE:
+    break;
+  case LINK_CONNECT:
+    if (now - g_primary.last_io_ms >= REPL_CONNECT_PERIOD_MS) {
+      __primary_connect();
+    }
+    break;
+  case LINK_CONNECTED:
+    if (now - g_primary.last_ack_ms >= REPL_ACK_PERIOD_MS) {
+      __send_ack();
+    }
+    /* fall through */
+  default:
+    if (now - g_primary.last_io_ms > timeout) {
+      LOG_WARNING("Timeout on the link to the primary %s", g_primary.addr);
+      __primary_disconnect();
+    }
+    break;
+  }
+
+  __start_full_sync();
+  for (int i = 0; i < g_replicas_len; i++) {
+    Replica *r = g_replicas[i];
+    if (r->state == REPLICA_WAIT_FORK) {
+      /* a newline keeps the connection alive until the snapshot starts */
+      if (write(r->fd, "\n", 1) == -1 && errno != EAGAIN &&
+          errno != EWOULDBLOCK) {
+        r->drop = true;
+      }
+    } else if (r->state == REPLICA_ONLINE && !r->old_sync &&
+               now - r->ack_ms > timeout) {
+      LOG_WARNING("Disconnecting timed out replica %s", r->addr);
+      r->drop = true;
+    }
+  }
+  if (g_repl_streaming && g_replicas_len > 0 &&
+      now - g_last_ping_ms >= REPL_PING_PERIOD_MS) {
+    char *ping[1] = {"PING"};
+    size_t ping_len[1] = {4};
+    repl_feed(1, ping, ping_len);
+    g_last_ping_ms = now;
+  }
+}
+
+void repl_before_sleep(void) {
+  for (int i = 0; i < g_replicas_len; i++) {
+    Replica *r = g_replicas[i];
+    if (!r->drop && r->state == REPLICA_ONLINE && r->sent < r->out.len &&
+        !(el_get_file_events(g_el, r->fd) & EL_WRITABLE)) {
+      r->drop = !__replica_flush(r);
+    }
+    if (r->drop) {
+      __replica_free(r);
+      i--;
+    }
+  }
+}
+
+void repl_feed(int argc, char **argv, const size_t *argv_len) {
+  if (!g_repl_streaming) {
+    return;
+  }
+  reply_add_array_len(&g_encoded, argc);
+  for (int i = 0; i < argc; i++) {
+    reply_add_bulk(&g_encoded, argv[i], argv_len[i]);
+  }
+  if (g_encoded.oom) {
+    /* the replicas would miss a write: make them resync */
+    LOG_WARNING("Unable to buffer the replication stream, dropping replicas");
+    __drop_replicas();
+  } else {
+    __stream_append(g_encoded.buf, g_encoded.len);
+  }
+  reply_clear(&g_encoded);
+}
+
+REDIS_RC repl_set_primary(const char *host, int port) {
+  if (!host) {
+    if (!g_repl_replica) {
+      return REDIS_OK;
+    }
+    __primary_disconnect();
+    free(g_primary.host);
+    g_primary.host = NULL;
+    g_primary.state = LINK_NONE;
+    g_repl_replica = false;
+    /* the history so far stays valid under the old id, so the replicas of
+     * the old primary can resume from here */
+    char replid[REPL_ID_LEN + 1];
+    string_random_hex(replid, REPL_ID_LEN);
+    replid[REPL_ID_LEN] = '\0';
+    __shift_replid(replid);
+    __update_streaming();
+    LOG_INFO("Replication stopped, new replication ID %s", g_replid);
+    return REDIS_OK;
+  }
+  if (g_repl_replica && port == g_primary.port &&
+      strcasecmp(host, g_primary.host) == 0) {
+    return REDIS_OK;
+  }
+  char *copy = strdup(host);
+  if (!copy || !__backlog_create()) {
+    free(copy);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  __primary_disconnect();
+  free(g_primary.host);
+  g_primary.host = copy;
+  g_primary.port = port;
+  snprintf(g_primary.addr, sizeof(g_primary.addr), "%s:%d", host, port);
+  g_repl_replica = true;
+  __update_streaming();
+  /* they follow this node's history, which is about to change */
+  __drop_replicas();
+  LOG_INFO("Replicating %s", g_primary.addr);
+  __primary_connect();
+  return REDIS_OK;
+}
+
+void repl_replconf(int argc, char **argv, const size_t *argv_len, int *port,
+                   ReplyBuffer *reply) {
+  if (argc % 2 == 0) {
+    reply_add_error(reply, redis_rc_message(REDIS_INVALID_ARGUMENT));
+    return;
+  }
+  for (int i = 1; i < argc; i += 2) {
+    if (strcasecmp(argv[i], "listening-port") == 0) {
+      long long value;
+      if (!string_to_ll(argv[i + 1], argv_len[i + 1], &value) || value < 0 ||
+          value > 65535) {
+        reply_add_error(reply, redis_rc_message(REDIS_NOT_AN_INTEGER));
+        return;
+      }
+      *port = (int)value;
+    }
+    /* capa, ip-address...: this primary only speaks one protocol */
+  }
+  reply_add_ok(reply);
+}
+
+void repl_add_replica(int fd, const char *addr, int port, int argc,
+                      char **argv, const size_t *argv_len) {
+  const char *err = NULL;
+  if (g_repl_replica && g_primary.state != LINK_CONNECTED) {
+    err = "-NOMASTERLINK Can't SYNC while not connected with my master\r\n";
+  } else if (!__backlog_create()) {
+    err = "-ERR out of memory\r\n";
+  }
+  Replica *r = err ? NULL : __replica_create(fd, addr, port);
+  if (!r) {
+    err = err ? err : "-ERR out of memory\r\n";
+    __write_all(fd, err, strlen(err));
+    close(fd);
+    return;
+  }
+  __update_streaming();
+
+  r->old_sync = argc < 3; /* SYNC rather than PSYNC replid offset */
+  if (!r->old_sync) {
+    if (__try_partial_resync(r, argv[1], argv_len[1], argv[2], argv_len[2])) {
+      g_sync_partial_ok++;
+      return;
+    }
+    /* "?" asks for a full sync from the start */
+    if (strcmp(argv[1], "?") != 0) {
+      g_sync_partial_err++;
+    }
+  }
+  LOG_INFO("Full synchronization requested by replica %s", r->addr);
+  g_sync_full++;
+  r->state = REPLICA_WAIT_FORK;
+  __start_full_sync();
+}
+
+void repl_status(ReplStatus *s) {
+  memset(s, 0, sizeof(*s));
+  s->replica = g_repl_replica;
+  s->primary_host = g_primary.host;
+  s->primary_port = g_primary.port;
+  s->link_up = g_primary.state == LINK_CONNECTED;
+  s->last_io_s = g_primary.last_io_ms && g_primary.fd != -1
+                     ? (el_mstime() - g_primary.last_io_ms) / 1000
+                     : -1;
+  s->sync_in_progress = g_primary.state == LINK_TRANSFER;
+  s->replid = g_el ? g_replid : "";
+  s->replid2 = g_el ? g_replid2 : "";
+  s->offset = g_offset;
+  s->second_offset = g_second_offset;
+  s->backlog_active = g_backlog != NULL;
+  s->backlog_size = g_backlog ? g_backlog_size
+                              : get_current_config()->repl_backlog_size;
+  s->backlog_first_byte = g_backlog ? g_offset - (long long)g_histlen + 1 : 0;
+  s->backlog_histlen = (long long)g_histlen;
+  s->replicas = g_replicas_len;
+  s->sync_full = g_sync_full;
+  s->sync_partial_ok = g_sync_partial_ok;
+  s->sync_partial_err = g_sync_partial_err;
+}
+
+void repl_replica_status(int i, ReplReplicaStatus *s) {
+  static const char *states[] = {"wait_bgsave", "send_bulk", "online"};
+  const Replica *r = g_replicas[i];
+  s->ip = r->ip;
+  s->port = r->port;
+  s->state = states[r->state];
+  s->offset = r->ack_offset;
+  s->lag_s = (el_mstime() - r->ack_ms) / 1000;
+}
+
+void repl_reply_role(ReplyBuffer *reply) {
+  char value[STR_UTIL_LL_SIZE];
+  if (g_repl_replica) {
+    static const char *states[] = {
+        "none",      "connect",   "connecting", "handshake",
+        "handshake", "handshake", "sync",       "connected"};
+    reply_add_array_len(reply, 5);
+    reply_add_bulk_cstr(reply, "slave");
+    reply_add_bulk_cstr(reply, g_primary.host);
+    reply_add_integer(reply, g_primary.port);
+    reply_add_bulk_cstr(reply, states[g_primary.state]);
+    reply_add_integer(reply, g_offset);
+    return;
+  }
+  reply_add_array_len(reply, 3);
+  reply_add_bulk_cstr(reply, "master");
+  reply_add_integer(reply, g_offset);
+  reply_add_array_len(reply, g_replicas_len);
+  for (int i = 0; i < g_replicas_len; i++) {
+    const Replica *r = g_replicas[i];
+    reply_add_array_len(reply, 3);
+    reply_add_bulk_cstr(reply, r->ip);
+    reply_add_bulk(reply, value, string_from_ll(value, r->port));
+    reply_add_bulk(reply, value, string_from_ll(value, r->ack_offset));
+  }
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static int __set_nonblock(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags == -1) {
+    return -1;
+  }
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* For files, and for the few bytes a fresh socket always takes */
+static bool __write_all(int fd, const char *p, size_t n) {
+  while (n > 0) {
+    ssize_t w = write(fd, p, n);
+    if (w == -1 && errno == EINTR) {
+      continue;
+    } else if (w <= 0) {
+      return false;
+    }
+    p += w;
+    n -= (size_t)w;
+  }
+  return true;
+}
+
+static void __update_streaming(void) {
+  g_repl_streaming = g_backlog != NULL && !g_repl_replica;
+}
+
+/* The backlog is only kept once there is something to replicate to */
+static bool __backlog_create(void) {
+  if (g_backlog) {
+    return true;
+  }
+  size_t size = get_current_config()->repl_backlog_size;
+  g_backlog = malloc(size);
+  if (!g_backlog) {
+    return false;
+  }
+  g_backlog_size = size;
+  g_idx = g_histlen = 0;
+  return true;
+}
+
+/* Append the stream from offset `from` on, which the backlog holds, to `out` */
+static void __backlog_copy(long long from, ReplyBuffer *out) {
+  size_t skip = (size_t)(from - (g_offset - (long long)g_histlen + 1));
+  size_t n = g_histlen - skip;
+  size_t start = (g_idx + g_backlog_size - g_histlen + skip) % g_backlog_size;
+  size_t first = n < g_backlog_size - start ? n : g_backlog_size - start;
+  reply_add_raw(out, g_backlog + start, first);
+  if (n > first) {
+    reply_add_raw(out, g_backlog, n - first);
+  }
+}
+
+/* Add stream bytes: to the backlog and to every replica past its fork */
+static void __stream_append(const char *p, size_t n) {
+  if (!g_backlog || n == 0) {
+    return;
+  }
+  g_offset += (long long)n;
+  const char *src = p;
+  size_t left = n;
+  if (left > g_backlog_size) {
+    src += left - g_backlog_size;
+    left = g_backlog_size;
+  }
+  while (left > 0) {
+    size_t chunk = g_backlog_size - g_idx;
+    chunk = chunk < left ? chunk : left;
+    memcpy(g_backlog + g_idx, src, chunk);
+    g_idx = (g_idx + chunk) % g_backlog_size;
+    src += chunk;
+    left -= chunk;
+  }
+  g_histlen = g_histlen + n > g_backlog_size ? g_backlog_size : g_histlen + n;
+
+  for (int i = 0; i < g_replicas_len; i++) {
+    Replica *r = g_replicas[i];
+    if (r->state == REPLICA_WAIT_FORK || r->drop) {
+      continue;
+    }
+    reply_add_raw(&r->out, p, n);
+    if (r->out.oom || r->out.len - r->sent > REPL_REPLICA_BUFFER_LIMIT) {
+      LOG_WARNING("Disconnecting replica %s, which does not keep up",
+                  r->addr);
+      r->drop = true;
+    }
+  }
+}
+
+/*
+ * Continue the history under a new id. The old one stays valid up to here,
+ * and the replicas are dropped so they resync under the new one.
+ */
+static void __shift_replid(const char *replid) {
+  memcpy(g_replid2, g_replid, sizeof(g_replid));
+  g_second_offset = g_offset + 1;
+  memcpy(g_replid, replid, REPL_ID_LEN);
+  __drop_replicas();
+}
+
+static Replica *__replica_create(int fd, const char *addr, int port) {
+  if (g_replicas_len == g_replicas_cap) {
+    int cap = g_replicas_cap ? g_replicas_cap * 2 : 4;
+    Replica **replicas = realloc(g_replicas, cap * sizeof(Replica *));
+    if (!replicas) {
+      return NULL;
+    }
+    g_replicas = replicas;
+    g_replicas_cap = cap;
+  }
+  Replica *r = calloc(1, sizeof(Replica));
+  if (!r) {
+    return NULL;
+  }
+  r->fd = fd;
+  snprintf(r->addr, sizeof(r->addr), "%s", addr);
+  /* "ip:port" or "[ip]:port" */
+  const char *colon = strrchr(addr, ':');
+  size_t ip_len = colon ? (size_t)(colon - addr) : strlen(addr);
+  if (addr[0] == '[' && ip_len >= 2) {
+    snprintf(r->ip, sizeof(r->ip), "%.*s", (int)ip_len - 2, addr + 1);
+  } else {
+    snprintf(r->ip, sizeof(r->ip), "%.*s", (int)ip_len, addr);
+  }
+  r->port = port;
+  r->ack_ms = el_mstime();
+  reply_init(&r->out, RESP_PROTO_2);
+  resp_parser_init(&r->parser);
+  if (el_add_file_event(g_el, fd, EL_READABLE, __replica_read_handler, r) ==
+      EL_ERR) {
+    reply_free(&r->out);
+    resp_parser_free(&r->parser);
+    free(r);
+    return NULL;
+  }
+  g_replicas[g_replicas_len++] = r;
+  return r;
+}
+
+static void __replica_free(Replica *r) {
+  for (int i = 0; i < g_transfer_len; i++) {
+    if (g_transfer[i] == r) {
+      g_transfer[i] = NULL;
+    }
+  }
+  for (int i = 0; i < g_replicas_len; i++) {
+    if (g_replicas[i] == r) {
+      memmove(g_replicas + i, g_replicas + i + 1,
+              (g_replicas_len - i - 1) * sizeof(Replica *));
+      g_replicas_len--;
+      break;
+    }
+  }
+  LOG_INFO("Connection with replica %s closed", r->addr);
+  el_del_file_event(g_el, r->fd, EL_READABLE | EL_WRITABLE);
+  close(r->fd);
+  reply_free(&r->out);
+  resp_parser_free(&r->parser);
+  free(r->rcv);
+  free(r);
+}
+
+static void __drop_replicas(void) {
+  while (g_replicas_len > 0) {
+    __replica_free(g_replicas[g_replicas_len - 1]);
+  }
+}
+
+/* Write what the socket takes; false on an error */
+static bool __replica_flush(Replica *r) {
+  while (r->sent < r->out.len) {
+    ssize_t n = write(r->fd, r->out.buf + r->sent, r->out.len - r->sent);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return false;
+      }
+      if (!(el_get_file_events(g_el, r->fd) & EL_WRITABLE) &&
+          el_add_file_event(g_el, r->fd, EL_WRITABLE, __replica_write_handler,
+                            r) == EL_ERR) {
+        return false;
+      }
+      /* the stream keeps growing at the end: drop what was written */
+      if (r->sent > r->out.len / 2) {
+        memmove(r->out.buf, r->out.buf + r->sent, r->out.len - r->sent);
+        r->out.len -= r->sent;
+        r->sent = 0;
+      }
+      return true;
+    }
+    r->sent += (size_t)n;
+  }
+  reply_clear(&r->out);
+  r->sent = 0;
+  if (r->out.cap > REPL_MAX_IDLE_BUF_LEN) {
+    reply_free(&r->out);
+  }
+  if (el_get_file_events(g_el, r->fd) & EL_WRITABLE) {
+    el_del_file_event(g_el, r->fd, EL_WRITABLE);
+  }
+  return true;
+}
+
+/*
+ * PSYNC: if the backlog still holds the stream from `offset` on, and that
+ * stream is the history the replica follows, answer +CONTINUE and queue it.
+ */
+static bool __try_partial_resync(Replica *r, const char *replid, size_t len,
+                                 const char *offset, size_t offset_len) {
+  long long from;
+  if (!string_to_ll(offset, offset_len, &from)) {
+    return false;
+  }
+  bool current = len == REPL_ID_LEN && memcmp(replid, g_replid, len) == 0;
+  bool previous = len == REPL_ID_LEN &&
+                  memcmp(replid, g_replid2, len) == 0 &&
+                  from <= g_second_offset;
+  if (!current && !previous) {
+    if (strcmp(replid, "?") != 0) {
+      LOG_INFO("Partial resynchronization with replica %s refused: "
+               "replication ID mismatch",
+               r->addr);
+    }
+    return false;
+  }
+  long long first = g_offset - (long long)g_histlen + 1;
+  if (from < first || from > g_offset + 1) {
+    LOG_INFO("Partial resynchronization with replica %s refused: offset %lld "
+             "is not in the backlog (%lld to %lld)",
+             r->addr, from, first, g_offset);
+    return false;
+  }
+  reply_add_raw(&r->out, "+CONTINUE ", 10);
+  reply_add_raw(&r->out, g_replid, REPL_ID_LEN);
+  reply_add_raw(&r->out, "\r\n", 2);
+  __backlog_copy(from, &r->out);
+  r->state = REPLICA_ONLINE;
+  r->ack_offset = from - 1;
+  LOG_INFO("Partial resynchronization with replica %s: %lld bytes of backlog",
+           r->addr, g_offset + 1 - from);
+  return true;
+}
+
+/*
+ * Fork a child that streams the snapshot to every replica waiting for one,
+ * unless a child already runs: the cron retries. The replicas are told the
+ * offset the snapshot stands for, then get the stream from there.
+ */
+static void __start_full_sync(void) {
+  int waiting = 0;
+  for (int i = 0; i < g_replicas_len; i++) {
+    const Replica *r = g_replicas[i];
+    waiting += r->state == REPLICA_WAIT_FORK && !r->drop;
+  }
+  if (waiting == 0 || rdb_bgsave_in_progress()) {
+    return;
+  }
+  Replica **batch = malloc(waiting * sizeof(Replica *));
+  int *fds = malloc(waiting * sizeof(int));
+  if (!batch || !fds) {
+    free(batch);
+    free(fds);
+    return;
+  }
+  char line[64 + REPL_ID_LEN];
+  int line_len = snprintf(line, sizeof(line), "+FULLRESYNC %s %lld\r\n",
+                          g_replid, g_offset);
+  int n = 0;
+  for (int i = 0; i < g_replicas_len; i++) {
+    Replica *r = g_replicas[i];
+    if (r->state != REPLICA_WAIT_FORK || r->drop) {
+      continue;
+    }
+    if (!r->old_sync && !__write_all(r->fd, line, (size_t)line_len)) {
+      r->drop = true;
+      continue;
+    }
+    batch[n] = r;
+    fds[n++] = r->fd;
+  }
+  char mark[RDB_EOF_MARK_LEN];
+  string_random_hex(mark, RDB_EOF_MARK_LEN);
+  REDIS_RC rc = n == 0 ? REDIS_OK
+                       : rdb_bgsave_to_sockets(
+                             fds, n, mark,
+                             get_current_config()->repl_timeout * 1000,
+                             __full_sync_done);
+  free(fds);
+  if (n == 0 || REDIS_FAILED(rc)) {
+    if (n > 0) {
+      LOG_WARNING("Unable to start the full synchronization of %d replicas",
+                  n);
+    }
+    for (int i = 0; i < n; i++) {
+      batch[i]->drop = true;
+    }
+    free(batch);
+    return;
+  }
+  for (int i = 0; i < n; i++) {
+    batch[i]->state = REPLICA_WAIT_SNAPSHOT;
+    batch[i]->ack_offset = g_offset;
+  }
+  g_transfer = batch;
+  g_transfer_len = n;
+}
+
+/* The child is done: the replicas that got all of it go online */
+static void __full_sync_done(const bool *ok, int count) {
+  long long now = el_mstime();
+  for (int i = 0; i < g_transfer_len; i++) {
+    Replica *r = g_transfer[i];
+    if (!r) {
+      continue; /* disconnected meanwhile */
+    }
+    if (ok && i < count && ok[i]) {
+      LOG_INFO("Full synchronization of replica %s done", r->addr);
+      r->state = REPLICA_ONLINE;
+      r->ack_ms = now;
+    } else {
+      LOG_WARNING("Full synchronization of replica %s failed", r->addr);
+      r->drop = true;
+    }
+  }
+  free(g_transfer);
+  g_transfer = NULL;
+  g_transfer_len = 0;
+}
+
+/* A replica only sends REPLCONF ACK <offset> */
+static void __replica_read_handler(EventLoop *el, int fd, void *data,
+                                   int mask) {
+  (void)el;
+  (void)mask;
+  Replica *r = data;
+  if (r->rcv_cap - r->rcv_len < 1024) {
+    size_t cap = r->rcv_cap ? r->rcv_cap * 2 : 4096;
+    char *buf = realloc(r->rcv, cap);
+    if (!buf) {
+      __replica_free(r);
+      return;
+    }
+    r->rcv = buf;
+    r->rcv_cap = cap;
+  }
+  ssize_t n = read(fd, r->rcv + r->rcv_len, r->rcv_cap - r->rcv_len);
+  if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return;
+  } else if (n <= 0) {
+    __replica_free(r);
+    return;
+  }
+  r->rcv_len += (size_t)n;
+
+  size_t pos = 0;
+  for (;;) {
+    RespParser *p = &r->parser;
+    RespStatus status = resp_parse(p, r->rcv + pos, r->rcv_len - pos);
+    if (status == RESP_INCOMPLETE) {
+      break;
+    } else if (status == RESP_ERROR) {
+      LOG_WARNING("Protocol error from replica %s: %s", r->addr, p->error);
+      __replica_free(r);
+      return;
+    }
+    long long offset;
+    if (p->argc == 3 && strcasecmp(p->argv[0], "REPLCONF") == 0 &&
+        strcasecmp(p->argv[1], "ACK") == 0 &&
+        string_to_ll(p->argv[2], p->arg_len[2], &offset)) {
+      r->ack_offset = offset;
+      r->ack_ms = el_mstime();
+    }
+    pos += p->pos;
+    resp_parser_reset(p);
+  }
+  memmove(r->rcv, r->rcv + pos, r->rcv_len - pos);
+  r->rcv_len -= pos;
+  if (r->rcv_len > REPL_MAX_REPLICA_INPUT) {
+    __replica_free(r);
+  }
+}
+
+static void __replica_write_handler(EventLoop *el, int fd, void *data,
+                                    int mask) {
+  (void)el;
+  (void)fd;
+  (void)mask;
+  Replica *r = data;
+  if (!__replica_flush(r)) {
+    r->drop = true;
+  }
+}
+
+static void __primary_connect(void) {
+  g_primary.last_io_ms = el_mstime();
+  char port[16];
+  snprintf(port, sizeof(port), "%d", g_primary.port);
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(g_primary.host, port, &hints, &res) != 0) {
+    LOG_WARNING("Unable to resolve the primary %s", g_primary.host);
+    g_primary.state = LINK_CONNECT;
+    return;
+  }
+  int fd = socket(res->ai_family, SOCK_STREAM, 0);
+  int yes = 1;
+  if (fd == -1 || __set_nonblock(fd) == -1 ||
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)) == -1 ||
+      (connect(fd, res->ai_addr, res->ai_addrlen) == -1 &&
+       errno != EINPROGRESS) ||
+      el_add_file_event(g_el, fd, EL_WRITABLE, __primary_connect_handler,
+                        NULL) == EL_ERR) {
+    LOG_WARNING("Unable to connect to the primary %s", g_primary.addr);
+    if (fd != -1) {
+      close(fd);
+    }
+    freeaddrinfo(res);
+    g_primary.state = LINK_CONNECT;
+    return;
+  }
+  freeaddrinfo(res);
+  g_primary.fd = fd;
+  g_primary.state = LINK_CONNECTING;
+}
+
+/* Back to LINK_CONNECT, keeping the replication id and offset to resume */
+static void __primary_disconnect(void) {
+  if (g_primary.fd != -1) {
+    el_del_file_event(g_el, g_primary.fd, EL_READABLE | EL_WRITABLE);
+    close(g_primary.fd);
+    g_primary.fd = -1;
+  }
+  if (g_primary.tmp_fd != -1) {
+    close(g_primary.tmp_fd);
+    g_primary.tmp_fd = -1;
+    unlink(g_primary.tmp_path);
+  }
+  free(g_primary.tmp_path);
+  g_primary.tmp_path = NULL;
+  g_primary.len = g_primary.pos = 0;
+  if (g_primary.cap > REPL_MAX_IDLE_BUF_LEN) {
+    free(g_primary.buf);
+    g_primary.buf = NULL;
+    g_primary.cap = 0;
+  }
+  resp_parser_reset(&g_primary.parser);
+  reply_clear(&g_primary.snd);
+  g_primary.sent = 0;
+  g_primary.eof_header = false;
+  g_primary.replconf_pending = 0;
+  if (g_primary.state != LINK_NONE) {
+    g_primary.state = LINK_CONNECT;
+  }
+  g_primary.last_io_ms = el_mstime();
+}
+
+static void __primary_send(int argc, const char **argv) {
+  reply_add_array_len(&g_primary.snd, argc);
+  for (int i = 0; i < argc; i++) {
+    reply_add_bulk_cstr(&g_primary.snd, argv[i]);
+  }
+  __primary_flush();
+}
+
+/* Write what the socket takes; the rest waits for it to be writable */
+static void __primary_flush(void) {
+  while (g_primary.sent < g_primary.snd.len) {
+    ssize_t n = write(g_primary.fd, g_primary.snd.buf + g_primary.sent,
+                      g_primary.snd.len - g_primary.sent);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return; /* the read side notices and drops the link */
+      }
+      if (!(el_get_file_events(g_el, g_primary.fd) & EL_WRITABLE)) {
+        el_add_file_event(g_el, g_primary.fd, EL_WRITABLE,
+                          __primary_write_handler, NULL);
+      }
+      return;
+    }
+    g_primary.sent += (size_t)n;
+  }
+  reply_clear(&g_primary.snd);
+  g_primary.sent = 0;
+  if (el_get_file_events(g_el, g_primary.fd) & EL_WRITABLE) {
+    el_del_file_event(g_el, g_primary.fd, EL_WRITABLE);
+  }
+}
+
+static void __send_ack(void) {
+  char offset[STR_UTIL_LL_SIZE];
+  string_from_ll(offset, g_offset);
+  const char *ack[3] = {"REPLCONF", "ACK", offset};
+  __primary_send(3, ack);
+  g_primary.last_ack_ms = el_mstime();
+}
+
+/* The next line of the handshake, without its CRLF; NULL until complete */
+static char *__read_line(void) {
+  char *start = g_primary.buf + g_primary.pos;
+  char *nl = memchr(start, '\n', g_primary.len - g_primary.pos);
+  if (!nl) {
+    return NULL;
+  }
+  g_primary.pos = (size_t)(nl - g_primary.buf) + 1;
+  if (nl > start && nl[-1] == '\r') {
+    nl--;
+  }
+  *nl = '\0';
+  return start;
+}
+
+/* Consume what the primary sent; false when the link was dropped */
+static bool __process_primary_input(void) {
+  for (;;) {
+    switch (g_primary.state) {
+    case LINK_RECEIVE_PONG:
+    case LINK_RECEIVE_REPLCONF:
+    case LINK_RECEIVE_PSYNC: {
+      char *line = __read_line();
+      if (!line) {
+        return true;
+      }
+      if (!__handshake_reply(line)) {
+        return false;
+      }
+      break;
+    }
+    case LINK_TRANSFER:
+      if (!__transfer_read()) {
+        return false;
+      }
+      if (g_primary.state == LINK_TRANSFER) {
+        return true;
+      }
+      break;
+    case LINK_CONNECTED:
+      return __apply_stream();
+    default:
+      return true;
+    }
+  }
+}
+
+static bool __handshake_reply(const char *line) {
+  switch (g_primary.state) {
+  case LINK_RECEIVE_PONG: {
+    if (line[0] != '+') {
+      LOG_WARNING("The primary %s answered PING with: %s", g_primary.addr,
+                  line);
+      __primary_disconnect();
+      return false;
+    }
+    char port[STR_UTIL_LL_SIZE], offset[STR_UTIL_LL_SIZE];
+    string_from_ll(port, get_current_config()->port);
+    string_from_ll(offset, g_offset + 1);
+    const char *listening_port[3] = {"REPLCONF", "listening-port", port};
+    const char *capa[5] = {"REPLCONF", "capa", "eof", "capa", "psync2"};
+    const char *psync[3] = {"PSYNC", g_replid, offset};
+    __primary_send(3, listening_port);
+    __primary_send(5, capa);
+    __primary_send(3, psync);
+    g_primary.replconf_pending = 2;
+    g_primary.state = LINK_RECEIVE_REPLCONF;
+    return true;
+  }
+  case LINK_RECEIVE_REPLCONF:
+    if (line[0] == '-') {
+      LOG_INFO("The primary %s does not understand REPLCONF: %s",
+               g_primary.addr, line);
+    }
+    if (--g_primary.replconf_pending == 0) {
+      g_primary.state = LINK_RECEIVE_PSYNC;
+    }
+    return true;
+  default:
+    break;
+  }
+
+  /* the primary may send newlines to keep the link alive before answering */
+  if (line[0] == '\0') {
+    return true;
+  }
+  if (strncmp(line, "+FULLRESYNC ", 12) == 0) {
+    const char *replid = line + 12;
+    const char *space = strchr(replid, ' ');
+    long long offset;
+    if (!space || space - replid != REPL_ID_LEN ||
+        !string_to_ll(space + 1, strlen(space + 1), &offset)) {
+      LOG_WARNING("Unexpected reply to PSYNC from the primary: %s", line);
+      __primary_disconnect();
+      return false;
+    }
+    memcpy(g_primary.sync_replid, replid, REPL_ID_LEN);
+    g_primary.sync_replid[REPL_ID_LEN] = '\0';
+    g_primary.sync_offset = offset;
+    g_primary.transfer_bytes = 0;
+    g_primary.state = LINK_TRANSFER;
+    LOG_INFO("Full synchronization with the primary %s, offset %lld",
+             g_primary.addr, offset);
+    return true;
+  }
+  if (strncmp(line, "+CONTINUE", 9) == 0) {
+    const char *replid = line + 9;
+    while (*replid == ' ') {
+      replid++;
+    }
+    /* the primary was promoted: its history goes on under a new id */
+    if (strlen(replid) == REPL_ID_LEN &&
+        memcmp(replid, g_replid, REPL_ID_LEN) != 0) {
+      __shift_replid(replid);
+    }
+    g_primary.state = LINK_CONNECTED;
+    LOG_INFO("Partial resynchronization with the primary %s, offset %lld",
+             g_primary.addr, g_offset);
+    __send_ack();
+    return true;
+  }
+  LOG_WARNING("The primary %s answered PSYNC with: %s", g_primary.addr, line);
+  __primary_disconnect();
+  return false;
+}
+
+/*
+ * The snapshot is "$EOF:<mark>\r\n", the image, then the mark: the image is
+ * written to a temporary file up to the mark, keeping back the bytes that
+ * could be the start of a mark split across reads.
+ */
+static bool __transfer_read(void) {
+  if (!g_primary.eof_header) {
+    while (g_primary.pos < g_primary.len &&
+           g_primary.buf[g_primary.pos] == '\n') {
+      g_primary.pos++;
+    }
+    char *line = __read_line();
+    if (!line) {
+      return true;
+    }
+    if (strncmp(line, "$EOF:", 5) != 0 ||
+        strlen(line) != 5 + RDB_EOF_MARK_LEN) {
+      LOG_WARNING("Unexpected snapshot header from the primary: %.64s", line);
+      __primary_disconnect();
+      return false;
+    }
+    memcpy(g_primary.mark, line + 5, RDB_EOF_MARK_LEN);
+    const char *dbfilename = get_current_config()->dbfilename;
+    size_t path_len = strlen(dbfilename) + 32;
+    g_primary.tmp_path = malloc(path_len);
+    if (g_primary.tmp_path) {
+      snprintf(g_primary.tmp_path, path_len, "%s.sync-%d.tmp", dbfilename,
+               (int)getpid());
+      g_primary.tmp_fd =
+          open(g_primary.tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (g_primary.tmp_fd == -1) {
+      LOG_WARNING("Unable to create a file for the snapshot of the primary");
+      __primary_disconnect();
+      return false;
+    }
+    g_primary.eof_header = true;
+  }
+
+  const char *data = g_primary.buf + g_primary.pos;
+  size_t avail = g_primary.len - g_primary.pos;
+  const char *mark = __find_mark(data, avail);
+  size_t payload;
+  if (mark) {
+    payload = (size_t)(mark - data);
+  } else {
+    payload = avail > RDB_EOF_MARK_LEN - 1 ? avail - (RDB_EOF_MARK_LEN - 1) : 0;
+  }
+  if (payload > 0 && !__write_all(g_primary.tmp_fd, data, payload)) {
+    LOG_WARNING("Unable to write the snapshot of the primary to disk");
+    __primary_disconnect();
+    return false;
+  }
+  g_primary.transfer_bytes += payload;
+  g_primary.pos += payload;
+  if (!mark) {
+    return true;
+  }
+  g_primary.pos += RDB_EOF_MARK_LEN;
+  return __transfer_load();
+}
+
+/* Replace the dataset with the snapshot received and follow its history */
+static bool __transfer_load(void) {
+  const RedisCConfig *cfg = get_current_config();
+  bool synced = fsync(g_primary.tmp_fd) == 0;
+  close(g_primary.tmp_fd);
+  g_primary.tmp_fd = -1;
+  LOG_INFO("Loading the snapshot of the primary (%zu bytes)",
+           g_primary.transfer_bytes);
+  size_t keys = 0;
+  REDIS_RC rc = synced ? storage_flush(true) : REDIS_IO_ERROR;
+  if (REDIS_SUCCESS(rc)) {
+    rc = rdb_load(g_primary.tmp_path, &keys);
+  }
+  if (REDIS_FAILED(rc)) {
+    LOG_WARNING("Unable to load the snapshot of the primary");
+    unlink(g_primary.tmp_path);
+    __primary_disconnect();
+    return false;
+  }
+  if (rename(g_primary.tmp_path, cfg->dbfilename) == -1) {
+    LOG_WARNING("Unable to rename the snapshot of the primary to %s",
+                cfg->dbfilename);
+    unlink(g_primary.tmp_path);
+  }
+  free(g_primary.tmp_path);
+  g_primary.tmp_path = NULL;
+  g_primary.eof_header = false;
+
+  memcpy(g_replid, g_primary.sync_replid, sizeof(g_replid));
+  memset(g_replid2, '0', REPL_ID_LEN);
+  g_second_offset = -1;
+  g_offset = g_primary.sync_offset;
+  g_idx = g_histlen = 0;
+  __drop_replicas();
+  /* the AOF must start over from the new dataset */
+  if (aof_enabled()) {
+    bool scheduled;
+    aof_rewrite(&scheduled);
+  }
+  g_primary.state = LINK_CONNECTED;
+  LOG_INFO("Synchronized with the primary %s: %zu keys, offset %lld",
+           g_primary.addr, keys, g_offset);
+  __send_ack();
+  return true;
+}
+
+/*
+ * Execute the commands of the stream, passing each on to the backlog and
+ * the replicas of this node as it was received.
+ */
+static bool __apply_stream(void) {
+  bool ok = true;
+  dispatch_batch_begin(g_primary.addr);
+  g_repl_applying = true;
+  while (g_primary.pos < g_primary.len) {
+    RespParser *p = &g_primary.parser;
+    char *start = g_primary.buf + g_primary.pos;
+    RespStatus status = resp_parse(p, start, g_primary.len - g_primary.pos);
+    if (status == RESP_INCOMPLETE) {
+      break;
+    }
+    if (status == RESP_ERROR || (start[0] != '*' && p->argc > 0)) {
+      /* an inline command could not be passed on as it was received */
+      LOG_WARNING("Protocol error from the primary %s", g_primary.addr);
+      ok = false;
+      break;
+    }
+    /* the parser terminated the arguments in place over their CR */
+    for (int i = 0; i < p->argc; i++) {
+      p->argv[i][p->arg_len[i]] = '\r';
+    }
+    __stream_append(start, p->pos);
+    for (int i = 0; i < p->argc; i++) {
+      p->argv[i][p->arg_len[i]] = '\0';
+    }
+    if (p->argc >= 2 && strcasecmp(p->argv[0], "REPLCONF") == 0 &&
+        strcasecmp(p->argv[1], "GETACK") == 0) {
+      __send_ack();
+    } else if (p->argc > 0) {
+      dispatch_command(p->argc, p->argv, p->arg_len, &g_discard);
+      reply_clear(&g_discard);
+    }
+    g_primary.pos += p->pos;
+    resp_parser_reset(p);
+  }
+  g_repl_applying = false;
+  dispatch_batch_end();
+  if (!ok) {
+    __primary_disconnect();
+  }
+  return ok;
+}
+
+static const char *__find_mark(const char *p, size_t len) {
+  const char *end = p + len;
+  while (len >= RDB_EOF_MARK_LEN) {
+    const char *hit = memchr(p, g_primary.mark[0], len - RDB_EOF_MARK_LEN + 1);
+    if (!hit) {
+      return NULL;
+    }
+    if (memcmp(hit, g_primary.mark, RDB_EOF_MARK_LEN) == 0) {
+      return hit;
+    }
+    p = hit + 1;
+    len = (size_t)(end - p);
+  }
+  return NULL;
+}
+
+/* Connected (or not): start the handshake */
+static void __primary_connect_handler(EventLoop *el, int fd, void *data,
+                                      int mask) {
+  (void)data;
+  (void)mask;
+  int err = 0;
+  socklen_t err_len = sizeof(err);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == -1 || err) {
+    LOG_WARNING("Unable to connect to the primary %s: %s", g_primary.addr,
+                strerror(err));
+    __primary_disconnect();
+    return;
+  }
+  el_del_file_event(el, fd, EL_WRITABLE);
+  if (el_add_file_event(el, fd, EL_READABLE, __primary_read_handler, NULL) ==
+      EL_ERR) {
+    __primary_disconnect();
+    return;
+  }
+  g_primary.state = LINK_RECEIVE_PONG;
+  g_primary.last_io_ms = el_mstime();
+  const char *ping[1] = {"PING"};
+  __primary_send(1, ping);
+}
+
+static void __primary_read_handler(EventLoop *el, int fd, void *data,
+                                   int mask) {
+  (void)el;
+  (void)data;
+  (void)mask;
+  if (g_primary.cap - g_primary.len < REPL_IOBUF_LEN) {
+    size_t cap = g_primary.cap ? g_primary.cap * 2 : REPL_IOBUF_LEN * 2;
+    while (cap - g_primary.len < REPL_IOBUF_LEN) {
+      cap *= 2;
+    }
+    char *buf = realloc(g_primary.buf, cap);
+    if (!buf) {
+      __primary_disconnect();
+      return;
+    }
+    g_primary.buf = buf;
+    g_primary.cap = cap;
+  }
+  ssize_t n = read(fd, g_primary.buf + g_primary.len,
+                   g_primary.cap - g_primary.len);
+  if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return;
+  } else if (n <= 0) {
+    LOG_WARNING("Lost the link to the primary %s", g_primary.addr);
+    __primary_disconnect();
+    return;
+  }
+  g_primary.len += (size_t)n;
+  g_primary.last_io_ms = el_mstime();
+  if (!__process_primary_input()) {
+    return;
+  }
+  /* keep only what is not processed; parser offsets are relative to it */
+  memmove(g_primary.buf, g_primary.buf + g_primary.pos,
+          g_primary.len - g_primary.pos);
+  g_primary.len -= g_primary.pos;
+  g_primary.pos = 0;
+}
+
+static void __primary_write_handler(EventLoop *el, int fd, void *data,
+                                    int mask) {
+  (void)el;
+  (void)fd;
+  (void)data;
+  (void)mask;
+  __primary_flush();
+}
@@ -0,0 +1,124 @@
+#ifndef REDIS_C_REPLICATION_H__
+#define REDIS_C_REPLICATION_H__
+
+#include "event_loop.h"
+#include "redis-C/rc.h"
+#include "serialize.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Asynchronous primary -> replica replication, as in Redis: replicas serve
+ * the reads, the primary takes the writes.
+ *
+ * The primary turns every write it executes into a stream of commands, the
+ * ones it logs to the AOF, and numbers its bytes: the replication offset.
+ * The last repl-backlog-size bytes of the stream are kept in a circular
+ * backlog. A replica connects with PSYNC <replication id> <offset + 1>; when
+ * the primary still has that part of the stream it answers +CONTINUE and
+ * sends the missing bytes (a partial resync), otherwise +FULLRESYNC <id>
+ * <offset>, then a snapshot streamed straight from a forked child to the
+ * socket (rdb_bgsave_to_sockets(), diskless: nothing is written on the
+ * primary) and the commands it executed meanwhile, buffered for the replica.
+ * From there the stream flows continuously and the replica acknowledges
+ * its offset once a second.
+ *
+ * A replica loads the snapshot from a temporary file next to the dbfilename,
+ * which then replaces the dbfilename, and applies the stream as a client
+ * would. It keeps a backlog as well, under the replication id of its
+ * primary, and passes the stream on, so replicas can be chained and a
+ * promoted replica (REPLICAOF NO ONE) lets the other replicas of its old
+ * primary resync partially: the old id is remembered as the secondary one,
+ * valid up to the offset of the promotion.
+ *
+ * Replication runs on the main loop, so it needs a single shard. Replicas
+ * refuse writes from clients (READONLY).
+ */
+
+#define REPL_ID_LEN 40
+/* A replica acknowledges its offset this often */
+#define REPL_ACK_PERIOD_MS 1000
+/* The primary pings its replicas through the stream this often */
+#define REPL_PING_PERIOD_MS 10000
+/* A replica whose stream piles up beyond this is disconnected */
+#define REPL_REPLICA_BUFFER_LIMIT (256L * 1024 * 1024)
+
+/* Set by REPLICAOF; read by the request path. */
+extern bool g_repl_replica;
+/* The backlog exists and this node is a primary: writes are streamed */
+extern bool g_repl_streaming;
+/* The stream of the primary is being applied */
+extern bool g_repl_applying;
+
+static inline bool repl_is_replica(void) { return g_repl_replica; }
+static inline bool repl_stream_enabled(void) { return g_repl_streaming; }
+/* Clients are refused writes: only the stream of the primary may write. */
+static inline bool repl_read_only(void) {
+  return g_repl_replica && !g_repl_applying;
+}
+
+/* Start replicating --replicaof, if set. Call once the dataset is loaded. */
+REDIS_RC repl_init(EventLoop *el);
+void repl_shutdown(void);
+/* Connections, full syncs, timeouts, acks and pings; from server_cron. */
+void repl_cron(void);
+/* Send the stream of this iteration to the replicas; from before_sleep. */
+void repl_before_sleep(void);
+
+/* Append a write that was executed to the stream. */
+void repl_feed(int argc, char **argv, const size_t *argv_len);
+
+/* REPLICAOF host port; NULL `host` for REPLICAOF NO ONE. */
+REDIS_RC repl_set_primary(const char *host, int port);
+
+/*
+ * REPLCONF from a client connection: listening-port is stored in `port`,
+ * the other options are accepted and ignored.
+ */
+void repl_replconf(int argc, char **argv, const size_t *argv_len, int *port,
+                   ReplyBuffer *reply);
+/*
+ * SYNC or PSYNC from a client connection, whose socket the replication takes
+ * over from then on (and closes): `addr` is its peer and `port` what it
+ * announced with REPLCONF listening-port (0 if nothing).
+ */
+void repl_add_replica(int fd, const char *addr, int port, int argc,
+                      char **argv, const size_t *argv_len);
+
+/* For INFO */
+typedef struct {
+  bool replica;
+  const char *primary_host;
+  int primary_port;
+  bool link_up;
+  long long last_io_s; /* since the primary was last heard from, -1: never */
+  bool sync_in_progress;
+  const char *replid;
+  const char *replid2;
+  long long offset;
+  long long second_offset;
+  bool backlog_active;
+  size_t backlog_size;
+  long long backlog_first_byte;
+  long long backlog_histlen;
+  int replicas;
+  unsigned long long sync_full;
+  unsigned long long sync_partial_ok;
+  unsigned long long sync_partial_err;
+} ReplStatus;
+
+typedef struct {
+  const char *ip;
+  int port;
+  const char *state; /* wait_bgsave, send_bulk or online */
+  long long offset;  /* acknowledged */
+  long long lag_s;   /* since the last ack */
+} ReplReplicaStatus;
+
+void repl_status(ReplStatus *s);
+/* Replica `i` of repl_status()->replicas */
+void repl_replica_status(int i, ReplReplicaStatus *s);
+/* ROLE */
+void repl_reply_role(ReplyBuffer *reply);
+
+#endif
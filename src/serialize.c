@@ -0,0 +1,541 @@
+#include "serialize.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARGS_INITIAL_CAP 8
+#define ARGS_PREALLOC_MAX 1024
+#define REPLY_INITIAL_CAP 256
+#define REPLY_REFS_INITIAL_CAP 4
+
+/* private functions */
+static bool __reserve_args(RespParser *p, long need);
+static bool __parse_long(const char *s, const char *end, long *out);
+static RespStatus __fail(RespParser *p, const char *msg);
+static RespStatus __parse_inline(RespParser *p, char *buf, size_t len);
+static RespStatus __parse_multibulk(RespParser *p, char *buf, size_t len);
+static void __fill_argv(RespParser *p, char *buf);
+static bool __reply_reserve(ReplyBuffer *r, size_t extra);
+static void __reply_prefixed_len(ReplyBuffer *r, char prefix, long long len);
+static size_t __ll2str(char *dst, long long value);
+static void __release_refs(ReplyBuffer *r);
+static int __iov_add(struct iovec *iov, const char *data, size_t len,
+                     size_t wire, size_t from);
+
+void resp_parser_init(RespParser *p) {
+  memset(p, 0, sizeof(*p));
+  p->bulk_len = -1;
+}
+
+void resp_parser_free(RespParser *p) {
+  free(p->arg_off);
+  free(p->arg_len);
+  free(p->argv);
+  resp_parser_init(p);
+}
+
+void resp_parser_reset(RespParser *p) {
+  p->expected = 0;
+  p->bulk_len = -1;
+  p->pos = 0;
+  p->argc = 0;
+  p->error = NULL;
+}
+
+RespStatus resp_parse(RespParser *p, char *buf, size_t len) {
+  if (len == 0) {
+    return RESP_INCOMPLETE;
+  }
+  if (buf[0] == '*') {
+    return __parse_multibulk(p, buf, len);
+  }
+  return __parse_inline(p, buf, len);
+}
+
+/* ============================================================================
+ * Reply encoder
+ * ============================================================================
+ */
+
+void reply_init(ReplyBuffer *r, int proto) {
+  r->buf = NULL;
+  r->len = 0;
+  r->cap = 0;
+  r->proto = proto;
+  r->oom = false;
+  r->refs_allowed = false;
+  r->refs = NULL;
+  r->nrefs = 0;
+  r->refs_cap = 0;
+  r->ref_bytes = 0;
+}
+
+void reply_free(ReplyBuffer *r) {
+  __release_refs(r);
+  free(r->refs);
+  r->refs = NULL;
+  r->refs_cap = 0;
+  free(r->buf);
+  r->buf = NULL;
+  r->len = 0;
+  r->cap = 0;
+}
+
+void reply_clear(ReplyBuffer *r) {
+  __release_refs(r);
+  r->len = 0;
+  r->oom = false;
+}
+
+char *reply_detach(ReplyBuffer *r, size_t *len) {
+  char *buf = r->buf;
+  *len = r->len;
+  r->buf = NULL;
+  r->len = 0;
+  r->cap = 0;
+  return buf;
+}
+
+void reply_allow_refs(ReplyBuffer *r) { r->refs_allowed = true; }
+
+int reply_iov(const ReplyBuffer *r, size_t from, struct iovec *iov, int max) {
+  int n = 0;
+  size_t wire = 0;  /* wire offset of the segment being looked at */
+  size_t start = 0; /* where the current stretch of `buf` starts */
+  for (size_t i = 0; i <= r->nrefs && n < max; i++) {
+    /* the stretch of `buf` up to ref i (or the end), then ref i */
+    size_t end = i < r->nrefs ? r->refs[i].offset : r->len;
+    n += __iov_add(iov + n, r->buf + start, end - start, wire, from);
+    wire += end - start;
+    start = end;
+    if (i < r->nrefs && n < max) {
+      n += __iov_add(iov + n, r->refs[i].data, r->refs[i].len, wire, from);
+      wire += r->refs[i].len;
+    }
+  }
+  return n;
+}
+
+void reply_add_raw(ReplyBuffer *r, const char *data, size_t len) {
+  if (!__reply_reserve(r, len)) {
+    return;
+  }
+  memcpy(r->buf + r->len, data, len);
+  r->len += len;
+}
+
+void reply_add_status(ReplyBuffer *r, const char *status) {
+  size_t n = strlen(status);
+  if (!__reply_reserve(r, n + 3)) {
+    return;
+  }
+  r->buf[r->len++] = '+';
+  memcpy(r->buf + r->len, status, n);
+  r->len += n;
+  r->buf[r->len++] = '\r';
+  r->buf[r->len++] = '\n';
+}
+
+void reply_add_ok(ReplyBuffer *r) { reply_add_raw(r, "+OK\r\n", 5); }
+
+void reply_add_error(ReplyBuffer *r, const char *err) {
+  size_t n = strlen(err);
+  if (!__reply_reserve(r, n + 3)) {
+    return;
+  }
+  r->buf[r->len++] = '-';
+  for (size_t i = 0; i < n; i++) {
+    /* an error must stay on a single line */
+    char c = err[i];
+    r->buf[r->len++] = (c == '\r' || c == '\n') ? ' ' : c;
+  }
+  r->buf[r->len++] = '\r';
+  r->buf[r->len++] = '\n';
+}
+
+void reply_add_error_format(ReplyBuffer *r, const char *fmt, ...) {
+  char msg[256];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  reply_add_error(r, msg);
+}
+
+void reply_add_integer(ReplyBuffer *r, long long value) {
+  __reply_prefixed_len(r, ':', value);
+}
+
+void reply_add_bulk(ReplyBuffer *r, const char *data, size_t len) {
+  __reply_prefixed_len(r, '$', (long long)len);
+  if (!__reply_reserve(r, len + 2)) {
+    return;
+  }
+  memcpy(r->buf + r->len, data, len);
+  r->len += len;
+  r->buf[r->len++] = '\r';
+  r->buf[r->len++] = '\n';
+}
+
+void reply_add_bulk_ref(ReplyBuffer *r, const char *data, size_t len,
+                        ReplyRelease release, void *owner) {
+  if (!reply_wants_ref(r, len)) {
+    reply_add_bulk(r, data, len);
+    release(owner);
+    return;
+  }
+  if (r->nrefs == r->refs_cap) {
+    size_t cap = r->refs_cap ? r->refs_cap * 2 : REPLY_REFS_INITIAL_CAP;
+    ReplyRef *refs = realloc(r->refs, cap * sizeof(ReplyRef));
+    if (!refs) {
+      reply_add_bulk(r, data, len);
+      release(owner);
+      return;
+    }
+    r->refs = refs;
+    r->refs_cap = cap;
+  }
+  __reply_prefixed_len(r, '$', (long long)len);
+  if (r->oom) {
+    release(owner);
+    return;
+  }
+  r->refs[r->nrefs++] = (ReplyRef){r->len, data, len, release, owner};
+  r->ref_bytes += len;
+  reply_add_raw(r, "\r\n", 2);
+}
+
+void reply_add_bulk_cstr(ReplyBuffer *r, const char *str) {
+  if (!str) {
+    reply_add_null(r);
+    return;
+  }
+  reply_add_bulk(r, str, strlen(str));
+}
+
+void reply_add_null(ReplyBuffer *r) {
+  if (r->proto >= RESP_PROTO_3) {
+    reply_add_raw(r, "_\r\n", 3);
+  } else {
+    reply_add_raw(r, "$-1\r\n", 5);
+  }
+}
+
+void reply_add_null_array(ReplyBuffer *r) {
+  if (r->proto >= RESP_PROTO_3) {
+    reply_add_raw(r, "_\r\n", 3);
+  } else {
+    reply_add_raw(r, "*-1\r\n", 5);
+  }
+}
+
+void reply_add_array_len(ReplyBuffer *r, long len) {
+  __reply_prefixed_len(r, '*', len);
+}
+
+void reply_add_map_len(ReplyBuffer *r, long len) {
+  if (r->proto >= RESP_PROTO_3) {
+    __reply_prefixed_len(r, '%', len);
+  } else {
+    __reply_prefixed_len(r, '*', len * 2);
+  }
+}
+
+void reply_add_double(ReplyBuffer *r, double value) {
+  char dbuf[64];
+  int n;
+  if (isinf(value)) {
+    n = snprintf(dbuf, sizeof(dbuf), "%s", value > 0 ? "inf" : "-inf");
+  } else {
+    n = snprintf(dbuf, sizeof(dbuf), "%.17g", value);
+  }
+  if (r->proto >= RESP_PROTO_3) {
+    if (!__reply_reserve(r, (size_t)n + 3)) {
+      return;
+    }
+    r->buf[r->len++] = ',';
+    memcpy(r->buf + r->len, dbuf, n);
+    r->len += n;
+    r->buf[r->len++] = '\r';
+    r->buf[r->len++] = '\n';
+  } else {
+    reply_add_bulk(r, dbuf, (size_t)n);
+  }
+}
+
+void reply_add_bool(ReplyBuffer *r, bool value) {
+  if (r->proto >= RESP_PROTO_3) {
+    reply_add_raw(r, value ? "#t\r\n" : "#f\r\n", 4);
+  } else {
+    reply_add_raw(r, value ? ":1\r\n" : ":0\r\n", 4);
+  }
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static bool __reserve_args(RespParser *p, long need) {
+  if (need <= p->arg_cap) {
+    return true;
+  }
+  long cap = p->arg_cap ? p->arg_cap : ARGS_INITIAL_CAP;
+  while (cap < need) {
+    cap *= 2;
+  }
+  size_t *off = realloc(p->arg_off, cap * sizeof(size_t));
+  if (!off) {
+    return false;
+  }
+  p->arg_off = off;
+  size_t *lens = realloc(p->arg_len, cap * sizeof(size_t));
+  if (!lens) {
+    return false;
+  }
+  p->arg_len = lens;
+  /* argv carries an extra slot for the terminating NULL */
+  char **argv = realloc(p->argv, (cap + 1) * sizeof(char *));
+  if (!argv) {
+    return false;
+  }
+  p->argv = argv;
+  p->arg_cap = (int)cap;
+  return true;
+}
+
+static bool __parse_long(const char *s, const char *end, long *out) {
+  bool negative = false;
+  long value = 0;
+  if (s < end && *s == '-') {
+    negative = true;
+    s++;
+  }
+  if (s == end) {
+    return false;
+  }
+  for (; s < end; s++) {
+    if (*s < '0' || *s > '9' || value > (RESP_MAX_BULK_LEN * 10L)) {
+      return false;
+    }
+    value = value * 10 + (*s - '0');
+  }
+  *out = negative ? -value : value;
+  return true;
+}
+
+static RespStatus __fail(RespParser *p, const char *msg) {
+  p->error = msg;
+  return RESP_ERROR;
+}
+
+static RespStatus __parse_inline(RespParser *p, char *buf, size_t len) {
+  char *nl = memchr(buf + p->pos, '\n', len - p->pos);
+  if (!nl) {
+    if (len > RESP_MAX_INLINE_SIZE) {
+      return __fail(p, "Protocol error: too big inline request");
+    }
+    p->pos = len;
+    return RESP_INCOMPLETE;
+  }
+
+  size_t end = (size_t)(nl - buf);
+  if (end > 0 && buf[end - 1] == '\r') {
+    end--;
+  }
+
+  p->argc = 0;
+  size_t i = 0;
+  while (i < end) {
+    while (i < end && (buf[i] == ' ' || buf[i] == '\t')) {
+      i++;
+    }
+    if (i == end) {
+      break;
+    }
+    size_t start = i;
+    while (i < end && buf[i] != ' ' && buf[i] != '\t') {
+      i++;
+    }
+    if (!__reserve_args(p, p->argc + 1)) {
+      return __fail(p, "Protocol error: out of memory");
+    }
+    p->arg_off[p->argc] = start;
+    p->arg_len[p->argc] = i - start;
+    p->argc++;
+    /* the separator (or the CR/LF at the end) becomes the terminator */
+    buf[i] = '\0';
+    i++;
+  }
+
+  p->pos = (size_t)(nl - buf) + 1;
+  __fill_argv(p, buf);
+  return RESP_OK;
+}
+
+static RespStatus __parse_multibulk(RespParser *p, char *buf, size_t len) {
+  if (p->expected == 0) {
+    char *cr = memchr(buf, '\r', len);
+    if (!cr) {
+      if (len > RESP_MAX_INLINE_SIZE) {
+        return __fail(p, "Protocol error: too big mbulk count string");
+      }
+      return RESP_INCOMPLETE;
+    }
+    if ((size_t)(cr - buf) + 1 >= len) {
+      return RESP_INCOMPLETE;
+    }
+    if (cr[1] != '\n') {
+      return __fail(p, "Protocol error: invalid multibulk length");
+    }
+    long count;
+    if (!__parse_long(buf + 1, cr, &count) || count > RESP_MAX_MULTIBULK_LEN) {
+      return __fail(p, "Protocol error: invalid multibulk length");
+    }
+    p->pos = (size_t)(cr - buf) + 2;
+    p->argc = 0;
+    if (count <= 0) {
+      __fill_argv(p, buf);
+      return RESP_OK;
+    }
+    /* don't trust the header with a huge preallocation */
+    if (!__reserve_args(p, count < ARGS_PREALLOC_MAX ? count
+                                                     : ARGS_PREALLOC_MAX)) {
+      return __fail(p, "Protocol error: out of memory");
+    }
+    p->expected = count;
+  }
+
+  while (p->argc < p->expected) {
+    if (p->bulk_len == -1) {
+      if (p->pos >= len) {
+        return RESP_INCOMPLETE;
+      }
+      if (buf[p->pos] != '$') {
+        return __fail(p, "Protocol error: expected '$'");
+      }
+      char *cr = memchr(buf + p->pos, '\r', len - p->pos);
+      if (!cr) {
+        if (len - p->pos > RESP_MAX_INLINE_SIZE) {
+          return __fail(p, "Protocol error: too big bulk count string");
+        }
+        return RESP_INCOMPLETE;
+      }
+      if ((size_t)(cr - buf) + 1 >= len) {
+        return RESP_INCOMPLETE;
+      }
+      long bulk;
+      if (cr[1] != '\n' || !__parse_long(buf + p->pos + 1, cr, &bulk) ||
+          bulk < 0 || bulk > RESP_MAX_BULK_LEN) {
+        return __fail(p, "Protocol error: invalid bulk length");
+      }
+      p->pos = (size_t)(cr - buf) + 2;
+      p->bulk_len = bulk;
+    }
+
+    size_t need = (size_t)p->bulk_len + 2;
+    if (len - p->pos < need) {
+      return RESP_INCOMPLETE;
+    }
+    size_t end = p->pos + (size_t)p->bulk_len;
+    if (buf[end] != '\r' || buf[end + 1] != '\n') {
+      return __fail(p, "Protocol error: bulk string not terminated by CRLF");
+    }
+    if (!__reserve_args(p, p->argc + 1)) {
+      return __fail(p, "Protocol error: out of memory");
+    }
+    p->arg_off[p->argc] = p->pos;
+    p->arg_len[p->argc] = (size_t)p->bulk_len;
+    p->argc++;
+    buf[end] = '\0';
+    p->pos = end + 2;
+    p->bulk_len = -1;
+  }
+
+  __fill_argv(p, buf);
+  return RESP_OK;
+}
+
+static void __fill_argv(RespParser *p, char *buf) {
+  if (!p->argv && !__reserve_args(p, ARGS_INITIAL_CAP)) {
+    return;
+  }
+  for (int i = 0; i < p->argc; i++) {
+    p->argv[i] = buf + p->arg_off[i];
+  }
+  p->argv[p->argc] = NULL;
+}
+
+static bool __reply_reserve(ReplyBuffer *r, size_t extra) {
+  if (r->oom) {
+    return false;
+  }
+  if (r->len + extra <= r->cap) {
+    return true;
+  }
+  size_t cap = r->cap ? r->cap : REPLY_INITIAL_CAP;
+  while (cap < r->len + extra) {
+    cap *= 2;
+  }
+  char *buf = realloc(r->buf, cap);
+  if (!buf) {
+    r->oom = true;
+    return false;
+  }
+  r->buf = buf;
+  r->cap = cap;
+  return true;
+}
+
+static void __reply_prefixed_len(ReplyBuffer *r, char prefix, long long len) {
+  /* prefix + 20 digits + sign + CRLF */
+  if (!__reply_reserve(r, 24)) {
+    return;
+  }
+  r->buf[r->len++] = prefix;
+  r->len += __ll2str(r->buf + r->len, len);
+  r->buf[r->len++] = '\r';
+  r->buf[r->len++] = '\n';
+}
+
+static size_t __ll2str(char *dst, long long value) {
+  char tmp[24];
+  size_t n = 0;
+  unsigned long long v;
+  bool negative = value < 0;
+  v = negative ? (unsigned long long)(-(value + 1)) + 1
+               : (unsigned long long)value;
+  do {
+    tmp[n++] = (char)('0' + (v % 10));
+    v /= 10;
+  } while (v);
+  size_t out = 0;
+  if (negative) {
+    dst[out++] = '-';
+  }
+  while (n) {
+    dst[out++] = tmp[--n];
+  }
+  return out;
+}
+
+static void __release_refs(ReplyBuffer *r) {
+  for (size_t i = 0; i < r->nrefs; i++) {
+    r->refs[i].release(r->refs[i].owner);
+  }
+  r->nrefs = 0;
+  r->ref_bytes = 0;
+}
+
+/* One iovec for the part of a segment at wire offset `wire` not sent yet */
+static int __iov_add(struct iovec *iov, const char *data, size_t len,
+                     size_t wire, size_t from) {
+  if (from >= wire + len) {
+    return 0;
+  }
+  size_t skip = from > wire ? from - wire : 0;
+  iov->iov_base = (char *)data + skip;
+  iov->iov_len = len - skip;
+  return 1;
+}
@@ -1,96 +1,148 @@
 #ifndef REDIS_C_SERIALIZE_H__
 #define REDIS_C_SERIALIZE_H__
 
-#include "command/cmd.h"
-#include "command/cmd_cms.h"
-#include <_stdio.h>
-#include <_stdlib.h>
 #include <stdbool.h>
-#include <string.h>
+#include <stddef.h>
+#include <sys/uio.h>
 
-static bool __strcmp(const char *l, const char *r, size_t cmp_size) {
-  for (size_t i = 0; i < cmp_size; i++) {
-    if (l[i] != r[i])
-      return false;
-  }
-  return true;
-}
+/*
+ * RESP (REdis Serialization Protocol) request parser and reply encoder.
+ *
+ * Requests are parsed straight out of the caller's buffer: every argument is
+ * a view (offset + length) into that buffer and is NUL-terminated in place by
+ * overwriting the CR of its trailing CRLF, so handlers can keep using C string
+ * APIs without copying. Both multibulk (`*<n>\r\n$<len>\r\n...`) and inline
+ * (`PING\r\n`) requests are accepted.
+ *
+ * The parser is resumable: when a request is split across reads it returns
+ * RESP_INCOMPLETE and remembers how far it got, so the next call only looks at
+ * the new bytes. Offsets are relative to the start of the request, so the
+ * caller may move the unconsumed bytes to the front of its buffer in between.
+ */
+
+#define RESP_PROTO_2 2
+#define RESP_PROTO_3 3
+
+#define RESP_MAX_INLINE_SIZE (64 * 1024)
+#define RESP_MAX_MULTIBULK_LEN (1024 * 1024)
+#define RESP_MAX_BULK_LEN (512L * 1024 * 1024)
 
-static Command *serializer(const char *buffer, size_t buf_size) {
-  char cmd_type[16];
-  char cmd_subtype[16];
-  size_t idx = 0;
+typedef enum { RESP_OK = 0, RESP_INCOMPLETE, RESP_ERROR } RespStatus;
 
-  // Skip any leading spaces
-  while (idx < buf_size && buffer[idx] == ' ')
-    idx++;
+typedef struct {
+  long expected;  /* elements announced by the multibulk header, 0 if unknown */
+  long bulk_len;  /* length of the bulk being read, -1 when expecting '$' */
+  size_t pos;     /* offset where the next call resumes (consumed on RESP_OK) */
+  int argc;       /* arguments parsed so far */
+  int arg_cap;
+  size_t *arg_off;
+  size_t *arg_len;
+  char **argv;    /* filled on RESP_OK, points into the parsed buffer */
+  const char *error; /* static description when RESP_ERROR is returned */
+} RespParser;
 
-  size_t type_idx = 0;
-  while (idx < buf_size && buffer[idx] != ' ' && buffer[idx] != '.' &&
-         type_idx < sizeof(cmd_type) - 1) {
-    cmd_type[type_idx++] = buffer[idx++];
-  }
-  // NUL-terminate
-  cmd_type[type_idx] = '\0';
+void resp_parser_init(RespParser *p);
+void resp_parser_free(RespParser *p);
+/* Forget the current request, keeping the argument arrays for reuse. */
+void resp_parser_reset(RespParser *p);
+/*
+ * Parse one request from buf[0..len). On RESP_OK p->argc/argv/arg_len describe
+ * it and p->pos is the number of bytes consumed; an empty request (blank
+ * inline line or `*0`) yields RESP_OK with argc == 0.
+ */
+RespStatus resp_parse(RespParser *p, char *buf, size_t len);
 
-  // If we stopped because of '.', parse subtype
-  if (idx < buf_size && buffer[idx] == '.') {
-    idx++; // skip '.'
-    size_t subtype_idx = 0;
-    while (idx < buf_size && buffer[idx] != ' ' &&
-           subtype_idx < sizeof(cmd_subtype) - 1) {
-      cmd_subtype[subtype_idx++] = buffer[idx++];
-    }
-    cmd_subtype[subtype_idx] = '\0';
-  }
+/* ============================================================================
+ * Reply encoder
+ * ============================================================================
+ */
 
-  int cur_arg = 0;
-  char *args[5];
-  int cur_word_len = 0;
-  char cur_word[256];
+/*
+ * Bulk payloads of at least REPLY_REF_MIN_LEN bytes can be referenced instead
+ * of copied: the reply keeps a pointer to the value's own memory, which the
+ * caller pins with a reference that is released once the bytes are written
+ * (or the reply is dropped). The wire stream is then `buf` with the
+ * referenced spans spliced in at their offsets, sent with writev().
+ */
+#define REPLY_REF_MIN_LEN (16 * 1024)
 
-  for (; idx < buf_size; idx++) {
-    if (buffer[idx] == ' ') {
-      if (cur_word_len > 0) {
-        cur_word[cur_word_len] = '\0';
-        args[cur_arg++] = strdup(cur_word);
-        cur_word_len = 0;
-      }
-    } else if (buffer[idx] == '\n') {
-      idx++;
-    } else {
-      cur_word[cur_word_len++] = buffer[idx];
-    }
-  }
+typedef void (*ReplyRelease)(void *owner);
 
-  // Handle last word
-  if (cur_word_len > 0) {
-    cur_word[cur_word_len] = '\0';
-    args[cur_arg++] = strdup(cur_word);
-  }
+typedef struct {
+  size_t offset;        /* spliced in after this many bytes of `buf` */
+  const char *data;
+  size_t len;
+  ReplyRelease release; /* called with `owner` when the span is dropped */
+  void *owner;
+} ReplyRef;
 
-  printf("Command: %s\n", cmd_type);
-  if (__strcmp(cmd_type, "PING", 4)) {
-    return create_command(CMD_PING, -1, NULL);
-  } else if (__strcmp(cmd_type, "CMS", 3)) {
-    if (__strcmp(cmd_subtype, "INITBYDIM", 9)) {
-      printf("Command INITBYDIM\n");
-      return create_command(CMD_CMS, (int)CMS_INITBYDIM, args);
-    } else if (__strcmp(cmd_subtype, "INITBYPROB", 10)) {
-      printf("Command INITBYPROB\n");
-      return create_command(CMD_CMS, (int)CMS_INITBYPROB, args);
-    } else if (__strcmp(cmd_subtype, "INCRBY", 6)) {
-      printf("Command INCRBY\n");
-      return create_command(CMD_CMS, (int)CMS_INCRBY, args);
-    } else if (__strcmp(cmd_subtype, "QUERY", 5)) {
-      printf("Command QUERY\n");
-      return create_command(CMD_CMS, (int)CMS_QUERY, args);
-    }
-    printf("Not match any CMS command\n");
-    return NULL;
-  }
+typedef struct {
+  char *buf;
+  size_t len;
+  size_t cap;
+  int proto;  /* RESP_PROTO_2 or RESP_PROTO_3, selected with HELLO */
+  bool oom;   /* set when growing the buffer failed; the reply is truncated */
+  bool refs_allowed; /* off: reply_add_bulk_ref copies (see reply_allow_refs) */
+  ReplyRef *refs;
+  size_t nrefs;
+  size_t refs_cap;
+  size_t ref_bytes; /* total length of the referenced spans */
+} ReplyBuffer;
+
+void reply_init(ReplyBuffer *r, int proto);
+void reply_free(ReplyBuffer *r);
+/* Drop the encoded bytes but keep the allocation and protocol. */
+void reply_clear(ReplyBuffer *r);
+/*
+ * Hand the encoded bytes to the caller, who must free() them. Only for
+ * buffers that never allowed references.
+ */
+char *reply_detach(ReplyBuffer *r, size_t *len);
+/*
+ * Let reply_add_bulk_ref keep references. Only for replies written straight
+ * to a socket by reply_iov; anything that reads `buf` directly (the AOF,
+ * shard messages) must leave this off.
+ */
+void reply_allow_refs(ReplyBuffer *r);
+/* Bytes of the reply on the wire: `buf` plus the referenced spans. */
+static inline size_t reply_length(const ReplyBuffer *r) {
+  return r->len + r->ref_bytes;
+}
+/*
+ * Describe the reply from wire offset `from` on in at most `max` iovecs;
+ * returns how many were filled.
+ */
+int reply_iov(const ReplyBuffer *r, size_t from, struct iovec *iov, int max);
 
-  return NULL;
+void reply_add_raw(ReplyBuffer *r, const char *data, size_t len);
+void reply_add_status(ReplyBuffer *r, const char *status);
+void reply_add_ok(ReplyBuffer *r);
+void reply_add_error(ReplyBuffer *r, const char *err);
+void reply_add_error_format(ReplyBuffer *r, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void reply_add_integer(ReplyBuffer *r, long long value);
+void reply_add_bulk(ReplyBuffer *r, const char *data, size_t len);
+void reply_add_bulk_cstr(ReplyBuffer *r, const char *str);
+/*
+ * Bulk string of `len` bytes at `data`, which stay valid until
+ * `release(owner)` is called; the call consumes that reference. Short
+ * payloads, and buffers without reply_allow_refs, are copied and released
+ * at once.
+ */
+void reply_add_bulk_ref(ReplyBuffer *r, const char *data, size_t len,
+                        ReplyRelease release, void *owner);
+/* Whether reply_add_bulk_ref would reference `len` bytes rather than copy. */
+static inline bool reply_wants_ref(const ReplyBuffer *r, size_t len) {
+  return r->refs_allowed && len >= REPLY_REF_MIN_LEN;
 }
+void reply_add_null(ReplyBuffer *r);
+void reply_add_null_array(ReplyBuffer *r);
+void reply_add_array_len(ReplyBuffer *r, long len);
+/* RESP3 map of `len` pairs; emitted as a flat array of 2*len under RESP2. */
+void reply_add_map_len(ReplyBuffer *r, long len);
+/* RESP3 double; emitted as a bulk string under RESP2. */
+void reply_add_double(ReplyBuffer *r, double value);
+/* RESP3 boolean; emitted as integer 0/1 under RESP2. */
+void reply_add_bool(ReplyBuffer *r, bool value);
 
 #endif
@@ -1,73 +1,629 @@
-#include "io-multiplexing/server/server.h"
+#include "aof.h"
+#include "bio.h"
+#include "cluster.h"
 #include "cmd_handler.h"
-#include "command/cmd.h"
-#include "io-multiplexing/server/config.h"
+#include "event_loop.h"
+#include "io_threads.h"
+#include "latency.h"
+#include "logging.h"
+#include "networking.h"
+#include "rdb.h"
 #include "redis-C/config.h"
 #include "redis-C/rc.h"
 #include "redis-C/server.h"
-#include "serialize.h"
+#include "replication.h"
+#include "shard.h"
+#include "slowlog.h"
+#include "stats.h"
 #include "storage.h"
+#include "util/monotonic.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
 
-// Callback function implementation
-char *process_request(const char *request, size_t req_size, size_t *res_size) {
-  /*
-   * response format:
-   *    - First 4 bytes is return code
-   *    - Rest 252 bytes is explanation
-   * */
-
-  Command *cmd = serializer(request, req_size);
-  REDIS_RC rc = handle_command(cmd);
-  printf("rc: %d\n", rc);
-  char *response = malloc(256);
-  *res_size = 256;
-  memcpy(response, &rc, sizeof(int));
-
-  if (REDIS_SUCCESS(rc)) {
-    return response;
-  } else if (rc == REDIS_CMD_NULL) {
-    char *msg = "Command generation failed\0";
-    memcpy(response + sizeof(int), msg, strlen(msg));
-    return response;
-  }
-  return response;
-}
-
-bool setup_config(int port) {
-  set_config(create_config(port));
+#define SERVER_CRON_HZ 10
+/* share of each cron period active expiry may take, so a burst of expiring
+ * keys costs at most 25ms of latency per tick */
+#define ACTIVE_EXPIRE_CYCLE_PERCENT 25
+#define ACTIVE_EXPIRE_BUDGET_US \
+  (1000000 / SERVER_CRON_HZ * ACTIVE_EXPIRE_CYCLE_PERCENT / 100)
+
+static EventLoop *g_el = NULL;
+
+/* Gauges INFO reads from any shard, published once per iteration. With
+ * several shards they lag the commands this iteration has run, including
+ * the ones pipelined before an INFO; a single shard reads its own live */
+static void publish_stats(EventLoop *el) {
+  ElStats loop;
+  el_get_stats(el, &loop);
+  ShardStats stats = {
+      .keys = storage_size(),
+      .expires = storage_expires_size(),
+      .clients = net_connected_clients(),
+      .loop_cycles = loop.cycles,
+      .loop_usec = (uint64_t)loop.duration_us,
+      .loop_max_usec = (uint64_t)loop.max_duration_us,
+      .loop_last_usec = (uint64_t)loop.last_duration_us,
+  };
+  stats_publish_shard(&stats);
+  /* the cycle that ended before this one started */
+  latency_add_sample_if_needed(LATENCY_EVENTLOOP,
+                               (uint64_t)loop.last_duration_us);
+}
+
+static void before_sleep(EventLoop *el) {
+  /* with I/O threads, the commands of this iteration run here */
+  net_handle_pending_reads();
+  cluster_before_sleep();
+  /* group commit: the writes of this iteration reach the AOF before their
+   * replies reach the clients */
+  if (aof_enabled()) {
+    long long start = el_monotonic_us();
+    aof_flush();
+    latency_add_sample_if_needed(LATENCY_AOF_WRITE,
+                                 (uint64_t)(el_monotonic_us() - start));
+  }
+  repl_before_sleep();
+  publish_stats(el);
+  net_before_sleep(el);
+}
+
+static long long server_cron(EventLoop *el, long long id, void *data) {
+  (void)el;
+  (void)id;
+  (void)data;
+  long long start = el_monotonic_us();
+  storage_active_expire(ACTIVE_EXPIRE_BUDGET_US);
+  latency_add_sample_if_needed(LATENCY_EXPIRE_CYCLE,
+                               (uint64_t)(el_monotonic_us() - start));
+  if (shard_count() == 1) {
+    rdb_cron();
+    aof_cron();
+    cluster_cron();
+    repl_cron();
+  }
+  /* resizing a table under a forked child would copy all of its pages */
+  if (!rdb_bgsave_in_progress()) {
+    storage_cron();
+  }
+  return 1000 / SERVER_CRON_HZ;
+}
+
+static void handle_shutdown_signal(int sig) {
+  (void)sig;
+  if (shard_count() > 1) {
+    shard_stop_all();
+  } else if (g_el) {
+    el_stop(g_el);
+  }
+}
+
+/* Event loop, listener and keyspace of shard `id`, owned by the caller. */
+static EventLoop *create_shard_loop(int id) {
+  EventLoop *el = el_create(NET_MAX_CLIENTS + 128);
+  if (!el) {
+    return NULL;
+  }
+  if (REDIS_FAILED(init_storage()) ||
+      REDIS_FAILED(net_init(el, get_current_config()->port)) ||
+      (shard_count() > 1 && REDIS_FAILED(shard_attach(el, id)))) {
+    net_shutdown();
+    release_storage();
+    el_destroy(el);
+    return NULL;
+  }
+  el_set_before_sleep(el, before_sleep);
+  el_add_time_event(el, 1, server_cron, NULL);
+  return el;
+}
+
+static void destroy_shard_loop(EventLoop *el) {
+  net_shutdown();
+  release_storage();
+  el_destroy(el);
+}
+
+static void *shard_thread_main(void *arg) {
+  int id = (int)(intptr_t)arg;
+  EventLoop *el = create_shard_loop(id);
+  if (!el) {
+    LOG_ERROR("Shard %d failed to start", id);
+    shard_stop_all();
+    return NULL;
+  }
+  el_main(el);
+  destroy_shard_loop(el);
+  return NULL;
+}
+
+/* Load the snapshot, if there is one, into the keyspace of the calling shard */
+static bool load_snapshot(void) {
+  const char *path = get_current_config()->dbfilename;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  size_t keys;
+  REDIS_RC rc = rdb_load(path, &keys);
+  if (REDIS_FAILED(rc)) {
+    LOG_ERROR("Failed to load %s: %s", path, redis_rc_message(rc));
+    return false;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (keys > 0) {
+    LOG_INFO("Loaded %zu keys from %s in %.3f seconds", keys, path,
+             (double)(end.tv_sec - start.tv_sec) +
+                 (double)(end.tv_nsec - start.tv_nsec) / 1e9);
+  }
   return true;
 }
 
-int main(int argc, char* argv[]) {
-  int port = REDIS_C_DEFAULT_PORT;
-  if (argc >= 2) {
-    port = atoi(argv[1]);
+/*
+ * Load the dataset into the calling shard: from the AOF when it is enabled
+ * and exists, else from the snapshot; then start logging if enabled.
+ */
+static bool load_data(void) {
+  const RedisCConfig *cfg = get_current_config();
+  if (!cfg->appendonly) {
+    return load_snapshot();
+  }
+  bool exists = access(cfg->appendfilename, F_OK) == 0;
+  if (exists) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t commands;
+    REDIS_RC rc = aof_load(cfg->appendfilename, &commands);
+    if (REDIS_FAILED(rc)) {
+      LOG_ERROR("Failed to load %s: %s", cfg->appendfilename,
+                redis_rc_message(rc));
+      return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    LOG_INFO("Loaded %zu keys from %s (%zu commands) in %.3f seconds",
+             storage_size(), cfg->appendfilename, commands,
+             (double)(end.tv_sec - start.tv_sec) +
+                 (double)(end.tv_nsec - start.tv_nsec) / 1e9);
+  } else if (!load_snapshot()) {
+    return false;
+  }
+  /* a new log has to start from the dataset loaded from the snapshot */
+  if (!exists && storage_size() > 0) {
+    if (REDIS_FAILED(aof_open_with_rewrite(cfg->appendfilename))) {
+      LOG_ERROR("Unable to rewrite the snapshot into %s",
+                cfg->appendfilename);
+      return false;
+    }
+  } else if (REDIS_FAILED(aof_open(cfg->appendfilename))) {
+    LOG_ERROR("Unable to open %s", cfg->appendfilename);
+    return false;
   }
+  return true;
+}
 
-  ServerConfig server_conf;
-  server_conf.port = port;
+/* "<n>[kb|mb|gb]" (case-insensitive) into bytes */
+static bool parse_memory(const char *s, size_t *bytes) {
+  char *end;
+  unsigned long long n = strtoull(s, &end, 10);
+  unsigned long long unit = 1;
+  if (end == s || *s == '-') {
+    return false;
+  }
+  if (strcasecmp(end, "kb") == 0) {
+    unit = 1024ULL;
+  } else if (strcasecmp(end, "mb") == 0) {
+    unit = 1024ULL * 1024;
+  } else if (strcasecmp(end, "gb") == 0) {
+    unit = 1024ULL * 1024 * 1024;
+  } else if (*end != '\0') {
+    return false;
+  }
+  if (n > SIZE_MAX / unit) {
+    return false;
+  }
+  *bytes = (size_t)(n * unit);
+  return true;
+}
 
-  setup_config(port);
+/* "<seconds> <changes> [<seconds> <changes> ...]", appended to `cfg` */
+static bool parse_save_params(const char *s, RedisCConfig *cfg) {
+  for (;;) {
+    long long seconds, changes;
+    int used;
+    while (*s == ' ') {
+      s++;
+    }
+    if (*s == '\0') {
+      return true;
+    }
+    if (sscanf(s, "%lld %lld%n", &seconds, &changes, &used) != 2 ||
+        seconds < 1 || changes < 1 ||
+        cfg->save_params_len == REDIS_C_MAX_SAVE_PARAMS) {
+      return false;
+    }
+    cfg->save_params[cfg->save_params_len++] = (SaveParam){seconds, changes};
+    s += used;
+  }
+}
 
-  Server *server = server_create(server_conf);
-  if (!server) {
-    printf("Failed to create server\n");
+static bool parse_yes_no(const char *s, bool *value) {
+  if (strcasecmp(s, "yes") == 0) {
+    *value = true;
+  } else if (strcasecmp(s, "no") == 0) {
+    *value = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static bool parse_appendfsync(const char *s, AppendFsync *policy) {
+  if (strcasecmp(s, "always") == 0) {
+    *policy = APPENDFSYNC_ALWAYS;
+  } else if (strcasecmp(s, "everysec") == 0) {
+    *policy = APPENDFSYNC_EVERYSEC;
+  } else if (strcasecmp(s, "no") == 0) {
+    *policy = APPENDFSYNC_NO;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static bool parse_maxmemory_policy(const char *s, MaxmemoryPolicy *policy) {
+  static const struct {
+    const char *name;
+    MaxmemoryPolicy policy;
+  } policies[] = {
+      {"noeviction", MAXMEMORY_NOEVICTION},
+      {"allkeys-lru", MAXMEMORY_ALLKEYS_LRU},
+      {"allkeys-lfu", MAXMEMORY_ALLKEYS_LFU},
+      {"volatile-ttl", MAXMEMORY_VOLATILE_TTL},
+  };
+  for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+    if (strcasecmp(s, policies[i].name) == 0) {
+      *policy = policies[i].policy;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Redis verbosity names onto the syslog severities of logging.h */
+static bool parse_loglevel(const char *s, int *level) {
+  static const struct {
+    const char *name;
+    int level;
+  } levels[] = {
+      {"debug", DEBUG},
+      {"verbose", INFO},
+      {"notice", NOTICE},
+      {"warning", WARNING},
+  };
+  for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+    if (strcasecmp(s, levels[i].name) == 0) {
+      *level = levels[i].level;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * usage: redis-c-server [port] [--io-threads N] [--shards N]
+ *                       [--maxmemory <bytes>[kb|mb|gb]]
+ *                       [--maxmemory-policy noeviction|allkeys-lru|
+ *                                           allkeys-lfu|volatile-ttl]
+ *                       [--dbfilename <path>]
+ *                       [--save "<seconds> <changes> ..."]
+ *                       [--appendonly yes|no] [--appendfilename <path>]
+ *                       [--appendfsync always|everysec|no]
+ *                       [--lazyfree-lazy-eviction yes|no]
+ *                       [--lazyfree-lazy-expire yes|no]
+ *                       [--lazyfree-lazy-server-del yes|no]
+ *                       [--loglevel debug|verbose|notice|warning]
+ *                       [--latency-monitor-threshold <ms>]
+ *                       [--slowlog-log-slower-than <us>]
+ *                       [--slowlog-max-len <entries>]
+ *                       [--cluster-enabled yes|no]
+ *                       [--cluster-config-file <path>]
+ *                       [--cluster-node-timeout <ms>]
+ *                       [--replicaof <host> <port>]
+ *                       [--repl-backlog-size <bytes>[kb|mb|gb]]
+ *                       [--repl-timeout <seconds>]
+ *
+ * The first --save replaces the default rules; --save "" disables them.
+ * --loglevel cannot enable messages compiled out by LOG_LEVEL.
+ * --slowlog-log-slower-than -1 disables the slow log, 0 logs every command.
+ * A cluster node listens for the other nodes on port + 10000.
+ * A replica loads the snapshot of its primary into --dbfilename.
+ */
+bool setup_config(int argc, char *argv[]) {
+  RedisCConfig *cfg = create_config(REDIS_C_DEFAULT_PORT);
+  bool default_save = true;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--io-threads") == 0 && i + 1 < argc) {
+      cfg->io_threads = atoi(argv[++i]);
+      if (cfg->io_threads < 1 || cfg->io_threads > IO_THREADS_MAX) {
+        printf("io-threads must be between 1 and %d\n", IO_THREADS_MAX);
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+      cfg->shards = atoi(argv[++i]);
+      if (cfg->shards < 1 || cfg->shards > SHARD_MAX) {
+        printf("shards must be between 1 and %d\n", SHARD_MAX);
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--maxmemory") == 0 && i + 1 < argc) {
+      if (!parse_memory(argv[++i], &cfg->maxmemory)) {
+        printf("Invalid maxmemory '%s'\n", argv[i]);
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--maxmemory-policy") == 0 && i + 1 < argc) {
+      if (!parse_maxmemory_policy(argv[++i], &cfg->maxmemory_policy)) {
+        printf("Unknown maxmemory-policy '%s'\n", argv[i]);
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--dbfilename") == 0 && i + 1 < argc) {
+      cfg->dbfilename = argv[++i];
+    } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+      if (default_save) {
+        cfg->save_params_len = 0;
+        default_save = false;
+      }
+      if (!parse_save_params(argv[++i], cfg)) {
+        printf("Invalid save rule '%s'\n", argv[i]);
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--appendonly") == 0 && i + 1 < argc) {
+      if (!parse_yes_no(argv[++i], &cfg->appendonly)) {
+        printf("appendonly must be yes or no\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--appendfilename") == 0 && i + 1 < argc) {
+      cfg->appendfilename = argv[++i];
+    } else if (strcmp(argv[i], "--appendfsync") == 0 && i + 1 < argc) {
+      if (!parse_appendfsync(argv[++i], &cfg->appendfsync)) {
+        printf("appendfsync must be always, everysec or no\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--lazyfree-lazy-eviction") == 0 &&
+               i + 1 < argc) {
+      if (!parse_yes_no(argv[++i], &cfg->lazyfree_lazy_eviction)) {
+        printf("lazyfree-lazy-eviction must be yes or no\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--lazyfree-lazy-expire") == 0 && i + 1 < argc) {
+      if (!parse_yes_no(argv[++i], &cfg->lazyfree_lazy_expire)) {
+        printf("lazyfree-lazy-expire must be yes or no\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--lazyfree-lazy-server-del") == 0 &&
+               i + 1 < argc) {
+      if (!parse_yes_no(argv[++i], &cfg->lazyfree_lazy_server_del)) {
+        printf("lazyfree-lazy-server-del must be yes or no\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--loglevel") == 0 && i + 1 < argc) {
+      if (!parse_loglevel(argv[++i], &cfg->loglevel)) {
+        printf("loglevel must be debug, verbose, notice or warning\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--latency-monitor-threshold") == 0 &&
+               i + 1 < argc) {
+      cfg->latency_monitor_threshold = atoll(argv[++i]);
+      if (cfg->latency_monitor_threshold < 0) {
+        printf("latency-monitor-threshold must be a number of ms\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--slowlog-log-slower-than") == 0 &&
+               i + 1 < argc) {
+      cfg->slowlog_log_slower_than = atoll(argv[++i]);
+    } else if (strcmp(argv[i], "--slowlog-max-len") == 0 && i + 1 < argc) {
+      cfg->slowlog_max_len = atoll(argv[++i]);
+      if (cfg->slowlog_max_len < 0) {
+        printf("slowlog-max-len must be a number of entries\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--cluster-enabled") == 0 && i + 1 < argc) {
+      if (!parse_yes_no(argv[++i], &cfg->cluster_enabled)) {
+        printf("cluster-enabled must be yes or no\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--cluster-config-file") == 0 &&
+               i + 1 < argc) {
+      cfg->cluster_config_file = argv[++i];
+    } else if (strcmp(argv[i], "--cluster-node-timeout") == 0 &&
+               i + 1 < argc) {
+      cfg->cluster_node_timeout = atoll(argv[++i]);
+      if (cfg->cluster_node_timeout <= 0) {
+        printf("cluster-node-timeout must be a number of ms\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--replicaof") == 0 && i + 2 < argc) {
+      cfg->replicaof_host = argv[++i];
+      cfg->replicaof_port = atoi(argv[++i]);
+      if (cfg->replicaof_port < 1 || cfg->replicaof_port > 65535) {
+        printf("replicaof needs a host and a port\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--repl-backlog-size") == 0 && i + 1 < argc) {
+      if (!parse_memory(argv[++i], &cfg->repl_backlog_size) ||
+          cfg->repl_backlog_size == 0) {
+        printf("Invalid repl-backlog-size value\n");
+        free(cfg);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--repl-timeout") == 0 && i + 1 < argc) {
+      cfg->repl_timeout = atoll(argv[++i]);
+      if (cfg->repl_timeout <= 0) {
+        printf("repl-timeout must be a number of seconds\n");
+        free(cfg);
+        return false;
+      }
+    } else {
+      cfg->port = atoi(argv[i]);
+    }
+  }
+  if (cfg->shards > 1 && cfg->io_threads > 1) {
+    printf("--shards and --io-threads cannot be combined\n");
+    free(cfg);
+    return false;
+  }
+  if (cfg->shards > 1 && cfg->appendonly) {
+    printf("--appendonly is not supported with --shards\n");
+    free(cfg);
+    return false;
+  }
+  /* the cluster state lives on the main loop */
+  if (cfg->shards > 1 && cfg->cluster_enabled) {
+    printf("--cluster-enabled is not supported with --shards\n");
+    free(cfg);
+    return false;
+  }
+  /* replication streams the main loop's keyspace */
+  if (cfg->shards > 1 && cfg->replicaof_host) {
+    printf("--replicaof is not supported with --shards\n");
+    free(cfg);
+    return false;
+  }
+  if (cfg->cluster_enabled && cfg->replicaof_host) {
+    printf("--replicaof is not supported with --cluster-enabled\n");
+    free(cfg);
+    return false;
+  }
+  if (cfg->cluster_enabled && cfg->port + CLUSTER_PORT_INCR > 65535) {
+    printf("The cluster bus port (port + %d) must be below 65536\n",
+           CLUSTER_PORT_INCR);
+    free(cfg);
+    return false;
+  }
+  set_config(cfg);
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  if (!setup_config(argc, argv)) {
     return 0;
   }
+  int port = get_current_config()->port;
+  log_set_verbosity(get_current_config()->loglevel);
+  monotonic_init();
+  stats_init();
+  latency_set_threshold_ms(get_current_config()->latency_monitor_threshold);
+  slowlog_init(get_current_config()->slowlog_log_slower_than,
+               (size_t)get_current_config()->slowlog_max_len);
+  command_table_init();
+  /* a replica or a replay of the AOF must not expire keys on its own */
+  storage_set_expired_hook(propagate_del);
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, handle_shutdown_signal);
+  signal(SIGTERM, handle_shutdown_signal);
 
-  // Initialize server with callback function
-  if (!server_init(server, process_request)) {
+  int shards = get_current_config()->shards;
+  if (REDIS_FAILED(shard_init(shards))) {
+    printf("Failed to create shards\n");
+    return 0;
+  }
+  /* shard 0 runs on the main thread and is set up first */
+  g_el = create_shard_loop(0);
+  if (!g_el) {
     printf("Init failed\n");
-    server_destroy(server);
+    shard_shutdown();
+    return 0;
+  }
+  if (REDIS_FAILED(bio_init())) {
+    printf("Unable to start background threads\n");
+    destroy_shard_loop(g_el);
+    shard_shutdown();
+    return 0;
+  }
+  /* before the load: the keys are indexed by slot as they come in */
+  if (REDIS_FAILED(cluster_init(g_el))) {
+    printf("Unable to start the cluster bus\n");
+    bio_shutdown();
+    destroy_shard_loop(g_el);
+    shard_shutdown();
+    return 0;
+  }
+  /* sharded keyspaces are not persisted yet */
+  if (shards == 1 && !load_data()) {
+    cluster_shutdown();
+    bio_shutdown();
+    destroy_shard_loop(g_el);
+    shard_shutdown();
+    return 0;
+  }
+  if (REDIS_FAILED(repl_init(g_el))) {
+    printf("Unable to start replication\n");
+    cluster_shutdown();
+    aof_close();
+    bio_shutdown();
+    destroy_shard_loop(g_el);
+    shard_shutdown();
+    return 0;
+  }
+  if (REDIS_FAILED(io_threads_init(get_current_config()->io_threads))) {
+    printf("Unable to start I/O threads\n");
+    repl_shutdown();
+    cluster_shutdown();
+    aof_close();
+    bio_shutdown();
+    destroy_shard_loop(g_el);
+    shard_shutdown();
     return 0;
   }
 
-  init_storage();
+  pthread_t threads[SHARD_MAX];
+  int started = 1;
+  for (; started < shards; started++) {
+    if (pthread_create(&threads[started], NULL, shard_thread_main,
+                       (void *)(intptr_t)started) != 0) {
+      LOG_ERROR("Unable to start shard %d", started);
+      shard_stop_all();
+      break;
+    }
+  }
+  LOG_INFO("Ready to accept connections on port %d (%d shards, %d I/O "
+           "threads)",
+           port, shards, io_threads_num());
+
+  el_main(g_el);
 
-  server_start(server);
-  server_destroy(server);
+  if (shards > 1) {
+    shard_stop_all();
+  }
+  for (int i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  io_threads_shutdown();
+  repl_shutdown();
+  cluster_shutdown();
+  rdb_bgsave_abort();
+  aof_close();
+  bio_shutdown();
+  destroy_shard_loop(g_el);
+  shard_shutdown();
 
   return 1;
 }
@@ -0,0 +1,242 @@
+#include "shard.h"
+#include "cmd_handler.h"
+#include "logging.h"
+#include "networking.h"
+#include "serialize.h"
+#include "util/hash.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SHARD_MSG_EXEC 0
+#define SHARD_MSG_REPLY 1
+#define SHARD_STACK_KEYS 16
+
+/*
+ * One forwarded request. The arguments are copied right behind the struct so
+ * a message is a single allocation owned by whoever popped it last.
+ */
+typedef struct ShardMsg {
+  struct ShardMsg *next;
+  int type;
+  int origin;
+  int fd;
+  uint64_t conn_id;
+  char client[NET_ADDR_LEN]; /* for SLOWLOG */
+  int argc;
+  char **argv;
+  size_t *argv_len;
+  ReplyBuffer reply;
+} ShardMsg;
+
+typedef struct {
+  /* Treiber stack of messages; the owner takes it all with one exchange */
+  _Atomic(ShardMsg *) inbox;
+  /* a wake-up byte is in flight, further pushes need not write another */
+  atomic_bool notified;
+  int pipe[2];
+  EventLoop *el;
+} Shard;
+
+static Shard g_shards[SHARD_MAX];
+static int g_num = 1;
+static atomic_bool g_stopping = false;
+static _Thread_local int g_self = 0;
+
+/* private functions */
+static void __push(int target, ShardMsg *msg);
+static ShardMsg *__take_all(Shard *s);
+static void __inbox_handler(EventLoop *el, int fd, void *data, int mask);
+static void __free_msg(ShardMsg *msg);
+
+REDIS_RC shard_init(int num) {
+  if (num < 1 || num > SHARD_MAX) {
+    return REDIS_INVALID_ARGUMENT;
+  }
+  g_num = num;
+  for (int i = 0; i < num; i++) {
+    Shard *s = &g_shards[i];
+    atomic_init(&s->inbox, NULL);
+    atomic_init(&s->notified, false);
+    if (pipe(s->pipe) == -1) {
+      LOG_ERROR("Unable to create the inbox of shard %d", i);
+      g_num = i;
+      shard_shutdown();
+      return REDIS_OUT_OF_MEMORY;
+    }
+    fcntl(s->pipe[0], F_SETFL, fcntl(s->pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(s->pipe[1], F_SETFL, fcntl(s->pipe[1], F_GETFL) | O_NONBLOCK);
+  }
+  return REDIS_OK;
+}
+
+void shard_shutdown(void) {
+  for (int i = 0; i < g_num; i++) {
+    Shard *s = &g_shards[i];
+    ShardMsg *msg = __take_all(s);
+    while (msg) {
+      ShardMsg *next = msg->next;
+      __free_msg(msg);
+      msg = next;
+    }
+    close(s->pipe[0]);
+    close(s->pipe[1]);
+    s->el = NULL;
+  }
+  g_num = 1;
+}
+
+int shard_count(void) { return g_num; }
+
+int shard_self(void) { return g_self; }
+
+REDIS_RC shard_attach(EventLoop *el, int id) {
+  g_self = id;
+  g_shards[id].el = el;
+  if (el_add_file_event(el, g_shards[id].pipe[0], EL_READABLE,
+                        __inbox_handler, &g_shards[id]) == EL_ERR) {
+    return REDIS_CMD_CONNECTION_FAILED;
+  }
+  return REDIS_OK;
+}
+
+int shard_route(int argc, char **argv, size_t *argv_len) {
+  if (g_num == 1) {
+    return 0;
+  }
+  int stack_keys[SHARD_STACK_KEYS];
+  int *keys = argc <= SHARD_STACK_KEYS ? stack_keys : malloc(argc * sizeof(int));
+  if (!keys) {
+    return g_self;
+  }
+
+  int owner = g_self;
+  int n = command_get_keys(argc, argv, argv_len, keys);
+  for (int i = 0; i < n; i++) {
+    int shard = (int)(hash_key_slot(argv[keys[i]], argv_len[keys[i]]) %
+                      (unsigned int)g_num);
+    if (i == 0) {
+      owner = shard;
+    } else if (shard != owner) {
+      owner = -1;
+      break;
+    }
+  }
+  if (keys != stack_keys) {
+    free(keys);
+  }
+  return owner;
+}
+
+REDIS_RC shard_forward(int target, int fd, uint64_t conn_id,
+                       const char *client, int proto, int argc, char **argv,
+                       size_t *argv_len) {
+  size_t size = sizeof(ShardMsg) + argc * (sizeof(char *) + sizeof(size_t));
+  for (int i = 0; i < argc; i++) {
+    size += argv_len[i] + 1;
+  }
+  ShardMsg *msg = malloc(size);
+  if (!msg) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  msg->type = SHARD_MSG_EXEC;
+  msg->origin = g_self;
+  msg->fd = fd;
+  msg->conn_id = conn_id;
+  snprintf(msg->client, sizeof(msg->client), "%s", client);
+  msg->argc = argc;
+  msg->argv = (char **)(msg + 1);
+  msg->argv_len = (size_t *)(msg->argv + argc);
+  char *p = (char *)(msg->argv_len + argc);
+  for (int i = 0; i < argc; i++) {
+    memcpy(p, argv[i], argv_len[i]);
+    p[argv_len[i]] = '\0';
+    msg->argv[i] = p;
+    msg->argv_len[i] = argv_len[i];
+    p += argv_len[i] + 1;
+  }
+  reply_init(&msg->reply, proto);
+
+  __push(target, msg);
+  return REDIS_OK;
+}
+
+void shard_stop_all(void) {
+  atomic_store(&g_stopping, true);
+  for (int i = 0; i < g_num; i++) {
+    if (write(g_shards[i].pipe[1], "s", 1) == -1) {
+      /* the pipe is full, the loop is awake anyway */
+    }
+  }
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static void __push(int target, ShardMsg *msg) {
+  Shard *s = &g_shards[target];
+  ShardMsg *head = atomic_load_explicit(&s->inbox, memory_order_relaxed);
+  do {
+    msg->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &s->inbox, &head, msg, memory_order_release, memory_order_relaxed));
+
+  if (!atomic_exchange(&s->notified, true)) {
+    if (write(s->pipe[1], "m", 1) == -1) {
+      /* the pipe is full, a wake-up is pending anyway */
+    }
+  }
+}
+
+/* Pop every queued message, oldest first. */
+static ShardMsg *__take_all(Shard *s) {
+  ShardMsg *msg = atomic_exchange_explicit(&s->inbox, NULL,
+                                           memory_order_acquire);
+  ShardMsg *ordered = NULL;
+  while (msg) {
+    ShardMsg *next = msg->next;
+    msg->next = ordered;
+    ordered = msg;
+    msg = next;
+  }
+  return ordered;
+}
+
+static void __inbox_handler(EventLoop *el, int fd, void *data, int mask) {
+  (void)mask;
+  Shard *s = data;
+  char buf[256];
+  while (read(fd, buf, sizeof(buf)) > 0) {
+  }
+  /* clear before draining so a concurrent push writes a new wake-up */
+  atomic_store(&s->notified, false);
+  if (atomic_load(&g_stopping)) {
+    el_stop(el);
+  }
+
+  ShardMsg *msg = __take_all(s);
+  while (msg) {
+    ShardMsg *next = msg->next;
+    if (msg->type == SHARD_MSG_EXEC) {
+      /* the messages drained together are timed as one batch */
+      dispatch_batch_begin(msg->client);
+      dispatch_command(msg->argc, msg->argv, msg->argv_len, &msg->reply);
+      msg->type = SHARD_MSG_REPLY;
+      __push(msg->origin, msg);
+    } else {
+      net_forward_done(msg->fd, msg->conn_id, &msg->reply);
+      __free_msg(msg);
+    }
+    msg = next;
+  }
+  dispatch_batch_end();
+}
+
+static void __free_msg(ShardMsg *msg) {
+  reply_free(&msg->reply);
+  free(msg);
+}
@@ -0,0 +1,45 @@
+#ifndef REDIS_C_SHARD_H__
+#define REDIS_C_SHARD_H__
+
+#include "event_loop.h"
+#include "redis-C/rc.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Shared-nothing sharded mode. Every shard is a thread with its own event
+ * loop, listening socket (SO_REUSEPORT lets the kernel spread the accepts)
+ * and keyspace partition; a key lives on shard hash_key_slot(key) %
+ * shard_count().
+ *
+ * A request whose keys live on another shard is copied into a message, pushed
+ * onto the owner's lock-free inbox and executed there; the reply travels back
+ * the same way and is handed to net_forward_done(). The connection does not
+ * run further commands meanwhile, so pipelined replies stay in order.
+ */
+
+#define SHARD_MAX 256
+
+REDIS_RC shard_init(int num);
+/* Free the inboxes; every shard thread must have stopped. */
+void shard_shutdown(void);
+int shard_count(void);
+/* Shard owning the calling thread (0 when not sharded). */
+int shard_self(void);
+/* Bind the calling thread to shard `id` and drain its inbox from `el`. */
+REDIS_RC shard_attach(EventLoop *el, int id);
+
+/* Shard owning the request's keys, or -1 if they span several shards. */
+int shard_route(int argc, char **argv, size_t *argv_len);
+/*
+ * Run a request on shard `target` on behalf of connection (fd, conn_id),
+ * whose peer is `client` ("ip:port").
+ */
+REDIS_RC shard_forward(int target, int fd, uint64_t conn_id,
+                       const char *client, int proto, int argc, char **argv,
+                       size_t *argv_len);
+
+/* Ask every shard's loop to stop; async-signal-safe. */
+void shard_stop_all(void);
+
+#endif
@@ -0,0 +1,165 @@
+#include "slowlog.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* The arguments are copied right behind the struct: one allocation each */
+typedef struct {
+  long long id;
+  long long time; /* unix time, seconds */
+  long long duration; /* us */
+  int argc;
+  char **argv;
+  size_t *argv_len;
+  char client[SLOWLOG_CLIENT_LEN];
+} SlowlogEntry;
+
+long long g_slowlog_log_slower_than = -1;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static SlowlogEntry **g_ring = NULL;
+static size_t g_cap = 0;
+static size_t g_next = 0; /* slot of the next entry */
+static size_t g_len = 0;
+static long long g_next_id = 0;
+
+/* private functions */
+static SlowlogEntry *__create_entry(int argc, char **argv, size_t *argv_len,
+                                    uint64_t us, const char *client);
+static size_t __stored_arg(int argc, char **argv, size_t *argv_len, int i,
+                           char *buf, size_t buf_len, const char **data);
+
+void slowlog_init(long long slower_than_us, size_t max_len) {
+  pthread_mutex_lock(&g_lock);
+  g_slowlog_log_slower_than = slower_than_us;
+  for (size_t i = 0; i < g_len; i++) {
+    free(g_ring[(g_next + g_cap - 1 - i) % g_cap]);
+  }
+  free(g_ring);
+  g_ring = max_len ? calloc(max_len, sizeof(SlowlogEntry *)) : NULL;
+  g_cap = g_ring ? max_len : 0;
+  g_next = g_len = 0;
+  pthread_mutex_unlock(&g_lock);
+}
+
+void slowlog_push(int argc, char **argv, size_t *argv_len, uint64_t us,
+                  const char *client) {
+  if (g_cap == 0) {
+    return;
+  }
+  /* copied outside the lock: the other shards only wait for the insertion */
+  SlowlogEntry *e = __create_entry(argc, argv, argv_len, us, client);
+  if (!e) {
+    return; /* the log is best effort */
+  }
+  pthread_mutex_lock(&g_lock);
+  e->id = g_next_id++;
+  if (g_len == g_cap) {
+    free(g_ring[g_next]);
+  } else {
+    g_len++;
+  }
+  g_ring[g_next] = e;
+  g_next = (g_next + 1) % g_cap;
+  pthread_mutex_unlock(&g_lock);
+}
+
+size_t slowlog_len(void) {
+  pthread_mutex_lock(&g_lock);
+  size_t len = g_len;
+  pthread_mutex_unlock(&g_lock);
+  return len;
+}
+
+void slowlog_reset(void) {
+  pthread_mutex_lock(&g_lock);
+  for (size_t i = 0; i < g_len; i++) {
+    size_t slot = (g_next + g_cap - 1 - i) % g_cap;
+    free(g_ring[slot]);
+    g_ring[slot] = NULL;
+  }
+  g_next = g_len = 0;
+  pthread_mutex_unlock(&g_lock);
+}
+
+void slowlog_reply_entries(ReplyBuffer *reply, long count) {
+  pthread_mutex_lock(&g_lock);
+  size_t n = count < 0 || (size_t)count > g_len ? g_len : (size_t)count;
+  reply_add_array_len(reply, (long)n);
+  for (size_t i = 0; i < n; i++) {
+    const SlowlogEntry *e = g_ring[(g_next + g_cap - 1 - i) % g_cap];
+    reply_add_array_len(reply, 6);
+    reply_add_integer(reply, e->id);
+    reply_add_integer(reply, e->time);
+    reply_add_integer(reply, e->duration);
+    reply_add_array_len(reply, e->argc);
+    for (int j = 0; j < e->argc; j++) {
+      reply_add_bulk(reply, e->argv[j], e->argv_len[j]);
+    }
+    reply_add_bulk_cstr(reply, e->client);
+    reply_add_bulk_cstr(reply, ""); /* client name: clients have none */
+  }
+  pthread_mutex_unlock(&g_lock);
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static SlowlogEntry *__create_entry(int argc, char **argv, size_t *argv_len,
+                                    uint64_t us, const char *client) {
+  int kept = argc > SLOWLOG_ENTRY_MAX_ARGC ? SLOWLOG_ENTRY_MAX_ARGC : argc;
+  char buf[SLOWLOG_ENTRY_MAX_STRING + 64];
+  const char *data;
+
+  size_t size = sizeof(SlowlogEntry) + kept * (sizeof(char *) + sizeof(size_t));
+  for (int i = 0; i < kept; i++) {
+    size += __stored_arg(argc, argv, argv_len, i, buf, sizeof(buf), &data) + 1;
+  }
+  SlowlogEntry *e = malloc(size);
+  if (!e) {
+    return NULL;
+  }
+  e->time = (long long)time(NULL);
+  e->duration = (long long)us;
+  e->argc = kept;
+  e->argv = (char **)(e + 1);
+  e->argv_len = (size_t *)(e->argv + kept);
+  char *p = (char *)(e->argv_len + kept);
+  for (int i = 0; i < kept; i++) {
+    size_t len = __stored_arg(argc, argv, argv_len, i, buf, sizeof(buf), &data);
+    memcpy(p, data, len);
+    p[len] = '\0';
+    e->argv[i] = p;
+    e->argv_len[i] = len;
+    p += len + 1;
+  }
+  snprintf(e->client, sizeof(e->client), "%s", client ? client : "");
+  return e;
+}
+
+/*
+ * What the log keeps of argument `i`: the argument itself, its first bytes
+ * followed by how many were left out, or in the last slot of a long command
+ * how many arguments were left out. Points `data` to it (`buf` when it had
+ * to be formatted) and returns its length.
+ */
+static size_t __stored_arg(int argc, char **argv, size_t *argv_len, int i,
+                           char *buf, size_t buf_len, const char **data) {
+  if (argc > SLOWLOG_ENTRY_MAX_ARGC && i == SLOWLOG_ENTRY_MAX_ARGC - 1) {
+    *data = buf;
+    return (size_t)snprintf(buf, buf_len, "... (%d more arguments)",
+                            argc - SLOWLOG_ENTRY_MAX_ARGC + 1);
+  }
+  if (argv_len[i] <= SLOWLOG_ENTRY_MAX_STRING) {
+    *data = argv[i];
+    return argv_len[i];
+  }
+  memcpy(buf, argv[i], SLOWLOG_ENTRY_MAX_STRING);
+  int n = snprintf(buf + SLOWLOG_ENTRY_MAX_STRING,
+                   buf_len - SLOWLOG_ENTRY_MAX_STRING, "... (%zu more bytes)",
+                   argv_len[i] - SLOWLOG_ENTRY_MAX_STRING);
+  *data = buf;
+  return SLOWLOG_ENTRY_MAX_STRING + (size_t)n;
+}
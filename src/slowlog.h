@@ -0,0 +1,50 @@
+#ifndef REDIS_C_SLOWLOG_H__
+#define REDIS_C_SLOWLOG_H__
+
+#include "serialize.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The slow log: the last --slowlog-max-len commands that ran for at least
+ * --slowlog-log-slower-than microseconds, with their arguments and the
+ * address of the client that sent them. Like the latency monitor, only the
+ * comparison against the threshold is on the hot path; logging a command
+ * copies its (truncated) arguments under a lock shared by the shards.
+ */
+
+/* Arguments past this many are summarized by the last one logged */
+#define SLOWLOG_ENTRY_MAX_ARGC 32
+/* Longer arguments keep this many bytes */
+#define SLOWLOG_ENTRY_MAX_STRING 128
+/* "ip:port", IPv6 included */
+#define SLOWLOG_CLIENT_LEN 64
+
+/* Commands at least this slow are logged; negative disables the log. */
+extern long long g_slowlog_log_slower_than;
+
+/* Set the threshold (us) and the number of entries kept; before the shards
+ * start. */
+void slowlog_init(long long slower_than_us, size_t max_len);
+
+static inline bool slowlog_wanted(uint64_t us) {
+  return g_slowlog_log_slower_than >= 0 &&
+         us >= (uint64_t)g_slowlog_log_slower_than;
+}
+
+/*
+ * Log a command that ran for `us` on behalf of `client` ("ip:port", NULL
+ * when the server runs it itself), pushing out the oldest entry when full.
+ */
+void slowlog_push(int argc, char **argv, size_t *argv_len, uint64_t us,
+                  const char *client);
+size_t slowlog_len(void);
+void slowlog_reset(void);
+/*
+ * Append the newest `count` entries (all of them when negative) to `reply`,
+ * newest first, each as [id, unix time, us, [args], client, client name].
+ */
+void slowlog_reply_entries(ReplyBuffer *reply, long count);
+
+#endif
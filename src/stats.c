@@ -0,0 +1,140 @@
+#include "stats.h"
+#include "shard.h"
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct {
+  _Atomic uint64_t calls;
+  _Atomic uint64_t nsec;
+  _Atomic uint64_t rejected_calls;
+  _Atomic uint64_t failed_calls;
+  _Atomic(Histogram *) latency;
+} CommandSlot;
+
+typedef struct {
+  alignas(64) CommandSlot commands[STATS_MAX_COMMANDS];
+  _Atomic uint64_t keys;
+  _Atomic uint64_t expires;
+  _Atomic uint64_t clients;
+  _Atomic uint64_t loop_cycles;
+  _Atomic uint64_t loop_usec;
+  _Atomic uint64_t loop_max_usec;
+  _Atomic uint64_t loop_last_usec;
+} ShardSlot;
+
+/* Written by their shard only; a slot left untouched is never paged in */
+static ShardSlot g_shards[SHARD_MAX];
+static uint64_t g_start_ns = 0;
+
+/* private functions */
+static uint64_t __load(_Atomic uint64_t *v);
+static void __add(_Atomic uint64_t *v, uint64_t n);
+static void __store(_Atomic uint64_t *v, uint64_t n);
+static CommandSlot *__slot(int id);
+
+void stats_init(void) { g_start_ns = stats_now_ns(); }
+
+long long stats_uptime_seconds(void) {
+  return (long long)((stats_now_ns() - g_start_ns) / 1000000000u);
+}
+
+void stats_command_call(int id, uint64_t ns, bool failed) {
+  CommandSlot *s = __slot(id);
+  __add(&s->calls, 1);
+  __add(&s->nsec, ns);
+  if (failed) {
+    __add(&s->failed_calls, 1);
+  }
+  Histogram *h = atomic_load_explicit(&s->latency, memory_order_relaxed);
+  if (!h) {
+    /* statistics are not keyspace memory, and an allocation failure only
+     * leaves the histogram out */
+    h = malloc(sizeof(Histogram));
+    if (!h) {
+      return;
+    }
+    histogram_init(h);
+    atomic_store_explicit(&s->latency, h, memory_order_release);
+  }
+  histogram_record(h, ns);
+}
+
+void stats_command_rejected(int id) { __add(&__slot(id)->rejected_calls, 1); }
+
+void stats_command_totals(int id, CommandTotals *totals) {
+  uint64_t nsec = 0;
+  *totals = (CommandTotals){0};
+  for (int i = 0; i < shard_count(); i++) {
+    CommandSlot *s = &g_shards[i].commands[id];
+    totals->calls += __load(&s->calls);
+    nsec += __load(&s->nsec);
+    totals->rejected_calls += __load(&s->rejected_calls);
+    totals->failed_calls += __load(&s->failed_calls);
+  }
+  totals->usec = nsec / 1000;
+}
+
+bool stats_command_latency(int id, Histogram *h) {
+  bool found = false;
+  for (int i = 0; i < shard_count(); i++) {
+    Histogram *src = atomic_load_explicit(&g_shards[i].commands[id].latency,
+                                          memory_order_acquire);
+    if (src) {
+      histogram_merge(h, src);
+      found = true;
+    }
+  }
+  return found;
+}
+
+void stats_publish_shard(const ShardStats *stats) {
+  ShardSlot *s = &g_shards[shard_self()];
+  __store(&s->keys, stats->keys);
+  __store(&s->expires, stats->expires);
+  __store(&s->clients, stats->clients);
+  __store(&s->loop_cycles, stats->loop_cycles);
+  __store(&s->loop_usec, stats->loop_usec);
+  __store(&s->loop_max_usec, stats->loop_max_usec);
+  __store(&s->loop_last_usec, stats->loop_last_usec);
+}
+
+void stats_shard_totals(ShardStats *stats) {
+  *stats = (ShardStats){0};
+  for (int i = 0; i < shard_count(); i++) {
+    ShardSlot *s = &g_shards[i];
+    stats->keys += __load(&s->keys);
+    stats->expires += __load(&s->expires);
+    stats->clients += __load(&s->clients);
+    stats->loop_cycles += __load(&s->loop_cycles);
+    stats->loop_usec += __load(&s->loop_usec);
+    uint64_t max = __load(&s->loop_max_usec);
+    if (max > stats->loop_max_usec) {
+      stats->loop_max_usec = max;
+    }
+    uint64_t last = __load(&s->loop_last_usec);
+    if (last > stats->loop_last_usec) {
+      stats->loop_last_usec = last;
+    }
+  }
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static uint64_t __load(_Atomic uint64_t *v) {
+  return atomic_load_explicit(v, memory_order_relaxed);
+}
+
+/* only the owning shard writes: a load and a store, no locked instruction */
+static void __add(_Atomic uint64_t *v, uint64_t n) {
+  __store(v, __load(v) + n);
+}
+
+static void __store(_Atomic uint64_t *v, uint64_t n) {
+  atomic_store_explicit(v, n, memory_order_relaxed);
+}
+
+static CommandSlot *__slot(int id) {
+  return &g_shards[shard_self()].commands[id];
+}
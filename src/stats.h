@@ -0,0 +1,68 @@
+#ifndef REDIS_C_STATS_H__
+#define REDIS_C_STATS_H__
+
+#include "util/histogram.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Counters behind INFO. Every shard thread records into its own slot of
+ * each table, with relaxed stores that need no lock and share no cache line
+ * with another writer; INFO, served by whichever shard a client is on, sums
+ * the slots of all shards. Totals may therefore lag a write made by another
+ * shard in the same instant, but are never torn.
+ */
+
+/* Room for the command table; checked where it is defined */
+#define STATS_MAX_COMMANDS 128
+
+typedef struct {
+    uint64_t calls;
+    uint64_t usec;
+    uint64_t rejected_calls; /* refused before running: arity, maxmemory */
+    uint64_t failed_calls;   /* ran and replied with an error */
+} CommandTotals;
+
+/* Gauges each shard publishes from its loop, see stats_publish_shard */
+typedef struct {
+    uint64_t keys;
+    uint64_t expires;
+    uint64_t clients;
+    uint64_t loop_cycles;
+    uint64_t loop_usec;
+    uint64_t loop_max_usec;
+    uint64_t loop_last_usec;
+} ShardStats;
+
+/* Record the start time; once, before the shards start. */
+void stats_init(void);
+long long stats_uptime_seconds(void);
+
+/* Nanoseconds on the monotonic clock; about 20ns through the vDSO. */
+static inline uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Account a call of command `id` that ran for `ns` nanoseconds. Its latency
+ * histogram is allocated on the shard's first call.
+ */
+void stats_command_call(int id, uint64_t ns, bool failed);
+void stats_command_rejected(int id);
+/* Sum of every shard's counters for command `id`. */
+void stats_command_totals(int id, CommandTotals *totals);
+/*
+ * Merge every shard's latency histogram (ns) for command `id` into `h`,
+ * which must be initialized; false when the command never ran.
+ */
+bool stats_command_latency(int id, Histogram *h);
+
+/* Replace the calling shard's gauges. */
+void stats_publish_shard(const ShardStats *stats);
+/* Sum of the gauges of every shard; the loop maximum is the largest. */
+void stats_shard_totals(ShardStats *stats);
+
+#endif
@@ -1,63 +1,721 @@
 #include "storage.h"
 #include "data_structure/count_min_sketch.h"
+#include "lazyfree.h"
 #include "redis-C/rc.h"
-#include "util/linked_list.h"
-#include <_stdio.h>
-#include <_string.h>
+#include "replication.h"
+#include "util/dict.h"
+#include "util/hash.h"
+#include "util/mem.h"
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* per thread: in sharded mode every shard owns a slice of the keyspace */
+static _Thread_local bool g_initialized = false;
+static _Thread_local Dict *g_keyspace = NULL;
+/* key -> expiry time; only keys with a TTL have an entry */
+static _Thread_local Dict *g_expires = NULL;
+/* where the active expiry sweep of g_expires resumes */
+static _Thread_local size_t g_expire_cursor = 0;
+/* a dataset is being loaded: nothing expires */
+static _Thread_local bool g_loading = false;
+/* cluster mode only: the keys of each hash slot, a dict each (NULL while
+ * the slot has none), see storage_enable_slot_index */
+static _Thread_local Dict **g_slot_keys = NULL;
 
 typedef struct {
-  char *name;
-  void *container;
-} storage_node_t;
+  uint64_t score; /* higher is evicted first */
+  char *key;      /* NULL: empty slot */
+  size_t len;
+} EvictCandidate;
+
+/* eviction candidates in ascending score order, the best last */
+static _Thread_local EvictCandidate g_evict_pool[STORAGE_EVICT_POOL_SIZE];
+static bool g_seeded = false;
+/* set once at startup: expired keys are propagated through it */
+static StorageExpiredProc g_expired_hook = NULL;
 
-static bool g_initialized = false;
-static LinkedList *g_cms_storage = NULL;
+static void __free_object(void *val) { object_free((RedisObject *)val); }
+static bool __keyspace_delete(const char *key, size_t len, bool lazy);
+static bool __slot_index_add(const char *key, size_t len);
+static void __slot_index_delete(const char *key, size_t len);
+static void __slot_index_clear(bool async);
+static bool __is_expired(const char *key, size_t len);
+static bool __expire_if_needed(const char *key, size_t len);
+static long long __time_us(void);
+static uint64_t __evict_score(MaxmemoryPolicy policy, DictEntry *e);
+static void __evict_pool_insert(uint64_t score, const char *key, size_t len);
+static void __evict_pool_populate(MaxmemoryPolicy policy, Dict *from);
+static void __evict_pool_clear(void);
+static REDIS_RC __store_cms(const char *sketch_name, size_t len,
+                            CountMinSketch *cms);
 
 REDIS_RC init_storage(void) {
   if (g_initialized) {
     printf("g_storage is already exists\n");
     return REDIS_OK;
   }
-  
-  g_cms_storage = (LinkedList*)malloc(sizeof(LinkedList));
 
+  /*
+   * per-process seed so bucket placement can't be predicted by clients; set
+   * by the first caller (the main thread, before any shard starts)
+   */
+  if (!g_seeded) {
+    dict_set_hash_seed(((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid() ^
+                       (uint64_t)(uintptr_t)&g_keyspace);
+    g_seeded = true;
+  }
+  g_keyspace = dict_create(__free_object);
+  g_expires = dict_create(NULL);
+  if (!g_keyspace || !g_expires) {
+    release_storage();
+    return REDIS_OUT_OF_MEMORY;
+  }
+  g_initialized = true;
+
+  return REDIS_OK;
+}
+
+void release_storage(void) {
+  __evict_pool_clear();
+  if (g_slot_keys) {
+    for (int i = 0; i < HASH_KEY_SLOTS; i++) {
+      dict_destroy(g_slot_keys[i]);
+    }
+    free(g_slot_keys);
+    g_slot_keys = NULL;
+  }
+  dict_destroy(g_keyspace);
+  dict_destroy(g_expires);
+  g_keyspace = NULL;
+  g_expires = NULL;
+  g_initialized = false;
+}
+
+RedisObject *storage_lookup(const char *key, size_t len) {
+  DictEntry *e = dict_find(g_keyspace, key, len);
+  if (!e || __expire_if_needed(key, len)) {
+    return NULL;
+  }
+  object_touch(e->v.val);
+  return (RedisObject *)e->v.val;
+}
+
+REDIS_RC storage_lookup_typed(const char *key, size_t len, ObjectType type,
+                              RedisObject **obj) {
+  RedisObject *o = storage_lookup(key, len);
+  *obj = NULL;
+  if (!o) {
+    return REDIS_OK;
+  }
+  if (o->type != type) {
+    return REDIS_WRONG_TYPE;
+  }
+  *obj = o;
+  return REDIS_OK;
+}
+
+REDIS_RC storage_add(const char *key, size_t len, RedisObject *obj) {
+  /* an expired key no longer counts as present */
+  __expire_if_needed(key, len);
+  DictEntry *existing;
+  DictEntry *e = dict_add_raw(g_keyspace, key, len, &existing);
+  if (!e) {
+    return existing ? REDIS_KEY_EXISTS : REDIS_OUT_OF_MEMORY;
+  }
+  e->v.val = NULL;
+  if (!__slot_index_add(key, len)) {
+    dict_delete(g_keyspace, key, len);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  e->v.val = obj;
   return REDIS_OK;
 }
 
-REDIS_RC save_to_file(const char *path) { return REDIS_OK; }
-REDIS_RC load_from_file(const char *path) { return REDIS_OK; }
+REDIS_RC storage_set(const char *key, size_t len, RedisObject *obj) {
+  DictEntry *existing;
+  DictEntry *e = dict_add_raw(g_keyspace, key, len, &existing);
+  if (e) {
+    e->v.val = NULL;
+    if (!__slot_index_add(key, len)) {
+      dict_delete(g_keyspace, key, len);
+      return REDIS_OUT_OF_MEMORY;
+    }
+    e->v.val = obj;
+    return REDIS_OK;
+  }
+  if (!existing) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  RedisObject *old = existing->v.val;
+  existing->v.val = obj;
+  if (old != obj) {
+    const RedisCConfig *cfg = get_current_config();
+    if (cfg && cfg->lazyfree_lazy_server_del) {
+      lazyfree_free_object(old);
+    } else {
+      object_free(old);
+    }
+  }
+  storage_persist(key, len);
+  return REDIS_OK;
+}
+
+bool storage_delete(const char *key, size_t len) {
+  if (__expire_if_needed(key, len) || !__keyspace_delete(key, len, false)) {
+    return false;
+  }
+  storage_persist(key, len);
+  return true;
+}
+
+bool storage_unlink(const char *key, size_t len) {
+  if (__expire_if_needed(key, len) || !__keyspace_delete(key, len, true)) {
+    return false;
+  }
+  storage_persist(key, len);
+  return true;
+}
+
+size_t storage_size(void) { return dict_size(g_keyspace); }
+
+void storage_clear(void) {
+  __evict_pool_clear();
+  __slot_index_clear(false);
+  dict_clear(g_keyspace);
+  dict_clear(g_expires);
+}
+
+REDIS_RC storage_flush(bool async) {
+  if (!async) {
+    storage_clear();
+    return REDIS_OK;
+  }
+  /* swap in empty tables so the old ones can be freed off the loop */
+  Dict *keyspace = dict_create(__free_object);
+  Dict *expires = dict_create(NULL);
+  if (!keyspace || !expires) {
+    dict_destroy(keyspace);
+    dict_destroy(expires);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  __evict_pool_clear();
+  __slot_index_clear(true);
+  lazyfree_free_keyspace(g_keyspace, g_expires);
+  g_keyspace = keyspace;
+  g_expires = expires;
+  g_expire_cursor = 0;
+  return REDIS_OK;
+}
+
+REDIS_RC storage_enable_slot_index(void) {
+  if (g_slot_keys) {
+    return REDIS_OK;
+  }
+  g_slot_keys = calloc(HASH_KEY_SLOTS, sizeof(Dict *));
+  if (!g_slot_keys) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  DictIterator it;
+  DictEntry *e;
+  bool ok = true;
+  dict_iter_init(&it, g_keyspace);
+  while (ok && (e = dict_iter_next(&it))) {
+    ok = __slot_index_add(e->key, e->key_len);
+  }
+  dict_iter_release(&it);
+  if (!ok) {
+    __slot_index_clear(false);
+    free(g_slot_keys);
+    g_slot_keys = NULL;
+    return REDIS_OUT_OF_MEMORY;
+  }
+  return REDIS_OK;
+}
+
+size_t storage_slot_size(unsigned int slot) {
+  return g_slot_keys && g_slot_keys[slot] ? dict_size(g_slot_keys[slot]) : 0;
+}
+
+size_t storage_slot_keys(unsigned int slot, const char **keys, size_t *lens,
+                         size_t count) {
+  if (!g_slot_keys || !g_slot_keys[slot]) {
+    return 0;
+  }
+  DictIterator it;
+  DictEntry *e;
+  size_t n = 0;
+  dict_iter_init(&it, g_slot_keys[slot]);
+  while (n < count && (e = dict_iter_next(&it))) {
+    keys[n] = e->key;
+    lens[n] = e->key_len;
+    n++;
+  }
+  dict_iter_release(&it);
+  return n;
+}
+
+void storage_reserve(size_t keys, size_t expires) {
+  dict_expand(g_keyspace, keys);
+  dict_expand(g_expires, expires);
+}
+
+void storage_iter_init(StorageIterator *it) {
+  dict_iter_init(&it->it, g_keyspace);
+}
+
+bool storage_iter_next(StorageIterator *it, const char **key, size_t *len,
+                       RedisObject **obj) {
+  DictEntry *e;
+  /* expired keys are skipped, not deleted: the caller may be mid-scan */
+  do {
+    e = dict_iter_next(&it->it);
+    if (!e) {
+      return false;
+    }
+  } while (__is_expired(e->key, e->key_len));
+  *key = e->key;
+  *len = e->key_len;
+  *obj = (RedisObject *)e->v.val;
+  return true;
+}
+
+void storage_iter_release(StorageIterator *it) { dict_iter_release(&it->it); }
+
+void storage_cron(void) {
+  if (!g_keyspace) {
+    return;
+  }
+  dict_shrink_if_needed(g_keyspace);
+  dict_shrink_if_needed(g_expires);
+  /* spend at most ~1ms per tick so an idle server finishes the migration */
+  dict_rehash_ms(g_keyspace, 1);
+  dict_rehash_ms(g_expires, 1);
+}
+
+long long storage_mstime(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+REDIS_RC storage_set_expire(const char *key, size_t len, long long when_ms) {
+  if (!storage_lookup(key, len)) {
+    return REDIS_KEY_NOT_FOUND;
+  }
+  DictEntry *existing;
+  DictEntry *e = dict_add_raw(g_expires, key, len, &existing);
+  if (!e && !existing) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  (e ? e : existing)->v.s64 = when_ms;
+  return REDIS_OK;
+}
+
+long long storage_get_expire(const char *key, size_t len) {
+  DictEntry *e = dict_find(g_expires, key, len);
+  return e ? e->v.s64 : -1;
+}
+
+bool storage_persist(const char *key, size_t len) {
+  return dict_size(g_expires) > 0 && dict_delete(g_expires, key, len);
+}
+
+size_t storage_expires_size(void) { return dict_size(g_expires); }
+
+size_t storage_active_expire(long long budget_us) {
+  /* a replica leaves expiry to its primary */
+  if (g_loading || repl_is_replica() || !g_expires ||
+      dict_size(g_expires) == 0) {
+    return 0;
+  }
+  long long start = __time_us();
+  const RedisCConfig *cfg = get_current_config();
+  bool lazy = cfg && cfg->lazyfree_lazy_expire;
+  size_t deleted = 0;
+  DictEntry *sample[STORAGE_EXPIRE_SAMPLE];
+  for (;;) {
+    long long now = storage_mstime();
+    size_t n =
+        dict_sample(g_expires, sample, STORAGE_EXPIRE_SAMPLE, &g_expire_cursor);
+    size_t expired = 0;
+    for (size_t i = 0; i < n; i++) {
+      DictEntry *e = sample[i];
+      if (e->v.s64 > now) {
+        continue;
+      }
+      /* the key bytes belong to the expiry entry, so it goes last */
+      __keyspace_delete(e->key, e->key_len, lazy);
+      if (g_expired_hook) {
+        g_expired_hook(e->key, e->key_len);
+      }
+      dict_delete(g_expires, e->key, e->key_len);
+      expired++;
+    }
+    deleted += expired;
+    /* stop once most of the sample was live: few expired keys remain */
+    if (expired * 100 <= n * STORAGE_EXPIRE_REPEAT_PERCENT ||
+        __time_us() - start >= budget_us) {
+      break;
+    }
+  }
+  return deleted;
+}
+
+void storage_set_loading(bool loading) { g_loading = loading; }
+
+bool storage_loading(void) { return g_loading; }
+
+void storage_set_expired_hook(StorageExpiredProc proc) {
+  g_expired_hook = proc;
+}
+
+REDIS_RC create_cms_store(const char *sketch_name, size_t len, uint32_t width,
+                          uint32_t depth, const CmsOptions *opts) {
+  if (storage_lookup(sketch_name, len)) {
+    return REDIS_CMS_SKETCH_EXISTED;
+  }
+  CountMinSketch *cms = mem_malloc(sizeof(CountMinSketch));
+  if (!cms) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  if (cms_init_by_dim_ex(cms, width, depth, opts) != CMS_SUCCESS) {
+    mem_free(cms);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  return __store_cms(sketch_name, len, cms);
+}
 
-REDIS_RC create_cms_store(const char* sketch_name) {
-  Node* prev = NULL;
-  Node *head = g_cms_storage->head;
-  while (head) {
-    storage_node_t *node_val = (storage_node_t *)(head->data);
-    if (strcmp(sketch_name, node_val->name) == 0 /* TODO: error here*/) {
-      return REDIS_CMS_SKETCH_EXISTED;
+REDIS_RC create_cms_store_by_prob(const char *sketch_name, size_t len,
+                                  double error_rate, double probability,
+                                  const CmsOptions *opts) {
+  if (storage_lookup(sketch_name, len)) {
+    return REDIS_CMS_SKETCH_EXISTED;
+  }
+  CountMinSketch *cms = mem_malloc(sizeof(CountMinSketch));
+  if (!cms) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  if (cms_init_by_prob_ex(cms, error_rate, 1 - probability, opts) !=
+      CMS_SUCCESS) {
+    mem_free(cms);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  return __store_cms(sketch_name, len, cms);
+}
+
+bool storage_evict_one(MaxmemoryPolicy policy, char **evicted,
+                       size_t *evicted_len) {
+  if (policy == MAXMEMORY_NOEVICTION) {
+    return false;
+  }
+  Dict *from = policy == MAXMEMORY_VOLATILE_TTL ? g_expires : g_keyspace;
+  const RedisCConfig *cfg = get_current_config();
+  bool lazy = cfg && cfg->lazyfree_lazy_eviction;
+  /* every pass drops stale candidates, so this ends once `from` is empty */
+  while (dict_size(from) > 0) {
+    __evict_pool_populate(policy, from);
+    for (int i = STORAGE_EVICT_POOL_SIZE - 1; i >= 0; i--) {
+      EvictCandidate *c = &g_evict_pool[i];
+      if (!c->key) {
+        continue;
+      }
+      /* candidates are copies: the key may be gone by now */
+      bool found = dict_find(from, c->key, c->len) != NULL;
+      if (found) {
+        __keyspace_delete(c->key, c->len, lazy);
+        storage_persist(c->key, c->len);
+      }
+      if (found && evicted) {
+        *evicted = c->key;
+        *evicted_len = c->len;
+      } else {
+        free(c->key);
+      }
+      c->key = NULL;
+      if (found) {
+        return true;
+      }
     }
-    prev = head;
-    head = head->next;
   }
-  CountMinSketch *cms = malloc(sizeof(CountMinSketch));
-  cms_init_by_dim(cms, 100, 5);
+  return false;
+}
 
-  storage_node_t *new_sketch = (storage_node_t *)malloc(sizeof(storage_node_t));
-  new_sketch->name = malloc(strlen(sketch_name));
-  strcpy(new_sketch->name, sketch_name);
-  new_sketch->container = cms;
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+/*
+ * Remove `key` from the keyspace (not its TTL). With `lazy` a large value is
+ * handed to the lazy-free thread instead of being freed here.
+ */
+static bool __keyspace_delete(const char *key, size_t len, bool lazy) {
+  DictEntry *e = dict_unlink(g_keyspace, key, len);
+  if (!e) {
+    return false;
+  }
+  /* `key` may be the bytes of the entry itself */
+  __slot_index_delete(e->key, e->key_len);
+  if (lazy) {
+    RedisObject *o = e->v.val;
+    e->v.val = NULL;
+    lazyfree_free_object(o);
+  }
+  dict_free_unlinked(g_keyspace, e);
+  return true;
+}
+
+static bool __slot_index_add(const char *key, size_t len) {
+  if (!g_slot_keys) {
+    return true;
+  }
+  unsigned int slot = hash_key_slot(key, len);
+  if (!g_slot_keys[slot] && !(g_slot_keys[slot] = dict_create(NULL))) {
+    return false;
+  }
+  return dict_add(g_slot_keys[slot], key, len, NULL);
+}
 
-  if (prev) {
-    prev->next = (Node *)malloc(sizeof(Node));
-    prev->next->data = new_sketch;
-    prev->next->next = NULL;
+static void __slot_index_delete(const char *key, size_t len) {
+  if (!g_slot_keys) {
+    return;
+  }
+  Dict *d = g_slot_keys[hash_key_slot(key, len)];
+  if (d) {
+    dict_delete(d, key, len);
+  }
+}
+
+/* Empty every slot; with `async` large ones are freed off the loop */
+static void __slot_index_clear(bool async) {
+  if (!g_slot_keys) {
+    return;
+  }
+  for (int i = 0; i < HASH_KEY_SLOTS; i++) {
+    if (!g_slot_keys[i]) {
+      continue;
+    }
+    if (async) {
+      lazyfree_free_keyspace(g_slot_keys[i], NULL);
+      g_slot_keys[i] = NULL;
+    } else {
+      dict_clear(g_slot_keys[i]);
+    }
+  }
+}
+
+/* How good an eviction victim the sampled entry is: higher goes first */
+static uint64_t __evict_score(MaxmemoryPolicy policy, DictEntry *e) {
+  switch (policy) {
+  case MAXMEMORY_ALLKEYS_LRU:
+    return object_idle_time(e->v.val);
+  case MAXMEMORY_ALLKEYS_LFU:
+    return UINT8_MAX - object_lfu(e->v.val);
+  default:
+    /* volatile-ttl samples the expires dict: the soonest expiry first */
+    return UINT64_MAX - (uint64_t)e->v.s64;
+  }
+}
+
+static void __evict_pool_insert(uint64_t score, const char *key, size_t len) {
+  EvictCandidate *pool = g_evict_pool;
+  int n = STORAGE_EVICT_POOL_SIZE;
+  int k = 0;
+  while (k < n && pool[k].key && pool[k].score < score) {
+    k++;
+  }
+  /* worse than everything in a full pool */
+  if (k == 0 && pool[n - 1].key) {
+    return;
+  }
+  char *copy = malloc(len + 1);
+  if (!copy) {
+    return;
+  }
+  memcpy(copy, key, len);
+  copy[len] = '\0';
+  if (!pool[n - 1].key) {
+    /* room at the end: shift the better candidates right */
+    memmove(pool + k + 1, pool + k, (size_t)(n - k - 1) * sizeof(*pool));
   } else {
-    g_cms_storage->head = (Node *)malloc(sizeof(Node));
-    g_cms_storage->head->data = new_sketch;
-    g_cms_storage->head->next = NULL;
+    /* full: drop the worst candidate, shift the weaker ones left */
+    k--;
+    free(pool[0].key);
+    memmove(pool, pool + 1, (size_t)k * sizeof(*pool));
   }
+  pool[k] = (EvictCandidate){score, copy, len};
+}
 
+static void __evict_pool_populate(MaxmemoryPolicy policy, Dict *from) {
+  DictEntry *sample[STORAGE_EVICT_SAMPLE];
+  size_t n = dict_sample(from, sample, STORAGE_EVICT_SAMPLE, NULL);
+  for (size_t i = 0; i < n; i++) {
+    __evict_pool_insert(__evict_score(policy, sample[i]), sample[i]->key,
+                        sample[i]->key_len);
+  }
+}
+
+static void __evict_pool_clear(void) {
+  for (int i = 0; i < STORAGE_EVICT_POOL_SIZE; i++) {
+    free(g_evict_pool[i].key);
+    g_evict_pool[i].key = NULL;
+  }
+}
+
+static bool __is_expired(const char *key, size_t len) {
+  if (dict_size(g_expires) == 0) {
+    return false;
+  }
+  DictEntry *e = dict_find(g_expires, key, len);
+  return e && e->v.s64 <= storage_mstime();
+}
+
+/*
+ * Delete the key if its TTL has passed; true when it is gone for the caller.
+ * A replica keeps it for the stream of its primary and hides it from clients.
+ */
+static bool __expire_if_needed(const char *key, size_t len) {
+  if (g_loading || !__is_expired(key, len)) {
+    return false;
+  }
+  if (repl_is_replica()) {
+    return repl_read_only();
+  }
+  const RedisCConfig *cfg = get_current_config();
+  __keyspace_delete(key, len, cfg && cfg->lazyfree_lazy_expire);
+  if (g_expired_hook) {
+    g_expired_hook(key, len);
+  }
+  dict_delete(g_expires, key, len);
+  return true;
+}
+
+static long long __time_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static REDIS_RC __store_cms(const char *sketch_name, size_t len,
+                            CountMinSketch *cms) {
+  RedisObject *obj = object_create(OBJ_CMS, cms);
+  if (!obj) {
+    cms_destroy(cms);
+    mem_free(cms);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  REDIS_RC rc = storage_add(sketch_name, len, obj);
+  if (REDIS_FAILED(rc)) {
+    object_free(obj);
+  }
+  return rc;
+}
+
+REDIS_RC create_zset_store(const char *key, size_t len, SortedSet **zs) {
+  SortedSet *set = zset_create();
+  if (!set) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  RedisObject *obj = object_create(OBJ_ZSET, set);
+  if (!obj) {
+    zset_destroy(set);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  REDIS_RC rc = storage_add(key, len, obj);
+  if (REDIS_FAILED(rc)) {
+    object_free(obj);
+    return rc;
+  }
+  *zs = set;
+  return REDIS_OK;
+}
+
+REDIS_RC create_bloom_store(const char *key, size_t len, double error_rate,
+                            uint64_t capacity, uint32_t expansion,
+                            BloomFilter **bf) {
+  if (storage_lookup(key, len)) {
+    return REDIS_BF_KEY_EXISTS;
+  }
+  BloomFilter *filter = bloom_create(error_rate, capacity, expansion);
+  if (!filter) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  RedisObject *obj = object_create(OBJ_BLOOM, filter);
+  if (!obj) {
+    bloom_destroy(filter);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  REDIS_RC rc = storage_add(key, len, obj);
+  if (REDIS_FAILED(rc)) {
+    object_free(obj);
+    return rc;
+  }
+  *bf = filter;
+  return REDIS_OK;
+}
+
+REDIS_RC create_cuckoo_store(const char *key, size_t len, uint64_t capacity,
+                             uint32_t max_kicks, uint32_t expansion,
+                             CuckooFilter **cf) {
+  if (storage_lookup(key, len)) {
+    return REDIS_CF_KEY_EXISTS;
+  }
+  CuckooFilter *filter = cuckoo_create(capacity, max_kicks, expansion);
+  if (!filter) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  RedisObject *obj = object_create(OBJ_CUCKOO, filter);
+  if (!obj) {
+    cuckoo_destroy(filter);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  REDIS_RC rc = storage_add(key, len, obj);
+  if (REDIS_FAILED(rc)) {
+    object_free(obj);
+    return rc;
+  }
+  *cf = filter;
+  return REDIS_OK;
+}
+
+REDIS_RC create_hll_store(const char *key, size_t len, HyperLogLog **hll) {
+  HyperLogLog *h = hll_create();
+  if (!h) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  RedisObject *obj = object_create(OBJ_HLL, h);
+  if (!obj) {
+    hll_destroy(h);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  REDIS_RC rc = storage_add(key, len, obj);
+  if (REDIS_FAILED(rc)) {
+    object_free(obj);
+    return rc;
+  }
+  *hll = h;
   return REDIS_OK;
 }
+
+REDIS_RC create_topk_store(const char *key, size_t len, uint32_t k,
+                           uint32_t width, uint32_t depth) {
+  if (storage_lookup(key, len)) {
+    return REDIS_TOPK_KEY_EXISTS;
+  }
+  TopK *tk = topk_create(k, width, depth);
+  if (!tk) {
+    return REDIS_OUT_OF_MEMORY;
+  }
+  RedisObject *obj = object_create(OBJ_TOPK, tk);
+  if (!obj) {
+    topk_destroy(tk);
+    return REDIS_OUT_OF_MEMORY;
+  }
+  REDIS_RC rc = storage_add(key, len, obj);
+  if (REDIS_FAILED(rc)) {
+    object_free(obj);
+  }
+  return rc;
+}
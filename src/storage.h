@@ -1,15 +1,173 @@
 #ifndef REDIS_C_STORAGE_H__
 #define REDIS_C_STORAGE_H__
 
+#include "data_structure/bloom_filter.h"
+#include "data_structure/count_min_sketch.h"
+#include "data_structure/cuckoo_filter.h"
+#include "data_structure/hyperloglog.h"
+#include "data_structure/sorted_set.h"
+#include "data_structure/top_k.h"
+#include "object.h"
+#include "redis-C/config.h"
 #include "redis-C/rc.h"
-#include "util/linked_list.h"
+#include "util/dict.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+/*
+ * The keyspace: one dictionary mapping binary-safe keys to type-tagged
+ * RedisObjects. Every command handler resolves its keys through here.
+ *
+ * Keys with a time to live also have an entry in a second dictionary holding
+ * their absolute expiry time (ms since the epoch, in v.s64). An expired key
+ * is removed when it is next looked up, and storage_active_expire reclaims
+ * the ones nobody touches again by sweeping that dictionary a sample at a
+ * time. While a dataset loads nothing expires, see storage_set_loading.
+ *
+ * Only a primary deletes expired keys, and every key it expires is handed to
+ * the expired hook to be propagated as a DEL. A replica waits for that DEL:
+ * meanwhile the key is missing for its clients but still there for the
+ * stream of its primary, which may use it before the DEL arrives.
+ *
+ * Values the server drops on its own (eviction, expiry, overwrite) are freed
+ * inline unless the matching lazyfree_* option is set; see lazyfree.h.
+ */
 
+/* Expiry entries sampled per active expiry round */
+#define STORAGE_EXPIRE_SAMPLE 20
+/* Another round runs while more than this share of a sample had expired */
+#define STORAGE_EXPIRE_REPEAT_PERCENT 25
+
+/*
+ * Eviction approximates the policy's ideal victim: each eviction samples
+ * STORAGE_EVICT_SAMPLE keys into a pool of the STORAGE_EVICT_POOL_SIZE best
+ * candidates seen so far and evicts the best one that still exists.
+ */
+#define STORAGE_EVICT_SAMPLE 5
+#define STORAGE_EVICT_POOL_SIZE 16
+
+typedef struct {
+  DictIterator it;
+} StorageIterator;
+
+/* Create the calling thread's keyspace (each shard thread has its own). */
 REDIS_RC init_storage(void);
-REDIS_RC save_to_file(const char* path);
-REDIS_RC load_from_file(const char* path);
+void release_storage(void);
+
+/*
+ * NULL when the key does not exist, or has expired (it is deleted then).
+ * Counts as an access for LRU/LFU eviction.
+ */
+RedisObject* storage_lookup(const char* key, size_t len);
+/*
+ * Look up a key that must hold `type`. *obj is NULL when the key does not
+ * exist; REDIS_WRONG_TYPE is returned when it holds another type.
+ */
+REDIS_RC storage_lookup_typed(const char* key, size_t len, ObjectType type,
+                              RedisObject** obj);
+/* Add a new key; REDIS_KEY_EXISTS if it is already present. */
+REDIS_RC storage_add(const char* key, size_t len, RedisObject* obj);
+/* Add or overwrite a key, releasing the previous value and its TTL. */
+REDIS_RC storage_set(const char* key, size_t len, RedisObject* obj);
+bool storage_delete(const char* key, size_t len);
+/* storage_delete, but a large value is freed on the lazy-free thread. */
+bool storage_unlink(const char* key, size_t len);
+size_t storage_size(void);
+void storage_clear(void);
+/*
+ * Drop every key. With `async` the old tables are swapped out and, when
+ * large, destroyed on the lazy-free thread, so this returns in O(1).
+ */
+REDIS_RC storage_flush(bool async);
+/*
+ * Cluster mode: also index the keys by hash slot (util/hash.h), so the keys
+ * of a slot can be counted and listed without a scan of the keyspace. Costs
+ * a second copy of every key.
+ */
+REDIS_RC storage_enable_slot_index(void);
+/* Keys in `slot`; 0 when the index is not enabled. */
+size_t storage_slot_size(unsigned int slot);
+/*
+ * Up to `count` keys of `slot`, as views valid until the keyspace is next
+ * modified. Returns the number stored.
+ */
+size_t storage_slot_keys(unsigned int slot, const char** keys, size_t* lens,
+                         size_t count);
+
+/* Presize for a bulk load of `keys` keys, `expires` of them with a TTL. */
+void storage_reserve(size_t keys, size_t expires);
+
+void storage_iter_init(StorageIterator* it);
+bool storage_iter_next(StorageIterator* it, const char** key, size_t* len,
+                       RedisObject** obj);
+void storage_iter_release(StorageIterator* it);
+
+/* Periodic housekeeping from the server cron: incremental rehash/shrink. */
+void storage_cron(void);
+
+/* Wall clock in ms since the epoch, the clock expiry times are kept in. */
+long long storage_mstime(void);
+/* Expire an existing key at `when_ms`; REDIS_KEY_NOT_FOUND if there is none. */
+REDIS_RC storage_set_expire(const char* key, size_t len, long long when_ms);
+/* Expiry time of `key`, or -1 when it has none. */
+long long storage_get_expire(const char* key, size_t len);
+/* Drop the key's TTL; false when it had none. */
+bool storage_persist(const char* key, size_t len);
+size_t storage_expires_size(void);
+/*
+ * Active expiry: delete expired keys, STORAGE_EXPIRE_SAMPLE at a time, until
+ * a sample is mostly live or `budget_us` microseconds have gone by. Returns
+ * the number of keys deleted.
+ */
+size_t storage_active_expire(long long budget_us);
+/*
+ * Set while a dataset is loaded (the snapshot, the AOF): keys past their TTL
+ * stay live, so the commands replayed after a key find it as the server did
+ * when it ran them, and expire once loading is done.
+ */
+void storage_set_loading(bool loading);
+bool storage_loading(void);
+/* Called with every key expiry deletes; NULL (the default) for none. */
+typedef void (*StorageExpiredProc)(const char* key, size_t len);
+void storage_set_expired_hook(StorageExpiredProc proc);
+
+/*
+ * Evict one key chosen by `policy` (allkeys-* from every key, volatile-ttl
+ * from keys with a TTL); false when there is none to evict. With `evicted`
+ * the caller gets the evicted key, malloc'd, to propagate the deletion.
+ */
+bool storage_evict_one(MaxmemoryPolicy policy, char **evicted,
+                       size_t *evicted_len);
+
+/* `opts` may be NULL for the default flat, 32-bit sketch. */
+REDIS_RC create_cms_store(const char* sketch_name, size_t len, uint32_t width,
+                          uint32_t depth, const CmsOptions* opts);
+/* `probability` is the chance of an estimate exceeding `error_rate`. */
+REDIS_RC create_cms_store_by_prob(const char* sketch_name, size_t len,
+                                  double error_rate, double probability,
+                                  const CmsOptions* opts);
+
+/* Create an empty sorted set under `key`; *zs receives it. */
+REDIS_RC create_zset_store(const char* key, size_t len, SortedSet** zs);
+
+/* Create a Bloom filter under `key` (expansion 0: non-scaling); *bf receives
+ * it. REDIS_BF_KEY_EXISTS if the key is taken. */
+REDIS_RC create_bloom_store(const char* key, size_t len, double error_rate,
+                            uint64_t capacity, uint32_t expansion,
+                            BloomFilter** bf);
+
+/* Create a cuckoo filter under `key` (expansion 0: fixed size); *cf receives
+ * it. REDIS_CF_KEY_EXISTS if the key is taken. */
+REDIS_RC create_cuckoo_store(const char* key, size_t len, uint64_t capacity,
+                             uint32_t max_kicks, uint32_t expansion,
+                             CuckooFilter** cf);
+
+/* Create an empty HyperLogLog under `key`; *hll receives it. */
+REDIS_RC create_hll_store(const char* key, size_t len, HyperLogLog** hll);
 
-REDIS_RC create_cms_store(const char* sketch_name);
+/* Create a Top-K tracker under `key`; REDIS_TOPK_KEY_EXISTS if it is taken. */
+REDIS_RC create_topk_store(const char* key, size_t len, uint32_t k,
+                           uint32_t width, uint32_t depth);
 
 #endif
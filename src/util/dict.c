@@ -0,0 +1,479 @@
+#include "dict.h"
+#include "hash.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t g_hash_seed = 0x5bd1e995ULL;
+/* per thread: each shard samples its own keyspace */
+static _Thread_local uint64_t g_sample_state = 0;
+
+/* private functions */
+static bool __expand_if_needed(Dict *d);
+static bool __start_rehash(Dict *d, size_t size);
+static void __rehash_step(Dict *d);
+static void __table_reset(DictTable *t);
+static bool __key_equals(const DictEntry *e, uint64_t hash, const char *key,
+                         size_t len);
+static long long __time_ms(void);
+static uint64_t __sample_random(void);
+static size_t __chain_len(const DictEntry *e);
+static DictEntry *__entry_create(const char *key, size_t len, uint64_t hash);
+static void __entry_free(Dict *d, DictEntry *e);
+
+Dict *dict_create(DictValFree val_free) {
+  Dict *d = mem_calloc(1, sizeof(Dict));
+  if (!d) {
+    return NULL;
+  }
+  d->rehash_idx = -1;
+  d->val_free = val_free;
+  return d;
+}
+
+void dict_destroy(Dict *d) {
+  if (!d) {
+    return;
+  }
+  dict_clear(d);
+  mem_free(d);
+}
+
+void dict_clear(Dict *d) {
+  for (int t = 0; t < 2; t++) {
+    DictTable *ht = &d->ht[t];
+    for (size_t i = 0; i < ht->size && ht->used > 0; i++) {
+      DictEntry *e = ht->table[i];
+      while (e) {
+        DictEntry *next = e->next;
+        __entry_free(d, e);
+        ht->used--;
+        e = next;
+      }
+    }
+    mem_free(ht->table);
+    __table_reset(ht);
+  }
+  d->rehash_idx = -1;
+}
+
+DictEntry *dict_find(Dict *d, const char *key, size_t len) {
+  if (dict_size(d) == 0) {
+    return NULL;
+  }
+  __rehash_step(d);
+  uint64_t hash = dict_hash_key(key, len);
+  for (int t = 0; t < 2; t++) {
+    DictEntry *e = d->ht[t].table[hash & d->ht[t].mask];
+    for (; e; e = e->next) {
+      if (__key_equals(e, hash, key, len)) {
+        return e;
+      }
+    }
+    if (!dict_is_rehashing(d)) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+void *dict_fetch_value(Dict *d, const char *key, size_t len) {
+  DictEntry *e = dict_find(d, key, len);
+  return e ? e->v.val : NULL;
+}
+
+DictEntry *dict_add_raw(Dict *d, const char *key, size_t len,
+                        DictEntry **existing) {
+  __rehash_step(d);
+  if (!__expand_if_needed(d)) {
+    if (existing) {
+      *existing = NULL;
+    }
+    return NULL;
+  }
+  uint64_t hash = dict_hash_key(key, len);
+  for (int t = 0; t < 2; t++) {
+    DictEntry *e = d->ht[t].table[hash & d->ht[t].mask];
+    for (; e; e = e->next) {
+      if (__key_equals(e, hash, key, len)) {
+        if (existing) {
+          *existing = e;
+        }
+        return NULL;
+      }
+    }
+    if (!dict_is_rehashing(d)) {
+      break;
+    }
+  }
+  if (existing) {
+    *existing = NULL;
+  }
+
+  DictEntry *e = __entry_create(key, len, hash);
+  if (!e) {
+    return NULL;
+  }
+  /* new keys go to the new table so ht[0] only ever drains */
+  DictTable *ht = dict_is_rehashing(d) ? &d->ht[1] : &d->ht[0];
+  size_t idx = hash & ht->mask;
+  e->next = ht->table[idx];
+  ht->table[idx] = e;
+  ht->used++;
+  return e;
+}
+
+bool dict_add(Dict *d, const char *key, size_t len, void *val) {
+  DictEntry *e = dict_add_raw(d, key, len, NULL);
+  if (!e) {
+    return false;
+  }
+  e->v.val = val;
+  return true;
+}
+
+bool dict_replace(Dict *d, const char *key, size_t len, void *val) {
+  DictEntry *existing;
+  DictEntry *e = dict_add_raw(d, key, len, &existing);
+  if (e) {
+    e->v.val = val;
+    return true;
+  }
+  if (!existing) {
+    return false; /* out of memory */
+  }
+  /* set the new value before freeing the old one, they may be the same */
+  void *old = existing->v.val;
+  existing->v.val = val;
+  if (d->val_free && old != val) {
+    d->val_free(old);
+  }
+  return false;
+}
+
+bool dict_delete(Dict *d, const char *key, size_t len) {
+  DictEntry *e = dict_unlink(d, key, len);
+  if (!e) {
+    return false;
+  }
+  dict_free_unlinked(d, e);
+  return true;
+}
+
+DictEntry *dict_unlink(Dict *d, const char *key, size_t len) {
+  if (dict_size(d) == 0) {
+    return NULL;
+  }
+  __rehash_step(d);
+  uint64_t hash = dict_hash_key(key, len);
+  for (int t = 0; t < 2; t++) {
+    DictTable *ht = &d->ht[t];
+    DictEntry **link = &ht->table[hash & ht->mask];
+    while (*link) {
+      DictEntry *e = *link;
+      if (__key_equals(e, hash, key, len)) {
+        *link = e->next;
+        e->next = NULL;
+        ht->used--;
+        return e;
+      }
+      link = &e->next;
+    }
+    if (!dict_is_rehashing(d)) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+void dict_free_unlinked(Dict *d, DictEntry *e) {
+  if (e) {
+    __entry_free(d, e);
+  }
+}
+
+size_t dict_size(const Dict *d) { return d->ht[0].used + d->ht[1].used; }
+
+size_t dict_buckets(const Dict *d) { return d->ht[0].size + d->ht[1].size; }
+
+bool dict_is_rehashing(const Dict *d) { return d->rehash_idx != -1; }
+
+bool dict_rehash(Dict *d, int n) {
+  if (!dict_is_rehashing(d)) {
+    return false;
+  }
+  /* bound the empty buckets visited too, a sparse table could stall here */
+  int empty_visits = n * 10;
+  DictTable *from = &d->ht[0];
+  DictTable *to = &d->ht[1];
+  while (n-- > 0 && from->used > 0) {
+    while (from->table[d->rehash_idx] == NULL) {
+      d->rehash_idx++;
+      if (--empty_visits == 0) {
+        return true;
+      }
+    }
+    DictEntry *e = from->table[d->rehash_idx];
+    while (e) {
+      DictEntry *next = e->next;
+      size_t idx = e->hash & to->mask;
+      e->next = to->table[idx];
+      to->table[idx] = e;
+      from->used--;
+      to->used++;
+      e = next;
+    }
+    from->table[d->rehash_idx++] = NULL;
+  }
+
+  if (from->used == 0) {
+    mem_free(from->table);
+    *from = *to;
+    __table_reset(to);
+    d->rehash_idx = -1;
+    return false;
+  }
+  return true;
+}
+
+long dict_rehash_ms(Dict *d, int ms) {
+  if (d->pause_rehash > 0) {
+    return 0;
+  }
+  long long start = __time_ms();
+  long moved = 0;
+  while (dict_rehash(d, 100)) {
+    moved += 100;
+    if (__time_ms() - start > ms) {
+      break;
+    }
+  }
+  return moved;
+}
+
+bool dict_expand(Dict *d, size_t size) {
+  if (dict_is_rehashing(d) || size < d->ht[0].used) {
+    return false;
+  }
+  size_t buckets = DICT_INITIAL_SIZE;
+  while (buckets < size) {
+    buckets *= 2;
+  }
+  if (buckets <= d->ht[0].size) {
+    return true;
+  }
+  if (d->ht[0].used == 0) {
+    mem_free(d->ht[0].table);
+    __table_reset(&d->ht[0]);
+  }
+  return __start_rehash(d, buckets);
+}
+
+bool dict_shrink_if_needed(Dict *d) {
+  if (dict_is_rehashing(d) || d->ht[0].size <= DICT_INITIAL_SIZE) {
+    return false;
+  }
+  /* shrink below 10% fill, to the smallest table that keeps load <= 1 */
+  if (d->ht[0].used * 10 >= d->ht[0].size) {
+    return false;
+  }
+  size_t size = DICT_INITIAL_SIZE;
+  while (size < d->ht[0].used) {
+    size <<= 1;
+  }
+  return __start_rehash(d, size);
+}
+
+size_t dict_sample(Dict *d, DictEntry **out, size_t count, size_t *cursor) {
+  if (count > dict_size(d)) {
+    count = dict_size(d);
+  }
+  if (count == 0) {
+    return 0;
+  }
+  int tables = dict_is_rehashing(d) ? 2 : 1;
+  size_t mask = d->ht[0].mask;
+  if (tables == 2 && d->ht[1].mask > mask) {
+    mask = d->ht[1].mask;
+  }
+  size_t idx = (cursor ? *cursor : __sample_random()) & mask;
+  size_t stored = 0, empty = 0;
+  for (size_t steps = count * 10; stored < count && steps > 0; steps--) {
+    for (int t = 0; t < tables && stored < count; t++) {
+      /* ht[0] below rehash_idx is already migrated; past the end of the
+       * (smaller) ht[1] too, skip ahead to what is left of ht[0] */
+      if (tables == 2 && t == 0 && idx < (size_t)d->rehash_idx) {
+        if (idx >= d->ht[1].size) {
+          idx = (size_t)d->rehash_idx;
+        } else {
+          continue;
+        }
+      }
+      if (idx >= d->ht[t].size) {
+        continue;
+      }
+      DictEntry *e = d->ht[t].table[idx];
+      if (!e) {
+        /* a long empty run: jump elsewhere rather than crawl through it */
+        if (!cursor && ++empty >= 5 && empty > count) {
+          idx = __sample_random() & mask;
+          empty = 0;
+        }
+        continue;
+      }
+      empty = 0;
+      if (cursor && stored > 0 && __chain_len(e) > count - stored) {
+        /* resume at this bucket next time rather than drop part of it */
+        *cursor = idx;
+        return stored;
+      }
+      for (; e && stored < count; e = e->next) {
+        out[stored++] = e;
+      }
+    }
+    idx = (idx + 1) & mask;
+  }
+  if (cursor) {
+    *cursor = idx;
+  }
+  return stored;
+}
+
+void dict_iter_init(DictIterator *it, Dict *d) {
+  it->d = d;
+  it->table = 0;
+  it->bucket = 0;
+  it->next = NULL;
+  d->pause_rehash++;
+}
+
+DictEntry *dict_iter_next(DictIterator *it) {
+  Dict *d = it->d;
+  while (!it->next) {
+    if (it->bucket >= d->ht[it->table].size) {
+      if (it->table == 1 || !dict_is_rehashing(d)) {
+        return NULL;
+      }
+      it->table = 1;
+      it->bucket = 0;
+      continue;
+    }
+    it->next = d->ht[it->table].table[it->bucket++];
+  }
+  DictEntry *e = it->next;
+  it->next = e->next;
+  return e;
+}
+
+void dict_iter_release(DictIterator *it) {
+  if (it->d) {
+    it->d->pause_rehash--;
+    it->d = NULL;
+  }
+}
+
+void dict_set_hash_seed(uint64_t seed) { g_hash_seed = seed; }
+
+uint64_t dict_hash_key(const char *key, size_t len) {
+  return hash_xxh64(key, len, g_hash_seed);
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static bool __expand_if_needed(Dict *d) {
+  if (dict_is_rehashing(d)) {
+    return true;
+  }
+  if (d->ht[0].size == 0) {
+    return __start_rehash(d, DICT_INITIAL_SIZE);
+  }
+  /* keep the load factor at or below 1; a failed grow just means longer
+   * chains, the insert itself can still go ahead */
+  if (d->ht[0].used >= d->ht[0].size) {
+    __start_rehash(d, d->ht[0].size * 2);
+  }
+  return true;
+}
+
+static bool __start_rehash(Dict *d, size_t size) {
+  DictEntry **table = mem_calloc(size, sizeof(DictEntry *));
+  if (!table) {
+    return false;
+  }
+  DictTable ht = {table, size, size - 1, 0};
+  /* the first allocation needs no migration */
+  if (d->ht[0].table == NULL) {
+    d->ht[0] = ht;
+    return true;
+  }
+  d->ht[1] = ht;
+  d->rehash_idx = 0;
+  return true;
+}
+
+static void __rehash_step(Dict *d) {
+  if (d->pause_rehash == 0) {
+    dict_rehash(d, DICT_REHASH_STEP);
+  }
+}
+
+static void __table_reset(DictTable *t) {
+  t->table = NULL;
+  t->size = 0;
+  t->mask = 0;
+  t->used = 0;
+}
+
+static bool __key_equals(const DictEntry *e, uint64_t hash, const char *key,
+                         size_t len) {
+  return e->hash == hash && e->key_len == len && memcmp(e->key, key, len) == 0;
+}
+
+static long long __time_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* xorshift64*, seeded per thread from the hash seed and a stack address */
+static uint64_t __sample_random(void) {
+  if (g_sample_state == 0) {
+    uint64_t local;
+    g_sample_state = (g_hash_seed ^ (uint64_t)(uintptr_t)&local) | 1;
+  }
+  g_sample_state ^= g_sample_state >> 12;
+  g_sample_state ^= g_sample_state << 25;
+  g_sample_state ^= g_sample_state >> 27;
+  return g_sample_state * 0x2545f4914f6cdd1dULL;
+}
+
+static size_t __chain_len(const DictEntry *e) {
+  size_t n = 0;
+  for (; e; e = e->next) {
+    n++;
+  }
+  return n;
+}
+
+static DictEntry *__entry_create(const char *key, size_t len, uint64_t hash) {
+  DictEntry *e = mem_malloc(sizeof(DictEntry) + len + 1);
+  if (!e) {
+    return NULL;
+  }
+  e->next = NULL;
+  e->v.val = NULL;
+  e->hash = hash;
+  e->key_len = (uint32_t)len;
+  memcpy(e->key, key, len);
+  e->key[len] = '\0';
+  return e;
+}
+
+static void __entry_free(Dict *d, DictEntry *e) {
+  if (d->val_free && e->v.val) {
+    d->val_free(e->v.val);
+  }
+  mem_free(e);
+}
@@ -0,0 +1,125 @@
+#ifndef REDIS_C_DICT_H__
+#define REDIS_C_DICT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Chained hash table with power-of-two bucket arrays, keyed by binary-safe
+ * strings. The key bytes are co-allocated with the entry (one malloc per
+ * entry) and kept NUL-terminated so they can be handed to C string APIs.
+ *
+ * Resizing is incremental: a second table is allocated and buckets are moved
+ * over a few at a time on every lookup/insert/delete (and by dict_rehash_ms
+ * from the server cron), so growing a large table never blocks for long.
+ * While rehashing, lookups check both tables and inserts go to the new one.
+ */
+
+#define DICT_INITIAL_SIZE 4
+/* Buckets migrated by each operation while a rehash is in progress. */
+#define DICT_REHASH_STEP 1
+
+typedef void (*DictValFree)(void *val);
+
+typedef struct DictEntry {
+  struct DictEntry *next;
+  union {
+    void *val;
+    int64_t s64;
+    double d;
+  } v;
+  uint64_t hash;
+  uint32_t key_len;
+  char key[]; /* key_len bytes + NUL */
+} DictEntry;
+
+typedef struct {
+  DictEntry **table;
+  size_t size; /* buckets, always a power of two */
+  size_t mask;
+  size_t used;
+} DictTable;
+
+typedef struct {
+  DictTable ht[2]; /* ht[1] is only allocated while rehashing */
+  long rehash_idx; /* next ht[0] bucket to migrate, -1 when not rehashing */
+  int pause_rehash; /* > 0 while iterators are active */
+  DictValFree val_free;
+} Dict;
+
+typedef struct {
+  Dict *d;
+  int table;
+  size_t bucket;
+  DictEntry *next;
+} DictIterator;
+
+Dict *dict_create(DictValFree val_free);
+void dict_destroy(Dict *d);
+void dict_clear(Dict *d);
+
+DictEntry *dict_find(Dict *d, const char *key, size_t len);
+void *dict_fetch_value(Dict *d, const char *key, size_t len);
+/*
+ * Insert `key` without a value and return the new entry, or NULL when the key
+ * already exists (then *existing, if given, is set to the current entry).
+ */
+DictEntry *dict_add_raw(Dict *d, const char *key, size_t len,
+                        DictEntry **existing);
+bool dict_add(Dict *d, const char *key, size_t len, void *val);
+/* Insert or overwrite; returns true when the key was new. */
+bool dict_replace(Dict *d, const char *key, size_t len, void *val);
+bool dict_delete(Dict *d, const char *key, size_t len);
+/* Remove the entry without freeing it; release it with dict_free_unlinked. */
+DictEntry *dict_unlink(Dict *d, const char *key, size_t len);
+void dict_free_unlinked(Dict *d, DictEntry *e);
+
+size_t dict_size(const Dict *d);
+/* Total buckets over both tables. */
+size_t dict_buckets(const Dict *d);
+bool dict_is_rehashing(const Dict *d);
+
+/*
+ * Migrate up to `n` buckets from the old table; returns true while there is
+ * still work left. dict_rehash_ms keeps going for about `ms` milliseconds and
+ * returns the number of buckets moved.
+ */
+bool dict_rehash(Dict *d, int n);
+long dict_rehash_ms(Dict *d, int ms);
+/*
+ * Size the table for `size` entries up front, so a bulk load does not grow it
+ * step by step. An empty table is replaced at once; a populated one is
+ * rehashed into the new size incrementally. False when already rehashing,
+ * `size` is below the current size, or out of memory.
+ */
+bool dict_expand(Dict *d, size_t size);
+/* Start shrinking the table when it is mostly empty; returns true if started. */
+bool dict_shrink_if_needed(Dict *d);
+
+/*
+ * Collect up to `count` entries from a stretch of consecutive buckets into
+ * `out`, visiting at most 10 * count buckets. Cheap, but not uniform: meant
+ * for sampling (expiry, eviction), not for fair selection. Entries are
+ * distinct. Returns the number written, possibly fewer than asked for.
+ *
+ * With a NULL `cursor` the stretch starts at a random bucket. Otherwise it
+ * starts at *cursor (initially 0) and the next bucket is stored back, so
+ * repeated calls sweep the whole table, give or take entries moved by a
+ * resize in between.
+ */
+size_t dict_sample(Dict *d, DictEntry **out, size_t count, size_t *cursor);
+
+/*
+ * Iteration order is unspecified. Rehashing is paused until
+ * dict_iter_release, so deleting the returned entry or inserting keys while
+ * iterating is allowed (inserted keys may or may not be visited).
+ */
+void dict_iter_init(DictIterator *it, Dict *d);
+DictEntry *dict_iter_next(DictIterator *it);
+void dict_iter_release(DictIterator *it);
+
+void dict_set_hash_seed(uint64_t seed);
+uint64_t dict_hash_key(const char *key, size_t len);
+
+#endif
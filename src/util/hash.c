@@ -0,0 +1,292 @@
+#include "hash.h"
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+/* unaligned little-endian loads */
+static inline uint64_t read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static inline uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME64_2;
+  acc = rotl64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+  acc ^= xxh64_round(0, val);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+static inline void xxh64_init_lanes(uint64_t v[4], uint64_t seed) {
+  v[0] = seed + PRIME64_1 + PRIME64_2;
+  v[1] = seed + PRIME64_2;
+  v[2] = seed;
+  v[3] = seed - PRIME64_1;
+}
+
+/* Fold whole 32-byte stripes into the lanes; returns the bytes consumed */
+static inline size_t xxh64_stripes(uint64_t v[4], const uint8_t *p,
+                                   size_t len) {
+  const uint8_t *start = p;
+  const uint8_t *end = p + (len & ~(size_t)31);
+  while (p < end) {
+    v[0] = xxh64_round(v[0], read64(p));
+    v[1] = xxh64_round(v[1], read64(p + 8));
+    v[2] = xxh64_round(v[2], read64(p + 16));
+    v[3] = xxh64_round(v[3], read64(p + 24));
+    p += 32;
+  }
+  return (size_t)(p - start);
+}
+
+static inline uint64_t xxh64_merge_lanes(const uint64_t v[4]) {
+  uint64_t h =
+      rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+  h = xxh64_merge(h, v[0]);
+  h = xxh64_merge(h, v[1]);
+  h = xxh64_merge(h, v[2]);
+  return xxh64_merge(h, v[3]);
+}
+
+/* Mix in the total length and the final (< 32) bytes, then avalanche */
+static uint64_t xxh64_finish(uint64_t h, uint64_t total_len, const uint8_t *p,
+                             const uint8_t *end) {
+  h += total_len;
+
+  while (p + 8 <= end) {
+    h ^= xxh64_round(0, read64(p));
+    h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    p += 8;
+  }
+  if (p + 4 <= end) {
+    h ^= (uint64_t)read32(p) * PRIME64_1;
+    h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= (*p) * PRIME64_5;
+    h = rotl64(h, 11) * PRIME64_1;
+    p++;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t hash_xxh64(const void *data, size_t len, uint64_t seed) {
+  const uint8_t *p = (const uint8_t *)data;
+  uint64_t h;
+
+  if (len >= 32) {
+    uint64_t v[4];
+    xxh64_init_lanes(v, seed);
+    p += xxh64_stripes(v, p, len);
+    h = xxh64_merge_lanes(v);
+  } else {
+    h = seed + PRIME64_5;
+  }
+  return xxh64_finish(h, (uint64_t)len, p, (const uint8_t *)data + len);
+}
+
+void hash_xxh64_init(HashXxh64State *st, uint64_t seed) {
+  xxh64_init_lanes(st->v, seed);
+  st->seed = seed;
+  st->total_len = 0;
+  st->buf_len = 0;
+}
+
+void hash_xxh64_update(HashXxh64State *st, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  st->total_len += len;
+  if (st->buf_len > 0) {
+    size_t take = 32 - st->buf_len;
+    if (take > len) {
+      take = len;
+    }
+    memcpy(st->buf + st->buf_len, p, take);
+    st->buf_len += (uint32_t)take;
+    p += take;
+    len -= take;
+    if (st->buf_len < 32) {
+      return;
+    }
+    xxh64_stripes(st->v, st->buf, 32);
+    st->buf_len = 0;
+  }
+  size_t done = xxh64_stripes(st->v, p, len);
+  memcpy(st->buf, p + done, len - done);
+  st->buf_len = (uint32_t)(len - done);
+}
+
+uint64_t hash_xxh64_digest(const HashXxh64State *st) {
+  uint64_t h = st->total_len >= 32 ? xxh64_merge_lanes(st->v)
+                                   : st->seed + PRIME64_5;
+  return xxh64_finish(h, st->total_len, st->buf, st->buf + st->buf_len);
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+void hash_murmur3_128(const void *data, size_t len, uint64_t seed,
+                      uint64_t out[2]) {
+  const uint8_t *p = (const uint8_t *)data;
+  const size_t nblocks = len / 16;
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+  uint64_t h1 = seed;
+  uint64_t h2 = seed;
+
+  for (size_t i = 0; i < nblocks; i++, p += 16) {
+    uint64_t k1 = read64(p);
+    uint64_t k2 = read64(p + 8);
+
+    k1 *= c1;
+    k1 = rotl64(k1, 31);
+    k1 *= c2;
+    h1 ^= k1;
+    h1 = rotl64(h1, 27);
+    h1 += h2;
+    h1 = h1 * 5 + 0x52dce729;
+
+    k2 *= c2;
+    k2 = rotl64(k2, 33);
+    k2 *= c1;
+    h2 ^= k2;
+    h2 = rotl64(h2, 31);
+    h2 += h1;
+    h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+  switch (len & 15) {
+  case 15: k2 ^= (uint64_t)p[14] << 48; /* fall through */
+  case 14: k2 ^= (uint64_t)p[13] << 40; /* fall through */
+  case 13: k2 ^= (uint64_t)p[12] << 32; /* fall through */
+  case 12: k2 ^= (uint64_t)p[11] << 24; /* fall through */
+  case 11: k2 ^= (uint64_t)p[10] << 16; /* fall through */
+  case 10: k2 ^= (uint64_t)p[9] << 8;   /* fall through */
+  case 9:
+    k2 ^= (uint64_t)p[8];
+    k2 *= c2;
+    k2 = rotl64(k2, 33);
+    k2 *= c1;
+    h2 ^= k2;
+    /* fall through */
+  case 8: k1 ^= (uint64_t)p[7] << 56; /* fall through */
+  case 7: k1 ^= (uint64_t)p[6] << 48; /* fall through */
+  case 6: k1 ^= (uint64_t)p[5] << 40; /* fall through */
+  case 5: k1 ^= (uint64_t)p[4] << 32; /* fall through */
+  case 4: k1 ^= (uint64_t)p[3] << 24; /* fall through */
+  case 3: k1 ^= (uint64_t)p[2] << 16; /* fall through */
+  case 2: k1 ^= (uint64_t)p[1] << 8;  /* fall through */
+  case 1:
+    k1 ^= (uint64_t)p[0];
+    k1 *= c1;
+    k1 = rotl64(k1, 31);
+    k1 *= c2;
+    h1 ^= k1;
+  }
+
+  h1 ^= (uint64_t)len;
+  h2 ^= (uint64_t)len;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix64(h1);
+  h2 = fmix64(h2);
+  h1 += h2;
+  h2 += h1;
+  out[0] = h1;
+  out[1] = h2;
+}
+
+static const uint16_t g_crc16_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+};
+
+uint16_t hash_crc16(const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  uint16_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    crc = (uint16_t)(crc << 8) ^ g_crc16_table[((crc >> 8) ^ p[i]) & 0xff];
+  }
+  return crc;
+}
+
+unsigned int hash_key_slot(const char *key, size_t len) {
+  const char *open = memchr(key, '{', len);
+  if (open) {
+    size_t start = (size_t)(open - key) + 1;
+    const char *close = memchr(key + start, '}', len - start);
+    if (close && close != key + start) {
+      return hash_crc16(key + start, (size_t)(close - key) - start) &
+             (HASH_KEY_SLOTS - 1);
+    }
+  }
+  return hash_crc16(key, len) & (HASH_KEY_SLOTS - 1);
+}
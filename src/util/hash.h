@@ -0,0 +1,42 @@
+#ifndef REDIS_C_HASH_H__
+#define REDIS_C_HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* xxHash64: fast non-cryptographic hash used by the keyspace dictionary. */
+uint64_t hash_xxh64(const void *data, size_t len, uint64_t seed);
+
+/*
+ * Streaming xxHash64, for data that is not in memory all at once: the digest
+ * equals hash_xxh64() over the concatenation of every update.
+ */
+typedef struct {
+  uint64_t v[4];
+  uint64_t seed;
+  uint64_t total_len;
+  uint8_t buf[32]; /* bytes of a partial stripe */
+  uint32_t buf_len;
+} HashXxh64State;
+
+void hash_xxh64_init(HashXxh64State *st, uint64_t seed);
+void hash_xxh64_update(HashXxh64State *st, const void *data, size_t len);
+uint64_t hash_xxh64_digest(const HashXxh64State *st);
+/*
+ * MurmurHash3 x64_128: one pass yields two independent 64-bit halves, enough
+ * to derive any number of probe positions by double hashing.
+ */
+void hash_murmur3_128(const void *data, size_t len, uint64_t seed,
+                      uint64_t out[2]);
+
+/*
+ * Keys map to one of HASH_KEY_SLOTS slots by CRC16 (XMODEM), like Redis
+ * Cluster. If the key contains a non-empty `{tag}` only the tag is hashed, so
+ * related keys can be forced onto the same slot.
+ */
+#define HASH_KEY_SLOTS 16384
+
+uint16_t hash_crc16(const void *data, size_t len);
+unsigned int hash_key_slot(const char *key, size_t len);
+
+#endif
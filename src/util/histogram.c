@@ -0,0 +1,116 @@
+#include "histogram.h"
+#include <math.h>
+#include <string.h>
+
+#define HISTOGRAM_SUB_COUNT (1u << HISTOGRAM_SUB_BITS)
+
+/* single writer: plain loads and stores, never a read-modify-write */
+#define LOAD(field) atomic_load_explicit(&(field), memory_order_relaxed)
+#define STORE(field, value)                                                    \
+  atomic_store_explicit(&(field), (value), memory_order_relaxed)
+
+/* private functions */
+static unsigned __bucket_of(uint64_t value);
+static uint64_t __bucket_high(unsigned bucket);
+
+void histogram_init(Histogram *h) {
+  memset(h, 0, sizeof(*h));
+  STORE(h->min, UINT64_MAX);
+}
+
+void histogram_record(Histogram *h, uint64_t value) {
+  histogram_record_n(h, value, 1);
+}
+
+void histogram_record_n(Histogram *h, uint64_t value, uint64_t n) {
+  if (n == 0) {
+    return;
+  }
+  unsigned b = __bucket_of(value);
+  STORE(h->buckets[b], LOAD(h->buckets[b]) + n);
+  STORE(h->count, LOAD(h->count) + n);
+  STORE(h->sum, LOAD(h->sum) + value * n);
+  if (value < LOAD(h->min)) {
+    STORE(h->min, value);
+  }
+  if (value > LOAD(h->max)) {
+    STORE(h->max, value);
+  }
+}
+
+void histogram_merge(Histogram *dst, const Histogram *src) {
+  if (LOAD(src->count) == 0) {
+    return;
+  }
+  /* the count is the buckets' sum even when `src` is recorded into meanwhile */
+  uint64_t count = 0;
+  for (unsigned i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    uint64_t n = LOAD(src->buckets[i]);
+    if (n) {
+      STORE(dst->buckets[i], LOAD(dst->buckets[i]) + n);
+      count += n;
+    }
+  }
+  STORE(dst->count, LOAD(dst->count) + count);
+  STORE(dst->sum, LOAD(dst->sum) + LOAD(src->sum));
+  uint64_t min = LOAD(src->min), max = LOAD(src->max);
+  if (min < LOAD(dst->min)) {
+    STORE(dst->min, min);
+  }
+  if (max > LOAD(dst->max)) {
+    STORE(dst->max, max);
+  }
+}
+
+uint64_t histogram_percentile(const Histogram *h, double p) {
+  uint64_t count = LOAD(h->count);
+  if (count == 0) {
+    return 0;
+  }
+  if (p <= 0) {
+    return LOAD(h->min);
+  }
+  uint64_t rank = (uint64_t)ceil(p / 100.0 * (double)count);
+  if (rank < 1) {
+    rank = 1;
+  } else if (rank > count) {
+    rank = count;
+  }
+  uint64_t max = LOAD(h->max);
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += LOAD(h->buckets[i]);
+    if (seen >= rank) {
+      uint64_t high = __bucket_high(i);
+      return high < max ? high : max;
+    }
+  }
+  return max;
+}
+
+double histogram_mean(const Histogram *h) {
+  uint64_t count = LOAD(h->count);
+  return count ? (double)LOAD(h->sum) / (double)count : 0;
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static unsigned __bucket_of(uint64_t value) {
+  if (value < 2 * HISTOGRAM_SUB_COUNT) {
+    return (unsigned)value;
+  }
+  /* the top HISTOGRAM_SUB_BITS + 1 bits pick the bucket */
+  unsigned shift = 63 - (unsigned)__builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+  return (shift << HISTOGRAM_SUB_BITS) + (unsigned)(value >> shift);
+}
+
+static uint64_t __bucket_high(unsigned bucket) {
+  if (bucket < 2 * HISTOGRAM_SUB_COUNT) {
+    return bucket;
+  }
+  unsigned shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+  uint64_t sub = (bucket & (HISTOGRAM_SUB_COUNT - 1)) + HISTOGRAM_SUB_COUNT;
+  /* the top bucket ends at UINT64_MAX */
+  return ((sub + 1) << shift) - 1;
+}
@@ -0,0 +1,43 @@
+#ifndef REDIS_C_HISTOGRAM_H__
+#define REDIS_C_HISTOGRAM_H__
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Log-linear latency histogram in the style of HdrHistogram: values below
+ * 2 * 2^HISTOGRAM_SUB_BITS get a bucket each, and every power of two above
+ * is split into 2^HISTOGRAM_SUB_BITS equal buckets. Any uint64_t value is
+ * recorded in O(1) and percentiles are within 1 / 2^HISTOGRAM_SUB_BITS
+ * (about 3%) of the true value. The unit is the caller's.
+ *
+ * A histogram has one writer, but other threads may read it (percentiles,
+ * merging it into their own) while it is being recorded into: the fields
+ * are relaxed atomics the writer loads and stores without a locked
+ * instruction, so a reader sees a slightly stale state, never a torn one.
+ */
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+typedef struct {
+  _Atomic uint64_t count;
+  _Atomic uint64_t min;
+  _Atomic uint64_t max;
+  _Atomic uint64_t sum;
+  _Atomic uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+void histogram_init(Histogram *h);
+void histogram_record(Histogram *h, uint64_t value);
+/* Record `n` occurrences of `value`; only from the histogram's writer. */
+void histogram_record_n(Histogram *h, uint64_t value, uint64_t n);
+/* Add every value recorded in `src` to `dst`, which the caller writes. */
+void histogram_merge(Histogram *dst, const Histogram *src);
+/*
+ * The value `p` percent of the recorded values are at or below (0 <= p <=
+ * 100), as the highest value of its bucket; 0 when nothing was recorded.
+ */
+uint64_t histogram_percentile(const Histogram *h, double p);
+double histogram_mean(const Histogram *h);
+
+#endif
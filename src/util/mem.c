@@ -0,0 +1,66 @@
+#include "mem.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define MEM_BLOCK_SIZE(p) malloc_size(p)
+#elif defined(__linux__) || defined(__FreeBSD__)
+#include <malloc.h>
+#define MEM_BLOCK_SIZE(p) malloc_usable_size(p)
+#else
+#define MEM_BLOCK_SIZE(p) ((void)(p), (size_t)0)
+#endif
+
+static _Atomic size_t g_used_memory = 0;
+
+/* private functions */
+static __inline__ void *__count_alloc(void *ptr);
+
+void *mem_malloc(size_t size) { return __count_alloc(malloc(size)); }
+
+void *mem_calloc(size_t n, size_t size) {
+  return __count_alloc(calloc(n, size));
+}
+
+void *mem_realloc(void *ptr, size_t size) {
+  size_t old = ptr ? MEM_BLOCK_SIZE(ptr) : 0;
+  void *grown = realloc(ptr, size);
+  if (!grown) {
+    /* the old block is untouched (or size was 0 and it is gone) */
+    if (size == 0) {
+      atomic_fetch_sub_explicit(&g_used_memory, old, memory_order_relaxed);
+    }
+    return NULL;
+  }
+  atomic_fetch_sub_explicit(&g_used_memory, old, memory_order_relaxed);
+  return __count_alloc(grown);
+}
+
+void *mem_aligned_alloc(size_t alignment, size_t size) {
+  return __count_alloc(aligned_alloc(alignment, size));
+}
+
+void mem_free(void *ptr) {
+  if (!ptr) {
+    return;
+  }
+  atomic_fetch_sub_explicit(&g_used_memory, MEM_BLOCK_SIZE(ptr),
+                            memory_order_relaxed);
+  free(ptr);
+}
+
+size_t mem_used(void) {
+  return atomic_load_explicit(&g_used_memory, memory_order_relaxed);
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static __inline__ void *__count_alloc(void *ptr) {
+  if (ptr) {
+    atomic_fetch_add_explicit(&g_used_memory, MEM_BLOCK_SIZE(ptr),
+                              memory_order_relaxed);
+  }
+  return ptr;
+}
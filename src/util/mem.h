@@ -0,0 +1,24 @@
+#ifndef REDIS_C_MEM_H__
+#define REDIS_C_MEM_H__
+
+#include <stddef.h>
+
+/*
+ * Counting allocator for everything the keyspace owns: keys, values and the
+ * structures behind them. mem_used() is what `maxmemory` is enforced against.
+ * Blocks are counted at their usable size, so the total tracks what malloc
+ * really hands out, and must be released with mem_free (never free()).
+ *
+ * The counter is shared by every shard thread and updated with relaxed
+ * atomics. Where the allocator cannot report block sizes mem_used() stays 0.
+ */
+void* mem_malloc(size_t size);
+void* mem_calloc(size_t n, size_t size);
+void* mem_realloc(void* ptr, size_t size);
+void* mem_aligned_alloc(size_t alignment, size_t size);
+void mem_free(void* ptr);
+
+/* Bytes currently allocated through mem_*, over all threads. */
+size_t mem_used(void);
+
+#endif
@@ -0,0 +1,87 @@
+#include "monotonic.h"
+#include <stdio.h>
+#include <string.h>
+
+#define CALIBRATION_NS 5000000u /* 5ms: the TSC rate to within ~0.01% */
+
+MonotonicSource g_monotonic_source = MONOTONIC_POSIX;
+uint64_t g_monotonic_ns_mult = 1ull << 32;
+
+static char g_info[64] = "POSIX clock_gettime";
+
+/* private functions */
+#if defined(__x86_64__)
+static bool __invariant_tsc(void);
+static uint64_t __posix_ns(void);
+#endif
+
+void monotonic_init(void) {
+#if defined(__x86_64__)
+  if (!__invariant_tsc()) {
+    return;
+  }
+  /* bracket the interval with the TSC inside the CLOCK_MONOTONIC reads */
+  uint64_t ns_start = __posix_ns();
+  uint64_t tsc_start = __rdtsc();
+  uint64_t ns_end;
+  do {
+    ns_end = __posix_ns();
+  } while (ns_end - ns_start < CALIBRATION_NS);
+  uint64_t tsc_end = __rdtsc();
+  uint64_t ticks = tsc_end - tsc_start;
+  if (ticks == 0) {
+    return;
+  }
+  g_monotonic_ns_mult = ((ns_end - ns_start) << 32) / ticks;
+  g_monotonic_source = MONOTONIC_X86_TSC;
+  snprintf(g_info, sizeof(g_info), "X86 TSC @ %llu ticks/us",
+           (unsigned long long)(ticks * 1000 / (ns_end - ns_start)));
+#elif defined(__aarch64__)
+  uint64_t hz;
+  __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(hz));
+  if (hz == 0) {
+    return;
+  }
+  g_monotonic_ns_mult = (1000000000ull << 32) / hz;
+  g_monotonic_source = MONOTONIC_ARM_CNTVCT;
+  snprintf(g_info, sizeof(g_info), "ARM CNTVCT @ %llu ticks/us",
+           (unsigned long long)(hz / 1000000));
+#endif
+}
+
+const char *monotonic_info(void) { return g_info; }
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+#if defined(__x86_64__)
+/*
+ * A TSC that ticks at a constant rate whatever the frequency and power
+ * state, which the kernel also keeps in sync across cores.
+ */
+static bool __invariant_tsc(void) {
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  if (!f) {
+    return false;
+  }
+  char line[8192];
+  bool constant = false, nonstop = false;
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, "flags", 5) != 0) {
+      continue;
+    }
+    /* the flags of the first CPU stand for all of them */
+    constant = strstr(line, " constant_tsc") != NULL;
+    nonstop = strstr(line, " nonstop_tsc") != NULL;
+    break;
+  }
+  fclose(f);
+  return constant && nonstop;
+}
+
+static uint64_t __posix_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
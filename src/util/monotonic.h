@@ -0,0 +1,65 @@
+#ifndef REDIS_C_MONOTONIC_H__
+#define REDIS_C_MONOTONIC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * A monotonic clock cheap enough to read around every command. On x86-64
+ * with an invariant TSC (constant_tsc and nonstop_tsc in /proc/cpuinfo) it
+ * is a bare rdtsc, on AArch64 the virtual counter cntvct_el0; both are a
+ * few cycles and never enter the kernel. Elsewhere it falls back to
+ * CLOCK_MONOTONIC, which the vDSO serves without a system call as well.
+ *
+ * Readings are in ticks of whichever source is in use: only differences are
+ * meaningful, converted with monotonic_ticks_to_ns(). rdtsc does not wait
+ * for earlier instructions to retire, which only matters below the
+ * microsecond.
+ */
+
+typedef enum {
+  MONOTONIC_POSIX = 0, /* clock_gettime(CLOCK_MONOTONIC), ticks are ns */
+  MONOTONIC_X86_TSC,
+  MONOTONIC_ARM_CNTVCT
+} MonotonicSource;
+
+/* Set by monotonic_init(); readers only ever see it after the threads start */
+extern MonotonicSource g_monotonic_source;
+/* ns per tick as 32.32 fixed point */
+extern uint64_t g_monotonic_ns_mult;
+
+/*
+ * Pick the clock source; calibrating the TSC against CLOCK_MONOTONIC spins
+ * for a few milliseconds. Call once, before any thread reads the clock;
+ * until then readings come from CLOCK_MONOTONIC.
+ */
+void monotonic_init(void);
+/* Human readable source and resolution, for INFO. */
+const char *monotonic_info(void);
+
+static inline uint64_t monotonic_now(void) {
+#if defined(__x86_64__)
+  if (g_monotonic_source == MONOTONIC_X86_TSC) {
+    return __rdtsc();
+  }
+#elif defined(__aarch64__)
+  if (g_monotonic_source == MONOTONIC_ARM_CNTVCT) {
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+  }
+#endif
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t monotonic_ticks_to_ns(uint64_t ticks) {
+  return (uint64_t)(((unsigned __int128)ticks * g_monotonic_ns_mult) >> 32);
+}
+
+#endif
@@ -0,0 +1,26 @@
+#include "simd.h"
+#include <pthread.h>
+
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static SimdLevel g_level = SIMD_SCALAR;
+
+/* private functions */
+static void __detect(void);
+
+SimdLevel simd_level(void) {
+  pthread_once(&g_once, __detect);
+  return g_level;
+}
+
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ *******************************************************************************/
+static void __detect(void) {
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+  if (__builtin_cpu_supports("avx2")) {
+    g_level = SIMD_AVX2;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  g_level = SIMD_NEON;
+#endif
+}
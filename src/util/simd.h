@@ -0,0 +1,20 @@
+#ifndef REDIS_C_SIMD_H__
+#define REDIS_C_SIMD_H__
+
+/*
+ * The vector extension the data structure kernels (CMS, Bloom, HyperLogLog)
+ * dispatch on. Each of them keeps its kernels in function pointers written
+ * by a pthread_once routine when its first instance is created, so shard
+ * threads creating their first sketches at the same time neither race nor
+ * see a half-made choice; the routine asks simd_level() what to pick.
+ */
+typedef enum {
+  SIMD_SCALAR = 0,
+  SIMD_NEON, /* AArch64, always there */
+  SIMD_AVX2  /* x86, when cpuid reports it */
+} SimdLevel;
+
+/* The widest level this CPU supports that the kernels are built for. */
+SimdLevel simd_level(void);
+
+#endif
@@ -0,0 +1,131 @@
+#include "str_util.h"
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Long enough for any 64-bit integer or a %.17g double. */
+#define STR_UTIL_MAX_NUM_LEN 64
+
+bool string_to_ll(const char *s, size_t len, long long *value) {
+  unsigned long long v = 0;
+  bool negative = false;
+  size_t i = 0;
+  if (len == 0 || len >= STR_UTIL_MAX_NUM_LEN) {
+    return false;
+  }
+  if (s[0] == '-') {
+    negative = true;
+    i = 1;
+    if (len == 1) {
+      return false;
+    }
+  }
+  /* no leading zeros so every value has exactly one spelling */
+  if (s[i] == '0' && len > i + 1) {
+    return false;
+  }
+  for (; i < len; i++) {
+    if (s[i] < '0' || s[i] > '9') {
+      return false;
+    }
+    unsigned digit = (unsigned)(s[i] - '0');
+    if (v > (ULLONG_MAX - digit) / 10) {
+      return false;
+    }
+    v = v * 10 + digit;
+  }
+  if (negative) {
+    if (v > (unsigned long long)LLONG_MAX + 1) {
+      return false;
+    }
+    *value = (long long)(0 - v);
+  } else {
+    if (v > LLONG_MAX) {
+      return false;
+    }
+    *value = (long long)v;
+  }
+  return true;
+}
+
+bool string_to_ull(const char *s, size_t len, unsigned long long *value) {
+  unsigned long long v = 0;
+  if (len == 0 || len >= STR_UTIL_MAX_NUM_LEN) {
+    return false;
+  }
+  if (s[0] == '0' && len > 1) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] < '0' || s[i] > '9') {
+      return false;
+    }
+    unsigned digit = (unsigned)(s[i] - '0');
+    if (v > (ULLONG_MAX - digit) / 10) {
+      return false;
+    }
+    v = v * 10 + digit;
+  }
+  *value = v;
+  return true;
+}
+
+bool string_to_double(const char *s, size_t len, double *value) {
+  char buf[STR_UTIL_MAX_NUM_LEN];
+  if (len == 0 || len >= sizeof(buf)) {
+    return false;
+  }
+  /* strtod would skip leading spaces */
+  if (s[0] == ' ' || s[0] == '\t' || s[0] == '\n' || s[0] == '\r') {
+    return false;
+  }
+  memcpy(buf, s, len);
+  buf[len] = '\0';
+
+  char *end;
+  errno = 0;
+  double v = strtod(buf, &end);
+  if ((size_t)(end - buf) != len || isnan(v) ||
+      (errno == ERANGE && (v == HUGE_VAL || v == -HUGE_VAL))) {
+    return false;
+  }
+  *value = v;
+  return true;
+}
+
+size_t string_from_ll(char *buf, long long value) {
+  char tmp[STR_UTIL_LL_SIZE];
+  unsigned long long v = value < 0 ? 0 - (unsigned long long)value
+                                   : (unsigned long long)value;
+  size_t n = 0;
+  do {
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  size_t len = 0;
+  if (value < 0) {
+    buf[len++] = '-';
+  }
+  while (n) {
+    buf[len++] = tmp[--n];
+  }
+  buf[len] = '\0';
+  return len;
+}
+
+void string_random_hex(char *buf, size_t len) {
+  static const char hex[] = "0123456789abcdef";
+  FILE *f = fopen("/dev/urandom", "r");
+  for (size_t i = 0; i < len; i++) {
+    int c = f ? fgetc(f) : EOF;
+    uint8_t byte = c == EOF ? (uint8_t)rand() : (uint8_t)c;
+    buf[i] = hex[byte & 15];
+  }
+  if (f) {
+    fclose(f);
+  }
+}
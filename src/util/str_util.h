@@ -0,0 +1,27 @@
+#ifndef REDIS_C_STR_UTIL_H__
+#define REDIS_C_STR_UTIL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Strict conversions for command arguments: the whole buffer must be the
+ * number, without surrounding spaces, and out-of-range values are rejected.
+ */
+bool string_to_ll(const char* s, size_t len, long long* value);
+bool string_to_ull(const char* s, size_t len, unsigned long long* value);
+bool string_to_double(const char* s, size_t len, double* value);
+
+/* Room for any long long in decimal, with sign and NUL. */
+#define STR_UTIL_LL_SIZE 21
+
+/* Format `value` into `buf` (STR_UTIL_LL_SIZE bytes); returns the length. */
+size_t string_from_ll(char* buf, long long value);
+
+/*
+ * Fill buf[0..len) with random hex digits (no NUL), from /dev/urandom when
+ * it can be read: node names and replication IDs.
+ */
+void string_random_hex(char* buf, size_t len);
+
+#endif
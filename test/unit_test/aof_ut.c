@@ -0,0 +1,312 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "aof.h"
+#include "cmd_handler.h"
+#include "rdb.h"
+#include "redis-C/config.h"
+#include "serialize.h"
+#include "storage.h"
+#include "util/monotonic.h"
+#include "util/str_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char g_path[64];
+
+/* A fresh server: empty keyspace, default config, no AOF */
+static void setup(void) {
+  static bool initialized = false;
+  if (!initialized) {
+    RedisCConfig *cfg = create_config(0);
+    cfg->save_params_len = 0;
+    set_config(cfg);
+    monotonic_init();
+    command_table_init();
+    init_storage();
+    initialized = true;
+  }
+  storage_clear();
+  snprintf(g_path, sizeof(g_path), "/tmp/aof_ut.%d.aof", (int)getpid());
+  unlink(g_path);
+}
+
+/* Append `argc` arguments to `f` as a RESP command */
+static void write_command(FILE *f, int argc, const char **argv) {
+  fprintf(f, "*%d\r\n", argc);
+  for (int i = 0; i < argc; i++) {
+    fprintf(f, "$%zu\r\n%s\r\n", strlen(argv[i]), argv[i]);
+  }
+}
+
+/* Run a command as a client would, logged if the AOF is open */
+static void run(int argc, const char **argv) {
+  char *args[8];
+  size_t lens[8];
+  for (int i = 0; i < argc; i++) {
+    args[i] = strdup(argv[i]);
+    lens[i] = strlen(argv[i]);
+  }
+  ReplyBuffer reply;
+  reply_init(&reply, RESP_PROTO_2);
+  dispatch_command(argc, args, lens, &reply);
+  reply_free(&reply);
+  for (int i = 0; i < argc; i++) {
+    free(args[i]);
+  }
+}
+
+static void write_file(const char *data, size_t len) {
+  FILE *f = fopen(g_path, "w");
+  fwrite(data, 1, len, f);
+  fclose(f);
+}
+
+static long long file_size(void) {
+  struct stat st;
+  return stat(g_path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+/* Reap the background rewrite the way the server cron does */
+static void wait_rewrite(void) {
+  while (rdb_bgsave_in_progress()) {
+    rdb_cron();
+    usleep(1000);
+  }
+}
+
+/* The string value of `key`, or NULL when it does not exist */
+static const char *get(const char *key) {
+  static char buf[64];
+  RedisObject *obj = storage_lookup(key, strlen(key));
+  if (!obj) {
+    return NULL;
+  }
+  char ibuf[STR_UTIL_LL_SIZE];
+  size_t len;
+  const char *value = object_string(obj, &len, ibuf);
+  snprintf(buf, sizeof(buf), "%.*s", (int)len, value);
+  return buf;
+}
+
+TEST(Aof, ExpiredKeyStaysExpiredAfterReplay) {
+  setup();
+  /* as logged for SET k 1 PX 1500 then INCR k, replayed after 2 seconds */
+  char when[STR_UTIL_LL_SIZE];
+  when[string_from_ll(when, storage_mstime() - 500)] = '\0';
+  FILE *f = fopen(g_path, "w");
+  ASSERT_NE(f, (FILE *)NULL);
+  write_command(f, 5, (const char *[]){"SET", "k", "1", "PX", "1500"});
+  write_command(f, 3, (const char *[]){"PEXPIREAT", "k", when});
+  write_command(f, 2, (const char *[]){"INCR", "k"});
+  fclose(f);
+
+  size_t commands;
+  ASSERT_EQ(aof_load(g_path, &commands), REDIS_OK);
+  EXPECT_EQ(commands, 3);
+  EXPECT_FALSE(storage_loading());
+  /* INCR ran on the key with its TTL, not on a new key without one */
+  EXPECT_EQ(get("k"), (const char *)NULL);
+  EXPECT_EQ(storage_size(), 0);
+  EXPECT_EQ(storage_expires_size(), 0);
+  unlink(g_path);
+}
+
+TEST(Aof, LiveKeyKeepsItsTtlAfterReplay) {
+  setup();
+  char when[STR_UTIL_LL_SIZE];
+  long long when_ms = storage_mstime() + 100000;
+  when[string_from_ll(when, when_ms)] = '\0';
+  FILE *f = fopen(g_path, "w");
+  ASSERT_NE(f, (FILE *)NULL);
+  write_command(f, 5, (const char *[]){"SET", "k", "1", "PX", "100000"});
+  write_command(f, 3, (const char *[]){"PEXPIREAT", "k", when});
+  write_command(f, 2, (const char *[]){"INCR", "k"});
+  fclose(f);
+
+  size_t commands;
+  ASSERT_EQ(aof_load(g_path, &commands), REDIS_OK);
+  EXPECT_EQ(commands, 3);
+  EXPECT_STR_EQ(get("k"), "2");
+  EXPECT_EQ(storage_get_expire("k", 1), when_ms);
+  unlink(g_path);
+}
+
+TEST(Aof, Replay) {
+  setup();
+  const char log[] = "*3\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\n1\r\n"
+                     "*2\r\n$4\r\nINCR\r\n$1\r\nn\r\n"
+                     "*2\r\n$4\r\nINCR\r\n$1\r\nn\r\n"
+                     "*3\r\n$3\r\nSET\r\n$1\r\nb\r\n$1\r\n2\r\n"
+                     "*2\r\n$3\r\nDEL\r\n$1\r\nb\r\n";
+  write_file(log, sizeof(log) - 1);
+  size_t commands;
+  ASSERT_EQ(aof_load(g_path, &commands), REDIS_OK);
+  EXPECT_EQ(commands, 5);
+  EXPECT_STR_EQ(get("a"), "1");
+  EXPECT_STR_EQ(get("n"), "2");
+  EXPECT_EQ(get("b"), (const char *)NULL);
+  EXPECT_EQ(file_size(), (long long)sizeof(log) - 1);
+  unlink(g_path);
+}
+
+TEST(Aof, EmptyFile) {
+  setup();
+  write_file("", 0);
+  size_t commands = 1;
+  EXPECT_EQ(aof_load(g_path, &commands), REDIS_OK);
+  EXPECT_EQ(commands, 0);
+  EXPECT_EQ(storage_size(), 0);
+  unlink(g_path);
+}
+
+TEST(Aof, TruncatedTailIsDropped) {
+  setup();
+  /* a crash in the middle of the second command */
+  const char whole[] = "*3\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\n1\r\n";
+  const char log[] = "*3\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\n1\r\n"
+                     "*3\r\n$3\r\nSET\r\n$1\r\nb\r\n$5\r\n12";
+  write_file(log, sizeof(log) - 1);
+  size_t commands;
+  ASSERT_EQ(aof_load(g_path, &commands), REDIS_OK);
+  EXPECT_EQ(commands, 1);
+  EXPECT_STR_EQ(get("a"), "1");
+  EXPECT_EQ(get("b"), (const char *)NULL);
+  /* cut back to the last complete command, so appends follow it */
+  EXPECT_EQ(file_size(), (long long)sizeof(whole) - 1);
+  unlink(g_path);
+}
+
+TEST(Aof, CorruptFileLoadsNothing) {
+  setup();
+  const char log[] = "*3\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\n1\r\n"
+                     "*2\r\n$4\r\nINCR\r\n$x\r\nn\r\n";
+  write_file(log, sizeof(log) - 1);
+  size_t commands;
+  EXPECT_EQ(aof_load(g_path, &commands), REDIS_CORRUPT_AOF);
+  EXPECT_EQ(commands, 0);
+  EXPECT_EQ(storage_size(), 0);
+  /* a corrupt file is left as it is */
+  EXPECT_EQ(file_size(), (long long)sizeof(log) - 1);
+  unlink(g_path);
+}
+
+TEST(Aof, MissingFile) {
+  setup();
+  size_t commands;
+  EXPECT_EQ(aof_load(g_path, &commands), REDIS_IO_ERROR);
+}
+
+TEST(Aof, SnapshotPreamble) {
+  setup();
+  run(3, (const char *[]){"SET", "a", "1"});
+  run(4, (const char *[]){"ZADD", "z", "1", "m"});
+  run(3, (const char *[]){"PFADD", "h", "x"});
+  ASSERT_EQ(rdb_save(g_path), REDIS_OK);
+  FILE *f = fopen(g_path, "a");
+  write_command(f, 2, (const char *[]){"INCR", "a"});
+  write_command(f, 3, (const char *[]){"SET", "b", "2"});
+  fclose(f);
+  storage_clear();
+
+  size_t commands;
+  ASSERT_EQ(aof_load(g_path, &commands), REDIS_OK);
+  /* the snapshot is not made of commands */
+  EXPECT_EQ(commands, 2);
+  EXPECT_EQ(storage_size(), 4);
+  EXPECT_STR_EQ(get("a"), "2");
+  EXPECT_STR_EQ(get("b"), "2");
+  RedisObject *z = storage_lookup("z", 1);
+  ASSERT_NE(z, (RedisObject *)NULL);
+  EXPECT_EQ(z->type, OBJ_ZSET);
+  unlink(g_path);
+}
+
+TEST(Aof, PreambleKeyExpiredSinceKeepsItsTtl) {
+  setup();
+  run(5, (const char *[]){"SET", "k", "1", "PX", "50"});
+  ASSERT_EQ(rdb_save(g_path), REDIS_OK);
+  FILE *f = fopen(g_path, "a");
+  write_command(f, 2, (const char *[]){"INCR", "k"});
+  fclose(f);
+  storage_clear();
+  usleep(100 * 1000);
+
+  size_t commands;
+  ASSERT_EQ(aof_load(g_path, &commands), REDIS_OK);
+  EXPECT_EQ(commands, 1);
+  /* the INCR found the key of the snapshot, TTL and all */
+  EXPECT_EQ(get("k"), (const char *)NULL);
+  unlink(g_path);
+}
+
+TEST(Aof, RewriteKeepsWritesDuringTheRewrite) {
+  setup();
+  write_file("", 0);
+  ASSERT_EQ(aof_open(g_path), REDIS_OK);
+  EXPECT_TRUE(aof_enabled());
+  for (int i = 0; i < 100; i++) {
+    run(2, (const char *[]){"INCR", "n"});
+  }
+  run(3, (const char *[]){"SET", "a", "before"});
+  aof_flush();
+  long long logged = file_size();
+  EXPECT_GT(logged, 0);
+
+  bool scheduled;
+  ASSERT_EQ(aof_rewrite(&scheduled), REDIS_OK);
+  EXPECT_FALSE(scheduled);
+  EXPECT_TRUE(aof_rewrite_in_progress());
+  EXPECT_EQ(aof_rewrite(&scheduled), REDIS_REWRITE_IN_PROGRESS);
+  /* after the fork: only in the buffer appended to the rewrite */
+  run(3, (const char *[]){"SET", "a", "after"});
+  run(3, (const char *[]){"SET", "b", "after"});
+  aof_flush();
+  wait_rewrite();
+  EXPECT_FALSE(aof_rewrite_in_progress());
+  /* 100 INCRs compacted into a snapshot record */
+  EXPECT_LT(file_size(), logged);
+
+  /* logging goes on into the rewritten file */
+  run(3, (const char *[]){"SET", "c", "later"});
+  aof_close();
+  EXPECT_FALSE(aof_enabled());
+
+  storage_clear();
+  size_t commands;
+  ASSERT_EQ(aof_load(g_path, &commands), REDIS_OK);
+  EXPECT_EQ(commands, 3);
+  EXPECT_STR_EQ(get("n"), "100");
+  EXPECT_STR_EQ(get("a"), "after");
+  EXPECT_STR_EQ(get("b"), "after");
+  EXPECT_STR_EQ(get("c"), "later");
+  unlink(g_path);
+}
+
+TEST(Aof, FirstRewriteCreatesTheFile) {
+  setup();
+  run(3, (const char *[]){"SET", "a", "1"});
+  ASSERT_EQ(aof_open_with_rewrite(g_path), REDIS_OK);
+  EXPECT_TRUE(aof_enabled());
+  run(3, (const char *[]){"SET", "b", "2"});
+  aof_flush();
+  /* until the rewrite is installed a restart loads the snapshot */
+  EXPECT_EQ(file_size(), -1);
+  wait_rewrite();
+  EXPECT_GT(file_size(), 0);
+  run(3, (const char *[]){"SET", "c", "3"});
+  aof_close();
+
+  storage_clear();
+  size_t commands;
+  ASSERT_EQ(aof_load(g_path, &commands), REDIS_OK);
+  EXPECT_STR_EQ(get("a"), "1");
+  EXPECT_STR_EQ(get("b"), "2");
+  EXPECT_STR_EQ(get("c"), "3");
+  unlink(g_path);
+}
+
+CTEST_MAIN()
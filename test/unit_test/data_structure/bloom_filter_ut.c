@@ -0,0 +1,178 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "data_structure/bloom_filter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int add(BloomFilter *bf, const char *key) {
+  return bloom_add(bf, key, strlen(key));
+}
+
+static bool exists(BloomFilter *bf, const char *key) {
+  return bloom_exists(bf, key, strlen(key));
+}
+
+TEST(BloomFilter, Create) {
+  EXPECT_EQ(bloom_create(0, 100, 2), (BloomFilter *)NULL);
+  EXPECT_EQ(bloom_create(1, 100, 2), (BloomFilter *)NULL);
+  EXPECT_EQ(bloom_create(0.01, 0, 2), (BloomFilter *)NULL);
+
+  BloomFilter *bf = bloom_create(0.01, 1000, 2);
+  ASSERT_NE(bf, (BloomFilter *)NULL);
+  EXPECT_EQ(bf->num_layers, 1);
+  EXPECT_EQ(bloom_capacity(bf), 1000);
+  EXPECT_EQ(bloom_count(bf), 0);
+  EXPECT_EQ(bf->layers[0].hashes, 7);
+  EXPECT_EQ(bloom_memory_usage(bf) % 64, 0);
+  /* At least the ~9.6 bits per key of a classic filter */
+  EXPECT_GE(bloom_memory_usage(bf) * 8, 9585);
+  EXPECT_EQ((uintptr_t)bf->layers[0].blocks % 64, 0);
+  bloom_destroy(bf);
+}
+
+TEST(BloomFilter, AddExists) {
+  BloomFilter *bf = bloom_create(0.001, 100, 2);
+  EXPECT_EQ(add(bf, "apple"), BLOOM_ADDED);
+  EXPECT_EQ(add(bf, "apple"), BLOOM_PRESENT);
+  EXPECT_EQ(add(bf, "pear"), BLOOM_ADDED);
+  EXPECT_TRUE(exists(bf, "apple"));
+  EXPECT_TRUE(exists(bf, "pear"));
+  EXPECT_FALSE(exists(bf, "plum"));
+  EXPECT_EQ(bloom_count(bf), 2);
+
+  /* Binary-safe keys */
+  EXPECT_EQ(bloom_add(bf, "a\0b", 3), BLOOM_ADDED);
+  EXPECT_TRUE(bloom_exists(bf, "a\0b", 3));
+  EXPECT_FALSE(bloom_exists(bf, "a\0c", 3));
+  bloom_destroy(bf);
+}
+
+TEST(BloomFilter, NoFalseNegativesAndErrorRate) {
+  const int n = 20000;
+  BloomFilter *bf = bloom_create(0.01, n, 2);
+  char key[32];
+  for (int i = 0; i < n; i++) {
+    int len = sprintf(key, "member:%d", i);
+    bloom_add(bf, key, len);
+  }
+  EXPECT_EQ(bf->num_layers, 1);
+  for (int i = 0; i < n; i++) {
+    int len = sprintf(key, "member:%d", i);
+    ASSERT_TRUE(bloom_exists(bf, key, len));
+  }
+  int false_positives = 0;
+  for (int i = 0; i < 100000; i++) {
+    int len = sprintf(key, "other:%d", i);
+    false_positives += bloom_exists(bf, key, len);
+  }
+  /* 1% target; allow sampling noise */
+  EXPECT_LT(false_positives, 1200);
+  bloom_destroy(bf);
+}
+
+TEST(BloomFilter, Scaling) {
+  BloomFilter *bf = bloom_create(0.01, 100, 2);
+  char key[32];
+  for (int i = 0; i < 1000; i++) {
+    int len = sprintf(key, "k%d", i);
+    bloom_add(bf, key, len);
+  }
+  /* 100 + 200 + 400 < 1000 <= 100 + 200 + 400 + 800 */
+  EXPECT_EQ(bf->num_layers, 4);
+  EXPECT_EQ(bloom_capacity(bf), 1500);
+  EXPECT_EQ(bf->layers[1].capacity, 200);
+  EXPECT_EQ(bf->layers[1].error_rate, 0.005);
+  EXPECT_GE(bloom_count(bf), 990);
+  for (int i = 0; i < 1000; i++) {
+    int len = sprintf(key, "k%d", i);
+    ASSERT_TRUE(bloom_exists(bf, key, len));
+  }
+  bloom_destroy(bf);
+}
+
+TEST(BloomFilter, NonScaling) {
+  BloomFilter *bf = bloom_create(0.01, 10, 0);
+  char key[32];
+  int added = 0, full = 0;
+  for (int i = 0; i < 20; i++) {
+    int len = sprintf(key, "k%d", i);
+    int r = bloom_add(bf, key, len);
+    added += r == BLOOM_ADDED;
+    full += r == BLOOM_ERR_FULL;
+  }
+  EXPECT_EQ(added, 10);
+  EXPECT_GE(full, 9);
+  EXPECT_EQ(bf->num_layers, 1);
+  /* Keys that made it in are still reported as present */
+  EXPECT_EQ(add(bf, "k0"), BLOOM_PRESENT);
+  bloom_destroy(bf);
+}
+
+TEST(BloomFilter, MultiMatchesSingle) {
+  enum { N = 300 };
+  static char buf[N][16];
+  const char *keys[N];
+  size_t lens[N];
+  int results[N];
+  bool found[N];
+  for (int i = 0; i < N; i++) {
+    /* Every key appears twice in a row */
+    lens[i] = sprintf(buf[i], "key%d", i / 2);
+    keys[i] = buf[i];
+  }
+
+  BloomFilter *bf = bloom_create(0.001, 64, 2);
+  size_t added = bloom_madd(bf, keys, lens, N, results);
+  EXPECT_GT(bf->num_layers, 1);
+  size_t counted = 0;
+  for (int i = 0; i < N; i++) {
+    if (i % 2 == 1) {
+      /* Repeats are never added twice */
+      EXPECT_EQ(results[i], BLOOM_PRESENT);
+    }
+    counted += results[i] == BLOOM_ADDED;
+  }
+  EXPECT_EQ(counted, added);
+  EXPECT_EQ(bloom_count(bf), added);
+  EXPECT_GE(added, 145);
+
+  bloom_mexists(bf, keys, lens, N, found);
+  for (int i = 0; i < N; i++) {
+    ASSERT_TRUE(found[i]);
+    ASSERT_EQ(found[i], bloom_exists(bf, keys[i], lens[i]));
+  }
+  bloom_destroy(bf);
+}
+
+TEST(BloomFilter, Restore) {
+  BloomFilter *bf = bloom_create(0.01, 100, 2);
+  char key[32];
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "key:%d", i);
+    add(bf, key);
+  }
+  ASSERT_GT(bf->num_layers, 1);
+
+  BloomFilter *copy = bloom_restore(bf);
+  ASSERT_NE(copy, (BloomFilter *)NULL);
+  EXPECT_EQ(copy->num_layers, bf->num_layers);
+  EXPECT_EQ(copy->expansion, 2);
+  EXPECT_EQ(bloom_count(copy), bloom_count(bf));
+  EXPECT_EQ(bloom_capacity(copy), bloom_capacity(bf));
+  EXPECT_EQ(bloom_memory_usage(copy), bloom_memory_usage(bf));
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "key:%d", i);
+    ASSERT_TRUE(exists(copy, key));
+  }
+  /* The copy owns its bits */
+  bloom_destroy(bf);
+  EXPECT_EQ(add(copy, "key:0"), BLOOM_PRESENT);
+  bloom_destroy(copy);
+
+  BloomLayer bad = {NULL, 0, 100, 0, 0.01, 7};
+  BloomFilter image = {&bad, 1, 2};
+  EXPECT_EQ(bloom_restore(&image), (BloomFilter *)NULL);
+}
+
+CTEST_MAIN()
@@ -2,6 +2,7 @@
 #include "ctest.h"
 #include "data_structure/count_min_sketch.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -230,4 +231,499 @@ TEST(CountMinSketch, LargeScale) {
   cms_destroy(&cms);
 }
 
+TEST(CountMinSketch, MultiKey) {
+  CountMinSketch cms;
+  cms_init_by_dim(&cms, 1000, 5);
+
+  const char *keys[] = {"a", "b", "a"};
+  size_t lens[] = {1, 1, 1};
+  uint32_t incs[] = {2, 5, 3};
+  int64_t counts[3];
+  EXPECT_EQ(cms_add_inc_multi(&cms, keys, lens, incs, 3, counts), CMS_SUCCESS);
+  EXPECT_EQ(counts[0], 2);
+  EXPECT_EQ(counts[1], 5);
+  EXPECT_EQ(counts[2], 5);
+  EXPECT_EQ(cms.elements_added, 10);
+
+  const char *query[] = {"b", "a", "missing"};
+  size_t query_lens[] = {1, 1, 7};
+  EXPECT_EQ(cms_check_multi(&cms, query, query_lens, 3, counts), CMS_SUCCESS);
+  EXPECT_EQ(counts[0], 5);
+  EXPECT_EQ(counts[1], 5);
+  EXPECT_EQ(counts[2], 0);
+
+  cms_destroy(&cms);
+}
+
+TEST(CountMinSketch, BinarySafeKeys) {
+  CountMinSketch cms;
+  cms_init_by_dim(&cms, 2000, 5);
+
+  cms_add_inc_len(&cms, "k\0a", 3, 4);
+  cms_add_inc_len(&cms, "k\0b", 3, 9);
+  EXPECT_EQ(cms_check_len(&cms, "k\0a", 3), 4);
+  EXPECT_EQ(cms_check_len(&cms, "k\0b", 3), 9);
+  EXPECT_EQ(cms_check(&cms, "k"), 0);
+
+  cms_destroy(&cms);
+}
+
+TEST(CountMinSketch, HashKeyMatchesAlt) {
+  CountMinSketch cms;
+  cms_init_by_dim(&cms, 500, 40); // deeper than the stack buffer
+
+  uint64_t hashes[40];
+  cms_hash_key(&cms, "key", 3, hashes);
+  EXPECT_NE(hashes[0], hashes[1]);
+  cms_add_inc_alt(&cms, hashes, 40, 6);
+  EXPECT_EQ(cms_check(&cms, "key"), 6);
+  EXPECT_EQ(cms_add_inc(&cms, "key", 1), 7);
+
+  uint64_t *heap = cms_get_hashes(&cms, "key");
+  EXPECT_EQ(memcmp(heap, hashes, sizeof(hashes)), 0);
+  free(heap);
+
+  cms_destroy(&cms);
+}
+
+TEST(CountMinSketch, ErrorBound) {
+  // Estimates never undercount and stay within error_rate * N for most keys
+  CountMinSketch cms;
+  cms_init_by_prob(&cms, 0.01, 0.99);
+  char key[32];
+  for (int i = 0; i < 2000; i++) {
+    sprintf(key, "item:%d", i);
+    cms_add_inc(&cms, key, (uint32_t)(i % 7 + 1));
+  }
+  int over = 0;
+  for (int i = 0; i < 2000; i++) {
+    sprintf(key, "item:%d", i);
+    int32_t est = cms_check(&cms, key);
+    EXPECT_GE(est, i % 7 + 1);
+    if (est - (i % 7 + 1) > cms.error_rate * cms.elements_added) {
+      over++;
+    }
+  }
+  EXPECT_LT(over, 2000 / 100 * 2);
+
+  cms_destroy(&cms);
+}
+
+TEST(CountMinSketch, Merge) {
+  CountMinSketch a, b, dest;
+  cms_init_by_dim(&a, 1000, 5);
+  cms_init_by_dim(&b, 1000, 5);
+  cms_init_by_dim(&dest, 1000, 5);
+
+  cms_add_inc(&a, "x", 3);
+  cms_add_inc(&b, "x", 4);
+  cms_add_inc(&b, "y", 1);
+
+  CountMinSketch *src[] = {&a, &b};
+  EXPECT_EQ(cms_merge(&dest, src, NULL, 2), CMS_SUCCESS);
+  EXPECT_EQ(cms_check(&dest, "x"), 7);
+  EXPECT_EQ(cms_check(&dest, "y"), 1);
+  EXPECT_EQ(dest.elements_added, 8);
+
+  // Weighted, with dest as one of the sources
+  int64_t weights[] = {2, 10};
+  CountMinSketch *self[] = {&dest, &a};
+  EXPECT_EQ(cms_merge(&dest, self, weights, 2), CMS_SUCCESS);
+  EXPECT_EQ(cms_check(&dest, "x"), 44);
+  EXPECT_EQ(dest.elements_added, 46);
+
+  // Saturates instead of overflowing
+  int64_t huge[] = {INT64_MAX};
+  CountMinSketch *one[] = {&a};
+  EXPECT_EQ(cms_merge(&dest, one, huge, 1), CMS_SUCCESS);
+  EXPECT_EQ(cms_check(&dest, "x"), INT32_MAX);
+
+  cms_destroy(&a);
+  cms_destroy(&b);
+  cms_destroy(&dest);
+}
+
+TEST(CountMinSketch, MergeExactPast2To53) {
+  CountMinSketch a, b, dest;
+  CmsOptions wide = {CMS_LAYOUT_FLAT, 64, 0};
+  cms_init_by_dim_ex(&a, 1000, 4, &wide);
+  cms_init_by_dim_ex(&b, 1000, 4, &wide);
+  cms_init_by_dim_ex(&dest, 1000, 4, &wide);
+  cms_add_inc(&a, "x", 3);
+  cms_add_inc(&b, "x", 2);
+  cms_add_inc(&b, "y", 1);
+
+  /* 3 * (2^52 + 1) + 2 is odd and above 2^53: a double would round it */
+  int64_t big = ((int64_t)1 << 52) + 1;
+  int64_t weights[] = {big, 1};
+  CountMinSketch *src[] = {&a, &b};
+  ASSERT_EQ(cms_merge(&dest, src, weights, 2), CMS_SUCCESS);
+  EXPECT_EQ(cms_check_len(&dest, "x", 1), 3 * big + 2);
+  EXPECT_EQ(cms_check_len(&dest, "y", 1), 1);
+  EXPECT_EQ(dest.elements_added, 3 * big + 3);
+
+  /* overshooting and coming back is exact too */
+  int64_t there_and_back[] = {INT64_MAX, -INT64_MAX, 1};
+  CountMinSketch *twice[] = {&a, &a, &b};
+  ASSERT_EQ(cms_merge(&dest, twice, there_and_back, 3), CMS_SUCCESS);
+  EXPECT_EQ(cms_check_len(&dest, "x", 1), 2);
+  EXPECT_EQ(dest.elements_added, 3);
+
+  /* and past the range it saturates */
+  int64_t up[] = {INT64_MAX, INT64_MAX};
+  ASSERT_EQ(cms_merge(&dest, src, up, 2), CMS_SUCCESS);
+  EXPECT_EQ(cms_check_len(&dest, "x", 1), INT64_MAX);
+  EXPECT_EQ(dest.elements_added, INT64_MAX);
+  int64_t down[] = {INT64_MIN, INT64_MIN};
+  ASSERT_EQ(cms_merge(&dest, src, down, 2), CMS_SUCCESS);
+  EXPECT_EQ(cms_check_len(&dest, "x", 1), INT64_MIN);
+  EXPECT_EQ(dest.elements_added, INT64_MIN);
+
+  cms_destroy(&a);
+  cms_destroy(&b);
+  cms_destroy(&dest);
+}
+
+TEST(CountMinSketch, MultiQueryAtMinimum) {
+  CountMinSketch a, b;
+  cms_init_by_dim(&a, 1000, 4);
+  cms_init_by_dim(&b, 1000, 4);
+  cms_add_inc(&b, "x", 1);
+
+  /* a negative weight saturates the counters at INT32_MIN == CMS_ERROR */
+  int64_t weights[] = {-((int64_t)1 << 40)};
+  CountMinSketch *src[] = {&b};
+  ASSERT_EQ(cms_merge(&a, src, weights, 1), CMS_SUCCESS);
+  const char *keys[] = {"x"};
+  size_t lens[] = {1};
+  int64_t counts[1];
+  EXPECT_EQ(cms_check_multi(&a, keys, lens, 1, counts), CMS_SUCCESS);
+  EXPECT_EQ(counts[0], INT32_MIN);
+
+  cms_destroy(&a);
+  cms_destroy(&b);
+}
+
+TEST(CountMinSketch, MergeDimensionMismatch) {
+  CountMinSketch a, dest;
+  cms_init_by_dim(&a, 100, 5);
+  cms_init_by_dim(&dest, 100, 4);
+
+  CountMinSketch *src[] = {&a};
+  EXPECT_EQ(cms_merge(&dest, src, NULL, 1), CMS_ERROR);
+
+  cms_destroy(&a);
+  cms_destroy(&dest);
+}
+
+TEST(CountMinSketch, BlockedInit) {
+  CountMinSketch cms;
+  EXPECT_EQ(cms_init_blocked(&cms, 1000, 3), CMS_SUCCESS);
+  EXPECT_EQ(cms.layout, CMS_LAYOUT_BLOCKED);
+  EXPECT_EQ(cms.row_lanes, 5);
+  EXPECT_EQ(cms.num_blocks, 200); // every row spans >= width counters
+  EXPECT_EQ((uintptr_t)cms.bins % 64, 0);
+  cms_destroy(&cms);
+
+  EXPECT_EQ(cms_init_blocked(&cms, 1000, CMS_BLOCK_MAX_DEPTH + 1), CMS_ERROR);
+  EXPECT_EQ(cms_init_blocked(&cms, 0, 4), CMS_ERROR);
+}
+
+TEST(CountMinSketch, BlockedAddCheck) {
+  unsigned int depths[] = {1, 2, 3, CMS_BLOCK_MAX_DEPTH};
+  for (int d = 0; d < 4; d++) {
+    CountMinSketch cms;
+    cms_init_blocked(&cms, 4096, depths[d]);
+
+    EXPECT_EQ(cms_add_inc(&cms, "a", 3), 3);
+    EXPECT_EQ(cms_add_inc(&cms, "a", 4), 7);
+    EXPECT_EQ(cms_add(&cms, "b"), 1);
+    EXPECT_EQ(cms_check(&cms, "a"), 7);
+    EXPECT_EQ(cms_check(&cms, "b"), 1);
+    EXPECT_EQ(cms_check(&cms, "missing"), 0);
+    EXPECT_EQ(cms.elements_added, 8);
+
+    EXPECT_EQ(cms_remove_inc(&cms, "a", 5), 2);
+    EXPECT_EQ(cms_remove_inc(&cms, "a", 5), 0); // floors at zero
+    EXPECT_EQ(cms_check_mean(&cms, "b"), 1);
+
+    cms_destroy(&cms);
+  }
+}
+
+TEST(CountMinSketch, BlockedSaturates) {
+  CountMinSketch cms;
+  cms_init_blocked(&cms, 64, 4);
+
+  cms_add_inc(&cms, "hot", UINT32_MAX);
+  EXPECT_EQ(cms_check(&cms, "hot"), INT32_MAX);
+  EXPECT_EQ(cms_add_inc(&cms, "hot", 1), INT32_MAX);
+
+  cms_destroy(&cms);
+}
+
+/* Share of `probes` absent keys (estimate alone is the error) over the bound,
+ * once `keys` keys of `count` each were added */
+static double over_bound(CountMinSketch *cms, int keys, uint32_t count,
+                         int probes) {
+  char key[32];
+  for (int i = 0; i < keys; i++) {
+    sprintf(key, "item:%d", i);
+    cms_add_inc(cms, key, count);
+  }
+  double bound = cms->error_rate * cms->elements_added;
+  int over = 0;
+  for (int i = 0; i < probes; i++) {
+    sprintf(key, "probe:%d", i);
+    if (cms_check(cms, key) >= bound) {
+      over++;
+    }
+  }
+  return (double)over / probes;
+}
+
+TEST(CountMinSketch, BlockedConfidence) {
+  for (unsigned int d = 1; d <= CMS_BLOCK_MAX_DEPTH; d++) {
+    CountMinSketch cms;
+    ASSERT_EQ(cms_init_blocked(&cms, 1000, d), CMS_SUCCESS);
+    EXPECT_EQ(cms.confidence, cms_blocked_confidence(d));
+    // one row is a flat row; more fall behind a flat sketch, still gaining
+    if (d > 1) {
+      EXPECT_LT(cms.confidence, 1 - 1.0 / (1 << d));
+      EXPECT_GT(cms.confidence, cms_blocked_confidence(d - 1));
+    }
+    cms_destroy(&cms);
+  }
+  EXPECT_EQ(cms_blocked_confidence(CMS_BLOCK_MAX_DEPTH + 1), 0.0);
+
+  // by probability: the fewest rows that reach it, or none
+  CountMinSketch cms;
+  CmsOptions blocked = {CMS_LAYOUT_BLOCKED, 32, 0};
+  ASSERT_EQ(cms_init_by_prob_ex(&cms, 0.01, 0.6, &blocked), CMS_SUCCESS);
+  EXPECT_EQ(cms.depth, 2);
+  EXPECT_GE(cms.confidence, 0.6);
+  cms_destroy(&cms);
+  EXPECT_EQ(cms_blocked_depth(0.6), 2);
+  EXPECT_EQ(cms_blocked_depth(0.99), 0);
+  EXPECT_EQ(cms_init_by_prob_ex(&cms, 0.01, 0.99, &blocked), CMS_ERROR);
+}
+
+TEST(CountMinSketch, BlockedErrorBound) {
+  // Keys of error_rate * N each: a single collision in a row reaches the
+  // bound, which is where rows sharing a block hurt the most
+  for (unsigned int d = 1; d <= CMS_BLOCK_MAX_DEPTH; d++) {
+    CountMinSketch cms;
+    cms_init_blocked(&cms, 2000, d);
+    double over = over_bound(&cms, 1000, 20, 20000);
+    EXPECT_LE(over, 1 - cms.confidence);
+    cms_destroy(&cms);
+  }
+
+  // Many small keys: rarely over the bound at all
+  CountMinSketch cms;
+  cms_init_blocked(&cms, 2000, CMS_BLOCK_MAX_DEPTH);
+  EXPECT_LE(over_bound(&cms, 20000, 1, 20000), (1 - cms.confidence) / 10);
+  cms_destroy(&cms);
+}
+
+TEST(CountMinSketch, BlockedAgainstFlat) {
+  // Same width and the deepest blocked sketch: both keep to the confidence
+  // they report, and the flat one reports (and gets) the better one
+  CountMinSketch flat, blocked;
+  cms_init_by_dim(&flat, 2000, CMS_BLOCK_MAX_DEPTH);
+  cms_init_blocked(&blocked, 2000, CMS_BLOCK_MAX_DEPTH);
+  double flat_over = over_bound(&flat, 1000, 20, 20000);
+  double blocked_over = over_bound(&blocked, 1000, 20, 20000);
+  EXPECT_LE(flat_over, 1 - flat.confidence);
+  EXPECT_LE(blocked_over, 1 - blocked.confidence);
+  EXPECT_GT(flat.confidence, blocked.confidence);
+  EXPECT_LT(flat_over, blocked_over);
+
+  // a key and its true count: neither ever undercounts
+  char key[32];
+  for (int i = 0; i < 1000; i++) {
+    sprintf(key, "item:%d", i);
+    EXPECT_GE(cms_check(&flat, key), 20);
+    EXPECT_GE(cms_check(&blocked, key), 20);
+  }
+  cms_destroy(&flat);
+  cms_destroy(&blocked);
+}
+
+TEST(CountMinSketch, BlockedMerge) {
+  CountMinSketch a, b, flat;
+  cms_init_blocked(&a, 1000, 4);
+  cms_init_blocked(&b, 1000, 4);
+  cms_init_by_dim(&flat, 1000, 4);
+
+  cms_add_inc(&a, "x", 5);
+  cms_add_inc(&b, "x", 2);
+  CountMinSketch *src[] = {&a, &b};
+  EXPECT_EQ(cms_merge(&a, src, NULL, 2), CMS_SUCCESS);
+  EXPECT_EQ(cms_check(&a, "x"), 7);
+
+  int64_t negative[] = {-1};
+  CountMinSketch *one[] = {&b};
+  EXPECT_EQ(cms_merge(&a, one, negative, 1), CMS_SUCCESS);
+  EXPECT_EQ(cms_check(&a, "x"), 0);
+
+  CountMinSketch *mixed[] = {&flat};
+  EXPECT_EQ(cms_merge(&a, mixed, NULL, 1), CMS_ERROR);
+
+  cms_destroy(&a);
+  cms_destroy(&b);
+  cms_destroy(&flat);
+}
+
+TEST(CountMinSketch, CounterWidths) {
+  unsigned int widths[] = {8, 16, 32, 64};
+  for (int w = 0; w < 4; w++) {
+    CountMinSketch cms;
+    CmsOptions opts = {CMS_LAYOUT_FLAT, widths[w], 0};
+    ASSERT_EQ(cms_init_by_dim_ex(&cms, 1000, 4, &opts), CMS_SUCCESS);
+    EXPECT_EQ(cms.counter_bits, widths[w]);
+    EXPECT_EQ(cms_memory_usage(&cms), 1000 * 4 * widths[w] / 8);
+
+    EXPECT_EQ(cms_add_inc(&cms, "a", 3), 3);
+    EXPECT_EQ(cms_add_inc_len(&cms, "a", 1, 4), 7);
+    EXPECT_EQ(cms_check(&cms, "a"), 7);
+    EXPECT_EQ(cms_check_len(&cms, "b", 1), 0);
+    EXPECT_EQ(cms_remove_inc(&cms, "a", 2), 5);
+    EXPECT_EQ(cms_check_mean(&cms, "a"), 5);
+    cms_destroy(&cms);
+  }
+
+  CountMinSketch cms;
+  CmsOptions bad = {CMS_LAYOUT_FLAT, 12, 0};
+  EXPECT_EQ(cms_init_by_dim_ex(&cms, 1000, 4, &bad), CMS_ERROR);
+  CmsOptions blocked16 = {CMS_LAYOUT_BLOCKED, 16, 0};
+  EXPECT_EQ(cms_init_by_dim_ex(&cms, 1000, 4, &blocked16), CMS_ERROR);
+}
+
+TEST(CountMinSketch, NarrowCountersSaturate) {
+  CountMinSketch cms;
+  CmsOptions opts = {CMS_LAYOUT_FLAT, 8, 0};
+  cms_init_by_dim_ex(&cms, 100, 3, &opts);
+
+  EXPECT_EQ(cms_add_inc(&cms, "k", 200), 200);
+  EXPECT_EQ(cms_add_inc(&cms, "k", 100), 255);
+  EXPECT_EQ(cms_check(&cms, "k"), 255);
+  EXPECT_EQ(cms.counter_bits, 8);
+  EXPECT_EQ(cms_remove_inc(&cms, "k", 1000), 0); // unsigned, floors at zero
+
+  cms_destroy(&cms);
+}
+
+TEST(CountMinSketch, Promote) {
+  CountMinSketch cms;
+  CmsOptions opts = {CMS_LAYOUT_FLAT, 8, CMS_FLAG_PROMOTE};
+  cms_init_by_dim_ex(&cms, 100, 3, &opts);
+
+  cms_add_inc(&cms, "small", 7);
+  EXPECT_EQ(cms_add_inc(&cms, "k", 250), 250);
+  EXPECT_EQ(cms.counter_bits, 8);
+  EXPECT_EQ(cms_add_inc(&cms, "k", 10), 260);
+  EXPECT_EQ(cms.counter_bits, 16);
+  EXPECT_EQ(cms_add_inc(&cms, "k", 70000), 70260);
+  EXPECT_EQ(cms.counter_bits, 32);
+  EXPECT_EQ(cms_check(&cms, "small"), 7); // values survive the copies
+
+  cms_destroy(&cms);
+}
+
+TEST(CountMinSketch, SixtyFourBitCounters) {
+  CountMinSketch cms;
+  CmsOptions opts = {CMS_LAYOUT_FLAT, 64, 0};
+  cms_init_by_dim_ex(&cms, 100, 3, &opts);
+
+  for (int i = 0; i < 3; i++) {
+    cms_add_inc_len(&cms, "big", 3, UINT32_MAX);
+  }
+  EXPECT_EQ(cms_check_len(&cms, "big", 3), 3 * (int64_t)UINT32_MAX);
+  EXPECT_EQ(cms_check(&cms, "big"), INT32_MAX); // legacy API clamps
+
+  cms_destroy(&cms);
+}
+
+TEST(CountMinSketch, Conservative) {
+  unsigned int layouts[] = {CMS_LAYOUT_FLAT, CMS_LAYOUT_BLOCKED};
+  for (int l = 0; l < 2; l++) {
+    CountMinSketch std_cms, cu_cms;
+    CmsOptions std_opts = {layouts[l], 32, 0};
+    CmsOptions cu_opts = {layouts[l], 32, CMS_FLAG_CONSERVATIVE};
+    cms_init_by_dim_ex(&std_cms, 64, 4, &std_opts);
+    cms_init_by_dim_ex(&cu_cms, 64, 4, &cu_opts);
+
+    // Heavy collisions on a narrow sketch
+    char key[32];
+    for (int i = 0; i < 500; i++) {
+      sprintf(key, "k%d", i);
+      cms_add_inc(&std_cms, key, (uint32_t)(i % 5 + 1));
+      cms_add_inc(&cu_cms, key, (uint32_t)(i % 5 + 1));
+    }
+    int64_t std_err = 0, cu_err = 0;
+    for (int i = 0; i < 500; i++) {
+      sprintf(key, "k%d", i);
+      int32_t cu = cms_check(&cu_cms, key);
+      int32_t st = cms_check(&std_cms, key);
+      EXPECT_GE(cu, i % 5 + 1); // still never undercounts
+      EXPECT_LE(cu, st);
+      cu_err += cu - (i % 5 + 1);
+      std_err += st - (i % 5 + 1);
+    }
+    EXPECT_LT(cu_err, std_err);
+    EXPECT_EQ(cu_cms.elements_added, std_cms.elements_added);
+    EXPECT_EQ(cms_remove_inc(&cu_cms, "k1", 1), CMS_ERROR);
+
+    cms_destroy(&std_cms);
+    cms_destroy(&cu_cms);
+  }
+}
+
+TEST(CountMinSketch, MergeMixedWidths) {
+  CountMinSketch a, b;
+  CmsOptions narrow = {CMS_LAYOUT_FLAT, 8, CMS_FLAG_PROMOTE};
+  CmsOptions wide = {CMS_LAYOUT_FLAT, 64, 0};
+  cms_init_by_dim_ex(&a, 100, 3, &narrow);
+  cms_init_by_dim_ex(&b, 100, 3, &wide);
+
+  cms_add_inc(&a, "x", 200);
+  cms_add_inc(&b, "x", 1000);
+  CountMinSketch *src[] = {&a, &b};
+  EXPECT_EQ(cms_merge(&a, src, NULL, 2), CMS_SUCCESS);
+  EXPECT_EQ(a.counter_bits, 16);
+  EXPECT_EQ(cms_check(&a, "x"), 1200);
+
+  cms_destroy(&a);
+  cms_destroy(&b);
+}
+
+TEST(CountMinSketch, Restore) {
+  CmsOptions layouts[] = {{CMS_LAYOUT_FLAT, 8, CMS_FLAG_PROMOTE},
+                          {CMS_LAYOUT_BLOCKED, 32, 0}};
+  for (int l = 0; l < 2; l++) {
+    CountMinSketch cms, copy;
+    ASSERT_EQ(cms_init_by_dim_ex(&cms, 500, 4, &layouts[l]), CMS_SUCCESS);
+    char key[32];
+    for (int i = 0; i < 1000; i++) {
+      int n = sprintf(key, "key:%d", i % 97);
+      cms_add_inc_len(&cms, key, n, 1 + i % 3);
+    }
+    ASSERT_EQ(cms_restore(&copy, &cms), CMS_SUCCESS);
+    EXPECT_EQ(copy.width, cms.width);
+    EXPECT_EQ(copy.depth, cms.depth);
+    EXPECT_EQ(copy.layout, cms.layout);
+    EXPECT_EQ(copy.counter_bits, cms.counter_bits);
+    EXPECT_EQ(copy.flags, cms.flags);
+    EXPECT_EQ(copy.elements_added, cms.elements_added);
+    EXPECT_EQ(cms_memory_usage(&copy), cms_memory_usage(&cms));
+    for (int i = 0; i < 97; i++) {
+      int n = sprintf(key, "key:%d", i);
+      ASSERT_EQ(cms_check_len(&copy, key, n), cms_check_len(&cms, key, n));
+    }
+    cms_destroy(&cms);
+    cms_destroy(&copy);
+  }
+}
+
 CTEST_MAIN()
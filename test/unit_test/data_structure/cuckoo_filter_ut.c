@@ -0,0 +1,189 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "data_structure/cuckoo_filter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int add(CuckooFilter *cf, const char *key) {
+  return cuckoo_add(cf, key, strlen(key));
+}
+
+static bool exists(CuckooFilter *cf, const char *key) {
+  return cuckoo_exists(cf, key, strlen(key));
+}
+
+static bool del(CuckooFilter *cf, const char *key) {
+  return cuckoo_delete(cf, key, strlen(key));
+}
+
+TEST(CuckooFilter, Create) {
+  EXPECT_EQ(cuckoo_create(0, 20, 1), (CuckooFilter *)NULL);
+  EXPECT_EQ(cuckoo_create(100, 0, 1), (CuckooFilter *)NULL);
+
+  CuckooFilter *cf = cuckoo_create(1000, 20, 1);
+  ASSERT_NE(cf, (CuckooFilter *)NULL);
+  EXPECT_EQ(cf->num_layers, 1);
+  /* 1000 / 4 / 0.95 rounded up to a power of two */
+  EXPECT_EQ(cuckoo_buckets(cf), 512);
+  EXPECT_EQ(cuckoo_memory_usage(cf), 512 * sizeof(uint64_t));
+  EXPECT_EQ(cuckoo_items(cf), 0);
+  cuckoo_destroy(cf);
+}
+
+TEST(CuckooFilter, AddExistsDelete) {
+  CuckooFilter *cf = cuckoo_create(100, 20, 1);
+  EXPECT_EQ(add(cf, "apple"), CUCKOO_OK);
+  EXPECT_EQ(add(cf, "pear"), CUCKOO_OK);
+  EXPECT_TRUE(exists(cf, "apple"));
+  EXPECT_TRUE(exists(cf, "pear"));
+  EXPECT_FALSE(exists(cf, "plum"));
+  EXPECT_EQ(cuckoo_items(cf), 2);
+
+  EXPECT_TRUE(del(cf, "apple"));
+  EXPECT_FALSE(exists(cf, "apple"));
+  EXPECT_TRUE(exists(cf, "pear"));
+  EXPECT_FALSE(del(cf, "apple"));
+  EXPECT_EQ(cuckoo_items(cf), 1);
+  EXPECT_EQ(cf->deleted, 1);
+
+  /* Binary-safe keys */
+  EXPECT_EQ(cuckoo_add(cf, "a\0b", 3), CUCKOO_OK);
+  EXPECT_TRUE(cuckoo_exists(cf, "a\0b", 3));
+  EXPECT_FALSE(cuckoo_exists(cf, "a\0c", 3));
+  cuckoo_destroy(cf);
+}
+
+TEST(CuckooFilter, AddNxAndCount) {
+  CuckooFilter *cf = cuckoo_create(100, 20, 1);
+  EXPECT_EQ(cuckoo_add_nx(cf, "k", 1), CUCKOO_OK);
+  EXPECT_EQ(cuckoo_add_nx(cf, "k", 1), CUCKOO_EXISTS);
+  EXPECT_EQ(cuckoo_count(cf, "k", 1), 1);
+
+  /* Plain adds store duplicates, up to both buckets' worth */
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(add(cf, "k"), CUCKOO_OK);
+  }
+  EXPECT_EQ(cuckoo_count(cf, "k", 1), 4);
+  EXPECT_EQ(cuckoo_count(cf, "x", 1), 0);
+  EXPECT_TRUE(del(cf, "k"));
+  EXPECT_EQ(cuckoo_count(cf, "k", 1), 3);
+  cuckoo_destroy(cf);
+}
+
+TEST(CuckooFilter, NoFalseNegativesAndErrorRate) {
+  const int n = 20000;
+  CuckooFilter *cf = cuckoo_create(n, 500, 0);
+  char key[32];
+  for (int i = 0; i < n; i++) {
+    int len = sprintf(key, "member:%d", i);
+    ASSERT_EQ(cuckoo_add(cf, key, len), CUCKOO_OK);
+  }
+  for (int i = 0; i < n; i++) {
+    int len = sprintf(key, "member:%d", i);
+    ASSERT_TRUE(cuckoo_exists(cf, key, len));
+  }
+  int false_positives = 0;
+  for (int i = 0; i < 100000; i++) {
+    int len = sprintf(key, "other:%d", i);
+    false_positives += cuckoo_exists(cf, key, len);
+  }
+  /* About 8 / 65535 per lookup */
+  EXPECT_LT(false_positives, 30);
+
+  /* Deleting half leaves the other half intact */
+  for (int i = 0; i < n; i += 2) {
+    int len = sprintf(key, "member:%d", i);
+    ASSERT_TRUE(cuckoo_delete(cf, key, len));
+  }
+  for (int i = 1; i < n; i += 2) {
+    int len = sprintf(key, "member:%d", i);
+    ASSERT_TRUE(cuckoo_exists(cf, key, len));
+  }
+  EXPECT_EQ(cuckoo_items(cf), n / 2);
+  cuckoo_destroy(cf);
+}
+
+TEST(CuckooFilter, FullWithoutExpansion) {
+  CuckooFilter *cf = cuckoo_create(8, 20, 0);
+  char key[32];
+  bool stored[100] = {false};
+  int added = 0, full = 0;
+  for (int i = 0; i < 100; i++) {
+    int len = sprintf(key, "k%d", i);
+    int r = cuckoo_add(cf, key, len);
+    if (r == CUCKOO_OK) {
+      stored[i] = true;
+      added++;
+      continue;
+    }
+    ASSERT_EQ(r, CUCKOO_ERR_FULL);
+    full++;
+  }
+  EXPECT_EQ(cf->num_layers, 1);
+  EXPECT_LE(added, 4 * (int)cuckoo_buckets(cf));
+  EXPECT_GT(full, 0);
+  EXPECT_EQ(cuckoo_items(cf), added);
+  /* A failed insert leaves every stored key in place */
+  for (int i = 0; i < 100; i++) {
+    int len = sprintf(key, "k%d", i);
+    if (stored[i]) {
+      ASSERT_TRUE(cuckoo_exists(cf, key, len));
+    }
+  }
+  cuckoo_destroy(cf);
+}
+
+TEST(CuckooFilter, Expansion) {
+  CuckooFilter *cf = cuckoo_create(64, 20, 2);
+  char key[32];
+  for (int i = 0; i < 2000; i++) {
+    int len = sprintf(key, "k%d", i);
+    ASSERT_EQ(cuckoo_add(cf, key, len), CUCKOO_OK);
+  }
+  EXPECT_GT(cf->num_layers, 1);
+  EXPECT_EQ(cf->layers[1].num_buckets, cf->layers[0].num_buckets * 2);
+  EXPECT_EQ(cuckoo_items(cf), 2000);
+  for (int i = 0; i < 2000; i++) {
+    int len = sprintf(key, "k%d", i);
+    ASSERT_TRUE(cuckoo_exists(cf, key, len));
+  }
+  /* Deletion reaches keys in older layers too */
+  for (int i = 0; i < 2000; i++) {
+    int len = sprintf(key, "k%d", i);
+    ASSERT_TRUE(cuckoo_delete(cf, key, len));
+  }
+  EXPECT_EQ(cuckoo_items(cf), 0);
+  cuckoo_destroy(cf);
+}
+
+TEST(CuckooFilter, Restore) {
+  CuckooFilter *cf = cuckoo_create(64, 20, 2);
+  char key[32];
+  for (int i = 0; i < 200; i++) {
+    sprintf(key, "key:%d", i);
+    ASSERT_EQ(add(cf, key), CUCKOO_OK);
+  }
+  ASSERT_TRUE(del(cf, "key:0"));
+  ASSERT_GT(cf->num_layers, 1);
+
+  CuckooFilter *copy = cuckoo_restore(cf);
+  ASSERT_NE(copy, (CuckooFilter *)NULL);
+  EXPECT_EQ(copy->num_layers, cf->num_layers);
+  EXPECT_EQ(cuckoo_items(copy), 199);
+  EXPECT_EQ(cuckoo_buckets(copy), cuckoo_buckets(cf));
+  EXPECT_EQ(copy->deleted, 1);
+  cuckoo_destroy(cf);
+  for (int i = 1; i < 200; i++) {
+    sprintf(key, "key:%d", i);
+    ASSERT_TRUE(exists(copy, key));
+  }
+  EXPECT_TRUE(del(copy, "key:1"));
+  cuckoo_destroy(copy);
+
+  CuckooLayer bad = {NULL, 3, 0};
+  CuckooFilter image = {&bad, 1, 1, 20, 0, 1};
+  EXPECT_EQ(cuckoo_restore(&image), (CuckooFilter *)NULL);
+}
+
+CTEST_MAIN()
@@ -862,4 +862,254 @@ TEST(GeoHashUT, AdjacentCellsShareBorders) {
  * Main Test Runner
  * ============================================================================ */
 
+/* ============================================================================
+ * Integer GeoHash Tests
+ * ============================================================================ */
+
+/**
+ * @brief 52-bit hashes match the sorted-set scores Redis stores for GEOADD
+ */
+TEST(GeoHashUT, IntEncodeKnownScores) {
+    GeoPoint palermo = geopoint_create(38.115556, 13.361389);
+    GeoPoint catania = geopoint_create(37.502669, 15.087269);
+    GeoHashBits hash;
+
+    EXPECT_EQ(geohash_int_encode(&palermo, GEOHASH_INT_MAX_STEP, &hash), GEOHASH_OK);
+    EXPECT_EQ(hash.bits, 3479099956230698ULL);
+    EXPECT_EQ(geohash_int_encode(&catania, GEOHASH_INT_MAX_STEP, &hash), GEOHASH_OK);
+    EXPECT_EQ(hash.bits, 3479447370796909ULL);
+
+    GeoPoint decoded;
+    EXPECT_EQ(geohash_int_decode(hash, &decoded), GEOHASH_OK);
+    EXPECT_TRUE(approx_equal(decoded.latitude, catania.latitude, 1e-5));
+    EXPECT_TRUE(approx_equal(decoded.longitude, catania.longitude, 1e-5));
+
+    /* Outside the Mercator latitude range or bad steps */
+    GeoPoint polar = geopoint_create(86.0, 0.0);
+    EXPECT_EQ(geohash_int_encode(&polar, 26, &hash), GEOHASH_ERROR_INVALID_POINT);
+    EXPECT_EQ(geohash_int_encode(&palermo, 0, &hash), GEOHASH_ERROR_INVALID_PRECISION);
+    EXPECT_EQ(geohash_int_encode(&palermo, 27, &hash), GEOHASH_ERROR_INVALID_PRECISION);
+}
+
+/**
+ * @brief Known distance between two cities, within a meter
+ */
+TEST(GeoHashUT, IntDistance) {
+    GeoPoint palermo = geopoint_create(38.115556, 13.361389);
+    GeoPoint catania = geopoint_create(37.502669, 15.087269);
+    EXPECT_TRUE(approx_equal(geohash_distance(&palermo, &catania), 166274.15, 1.0));
+    EXPECT_EQ(geohash_distance(&palermo, &palermo), 0.0);
+}
+
+/**
+ * @brief Moving across cells wraps in longitude and stops at the latitude limits
+ */
+TEST(GeoHashUT, IntMoveAndScoreRange) {
+    GeoPoint west_edge = geopoint_create(0.0, -179.99);
+    GeoHashBits hash, moved, back;
+    EXPECT_EQ(geohash_int_encode(&west_edge, 10, &hash), GEOHASH_OK);
+
+    EXPECT_TRUE(geohash_int_move(hash, -1, 0, &moved));
+    GeoBounds bounds;
+    EXPECT_EQ(geohash_int_cell(moved, &bounds), GEOHASH_OK);
+    EXPECT_TRUE(approx_equal(bounds.max_longitude, 180.0, 1e-9));
+    EXPECT_TRUE(geohash_int_move(moved, 1, 0, &back));
+    EXPECT_EQ(back.bits, hash.bits);
+
+    GeoPoint top = geopoint_create(GEOHASH_LAT_MAX, 0.0);
+    EXPECT_EQ(geohash_int_encode(&top, 10, &hash), GEOHASH_OK);
+    EXPECT_FALSE(geohash_int_move(hash, 0, 1, &moved));
+    EXPECT_TRUE(geohash_int_move(hash, 0, -1, &moved));
+
+    /* Every 52-bit point of a cell scores inside the cell's range */
+    GeoPoint p = geopoint_create(38.115556, 13.361389);
+    GeoHashBits cell, full;
+    geohash_int_encode(&p, 12, &cell);
+    geohash_int_encode(&p, GEOHASH_INT_MAX_STEP, &full);
+    double min, max;
+    geohash_int_score_range(cell, &min, &max);
+    EXPECT_TRUE((double)full.bits >= min && (double)full.bits < max);
+}
+
+/**
+ * @brief Points inside a search radius always fall in one of the area's cells
+ */
+TEST(GeoHashUT, IntSearchAreaCoversRadius) {
+    GeoPoint centers[] = {
+        geopoint_create(38.115556, 13.361389),
+        geopoint_create(-33.8688, 151.2093),
+        geopoint_create(0.0, 179.999),     /* next to the antimeridian */
+        geopoint_create(70.0, 20.0),       /* high latitude */
+    };
+    double radii[] = {5.0, 500.0, 20000.0, 300000.0};
+
+    for (size_t c = 0; c < sizeof(centers) / sizeof(centers[0]); c++) {
+        for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+            GeoSearchArea area;
+            ASSERT_EQ(geohash_int_search_area(&centers[c], 2 * radii[r], 2 * radii[r], &area),
+                      GEOHASH_OK);
+            ASSERT_TRUE(area.count >= 1 && area.count <= 9);
+
+            /* Walk the circle's rim, the hardest points to cover */
+            for (int k = 0; k < 64; k++) {
+                double bearing = k * 2 * M_PI / 64;
+                double d = radii[r] * 0.999 / GEOHASH_EARTH_RADIUS_M;
+                double lat1 = centers[c].latitude * M_PI / 180;
+                double lon1 = centers[c].longitude * M_PI / 180;
+                double lat2 = asin(sin(lat1) * cos(d) + cos(lat1) * sin(d) * cos(bearing));
+                double lon2 = lon1 + atan2(sin(bearing) * sin(d) * cos(lat1),
+                                           cos(d) - sin(lat1) * sin(lat2));
+                GeoPoint rim = geopoint_create(lat2 * 180 / M_PI,
+                                               remainder(lon2 * 180 / M_PI, 360.0));
+                ASSERT_TRUE(geohash_distance(&centers[c], &rim) <= radii[r]);
+
+                GeoHashBits full;
+                ASSERT_EQ(geohash_int_encode(&rim, GEOHASH_INT_MAX_STEP, &full), GEOHASH_OK);
+                bool covered = false;
+                for (size_t i = 0; i < area.count; i++) {
+                    double min, max;
+                    geohash_int_score_range(area.cells[i], &min, &max);
+                    covered |= (double)full.bits >= min && (double)full.bits < max;
+                }
+                ASSERT_TRUE(covered);
+            }
+        }
+    }
+}
+
+/**
+ * @brief The caller-buffer API agrees with the allocating one
+ */
+TEST(GeoHashUT, BufferApiMatchesAllocating) {
+    GeoPoint points[] = {
+        geopoint_create(37.7749, -122.4194),
+        geopoint_create(-33.8688, 151.2093),
+        geopoint_create(90.0, 180.0),
+        geopoint_create(-90.0, -180.0),
+    };
+    for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); i++) {
+        for (size_t precision = 1; precision <= GEOHASH_MAX_PRECISION; precision++) {
+            char buf[GEOHASH_MAX_PRECISION + 1];
+            GeoHash hash = geohash_create();
+            ASSERT_EQ(geohash_encode_into(&points[i], precision, buf), GEOHASH_OK);
+            ASSERT_EQ(geohash_encode(&points[i], precision, &hash), GEOHASH_OK);
+            ASSERT_EQ(strcmp(buf, hash.hash), 0);
+
+            GeoBounds a, b;
+            ASSERT_EQ(geohash_bounds_of(buf, precision, &a), GEOHASH_OK);
+            ASSERT_EQ(geohash_get_bounds(&hash, &b), GEOHASH_OK);
+            ASSERT_EQ(a.min_latitude, b.min_latitude);
+            ASSERT_EQ(a.max_longitude, b.max_longitude);
+            ASSERT_TRUE(points[i].latitude >= a.min_latitude &&
+                        points[i].latitude <= a.max_latitude);
+
+            for (int dir = GEOHASH_NORTH; dir <= GEOHASH_WEST; dir++) {
+                char next[GEOHASH_MAX_PRECISION + 1];
+                GeoHash adjacent = geohash_create();
+                ASSERT_EQ(geohash_adjacent_into(buf, precision, (GeoDirection)dir, next),
+                          GEOHASH_OK);
+                ASSERT_EQ(geohash_get_adjacent(&hash, (GeoDirection)dir, &adjacent),
+                          GEOHASH_OK);
+                ASSERT_EQ(strcmp(next, adjacent.hash), 0);
+                geohash_free(&adjacent);
+            }
+            geohash_free(&hash);
+        }
+    }
+
+    char buf[GEOHASH_MAX_PRECISION + 1];
+    EXPECT_EQ(geohash_encode_into(&points[0], 0, buf), GEOHASH_ERROR_INVALID_PRECISION);
+    EXPECT_EQ(geohash_adjacent_into("zzzz", 4, GEOHASH_NORTH, buf), GEOHASH_OK);
+    EXPECT_EQ(strcmp(buf, "pbpb"), 0);
+}
+
+/**
+ * @brief Characters outside the base32 alphabet are rejected
+ */
+TEST(GeoHashUT, DecodeRejectsNonAlphabet) {
+    GeoBounds bounds;
+    const char *invalid[] = {"9q8yya", "9q8yyi", "9q8yyl", "9q8yyo", "9Q8YY", "9q8y-"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        EXPECT_EQ(geohash_bounds_of(invalid[i], strlen(invalid[i]), &bounds),
+                  GEOHASH_ERROR_INVALID_HASH);
+    }
+    char high[] = {'9', 'q', (char)0xe9, '\0'};
+    EXPECT_EQ(geohash_bounds_of(high, 3, &bounds), GEOHASH_ERROR_INVALID_HASH);
+    EXPECT_EQ(geohash_bounds_of("9q8yy", 0, &bounds), GEOHASH_ERROR_INVALID_HASH);
+    EXPECT_EQ(geohash_bounds_of("0123456789bcd", 13, &bounds), GEOHASH_ERROR_INVALID_HASH);
+    EXPECT_EQ(geohash_bounds_of("0123456789bcdefghjkmnpqrstuvwxyz", 12, &bounds), GEOHASH_OK);
+}
+
+/**
+ * @brief Moving on the interleaved bits lands on the cell of the shifted point
+ */
+TEST(GeoHashUT, IntMoveMatchesGrid) {
+    GeoPoint p = geopoint_create(38.115556, 13.361389);
+    for (uint8_t step = 1; step <= GEOHASH_INT_MAX_STEP; step++) {
+        GeoHashBits hash;
+        geohash_int_encode(&p, step, &hash);
+        GeoBounds cell;
+        geohash_int_cell(hash, &cell);
+        double width = cell.max_longitude - cell.min_longitude;
+        double height = cell.max_latitude - cell.min_latitude;
+        GeoPoint center = geopoint_create((cell.min_latitude + cell.max_latitude) / 2,
+                                          (cell.min_longitude + cell.max_longitude) / 2);
+
+        for (int dx = -2; dx <= 2; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                GeoPoint shifted = geopoint_create(center.latitude + dy * height,
+                                                   remainder(center.longitude + dx * width, 360.0));
+                GeoHashBits moved, expected;
+                if (geohash_int_encode(&shifted, step, &expected) != GEOHASH_OK) {
+                    continue;
+                }
+                ASSERT_TRUE(geohash_int_move(hash, dx, dy, &moved));
+                ASSERT_EQ(moved.bits, expected.bits);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Batch encoding gives the scalar scores and stops at the first invalid point
+ */
+TEST(GeoHashUT, IntEncodeBatchMatchesScalar) {
+    enum { N = 1031 };
+    static GeoPoint points[N];
+    static uint64_t out[N];
+    uint64_t seed = 42;
+    for (size_t i = 0; i < N; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        double u = (double)(seed >> 11) / (double)(1ULL << 53);
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        double v = (double)(seed >> 11) / (double)(1ULL << 53);
+        points[i] = geopoint_create(GEOHASH_LAT_MIN + u * (GEOHASH_LAT_MAX - GEOHASH_LAT_MIN),
+                                    -180.0 + v * 360.0);
+    }
+    /* The edges of the valid range */
+    points[0] = geopoint_create(GEOHASH_LAT_MAX, 180.0);
+    points[1] = geopoint_create(GEOHASH_LAT_MIN, -180.0);
+    points[2] = geopoint_create(0.0, 0.0);
+
+    ASSERT_EQ(geohash_int_encode_batch(points, N, out), (size_t)N);
+    for (size_t i = 0; i < N; i++) {
+        GeoHashBits hash;
+        ASSERT_EQ(geohash_int_encode(&points[i], GEOHASH_INT_MAX_STEP, &hash), GEOHASH_OK);
+        ASSERT_EQ(out[i], hash.bits);
+    }
+
+    /* Every tail length and an invalid point at each position of a block */
+    for (size_t n = 0; n < 9; n++) {
+        EXPECT_EQ(geohash_int_encode_batch(points + 3, n, out), n);
+    }
+    for (size_t bad = 0; bad < 9; bad++) {
+        GeoPoint saved = points[bad];
+        points[bad] = geopoint_create(bad % 2 ? 86.0 : NAN, 0.0);
+        EXPECT_EQ(geohash_int_encode_batch(points, 16, out), bad);
+        points[bad] = geopoint_create(0.0, bad % 2 ? -180.5 : 181.0);
+        EXPECT_EQ(geohash_int_encode_batch(points, 16, out), bad);
+        points[bad] = saved;
+    }
+}
+
 CTEST_MAIN()
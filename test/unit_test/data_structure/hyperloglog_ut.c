@@ -0,0 +1,203 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "data_structure/hyperloglog.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void add_range(HyperLogLog *hll, const char *prefix, int from, int to) {
+  char key[48];
+  for (int i = from; i < to; i++) {
+    int len = sprintf(key, "%s:%d", prefix, i);
+    hll_add(hll, key, len);
+  }
+}
+
+static double relative_error(uint64_t estimate, double actual) {
+  return fabs((double)estimate - actual) / actual;
+}
+
+TEST(HyperLogLog, Empty) {
+  HyperLogLog *hll = hll_create();
+  ASSERT_NE(hll, (HyperLogLog *)NULL);
+  EXPECT_EQ(hll->encoding, HLL_SPARSE);
+  EXPECT_EQ(hll_count(hll), 0);
+  EXPECT_LT(hll_memory_usage(hll), 64);
+  hll_destroy(hll);
+}
+
+TEST(HyperLogLog, AddReportsUpdates) {
+  HyperLogLog *hll = hll_create();
+  EXPECT_EQ(hll_add(hll, "a", 1), HLL_UPDATED);
+  EXPECT_EQ(hll_add(hll, "a", 1), HLL_OK);
+  EXPECT_EQ(hll_add(hll, "b", 1), HLL_UPDATED);
+  EXPECT_EQ(hll_count(hll), 2);
+  /* The cached estimate is refreshed after a write */
+  EXPECT_EQ(hll_add(hll, "c", 1), HLL_UPDATED);
+  EXPECT_FALSE(hll->card_valid);
+  EXPECT_EQ(hll_count(hll), 3);
+  EXPECT_TRUE(hll->card_valid);
+  hll_destroy(hll);
+}
+
+TEST(HyperLogLog, SparseIsExactForSmallSets) {
+  HyperLogLog *hll = hll_create();
+  add_range(hll, "user", 0, 300);
+  EXPECT_EQ(hll->encoding, HLL_SPARSE);
+  EXPECT_LT(relative_error(hll_count(hll), 300), 0.02);
+  /* Far below the dense footprint */
+  EXPECT_LT(hll_memory_usage(hll), HLL_DENSE_BYTES / 4);
+  hll_destroy(hll);
+}
+
+TEST(HyperLogLog, PromotesToDense) {
+  HyperLogLog *hll = hll_create();
+  add_range(hll, "user", 0, 700);
+  uint32_t before = hll->sparse_len;
+  uint64_t sparse_count = hll_count(hll);
+  EXPECT_EQ(hll->encoding, HLL_SPARSE);
+
+  add_range(hll, "user", 700, 2000);
+  EXPECT_EQ(hll->encoding, HLL_DENSE);
+  EXPECT_EQ(hll->sparse, (uint32_t *)NULL);
+  EXPECT_GT(before, 0);
+  EXPECT_GT(hll_count(hll), sparse_count);
+  EXPECT_LT(relative_error(hll_count(hll), 2000), 0.03);
+  hll_destroy(hll);
+}
+
+TEST(HyperLogLog, Accuracy) {
+  const int counts[] = {10000, 100000, 1000000};
+  for (int c = 0; c < 3; c++) {
+    HyperLogLog *hll = hll_create();
+    add_range(hll, "page", 0, counts[c]);
+    /* About 0.81% standard error; allow 3 sigma */
+    EXPECT_LT(relative_error(hll_count(hll), counts[c]), 0.025);
+    hll_destroy(hll);
+  }
+}
+
+TEST(HyperLogLog, MergeMatchesSingle) {
+  HyperLogLog *all = hll_create();
+  HyperLogLog *parts[4];
+  for (int i = 0; i < 4; i++) {
+    parts[i] = hll_create();
+    add_range(parts[i], "k", i * 5000, i * 5000 + 7000);
+    add_range(all, "k", i * 5000, i * 5000 + 7000);
+  }
+  HyperLogLog *dest = hll_create();
+  ASSERT_EQ(hll_merge(dest, (const HyperLogLog *const *)parts, 4), HLL_OK);
+  EXPECT_EQ(dest->encoding, HLL_DENSE);
+  /* Register-wise max is exactly what adding everything to one gives */
+  EXPECT_EQ(memcmp(dest->dense, all->dense, HLL_DENSE_BYTES), 0);
+  EXPECT_EQ(hll_count(dest), hll_count(all));
+  EXPECT_EQ(hll_count_union((const HyperLogLog *const *)parts, 4),
+            hll_count(all));
+  hll_destroy(dest);
+  hll_destroy(all);
+  for (int i = 0; i < 4; i++) {
+    hll_destroy(parts[i]);
+  }
+}
+
+TEST(HyperLogLog, MergeMixedEncodings) {
+  HyperLogLog *dense = hll_create();
+  HyperLogLog *sparse = hll_create();
+  HyperLogLog *all = hll_create();
+  add_range(dense, "x", 0, 5000);
+  add_range(sparse, "x", 5000, 5100);
+  add_range(all, "x", 0, 5100);
+  EXPECT_EQ(sparse->encoding, HLL_SPARSE);
+
+  /* Sparse destination, dense source */
+  const HyperLogLog *srcs[] = {dense, NULL};
+  ASSERT_EQ(hll_merge(sparse, srcs, 2), HLL_OK);
+  EXPECT_EQ(sparse->encoding, HLL_DENSE);
+  EXPECT_EQ(memcmp(sparse->dense, all->dense, HLL_DENSE_BYTES), 0);
+  hll_destroy(dense);
+  hll_destroy(sparse);
+  hll_destroy(all);
+}
+
+TEST(HyperLogLog, MergeSparseStaysSparse) {
+  HyperLogLog *a = hll_create();
+  HyperLogLog *b = hll_create();
+  add_range(a, "a", 0, 100);
+  add_range(b, "b", 0, 100);
+  uint64_t before = hll_count(b);
+  uint32_t entries = b->sparse_len;
+  const HyperLogLog *srcs[] = {b};
+  ASSERT_EQ(hll_merge(a, srcs, 1), HLL_OK);
+  EXPECT_EQ(a->encoding, HLL_SPARSE);
+  EXPECT_LT(relative_error(hll_count(a), 200), 0.03);
+  /* Sources are untouched */
+  EXPECT_EQ(hll_count(b), before);
+  EXPECT_EQ(b->sparse_len, entries);
+
+  /* Count of a union with itself is unchanged */
+  const HyperLogLog *same[] = {a, a};
+  EXPECT_EQ(hll_count_union(same, 2), hll_count(a));
+  hll_destroy(a);
+  hll_destroy(b);
+}
+
+TEST(HyperLogLog, Restore) {
+  HyperLogLog *sparse = hll_create();
+  HyperLogLog *dense = hll_create();
+  add_range(sparse, "s", 0, 100);
+  add_range(dense, "d", 0, 50000);
+  ASSERT_EQ(sparse->encoding, HLL_SPARSE);
+  ASSERT_EQ(dense->encoding, HLL_DENSE);
+
+  HyperLogLog *sparse_copy = hll_restore(sparse);
+  HyperLogLog *dense_copy = hll_restore(dense);
+  ASSERT_NE(sparse_copy, (HyperLogLog *)NULL);
+  ASSERT_NE(dense_copy, (HyperLogLog *)NULL);
+  EXPECT_EQ(sparse_copy->encoding, HLL_SPARSE);
+  EXPECT_EQ(dense_copy->encoding, HLL_DENSE);
+  EXPECT_EQ(hll_count(sparse_copy), hll_count(sparse));
+  EXPECT_EQ(hll_count(dense_copy), hll_count(dense));
+
+  /* A restored sparse HLL keeps growing and promotes as usual */
+  add_range(sparse_copy, "s", 100, 20000);
+  EXPECT_EQ(sparse_copy->encoding, HLL_DENSE);
+  EXPECT_LT(relative_error(hll_count(sparse_copy), 20000), 0.05);
+
+  HyperLogLog bad = *sparse;
+  bad.encoding = 7;
+  EXPECT_EQ(hll_restore(&bad), (HyperLogLog *)NULL);
+
+  /* Corrupt registers are refused before they index a histogram */
+  uint8_t *regs = malloc(HLL_DENSE_BYTES);
+  ASSERT_NE(regs, (uint8_t *)NULL);
+  memset(regs, 0xff, HLL_DENSE_BYTES);
+  bad = *dense;
+  bad.dense = regs;
+  EXPECT_EQ(hll_restore(&bad), (HyperLogLog *)NULL);
+  free(regs);
+
+  uint32_t entries[2];
+  bad = *sparse;
+  bad.sparse = entries;
+  bad.sparse_len = 1;
+  entries[0] = (uint32_t)HLL_REGISTERS << HLL_BITS | 1; /* index too large */
+  EXPECT_EQ(hll_restore(&bad), (HyperLogLog *)NULL);
+  entries[0] = 5u << HLL_BITS; /* zero rank */
+  EXPECT_EQ(hll_restore(&bad), (HyperLogLog *)NULL);
+  entries[0] = 5u << HLL_BITS | HLL_REGISTER_MAX; /* rank too large */
+  EXPECT_EQ(hll_restore(&bad), (HyperLogLog *)NULL);
+  bad.sparse_len = 2;
+  entries[0] = 9u << HLL_BITS | 1;
+  entries[1] = 3u << HLL_BITS | 1; /* out of order */
+  EXPECT_EQ(hll_restore(&bad), (HyperLogLog *)NULL);
+  entries[1] = 9u << HLL_BITS | 2; /* duplicate register */
+  EXPECT_EQ(hll_restore(&bad), (HyperLogLog *)NULL);
+  hll_destroy(sparse);
+  hll_destroy(dense);
+  hll_destroy(sparse_copy);
+  hll_destroy(dense_copy);
+}
+
+CTEST_MAIN()
@@ -494,4 +494,301 @@ TEST(SkipList, EmptyStringTest) {
   skiplist_destroy(list);
 }
 
+// ===== Rank and Ordered Access =====
+
+TEST(SkipList, RankAndNodeAt) {
+  SkipList *list = skiplist_create(compare_int, free_generic, copy_int);
+  // Insert 0, 2, 4, ... 1998 in a scrambled order
+  for (int i = 0; i < 1000; i++) {
+    int v = ((i * 7919) % 1000) * 2;
+    EXPECT_EQ(skiplist_insert(list, &v), true);
+  }
+  EXPECT_EQ(skiplist_size(list), 1000);
+
+  for (int i = 0; i < 1000; i++) {
+    int v = i * 2;
+    ASSERT_EQ(skiplist_rank(list, &v), (size_t)i + 1);
+    SkipListNode *node = skiplist_node_at(list, (size_t)i + 1);
+    ASSERT_NE(node, (SkipListNode *)NULL);
+    EXPECT_EQ(*(int *)skiplist_node_value(node), v);
+  }
+  int missing = 3;
+  EXPECT_EQ(skiplist_rank(list, &missing), 0);
+  EXPECT_EQ(skiplist_node_at(list, 0), (SkipListNode *)NULL);
+  EXPECT_EQ(skiplist_node_at(list, 1001), (SkipListNode *)NULL);
+
+  skiplist_destroy(list);
+}
+
+TEST(SkipList, RanksAfterErase) {
+  SkipList *list = skiplist_create(compare_int, free_generic, copy_int);
+  for (int i = 0; i < 500; i++) {
+    skiplist_insert(list, &i);
+  }
+  // Drop every multiple of 3, ranks of the rest shift down
+  for (int i = 0; i < 500; i += 3) {
+    EXPECT_EQ(skiplist_erase(list, &i), true);
+  }
+  size_t expected = 0;
+  for (int i = 0; i < 500; i++) {
+    if (i % 3 == 0) {
+      EXPECT_EQ(skiplist_rank(list, &i), 0);
+    } else {
+      ASSERT_EQ(skiplist_rank(list, &i), ++expected);
+    }
+  }
+  EXPECT_EQ(skiplist_size(list), expected);
+
+  int first = 0; // already erased
+  int *taken = skiplist_unlink(list, &(int){1});
+  ASSERT_NE(taken, (int *)NULL);
+  EXPECT_EQ(*taken, 1);
+  free(taken);
+  EXPECT_EQ(skiplist_unlink(list, &first), NULL);
+  EXPECT_EQ(skiplist_size(list), expected - 1);
+
+  skiplist_destroy(list);
+}
+
+TEST(SkipList, OrderedWalk) {
+  SkipList *list = skiplist_create(compare_int, free_generic, copy_int);
+  EXPECT_EQ(skiplist_first(list), (SkipListNode *)NULL);
+  EXPECT_EQ(skiplist_last(list), (SkipListNode *)NULL);
+
+  int values[] = {50, 10, 40, 20, 30};
+  for (int i = 0; i < 5; i++) {
+    skiplist_insert(list, &values[i]);
+  }
+
+  int expect = 10;
+  for (SkipListNode *n = skiplist_first(list); n; n = skiplist_next(n)) {
+    EXPECT_EQ(*(int *)skiplist_node_value(n), expect);
+    expect += 10;
+  }
+  expect = 50;
+  for (SkipListNode *n = skiplist_last(list); n; n = skiplist_prev(n)) {
+    EXPECT_EQ(*(int *)skiplist_node_value(n), expect);
+    expect -= 10;
+  }
+
+  int probe = 25;
+  EXPECT_EQ(*(int *)skiplist_node_value(skiplist_lower_bound(list, &probe)), 30);
+  probe = 30;
+  EXPECT_EQ(*(int *)skiplist_node_value(skiplist_lower_bound(list, &probe)), 30);
+  probe = 51;
+  EXPECT_EQ(skiplist_lower_bound(list, &probe), (SkipListNode *)NULL);
+
+  // The tail moves back when the last node goes away
+  EXPECT_EQ(skiplist_erase(list, &values[0]), true);
+  EXPECT_EQ(*(int *)skiplist_node_value(skiplist_last(list)), 40);
+
+  skiplist_destroy(list);
+}
+
+// ===== Inline Keys and Node Pool =====
+
+// Length-prefixed string ordered by score, then bytes (a prefix sorts first)
+typedef struct {
+  double score;
+  size_t len;
+  char bytes[16];
+} KeyedItem;
+
+static int compare_keyed(const void *a, const void *b) {
+  const KeyedItem *x = (const KeyedItem *)a;
+  const KeyedItem *y = (const KeyedItem *)b;
+  if (x->score != y->score) {
+    return x->score < y->score ? -1 : 1;
+  }
+  size_t min = x->len < y->len ? x->len : y->len;
+  int cmp = memcmp(x->bytes, y->bytes, min);
+  return cmp ? cmp : (x->len > y->len) - (x->len < y->len);
+}
+
+static void key_of_keyed(const void *value, SkipListKey *key) {
+  const KeyedItem *item = (const KeyedItem *)value;
+  key->score = item->score;
+  key->prefix = skiplist_key_prefix(item->bytes, item->len);
+}
+
+TEST(SkipList, KeyPrefixOrder) {
+  EXPECT_EQ(skiplist_key_prefix("", 0), 0);
+  EXPECT_TRUE(skiplist_key_prefix("a", 1) < skiplist_key_prefix("ab", 2));
+  EXPECT_TRUE(skiplist_key_prefix("ab", 2) < skiplist_key_prefix("b", 1));
+  EXPECT_TRUE(skiplist_key_prefix("\xff", 1) > skiplist_key_prefix("~", 1));
+  // Only the first 8 bytes take part; the rest is CompareFunc's job
+  EXPECT_EQ(skiplist_key_prefix("abcdefghX", 9),
+            skiplist_key_prefix("abcdefghY", 9));
+  // A trailing NUL pads like nothing, also left to CompareFunc
+  EXPECT_EQ(skiplist_key_prefix("a\0", 2), skiplist_key_prefix("a", 1));
+}
+
+TEST(SkipList, KeyedOrderMatchesCompare) {
+  SkipList *list = skiplist_create_keyed(compare_keyed, NULL, NULL,
+                                         key_of_keyed);
+  // Few scores and a shared 8-byte prefix, so ties reach CompareFunc; some
+  // members differ only by trailing NULs
+  enum { N = 2000 };
+  KeyedItem *items = calloc(N, sizeof(KeyedItem));
+  for (int i = 0; i < N; i++) {
+    int r = (i * 7919) % N;
+    items[i].score = (double)(r % 5);
+    items[i].len = (size_t)snprintf(items[i].bytes, sizeof(items[i].bytes),
+                                    "prefix00%d", r / 5) + (size_t)(r % 2);
+    EXPECT_EQ(skiplist_insert(list, &items[i]), true);
+  }
+  EXPECT_EQ(skiplist_size(list), N);
+  EXPECT_EQ(skiplist_insert(list, &items[N / 2]), false);
+
+  size_t rank = 0;
+  const KeyedItem *prev = NULL;
+  for (SkipListNode *n = skiplist_first(list); n; n = skiplist_next(n)) {
+    const KeyedItem *cur = skiplist_node_value(n);
+    if (prev) {
+      ASSERT_TRUE(compare_keyed(prev, cur) < 0);
+    }
+    ASSERT_EQ(skiplist_rank(list, cur), ++rank);
+    prev = cur;
+  }
+  EXPECT_EQ(rank, N);
+
+  for (int i = 0; i < N; i += 2) {
+    EXPECT_EQ(skiplist_erase(list, &items[i]), true);
+  }
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(skiplist_contain(list, &items[i]), i % 2 == 1);
+  }
+  KeyedItem probe = {1.0, 0, ""};
+  SkipListNode *first = skiplist_lower_bound(list, &probe);
+  ASSERT_NE(first, (SkipListNode *)NULL);
+  EXPECT_EQ(((KeyedItem *)skiplist_node_value(first))->score, 1.0);
+  EXPECT_EQ(((KeyedItem *)skiplist_node_value(skiplist_prev(first)))->score,
+            0.0);
+
+  skiplist_destroy(list);
+  free(items);
+}
+
+TEST(SkipList, PoolReuse) {
+  SkipList *list = skiplist_create(compare_int, free_generic, copy_int);
+  // Freed nodes go back to their level's bucket and are handed out again
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 20000; i++) {
+      int v = (i * 7919) % 20000;
+      ASSERT_EQ(skiplist_insert(list, &v), true);
+    }
+    for (int i = 0; i < 20000; i += 2) {
+      ASSERT_EQ(skiplist_erase(list, &i), true);
+    }
+    ASSERT_EQ(skiplist_size(list), 10000);
+    for (int i = 1; i < 20000; i += 2) {
+      ASSERT_EQ(skiplist_rank(list, &i), (size_t)(i + 1) / 2);
+    }
+    for (int i = 1; i < 20000; i += 2) {
+      ASSERT_EQ(skiplist_erase(list, &i), true);
+    }
+    ASSERT_EQ(skiplist_size(list), 0);
+    EXPECT_EQ(skiplist_first(list), (SkipListNode *)NULL);
+  }
+  // Destroy with nodes still linked frees their values and the slabs
+  for (int i = 0; i < 1000; i++) {
+    skiplist_insert(list, &i);
+  }
+  skiplist_destroy(list);
+}
+
+// ===== Bulk Build and Range Erase =====
+
+static void count_erased(void *value, void *ctx) {
+  (void)value;
+  (*(int *)ctx)++;
+}
+
+TEST(SkipList, BuildFromSorted) {
+  enum { N = 5000 };
+  int *values = malloc(N * sizeof(int));
+  void **ptrs = malloc(N * sizeof(void *));
+  for (int i = 0; i < N; i++) {
+    values[i] = i * 2;
+    ptrs[i] = &values[i];
+  }
+
+  SkipList *list = skiplist_create(compare_int, free_generic, copy_int);
+  ASSERT_EQ(skiplist_build_from_sorted(list, ptrs, N), true);
+  EXPECT_EQ(skiplist_size(list), N);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(skiplist_rank(list, &values[i]), (size_t)i + 1);
+    ASSERT_EQ(*(int *)skiplist_node_value(skiplist_node_at(list, i + 1)),
+              values[i]);
+  }
+  int expect = (N - 1) * 2;
+  for (SkipListNode *n = skiplist_last(list); n; n = skiplist_prev(n)) {
+    ASSERT_EQ(*(int *)skiplist_node_value(n), expect);
+    expect -= 2;
+  }
+  EXPECT_EQ(expect, -2);
+
+  // Only an empty list can be built
+  EXPECT_EQ(skiplist_build_from_sorted(list, ptrs, N), false);
+  // A built list behaves like an inserted one
+  int odd = 7;
+  EXPECT_EQ(skiplist_insert(list, &odd), true);
+  EXPECT_EQ(skiplist_rank(list, &odd), 5);
+  EXPECT_EQ(skiplist_erase(list, &values[0]), true);
+  EXPECT_EQ(skiplist_rank(list, &odd), 4);
+  skiplist_destroy(list);
+
+  // Unsorted or duplicated input is refused and leaves the list empty
+  list = skiplist_create(compare_int, free_generic, copy_int);
+  void *tmp = ptrs[10];
+  ptrs[10] = ptrs[11];
+  ptrs[11] = tmp;
+  EXPECT_EQ(skiplist_build_from_sorted(list, ptrs, N), false);
+  ptrs[11] = ptrs[10];
+  EXPECT_EQ(skiplist_build_from_sorted(list, ptrs, N), false);
+  EXPECT_EQ(skiplist_size(list), 0);
+  EXPECT_EQ(skiplist_build_from_sorted(list, ptrs, 0), true);
+  EXPECT_EQ(skiplist_first(list), (SkipListNode *)NULL);
+  skiplist_destroy(list);
+
+  free(ptrs);
+  free(values);
+}
+
+TEST(SkipList, EraseRange) {
+  SkipList *list = skiplist_create(compare_int, free_generic, copy_int);
+  for (int i = 1; i <= 100; i++) {
+    skiplist_insert(list, &i);
+  }
+
+  int erased = 0;
+  EXPECT_EQ(skiplist_erase_range(list, 11, 20, count_erased, &erased), 10);
+  EXPECT_EQ(erased, 10);
+  int v = 10;
+  EXPECT_EQ(skiplist_rank(list, &v), 10);
+  v = 21;
+  EXPECT_EQ(skiplist_rank(list, &v), 11);
+  // The end is clamped; out-of-range starts remove nothing
+  EXPECT_EQ(skiplist_erase_range(list, 81, 1000, NULL, NULL), 10);
+  EXPECT_EQ(*(int *)skiplist_node_value(skiplist_last(list)), 90);
+  EXPECT_EQ(skiplist_erase_range(list, 81, 90, NULL, NULL), 0);
+  EXPECT_EQ(skiplist_erase_range(list, 0, 5, NULL, NULL), 0);
+  EXPECT_EQ(skiplist_size(list), 80);
+
+  // Half-open value ranges
+  int lo = 30, hi = 40;
+  EXPECT_EQ(skiplist_erase_between(list, &lo, &hi, NULL, NULL), 10);
+  EXPECT_EQ(skiplist_contain(list, &lo), false);
+  EXPECT_EQ(skiplist_contain(list, &hi), true);
+  EXPECT_EQ(skiplist_erase_between(list, NULL, &lo, NULL, NULL), 19);
+  EXPECT_EQ(*(int *)skiplist_node_value(skiplist_first(list)), 40);
+  EXPECT_EQ(skiplist_prev(skiplist_first(list)), (SkipListNode *)NULL);
+  EXPECT_EQ(skiplist_erase_between(list, &hi, &lo, NULL, NULL), 0);
+  EXPECT_EQ(skiplist_erase_between(list, &hi, NULL, NULL, NULL), 51);
+  EXPECT_EQ(skiplist_size(list), 0);
+  EXPECT_EQ(skiplist_last(list), (SkipListNode *)NULL);
+
+  skiplist_destroy(list);
+}
+
 CTEST_MAIN()
@@ -0,0 +1,221 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "data_structure/sorted_set.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static ZSetAddResult add(SortedSet *zs, const char *member, double score) {
+  return zset_add(zs, member, strlen(member), score, 0, NULL);
+}
+
+TEST(SortedSet, AddScoreCard) {
+  SortedSet *zs = zset_create();
+  ASSERT_NE(zs, (SortedSet *)NULL);
+
+  EXPECT_EQ(add(zs, "a", 1), ZSET_ADDED);
+  EXPECT_EQ(add(zs, "b", 2), ZSET_ADDED);
+  EXPECT_EQ(add(zs, "a", 1), ZSET_NOP);
+  EXPECT_EQ(add(zs, "a", 3), ZSET_UPDATED);
+  EXPECT_EQ(zset_card(zs), 2);
+
+  double score;
+  EXPECT_TRUE(zset_score(zs, "a", 1, &score));
+  EXPECT_EQ(score, 3.0);
+  EXPECT_FALSE(zset_score(zs, "c", 1, &score));
+
+  EXPECT_TRUE(zset_remove(zs, "a", 1));
+  EXPECT_FALSE(zset_remove(zs, "a", 1));
+  EXPECT_EQ(zset_card(zs), 1);
+
+  zset_destroy(zs);
+}
+
+TEST(SortedSet, Flags) {
+  SortedSet *zs = zset_create();
+  double score;
+
+  EXPECT_EQ(zset_add(zs, "m", 1, 5, ZSET_ADD_XX, NULL), ZSET_NOP);
+  EXPECT_EQ(zset_card(zs), 0);
+  EXPECT_EQ(zset_add(zs, "m", 1, 5, ZSET_ADD_NX, NULL), ZSET_ADDED);
+  EXPECT_EQ(zset_add(zs, "m", 1, 9, ZSET_ADD_NX, NULL), ZSET_NOP);
+  EXPECT_EQ(zset_add(zs, "m", 1, 4, ZSET_ADD_GT, NULL), ZSET_NOP);
+  EXPECT_EQ(zset_add(zs, "m", 1, 6, ZSET_ADD_GT, NULL), ZSET_UPDATED);
+  EXPECT_EQ(zset_add(zs, "m", 1, 7, ZSET_ADD_LT, NULL), ZSET_NOP);
+
+  EXPECT_EQ(zset_add(zs, "m", 1, 2.5, ZSET_ADD_INCR, &score), ZSET_UPDATED);
+  EXPECT_EQ(score, 8.5);
+  EXPECT_EQ(zset_add(zs, "n", 1, 2, ZSET_ADD_INCR, &score), ZSET_ADDED);
+  EXPECT_EQ(score, 2.0);
+
+  zset_add(zs, "i", 1, INFINITY, 0, NULL);
+  EXPECT_EQ(zset_add(zs, "i", 1, -INFINITY, ZSET_ADD_INCR, NULL),
+            ZSET_ERR_NAN);
+
+  zset_destroy(zs);
+}
+
+TEST(SortedSet, RankOrder) {
+  SortedSet *zs = zset_create();
+  char member[32];
+  // Scores collide in groups of 10, members break the ties
+  for (int i = 999; i >= 0; i--) {
+    int n = sprintf(member, "m%03d", i);
+    zset_add(zs, member, n, i / 10, 0, NULL);
+  }
+
+  size_t rank;
+  for (int i = 0; i < 1000; i++) {
+    int n = sprintf(member, "m%03d", i);
+    ASSERT_TRUE(zset_rank(zs, member, n, false, &rank));
+    EXPECT_EQ(rank, (size_t)i);
+    ASSERT_TRUE(zset_rank(zs, member, n, true, &rank));
+    EXPECT_EQ(rank, (size_t)(999 - i));
+  }
+  EXPECT_FALSE(zset_rank(zs, "nope", 4, false, &rank));
+
+  SkipListNode *node = zset_node_at(zs, 500);
+  EXPECT_STR_EQ(zset_node_entry(node)->member, "m500");
+  EXPECT_STR_EQ(zset_node_entry(skiplist_next(node))->member, "m501");
+  EXPECT_EQ(zset_node_at(zs, 1000), (SkipListNode *)NULL);
+
+  // Updating a score moves the member and shifts the others
+  zset_add(zs, "m000", 4, 1000, 0, NULL);
+  zset_rank(zs, "m000", 4, false, &rank);
+  EXPECT_EQ(rank, 999);
+  zset_rank(zs, "m001", 4, false, &rank);
+  EXPECT_EQ(rank, 0);
+
+  zset_destroy(zs);
+}
+
+TEST(SortedSet, ScoreRanges) {
+  SortedSet *zs = zset_create();
+  add(zs, "a", 1);
+  add(zs, "b", 2);
+  add(zs, "c", 2);
+  add(zs, "d", 3);
+  add(zs, "e", INFINITY);
+
+  ZRangeSpec all = {-INFINITY, INFINITY, false, false};
+  EXPECT_EQ(zset_count(zs, &all), 5);
+  EXPECT_STR_EQ(zset_node_entry(zset_first_in_range(zs, &all))->member, "a");
+  EXPECT_STR_EQ(zset_node_entry(zset_last_in_range(zs, &all))->member, "e");
+
+  ZRangeSpec two = {2, 2, false, false};
+  EXPECT_EQ(zset_count(zs, &two), 2);
+  EXPECT_STR_EQ(zset_node_entry(zset_first_in_range(zs, &two))->member, "b");
+  EXPECT_STR_EQ(zset_node_entry(zset_last_in_range(zs, &two))->member, "c");
+
+  ZRangeSpec open = {1, 3, true, true};
+  EXPECT_EQ(zset_count(zs, &open), 2);
+
+  // An exclusive min skips every member tied with it
+  ZRangeSpec above_two = {2, INFINITY, true, false};
+  EXPECT_EQ(zset_count(zs, &above_two), 2);
+  EXPECT_STR_EQ(zset_node_entry(zset_first_in_range(zs, &above_two))->member,
+                "d");
+  ZRangeSpec above_inf = {INFINITY, INFINITY, true, false};
+  EXPECT_EQ(zset_first_in_range(zs, &above_inf), (SkipListNode *)NULL);
+  EXPECT_EQ(zset_count(zs, &above_inf), 0);
+
+  ZRangeSpec upto = {-INFINITY, 3, false, true};
+  EXPECT_STR_EQ(zset_node_entry(zset_last_in_range(zs, &upto))->member, "c");
+
+  ZRangeSpec none = {2.1, 2.9, false, false};
+  EXPECT_EQ(zset_count(zs, &none), 0);
+  EXPECT_EQ(zset_first_in_range(zs, &none), (SkipListNode *)NULL);
+  EXPECT_EQ(zset_last_in_range(zs, &none), (SkipListNode *)NULL);
+
+  ZRangeSpec inverted = {3, 1, false, false};
+  EXPECT_EQ(zset_count(zs, &inverted), 0);
+
+  zset_destroy(zs);
+}
+
+TEST(SortedSet, RemoveRanges) {
+  SortedSet *zs = zset_create();
+  char name[8];
+  for (int i = 0; i < 10; i++) {
+    snprintf(name, sizeof(name), "m%d", i);
+    add(zs, name, i);
+  }
+  add(zs, "inf", INFINITY);
+
+  // Ranks 1..3 are m1, m2, m3; the dict forgets them too
+  EXPECT_EQ(zset_remove_range_by_rank(zs, 1, 3), 3);
+  EXPECT_EQ(zset_card(zs), 8);
+  double score;
+  EXPECT_FALSE(zset_score(zs, "m2", 2, &score));
+  EXPECT_TRUE(zset_score(zs, "m4", 2, &score));
+  size_t rank;
+  EXPECT_TRUE(zset_rank(zs, "m4", 2, false, &rank));
+  EXPECT_EQ(rank, 1);
+
+  ZRangeSpec open = {4, 6, true, false}; /* (4 6 */
+  EXPECT_EQ(zset_remove_range_by_score(zs, &open), 2);
+  EXPECT_TRUE(zset_score(zs, "m4", 2, &score));
+  EXPECT_FALSE(zset_score(zs, "m6", 2, &score));
+
+  ZRangeSpec above_inf = {INFINITY, INFINITY, true, false};
+  EXPECT_EQ(zset_remove_range_by_score(zs, &above_inf), 0);
+  ZRangeSpec upto = {-INFINITY, 8, false, true}; /* -inf (8 */
+  EXPECT_EQ(zset_remove_range_by_score(zs, &upto), 3); /* m0 m4 m7 */
+  ZRangeSpec all = {-INFINITY, INFINITY, false, false};
+  EXPECT_EQ(zset_remove_range_by_score(zs, &all), 3); /* m8 m9 inf */
+  EXPECT_EQ(zset_card(zs), 0);
+  EXPECT_FALSE(zset_score(zs, "inf", 3, &score));
+
+  zset_destroy(zs);
+}
+
+TEST(SortedSet, BinarySafeMembers) {
+  SortedSet *zs = zset_create();
+  EXPECT_EQ(zset_add(zs, "a\0b", 3, 1, 0, NULL), ZSET_ADDED);
+  EXPECT_EQ(zset_add(zs, "a\0c", 3, 1, 0, NULL), ZSET_ADDED);
+  EXPECT_EQ(zset_add(zs, "a", 1, 1, 0, NULL), ZSET_ADDED);
+  EXPECT_EQ(zset_card(zs), 3);
+
+  size_t rank;
+  zset_rank(zs, "a", 1, false, &rank);
+  EXPECT_EQ(rank, 0); // a prefix sorts first
+  zset_rank(zs, "a\0c", 3, false, &rank);
+  EXPECT_EQ(rank, 2);
+
+  zset_destroy(zs);
+}
+
+TEST(SortedSet, LoadSorted) {
+  const char *members[] = {"a", "b", "c", "ab", "d"};
+  const size_t lens[] = {1, 1, 1, 2, 1};
+  const double scores[] = {1, 1, 1, 2, 3};
+  /* "ab" sorts after "c" only because its score is higher */
+  SortedSet *zs = zset_create();
+  ASSERT_TRUE(zset_load_sorted(zs, members, lens, scores, 5));
+  EXPECT_EQ(zset_card(zs), 5);
+  size_t rank;
+  EXPECT_TRUE(zset_rank(zs, "ab", 2, false, &rank));
+  EXPECT_EQ(rank, 3);
+  double score;
+  EXPECT_TRUE(zset_score(zs, "d", 1, &score));
+  EXPECT_EQ(score, 3.0);
+  /* The set is fully usable afterwards */
+  EXPECT_EQ(add(zs, "a", 10), ZSET_UPDATED);
+  EXPECT_TRUE(zset_rank(zs, "a", 1, true, &rank));
+  EXPECT_EQ(rank, 0);
+  /* Only an empty set can be loaded */
+  EXPECT_FALSE(zset_load_sorted(zs, members, lens, scores, 5));
+  zset_destroy(zs);
+
+  /* Out of order input leaves the set empty */
+  const double unsorted[] = {1, 1, 1, 0, 3};
+  zs = zset_create();
+  EXPECT_FALSE(zset_load_sorted(zs, members, lens, unsorted, 5));
+  EXPECT_EQ(zset_card(zs), 0);
+  EXPECT_EQ(dict_size(zs->dict), 0);
+  EXPECT_EQ(add(zs, "a", 1), ZSET_ADDED);
+  zset_destroy(zs);
+}
+
+CTEST_MAIN()
@@ -0,0 +1,159 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "data_structure/top_k.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Add an item, dropping any expelled item; returns whether one was expelled */
+static bool add(TopK *tk, const char *key, uint32_t incr) {
+  char *expelled;
+  size_t len;
+  topk_add(tk, key, strlen(key), incr, &expelled, &len);
+  free(expelled);
+  return expelled != NULL;
+}
+
+static bool query(TopK *tk, const char *key) {
+  return topk_query(tk, key, strlen(key));
+}
+
+TEST(TopK, Create) {
+  EXPECT_EQ(topk_create(0, 100, 4), (TopK *)NULL);
+  EXPECT_EQ(topk_create(5, 0, 4), (TopK *)NULL);
+  EXPECT_EQ(topk_create(5, 100, 0), (TopK *)NULL);
+  EXPECT_EQ(topk_create(5, 100, TOPK_MAX_DEPTH + 1), (TopK *)NULL);
+
+  TopK *tk = topk_create(5, 100, 4);
+  ASSERT_NE(tk, (TopK *)NULL);
+  EXPECT_EQ(tk->k, 5);
+  EXPECT_EQ(tk->size, 0);
+  EXPECT_EQ(tk->sketch.width, 100);
+  EXPECT_EQ(tk->sketch.depth, 4);
+  EXPECT_GT(topk_memory_usage(tk), 400 * sizeof(int32_t));
+  topk_destroy(tk);
+}
+
+TEST(TopK, FillsThenExpelsMinimum) {
+  TopK *tk = topk_create(3, 1000, 5);
+  EXPECT_FALSE(add(tk, "a", 5));
+  EXPECT_FALSE(add(tk, "b", 3));
+  EXPECT_FALSE(add(tk, "c", 1));
+  EXPECT_EQ(tk->size, 3);
+
+  /* Not above the minimum: rejected */
+  EXPECT_FALSE(add(tk, "d", 1));
+  EXPECT_FALSE(query(tk, "d"));
+
+  char *expelled;
+  size_t len;
+  ASSERT_EQ(topk_add(tk, "d", 1, 1, &expelled, &len), TOPK_OK);
+  ASSERT_NE(expelled, (char *)NULL);
+  EXPECT_EQ(len, 1);
+  EXPECT_EQ(strcmp(expelled, "c"), 0);
+  free(expelled);
+  EXPECT_TRUE(query(tk, "d"));
+  EXPECT_FALSE(query(tk, "c"));
+  EXPECT_EQ(topk_count(tk, "d", 1), 2);
+
+  TopKSlot out[3];
+  ASSERT_EQ(topk_list(tk, out), 3);
+  EXPECT_EQ(strcmp(out[0].entry->key, "a"), 0);
+  EXPECT_EQ(out[0].count, 5);
+  EXPECT_EQ(strcmp(out[1].entry->key, "b"), 0);
+  EXPECT_EQ(strcmp(out[2].entry->key, "d"), 0);
+  topk_destroy(tk);
+}
+
+TEST(TopK, RepeatedAddsRaiseCount) {
+  TopK *tk = topk_create(2, 1000, 5);
+  for (int i = 0; i < 10; i++) {
+    EXPECT_FALSE(add(tk, "hot", 1));
+  }
+  EXPECT_FALSE(add(tk, "warm", 1));
+  TopKSlot out[2];
+  ASSERT_EQ(topk_list(tk, out), 2);
+  EXPECT_EQ(strcmp(out[0].entry->key, "hot"), 0);
+  EXPECT_EQ(out[0].count, 10);
+  EXPECT_EQ(out[1].count, 1);
+  /* The heap minimum is the lower count */
+  EXPECT_EQ(tk->heap[0].count, 1);
+  topk_destroy(tk);
+}
+
+TEST(TopK, FindsHeavyHittersInSkewedStream) {
+  enum { K = 10, HEAVY = 10, LIGHT = 20000 };
+  TopK *tk = topk_create(K, 2048, 5);
+  char key[32];
+  /* Heavy items interleaved with a long tail of items seen once or twice */
+  for (int round = 0; round < 200; round++) {
+    for (int h = 0; h < HEAVY; h++) {
+      sprintf(key, "heavy:%d", h);
+      add(tk, key, 1);
+    }
+    for (int l = 0; l < LIGHT / 200; l++) {
+      sprintf(key, "light:%d", (round * 97 + l * 31) % LIGHT);
+      add(tk, key, 1);
+    }
+  }
+  for (int h = 0; h < HEAVY; h++) {
+    sprintf(key, "heavy:%d", h);
+    ASSERT_TRUE(query(tk, key));
+  }
+  EXPECT_EQ(tk->size, K);
+  EXPECT_EQ(dict_size(tk->index), K);
+  topk_destroy(tk);
+}
+
+TEST(TopK, HeapAndIndexStayConsistent) {
+  TopK *tk = topk_create(16, 256, 4);
+  char key[32];
+  srand(7);
+  for (int i = 0; i < 20000; i++) {
+    /* Zipf-ish: low ids are far more common */
+    int id = rand() % (1 + rand() % 500);
+    sprintf(key, "k%d", id);
+    add(tk, key, 1 + rand() % 3);
+  }
+  ASSERT_EQ(tk->size, 16);
+  for (uint32_t i = 0; i < tk->size; i++) {
+    ASSERT_EQ(tk->heap[i].entry->v.s64, i);
+    if (i > 0) {
+      ASSERT_LE(tk->heap[(i - 1) / 2].count, tk->heap[i].count);
+    }
+  }
+  EXPECT_TRUE(query(tk, "k0"));
+  topk_destroy(tk);
+}
+
+TEST(TopK, Restore) {
+  TopK *tk = topk_create(4, 256, 4);
+  char key[32];
+  for (int i = 0; i < 2000; i++) {
+    sprintf(key, "k%d", i % (1 + i % 23));
+    add(tk, key, 1);
+  }
+  ASSERT_EQ(tk->size, 4);
+
+  TopK *copy = topk_restore(tk->k, &tk->sketch);
+  ASSERT_NE(copy, (TopK *)NULL);
+  for (uint32_t i = 0; i < tk->size; i++) {
+    const DictEntry *e = tk->heap[i].entry;
+    ASSERT_EQ(topk_restore_slot(copy, e->key, e->key_len, tk->heap[i].count),
+              TOPK_OK);
+  }
+  EXPECT_EQ(topk_restore_slot(copy, "extra", 5, 1), TOPK_ERR_OOM);
+  TopKSlot a[4], b[4];
+  ASSERT_EQ(topk_list(tk, a), topk_list(copy, b));
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(strcmp(a[i].entry->key, b[i].entry->key), 0);
+    EXPECT_EQ(a[i].count, b[i].count);
+    EXPECT_EQ(copy->heap[i].entry->v.s64, i);
+  }
+  EXPECT_EQ(topk_count(copy, "k0", 2), topk_count(tk, "k0", 2));
+  topk_destroy(tk);
+  topk_destroy(copy);
+}
+
+CTEST_MAIN()
@@ -0,0 +1,332 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "util/dict.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int g_freed = 0;
+
+static void count_free(void *val) {
+  g_freed++;
+  free(val);
+}
+
+TEST(Dict, CreateDestroy) {
+  Dict *d = dict_create(NULL);
+  EXPECT_NE(d, (Dict *)NULL);
+  EXPECT_EQ(dict_size(d), 0);
+  EXPECT_EQ(dict_find(d, "missing", 7), (DictEntry *)NULL);
+  dict_destroy(d);
+  dict_destroy(NULL);
+}
+
+TEST(Dict, AddFind) {
+  Dict *d = dict_create(NULL);
+  int a = 1, b = 2;
+
+  EXPECT_TRUE(dict_add(d, "a", 1, &a));
+  EXPECT_TRUE(dict_add(d, "b", 1, &b));
+  EXPECT_FALSE(dict_add(d, "a", 1, &b)); // Duplicate
+  EXPECT_EQ(dict_size(d), 2);
+
+  EXPECT_EQ(dict_fetch_value(d, "a", 1), &a);
+  EXPECT_EQ(dict_fetch_value(d, "b", 1), &b);
+  EXPECT_EQ(dict_fetch_value(d, "c", 1), NULL);
+
+  DictEntry *e = dict_find(d, "a", 1);
+  EXPECT_STR_EQ(e->key, "a");
+  EXPECT_EQ(e->key_len, 1);
+
+  dict_destroy(d);
+}
+
+TEST(Dict, BinarySafeKeys) {
+  Dict *d = dict_create(NULL);
+  int a = 1, b = 2;
+
+  EXPECT_TRUE(dict_add(d, "k\0x", 3, &a));
+  EXPECT_TRUE(dict_add(d, "k\0y", 3, &b));
+  EXPECT_TRUE(dict_add(d, "k", 1, &b));
+  EXPECT_EQ(dict_size(d), 3);
+  EXPECT_EQ(dict_fetch_value(d, "k\0x", 3), &a);
+  EXPECT_EQ(dict_fetch_value(d, "k\0y", 3), &b);
+
+  dict_destroy(d);
+}
+
+TEST(Dict, ReplaceFreesOldValue) {
+  Dict *d = dict_create(count_free);
+  g_freed = 0;
+
+  EXPECT_TRUE(dict_replace(d, "k", 1, malloc(4)));
+  EXPECT_FALSE(dict_replace(d, "k", 1, malloc(4)));
+  EXPECT_EQ(g_freed, 1);
+  EXPECT_EQ(dict_size(d), 1);
+
+  dict_destroy(d);
+  EXPECT_EQ(g_freed, 2);
+}
+
+TEST(Dict, Delete) {
+  Dict *d = dict_create(count_free);
+  g_freed = 0;
+
+  dict_add(d, "x", 1, malloc(4));
+  dict_add(d, "y", 1, malloc(4));
+  EXPECT_TRUE(dict_delete(d, "x", 1));
+  EXPECT_FALSE(dict_delete(d, "x", 1));
+  EXPECT_EQ(g_freed, 1);
+  EXPECT_EQ(dict_size(d), 1);
+
+  // Unlink hands the entry back without freeing the value
+  DictEntry *e = dict_unlink(d, "y", 1);
+  EXPECT_NE(e, (DictEntry *)NULL);
+  EXPECT_EQ(dict_size(d), 0);
+  EXPECT_EQ(g_freed, 1);
+  dict_free_unlinked(d, e);
+  EXPECT_EQ(g_freed, 2);
+
+  dict_destroy(d);
+}
+
+TEST(Dict, Grow) {
+  Dict *d = dict_create(NULL);
+  char key[32];
+
+  for (long i = 0; i < 100000; i++) {
+    int n = sprintf(key, "key:%ld", i);
+    DictEntry *e = dict_add_raw(d, key, n, NULL);
+    ASSERT_NE(e, (DictEntry *)NULL);
+    e->v.s64 = i;
+  }
+  EXPECT_EQ(dict_size(d), 100000);
+  EXPECT_LE(dict_size(d), dict_buckets(d));
+
+  for (long i = 0; i < 100000; i += 997) {
+    int n = sprintf(key, "key:%ld", i);
+    DictEntry *e = dict_find(d, key, n);
+    ASSERT_NE(e, (DictEntry *)NULL);
+    EXPECT_EQ(e->v.s64, i);
+  }
+
+  dict_destroy(d);
+}
+
+TEST(Dict, Iterate) {
+  Dict *d = dict_create(NULL);
+  char key[32];
+  for (int i = 0; i < 1000; i++) {
+    int n = sprintf(key, "%d", i);
+    dict_add_raw(d, key, n, NULL)->v.s64 = i;
+  }
+
+  // Every entry is visited once, deleting while iterating is allowed
+  DictIterator it;
+  DictEntry *e;
+  long sum = 0;
+  int visited = 0;
+  dict_iter_init(&it, d);
+  while ((e = dict_iter_next(&it))) {
+    sum += e->v.s64;
+    visited++;
+    if (e->v.s64 % 2 == 0) {
+      dict_delete(d, e->key, e->key_len);
+    }
+  }
+  dict_iter_release(&it);
+  EXPECT_EQ(visited, 1000);
+  EXPECT_EQ(sum, 999 * 1000 / 2);
+  EXPECT_EQ(dict_size(d), 500);
+  EXPECT_EQ(d->pause_rehash, 0);
+
+  dict_destroy(d);
+}
+
+TEST(Dict, IncrementalRehash) {
+  Dict *d = dict_create(NULL);
+  char key[32];
+
+  /* fill the table exactly, the next insert starts a rehash */
+  for (int i = 0; i < 1024; i++) {
+    int n = sprintf(key, "k%d", i);
+    dict_add_raw(d, key, n, NULL)->v.s64 = i;
+  }
+  EXPECT_FALSE(dict_is_rehashing(d));
+  dict_add_raw(d, "extra", 5, NULL)->v.s64 = -1;
+  EXPECT_TRUE(dict_is_rehashing(d));
+  EXPECT_EQ(d->ht[1].size, 2048);
+
+  /* every key stays reachable while split across both tables */
+  EXPECT_TRUE(d->ht[0].used > 0);
+  EXPECT_TRUE(d->ht[1].used > 0);
+  for (int i = 0; i < 1024; i += 2) {
+    int n = sprintf(key, "k%d", i);
+    DictEntry *e = dict_find(d, key, n);
+    ASSERT_NE(e, (DictEntry *)NULL);
+    EXPECT_EQ(e->v.s64, i);
+  }
+  EXPECT_TRUE(dict_is_rehashing(d));
+  EXPECT_EQ(dict_size(d), 1025);
+
+  EXPECT_TRUE(dict_delete(d, "k7", 2));
+  EXPECT_FALSE(dict_add(d, "k8", 2, NULL));
+
+  while (dict_rehash(d, 100)) {
+  }
+  EXPECT_FALSE(dict_is_rehashing(d));
+  EXPECT_EQ(d->ht[0].size, 2048);
+  EXPECT_EQ(d->ht[1].table, (DictEntry **)NULL);
+  EXPECT_EQ(dict_size(d), 1024);
+  EXPECT_NE(dict_find(d, "extra", 5), (DictEntry *)NULL);
+  EXPECT_EQ(dict_find(d, "k7", 2), (DictEntry *)NULL);
+
+  dict_destroy(d);
+}
+
+TEST(Dict, IteratorPausesRehash) {
+  Dict *d = dict_create(NULL);
+  char key[32];
+  for (int i = 0; i < 65; i++) {
+    int n = sprintf(key, "%d", i);
+    dict_add_raw(d, key, n, NULL)->v.s64 = i;
+  }
+  ASSERT_TRUE(dict_is_rehashing(d));
+
+  DictIterator it;
+  DictEntry *e;
+  int visited = 0;
+  dict_iter_init(&it, d);
+  long idx = d->rehash_idx;
+  while ((e = dict_iter_next(&it))) {
+    EXPECT_NE(dict_find(d, e->key, e->key_len), (DictEntry *)NULL);
+    visited++;
+  }
+  EXPECT_EQ(d->rehash_idx, idx);
+  dict_iter_release(&it);
+  EXPECT_EQ(visited, 65);
+
+  dict_rehash_ms(d, 100);
+  EXPECT_FALSE(dict_is_rehashing(d));
+  EXPECT_EQ(dict_size(d), 65);
+
+  dict_destroy(d);
+}
+
+TEST(Dict, Shrink) {
+  Dict *d = dict_create(NULL);
+  char key[32];
+  for (int i = 0; i < 4096; i++) {
+    int n = sprintf(key, "%d", i);
+    dict_add(d, key, n, NULL);
+  }
+  dict_rehash_ms(d, 100);
+  for (int i = 10; i < 4096; i++) {
+    int n = sprintf(key, "%d", i);
+    dict_delete(d, key, n);
+  }
+  dict_rehash_ms(d, 100);
+  EXPECT_TRUE(dict_shrink_if_needed(d));
+  dict_rehash_ms(d, 100);
+  EXPECT_EQ(d->ht[0].size, 16);
+  EXPECT_EQ(dict_size(d), 10);
+  EXPECT_NE(dict_find(d, "9", 1), (DictEntry *)NULL);
+
+  dict_destroy(d);
+}
+
+TEST(Dict, Expand) {
+  Dict *d = dict_create(NULL);
+  ASSERT_TRUE(dict_expand(d, 1000));
+  EXPECT_EQ(d->ht[0].size, 1024);
+  EXPECT_FALSE(dict_is_rehashing(d));
+
+  /* Filling up to the reserved size never starts a rehash */
+  char key[32];
+  for (int i = 0; i < 1000; i++) {
+    int n = sprintf(key, "%d", i);
+    dict_add(d, key, n, NULL);
+    ASSERT_FALSE(dict_is_rehashing(d));
+  }
+  EXPECT_EQ(d->ht[0].size, 1024);
+
+  /* A populated table grows by rehashing */
+  EXPECT_FALSE(dict_expand(d, 10));
+  ASSERT_TRUE(dict_expand(d, 5000));
+  EXPECT_TRUE(dict_is_rehashing(d));
+  dict_rehash_ms(d, 100);
+  EXPECT_EQ(d->ht[0].size, 8192);
+  EXPECT_EQ(dict_size(d), 1000);
+  EXPECT_NE(dict_find(d, "999", 3), (DictEntry *)NULL);
+
+  dict_destroy(d);
+}
+
+TEST(Dict, Sample) {
+  Dict *d = dict_create(NULL);
+  DictEntry *out[16];
+  EXPECT_EQ(dict_sample(d, out, 16, NULL), 0);
+
+  char key[32];
+  for (int i = 0; i < 3; i++) {
+    int n = sprintf(key, "%d", i);
+    dict_add(d, key, n, NULL);
+  }
+  /* never more than the dict holds, and each entry at most once */
+  ASSERT_EQ(dict_sample(d, out, 16, NULL), 3);
+  EXPECT_NE(out[0], out[1]);
+  EXPECT_NE(out[0], out[2]);
+  EXPECT_NE(out[1], out[2]);
+
+  for (int i = 3; i < 65; i++) {
+    int n = sprintf(key, "%d", i);
+    dict_add(d, key, n, NULL);
+  }
+  /* sampling works across both tables mid-rehash */
+  ASSERT_TRUE(dict_is_rehashing(d));
+  size_t got = dict_sample(d, out, 16, NULL);
+  EXPECT_GT(got, 0);
+  for (size_t i = 0; i < got; i++) {
+    EXPECT_EQ(dict_find(d, out[i]->key, out[i]->key_len), out[i]);
+  }
+
+  /* repeated samples reach most of a small dict */
+  dict_rehash_ms(d, 100);
+  for (int i = 65; i < 100; i++) {
+    int n = sprintf(key, "%d", i);
+    dict_add(d, key, n, NULL);
+  }
+  int seen[100] = {0};
+  for (int round = 0; round < 200; round++) {
+    got = dict_sample(d, out, 4, NULL);
+    for (size_t i = 0; i < got; i++) {
+      seen[atoi(out[i]->key)] = 1;
+    }
+  }
+  int distinct = 0;
+  for (int i = 0; i < 100; i++) {
+    distinct += seen[i];
+  }
+  EXPECT_GT(distinct, 80);
+
+  /* with a cursor, each call moves on at least one bucket: as many calls as
+   * buckets sweep the whole table */
+  memset(seen, 0, sizeof(seen));
+  size_t cursor = 0;
+  for (size_t calls = 0; calls < d->ht[0].size; calls++) {
+    got = dict_sample(d, out, 4, &cursor);
+    for (size_t i = 0; i < got; i++) {
+      seen[atoi(out[i]->key)] = 1;
+    }
+  }
+  distinct = 0;
+  for (int i = 0; i < 100; i++) {
+    distinct += seen[i];
+  }
+  EXPECT_EQ(distinct, 100);
+
+  dict_destroy(d);
+}
+
+CTEST_MAIN()
@@ -0,0 +1,78 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "util/hash.h"
+
+#include <string.h>
+
+TEST(Hash, XXH64) {
+  EXPECT_EQ(hash_xxh64("", 0, 0), 0xef46db3751d8e999ULL);
+  EXPECT_EQ(hash_xxh64("a", 1, 0), 0xd24ec4f1a98c6e5bULL);
+  EXPECT_EQ(hash_xxh64("abc", 3, 0), 0x44bc2cf5ad770999ULL);
+}
+
+TEST(Hash, XXH64Streaming) {
+  char data[300];
+  for (size_t i = 0; i < sizeof(data); i++) {
+    data[i] = (char)(i * 31 + 7);
+  }
+  /* Any split, across and within stripes, yields the one-shot digest */
+  const size_t chunks[] = {1, 5, 31, 32, 33, 64, 100};
+  for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+    for (size_t len = 0; len <= sizeof(data); len += 37) {
+      HashXxh64State st;
+      hash_xxh64_init(&st, 42);
+      for (size_t off = 0; off < len; off += chunks[c]) {
+        size_t n = len - off < chunks[c] ? len - off : chunks[c];
+        hash_xxh64_update(&st, data + off, n);
+      }
+      ASSERT_EQ(hash_xxh64_digest(&st), hash_xxh64(data, len, 42));
+    }
+  }
+
+  HashXxh64State st;
+  hash_xxh64_init(&st, 0);
+  hash_xxh64_update(&st, "ab", 2);
+  hash_xxh64_update(&st, "c", 1);
+  EXPECT_EQ(hash_xxh64_digest(&st), 0x44bc2cf5ad770999ULL);
+}
+
+TEST(Hash, Murmur3_128) {
+  uint64_t h[2];
+  hash_murmur3_128("", 0, 0, h);
+  EXPECT_EQ(h[0], 0);
+  EXPECT_EQ(h[1], 0);
+
+  hash_murmur3_128("hello", 5, 0, h);
+  EXPECT_EQ(h[0], 0xcbd8a7b341bd9b02ULL);
+  EXPECT_EQ(h[1], 0x5b1e906a48ae1d19ULL);
+
+  const char *fox = "The quick brown fox jumps over the lazy dog";
+  hash_murmur3_128(fox, strlen(fox), 0, h);
+  EXPECT_EQ(h[0], 0xe34bbc7bbc071b6cULL);
+  EXPECT_EQ(h[1], 0x7a433ca9c49a9347ULL);
+
+  // Tail lengths 1..15 and the seed all change the result
+  uint64_t prev[2] = {0, 0};
+  for (size_t len = 1; len < 16; len++) {
+    hash_murmur3_128(fox, len, 0, h);
+    EXPECT_TRUE(h[0] != prev[0] || h[1] != prev[1]);
+    prev[0] = h[0];
+    prev[1] = h[1];
+  }
+  hash_murmur3_128("hello", 5, 42, h);
+  EXPECT_EQ(h[0], 0xc4b8b3c960af6f08ULL);
+}
+
+TEST(Hash, KeySlot) {
+  EXPECT_EQ(hash_crc16("123456789", 9), 0x31c3);
+  EXPECT_EQ(hash_key_slot("foo", 3), 12182);
+  EXPECT_EQ(hash_key_slot("user1000", 8), 3443);
+
+  // Only a non-empty {tag} is hashed
+  EXPECT_EQ(hash_key_slot("{user1000}.following", 20), 3443);
+  EXPECT_EQ(hash_key_slot("x{user1000}y{z}", 15), 3443);
+  EXPECT_EQ(hash_key_slot("{}user1000", 10), hash_crc16("{}user1000", 10) % HASH_KEY_SLOTS);
+  EXPECT_EQ(hash_key_slot("{user1000", 9), hash_crc16("{user1000", 9) % HASH_KEY_SLOTS);
+}
+
+CTEST_MAIN()
@@ -0,0 +1,83 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "util/histogram.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static Histogram *make(void) {
+  Histogram *h = malloc(sizeof(Histogram));
+  histogram_init(h);
+  return h;
+}
+
+TEST(Histogram, Empty) {
+  Histogram *h = make();
+  EXPECT_EQ(h->count, 0);
+  EXPECT_EQ(histogram_percentile(h, 50), 0);
+  EXPECT_EQ(histogram_mean(h), 0);
+  free(h);
+}
+
+TEST(Histogram, SmallValuesAreExact) {
+  Histogram *h = make();
+  for (uint64_t v = 1; v <= 50; v++) {
+    histogram_record(h, v);
+  }
+  EXPECT_EQ(h->count, 50);
+  EXPECT_EQ(h->min, 1);
+  EXPECT_EQ(h->max, 50);
+  EXPECT_EQ(histogram_percentile(h, 0), 1);
+  EXPECT_EQ(histogram_percentile(h, 50), 25);
+  EXPECT_EQ(histogram_percentile(h, 90), 45);
+  EXPECT_EQ(histogram_percentile(h, 100), 50);
+  EXPECT_EQ(histogram_mean(h), 25.5);
+  free(h);
+}
+
+TEST(Histogram, RelativeError) {
+  Histogram *h = make();
+  for (uint64_t v = 1; v <= 1000000; v++) {
+    histogram_record(h, v);
+  }
+  double ps[] = {10, 50, 90, 99, 99.9};
+  for (size_t i = 0; i < sizeof(ps) / sizeof(ps[0]); i++) {
+    double exact = ps[i] / 100 * 1000000;
+    double got = (double)histogram_percentile(h, ps[i]);
+    /* reported as the top of the bucket: never low, at most 1/32 high */
+    EXPECT_GE(got, exact);
+    EXPECT_LE(got, exact * (1 + 1.0 / 32));
+  }
+  EXPECT_EQ(histogram_percentile(h, 100), 1000000);
+  free(h);
+}
+
+TEST(Histogram, LargeValues) {
+  Histogram *h = make();
+  histogram_record(h, UINT64_MAX);
+  histogram_record(h, (uint64_t)1 << 63);
+  /* 2^63 falls in the first bucket of its power of two, 2^58 wide */
+  EXPECT_EQ(histogram_percentile(h, 50),
+            ((uint64_t)1 << 63) + ((uint64_t)1 << 58) - 1);
+  EXPECT_EQ(histogram_percentile(h, 100), UINT64_MAX);
+  free(h);
+}
+
+TEST(Histogram, RecordNAndMerge) {
+  Histogram *a = make();
+  Histogram *b = make();
+  histogram_record_n(a, 10, 90);
+  histogram_record_n(b, 1000, 10);
+  histogram_record_n(b, 5, 0);
+  histogram_merge(a, b);
+  EXPECT_EQ(a->count, 100);
+  EXPECT_EQ(a->min, 10);
+  EXPECT_EQ(a->max, 1000);
+  EXPECT_EQ(histogram_percentile(a, 90), 10);
+  EXPECT_GE(histogram_percentile(a, 91), 1000);
+  EXPECT_EQ(histogram_mean(a), 109);
+  free(a);
+  free(b);
+}
+
+CTEST_MAIN()
@@ -0,0 +1,89 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "io_threads.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct {
+  long value;
+  pthread_t worker;
+} Item;
+
+static pthread_t g_main_thread;
+static int g_ran_off_main = 0;
+
+static void square(void *arg) {
+  Item *item = arg;
+  item->value *= item->value;
+  item->worker = pthread_self();
+}
+
+static void **make_batch(Item *items, size_t n) {
+  void **batch = malloc(n * sizeof(void *));
+  for (size_t i = 0; i < n; i++) {
+    items[i].value = (long)i;
+    batch[i] = &items[i];
+  }
+  return batch;
+}
+
+TEST(IoThreads, Disabled) {
+  g_main_thread = pthread_self();
+  ASSERT_EQ(io_threads_init(1), REDIS_OK);
+  EXPECT_EQ(io_threads_num(), 1);
+
+  Item items[16];
+  void **batch = make_batch(items, 16);
+  io_threads_run(batch, 16, square);
+  for (int i = 0; i < 16; i++) {
+    EXPECT_EQ(items[i].value, (long)i * i);
+    EXPECT_TRUE(pthread_equal(items[i].worker, g_main_thread));
+  }
+
+  free(batch);
+  io_threads_shutdown();
+}
+
+TEST(IoThreads, EveryItemOnce) {
+  g_main_thread = pthread_self();
+  ASSERT_EQ(io_threads_init(4), REDIS_OK);
+  EXPECT_EQ(io_threads_num(), 4);
+
+  Item items[1000];
+  void **batch = make_batch(items, 1000);
+  for (int round = 0; round < 20; round++) {
+    for (int i = 0; i < 1000; i++) {
+      items[i].value = i;
+    }
+    io_threads_run(batch, 1000, square);
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_EQ(items[i].value, (long)i * i);
+      if (!pthread_equal(items[i].worker, g_main_thread)) {
+        g_ran_off_main = 1;
+      }
+    }
+  }
+  EXPECT_TRUE(g_ran_off_main);
+
+  // Small batches stay on the main thread
+  io_threads_run(batch, 3, square);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(pthread_equal(items[i].worker, g_main_thread));
+  }
+
+  // Parked workers wake up for the next large batch
+  io_threads_pause();
+  io_threads_run(batch + 3, 997, square);
+  EXPECT_EQ(items[999].value, 999L * 999 * 999 * 999);
+
+  free(batch);
+  io_threads_shutdown();
+  EXPECT_EQ(io_threads_num(), 1);
+}
+
+TEST(IoThreads, TooMany) {
+  EXPECT_EQ(io_threads_init(IO_THREADS_MAX + 1), REDIS_INVALID_ARGUMENT);
+}
+
+CTEST_MAIN()
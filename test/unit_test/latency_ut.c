@@ -0,0 +1,52 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "latency.h"
+
+TEST(Latency, Threshold) {
+  latency_set_threshold_ms(0);
+  EXPECT_FALSE(latency_monitored(1000000));
+  latency_set_threshold_ms(10);
+  EXPECT_FALSE(latency_monitored(9999));
+  EXPECT_TRUE(latency_monitored(10000));
+  latency_set_threshold_ms(0);
+}
+
+TEST(Latency, EventNames) {
+  LatencyEvent e;
+  ASSERT_TRUE(latency_event_by_name("FAST-COMMAND", &e));
+  EXPECT_EQ(e, LATENCY_FAST_COMMAND);
+  EXPECT_STR_EQ(latency_event_name(LATENCY_EXPIRE_CYCLE), "expire-cycle");
+  EXPECT_FALSE(latency_event_by_name("nope", &e));
+}
+
+TEST(Latency, SameSecondKeepsTheLargest) {
+  latency_reset(LATENCY_COMMAND);
+  latency_add_sample(LATENCY_COMMAND, 5000);
+  latency_add_sample(LATENCY_COMMAND, 20000);
+  latency_add_sample(LATENCY_COMMAND, 7000);
+
+  LatencySample samples[LATENCY_HISTORY_LEN];
+  size_t n = latency_history(LATENCY_COMMAND, samples);
+  /* the three samples may straddle a second boundary */
+  ASSERT_GE(n, 1);
+  ASSERT_LE(n, 2);
+  LatencySample latest;
+  uint32_t max_ms;
+  ASSERT_TRUE(latency_latest(LATENCY_COMMAND, &latest, &max_ms));
+  EXPECT_EQ(max_ms, 20);
+  EXPECT_EQ(latest.time, samples[n - 1].time);
+  EXPECT_EQ(latest.latency_ms, samples[n - 1].latency_ms);
+}
+
+TEST(Latency, Reset) {
+  latency_add_sample(LATENCY_FORK, 1000);
+  EXPECT_TRUE(latency_reset(LATENCY_FORK));
+  EXPECT_FALSE(latency_reset(LATENCY_FORK));
+  LatencySample latest;
+  uint32_t max_ms;
+  EXPECT_FALSE(latency_latest(LATENCY_FORK, &latest, &max_ms));
+  LatencySample samples[LATENCY_HISTORY_LEN];
+  EXPECT_EQ(latency_history(LATENCY_FORK, samples), 0);
+}
+
+CTEST_MAIN()
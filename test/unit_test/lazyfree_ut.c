@@ -0,0 +1,106 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "bio.h"
+#include "lazyfree.h"
+#include "data_structure/count_min_sketch.h"
+#include "data_structure/sorted_set.h"
+#include "util/mem.h"
+
+#include <stdio.h>
+
+static void free_object(void *val) { object_free((RedisObject *)val); }
+
+static RedisObject *make_zset(size_t members) {
+  SortedSet *zs = zset_create();
+  char member[32];
+  double newscore;
+  for (size_t i = 0; i < members; i++) {
+    int len = snprintf(member, sizeof(member), "member:%zu", i);
+    zset_add(zs, member, (size_t)len, (double)i, 0, &newscore);
+  }
+  return object_create(OBJ_ZSET, zs);
+}
+
+static RedisObject *make_cms(unsigned int width, unsigned int depth) {
+  CountMinSketch *cms = mem_malloc(sizeof(CountMinSketch));
+  cms_init_by_dim(cms, width, depth);
+  return object_create(OBJ_CMS, cms);
+}
+
+TEST(Lazyfree, Effort) {
+  RedisObject *s = object_create_string("value", 5);
+  RedisObject *small = make_zset(10);
+  RedisObject *large = make_zset(1000);
+  RedisObject *small_cms = make_cms(100, 4);
+  RedisObject *large_cms = make_cms(1 << 20, 4);
+
+  EXPECT_EQ(lazyfree_effort(s), 1);
+  EXPECT_EQ(lazyfree_effort(small), 10);
+  EXPECT_EQ(lazyfree_effort(large), 1000);
+  EXPECT_LE(lazyfree_effort(small_cms), LAZYFREE_THRESHOLD);
+  /* 16MB of counters */
+  EXPECT_GT(lazyfree_effort(large_cms), LAZYFREE_THRESHOLD);
+
+  object_free(s);
+  object_free(small);
+  object_free(large);
+  object_free(small_cms);
+  object_free(large_cms);
+}
+
+TEST(Lazyfree, SmallObjectFreedInline) {
+  ASSERT_EQ(bio_init(), REDIS_OK);
+  size_t before = mem_used();
+  size_t freed = lazyfree_freed_objects();
+  lazyfree_free_object(make_zset(10));
+  /* nothing queued: the memory is back before any drain */
+  EXPECT_EQ(mem_used(), before);
+  EXPECT_EQ(lazyfree_freed_objects(), freed);
+  lazyfree_free_object(NULL);
+  bio_shutdown();
+}
+
+TEST(Lazyfree, LargeObjectsFreedInBackground) {
+  ASSERT_EQ(bio_init(), REDIS_OK);
+  size_t before = mem_used();
+  size_t freed = lazyfree_freed_objects();
+  lazyfree_free_object(make_zset(100000));
+  lazyfree_free_object(make_cms(1 << 20, 4));
+  lazyfree_drain();
+  EXPECT_EQ(lazyfree_pending(), 0);
+  EXPECT_EQ(mem_used(), before);
+  EXPECT_EQ(lazyfree_freed_objects(), freed + 2);
+  bio_shutdown();
+}
+
+TEST(Lazyfree, Keyspace) {
+  ASSERT_EQ(bio_init(), REDIS_OK);
+  size_t before = mem_used();
+  size_t freed = lazyfree_freed_objects();
+  Dict *keyspace = dict_create(free_object);
+  Dict *expires = dict_create(NULL);
+  char key[32];
+  for (int i = 0; i < 1000; i++) {
+    int len = snprintf(key, sizeof(key), "key:%d", i);
+    dict_add(keyspace, key, (size_t)len, make_zset(3));
+    if (i % 2 == 0) {
+      DictEntry *e = dict_add_raw(expires, key, (size_t)len, NULL);
+      e->v.s64 = i;
+    }
+  }
+  lazyfree_free_keyspace(keyspace, expires);
+  lazyfree_drain();
+  EXPECT_EQ(mem_used(), before);
+  EXPECT_EQ(lazyfree_freed_objects(), freed + 1000);
+  bio_shutdown();
+}
+
+TEST(Lazyfree, WithoutThreads) {
+  /* before bio_init (or after shutdown) jobs run on the caller */
+  size_t before = mem_used();
+  lazyfree_free_object(make_zset(1000));
+  EXPECT_EQ(mem_used(), before);
+  lazyfree_free_keyspace(NULL, NULL);
+}
+
+CTEST_MAIN()
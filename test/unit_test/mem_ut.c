@@ -0,0 +1,60 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "util/mem.h"
+
+#include <stdint.h>
+#include <string.h>
+
+TEST(Mem, MallocFree) {
+  size_t before = mem_used();
+  char *p = mem_malloc(100);
+  ASSERT_NE(p, (char *)NULL);
+  /* counted at the usable size, which is at least what was asked for */
+  EXPECT_GE(mem_used() - before, 100);
+  mem_free(p);
+  EXPECT_EQ(mem_used(), before);
+  mem_free(NULL);
+  EXPECT_EQ(mem_used(), before);
+}
+
+TEST(Mem, Calloc) {
+  size_t before = mem_used();
+  unsigned char *p = mem_calloc(64, 4);
+  ASSERT_NE(p, (unsigned char *)NULL);
+  for (int i = 0; i < 256; i++) {
+    ASSERT_EQ(p[i], 0);
+  }
+  EXPECT_GE(mem_used() - before, 256);
+  mem_free(p);
+  EXPECT_EQ(mem_used(), before);
+}
+
+TEST(Mem, Realloc) {
+  size_t before = mem_used();
+  char *p = mem_realloc(NULL, 16);
+  ASSERT_NE(p, (char *)NULL);
+  memcpy(p, "0123456789abcdef", 16);
+
+  p = mem_realloc(p, 4096);
+  ASSERT_NE(p, (char *)NULL);
+  EXPECT_EQ(memcmp(p, "0123456789abcdef", 16), 0);
+  EXPECT_GE(mem_used() - before, 4096);
+
+  p = mem_realloc(p, 32);
+  ASSERT_NE(p, (char *)NULL);
+  EXPECT_LT(mem_used() - before, 4096);
+  mem_free(p);
+  EXPECT_EQ(mem_used(), before);
+}
+
+TEST(Mem, AlignedAlloc) {
+  size_t before = mem_used();
+  void *p = mem_aligned_alloc(64, 1024);
+  ASSERT_NE(p, (void *)NULL);
+  EXPECT_EQ((uintptr_t)p % 64, 0);
+  EXPECT_GE(mem_used() - before, 1024);
+  mem_free(p);
+  EXPECT_EQ(mem_used(), before);
+}
+
+CTEST_MAIN()
@@ -0,0 +1,37 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "util/monotonic.h"
+
+#include <time.h>
+
+static uint64_t elapsed_ns(uint64_t sleep_ns) {
+  struct timespec ts = {0, (long)sleep_ns};
+  uint64_t start = monotonic_now();
+  nanosleep(&ts, NULL);
+  return monotonic_ticks_to_ns(monotonic_now() - start);
+}
+
+TEST(Monotonic, PosixBeforeInit) {
+  EXPECT_EQ(g_monotonic_source, MONOTONIC_POSIX);
+  EXPECT_EQ(monotonic_ticks_to_ns(12345), 12345);
+}
+
+TEST(Monotonic, MeasuresSleep) {
+  monotonic_init();
+  uint64_t ns = elapsed_ns(20000000);
+  EXPECT_GE(ns, 19000000);
+  /* generous: the machine may be busy */
+  EXPECT_LT(ns, 500000000);
+  EXPECT_EQ(monotonic_ticks_to_ns(0), 0);
+}
+
+TEST(Monotonic, NeverGoesBack) {
+  uint64_t prev = monotonic_now();
+  for (int i = 0; i < 100000; i++) {
+    uint64_t now = monotonic_now();
+    ASSERT_GE(now, prev);
+    prev = now;
+  }
+}
+
+CTEST_MAIN()
@@ -0,0 +1,234 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "cmd_handler.h"
+#include "object.h"
+#include "redis-C/config.h"
+#include "serialize.h"
+#include "storage.h"
+#include "util/str_util.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The bytes of string object `o`, NUL-terminated */
+static const char *value(const RedisObject *o) {
+  static char buf[128];
+  char ibuf[STR_UTIL_LL_SIZE];
+  size_t len;
+  const char *s = object_string(o, &len, ibuf);
+  snprintf(buf, sizeof(buf), "%.*s", (int)len, s);
+  return buf;
+}
+
+static RedisObject *string(const char *s) {
+  return object_create_string(s, strlen(s));
+}
+
+/* Run a command through the command table; its reply is left in `out` */
+static void run(int argc, const char **argv, char *out, size_t size) {
+  static bool initialized = false;
+  if (!initialized) {
+    RedisCConfig *cfg = create_config(0);
+    cfg->save_params_len = 0;
+    set_config(cfg);
+    command_table_init();
+    init_storage();
+    initialized = true;
+  }
+  char *args[4];
+  size_t lens[4];
+  for (int i = 0; i < argc; i++) {
+    args[i] = strdup(argv[i]);
+    lens[i] = strlen(argv[i]);
+  }
+  ReplyBuffer reply;
+  reply_init(&reply, RESP_PROTO_2);
+  dispatch_command(argc, args, lens, &reply);
+  snprintf(out, size, "%.*s", (int)reply.len, reply.buf);
+  reply_free(&reply);
+  for (int i = 0; i < argc; i++) {
+    free(args[i]);
+  }
+}
+
+TEST(Object, EmbstrUpToItsMaxLength) {
+  char s[OBJ_EMBSTR_MAX_LEN + 2];
+  memset(s, 'a', sizeof(s));
+  s[sizeof(s) - 1] = '\0';
+
+  RedisObject *embstr = object_create_string(s, OBJ_EMBSTR_MAX_LEN);
+  ASSERT_NE(embstr, (RedisObject *)NULL);
+  EXPECT_EQ(embstr->type, OBJ_STRING);
+  EXPECT_EQ(embstr->encoding, OBJ_ENCODING_EMBSTR);
+  EXPECT_EQ(strlen(value(embstr)), OBJ_EMBSTR_MAX_LEN);
+  /* header, length byte, bytes and NUL: within a 64-byte allocation */
+  EXPECT_EQ(object_memory_usage(embstr),
+            sizeof(RedisObject) + 1 + OBJ_EMBSTR_MAX_LEN + 1);
+  EXPECT_LE(object_memory_usage(embstr), 64);
+
+  RedisObject *raw = object_create_string(s, OBJ_EMBSTR_MAX_LEN + 1);
+  ASSERT_NE(raw, (RedisObject *)NULL);
+  EXPECT_EQ(raw->encoding, OBJ_ENCODING_RAW);
+  EXPECT_STR_EQ(value(raw), s);
+  EXPECT_EQ(object_memory_usage(raw), sizeof(RedisObject) +
+                                          sizeof(StringBuffer) +
+                                          OBJ_EMBSTR_MAX_LEN + 2);
+  object_free(embstr);
+  object_free(raw);
+}
+
+TEST(Object, EmptyAndBinaryStrings) {
+  RedisObject *empty = object_create_string("", 0);
+  EXPECT_EQ(empty->encoding, OBJ_ENCODING_EMBSTR);
+  EXPECT_STR_EQ(value(empty), "");
+  object_free(empty);
+
+  RedisObject *binary = object_create_string("a\0b", 3);
+  size_t len;
+  const char *s = object_string(binary, &len, NULL);
+  EXPECT_EQ(len, 3);
+  EXPECT_EQ(memcmp(s, "a\0b", 3), 0);
+  object_free(binary);
+}
+
+TEST(Object, CanonicalIntegersOnly) {
+  static const char *ints[] = {"0", "1", "-1", "123", "9223372036854775807",
+                               "-9223372036854775808"};
+  for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+    RedisObject *o = string(ints[i]);
+    EXPECT_EQ(o->encoding, OBJ_ENCODING_INT);
+    EXPECT_EQ(object_memory_usage(o), sizeof(RedisObject));
+    /* GET returns the bytes that were SET */
+    EXPECT_STR_EQ(value(o), ints[i]);
+    object_free(o);
+  }
+
+  /* other spellings of a number keep their bytes */
+  static const char *strings[] = {"007", "-0", "+1", " 1", "1 ", "1.0",
+                                  "9223372036854775808"};
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+    RedisObject *o = string(strings[i]);
+    EXPECT_EQ(o->encoding, OBJ_ENCODING_EMBSTR);
+    EXPECT_STR_EQ(value(o), strings[i]);
+    object_free(o);
+  }
+}
+
+TEST(Object, NonCanonicalIntegersAreStillNumbers) {
+  int64_t v = -1;
+  RedisObject *o = string("-0");
+  EXPECT_TRUE(object_string_to_int(o, &v));
+  EXPECT_EQ(v, 0);
+  object_free(o);
+
+  /* leading zeros are not a number, as in Redis */
+  static const char *strings[] = {"007", "1.0", "+1", ""};
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+    o = string(strings[i]);
+    EXPECT_FALSE(object_string_to_int(o, &v));
+    object_free(o);
+  }
+
+  o = object_create_int(42);
+  EXPECT_TRUE(object_string_to_int(o, &v));
+  EXPECT_EQ(v, 42);
+  object_free(o);
+}
+
+TEST(Object, SetIntOnEveryEncoding) {
+  char long_string[OBJ_EMBSTR_MAX_LEN + 10];
+  memset(long_string, '1', sizeof(long_string) - 1);
+  long_string[sizeof(long_string) - 1] = '\0';
+  RedisObject *objs[] = {object_create_int(1), string("007"),
+                         string(long_string)};
+  EXPECT_EQ(objs[0]->encoding, OBJ_ENCODING_INT);
+  EXPECT_EQ(objs[1]->encoding, OBJ_ENCODING_EMBSTR);
+  EXPECT_EQ(objs[2]->encoding, OBJ_ENCODING_RAW);
+
+  for (size_t i = 0; i < 3; i++) {
+    objs[i]->lfu = 200;
+    uint32_t atime = objs[i]->atime;
+    object_set_int(objs[i], -(int64_t)i);
+    EXPECT_EQ(objs[i]->encoding, OBJ_ENCODING_INT);
+    EXPECT_EQ(objs[i]->ival, -(int64_t)i);
+    EXPECT_EQ(object_memory_usage(objs[i]), sizeof(RedisObject));
+    /* the access tracking of the key is kept */
+    EXPECT_EQ(objs[i]->lfu, 200);
+    EXPECT_EQ(objs[i]->atime, atime);
+    object_free(objs[i]);
+  }
+}
+
+TEST(Object, SetIntKeepsABufferAReplyHolds) {
+  char long_string[OBJ_EMBSTR_MAX_LEN + 10];
+  memset(long_string, 'x', sizeof(long_string) - 1);
+  long_string[sizeof(long_string) - 1] = '\0';
+  RedisObject *o = string(long_string);
+  StringBuffer *sb = object_string_retain(o);
+  object_set_int(o, 5);
+  EXPECT_STR_EQ(value(o), "5");
+  EXPECT_STR_EQ(sb->buf, long_string);
+  object_string_release(sb);
+  object_free(o);
+}
+
+TEST(Object, IncrOverflow) {
+  char reply[128];
+  run(3, (const char *[]){"SET", "n", "9223372036854775806"}, reply,
+      sizeof(reply));
+  run(2, (const char *[]){"INCR", "n"}, reply, sizeof(reply));
+  EXPECT_STR_EQ(reply, ":9223372036854775807\r\n");
+  run(2, (const char *[]){"INCR", "n"}, reply, sizeof(reply));
+  EXPECT_STR_EQ(reply, "-ERR increment or decrement would overflow\r\n");
+  run(3, (const char *[]){"INCRBY", "n", "-1"}, reply, sizeof(reply));
+  EXPECT_STR_EQ(reply, ":9223372036854775806\r\n");
+
+  run(3, (const char *[]){"SET", "m", "-9223372036854775808"}, reply,
+      sizeof(reply));
+  run(2, (const char *[]){"DECR", "m"}, reply, sizeof(reply));
+  EXPECT_STR_EQ(reply, "-ERR increment or decrement would overflow\r\n");
+  run(3, (const char *[]){"DECRBY", "n", "-9223372036854775808"}, reply,
+      sizeof(reply));
+  EXPECT_STR_EQ(reply, "-ERR increment or decrement would overflow\r\n");
+
+  /* a failed INCR leaves the value as it was */
+  run(2, (const char *[]){"GET", "m"}, reply, sizeof(reply));
+  EXPECT_STR_EQ(reply, "$20\r\n-9223372036854775808\r\n");
+}
+
+TEST(Object, IncrOfANonCanonicalInteger) {
+  char reply[128];
+  run(3, (const char *[]){"SET", "c", "-0"}, reply, sizeof(reply));
+  EXPECT_EQ(storage_lookup("c", 1)->encoding, OBJ_ENCODING_EMBSTR);
+  run(2, (const char *[]){"INCR", "c"}, reply, sizeof(reply));
+  EXPECT_STR_EQ(reply, ":1\r\n");
+  EXPECT_EQ(storage_lookup("c", 1)->encoding, OBJ_ENCODING_INT);
+  run(2, (const char *[]){"GET", "c"}, reply, sizeof(reply));
+  EXPECT_STR_EQ(reply, "$1\r\n1\r\n");
+
+  run(3, (const char *[]){"SET", "z", "007"}, reply, sizeof(reply));
+  run(2, (const char *[]){"INCR", "z"}, reply, sizeof(reply));
+  EXPECT_STR_EQ(reply, "-ERR value is not an integer or out of range\r\n");
+  run(2, (const char *[]){"GET", "z"}, reply, sizeof(reply));
+  EXPECT_STR_EQ(reply, "$3\r\n007\r\n");
+}
+
+TEST(Object, MemoryUsage) {
+  RedisObject *i = object_create_int(INT64_MAX);
+  RedisObject *e = string("hello");
+  EXPECT_EQ(object_memory_usage(i), sizeof(RedisObject));
+  EXPECT_EQ(object_memory_usage(e), sizeof(RedisObject) + 1 + 5 + 1);
+  object_free(i);
+  object_free(e);
+
+  char buf[1000];
+  memset(buf, 'z', sizeof(buf));
+  RedisObject *r = object_create_string(buf, sizeof(buf));
+  EXPECT_EQ(object_memory_usage(r),
+            sizeof(RedisObject) + sizeof(StringBuffer) + sizeof(buf) + 1);
+  object_free(r);
+}
+
+CTEST_MAIN()
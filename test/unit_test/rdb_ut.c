@@ -0,0 +1,168 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "cmd_handler.h"
+#include "object.h"
+#include "rdb.h"
+#include "redis-C/config.h"
+#include "storage.h"
+#include "util/monotonic.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static char g_path[64];
+static RedisCConfig *g_cfg = NULL;
+
+/* An empty keyspace, no save rule, snapshots to g_path */
+static void setup(void) {
+  if (!g_cfg) {
+    g_cfg = create_config(0);
+    set_config(g_cfg);
+    monotonic_init();
+    command_table_init();
+    init_storage();
+  }
+  snprintf(g_path, sizeof(g_path), "/tmp/rdb_ut.%d.rdb", (int)getpid());
+  g_cfg->dbfilename = g_path;
+  g_cfg->save_params_len = 0;
+  storage_clear();
+  unlink(g_path);
+  rdb_reset_save_clock();
+}
+
+static void save_rule(long long seconds, long long changes) {
+  g_cfg->save_params[0].seconds = seconds;
+  g_cfg->save_params[0].changes = changes;
+  g_cfg->save_params_len = 1;
+}
+
+/* `count` string keys */
+static void fill(size_t count) {
+  char key[32];
+  for (size_t i = 0; i < count; i++) {
+    int len = snprintf(key, sizeof(key), "key:%zu", i);
+    storage_set(key, (size_t)len, object_create_int((int64_t)i));
+  }
+}
+
+static bool exists(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0;
+}
+
+/* Reap the background save the way the server cron does */
+static void wait_bgsave(void) {
+  while (rdb_bgsave_in_progress()) {
+    rdb_cron();
+    usleep(1000);
+  }
+}
+
+TEST(Rdb, SaveRuleWaitsForItsChanges) {
+  setup();
+  fill(10);
+  save_rule(0, 3);
+  rdb_add_dirty(2);
+  rdb_cron();
+  EXPECT_FALSE(rdb_bgsave_in_progress());
+
+  rdb_add_dirty(1);
+  rdb_cron();
+  ASSERT_TRUE(rdb_bgsave_in_progress());
+  /* writes during the save count towards the next one */
+  rdb_add_dirty(5);
+  wait_bgsave();
+  EXPECT_TRUE(rdb_save_info()->last_bgsave_ok);
+  EXPECT_EQ(rdb_dirty(), 5);
+  EXPECT_TRUE(exists(g_path));
+
+  storage_clear();
+  size_t keys;
+  ASSERT_EQ(rdb_load(g_path, &keys), REDIS_OK);
+  EXPECT_EQ(keys, 10);
+  unlink(g_path);
+}
+
+TEST(Rdb, SaveRuleWaitsForItsSeconds) {
+  setup();
+  fill(10);
+  save_rule(1, 1);
+  long long lastsave = rdb_save_info()->lastsave;
+  rdb_add_dirty(100);
+  rdb_cron();
+  if (time(NULL) == lastsave) {
+    EXPECT_FALSE(rdb_bgsave_in_progress());
+  }
+
+  while (time(NULL) == lastsave) {
+    usleep(10000);
+  }
+  rdb_cron();
+  ASSERT_TRUE(rdb_bgsave_in_progress());
+  wait_bgsave();
+  EXPECT_TRUE(rdb_save_info()->last_bgsave_ok);
+  EXPECT_EQ(rdb_dirty(), 0);
+  EXPECT_GT(rdb_save_info()->lastsave, lastsave);
+  EXPECT_TRUE(exists(g_path));
+  unlink(g_path);
+}
+
+TEST(Rdb, FailedChildKeepsTheChangesAndBacksOff) {
+  setup();
+  fill(10);
+  /* the snapshot cannot be renamed over a directory that is not empty */
+  char file[96];
+  mkdir(g_path, 0755);
+  snprintf(file, sizeof(file), "%s/file", g_path);
+  FILE *f = fopen(file, "w");
+  ASSERT_NE(f, (FILE *)NULL);
+  fclose(f);
+
+  save_rule(0, 1);
+  long long lastsave = rdb_save_info()->lastsave;
+  rdb_add_dirty(3);
+  rdb_cron();
+  ASSERT_TRUE(rdb_bgsave_in_progress());
+  pid_t pid = rdb_save_info()->child_pid;
+  wait_bgsave();
+  EXPECT_FALSE(rdb_save_info()->last_bgsave_ok);
+  EXPECT_EQ(rdb_dirty(), 3);
+  EXPECT_EQ(rdb_save_info()->lastsave, lastsave);
+  char tmp[96];
+  snprintf(tmp, sizeof(tmp), "%s.tmp-%d", g_path, (int)pid);
+  EXPECT_FALSE(exists(tmp));
+
+  /* the rule is still met, but a failing disk is not retried every tick */
+  rdb_cron();
+  EXPECT_FALSE(rdb_bgsave_in_progress());
+
+  unlink(file);
+  rmdir(g_path);
+}
+
+TEST(Rdb, KilledChildLeavesNoTempFile) {
+  setup();
+  /* enough keys for the child to still be writing when it is killed */
+  fill(500000);
+  ASSERT_EQ(rdb_bgsave(g_path), REDIS_OK);
+  pid_t pid = rdb_save_info()->child_pid;
+  char tmp[96];
+  snprintf(tmp, sizeof(tmp), "%s.tmp-%d", g_path, (int)pid);
+  for (int i = 0; i < 100000 && !exists(tmp); i++) {
+    usleep(10);
+  }
+  ASSERT_TRUE(exists(tmp));
+  kill(pid, SIGKILL);
+
+  wait_bgsave();
+  EXPECT_FALSE(rdb_save_info()->last_bgsave_ok);
+  EXPECT_FALSE(exists(tmp));
+  EXPECT_FALSE(exists(g_path));
+  storage_clear();
+}
+
+CTEST_MAIN()
@@ -0,0 +1,285 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "serialize.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ===== Request Parser =====
+
+TEST(Serialize, ParseMultibulk) {
+  RespParser p;
+  resp_parser_init(&p);
+  char buf[] = "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n";
+
+  EXPECT_EQ(resp_parse(&p, buf, strlen(buf)), RESP_OK);
+  EXPECT_EQ(p.argc, 3);
+  EXPECT_STR_EQ(p.argv[0], "SET");
+  EXPECT_STR_EQ(p.argv[1], "key");
+  EXPECT_STR_EQ(p.argv[2], "value");
+  EXPECT_EQ(p.arg_len[2], 5);
+  EXPECT_EQ(p.pos, sizeof(buf) - 1);
+
+  resp_parser_free(&p);
+}
+
+TEST(Serialize, ParseInline) {
+  RespParser p;
+  resp_parser_init(&p);
+  char buf[] = "  CMS.INITBYDIM  sketch 100 5\r\n";
+
+  EXPECT_EQ(resp_parse(&p, buf, strlen(buf)), RESP_OK);
+  EXPECT_EQ(p.argc, 4);
+  EXPECT_STR_EQ(p.argv[0], "CMS.INITBYDIM");
+  EXPECT_STR_EQ(p.argv[1], "sketch");
+  EXPECT_STR_EQ(p.argv[3], "5");
+  EXPECT_EQ(p.pos, sizeof(buf) - 1);
+
+  // LF only, as sent by a line-based client
+  char lf[] = "PING\n";
+  resp_parser_reset(&p);
+  EXPECT_EQ(resp_parse(&p, lf, strlen(lf)), RESP_OK);
+  EXPECT_EQ(p.argc, 1);
+  EXPECT_STR_EQ(p.argv[0], "PING");
+
+  resp_parser_free(&p);
+}
+
+TEST(Serialize, ParseIncremental) {
+  RespParser p;
+  resp_parser_init(&p);
+  const char *full = "*2\r\n$4\r\nECHO\r\n$11\r\nhello world\r\n";
+  size_t total = strlen(full);
+  char buf[64];
+
+  // Feed one byte at a time; only the last byte completes the request
+  for (size_t n = 1; n < total; n++) {
+    memcpy(buf, full, n);
+    EXPECT_EQ(resp_parse(&p, buf, n), RESP_INCOMPLETE);
+  }
+  memcpy(buf, full, total);
+  EXPECT_EQ(resp_parse(&p, buf, total), RESP_OK);
+  EXPECT_EQ(p.argc, 2);
+  EXPECT_STR_EQ(p.argv[1], "hello world");
+  EXPECT_EQ(p.pos, total);
+
+  resp_parser_free(&p);
+}
+
+TEST(Serialize, ParsePipeline) {
+  RespParser p;
+  resp_parser_init(&p);
+  char buf[] = "*1\r\n$4\r\nPING\r\nPING\r\n*2\r\n$4\r\nPING\r\n$2\r\nhi\r\n";
+  size_t len = strlen(buf);
+  size_t off = 0;
+  int commands = 0;
+
+  while (off < len) {
+    EXPECT_EQ(resp_parse(&p, buf + off, len - off), RESP_OK);
+    EXPECT_STR_EQ(p.argv[0], "PING");
+    off += p.pos;
+    commands++;
+    resp_parser_reset(&p);
+  }
+  EXPECT_EQ(commands, 3);
+
+  resp_parser_free(&p);
+}
+
+TEST(Serialize, ParseManyArguments) {
+  RespParser p;
+  resp_parser_init(&p);
+  // No fixed cap on the number of arguments
+  const int n = 200;
+  char *buf = malloc(n * 16 + 16);
+  size_t len = sprintf(buf, "*%d\r\n", n);
+  for (int i = 0; i < n; i++) {
+    len += sprintf(buf + len, "$1\r\n%c\r\n", 'a' + (i % 26));
+  }
+
+  EXPECT_EQ(resp_parse(&p, buf, len), RESP_OK);
+  EXPECT_EQ(p.argc, n);
+  EXPECT_STR_EQ(p.argv[n - 1], "r");
+
+  free(buf);
+  resp_parser_free(&p);
+}
+
+TEST(Serialize, ParseBinarySafe) {
+  RespParser p;
+  resp_parser_init(&p);
+  char buf[] = "*1\r\n$5\r\na\r\nbc\r\n";
+
+  EXPECT_EQ(resp_parse(&p, buf, sizeof(buf) - 1), RESP_OK);
+  EXPECT_EQ(p.argc, 1);
+  EXPECT_EQ(p.arg_len[0], 5);
+  EXPECT_EQ(memcmp(p.argv[0], "a\r\nbc", 5), 0);
+
+  resp_parser_free(&p);
+}
+
+TEST(Serialize, ParseErrors) {
+  RespParser p;
+  resp_parser_init(&p);
+
+  char bad_count[] = "*x\r\n";
+  EXPECT_EQ(resp_parse(&p, bad_count, strlen(bad_count)), RESP_ERROR);
+
+  resp_parser_reset(&p);
+  char bad_type[] = "*1\r\n+PING\r\n";
+  EXPECT_EQ(resp_parse(&p, bad_type, strlen(bad_type)), RESP_ERROR);
+
+  resp_parser_reset(&p);
+  char bad_crlf[] = "*1\r\n$2\r\nabc\r\n";
+  EXPECT_EQ(resp_parse(&p, bad_crlf, strlen(bad_crlf)), RESP_ERROR);
+  EXPECT_NE(p.error, NULL);
+
+  resp_parser_reset(&p);
+  char empty[] = "*0\r\n";
+  EXPECT_EQ(resp_parse(&p, empty, strlen(empty)), RESP_OK);
+  EXPECT_EQ(p.argc, 0);
+
+  resp_parser_free(&p);
+}
+
+// ===== Reply Encoder =====
+
+TEST(Serialize, ReplyRESP2) {
+  ReplyBuffer r;
+  reply_init(&r, RESP_PROTO_2);
+
+  reply_add_ok(&r);
+  reply_add_error(&r, "ERR bad\nthing");
+  reply_add_integer(&r, -42);
+  reply_add_bulk(&r, "abc", 3);
+  reply_add_null(&r);
+  reply_add_array_len(&r, 2);
+  reply_add_map_len(&r, 1);
+  reply_add_double(&r, 1.5);
+  reply_add_bool(&r, true);
+
+  const char *expected = "+OK\r\n-ERR bad thing\r\n:-42\r\n$3\r\nabc\r\n"
+                         "$-1\r\n*2\r\n*2\r\n$3\r\n1.5\r\n:1\r\n";
+  EXPECT_EQ(r.len, strlen(expected));
+  EXPECT_EQ(memcmp(r.buf, expected, r.len), 0);
+
+  reply_free(&r);
+}
+
+TEST(Serialize, ReplyRESP3) {
+  ReplyBuffer r;
+  reply_init(&r, RESP_PROTO_3);
+
+  reply_add_null(&r);
+  reply_add_map_len(&r, 1);
+  reply_add_double(&r, 1.5);
+  reply_add_bool(&r, false);
+
+  const char *expected = "_\r\n%1\r\n,1.5\r\n#f\r\n";
+  EXPECT_EQ(r.len, strlen(expected));
+  EXPECT_EQ(memcmp(r.buf, expected, r.len), 0);
+
+  size_t len = 0;
+  char *detached = reply_detach(&r, &len);
+  EXPECT_EQ(len, strlen(expected));
+  EXPECT_EQ(r.buf, NULL);
+  free(detached);
+}
+
+static int g_released = 0;
+
+static void count_release(void *owner) {
+  (void)owner;
+  g_released++;
+}
+
+/* What reply_iov() would put on the wire from offset `from`, into `out` */
+static size_t gather(const ReplyBuffer *r, size_t from, char *out) {
+  struct iovec iov[2];
+  size_t n = 0;
+  int cnt;
+  /* two iovecs at a time, so the resume path is exercised as well */
+  while ((cnt = reply_iov(r, from + n, iov, 2)) > 0) {
+    for (int i = 0; i < cnt; i++) {
+      memcpy(out + n, iov[i].iov_base, iov[i].iov_len);
+      n += iov[i].iov_len;
+    }
+  }
+  return n;
+}
+
+TEST(Serialize, ReplyRefs) {
+  ReplyBuffer r;
+  reply_init(&r, RESP_PROTO_2);
+  reply_allow_refs(&r);
+  g_released = 0;
+
+  size_t big = REPLY_REF_MIN_LEN + 10;
+  char *value = malloc(big);
+  memset(value, 'v', big);
+  char header[32];
+  int header_len = snprintf(header, sizeof(header), "$%zu\r\n", big);
+
+  reply_add_ok(&r);
+  EXPECT_TRUE(reply_wants_ref(&r, big));
+  reply_add_bulk_ref(&r, value, big, count_release, NULL);
+  reply_add_integer(&r, 7);
+  reply_add_bulk_ref(&r, value, big, count_release, NULL);
+  /* short payloads are copied and released right away */
+  EXPECT_FALSE(reply_wants_ref(&r, 3));
+  reply_add_bulk_ref(&r, "abc", 3, count_release, NULL);
+  EXPECT_EQ(g_released, 1);
+  EXPECT_EQ(r.nrefs, 2);
+  EXPECT_EQ(reply_length(&r), r.len + 2 * big);
+
+  char *expected = malloc(reply_length(&r));
+  size_t n = 0;
+  memcpy(expected + n, "+OK\r\n", 5);
+  n += 5;
+  for (int i = 0; i < 2; i++) {
+    memcpy(expected + n, header, (size_t)header_len);
+    n += (size_t)header_len;
+    memcpy(expected + n, value, big);
+    n += big;
+    memcpy(expected + n, i == 0 ? "\r\n:7\r\n" : "\r\n", i == 0 ? 6 : 2);
+    n += i == 0 ? 6 : 2;
+  }
+  memcpy(expected + n, "$3\r\nabc\r\n", 9);
+  n += 9;
+  ASSERT_EQ(n, reply_length(&r));
+
+  char *wire = malloc(n);
+  EXPECT_EQ(gather(&r, 0, wire), n);
+  EXPECT_EQ(memcmp(wire, expected, n), 0);
+  /* resuming mid-buffer and mid-reference */
+  for (size_t from = 1; from < n; from += 4099) {
+    EXPECT_EQ(gather(&r, from, wire), n - from);
+    EXPECT_EQ(memcmp(wire, expected + from, n - from), 0);
+  }
+  EXPECT_EQ(reply_iov(&r, n, NULL, 0), 0);
+
+  reply_clear(&r);
+  EXPECT_EQ(g_released, 3);
+  EXPECT_EQ(reply_length(&r), 0);
+
+  /* without reply_allow_refs() nothing is referenced */
+  ReplyBuffer plain;
+  reply_init(&plain, RESP_PROTO_2);
+  EXPECT_FALSE(reply_wants_ref(&plain, big));
+  reply_add_bulk_ref(&plain, value, big, count_release, NULL);
+  EXPECT_EQ(g_released, 4);
+  EXPECT_EQ(plain.nrefs, 0);
+  EXPECT_EQ(plain.len, (size_t)header_len + big + 2);
+  reply_free(&plain);
+
+  reply_add_bulk_ref(&r, value, big, count_release, NULL);
+  reply_free(&r);
+  EXPECT_EQ(g_released, 5);
+
+  free(wire);
+  free(expected);
+  free(value);
+}
+
+CTEST_MAIN()
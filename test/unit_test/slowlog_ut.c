@@ -0,0 +1,98 @@
+#define _GNU_SOURCE /* memmem */
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "serialize.h"
+#include "slowlog.h"
+
+#include <string.h>
+
+static bool reply_contains(const ReplyBuffer *r, const char *s) {
+  return memmem(r->buf, r->len, s, strlen(s)) != NULL;
+}
+
+static void push(int argc, char **argv, uint64_t us) {
+  size_t argv_len[64];
+  for (int i = 0; i < argc; i++) {
+    argv_len[i] = strlen(argv[i]);
+  }
+  slowlog_push(argc, argv, argv_len, us, "127.0.0.1:6379");
+}
+
+TEST(Slowlog, Threshold) {
+  slowlog_init(-1, 4);
+  EXPECT_FALSE(slowlog_wanted(1000000));
+  slowlog_init(0, 4);
+  EXPECT_TRUE(slowlog_wanted(0));
+  slowlog_init(1000, 4);
+  EXPECT_FALSE(slowlog_wanted(999));
+  EXPECT_TRUE(slowlog_wanted(1000));
+}
+
+TEST(Slowlog, KeepsTheNewest) {
+  slowlog_init(0, 2);
+  char *first[] = {"GET", "first"};
+  char *second[] = {"GET", "second"};
+  char *third[] = {"GEOSEARCH", "third"};
+  push(2, first, 10);
+  push(2, second, 20);
+  push(2, third, 30);
+  EXPECT_EQ(slowlog_len(), 2);
+
+  ReplyBuffer r;
+  reply_init(&r, RESP_PROTO_2);
+  slowlog_reply_entries(&r, 1);
+  EXPECT_TRUE(reply_contains(&r, "*1\r\n*6\r\n"));
+  EXPECT_TRUE(reply_contains(&r, ":30\r\n*2\r\n$9\r\nGEOSEARCH\r\n$5\r\nthird\r\n"
+                                 "$14\r\n127.0.0.1:6379\r\n$0\r\n\r\n"));
+  reply_clear(&r);
+  slowlog_reply_entries(&r, -1);
+  EXPECT_TRUE(reply_contains(&r, "*2\r\n"));
+  EXPECT_TRUE(reply_contains(&r, "second"));
+  EXPECT_FALSE(reply_contains(&r, "first"));
+  reply_free(&r);
+}
+
+TEST(Slowlog, Truncates) {
+  slowlog_init(0, 4);
+  char big[201];
+  memset(big, 'x', 200);
+  big[200] = '\0';
+  char *argv[40];
+  argv[0] = "MSET";
+  for (int i = 1; i < 40; i++) {
+    argv[i] = big;
+  }
+  push(40, argv, 10);
+
+  ReplyBuffer r;
+  reply_init(&r, RESP_PROTO_2);
+  slowlog_reply_entries(&r, -1);
+  EXPECT_TRUE(reply_contains(&r, "*32\r\n$4\r\nMSET\r\n"));
+  EXPECT_TRUE(reply_contains(&r, "xxx... (72 more bytes)\r\n"));
+  EXPECT_TRUE(reply_contains(&r, "$22\r\n... (9 more arguments)\r\n"));
+  reply_free(&r);
+}
+
+TEST(Slowlog, Reset) {
+  slowlog_init(0, 4);
+  char *argv[] = {"PING"};
+  push(1, argv, 10);
+  EXPECT_EQ(slowlog_len(), 1);
+  slowlog_reset();
+  EXPECT_EQ(slowlog_len(), 0);
+
+  ReplyBuffer r;
+  reply_init(&r, RESP_PROTO_2);
+  slowlog_reply_entries(&r, 10);
+  EXPECT_EQ(r.len, 4);
+  reply_free(&r);
+}
+
+TEST(Slowlog, Disabled) {
+  slowlog_init(0, 0);
+  char *argv[] = {"PING"};
+  push(1, argv, 10);
+  EXPECT_EQ(slowlog_len(), 0);
+}
+
+CTEST_MAIN()
@@ -0,0 +1,187 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "object.h"
+#include "redis-C/config.h"
+#include "storage.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Every key the expired hook was called with, in order */
+static char g_expired[8][16];
+static size_t g_expired_count = 0;
+
+static void record_expired(const char *key, size_t len) {
+  if (g_expired_count < 8) {
+    snprintf(g_expired[g_expired_count], sizeof(g_expired[0]), "%.*s",
+             (int)len, key);
+  }
+  g_expired_count++;
+}
+
+/* An empty keyspace with the default config and no expired hook */
+static void setup(void) {
+  static bool initialized = false;
+  if (!initialized) {
+    set_config(create_config(0));
+    init_storage();
+    initialized = true;
+  }
+  storage_clear();
+  storage_set_expired_hook(NULL);
+  g_expired_count = 0;
+}
+
+static void set(const char *key, const char *value) {
+  storage_set(key, strlen(key), object_create_string(value, strlen(value)));
+}
+
+/* `count` keys named <prefix><i>, each expiring at `when_ms` */
+static void set_volatile(const char *prefix, size_t count, long long when_ms) {
+  char key[32];
+  for (size_t i = 0; i < count; i++) {
+    int len = snprintf(key, sizeof(key), "%s%zu", prefix, i);
+    storage_set(key, (size_t)len, object_create_int((int64_t)i));
+    storage_set_expire(key, (size_t)len, when_ms);
+  }
+}
+
+TEST(Storage, LookupExpiresAKeyPastItsTtl) {
+  setup();
+  storage_set_expired_hook(record_expired);
+  set("k", "v");
+  set("live", "v");
+  ASSERT_EQ(storage_set_expire("k", 1, storage_mstime() - 1), REDIS_OK);
+  ASSERT_EQ(storage_set_expire("live", 4, storage_mstime() + 100000),
+            REDIS_OK);
+  EXPECT_EQ(storage_size(), 2);
+
+  EXPECT_EQ(storage_lookup("k", 1), (RedisObject *)NULL);
+  EXPECT_NE(storage_lookup("live", 4), (RedisObject *)NULL);
+  EXPECT_EQ(storage_size(), 1);
+  EXPECT_EQ(storage_expires_size(), 1);
+  EXPECT_EQ(storage_get_expire("k", 1), -1);
+  ASSERT_EQ(g_expired_count, 1);
+  EXPECT_STR_EQ(g_expired[0], "k");
+}
+
+TEST(Storage, DeleteOfAnExpiredKeyFindsNothing) {
+  setup();
+  set("k", "v");
+  storage_set_expire("k", 1, storage_mstime() - 1);
+  EXPECT_FALSE(storage_delete("k", 1));
+  EXPECT_EQ(storage_size(), 0);
+  EXPECT_EQ(storage_expires_size(), 0);
+}
+
+TEST(Storage, LoadingKeepsExpiredKeys) {
+  setup();
+  storage_set_expired_hook(record_expired);
+  set("k", "v");
+  storage_set_expire("k", 1, storage_mstime() - 1);
+  set_volatile("v", 100, storage_mstime() - 1);
+
+  storage_set_loading(true);
+  EXPECT_TRUE(storage_loading());
+  EXPECT_NE(storage_lookup("k", 1), (RedisObject *)NULL);
+  EXPECT_EQ(storage_active_expire(1000000), 0);
+  EXPECT_EQ(storage_size(), 101);
+  storage_set_loading(false);
+
+  EXPECT_EQ(storage_lookup("k", 1), (RedisObject *)NULL);
+  EXPECT_EQ(g_expired_count, 1);
+}
+
+TEST(Storage, ActiveExpireRepeatsWhileMostOfTheSampleExpired) {
+  setup();
+  storage_set_expired_hook(record_expired);
+  set_volatile("dead", 1000, storage_mstime() - 1);
+  set_volatile("live", 10, storage_mstime() + 100000);
+
+  /* more than one sample in a single call */
+  size_t deleted = storage_active_expire(1000000);
+  EXPECT_GT(deleted, STORAGE_EXPIRE_SAMPLE);
+  EXPECT_EQ(storage_size(), 1010 - deleted);
+  EXPECT_EQ(g_expired_count, deleted);
+
+  /* the calls that follow sweep the rest of the table */
+  for (int i = 0; i < 1000 && storage_size() > 10; i++) {
+    deleted += storage_active_expire(1000000);
+  }
+  EXPECT_EQ(deleted, 1000);
+  EXPECT_EQ(storage_size(), 10);
+  EXPECT_EQ(storage_expires_size(), 10);
+  EXPECT_EQ(g_expired_count, 1000);
+  EXPECT_NE(storage_lookup("live0", 5), (RedisObject *)NULL);
+}
+
+TEST(Storage, ActiveExpireStopsOnAMostlyLiveSample) {
+  setup();
+  set_volatile("live", 1000, storage_mstime() + 100000);
+  set_volatile("dead", 5, storage_mstime() - 1);
+
+  /* at most 5 of a sample can have expired: one round */
+  size_t deleted = storage_active_expire(1000000);
+  EXPECT_LE(deleted, 5);
+  EXPECT_EQ(storage_size(), 1005 - deleted);
+}
+
+TEST(Storage, ActiveExpireKeepsToItsBudget) {
+  setup();
+  set_volatile("dead", 1000, storage_mstime() - 1);
+
+  /* a budget that is spent after the first sample */
+  size_t deleted = storage_active_expire(0);
+  EXPECT_GT(deleted, 0);
+  EXPECT_LE(deleted, STORAGE_EXPIRE_SAMPLE);
+  EXPECT_EQ(storage_size(), 1000 - deleted);
+}
+
+TEST(Storage, ActiveExpireWithoutVolatileKeys) {
+  setup();
+  set("k", "v");
+  EXPECT_EQ(storage_active_expire(1000000), 0);
+  EXPECT_EQ(storage_size(), 1);
+}
+
+TEST(Storage, Persist) {
+  setup();
+  set("k", "v");
+  EXPECT_FALSE(storage_persist("k", 1));
+  storage_set_expire("k", 1, storage_mstime() + 100000);
+  EXPECT_EQ(storage_expires_size(), 1);
+  EXPECT_TRUE(storage_persist("k", 1));
+  EXPECT_EQ(storage_get_expire("k", 1), -1);
+  EXPECT_EQ(storage_expires_size(), 0);
+  EXPECT_FALSE(storage_persist("k", 1));
+  EXPECT_FALSE(storage_persist("missing", 7));
+}
+
+TEST(Storage, SetExpireOnAMissingKey) {
+  setup();
+  EXPECT_EQ(storage_set_expire("k", 1, storage_mstime() + 100000),
+            REDIS_KEY_NOT_FOUND);
+  EXPECT_EQ(storage_expires_size(), 0);
+}
+
+TEST(Storage, SetClearsTheTtl) {
+  setup();
+  set("k", "v");
+  long long when_ms = storage_mstime() + 100000;
+  storage_set_expire("k", 1, when_ms);
+  EXPECT_EQ(storage_get_expire("k", 1), when_ms);
+
+  set("k", "w");
+  EXPECT_EQ(storage_get_expire("k", 1), -1);
+  EXPECT_EQ(storage_expires_size(), 0);
+  EXPECT_EQ(storage_size(), 1);
+
+  /* storing the object the key already holds clears it too */
+  storage_set_expire("k", 1, when_ms);
+  RedisObject *obj = storage_lookup("k", 1);
+  storage_set("k", 1, obj);
+  EXPECT_EQ(storage_get_expire("k", 1), -1);
+  EXPECT_EQ(storage_lookup("k", 1), obj);
+}
+
+CTEST_MAIN()
@@ -0,0 +1,94 @@
+#define CTEST_IMPLEMENTATION
+#include "ctest.h"
+#include "util/str_util.h"
+
+#include <limits.h>
+#include <string.h>
+
+static bool ll(const char *s, long long *v) {
+  return string_to_ll(s, strlen(s), v);
+}
+
+static bool dbl(const char *s, double *v) {
+  return string_to_double(s, strlen(s), v);
+}
+
+TEST(StrUtil, LongLong) {
+  long long v;
+  EXPECT_TRUE(ll("0", &v));
+  EXPECT_EQ(v, 0);
+  EXPECT_TRUE(ll("12345", &v));
+  EXPECT_EQ(v, 12345);
+  EXPECT_TRUE(ll("-42", &v));
+  EXPECT_EQ(v, -42);
+  EXPECT_TRUE(ll("9223372036854775807", &v));
+  EXPECT_EQ(v, LLONG_MAX);
+  EXPECT_TRUE(ll("-9223372036854775808", &v));
+  EXPECT_EQ(v, LLONG_MIN);
+}
+
+TEST(StrUtil, LongLongRejects) {
+  long long v;
+  EXPECT_FALSE(ll("", &v));
+  EXPECT_FALSE(ll("-", &v));
+  EXPECT_FALSE(ll("01", &v));
+  EXPECT_FALSE(ll(" 1", &v));
+  EXPECT_FALSE(ll("1 ", &v));
+  EXPECT_FALSE(ll("+1", &v));
+  EXPECT_FALSE(ll("1.5", &v));
+  EXPECT_FALSE(ll("abc", &v));
+  EXPECT_FALSE(ll("9223372036854775808", &v));
+  EXPECT_FALSE(ll("-9223372036854775809", &v));
+  EXPECT_FALSE(string_to_ll("12\0" "3", 4, &v));
+}
+
+TEST(StrUtil, UnsignedLongLong) {
+  unsigned long long v;
+  EXPECT_TRUE(string_to_ull("18446744073709551615", 20, &v));
+  EXPECT_EQ(v, ULLONG_MAX);
+  EXPECT_FALSE(string_to_ull("18446744073709551616", 20, &v));
+  EXPECT_FALSE(string_to_ull("-1", 2, &v));
+}
+
+TEST(StrUtil, Double) {
+  double v;
+  EXPECT_TRUE(dbl("1.5", &v));
+  EXPECT_NEAR(v, 1.5, 1e-12);
+  EXPECT_TRUE(dbl("-0.001", &v));
+  EXPECT_NEAR(v, -0.001, 1e-12);
+  EXPECT_TRUE(dbl("1e3", &v));
+  EXPECT_NEAR(v, 1000.0, 1e-12);
+  EXPECT_TRUE(dbl("inf", &v));
+
+  EXPECT_FALSE(dbl("", &v));
+  EXPECT_FALSE(dbl(" 1", &v));
+  EXPECT_FALSE(dbl("1.5x", &v));
+  EXPECT_FALSE(dbl("nan", &v));
+  EXPECT_FALSE(dbl("1e999", &v));
+}
+
+TEST(StrUtil, FromLongLong) {
+  char buf[STR_UTIL_LL_SIZE];
+  const long long values[] = {0, 7, -7, 1234567890, LLONG_MAX, LLONG_MIN};
+  const char *expected[] = {"0", "7", "-7", "1234567890",
+                            "9223372036854775807", "-9223372036854775808"};
+  for (int i = 0; i < 6; i++) {
+    size_t len = string_from_ll(buf, values[i]);
+    EXPECT_EQ(len, strlen(expected[i]));
+    EXPECT_EQ(strcmp(buf, expected[i]), 0);
+    long long back;
+    EXPECT_TRUE(string_to_ll(buf, len, &back));
+    EXPECT_EQ(back, values[i]);
+  }
+}
+
+TEST(StrUtil, RandomHex) {
+  char a[41] = {0}, b[41] = {0};
+  string_random_hex(a, 40);
+  string_random_hex(b, 40);
+  EXPECT_EQ(strlen(a), 40u);
+  EXPECT_EQ(strspn(a, "0123456789abcdef"), 40u);
+  EXPECT_NE(strcmp(a, b), 0);
+}
+
+CTEST_MAIN()